@@ -31,7 +31,9 @@
 #include "sysemu/kvm_int.h"
 #include "sysemu/runstate.h"
 #include "sysemu/cpus.h"
+#include "sysemu/dirtylimit.h"
 #include "qemu/bswap.h"
+#include "qemu/range.h"
 #include "exec/memory.h"
 #include "exec/ram_addr.h"
 #include "qemu/event_notifier.h"
@@ -100,8 +102,19 @@ struct KVMDirtyRingReaper {
     QemuThread reaper_thr;
     volatile uint64_t reaper_iteration; /* iteration number of reaper thr */
     volatile enum KVMDirtyRingReaperState reaper_state; /* reap thr state */
+    /* Most entries found in one ring by the last reap of all rings */
+    uint32_t max_fill;
 };
 
+/*
+ * The reaper sleeps between 10ms and 1s, shorter while rings are filling up
+ * quickly.  A vCPU reaps its own ring when it leaves KVM_RUN with the ring
+ * at least 3/4 full, before the ring-full exit makes it wait.
+ */
+#define KVM_DIRTY_RING_REAPER_MIN_MS    10
+#define KVM_DIRTY_RING_REAPER_MAX_MS    1000
+#define KVM_DIRTY_RING_VCPU_REAP(size)  ((size) / 4 * 3)
+
 struct KVMState
 {
     AccelState parent_obj;
@@ -153,6 +166,8 @@ struct KVMState
     uint64_t kvm_dirty_ring_bytes;  /* Size of the per-vcpu dirty ring */
     uint32_t kvm_dirty_ring_size;   /* Number of dirty GFNs per ring */
     struct KVMDirtyRingReaper reaper;
+    bool halt_poll_ns_set;          /* false to keep the host's default */
+    uint32_t halt_poll_ns;          /* Maximum halt polling time */
 };
 
 KVMState *kvm_state;
@@ -203,6 +218,13 @@ static QLIST_HEAD(, KVMResampleFd) kvm_resample_fd_list =
 
 static QemuMutex kml_slots_lock;
 
+/* VM ioctls issued without the BQL, see kvm_ioctl_inhibit_begin() */
+static QemuLockCnt kvm_in_ioctl_lock;
+static QemuEvent kvm_in_ioctl_event;
+
+/* Protected by kml_slots_lock */
+static KVMDirtyRingPageHook kvm_dirty_ring_page_hook;
+
 #define kvm_slots_lock()    qemu_mutex_lock(&kml_slots_lock)
 #define kvm_slots_unlock()  qemu_mutex_unlock(&kml_slots_lock)
 
@@ -423,6 +445,9 @@ static int do_kvm_destroy_vcpu(CPUState *cpu)
         }
     }
 
+    g_free(cpu->kvm_mmio_cache);
+    cpu->kvm_mmio_cache = NULL;
+
     vcpu = g_malloc0(sizeof(*vcpu));
     vcpu->vcpu_id = kvm_arch_vcpu_id(cpu);
     vcpu->kvm_fd = cpu->kvm_fd;
@@ -513,6 +538,8 @@ int kvm_init_vcpu(CPUState *cpu, Error **errp)
         }
     }
 
+    cpu->kvm_mmio_cache = g_new0(AddressSpaceSectionCache, 1);
+
     ret = kvm_arch_init_vcpu(cpu);
     if (ret < 0) {
         error_setg_errno(errp, -ret,
@@ -712,16 +739,36 @@ static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
     }
 
     set_bit(offset, mem->dirty_bmap);
+
+    if (kvm_dirty_ring_page_hook) {
+        kvm_dirty_ring_page_hook(mem->ram_start_offset +
+                                 offset * qemu_real_host_page_size);
+    }
 }
 
 static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
 {
-    return gfn->flags == KVM_DIRTY_GFN_F_DIRTY;
+    /* Pairs with the kernel publishing slot and offset before the flags */
+    return qatomic_load_acquire(&gfn->flags) == KVM_DIRTY_GFN_F_DIRTY;
 }
 
 static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
 {
-    gfn->flags = KVM_DIRTY_GFN_F_RESET;
+    qatomic_store_release(&gfn->flags, KVM_DIRTY_GFN_F_RESET);
+}
+
+/*
+ * Whether the ring of @cpu is full enough for the vCPU to reap it.  The
+ * kernel fills the ring in order, so only one entry needs to be checked.
+ * Called without any lock from the vCPU thread; a stale kvm_fetch_index
+ * only makes the answer wrong once, the reap itself is done under the locks.
+ */
+static bool kvm_dirty_ring_needs_reap(KVMState *s, CPUState *cpu)
+{
+    uint32_t size = s->kvm_dirty_ring_size;
+    uint32_t index = cpu->kvm_fetch_index + KVM_DIRTY_RING_VCPU_REAP(size) - 1;
+
+    return dirty_gfn_is_dirtied(&cpu->kvm_dirty_gfns[index % size]);
 }
 
 /*
@@ -755,18 +802,28 @@ static uint32_t kvm_dirty_ring_reap_one(KVMState *s, CPUState *cpu)
     return count;
 }
 
-/* Must be with slots_lock held */
-static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
+/*
+ * Must be with slots_lock held.  Reaps the ring of @cpu, or of all vCPUs if
+ * @cpu is NULL.
+ */
+static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState *cpu)
 {
     int ret;
-    CPUState *cpu;
     uint64_t total = 0;
+    uint32_t count, max_fill = 0;
     int64_t stamp;
 
     stamp = get_clock();
 
-    CPU_FOREACH(cpu) {
-        total += kvm_dirty_ring_reap_one(s, cpu);
+    if (cpu) {
+        total = kvm_dirty_ring_reap_one(s, cpu);
+    } else {
+        CPU_FOREACH(cpu) {
+            count = kvm_dirty_ring_reap_one(s, cpu);
+            max_fill = MAX(max_fill, count);
+            total += count;
+        }
+        s->reaper.max_fill = max_fill;
     }
 
     if (total) {
@@ -787,7 +844,7 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s)
  * Currently for simplicity, we must hold BQL before calling this.  We can
  * consider to drop the BQL if we're clear with all the race conditions.
  */
-static uint64_t kvm_dirty_ring_reap(KVMState *s)
+static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
     uint64_t total;
 
@@ -807,7 +864,7 @@ static uint64_t kvm_dirty_ring_reap(KVMState *s)
      *     reset below.
      */
     kvm_slots_lock();
-    total = kvm_dirty_ring_reap_locked(s);
+    total = kvm_dirty_ring_reap_locked(s, cpu);
     kvm_slots_unlock();
 
     return total;
@@ -854,7 +911,7 @@ static void kvm_dirty_ring_flush(void)
      * vcpus out in a synchronous way.
      */
     kvm_cpu_synchronize_kick_all();
-    kvm_dirty_ring_reap(kvm_state);
+    kvm_dirty_ring_reap(kvm_state, NULL);
     trace_kvm_dirty_ring_flush(1);
 }
 
@@ -1374,8 +1431,6 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
     ram = memory_region_get_ram_ptr(mr) + mr_offset;
     ram_start_offset = memory_region_get_ram_addr(mr) + mr_offset;
 
-    kvm_slots_lock();
-
     if (!add) {
         do {
             slot_size = MIN(kvm_max_slot_size, size);
@@ -1398,7 +1453,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                  * Not easy.  Let's cross the fingers until it's fixed.
                  */
                 if (kvm_state->kvm_dirty_ring_size) {
-                    kvm_dirty_ring_reap_locked(kvm_state);
+                    kvm_dirty_ring_reap_locked(kvm_state, NULL);
                 } else {
                     kvm_slot_get_dirty_log(kvm_state, mem);
                 }
@@ -1419,7 +1474,7 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
             start_addr += slot_size;
             size -= slot_size;
         } while (size);
-        goto out;
+        return;
     }
 
     /* register the new slot */
@@ -1444,15 +1499,13 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
         ram += slot_size;
         size -= slot_size;
     } while (size);
-
-out:
-    kvm_slots_unlock();
 }
 
 static void *kvm_dirty_ring_reaper_thread(void *data)
 {
     KVMState *s = data;
     struct KVMDirtyRingReaper *r = &s->reaper;
+    unsigned interval_ms = KVM_DIRTY_RING_REAPER_MAX_MS;
 
     rcu_register_thread();
 
@@ -1461,18 +1514,26 @@ static void *kvm_dirty_ring_reaper_thread(void *data)
     while (true) {
         r->reaper_state = KVM_DIRTY_RING_REAPER_WAIT;
         trace_kvm_dirty_ring_reaper("wait");
-        /*
-         * TODO: provide a smarter timeout rather than a constant?
-         */
-        sleep(1);
+        g_usleep(interval_ms * 1000);
 
         trace_kvm_dirty_ring_reaper("wakeup");
         r->reaper_state = KVM_DIRTY_RING_REAPER_REAPING;
 
         qemu_mutex_lock_iothread();
-        kvm_dirty_ring_reap(s);
+        kvm_dirty_ring_reap(s, NULL);
         qemu_mutex_unlock_iothread();
 
+        /*
+         * Come back twice as fast if a ring got more than half full since the
+         * last round, and slow down if all of them stayed below 1/8.
+         */
+        if (r->max_fill > s->kvm_dirty_ring_size / 2) {
+            interval_ms = MAX(interval_ms / 2, KVM_DIRTY_RING_REAPER_MIN_MS);
+        } else if (r->max_fill < s->kvm_dirty_ring_size / 8) {
+            interval_ms = MIN(interval_ms * 2, KVM_DIRTY_RING_REAPER_MAX_MS);
+        }
+        trace_kvm_dirty_ring_reaper_interval(r->max_fill, interval_ms);
+
         r->reaper_iteration++;
     }
 
@@ -1494,22 +1555,196 @@ static int kvm_dirty_ring_reaper_init(KVMState *s)
     return 0;
 }
 
+static void kvm_ioctl_begin(void)
+{
+    if (likely(qemu_mutex_iothread_locked())) {
+        return;
+    }
+
+    /* Blocks while kvm_ioctl_inhibit_begin() holds the lock */
+    qemu_lockcnt_inc(&kvm_in_ioctl_lock);
+}
+
+static void kvm_ioctl_end(void)
+{
+    if (likely(qemu_mutex_iothread_locked())) {
+        return;
+    }
+
+    qemu_lockcnt_dec(&kvm_in_ioctl_lock);
+    qemu_event_set(&kvm_in_ioctl_event);
+}
+
+static void kvm_cpu_ioctl_begin(CPUState *cpu)
+{
+    if (unlikely(qemu_mutex_iothread_locked())) {
+        return;
+    }
+
+    qemu_lockcnt_inc(&cpu->kvm_in_ioctl_lock);
+}
+
+static void kvm_cpu_ioctl_end(CPUState *cpu)
+{
+    if (unlikely(qemu_mutex_iothread_locked())) {
+        return;
+    }
+
+    qemu_lockcnt_dec(&cpu->kvm_in_ioctl_lock);
+    qemu_event_set(&kvm_in_ioctl_event);
+}
+
+static bool kvm_ioctls_in_progress(void)
+{
+    CPUState *cpu;
+    bool in_progress = false;
+
+    CPU_FOREACH(cpu) {
+        if (qemu_lockcnt_count(&cpu->kvm_in_ioctl_lock)) {
+            /* Get the vCPU out of KVM_RUN */
+            qemu_cpu_kick(cpu);
+            in_progress = true;
+        }
+    }
+
+    return in_progress || qemu_lockcnt_count(&kvm_in_ioctl_lock);
+}
+
+/*
+ * Waits until no KVM ioctl is running outside the BQL, and keeps new ones
+ * (in particular KVM_RUN) from starting until kvm_ioctl_inhibit_end().
+ * Together with the BQL, this makes a series of memslot updates atomic for
+ * the vCPUs.
+ */
+static void kvm_ioctl_inhibit_begin(void)
+{
+    CPUState *cpu;
+
+    assert(qemu_mutex_iothread_locked());
+
+    CPU_FOREACH(cpu) {
+        qemu_lockcnt_lock(&cpu->kvm_in_ioctl_lock);
+    }
+    qemu_lockcnt_lock(&kvm_in_ioctl_lock);
+
+    for (;;) {
+        /*
+         * An ioctl that ends after the reset sets the event again, so that
+         * the wait below cannot miss it.
+         */
+        qemu_event_reset(&kvm_in_ioctl_event);
+        if (!kvm_ioctls_in_progress()) {
+            return;
+        }
+        qemu_event_wait(&kvm_in_ioctl_event);
+    }
+}
+
+static void kvm_ioctl_inhibit_end(void)
+{
+    CPUState *cpu;
+
+    qemu_lockcnt_unlock(&kvm_in_ioctl_lock);
+    CPU_FOREACH(cpu) {
+        qemu_lockcnt_unlock(&cpu->kvm_in_ioctl_lock);
+    }
+}
+
+/*
+ * Slot changes are collected until the end of the memory transaction, so
+ * that all of them can be applied at once in kvm_region_commit().
+ */
 static void kvm_region_add(MemoryListener *listener,
                            MemoryRegionSection *section)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *update = g_new0(KVMMemoryUpdate, 1);
 
-    memory_region_ref(section->mr);
-    kvm_set_phys_mem(kml, section, true);
+    update->section = *section;
+    QSIMPLEQ_INSERT_TAIL(&kml->transaction_add, update, next);
 }
 
 static void kvm_region_del(MemoryListener *listener,
                            MemoryRegionSection *section)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *update = g_new0(KVMMemoryUpdate, 1);
 
-    kvm_set_phys_mem(kml, section, false);
-    memory_region_unref(section->mr);
+    /* The reference taken when the section was added is dropped on commit */
+    update->section = *section;
+    QSIMPLEQ_INSERT_TAIL(&kml->transaction_del, update, next);
+}
+
+static void kvm_region_commit(MemoryListener *listener)
+{
+    KVMMemoryListener *kml = container_of(listener, KVMMemoryListener, listener);
+    KVMMemoryUpdate *u1, *u2;
+    bool need_inhibit = false;
+
+    if (QSIMPLEQ_EMPTY(&kml->transaction_add) &&
+        QSIMPLEQ_EMPTY(&kml->transaction_del)) {
+        return;
+    }
+
+    /*
+     * Removing a slot and adding one for an overlapping range opens a window
+     * in which vCPUs see a hole.  Such updates are done while no vCPU is in
+     * KVM_RUN.  Both lists are sorted by address, so overlaps are found in a
+     * single pass.
+     */
+    u1 = QSIMPLEQ_FIRST(&kml->transaction_del);
+    u2 = QSIMPLEQ_FIRST(&kml->transaction_add);
+    while (u1 && u2) {
+        Range r1, r2;
+
+        range_init_nofail(&r1, u1->section.offset_within_address_space,
+                          int128_get64(u1->section.size));
+        range_init_nofail(&r2, u2->section.offset_within_address_space,
+                          int128_get64(u2->section.size));
+
+        if (range_overlaps_range(&r1, &r2)) {
+            need_inhibit = true;
+            break;
+        }
+        if (range_lob(&r1) < range_lob(&r2)) {
+            u1 = QSIMPLEQ_NEXT(u1, next);
+        } else {
+            u2 = QSIMPLEQ_NEXT(u2, next);
+        }
+    }
+
+    trace_kvm_region_commit(kml->as_id, need_inhibit);
+
+    /*
+     * Take the slots lock first: ioctls issued by its other users must not
+     * be blocked by the inhibitor while it waits for the lock.
+     */
+    kvm_slots_lock();
+    if (need_inhibit) {
+        kvm_ioctl_inhibit_begin();
+    }
+
+    while (!QSIMPLEQ_EMPTY(&kml->transaction_del)) {
+        u1 = QSIMPLEQ_FIRST(&kml->transaction_del);
+        QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+
+        kvm_set_phys_mem(kml, &u1->section, false);
+        memory_region_unref(u1->section.mr);
+        g_free(u1);
+    }
+    while (!QSIMPLEQ_EMPTY(&kml->transaction_add)) {
+        u1 = QSIMPLEQ_FIRST(&kml->transaction_add);
+        QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+
+        memory_region_ref(u1->section.mr);
+        kvm_set_phys_mem(kml, &u1->section, true);
+        g_free(u1);
+    }
+
+    if (need_inhibit) {
+        kvm_ioctl_inhibit_end();
+    }
+    kvm_slots_unlock();
 }
 
 static void kvm_log_sync(MemoryListener *listener,
@@ -1648,6 +1883,8 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
 
     kml->slots = g_malloc0(s->nr_slots * sizeof(KVMSlot));
     kml->as_id = as_id;
+    QSIMPLEQ_INIT(&kml->transaction_add);
+    QSIMPLEQ_INIT(&kml->transaction_del);
 
     for (i = 0; i < s->nr_slots; i++) {
         kml->slots[i].slot = i;
@@ -1655,6 +1892,7 @@ void kvm_memory_listener_register(KVMState *s, KVMMemoryListener *kml,
 
     kml->listener.region_add = kvm_region_add;
     kml->listener.region_del = kvm_region_del;
+    kml->listener.commit = kvm_region_commit;
     kml->listener.log_start = kvm_log_start;
     kml->listener.log_stop = kvm_log_stop;
     kml->listener.priority = 10;
@@ -2309,6 +2547,18 @@ bool kvm_dirty_ring_enabled(void)
     return kvm_state->kvm_dirty_ring_size ? true : false;
 }
 
+uint32_t kvm_dirty_ring_size(void)
+{
+    return kvm_state->kvm_dirty_ring_size;
+}
+
+void kvm_dirty_ring_set_page_hook(KVMDirtyRingPageHook hook)
+{
+    kvm_slots_lock();
+    kvm_dirty_ring_page_hook = hook;
+    kvm_slots_unlock();
+}
+
 static int kvm_init(MachineState *ms)
 {
     MachineClass *mc = MACHINE_GET_CLASS(ms);
@@ -2331,6 +2581,8 @@ static int kvm_init(MachineState *ms)
     uint64_t dirty_log_manual_caps;
 
     qemu_mutex_init(&kml_slots_lock);
+    qemu_lockcnt_init(&kvm_in_ioctl_lock);
+    qemu_event_init(&kvm_in_ioctl_event, false);
 
     s = KVM_STATE(ms->accelerator);
 
@@ -2496,6 +2748,15 @@ static int kvm_init(MachineState *ms)
         }
     }
 
+    if (s->halt_poll_ns_set) {
+        ret = kvm_vm_enable_cap(s, KVM_CAP_HALT_POLL, 0, s->halt_poll_ns);
+        if (ret) {
+            error_report("Setting KVM halt polling time failed: %s",
+                         strerror(-ret));
+            goto err;
+        }
+    }
+
     /*
      * KVM_CAP_MANUAL_DIRTY_LOG_PROTECT2 is not needed when dirty ring is
      * enabled.  More importantly, KVM_DIRTY_LOG_INITIALLY_SET will assume no
@@ -2879,6 +3140,16 @@ int kvm_cpu_exec(CPUState *cpu)
 
         attrs = kvm_arch_post_run(cpu, run);
 
+        /* Collect our own dirty pages before the ring-full exit stalls us */
+        if (kvm_state->kvm_dirty_ring_size &&
+            run->exit_reason != KVM_EXIT_DIRTY_RING_FULL &&
+            kvm_dirty_ring_needs_reap(kvm_state, cpu)) {
+            trace_kvm_dirty_ring_vcpu_reap(cpu->cpu_index);
+            qemu_mutex_lock_iothread();
+            kvm_dirty_ring_reap(kvm_state, cpu);
+            qemu_mutex_unlock_iothread();
+        }
+
 #ifdef KVM_HAVE_MCE_INJECTION
         if (unlikely(have_sigbus_pending)) {
             qemu_mutex_lock_iothread();
@@ -2925,11 +3196,12 @@ int kvm_cpu_exec(CPUState *cpu)
         case KVM_EXIT_MMIO:
             DPRINTF("handle_mmio\n");
             /* Called outside BQL */
-            address_space_rw(&address_space_memory,
-                             run->mmio.phys_addr, attrs,
-                             run->mmio.data,
-                             run->mmio.len,
-                             run->mmio.is_write);
+            address_space_rw_cached_section(&address_space_memory,
+                                            run->mmio.phys_addr, attrs,
+                                            run->mmio.data,
+                                            run->mmio.len,
+                                            run->mmio.is_write,
+                                            cpu->kvm_mmio_cache);
             ret = 0;
             break;
         case KVM_EXIT_IRQ_WINDOW_OPEN:
@@ -2956,8 +3228,10 @@ int kvm_cpu_exec(CPUState *cpu)
              */
             trace_kvm_dirty_ring_full(cpu->cpu_index);
             qemu_mutex_lock_iothread();
-            kvm_dirty_ring_reap(kvm_state);
+            /* Only our ring needs to be emptied before we can go on */
+            kvm_dirty_ring_reap(kvm_state, cpu);
             qemu_mutex_unlock_iothread();
+            dirtylimit_vcpu_execute(cpu);
             ret = 0;
             break;
         case KVM_EXIT_SYSTEM_EVENT:
@@ -3031,7 +3305,9 @@ int kvm_vm_ioctl(KVMState *s, int type, ...)
     va_end(ap);
 
     trace_kvm_vm_ioctl(type, arg);
+    kvm_ioctl_begin();
     ret = ioctl(s->vmfd, type, arg);
+    kvm_ioctl_end();
     if (ret == -1) {
         ret = -errno;
     }
@@ -3049,7 +3325,9 @@ int kvm_vcpu_ioctl(CPUState *cpu, int type, ...)
     va_end(ap);
 
     trace_kvm_vcpu_ioctl(cpu->cpu_index, type, arg);
+    kvm_cpu_ioctl_begin(cpu);
     ret = ioctl(cpu->kvm_fd, type, arg);
+    kvm_cpu_ioctl_end(cpu);
     if (ret == -1) {
         ret = -errno;
     }
@@ -3642,6 +3920,37 @@ static void kvm_set_dirty_ring_size(Object *obj, Visitor *v,
     s->kvm_dirty_ring_size = value;
 }
 
+static void kvm_get_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value = s->halt_poll_ns;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void kvm_set_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    KVMState *s = KVM_STATE(obj);
+    uint32_t value;
+
+    if (s->fd != -1) {
+        error_setg(errp, "Cannot set properties after the accelerator "
+                   "has been initialized");
+        return;
+    }
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->halt_poll_ns = value;
+    s->halt_poll_ns_set = true;
+}
+
 static void kvm_accel_instance_init(Object *obj)
 {
     KVMState *s = KVM_STATE(obj);
@@ -3680,6 +3989,13 @@ static void kvm_accel_class_init(ObjectClass *oc, void *data)
         NULL, NULL);
     object_class_property_set_description(oc, "dirty-ring-size",
         "Size of KVM dirty page ring buffer (default: 0, i.e. use bitmap)");
+
+    object_class_property_add(oc, "halt-poll-ns", "uint32",
+        kvm_get_halt_poll_ns, kvm_set_halt_poll_ns,
+        NULL, NULL);
+    object_class_property_set_description(oc, "halt-poll-ns",
+        "Maximum time in ns that a halted vCPU polls for wakeups "
+        "(default: the host's halt_poll_ns)");
 }
 
 static const TypeInfo kvm_accel_type = {
@@ -152,4 +152,13 @@ bool kvm_dirty_ring_enabled(void)
 {
     return false;
 }
+
+uint32_t kvm_dirty_ring_size(void)
+{
+    return 0;
+}
+
+void kvm_dirty_ring_set_page_hook(KVMDirtyRingPageHook hook)
+{
+}
 #endif
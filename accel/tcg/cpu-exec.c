@@ -171,36 +171,79 @@ uint32_t curr_cflags(CPUState *cpu)
     return cflags;
 }
 
+/*
+ * Makes @tb the most recently used entry of the jump cache set for @pc,
+ * moving the entries before @way down by one.  Pass TB_JMP_CACHE_WAYS - 1
+ * to insert a new TB and drop the least recently used one.
+ *
+ * Other threads may concurrently clear entries of the set; an invalidated
+ * TB that is moved around as a result is harmless, because lookups check
+ * CF_INVALID through the cflags.
+ */
+static inline void tb_jmp_cache_set(CPUState *cpu, target_ulong pc,
+                                    unsigned int way, TranslationBlock *tb)
+{
+    TranslationBlock **set = cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+
+    for (; way > 0; way--) {
+        qatomic_set(&set[way], qatomic_read(&set[way - 1]));
+    }
+    qatomic_set(&set[0], tb);
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
+    TranslationBlock **set;
     TranslationBlock *tb;
-    uint32_t hash;
+    unsigned int i;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
-        return tb;
+    set = cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)];
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        tb = qatomic_rcu_read(&set[i]);
+        if (likely(tb &&
+                   tb->pc == pc &&
+                   tb->cs_base == cs_base &&
+                   tb->flags == flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   tb_cflags(tb) == cflags)) {
+            if (i != 0) {
+                tb_jmp_cache_set(cpu, pc, i, tb);
+            }
+            qatomic_set(&cpu->tb_jmp_cache_hit_count,
+                        cpu->tb_jmp_cache_hit_count + 1);
+            return tb;
+        }
     }
+    qatomic_set(&cpu->tb_jmp_cache_miss_count,
+                cpu->tb_jmp_cache_miss_count + 1);
+
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_set(cpu, pc, TB_JMP_CACHE_WAYS - 1, tb);
     return tb;
 }
 
+void tb_jmp_cache_counts(size_t *phit, size_t *pmiss)
+{
+    CPUState *cpu;
+    size_t hit = 0, miss = 0;
+
+    CPU_FOREACH(cpu) {
+        hit += qatomic_read(&cpu->tb_jmp_cache_hit_count);
+        miss += qatomic_read(&cpu->tb_jmp_cache_miss_count);
+    }
+    *phit = hit;
+    *pmiss = miss;
+}
+
 static inline void log_cpu_exec(target_ulong pc, CPUState *cpu,
                                 const TranslationBlock *tb)
 {
@@ -979,7 +1022,7 @@ int cpu_exec(CPUState *cpu)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_set(cpu, pc, TB_JMP_CACHE_WAYS - 1, tb);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -987,10 +1030,19 @@ int cpu_exec(CPUState *cpu)
              * We don't take care of direct jumps when address mapping
              * changes in system emulation.  So it's not safe to make a
              * direct jump to a TB spanning two pages because the mapping
-             * for the second page can change.
+             * for the second page can change.  The exception is a jump
+             * from a TB that starts on the same page and spans the same
+             * two pages: a TB is only executed while the mappings of all
+             * its pages are unchanged, so the second page of the
+             * destination is then valid too.
              */
-            if (tb->page_addr[1] != -1) {
-                last_tb = NULL;
+            if (tb->page_addr[1] != -1 && last_tb) {
+                if (((last_tb->pc ^ tb->pc) & TARGET_PAGE_MASK) == 0 &&
+                    last_tb->page_addr[1] == tb->page_addr[1]) {
+                    trace_exec_tb_chain_cross_page(last_tb, tb);
+                } else {
+                    last_tb = NULL;
+                }
             }
 #endif
             /* See if we can patch the calling TB. */
@@ -100,10 +100,12 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 
 static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
 {
-    unsigned int i, i0 = tb_jmp_cache_hash_page(page_addr);
+    unsigned int i, j, i0 = tb_jmp_cache_hash_page(page_addr);
 
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
+        for (j = 0; j < TB_JMP_CACHE_WAYS; j++) {
+            qatomic_set(&cpu->tb_jmp_cache[i0 + i][j], NULL);
+        }
     }
 }
 
@@ -235,6 +237,8 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
+    desc->used_addr_min = -1;
+    desc->used_addr_max = 0;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
     memset(desc->vtable, -1, sizeof(desc->vtable));
@@ -339,6 +343,21 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+void tlb_miss_counts(size_t *pvictim_hit, size_t *pfill)
+{
+    CPUState *cpu;
+    size_t victim_hit = 0, fill = 0;
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+
+        victim_hit += qatomic_read(&env_tlb(env)->c.victim_hit_count);
+        fill += qatomic_read(&env_tlb(env)->c.fill_count);
+    }
+    *pvictim_hit = victim_hit;
+    *pfill = fill;
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -715,6 +734,35 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
     CPUTLBDescFast *f = &env_tlb(env)->f[midx];
     target_ulong mask = MAKE_64BIT_MASK(0, bits);
 
+    /*
+     * Check if we need to flush due to large pages.
+     * Because large_page_mask contains all 1's from the msb,
+     * we only need to test the end of the range.
+     */
+    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
+        tlb_debug("forcing full flush midx %d ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  midx, d->large_page_addr, d->large_page_mask);
+        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
+        return;
+    }
+
+    /*
+     * Only the part of the range that has been allocated into the tlb
+     * needs to be flushed.  With a partial @mask, addresses outside the
+     * used range can match entries within it, so do not clip.
+     */
+    if (bits >= TARGET_LONG_BITS) {
+        target_ulong last = addr + len - 1;
+        target_ulong used_last = d->used_addr_max | ~TARGET_PAGE_MASK;
+
+        if (last < d->used_addr_min || addr > d->used_addr_max) {
+            return;
+        }
+        addr = MAX(addr, d->used_addr_min);
+        len = MIN(last, used_last) - addr + 1;
+    }
+
     /*
      * If @bits is smaller than the tlb size, there may be multiple entries
      * within the TLB; otherwise all addresses that match under @mask hit
@@ -733,19 +781,6 @@ static void tlb_flush_range_locked(CPUArchState *env, int midx,
         return;
     }
 
-    /*
-     * Check if we need to flush due to large pages.
-     * Because large_page_mask contains all 1's from the msb,
-     * we only need to test the end of the range.
-     */
-    if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(env, midx, get_clock_realtime());
-        return;
-    }
-
     for (target_ulong i = 0; i < len; i += TARGET_PAGE_SIZE) {
         target_ulong page = addr + i;
         CPUTLBEntry *entry = tlb_entry(env, midx, page);
@@ -1197,6 +1232,9 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     /* Note that the tlb is no longer clean.  */
     tlb->c.dirty |= 1 << mmu_idx;
 
+    desc->used_addr_min = MIN(desc->used_addr_min, vaddr_page);
+    desc->used_addr_max = MAX(desc->used_addr_max, vaddr_page);
+
     /* Make sure there's no cached translation for the new page.  */
     tlb_flush_vtlb_page_locked(env, mmu_idx, vaddr_page);
 
@@ -1295,8 +1333,11 @@ static void tlb_fill(CPUState *cpu, target_ulong addr, int size,
                      MMUAccessType access_type, int mmu_idx, uintptr_t retaddr)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
+    CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
     bool ok;
 
+    qatomic_set(&c->fill_count, c->fill_count + 1);
+
     /*
      * This is not a probe, so only valid return is success; failure
      * should result in exception + longjmp to the cpu loop.
@@ -1352,7 +1393,7 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         cpu_io_recompile(cpu, retaddr);
     }
 
-    if (!qemu_mutex_iothread_locked()) {
+    if (!mr->lockless_io && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         locked = true;
     }
@@ -1413,7 +1454,7 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
      */
     save_iotlb_data(cpu, iotlbentry->addr, section, mr_offset);
 
-    if (!qemu_mutex_iothread_locked()) {
+    if (!mr->lockless_io && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         locked = true;
     }
@@ -1474,6 +1515,9 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
             CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
             tmpio = *io; *io = *vio; *vio = tmpio;
+
+            qatomic_set(&env_tlb(env)->c.victim_hit_count,
+                        env_tlb(env)->c.victim_hit_count + 1);
             return true;
         }
     }
@@ -1599,6 +1643,8 @@ static int probe_access_internal(CPUArchState *env, target_ulong addr,
             CPUState *cs = env_cpu(env);
             CPUClass *cc = CPU_GET_CLASS(cs);
 
+            qatomic_set(&env_tlb(env)->c.fill_count,
+                        env_tlb(env)->c.fill_count + 1);
             if (!cc->tcg_ops->tlb_fill(cs, addr, fault_size, access_type,
                                        mmu_idx, nonfault, retaddr)) {
                 /* Non-faulting page table read failed.  */
@@ -10,6 +10,7 @@ static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp_info_hrt("tb-stats", qmp_x_query_tb_stats);
 }
 
 type_init(hmp_tcg_register);
@@ -18,5 +18,37 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
 void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
+void tb_jmp_cache_counts(size_t *hit, size_t *miss);
+
+/*
+ * Statistics of a guest block, kept across retranslations and TB flushes.
+ * Entries are never freed.
+ */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+
+    /* Updated by the translated code, without atomics */
+    uint64_t executions;
+    uint32_t translations;
+    uint32_t invalidations;
+    uint32_t io_exits;
+
+    /* Of the most recent translation */
+    uint16_t guest_insns;
+    uint16_t guest_size;
+    uint32_t host_size;
+} TBStatistics;
+
+extern bool tb_stats_enabled;
+
+void perf_enable_perfmap(void);
+void perf_report_code(const TranslationBlock *tb);
+
+void tb_stats_init(void);
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags);
 
 #endif /* ACCEL_TCG_INTERNAL_H */
@@ -0,0 +1,48 @@
+/*
+ * Linux perf map of the translated code
+ *
+ * perf cannot symbolize samples in the code buffer by itself.  With
+ * perf-map=on, a line "START SIZE NAME" is appended to /tmp/perf-PID.map
+ * for each TB as it is generated, naming it after its guest PC and the
+ * guest symbol, if known.  Host code is reused after TB flushes and
+ * invalidations, so later entries may overlap earlier ones.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "internal.h"
+
+static FILE *perfmap;
+
+void perf_enable_perfmap(void)
+{
+    g_autofree char *path = g_strdup_printf("/tmp/perf-%d.map", getpid());
+
+    perfmap = fopen(path, "w");
+    if (!perfmap) {
+        warn_report("Could not open %s: %s", path, strerror(errno));
+        return;
+    }
+    /* perf reads the map while QEMU runs, or after it was killed */
+    setvbuf(perfmap, NULL, _IOLBF, 0);
+}
+
+void perf_report_code(const TranslationBlock *tb)
+{
+    const char *sym;
+
+    if (!perfmap) {
+        return;
+    }
+
+    /* Each line is written with one call, so threads do not interleave */
+    sym = lookup_symbol(tb->pc);
+    fprintf(perfmap, "%" PRIxPTR " %zx guest-0x%" PRIx64 "%s%s\n",
+            (uintptr_t)tb->tc.ptr, tb->tc.size, (uint64_t)tb->pc,
+            *sym ? " " : "", sym);
+}
@@ -74,6 +74,7 @@ enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
     PLUGIN_GEN_CB_MEM,
+    PLUGIN_GEN_CB_MEM_RING,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
     PLUGIN_GEN_N_CBS,
@@ -124,20 +125,33 @@ static void gen_empty_udata_cb(void)
 }
 
 /*
- * For now we only support addi_i64.
- * When we support more ops, we can generate one empty inline cb for each.
+ * All inline ops share this pattern, which operates on the element of the
+ * current vCPU: ptr + cpu_index * stride.  Global counters use a stride
+ * of 0, and the optimizer then drops the address computation.  A store
+ * is an add to a constant 0.
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
     TCGv_i64 val = tcg_temp_new_i64();
     TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
 
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* the second operand is replaced with the stride */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_extu_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -145,6 +159,55 @@ static void gen_empty_mem_cb(TCGv addr, uint32_t info)
     do_gen_mem_cb(addr, info);
 }
 
+/*
+ * Append a record to the memory ring of the current vCPU, at
+ * ptr + cpu_index * stride.  The ring header is followed by the records.
+ */
+static void gen_empty_mem_ring(TCGv addr, uint32_t info)
+{
+    const size_t rec_offset = sizeof(PluginMemRingHeader);
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
+    TCGv_i32 slot = tcg_temp_new_i32();
+    TCGv_ptr rec = tcg_temp_new_ptr();
+    TCGv_i64 vaddr64 = tcg_temp_new_i64();
+    TCGv_i32 meminfo = tcg_const_i32(info);
+    TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* the second operand is replaced with the stride */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_extu_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+
+    /* head++ */
+    tcg_gen_ld_i32(slot, ptr, offsetof(PluginMemRingHeader, head));
+    tcg_gen_addi_i32(cpu_index, slot, 1);
+    tcg_gen_st_i32(cpu_index, ptr, offsetof(PluginMemRingHeader, head));
+
+    /* the second operand is replaced with the ring mask */
+    tcg_gen_and_i32(slot, slot, slot);
+    QEMU_BUILD_BUG_ON(sizeof(qemu_plugin_mem_record) != 16);
+    tcg_gen_shli_i32(slot, slot, 4);
+    tcg_gen_extu_i32_ptr(rec, slot);
+    tcg_gen_add_ptr(rec, rec, ptr);
+
+    tcg_gen_extu_tl_i64(vaddr64, addr);
+    tcg_gen_st_i64(vaddr64, rec,
+                   rec_offset + offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i32(meminfo, rec,
+                   rec_offset + offsetof(qemu_plugin_mem_record, info));
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i32(meminfo);
+    tcg_temp_free_i64(vaddr64);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_i32(slot);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -224,6 +287,9 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
     fn.mem_fn = gen_empty_mem_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_MEM, &fn, addr, info, true);
 
+    fn.mem_fn = gen_empty_mem_ring;
+    gen_mem_wrapped(PLUGIN_GEN_CB_MEM_RING, &fn, addr, info, true);
+
     fn.inline_fn = gen_empty_inline_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
 }
@@ -366,6 +432,37 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_extu_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* extu_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_extu_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -445,11 +542,32 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
+    /* ld_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* mul_i32 */
+    op = copy_mul_i32(&begin_op, op, cb->inline_insn.stride);
+
+    /* extu_i32_ptr */
+    op = copy_extu_i32_ptr(&begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(&begin_op, op);
+
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
 
     /* add_i64 */
     op = copy_add_i64(&begin_op, op, cb->inline_insn.imm);
+    if (cb->inline_insn.op == QEMU_PLUGIN_INLINE_STORE_U64) {
+        /* add the immediate to 0 instead of the loaded value */
+        if (TCG_TARGET_REG_BITS == 32) {
+            op->args[2] = tcgv_i32_arg(tcg_constant_i32(0));
+            op->args[3] = tcgv_i32_arg(tcg_constant_i32(0));
+        } else {
+            op->args[1] = tcgv_i64_arg(tcg_constant_i64(0));
+        }
+    }
 
     /* st_i64 */
     op = copy_st_i64(&begin_op, op);
@@ -490,6 +608,57 @@ static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGOp *append_mem_ring_cb(const struct qemu_plugin_dyn_cb *cb,
+                                 TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    /* const_i32 == mov_i32 ("info", so it remains as is) */
+    op = copy_op(&begin_op, op, INDEX_op_mov_i32);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->mem_ring.base);
+
+    /* ld_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* mul_i32 */
+    op = copy_mul_i32(&begin_op, op, cb->mem_ring.stride);
+
+    /* extu_i32_ptr */
+    op = copy_extu_i32_ptr(&begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(&begin_op, op);
+
+    /* ld_i32, add_i32, st_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_op(&begin_op, op, INDEX_op_add_i32);
+    op = copy_op(&begin_op, op, INDEX_op_st_i32);
+
+    /* and_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_and_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(cb->mem_ring.mask));
+
+    /* shl_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_shl_i32);
+
+    /* extu_i32_ptr */
+    op = copy_extu_i32_ptr(&begin_op, op);
+
+    /* add_ptr */
+    op = copy_add_ptr(&begin_op, op);
+
+    /* extu_tl_i64 */
+    op = copy_extu_tl_i64(&begin_op, op);
+
+    /* st_i64 */
+    op = copy_st_i64(&begin_op, op);
+
+    /* st_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_st_i32);
+
+    return op;
+}
+
 typedef TCGOp *(*inject_fn)(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *intp);
 typedef bool (*op_ok_fn)(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb);
@@ -554,6 +723,12 @@ inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
     inject_cb_type(cbs, begin_op, append_mem_cb, op_rw);
 }
 
+static void
+inject_mem_ring_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_mem_ring_cb, op_rw);
+}
+
 /* we could change the ops in place, but we can reuse more code by copying */
 static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 {
@@ -588,12 +763,13 @@ static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 static void inject_mem_enable_helper(struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
     cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
     cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -688,6 +864,22 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(cbs, begin_op, op_rw);
 }
 
+/* returns the number of records each execution of the access appends */
+static uint32_t plugin_gen_mem_ring(const struct qemu_plugin_tb *ptb,
+                                    TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+    const GArray *cbs = insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING];
+    uint32_t n = 0;
+    int i;
+
+    for (i = 0; i < cbs->len; i++) {
+        n += op_rw(begin_op, &g_array_index(cbs, struct qemu_plugin_dyn_cb, i));
+    }
+    inject_mem_ring_cb(cbs, begin_op);
+    return n;
+}
+
 static void plugin_gen_enable_mem_helper(const struct qemu_plugin_tb *ptb,
                                          TCGOp *begin_op, int insn_idx)
 {
@@ -740,6 +932,9 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
+            case PLUGIN_GEN_CB_MEM_RING:
+                type = "mem ring";
+                break;
             case PLUGIN_GEN_ENABLE_MEM_HELPER:
                 type = "enable mem helper";
                 break;
@@ -756,10 +951,11 @@ static void pr_ops(void)
 #endif
 }
 
-static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
+static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
 {
     TCGOp *op;
     int insn_idx = -1;
+    uint32_t n_ring_records = 0;
 
     pr_ops();
 
@@ -817,6 +1013,10 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_MEM:
                     plugin_gen_mem_regular(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_RING:
+                    n_ring_records += plugin_gen_mem_ring(plugin_tb, op,
+                                                          insn_idx);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
@@ -849,6 +1049,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
             break;
         }
     }
+    if (n_ring_records) {
+        qemu_plugin_tb_mem_ring_records(plugin_tb, n_ring_records);
+    }
     pr_ops();
 }
 
@@ -35,6 +35,9 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_evict_count;
+    /* incremented by both tb_flush() and tb_evict() */
+    unsigned tb_reclaim_count;
 };
 
 extern TBContext tb_ctx;
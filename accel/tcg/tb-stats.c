@@ -0,0 +1,201 @@
+/*
+ * Per-TB execution, translation and invalidation statistics
+ *
+ * With -accel tcg,tb-stats=on, every guest block (identified by its physical
+ * and virtual PC and the CPU state flags) gets an entry that survives
+ * retranslation and TB flushes, so that code that keeps being retranslated,
+ * invalidated by self-modifying code or recompiled for I/O stands out next
+ * to the hot code.  Execution counts are incremented by the translated code
+ * without atomics and may miss a few increments under MTTCG.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "sysemu/tcg.h"
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "internal.h"
+#ifndef CONFIG_USER_ONLY
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
+#endif
+
+/* Number of entries listed by x-query-tb-stats */
+#define TB_STATS_QUERY_MAX 32
+
+bool tb_stats_enabled;
+
+static QemuMutex tb_stats_lock;
+static GHashTable *tb_stats_table;
+
+static guint tb_stats_hash(gconstpointer p)
+{
+    const TBStatistics *tbs = p;
+
+    return tb_hash_func(tbs->phys_pc, tbs->pc, tbs->flags, 0, 0);
+}
+
+static gboolean tb_stats_equal(gconstpointer a, gconstpointer b)
+{
+    const TBStatistics *x = a, *y = b;
+
+    return x->phys_pc == y->phys_pc && x->pc == y->pc &&
+           x->cs_base == y->cs_base && x->flags == y->flags;
+}
+
+void tb_stats_init(void)
+{
+    qemu_mutex_init(&tb_stats_lock);
+    tb_stats_table = g_hash_table_new_full(tb_stats_hash, tb_stats_equal,
+                                           g_free, NULL);
+    tb_stats_enabled = true;
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags)
+{
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+    };
+    TBStatistics *tbs;
+
+    qemu_mutex_lock(&tb_stats_lock);
+    tbs = g_hash_table_lookup(tb_stats_table, &key);
+    if (!tbs) {
+        tbs = g_memdup2(&key, sizeof(key));
+        g_hash_table_add(tb_stats_table, tbs);
+    }
+    qemu_mutex_unlock(&tb_stats_lock);
+
+    return tbs;
+}
+
+#ifndef CONFIG_USER_ONLY
+
+/*
+ * The counters keep changing while vCPUs run; sorting works on a copy made
+ * here, so that the comparison function sees consistent values.
+ */
+static void tb_stats_collect(gpointer key, gpointer value, gpointer data)
+{
+    const TBStatistics *tbs = key;
+    TBStatistics snapshot = {
+        .phys_pc = tbs->phys_pc,
+        .pc = tbs->pc,
+        .cs_base = tbs->cs_base,
+        .flags = tbs->flags,
+        .executions = tbs->executions,
+        .translations = qatomic_read(&tbs->translations),
+        .invalidations = qatomic_read(&tbs->invalidations),
+        .io_exits = qatomic_read(&tbs->io_exits),
+        .guest_insns = qatomic_read(&tbs->guest_insns),
+        .guest_size = qatomic_read(&tbs->guest_size),
+        .host_size = qatomic_read(&tbs->host_size),
+    };
+
+    g_array_append_val(data, snapshot);
+}
+
+static gint tb_stats_cmp_executions(gconstpointer a, gconstpointer b)
+{
+    const TBStatistics *x = a;
+    const TBStatistics *y = b;
+
+    if (x->executions != y->executions) {
+        return x->executions < y->executions ? 1 : -1;
+    }
+    return 0;
+}
+
+HumanReadableText *qmp_x_query_tb_stats(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GArray) entries = g_array_new(false, false,
+                                            sizeof(TBStatistics));
+    guint i;
+
+    if (!tb_stats_enabled) {
+        error_setg(errp, "TB statistics are not enabled, "
+                   "use -accel tcg,tb-stats=on");
+        return NULL;
+    }
+
+    qemu_mutex_lock(&tb_stats_lock);
+    g_hash_table_foreach(tb_stats_table, tb_stats_collect, entries);
+    qemu_mutex_unlock(&tb_stats_lock);
+
+    g_array_sort(entries, tb_stats_cmp_executions);
+
+    g_string_append_printf(buf, "%u guest blocks, most executed first\n",
+                           entries->len);
+    g_string_append_printf(buf, "%-18s %-18s %-10s %14s %6s %6s %6s "
+                           "%5s %5s %6s\n", "pc", "phys_pc", "flags",
+                           "executions", "trans", "inval", "io",
+                           "insns", "bytes", "host");
+    for (i = 0; i < MIN(entries->len, TB_STATS_QUERY_MAX); i++) {
+        const TBStatistics *tbs = &g_array_index(entries, TBStatistics, i);
+
+        g_string_append_printf(buf, "0x%-16" PRIx64 " 0x%-16" PRIx64
+                               " 0x%08" PRIx32 " %14" PRIu64
+                               " %6u %6u %6u %5u %5u %6u\n",
+                               (uint64_t)tbs->pc, (uint64_t)tbs->phys_pc,
+                               tbs->flags, tbs->executions,
+                               tbs->translations, tbs->invalidations,
+                               tbs->io_exits, tbs->guest_insns,
+                               tbs->guest_size, tbs->host_size);
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
+/* One line per TB in the perf map format: start, size, symbol name */
+static gboolean tb_stats_perf_map_iter(gpointer key, gpointer value,
+                                       gpointer data)
+{
+    const TranslationBlock *tb = value;
+    FILE *f = data;
+
+    fprintf(f, "%" PRIxPTR " %zx guest-0x%" PRIx64,
+            (uintptr_t)tb->tc.ptr, tb->tc.size, (uint64_t)tb->pc);
+    if (tb->tb_stats) {
+        fprintf(f, " [exec %" PRIu64 " trans %u inval %u io %u]",
+                tb->tb_stats->executions,
+                qatomic_read(&tb->tb_stats->translations),
+                qatomic_read(&tb->tb_stats->invalidations),
+                qatomic_read(&tb->tb_stats->io_exits));
+    }
+    fputc('\n', f);
+    return false;
+}
+
+void qmp_x_dump_tb_stats(const char *filename, Error **errp)
+{
+    FILE *f;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TB statistics are only available with accel=tcg");
+        return;
+    }
+
+    f = fopen(filename, "w");
+    if (!f) {
+        error_setg_file_open(errp, errno, filename);
+        return;
+    }
+
+    tcg_tb_foreach(tb_stats_perf_map_iter, f);
+
+    if (fclose(f)) {
+        error_setg_errno(errp, errno, "Could not write '%s'", filename);
+    }
+}
+
+#endif /* !CONFIG_USER_ONLY */
@@ -44,6 +44,8 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool tb_stats_enabled;
+    bool perfmap_enabled;
 };
 typedef struct TCGState TCGState;
 
@@ -125,6 +127,12 @@ static int tcg_init_machine(MachineState *ms)
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    if (s->tb_stats_enabled) {
+        tb_stats_init();
+    }
+    if (s->perfmap_enabled) {
+        perf_enable_perfmap();
+    }
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -208,6 +216,30 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+static bool tcg_get_tb_stats(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->tb_stats_enabled;
+}
+
+static void tcg_set_tb_stats(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->tb_stats_enabled = value;
+}
+
+static bool tcg_get_perfmap(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->perfmap_enabled;
+}
+
+static void tcg_set_perfmap(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->perfmap_enabled = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -229,6 +261,16 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "tb-stats",
+        tcg_get_tb_stats, tcg_set_tb_stats);
+    object_class_property_set_description(oc, "tb-stats",
+        "Collect per-TB execution and translation statistics");
+
+    object_class_property_add_bool(oc, "perf-map",
+        tcg_get_perfmap, tcg_set_perfmap);
+    object_class_property_set_description(oc, "perf-map",
+        "Write a perf map of the translated code to /tmp/perf-PID.map");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -988,13 +988,19 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
         cpu_tb_jmp_cache_clear(cpu);
     }
 
-    qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
+    /*
+     * Keep the size that the table has grown to: the code buffer is going
+     * to fill up with about as many TBs again, and growing the table once
+     * more would rehash all of them under the table lock.
+     */
+    qht_reset(&tb_ctx.htable);
     page_flush_tb();
 
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+    qatomic_mb_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
 
 done:
     mmap_unlock();
@@ -1017,6 +1023,63 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    tb_phys_invalidate(value, -1);
+    return false;
+}
+
+/* free the oldest regions of the code buffer, or flush it all */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_reclaim_count)
+{
+    size_t n;
+
+    mmap_lock();
+    /* Space may already have been reclaimed on request of another CPU */
+    if (tb_ctx.tb_reclaim_count != tb_reclaim_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+
+    qemu_thread_jit_write();
+    n = tcg_region_evict(DIV_ROUND_UP(tcg_region_count(), 8), tb_evict_iter);
+    qemu_thread_jit_execute();
+    if (n == 0) {
+        /* Every region is in use, there is nothing old to free */
+        mmap_unlock();
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+        return;
+    }
+
+    /*
+     * The freed regions are reused as soon as the vCPUs resume, so no
+     * jump cache may still point into them.
+     */
+    CPU_FOREACH(cpu) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+    qatomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    qatomic_mb_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
+    mmap_unlock();
+}
+
+/*
+ * Make space in the code buffer by invalidating the TBs of the regions that
+ * were filled first, so that recently translated code survives.
+ */
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_reclaim_count = qatomic_mb_read(&tb_ctx.tb_reclaim_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(tb_reclaim_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_evict,
+                              RUN_ON_CPU_HOST_INT(tb_reclaim_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1174,6 +1237,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     CPUState *cpu;
     PageDesc *p;
     uint32_t h;
+    unsigned int i;
     tb_page_addr_t phys_pc;
     uint32_t orig_cflags = tb_cflags(tb);
 
@@ -1192,6 +1256,10 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
         return;
     }
 
+    if (tb->tb_stats) {
+        qatomic_inc(&tb->tb_stats->invalidations);
+    }
+
     /* remove the TB from the page list */
     if (rm_from_page_list) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
@@ -1207,8 +1275,10 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     /* remove the TB from the hash list */
     h = tb_jmp_cache_hash_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+            if (qatomic_read(&cpu->tb_jmp_cache[h][i]) == tb) {
+                qatomic_set(&cpu->tb_jmp_cache[h][i], NULL);
+            }
         }
     }
 
@@ -1413,7 +1483,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
         /* flush must be done */
-        tb_flush(cpu);
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1427,6 +1497,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->tb_stats = NULL;
+    if (tb_stats_enabled && phys_pc != -1) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags);
+    }
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1517,6 +1591,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+    if (tb->tb_stats) {
+        TBStatistics *tbs = tb->tb_stats;
+
+        qatomic_inc(&tbs->translations);
+        qatomic_set(&tbs->guest_insns, tb->icount);
+        qatomic_set(&tbs->guest_size, tb->size);
+        qatomic_set(&tbs->host_size, gen_code_size);
+    }
+    perf_report_code(tb);
+
 #ifdef CONFIG_PROFILER
     qatomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     qatomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1961,6 +2045,9 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
                   (void *)retaddr);
     }
+    if (tb->tb_stats) {
+        qatomic_inc(&tb->tb_stats->io_exits);
+    }
     cpu_restore_state_from_tb(cpu, tb, retaddr, true);
 
     /*
@@ -2069,7 +2156,8 @@ void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, victim_hit, fill;
+    size_t jc_hit, jc_miss;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2108,6 +2196,8 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB partial flushes  %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
@@ -2115,6 +2205,16 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+
+    tlb_miss_counts(&victim_hit, &fill);
+    g_string_append_printf(buf, "TLB victim hits     %zu\n", victim_hit);
+    g_string_append_printf(buf, "TLB fills           %zu\n", fill);
+
+    tb_jmp_cache_counts(&jc_hit, &jc_miss);
+    g_string_append_printf(buf, "TB jump cache hits  %zu (%0.1f%%)\n",
+                           jc_hit, jc_hit + jc_miss ?
+                           (double)jc_hit * 100 / (jc_hit + jc_miss) : 0);
+    g_string_append_printf(buf, "TB jump cache misses %zu\n", jc_miss);
     tcg_dump_info(buf);
 }
 
@@ -2411,6 +2511,17 @@ void page_protect(tb_page_addr_t page_addr)
     }
 }
 
+static bool page_unprotect_current_tb_invalidated(uintptr_t pc)
+{
+#ifdef TARGET_HAS_PRECISE_SMC
+    TranslationBlock *current_tb = tcg_tb_lookup(pc);
+    if (current_tb) {
+        return tb_cflags(current_tb) & CF_INVALID;
+    }
+#endif
+    return false;
+}
+
 /* called from signal handler: invalidate the code and unprotect the
  * page. Return 0 if the fault was not handled, 1 if it was handled,
  * and 2 if it was handled but the caller must cause the TB to be
@@ -2424,6 +2535,23 @@ int page_unprotect(target_ulong address, uintptr_t pc)
     PageDesc *p;
     target_ulong host_start, host_end, addr;
 
+    /*
+     * Many threads writing to the same page fault at once; all but the
+     * first only need to retry once the page is writable.  PAGE_WRITE is
+     * set with release semantics after the TBs were invalidated and the
+     * host page was made writable, so check for it without mmap_lock.
+     * A stale PAGE_WRITE only makes the caller retry and fault again.
+     */
+    p = page_find(address >> TARGET_PAGE_BITS);
+    if (p) {
+        unsigned long flags = qatomic_load_acquire(&p->flags);
+
+        if ((flags & (PAGE_WRITE | PAGE_WRITE_ORG)) ==
+            (PAGE_WRITE | PAGE_WRITE_ORG)) {
+            return page_unprotect_current_tb_invalidated(pc) ? 2 : 1;
+        }
+    }
+
     /* Technically this isn't safe inside a signal handler.  However we
        know this only ever happens in a synchronous SEGV handler, so in
        practice it seems to be ok.  */
@@ -2444,20 +2572,14 @@ int page_unprotect(target_ulong address, uintptr_t pc)
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
              */
-#ifdef TARGET_HAS_PRECISE_SMC
-            TranslationBlock *current_tb = tcg_tb_lookup(pc);
-            if (current_tb) {
-                current_tb_invalidated = tb_cflags(current_tb) & CF_INVALID;
-            }
-#endif
+            current_tb_invalidated = page_unprotect_current_tb_invalidated(pc);
         } else {
             host_start = address & qemu_host_page_mask;
             host_end = host_start + qemu_host_page_size;
 
-            prot = 0;
+            prot = PAGE_WRITE;
             for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
                 p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
                 prot |= p->flags;
 
                 /* and since the content will be modified, we must invalidate
@@ -2471,6 +2593,12 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             }
             mprotect((void *)g2h_untagged(host_start), qemu_host_page_size,
                      prot & PAGE_BITS);
+
+            /* Publish PAGE_WRITE for the lockless check above */
+            for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
+                p = page_find(addr >> TARGET_PAGE_BITS);
+                qatomic_store_release(&p->flags, p->flags | PAGE_WRITE);
+            }
         }
         mmap_unlock();
         /* If current TB was invalidated return to main loop */
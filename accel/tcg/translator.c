@@ -17,6 +17,7 @@
 #include "exec/translator.h"
 #include "exec/plugin-gen.h"
 #include "sysemu/replay.h"
+#include "internal.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -51,6 +52,20 @@ static inline void translator_page_protect(DisasContextBase *dcbase,
 #endif
 }
 
+/* Count executions of the TB; a plain increment is cheap but racy */
+static void gen_tb_stats_exec(TBStatistics *tbs)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tbs->executions);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
@@ -75,6 +90,9 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
     /* Start translating.  */
     gen_tb_start(db->tb);
+    if (tb->tb_stats) {
+        gen_tb_stats_exec(tb->tb_stats);
+    }
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
@@ -31,6 +31,7 @@
 #include "qapi/qobject-input-visitor.h"
 #include "qapi/qapi-visit-audio.h"
 #include "qemu/cutils.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu-common.h"
 #include "sysemu/replay.h"
@@ -834,6 +835,15 @@ static void audio_timer (void *opaque)
     audio_reset_timer(s);
 }
 
+static void audio_kick_bh(void *opaque)
+{
+    AudioState *s = opaque;
+
+    if (s->vm_running) {
+        audio_run(s, "kick");
+    }
+}
+
 /*
  * Public API
  */
@@ -853,7 +863,20 @@ size_t AUD_write(SWVoiceOut *sw, void *buf, size_t size)
     }
 
     if (audio_get_pdo_out(hw->s->dev)->mixing_engine) {
-        return audio_pcm_sw_write(sw, buf, size);
+        AudioState *s = hw->s;
+        bool empty = sw->empty;
+        size_t ret = audio_pcm_sw_write(sw, buf, size);
+
+        /*
+         * The voice ran dry and the front end refilled it outside of the
+         * audio callback, e.g. from guest DMA.  Play the new samples now
+         * instead of up to a whole timer period later.
+         */
+        if (empty && ret && !s->in_run && s->timer_running &&
+            replay_mode == REPLAY_MODE_NONE) {
+            qemu_bh_schedule(s->kick_bh);
+        }
+        return ret;
     } else {
         return hw->pcm_ops->write(hw, buf, size);
     }
@@ -1349,9 +1372,11 @@ static void audio_run_capture (AudioState *s)
 
 void audio_run(AudioState *s, const char *msg)
 {
+    s->in_run = true;
     audio_run_out(s);
     audio_run_in(s);
     audio_run_capture(s);
+    s->in_run = false;
 
 #ifdef DEBUG_POLL
     {
@@ -1610,6 +1635,11 @@ static void free_audio_state(AudioState *s)
         s->ts = NULL;
     }
 
+    if (s->kick_bh) {
+        qemu_bh_delete(s->kick_bh);
+        s->kick_bh = NULL;
+    }
+
     g_free(s);
 }
 
@@ -1729,6 +1759,7 @@ static AudioState *audio_init(Audiodev *dev, const char *name)
     QTAILQ_INSERT_TAIL(&audio_states, s, list);
 
     s->ts = timer_new_ns(QEMU_CLOCK_VIRTUAL, audio_timer, s);
+    s->kick_bh = qemu_bh_new(audio_kick_bh, s);
 
     s->nb_hw_voices_out = audio_get_pdo_out(dev)->voices;
     s->nb_hw_voices_in = audio_get_pdo_in(dev)->voices;
@@ -232,6 +232,10 @@ typedef struct AudioState {
     bool timer_running;
     uint64_t timer_last;
 
+    /* Runs the mixer as soon as an underrun voice gets new samples */
+    QEMUBH *kick_bh;
+    bool in_run;
+
     QTAILQ_ENTRY(AudioState) list;
 } AudioState;
 
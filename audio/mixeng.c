@@ -456,6 +456,10 @@ void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
         mixeng_clear (buf, len);
         return;
     }
+    if (vol->l == nominal_volume.l && vol->r == nominal_volume.r) {
+        /* Full volume, the common case: nothing to scale */
+        return;
+    }
 
     while (len--) {
 #ifdef FLOAT_MIXENG
@@ -28,6 +28,9 @@ QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_BIND != MPOL_BIND);
 QEMU_BUILD_BUG_ON(HOST_MEM_POLICY_INTERLEAVE != MPOL_INTERLEAVE);
 #endif
 
+/* Backends whose preallocation may still run, each holds a reference */
+static GSList *prealloc_pending;
+
 char *
 host_memory_backend_get_name(HostMemoryBackend *backend)
 {
@@ -177,6 +180,26 @@ static void host_memory_backend_set_merge(Object *obj, bool value, Error **errp)
     }
 }
 
+static bool host_memory_backend_get_merge_hints(Object *obj, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    return backend->merge_hints;
+}
+
+static void host_memory_backend_set_merge_hints(Object *obj, bool value,
+                                                Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+
+    backend->merge_hints = value;
+}
+
 static bool host_memory_backend_get_dump(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -231,7 +254,8 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
-        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads, &local_err);
+        os_mem_prealloc(fd, ptr, sz, backend->prealloc_threads,
+                        backend->host_nodes, MAX_NODES, false, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -342,6 +366,8 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
 
         if (backend->merge) {
             qemu_madvise(ptr, sz, QEMU_MADV_MERGEABLE);
+        } else if (backend->merge_hints) {
+            qemu_ram_set_merge_hints(backend->mr.ram_block);
         }
         if (!backend->dump) {
             qemu_madvise(ptr, sz, QEMU_MADV_DONTDUMP);
@@ -390,19 +416,39 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
         /* Preallocate memory after the NUMA policy has been instantiated.
          * This is necessary to guarantee memory is allocated with
          * specified NUMA policy in place.
+         *
+         * Backends created on startup are preallocated while the machine
+         * and devices are being created; qmp_x_exit_preconfig() waits for
+         * them before the guest can run.
          */
         if (backend->prealloc) {
+            bool async = !phase_check(PHASE_MACHINE_READY);
+
             os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            backend->prealloc_threads, &local_err);
+                            backend->prealloc_threads, backend->host_nodes,
+                            MAX_NODES, async, &local_err);
             if (local_err) {
                 goto out;
             }
+            if (async) {
+                /* Keep the memory if the backend is deleted meanwhile */
+                prealloc_pending = g_slist_prepend(prealloc_pending,
+                                                   object_ref(backend));
+            }
         }
     }
 out:
     error_propagate(errp, local_err);
 }
 
+bool host_memory_backend_prealloc_finish(Error **errp)
+{
+    bool ret = os_mem_prealloc_finish(errp);
+
+    g_slist_free_full(g_steal_pointer(&prealloc_pending), object_unref);
+    return ret;
+}
+
 static bool
 host_memory_backend_can_be_deleted(UserCreatable *uc)
 {
@@ -485,6 +531,11 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
         host_memory_backend_set_merge);
     object_class_property_set_description(oc, "merge",
         "Mark memory as mergeable");
+    object_class_property_add_bool(oc, "x-merge-hints",
+        host_memory_backend_get_merge_hints,
+        host_memory_backend_set_merge_hints);
+    object_class_property_set_description(oc, "x-merge-hints",
+        "Mark memory as mergeable where it is likely to be identical");
     object_class_property_add_bool(oc, "dump",
         host_memory_backend_get_dump,
         host_memory_backend_set_dump);
@@ -76,6 +76,9 @@ static QTAILQ_HEAD(, BlockDriverState) all_bdrv_states =
 static QLIST_HEAD(, BlockDriver) bdrv_drivers =
     QLIST_HEAD_INITIALIZER(bdrv_drivers);
 
+/* Incremented whenever block status results of a chain may change */
+static unsigned int bdrv_graph_gen;
+
 static BlockDriverState *bdrv_open_inherit(const char *filename,
                                            const char *reference,
                                            QDict *options, int flags,
@@ -412,6 +415,7 @@ BlockDriverState *bdrv_new(void)
 
     qemu_co_mutex_init(&bs->bsc_modify_lock);
     bs->block_status_cache = g_new0(BdrvBlockStatusCache, 1);
+    qemu_co_mutex_init(&bs->chain_cache_lock);
 
     for (i = 0; i < bdrv_drain_all_count; i++) {
         bdrv_drained_begin(bs);
@@ -2753,6 +2757,8 @@ static void bdrv_replace_child_noperm(BdrvChild **childp,
     assert(!child->frozen);
     assert(old_bs != new_bs);
 
+    qatomic_inc(&bdrv_graph_gen);
+
     if (old_bs && new_bs) {
         assert(bdrv_get_aio_context(old_bs) == bdrv_get_aio_context(new_bs));
     }
@@ -4813,6 +4819,10 @@ static void bdrv_close(BlockDriverState *bs)
     bs->full_open_options = NULL;
     g_free(bs->block_status_cache);
     bs->block_status_cache = NULL;
+    if (bs->chain_cache) {
+        g_array_free(bs->chain_cache, true);
+        bs->chain_cache = NULL;
+    }
 
     bdrv_release_named_dirty_bitmaps(bs);
     assert(QLIST_EMPTY(&bs->dirty_bitmaps));
@@ -5246,6 +5256,7 @@ static void bdrv_delete(BlockDriverState *bs)
 
     bdrv_close(bs);
 
+    g_free(bs->latency_log_histogram);
     g_free(bs);
 }
 
@@ -5854,10 +5865,14 @@ BlockDeviceInfoList *bdrv_named_nodes_list(bool flat,
 {
     BlockDeviceInfoList *list;
     BlockDriverState *bs;
+    g_autoptr(GHashTable) image_cache =
+        g_hash_table_new_full(NULL, NULL, NULL,
+                              (GDestroyNotify)qapi_free_ImageInfo);
 
     list = NULL;
     QTAILQ_FOREACH(bs, &graph_bdrv_states, node_list) {
-        BlockDeviceInfo *info = bdrv_block_device_info(NULL, bs, flat, errp);
+        BlockDeviceInfo *info = bdrv_block_device_info(NULL, bs, flat,
+                                                       image_cache, errp);
         if (!info) {
             qapi_free_BlockDeviceInfoList(list);
             return NULL;
@@ -6400,6 +6415,9 @@ int coroutine_fn bdrv_co_invalidate_cache(BlockDriverState *bs, Error **errp)
         return -ENOMEDIUM;
     }
 
+    /* Another process may have changed the image */
+    qatomic_inc(&bdrv_graph_gen);
+
     QLIST_FOREACH(child, &bs->children, next) {
         bdrv_co_invalidate_cache(child->bs, &local_err);
         if (local_err) {
@@ -7715,6 +7733,8 @@ int bdrv_make_empty(BdrvChild *c, Error **errp)
     }
 
     ret = drv->bdrv_make_empty(c->bs);
+    /* The driver bypasses the generic write path */
+    qatomic_inc(&c->bs->write_gen);
     if (ret < 0) {
         error_setg_errno(errp, -ret, "Failed to empty %s",
                          c->bs->filename);
@@ -7904,6 +7924,14 @@ static bool bdrv_bsc_range_overlaps_locked(BlockDriverState *bs,
     return overlaps;
 }
 
+/**
+ * See block_int.h for this function's documentation.
+ */
+unsigned int bdrv_get_graph_gen(void)
+{
+    return qatomic_read(&bdrv_graph_gen);
+}
+
 /**
  * See block_int.h for this function's documentation.
  */
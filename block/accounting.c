@@ -182,6 +182,55 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+/* Returns the start time to pass to block_latency_log_histogram_account() */
+int64_t block_latency_log_histogram_start(void)
+{
+    return qemu_clock_get_ns(clock_type);
+}
+
+static int block_latency_log_histogram_bin(uint64_t latency_ns)
+{
+    const int sub_bits = BLOCK_LOG_HISTOGRAM_SUB_BITS;
+    int msb;
+
+    if (latency_ns < (1 << sub_bits)) {
+        return latency_ns;
+    }
+
+    msb = 63 - clz64(latency_ns);
+    return ((msb - sub_bits + 1) << sub_bits) +
+           ((latency_ns >> (msb - sub_bits)) & ((1 << sub_bits) - 1));
+}
+
+/* Returns the smallest latency in nanoseconds that falls into @bin */
+uint64_t block_latency_log_histogram_bin_start(int bin)
+{
+    const int sub_bits = BLOCK_LOG_HISTOGRAM_SUB_BITS;
+
+    assert(bin >= 0 && bin < BLOCK_LOG_HISTOGRAM_BINS);
+    if (bin < (1 << sub_bits)) {
+        return bin;
+    }
+
+    return (uint64_t)((1 << sub_bits) + (bin & ((1 << sub_bits) - 1))) <<
+           ((bin >> sub_bits) - 1);
+}
+
+/*
+ * Accounts a request of @type that was started at @start_time_ns.  This may
+ * be called concurrently from any thread.
+ */
+void block_latency_log_histogram_account(BlockLatencyLogHistogram *hist,
+                                         enum BlockAcctType type,
+                                         int64_t start_time_ns)
+{
+    int64_t latency_ns = qemu_clock_get_ns(clock_type) - start_time_ns;
+    int bin = block_latency_log_histogram_bin(MAX(latency_ns, 0));
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    stat64_add(&hist->bins[type][bin], 1);
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -1418,6 +1418,11 @@ static void blk_aio_complete_bh(void *opaque)
     blk_aio_complete(acb);
 }
 
+/*
+ * Callers outside of the BlockBackend's AioContext must hold that AioContext:
+ * the coroutine is then scheduled there and cannot complete @acb before this
+ * function has looked at acb->rwco.ret.
+ */
 static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset,
                                 int64_t bytes,
                                 void *iobuf, CoroutineEntry co_entry,
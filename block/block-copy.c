@@ -28,8 +28,19 @@
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
+
+/* Adaptive sizing: start values, limit and measurement interval */
+#define BLOCK_COPY_ADAPT_START_WORKERS 4
+#define BLOCK_COPY_ADAPT_MAX_CHUNK (16 * MiB)
+#define BLOCK_COPY_ADAPT_INTERVAL 500000000LL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
+typedef enum {
+    BLOCK_COPY_ADAPT_NONE,
+    BLOCK_COPY_ADAPT_WORKERS,
+    BLOCK_COPY_ADAPT_CHUNK,
+} BlockCopyAdaptStep;
+
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
     COPY_READ_WRITE,
@@ -47,6 +58,7 @@ typedef struct BlockCopyCallState {
     int64_t bytes;
     int max_workers;
     int64_t max_chunk;
+    bool adaptive;
     bool ignore_ratelimit;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
@@ -60,6 +72,20 @@ typedef struct BlockCopyCallState {
     /* To reference all call states from BlockCopyState */
     QLIST_ENTRY(BlockCopyCallState) list;
 
+    /*
+     * Adaptive sizing of workers and chunks, see block_copy_adapt().
+     * Protected by lock in BlockCopyState.
+     */
+    int cur_workers;
+    int chunk_shift;
+    BlockCopyAdaptStep last_step;
+    uint64_t best_throughput; /* bytes per second */
+    int64_t best_latency_ns;
+    int64_t window_start_ns;
+    int64_t window_bytes;
+    int64_t window_latency_ns;
+    int window_tasks;
+
     /*
      * Fields that report information about return values and erros.
      * Protected by lock in BlockCopyState.
@@ -215,6 +241,21 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+/* Called with lock held */
+static int64_t block_copy_call_chunk_size(BlockCopyCallState *call_state)
+{
+    BlockCopyState *s = call_state->s;
+    int64_t chunk = block_copy_chunk_size(s);
+
+    if (call_state->adaptive && s->method != COPY_READ_WRITE_CLUSTER) {
+        int64_t limit = MIN(s->max_transfer, BLOCK_COPY_ADAPT_MAX_CHUNK);
+
+        chunk = MAX(chunk, MIN(chunk << call_state->chunk_shift, limit));
+    }
+
+    return MIN_NON_ZERO(chunk, call_state->max_chunk);
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
  * the beginning of it.
@@ -227,7 +268,7 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
     int64_t max_chunk;
 
     QEMU_LOCK_GUARD(&s->lock);
-    max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    max_chunk = block_copy_call_chunk_size(call_state);
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -581,6 +622,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     BlockCopyState *s = t->s;
     bool error_is_read = false;
     BlockCopyMethod method = t->method;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int ret;
 
     ret = block_copy_do_copy(s, t->offset, t->bytes, &method, &error_is_read);
@@ -590,6 +632,13 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
             s->method = method;
         }
 
+        if (ret >= 0 && t->method != COPY_WRITE_ZEROES) {
+            t->call_state->window_bytes += t->bytes;
+            t->call_state->window_latency_ns +=
+                qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
+            t->call_state->window_tasks++;
+        }
+
         if (ret < 0) {
             if (!t->call_state->ret) {
                 t->call_state->ret = ret;
@@ -713,6 +762,85 @@ int64_t block_copy_reset_unallocated(BlockCopyState *s,
     return ret;
 }
 
+/*
+ * block_copy_adapt
+ *
+ * Tune the number of workers and the chunk size of an adaptive call from the
+ * throughput and latency of the copy requests completed in the last interval
+ * (zero writes are not counted).  This is a simple hill climb: as long as a
+ * step increases the throughput by more than 10%, the next one is tried,
+ * first doubling the number of workers up to @max_workers, then the chunk
+ * size.  A step that doesn't pay off is reverted.  If the latency grows a
+ * lot without a gain in throughput, requests are only queueing up on the
+ * way, so the number of workers is halved.  A large drop in throughput
+ * means that the conditions changed, so probing starts again.
+ */
+static void coroutine_fn block_copy_adapt(BlockCopyCallState *call_state,
+                                          AioTaskPool *aio)
+{
+    BlockCopyState *s = call_state->s;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - call_state->window_start_ns;
+    uint64_t throughput;
+    int64_t latency, chunk;
+    int workers;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    if (elapsed < BLOCK_COPY_ADAPT_INTERVAL ||
+        call_state->window_tasks < call_state->cur_workers) {
+        return;
+    }
+
+    throughput = muldiv64(call_state->window_bytes, NANOSECONDS_PER_SECOND,
+                          elapsed);
+    latency = call_state->window_latency_ns / call_state->window_tasks;
+    workers = call_state->cur_workers;
+    chunk = block_copy_call_chunk_size(call_state);
+
+    if (throughput * 10 > call_state->best_throughput * 11) {
+        call_state->best_throughput = throughput;
+        call_state->best_latency_ns = latency;
+        call_state->last_step = BLOCK_COPY_ADAPT_NONE;
+        if (workers < call_state->max_workers) {
+            call_state->cur_workers = MIN((int64_t)workers * 2,
+                                          call_state->max_workers);
+            call_state->last_step = BLOCK_COPY_ADAPT_WORKERS;
+        } else {
+            call_state->chunk_shift++;
+            if (block_copy_call_chunk_size(call_state) > chunk) {
+                call_state->last_step = BLOCK_COPY_ADAPT_CHUNK;
+            } else {
+                call_state->chunk_shift--;
+            }
+        }
+    } else if (call_state->last_step == BLOCK_COPY_ADAPT_WORKERS) {
+        call_state->cur_workers = MAX(workers / 2, 1);
+        call_state->last_step = BLOCK_COPY_ADAPT_NONE;
+    } else if (call_state->last_step == BLOCK_COPY_ADAPT_CHUNK) {
+        call_state->chunk_shift--;
+        call_state->last_step = BLOCK_COPY_ADAPT_NONE;
+    } else if (throughput * 10 < call_state->best_throughput * 9) {
+        call_state->best_throughput = throughput;
+        call_state->best_latency_ns = latency;
+    } else if (latency > call_state->best_latency_ns * 2 && workers > 1) {
+        call_state->cur_workers = workers / 2;
+        call_state->best_latency_ns = latency;
+    }
+
+    trace_block_copy_adapt(s, throughput, latency, call_state->cur_workers,
+                           block_copy_call_chunk_size(call_state));
+
+    if (aio) {
+        aio_task_pool_set_max_busy_tasks(aio, call_state->cur_workers);
+    }
+
+    call_state->window_start_ns = now;
+    call_state->window_bytes = 0;
+    call_state->window_latency_ns = 0;
+    call_state->window_tasks = 0;
+}
+
 /*
  * block_copy_dirty_clusters
  *
@@ -747,6 +875,10 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         BlockCopyTask *task;
         int64_t status_bytes;
 
+        if (call_state->adaptive) {
+            block_copy_adapt(call_state, aio);
+        }
+
         task = block_copy_task_create(s, call_state, offset, bytes);
         if (!task) {
             /* No more dirty bits in the bitmap */
@@ -799,7 +931,9 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         bytes = end - offset;
 
         if (!aio && bytes) {
-            aio = aio_task_pool_new(call_state->max_workers);
+            aio = aio_task_pool_new(call_state->adaptive ?
+                                    call_state->cur_workers :
+                                    call_state->max_workers);
         }
 
         ret = block_copy_task_run(aio, task);
@@ -928,6 +1062,7 @@ static void coroutine_fn block_copy_async_co_entry(void *opaque)
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -939,6 +1074,9 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .adaptive = adaptive,
+        .cur_workers = MIN(BLOCK_COPY_ADAPT_START_WORKERS, max_workers),
+        .window_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME),
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -15,6 +15,7 @@
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
 #include "trace.h"
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
 #include "qapi/error.h"
@@ -29,6 +30,9 @@ enum {
      * contiguous regions of the image is efficient.
      */
     COMMIT_BUFFER_SIZE = 512 * 1024, /* in bytes */
+
+    /* Number of chunks copied in parallel */
+    COMMIT_MAX_WORKERS = 8,
 };
 
 typedef struct CommitBlockJob {
@@ -42,8 +46,21 @@ typedef struct CommitBlockJob {
     bool base_read_only;
     bool chain_frozen;
     char *backing_file_str;
+
+    /* Failed chunks since the last error was handled */
+    int err_ret;
+    bool err_in_source;
+    int64_t err_offset;         /* the first one */
+    int64_t err_bytes;          /* all of them */
 } CommitBlockJob;
 
+typedef struct CommitTask {
+    AioTask task;
+    CommitBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} CommitTask;
+
 static int commit_prepare(Job *job)
 {
     CommitBlockJob *s = container_of(job, CommitBlockJob, common.job);
@@ -112,14 +129,48 @@ static void commit_clean(Job *job)
     blk_unref(s->top);
 }
 
+static void commit_record_error(CommitBlockJob *s, int64_t offset,
+                                int64_t bytes, int ret, bool error_in_source)
+{
+    if (!s->err_ret || offset < s->err_offset) {
+        s->err_ret = ret;
+        s->err_in_source = error_in_source;
+        s->err_offset = offset;
+    }
+    s->err_bytes += bytes;
+}
+
+static int coroutine_fn commit_task_entry(AioTask *task)
+{
+    CommitTask *t = container_of(task, CommitTask, task);
+    CommitBlockJob *s = t->s;
+    QEMU_AUTO_VFREE void *buf = blk_blockalign(s->top, t->bytes);
+    int ret;
+
+    ret = blk_co_pread(s->top, t->offset, t->bytes, buf, 0);
+    if (ret < 0) {
+        commit_record_error(s, t->offset, t->bytes, ret, true);
+        return 0;
+    }
+    ret = blk_co_pwrite(s->base, t->offset, t->bytes, buf, 0);
+    if (ret < 0) {
+        commit_record_error(s, t->offset, t->bytes, ret, false);
+        return 0;
+    }
+
+    /* Publish progress */
+    job_progress_update(&s->common.job, t->bytes);
+    return 0;
+}
+
 static int coroutine_fn commit_run(Job *job, Error **errp)
 {
     CommitBlockJob *s = container_of(job, CommitBlockJob, common.job);
+    AioTaskPool *aio;
     int64_t offset;
     uint64_t delay_ns = 0;
-    int ret = 0;
+    int ret;
     int64_t n = 0; /* bytes */
-    QEMU_AUTO_VFREE void *buf = NULL;
     int64_t len, base_len;
 
     len = blk_getlength(s->top);
@@ -140,57 +191,89 @@ static int coroutine_fn commit_run(Job *job, Error **errp)
         }
     }
 
-    buf = blk_blockalign(s->top, COMMIT_BUFFER_SIZE);
+    aio = aio_task_pool_new(COMMIT_MAX_WORKERS);
+    ret = 0;
 
-    for (offset = 0; offset < len; offset += n) {
-        bool copy;
-        bool error_in_source = true;
+    for (offset = 0; ; offset += n) {
+        if (offset >= len) {
+            /* The last chunks may still fail */
+            aio_task_pool_wait_all(aio);
+            if (!s->err_ret) {
+                break;
+            }
+        }
 
-        /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+        /*
+         * Note that even when no rate limit is applied we need to yield
+         * here so that bdrv_drain_all() returns.
          */
         job_sleep_ns(&s->common.job, delay_ns);
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
+
+        if (s->err_ret) {
+            BlockErrorAction action;
+
+            aio_task_pool_wait_all(aio);
+            action = block_job_error_action(&s->common, s->on_error,
+                                            s->err_in_source, -s->err_ret);
+            if (action == BLOCK_ERROR_ACTION_REPORT) {
+                ret = s->err_ret;
+                break;
+            }
+
+            /*
+             * Unlike stream, commit retries failed chunks for "ignore" as
+             * well as for "stop", so go back to the first failed chunk.
+             * Everything after it that did not fail has already been
+             * counted, so it is copied again without progress.
+             */
+            job_progress_increase_remaining(&s->common.job,
+                offset - s->err_offset - s->err_bytes);
+            offset = s->err_offset;
+            s->err_ret = 0;
+            s->err_bytes = 0;
+            n = 0;
+            delay_ns = 0;
+            continue;
+        }
+
         /* Copy if allocated above the base */
         ret = bdrv_is_allocated_above(blk_bs(s->top), s->base_overlay, true,
                                       offset, COMMIT_BUFFER_SIZE, &n);
-        copy = (ret > 0);
         trace_commit_one_iteration(s, offset, n, ret);
-        if (copy) {
-            assert(n < SIZE_MAX);
-
-            ret = blk_co_pread(s->top, offset, n, buf, 0);
-            if (ret >= 0) {
-                ret = blk_co_pwrite(s->base, offset, n, buf, 0);
-                if (ret < 0) {
-                    error_in_source = false;
-                }
-            }
-        }
         if (ret < 0) {
-            BlockErrorAction action =
-                block_job_error_action(&s->common, s->on_error,
-                                       error_in_source, -ret);
-            if (action == BLOCK_ERROR_ACTION_REPORT) {
-                return ret;
-            } else {
-                n = 0;
-                continue;
-            }
+            commit_record_error(s, offset, 0, ret, true);
+            ret = 0;
+            n = 0;
+            continue;
         }
-        /* Publish progress */
-        job_progress_update(&s->common.job, n);
 
-        if (copy) {
+        if (ret > 0) {
+            CommitTask *t = g_new(CommitTask, 1);
+
+            assert(n < SIZE_MAX);
+            *t = (CommitTask) {
+                .task.func = commit_task_entry,
+                .s = s,
+                .offset = offset,
+                .bytes = n,
+            };
+            aio_task_pool_start_task(aio, &t->task);
             delay_ns = block_job_ratelimit_get_delay(&s->common, n);
         } else {
+            /* Publish progress */
+            job_progress_update(&s->common.job, n);
             delay_ns = 0;
         }
+        ret = 0;
     }
 
-    return 0;
+    aio_task_pool_wait_all(aio);
+    aio_task_pool_free(aio);
+
+    return ret;
 }
 
 static const BlockJobDriver commit_job_driver = {
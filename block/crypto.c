@@ -21,7 +21,9 @@
 #include "qemu/osdep.h"
 
 #include "block/block_int.h"
+#include "block/aio_task.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -35,9 +37,20 @@
 
 typedef struct BlockCrypto BlockCrypto;
 
+/*
+ * Maximum number of threads that encrypt or decrypt data at the same time;
+ * each of them has its own cipher context.
+ */
+#define BLOCK_CRYPTO_MAX_THREADS 4
+
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
+
+    /* Limits the number of cipher operations running in the thread pool */
+    CoMutex lock;
+    CoQueue thread_task_queue;
+    int nb_threads;
 };
 
 
@@ -290,11 +303,13 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     if (flags & BDRV_O_NO_IO) {
         cflags |= QCRYPTO_BLOCK_OPEN_NO_IO;
     }
+    qemu_co_mutex_init(&crypto->lock);
+    qemu_co_queue_init(&crypto->thread_task_queue);
     crypto->block = qcrypto_block_open(open_opts, NULL,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
-                                       1,
+                                       BLOCK_CRYPTO_MAX_THREADS,
                                        errp);
 
     if (!crypto->block) {
@@ -391,136 +406,231 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
 }
 
 /*
- * 1 MB bounce buffer gives good performance / memory tradeoff
- * when using cache=none|directsync.
+ * Requests are split into tasks of up to 256 KB, of which up to
+ * BLOCK_CRYPTO_MAX_THREADS run in parallel: as with a single 1 MB bounce
+ * buffer, this gives good performance / memory tradeoff when using
+ * cache=none|directsync, and the tasks of a request are encrypted or
+ * decrypted on several CPUs while their I/O is in flight.
  */
-#define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
+#define BLOCK_CRYPTO_MAX_IO_SIZE (256 * 1024)
 
-static coroutine_fn int
-block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
-                       QEMUIOVector *qiov, BdrvRequestFlags flags)
+typedef struct BlockCryptoEncDecData {
+    QCryptoBlock *block;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+    bool encrypt;
+} BlockCryptoEncDecData;
+
+static int block_crypto_encdec_pool_func(void *opaque)
 {
-    BlockCrypto *crypto = bs->opaque;
-    uint64_t cur_bytes; /* number of bytes in current iteration */
-    uint64_t bytes_done = 0;
-    uint8_t *cipher_data = NULL;
-    QEMUIOVector hd_qiov;
-    int ret = 0;
-    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
-    uint64_t payload_offset = qcrypto_block_get_payload_offset(crypto->block);
+    BlockCryptoEncDecData *data = opaque;
 
-    assert(!flags);
-    assert(payload_offset < INT64_MAX);
-    assert(QEMU_IS_ALIGNED(offset, sector_size));
-    assert(QEMU_IS_ALIGNED(bytes, sector_size));
+    if (data->encrypt) {
+        return qcrypto_block_encrypt(data->block, data->offset,
+                                     data->buf, data->len, NULL);
+    }
+    return qcrypto_block_decrypt(data->block, data->offset,
+                                 data->buf, data->len, NULL);
+}
 
-    qemu_iovec_init(&hd_qiov, qiov->niov);
+/* Encrypts or decrypts @len bytes at guest offset @offset in a worker thread */
+static int coroutine_fn
+block_crypto_co_encdec(BlockDriverState *bs, uint64_t offset,
+                       uint8_t *buf, size_t len, bool encrypt)
+{
+    BlockCrypto *crypto = bs->opaque;
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    BlockCryptoEncDecData arg = {
+        .block = crypto->block,
+        .offset = offset,
+        .buf = buf,
+        .len = len,
+        .encrypt = encrypt,
+    };
+    int ret;
 
-    /* Bounce buffer because we don't wish to expose cipher text
-     * in qiov which points to guest memory.
-     */
-    cipher_data =
-        qemu_try_blockalign(bs->file->bs, MIN(BLOCK_CRYPTO_MAX_IO_SIZE,
-                                              qiov->size));
-    if (cipher_data == NULL) {
-        ret = -ENOMEM;
-        goto cleanup;
+    qemu_co_mutex_lock(&crypto->lock);
+    while (crypto->nb_threads >= BLOCK_CRYPTO_MAX_THREADS) {
+        qemu_co_queue_wait(&crypto->thread_task_queue, &crypto->lock);
     }
+    crypto->nb_threads++;
+    qemu_co_mutex_unlock(&crypto->lock);
 
-    while (bytes) {
-        cur_bytes = MIN(bytes, BLOCK_CRYPTO_MAX_IO_SIZE);
+    ret = thread_pool_submit_co(pool, block_crypto_encdec_pool_func, &arg);
 
-        qemu_iovec_reset(&hd_qiov);
-        qemu_iovec_add(&hd_qiov, cipher_data, cur_bytes);
+    qemu_co_mutex_lock(&crypto->lock);
+    crypto->nb_threads--;
+    qemu_co_queue_next(&crypto->thread_task_queue);
+    qemu_co_mutex_unlock(&crypto->lock);
 
-        ret = bdrv_co_preadv(bs->file, payload_offset + offset + bytes_done,
-                             cur_bytes, &hd_qiov, 0);
-        if (ret < 0) {
-            goto cleanup;
-        }
+    return ret < 0 ? -EIO : 0;
+}
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
-            goto cleanup;
-        }
+typedef struct BlockCryptoAioTask {
+    AioTask task;
 
-        qemu_iovec_from_buf(qiov, bytes_done, cipher_data, cur_bytes);
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint64_t bytes;
+    QEMUIOVector *qiov;
+    size_t qiov_offset;
+    BdrvRequestFlags flags;
+} BlockCryptoAioTask;
 
-        bytes -= cur_bytes;
-        bytes_done += cur_bytes;
+static coroutine_fn int block_crypto_co_preadv_task_entry(AioTask *task)
+{
+    BlockCryptoAioTask *t = container_of(task, BlockCryptoAioTask, task);
+    BlockDriverState *bs = t->bs;
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t payload_offset = qcrypto_block_get_payload_offset(crypto->block);
+    uint8_t *cipher_data;
+    int ret;
+
+    /*
+     * Bounce buffer because we don't wish to expose cipher text
+     * in qiov which points to guest memory.
+     */
+    cipher_data = qemu_try_blockalign(bs->file->bs, t->bytes);
+    if (cipher_data == NULL) {
+        return -ENOMEM;
     }
 
- cleanup:
-    qemu_iovec_destroy(&hd_qiov);
-    qemu_vfree(cipher_data);
+    ret = bdrv_co_pread(bs->file, payload_offset + t->offset, t->bytes,
+                        cipher_data, 0);
+    if (ret < 0) {
+        goto out;
+    }
+
+    ret = block_crypto_co_encdec(bs, t->offset, cipher_data, t->bytes, false);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_iovec_from_buf(t->qiov, t->qiov_offset, cipher_data, t->bytes);
 
+out:
+    qemu_vfree(cipher_data);
     return ret;
 }
 
-
-static coroutine_fn int
-block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
-                        QEMUIOVector *qiov, BdrvRequestFlags flags)
+static coroutine_fn int block_crypto_co_pwritev_task_entry(AioTask *task)
 {
+    BlockCryptoAioTask *t = container_of(task, BlockCryptoAioTask, task);
+    BlockDriverState *bs = t->bs;
     BlockCrypto *crypto = bs->opaque;
-    uint64_t cur_bytes; /* number of bytes in current iteration */
-    uint64_t bytes_done = 0;
-    uint8_t *cipher_data = NULL;
-    QEMUIOVector hd_qiov;
-    int ret = 0;
-    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
     uint64_t payload_offset = qcrypto_block_get_payload_offset(crypto->block);
+    uint8_t *cipher_data;
+    int ret;
 
-    assert(!(flags & ~BDRV_REQ_FUA));
-    assert(payload_offset < INT64_MAX);
-    assert(QEMU_IS_ALIGNED(offset, sector_size));
-    assert(QEMU_IS_ALIGNED(bytes, sector_size));
-
-    qemu_iovec_init(&hd_qiov, qiov->niov);
-
-    /* Bounce buffer because we're not permitted to touch
+    /*
+     * Bounce buffer because we're not permitted to touch
      * contents of qiov - it points to guest memory.
      */
-    cipher_data =
-        qemu_try_blockalign(bs->file->bs, MIN(BLOCK_CRYPTO_MAX_IO_SIZE,
-                                              qiov->size));
+    cipher_data = qemu_try_blockalign(bs->file->bs, t->bytes);
     if (cipher_data == NULL) {
-        ret = -ENOMEM;
-        goto cleanup;
+        return -ENOMEM;
     }
 
-    while (bytes) {
-        cur_bytes = MIN(bytes, BLOCK_CRYPTO_MAX_IO_SIZE);
+    qemu_iovec_to_buf(t->qiov, t->qiov_offset, cipher_data, t->bytes);
 
-        qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
+    ret = block_crypto_co_encdec(bs, t->offset, cipher_data, t->bytes, true);
+    if (ret < 0) {
+        goto out;
+    }
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
-            goto cleanup;
-        }
+    ret = bdrv_co_pwrite(bs->file, payload_offset + t->offset, t->bytes,
+                         cipher_data, t->flags);
 
-        qemu_iovec_reset(&hd_qiov);
-        qemu_iovec_add(&hd_qiov, cipher_data, cur_bytes);
+out:
+    qemu_vfree(cipher_data);
+    return ret;
+}
+
+static coroutine_fn int
+block_crypto_co_rw(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                   QEMUIOVector *qiov, BdrvRequestFlags flags,
+                   AioTaskFunc func)
+{
+    AioTaskPool *aio = NULL;
+    uint64_t bytes_done = 0;
+    int ret = 0;
+
+    while (bytes_done < bytes && (!aio || aio_task_pool_status(aio) == 0)) {
+        uint64_t cur_bytes = MIN(bytes - bytes_done, BLOCK_CRYPTO_MAX_IO_SIZE);
+        BlockCryptoAioTask local_task;
+        BlockCryptoAioTask *task;
 
-        ret = bdrv_co_pwritev(bs->file, payload_offset + offset + bytes_done,
-                              cur_bytes, &hd_qiov, flags);
-        if (ret < 0) {
-            goto cleanup;
+        if (!aio && cur_bytes != bytes) {
+            aio = aio_task_pool_new(BLOCK_CRYPTO_MAX_THREADS);
+        }
+        task = aio ? g_new(BlockCryptoAioTask, 1) : &local_task;
+        *task = (BlockCryptoAioTask) {
+            .task.func = func,
+            .bs = bs,
+            .offset = offset + bytes_done,
+            .bytes = cur_bytes,
+            .qiov = qiov,
+            .qiov_offset = bytes_done,
+            .flags = flags,
+        };
+
+        if (aio) {
+            aio_task_pool_start_task(aio, &task->task);
+        } else {
+            ret = func(&task->task);
+            if (ret < 0) {
+                break;
+            }
         }
 
-        bytes -= cur_bytes;
         bytes_done += cur_bytes;
     }
 
- cleanup:
-    qemu_iovec_destroy(&hd_qiov);
-    qemu_vfree(cipher_data);
+    if (aio) {
+        aio_task_pool_wait_all(aio);
+        ret = aio_task_pool_status(aio);
+        g_free(aio);
+    }
 
     return ret;
 }
 
+static coroutine_fn int
+block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                       QEMUIOVector *qiov, BdrvRequestFlags flags)
+{
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    uint64_t payload_offset = qcrypto_block_get_payload_offset(crypto->block);
+
+    assert(!flags);
+    assert(payload_offset < INT64_MAX);
+    assert(QEMU_IS_ALIGNED(offset, sector_size));
+    assert(QEMU_IS_ALIGNED(bytes, sector_size));
+
+    return block_crypto_co_rw(bs, offset, bytes, qiov, 0,
+                              block_crypto_co_preadv_task_entry);
+}
+
+
+static coroutine_fn int
+block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                        QEMUIOVector *qiov, BdrvRequestFlags flags)
+{
+    BlockCrypto *crypto = bs->opaque;
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    uint64_t payload_offset = qcrypto_block_get_payload_offset(crypto->block);
+
+    assert(!(flags & ~BDRV_REQ_FUA));
+    assert(payload_offset < INT64_MAX);
+    assert(QEMU_IS_ALIGNED(offset, sector_size));
+    assert(QEMU_IS_ALIGNED(bytes, sector_size));
+
+    return block_crypto_co_rw(bs, offset, bytes, qiov, flags,
+                              block_crypto_co_pwritev_task_entry);
+}
+
 static void block_crypto_refresh_limits(BlockDriverState *bs, Error **errp)
 {
     BlockCrypto *crypto = bs->opaque;
@@ -28,6 +28,8 @@
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "block/block_int.h"
+#include "block/aio_task.h"
+#include "qemu/queue.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qstring.h"
 #include "crypto/secret.h"
@@ -43,6 +45,7 @@
 #define CURL_NUM_STATES 8
 #define CURL_NUM_ACB    8
 #define CURL_TIMEOUT_MAX 10000
+#define CURL_CACHE_BLOCK_SIZE (64 * 1024)
 
 #define CURL_BLOCK_OPT_URL       "url"
 #define CURL_BLOCK_OPT_READAHEAD "readahead"
@@ -54,10 +57,13 @@
 #define CURL_BLOCK_OPT_PASSWORD_SECRET "password-secret"
 #define CURL_BLOCK_OPT_PROXY_USERNAME "proxy-username"
 #define CURL_BLOCK_OPT_PROXY_PASSWORD_SECRET "proxy-password-secret"
+#define CURL_BLOCK_OPT_CHUNK_SIZE "chunk-size"
+#define CURL_BLOCK_OPT_CACHE_SIZE "cache-size"
 
 #define CURL_BLOCK_OPT_READAHEAD_DEFAULT (256 * 1024)
 #define CURL_BLOCK_OPT_SSLVERIFY_DEFAULT true
 #define CURL_BLOCK_OPT_TIMEOUT_DEFAULT 5
+#define CURL_BLOCK_OPT_CHUNK_SIZE_DEFAULT (1024 * 1024)
 
 struct BDRVCURLState;
 struct CURLState;
@@ -67,6 +73,7 @@ static bool libcurl_initialized;
 typedef struct CURLAIOCB {
     Coroutine *co;
     QEMUIOVector *qiov;
+    size_t qiov_offset;
 
     uint64_t offset;
     uint64_t bytes;
@@ -76,6 +83,13 @@ typedef struct CURLAIOCB {
     size_t end;
 } CURLAIOCB;
 
+/* A CURL_CACHE_BLOCK_SIZE block of the image, the last one may be shorter */
+typedef struct CURLCacheEntry {
+    uint64_t index;
+    char *buf;
+    QTAILQ_ENTRY(CURLCacheEntry) next;
+} CURLCacheEntry;
+
 typedef struct CURLSocket {
     int fd;
     struct BDRVCURLState *s;
@@ -114,6 +128,13 @@ typedef struct BDRVCURLState {
     char *password;
     char *proxyusername;
     char *proxypassword;
+    uint64_t chunk_size;
+
+    /* LRU cache of image blocks, most recently used first */
+    GHashTable *cache; /* &entry->index -> entry */
+    QTAILQ_HEAD(, CURLCacheEntry) cache_lru;
+    uint64_t cache_entries;
+    uint64_t cache_max_entries;
 } BDRVCURLState;
 
 static void curl_clean_state(CURLState *s);
@@ -261,6 +282,118 @@ read_end:
     return size * nmemb;
 }
 
+static uint64_t curl_cache_block_len(BDRVCURLState *s, uint64_t index)
+{
+    uint64_t start = index * CURL_CACHE_BLOCK_SIZE;
+
+    return MIN(CURL_CACHE_BLOCK_SIZE, s->len - start);
+}
+
+/*
+ * Called with s->mutex held.  Copies [start, start + len) to acb->qiov if
+ * all the blocks it covers are cached.
+ */
+static bool curl_cache_read(BDRVCURLState *s, uint64_t start, uint64_t len,
+                            CURLAIOCB *acb)
+{
+    uint64_t clamped_end = MIN(start + len, s->len);
+    uint64_t first, last, i;
+    size_t qiov_offset = acb->qiov_offset;
+
+    if (!s->cache || clamped_end <= start) {
+        return false;
+    }
+
+    first = start / CURL_CACHE_BLOCK_SIZE;
+    last = (clamped_end - 1) / CURL_CACHE_BLOCK_SIZE;
+    for (i = first; i <= last; i++) {
+        if (!g_hash_table_contains(s->cache, &i)) {
+            return false;
+        }
+    }
+
+    for (i = first; i <= last; i++) {
+        CURLCacheEntry *entry = g_hash_table_lookup(s->cache, &i);
+        uint64_t block_start = i * CURL_CACHE_BLOCK_SIZE;
+        uint64_t from = MAX(start, block_start);
+        uint64_t to = MIN(clamped_end, block_start + CURL_CACHE_BLOCK_SIZE);
+
+        qemu_iovec_from_buf(acb->qiov, qiov_offset,
+                            entry->buf + (from - block_start), to - from);
+        qiov_offset += to - from;
+
+        QTAILQ_REMOVE(&s->cache_lru, entry, next);
+        QTAILQ_INSERT_HEAD(&s->cache_lru, entry, next);
+    }
+    if (clamped_end - start < len) {
+        qemu_iovec_memset(acb->qiov, qiov_offset, 0,
+                          len - (clamped_end - start));
+    }
+
+    trace_curl_cache_hit(start, len);
+    acb->ret = 0;
+    return true;
+}
+
+/*
+ * Called with s->mutex held.  Adds the blocks that were completely
+ * downloaded by @state to the cache, evicting the least recently used ones.
+ */
+static void curl_cache_insert(BDRVCURLState *s, CURLState *state)
+{
+    uint64_t buf_end = state->buf_start + state->buf_off;
+    uint64_t i;
+
+    if (!s->cache) {
+        return;
+    }
+
+    for (i = DIV_ROUND_UP(state->buf_start, CURL_CACHE_BLOCK_SIZE);
+         i * CURL_CACHE_BLOCK_SIZE < s->len &&
+         i * CURL_CACHE_BLOCK_SIZE + curl_cache_block_len(s, i) <= buf_end;
+         i++) {
+        CURLCacheEntry *entry = g_hash_table_lookup(s->cache, &i);
+
+        if (entry) {
+            QTAILQ_REMOVE(&s->cache_lru, entry, next);
+        } else if (s->cache_entries < s->cache_max_entries) {
+            entry = g_new(CURLCacheEntry, 1);
+            entry->buf = g_malloc(CURL_CACHE_BLOCK_SIZE);
+            s->cache_entries++;
+        } else {
+            entry = QTAILQ_LAST(&s->cache_lru);
+            QTAILQ_REMOVE(&s->cache_lru, entry, next);
+            g_hash_table_remove(s->cache, &entry->index);
+        }
+
+        if (!g_hash_table_contains(s->cache, &i)) {
+            entry->index = i;
+            memcpy(entry->buf, state->orig_buf +
+                   (i * CURL_CACHE_BLOCK_SIZE - state->buf_start),
+                   curl_cache_block_len(s, i));
+            g_hash_table_insert(s->cache, &entry->index, entry);
+        }
+        QTAILQ_INSERT_HEAD(&s->cache_lru, entry, next);
+    }
+}
+
+static void curl_cache_free(BDRVCURLState *s)
+{
+    CURLCacheEntry *entry, *next_entry;
+
+    if (!s->cache) {
+        return;
+    }
+
+    QTAILQ_FOREACH_SAFE(entry, &s->cache_lru, next, next_entry) {
+        g_free(entry->buf);
+        g_free(entry);
+    }
+    g_hash_table_destroy(s->cache);
+    s->cache = NULL;
+    s->cache_entries = 0;
+}
+
 /* Called with s->mutex held.  */
 static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
                           CURLAIOCB *acb)
@@ -288,9 +421,11 @@ static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
         {
             char *buf = state->orig_buf + (start - state->buf_start);
 
-            qemu_iovec_from_buf(acb->qiov, 0, buf, clamped_len);
+            qemu_iovec_from_buf(acb->qiov, acb->qiov_offset, buf,
+                                clamped_len);
             if (clamped_len < len) {
-                qemu_iovec_memset(acb->qiov, clamped_len, 0, len - clamped_len);
+                qemu_iovec_memset(acb->qiov, acb->qiov_offset + clamped_len,
+                                  0, len - clamped_len);
             }
             acb->ret = 0;
             return true;
@@ -355,6 +490,8 @@ static void curl_multi_check_completion(BDRVCURLState *s)
                         error_report("curl: further errors suppressed");
                     }
                 }
+            } else {
+                curl_cache_insert(s, state);
             }
 
             for (i = 0; i < CURL_NUM_ACB; i++) {
@@ -368,14 +505,14 @@ static void curl_multi_check_completion(BDRVCURLState *s)
                     /* Assert that we have read all data */
                     assert(state->buf_off >= acb->end);
 
-                    qemu_iovec_from_buf(acb->qiov, 0,
+                    qemu_iovec_from_buf(acb->qiov, acb->qiov_offset,
                                         state->orig_buf + acb->start,
                                         acb->end - acb->start);
 
                     if (acb->end - acb->start < acb->bytes) {
                         size_t offset = acb->end - acb->start;
-                        qemu_iovec_memset(acb->qiov, offset, 0,
-                                          acb->bytes - offset);
+                        qemu_iovec_memset(acb->qiov, acb->qiov_offset + offset,
+                                          0, acb->bytes - offset);
                     }
                 }
 
@@ -503,6 +640,17 @@ static int curl_init_state(BDRVCURLState *s, CURLState *state)
         curl_easy_setopt(state->curl, CURLOPT_REDIR_PROTOCOLS, PROTOCOLS);
 #endif
 
+        /*
+         * Use HTTP/2 with https servers that support it, so that parallel
+         * range requests are multiplexed over a single connection instead
+         * of opening one connection per request.
+         */
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        curl_easy_setopt(state->curl, CURLOPT_HTTP_VERSION,
+                         (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(state->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+
 #ifdef DEBUG_VERBOSE
         curl_easy_setopt(state->curl, CURLOPT_VERBOSE, 1);
 #endif
@@ -577,6 +725,9 @@ static void curl_attach_aio_context(BlockDriverState *bs,
     curl_multi_setopt(s->multi, CURLMOPT_SOCKETFUNCTION, curl_sock_cb);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERDATA, s);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERFUNCTION, curl_timer_cb);
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(s->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
 }
 
 static QemuOptsList runtime_opts = {
@@ -633,6 +784,16 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_STRING,
             .help = "ID of secret used as password for HTTP proxy auth",
         },
+        {
+            .name = CURL_BLOCK_OPT_CHUNK_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Split larger reads into parallel requests of this size",
+        },
+        {
+            .name = CURL_BLOCK_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Size of the in-memory cache of downloaded data",
+        },
         { /* end of list */ }
     },
 };
@@ -650,6 +811,7 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
     double d;
     const char *secretid;
     const char *protocol_delimiter;
+    uint64_t cache_size;
     int ret;
 
     ret = bdrv_apply_auto_read_only(bs, "curl driver does not support writes",
@@ -681,6 +843,22 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
         goto out_noclean;
     }
 
+    s->chunk_size = qemu_opt_get_size(opts, CURL_BLOCK_OPT_CHUNK_SIZE,
+                                      CURL_BLOCK_OPT_CHUNK_SIZE_DEFAULT);
+    if ((s->chunk_size & 0x1ff) != 0) {
+        error_setg(errp, "chunk-size %" PRIu64 " is not a multiple of 512",
+                   s->chunk_size);
+        goto out_noclean;
+    }
+
+    cache_size = qemu_opt_get_size(opts, CURL_BLOCK_OPT_CACHE_SIZE, 0);
+    s->cache_max_entries = cache_size / CURL_CACHE_BLOCK_SIZE;
+    if (cache_size && !s->cache_max_entries) {
+        error_setg(errp, "cache-size must be at least %d bytes",
+                   CURL_CACHE_BLOCK_SIZE);
+        goto out_noclean;
+    }
+
     s->timeout = qemu_opt_get_number(opts, CURL_BLOCK_OPT_TIMEOUT,
                                      CURL_BLOCK_OPT_TIMEOUT_DEFAULT);
     if (s->timeout > CURL_TIMEOUT_MAX) {
@@ -806,6 +984,11 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
     curl_easy_cleanup(state->curl);
     state->curl = NULL;
 
+    if (s->cache_max_entries) {
+        s->cache = g_hash_table_new(g_int64_hash, g_int64_equal);
+        QTAILQ_INIT(&s->cache_lru);
+    }
+
     curl_attach_aio_context(bs, bdrv_get_aio_context(bs));
 
     qemu_opts_del(opts);
@@ -828,7 +1011,8 @@ out_noclean:
     return -EINVAL;
 }
 
-static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
+static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb,
+                              bool readahead)
 {
     CURLState *state;
     int running;
@@ -842,7 +1026,8 @@ static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
 
     // In case we have the requested data already (e.g. read-ahead),
     // we can just call the callback and be done.
-    if (curl_find_buf(s, start, acb->bytes, acb)) {
+    if (curl_cache_read(s, start, acb->bytes, acb) ||
+        curl_find_buf(s, start, acb->bytes, acb)) {
         goto out;
     }
 
@@ -867,7 +1052,8 @@ static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
     state->buf_off = 0;
     g_free(state->orig_buf);
     state->buf_start = start;
-    state->buf_len = MIN(acb->end + s->readahead_size, s->len - start);
+    state->buf_len = MIN(acb->end + (readahead ? s->readahead_size : 0),
+                         s->len - start);
     end = start + state->buf_len - 1;
     state->orig_buf = g_try_malloc(state->buf_len);
     if (state->buf_len && state->orig_buf == NULL) {
@@ -896,25 +1082,92 @@ out:
     qemu_mutex_unlock(&s->mutex);
 }
 
-static int coroutine_fn curl_co_preadv(BlockDriverState *bs,
-        int64_t offset, int64_t bytes, QEMUIOVector *qiov,
-        BdrvRequestFlags flags)
+static int coroutine_fn curl_co_preadv_chunk(BlockDriverState *bs,
+                                             uint64_t offset, uint64_t bytes,
+                                             QEMUIOVector *qiov,
+                                             size_t qiov_offset,
+                                             bool readahead)
 {
     CURLAIOCB acb = {
         .co = qemu_coroutine_self(),
         .ret = -EINPROGRESS,
         .qiov = qiov,
+        .qiov_offset = qiov_offset,
         .offset = offset,
         .bytes = bytes
     };
 
-    curl_setup_preadv(bs, &acb);
+    curl_setup_preadv(bs, &acb, readahead);
     while (acb.ret == -EINPROGRESS) {
         qemu_coroutine_yield();
     }
     return acb.ret;
 }
 
+typedef struct CURLAioTask {
+    AioTask task;
+
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint64_t bytes;
+    QEMUIOVector *qiov;
+    size_t qiov_offset;
+    bool readahead;
+} CURLAioTask;
+
+static coroutine_fn int curl_co_preadv_task_entry(AioTask *task)
+{
+    CURLAioTask *t = container_of(task, CURLAioTask, task);
+
+    return curl_co_preadv_chunk(t->bs, t->offset, t->bytes,
+                                t->qiov, t->qiov_offset, t->readahead);
+}
+
+static int coroutine_fn curl_co_preadv(BlockDriverState *bs,
+        int64_t offset, int64_t bytes, QEMUIOVector *qiov,
+        BdrvRequestFlags flags)
+{
+    BDRVCURLState *s = bs->opaque;
+    AioTaskPool *aio;
+    size_t qiov_offset = 0;
+    int ret;
+
+    if (!s->chunk_size || bytes <= s->chunk_size) {
+        return curl_co_preadv_chunk(bs, offset, bytes, qiov, 0, true);
+    }
+
+    /*
+     * Send one range request per chunk, so that they are downloaded in
+     * parallel.  Only the last one reads ahead.
+     */
+    aio = aio_task_pool_new(CURL_NUM_STATES);
+    while (bytes != 0 && aio_task_pool_status(aio) == 0) {
+        uint64_t cur_bytes = MIN(bytes, s->chunk_size);
+        CURLAioTask *task = g_new(CURLAioTask, 1);
+
+        *task = (CURLAioTask) {
+            .task.func = curl_co_preadv_task_entry,
+            .bs = bs,
+            .offset = offset,
+            .bytes = cur_bytes,
+            .qiov = qiov,
+            .qiov_offset = qiov_offset,
+            .readahead = cur_bytes == bytes,
+        };
+        aio_task_pool_start_task(aio, &task->task);
+
+        bytes -= cur_bytes;
+        offset += cur_bytes;
+        qiov_offset += cur_bytes;
+    }
+
+    aio_task_pool_wait_all(aio);
+    ret = aio_task_pool_status(aio);
+    g_free(aio);
+
+    return ret;
+}
+
 static void curl_close(BlockDriverState *bs)
 {
     BDRVCURLState *s = bs->opaque;
@@ -922,6 +1175,7 @@ static void curl_close(BlockDriverState *bs)
     trace_curl_close();
     curl_detach_aio_context(bs);
     qemu_mutex_destroy(&s->mutex);
+    curl_cache_free(s);
 
     g_hash_table_destroy(s->sockets);
     g_free(s->cookie);
@@ -941,8 +1195,10 @@ static void curl_refresh_filename(BlockDriverState *bs)
 {
     BDRVCURLState *s = bs->opaque;
 
-    /* "readahead" and "timeout" do not change the guest-visible data,
-     * so ignore them */
+    /*
+     * "readahead", "timeout", "chunk-size" and "cache-size" do not change
+     * the guest-visible data, so ignore them
+     */
     if (s->sslverify != CURL_BLOCK_OPT_SSLVERIFY_DEFAULT ||
         s->cookie || s->username || s->password || s->proxyusername ||
         s->proxypassword)
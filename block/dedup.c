@@ -0,0 +1,722 @@
+/*
+ * Deduplicating block driver
+ *
+ * Full clusters written through this driver are identified by their SHA-256
+ * digest and stored once in a content store ("store" node).  A per-image
+ * index ("index" child) maps each guest cluster either to a store cluster
+ * or to the same offset in "file", which holds partially written clusters
+ * and everything that was never written through this driver.  Several
+ * dedup nodes in the same process may share one store; identical clusters
+ * written by any of them are then only stored once.
+ *
+ * The store is append-only: clusters that are no longer referenced are not
+ * reclaimed.  It is accessed through one BlockBackend per store, which does
+ * not let any other user write it.  Its digests are computed on the first
+ * full cluster write.  Store clusters are durable before an index entry
+ * refers to them.
+ *
+ * Index layout: a DedupIndexHeader, then from DEDUP_INDEX_MAP_OFFSET one
+ * little-endian 64-bit entry per guest cluster, 0 for "file" or the store
+ * cluster number plus one.  An empty index is initialized on the first write.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "crypto/hash.h"
+#include "qemu/bswap.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "sysemu/block-backend.h"
+#include "trace.h"
+
+#define DEDUP_OPT_CLUSTER_SIZE      "cluster-size"
+#define DEDUP_CLUSTER_SIZE_DEFAULT  (64 * KiB)
+
+#define DEDUP_INDEX_MAGIC           0x51444449 /* "QDDI" */
+#define DEDUP_INDEX_VERSION         1
+#define DEDUP_INDEX_MAP_OFFSET      4096
+
+#define DEDUP_DIGEST_LEN            32
+
+typedef struct DedupIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cluster_size;
+    uint32_t reserved;
+    uint64_t nb_clusters;
+} QEMU_PACKED DedupIndexHeader;
+
+typedef struct DedupStoreEntry {
+    uint8_t digest[DEDUP_DIGEST_LEN];
+    uint64_t cluster;
+} DedupStoreEntry;
+
+/* A content store, shared by all dedup nodes that use the same node */
+typedef struct DedupStore {
+    BlockBackend *blk;
+    uint32_t cluster_size;
+    int refcnt;
+
+    CoMutex load_lock;
+    bool loaded;                /* @entries holds all clusters */
+
+    QemuMutex lock;
+    GHashTable *entries;        /* digest -> DedupStoreEntry */
+    uint64_t nb_clusters;       /* including those being written */
+
+    QLIST_ENTRY(DedupStore) next;
+} DedupStore;
+
+typedef struct BDRVDedupState {
+    BdrvChild *index;
+    DedupStore *store;
+
+    uint32_t cluster_size;
+    int64_t size;
+    uint64_t nb_clusters;
+    uint64_t *map;              /* cached index entries, CPU endianness */
+    bool index_initialized;
+
+    CoMutex lock;               /* serializes writes */
+} BDRVDedupState;
+
+static QLIST_HEAD(, DedupStore) dedup_stores =
+    QLIST_HEAD_INITIALIZER(dedup_stores);
+
+static QemuOptsList dedup_runtime_opts = {
+    .name = "dedup",
+    .head = QTAILQ_HEAD_INITIALIZER(dedup_runtime_opts.head),
+    .desc = {
+        {
+            .name = DEDUP_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Deduplication granularity (default: 64k)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static guint dedup_digest_hash(gconstpointer p)
+{
+    const DedupStoreEntry *e = p;
+    guint h;
+
+    /* SHA-256 output is uniformly distributed */
+    memcpy(&h, e->digest, sizeof(h));
+    return h;
+}
+
+static gboolean dedup_digest_equal(gconstpointer a, gconstpointer b)
+{
+    const DedupStoreEntry *x = a, *y = b;
+
+    return !memcmp(x->digest, y->digest, DEDUP_DIGEST_LEN);
+}
+
+static int dedup_digest(const void *buf, size_t len, uint8_t *digest)
+{
+    size_t digest_len = DEDUP_DIGEST_LEN;
+
+    if (qcrypto_hash_bytes(QCRYPTO_HASH_ALG_SHA256, buf, len,
+                           &digest, &digest_len, NULL) < 0) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* Called with store->lock held */
+static void dedup_store_insert(DedupStore *store, const uint8_t *digest,
+                               uint64_t cluster)
+{
+    DedupStoreEntry *e = g_new(DedupStoreEntry, 1);
+
+    memcpy(e->digest, digest, DEDUP_DIGEST_LEN);
+    e->cluster = cluster;
+    if (!g_hash_table_add(store->entries, e)) {
+        /* Keep the existing entry, it was there first */
+        g_free(e);
+    }
+}
+
+/*
+ * Several dedup nodes write the same store, so it is not their child: they
+ * could not keep others from writing it without also keeping each other
+ * out.  Instead the store has a BlockBackend that takes all permissions
+ * needed by its dedup nodes and only shares reading.
+ */
+static DedupStore *dedup_store_get(BlockDriverState *bs, uint32_t cluster_size,
+                                   Error **errp)
+{
+    DedupStore *store;
+    BlockBackend *blk;
+    uint64_t perm = BLK_PERM_CONSISTENT_READ;
+    int64_t len;
+
+    QLIST_FOREACH(store, &dedup_stores, next) {
+        if (blk_bs(store->blk) == bs) {
+            if (store->cluster_size != cluster_size) {
+                error_setg(errp, "Store '%s' is already used with cluster "
+                           "size %" PRIu32, bdrv_get_node_name(bs),
+                           store->cluster_size);
+                return NULL;
+            }
+            store->refcnt++;
+            return store;
+        }
+    }
+
+    len = bdrv_getlength(bs);
+    if (len < 0) {
+        error_setg_errno(errp, -len, "Could not get the size of the store");
+        return NULL;
+    }
+
+    if (!bdrv_is_read_only(bs)) {
+        perm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+    blk = blk_new_with_bs(bs, perm, BLK_PERM_CONSISTENT_READ |
+                          BLK_PERM_WRITE_UNCHANGED, errp);
+    if (!blk) {
+        return NULL;
+    }
+    /* The store grows by writing after its end */
+    blk_set_allow_write_beyond_eof(blk, true);
+    blk_set_allow_aio_context_change(blk, true);
+    blk_set_force_allow_inactivate(blk);
+
+    store = g_new0(DedupStore, 1);
+    store->blk = blk;
+    store->cluster_size = cluster_size;
+    store->refcnt = 1;
+    qemu_co_mutex_init(&store->load_lock);
+    qemu_mutex_init(&store->lock);
+    store->entries = g_hash_table_new_full(dedup_digest_hash,
+                                           dedup_digest_equal, g_free, NULL);
+    /* A partially written last cluster is overwritten later */
+    store->nb_clusters = len / cluster_size;
+
+    QLIST_INSERT_HEAD(&dedup_stores, store, next);
+    return store;
+}
+
+/*
+ * Computes the digests of the clusters that are in the store since before
+ * it was opened.  Only writes need them, so this is done before the first
+ * one instead of blocking open.
+ */
+static int coroutine_fn dedup_store_load(DedupStore *store)
+{
+    uint8_t digest[DEDUP_DIGEST_LEN];
+    uint8_t *buf;
+    uint64_t i;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&store->load_lock);
+    if (store->loaded) {
+        goto out;
+    }
+
+    buf = blk_try_blockalign(store->blk, store->cluster_size);
+    if (!buf) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    /* No cluster is added before the store is loaded */
+    for (i = 0; i < store->nb_clusters; i++) {
+        ret = blk_co_pread(store->blk, i * store->cluster_size,
+                           store->cluster_size, buf, 0);
+        if (ret >= 0) {
+            ret = dedup_digest(buf, store->cluster_size, digest);
+        }
+        if (ret < 0) {
+            break;
+        }
+        qemu_mutex_lock(&store->lock);
+        dedup_store_insert(store, digest, i);
+        qemu_mutex_unlock(&store->lock);
+    }
+    qemu_vfree(buf);
+
+    if (ret >= 0) {
+        trace_dedup_store_open(blk_bs(store->blk), store->nb_clusters,
+                               g_hash_table_size(store->entries));
+        store->loaded = true;
+    }
+
+out:
+    qemu_co_mutex_unlock(&store->load_lock);
+    return ret < 0 ? ret : 0;
+}
+
+static void dedup_store_put(DedupStore *store)
+{
+    if (!store || --store->refcnt) {
+        return;
+    }
+
+    QLIST_REMOVE(store, next);
+    blk_unref(store->blk);
+    g_hash_table_destroy(store->entries);
+    qemu_mutex_destroy(&store->lock);
+    g_free(store);
+}
+
+static int dedup_load_index(BlockDriverState *bs, QemuOpts *opts,
+                            Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+    DedupIndexHeader header = { 0 };
+    int64_t file_len, index_len, map_len;
+    uint64_t cluster_size, i;
+    int ret;
+
+    file_len = bdrv_getlength(bs->file->bs);
+    index_len = bdrv_getlength(s->index->bs);
+    if (file_len < 0 || index_len < 0) {
+        error_setg_errno(errp, -(file_len < 0 ? file_len : index_len),
+                         "Could not get the image size");
+        return -EINVAL;
+    }
+
+    cluster_size = qemu_opt_get_size(opts, DEDUP_OPT_CLUSTER_SIZE, 0);
+    if (cluster_size > 2 * MiB) {
+        error_setg(errp, "Cluster size must be at most 2M");
+        return -EINVAL;
+    }
+    s->cluster_size = cluster_size;
+    if (index_len) {
+        ret = bdrv_pread(s->index, 0, &header, sizeof(header));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the index header");
+            return ret;
+        }
+        if (le32_to_cpu(header.magic) != DEDUP_INDEX_MAGIC ||
+            le32_to_cpu(header.version) != DEDUP_INDEX_VERSION) {
+            error_setg(errp, "Not a dedup index, or unsupported version");
+            return -EINVAL;
+        }
+        if (s->cluster_size &&
+            s->cluster_size != le32_to_cpu(header.cluster_size)) {
+            error_setg(errp, "The index uses a cluster size of %" PRIu32,
+                       le32_to_cpu(header.cluster_size));
+            return -EINVAL;
+        }
+        s->cluster_size = le32_to_cpu(header.cluster_size);
+        s->index_initialized = true;
+    } else if (!s->cluster_size) {
+        s->cluster_size = DEDUP_CLUSTER_SIZE_DEFAULT;
+    }
+
+    if (!is_power_of_2(s->cluster_size) ||
+        s->cluster_size < BDRV_SECTOR_SIZE || s->cluster_size > 2 * MiB) {
+        error_setg(errp, "Cluster size must be a power of two between 512 "
+                   "and 2M");
+        return -EINVAL;
+    }
+
+    s->size = file_len;
+    s->nb_clusters = DIV_ROUND_UP(file_len, s->cluster_size);
+    if (s->index_initialized &&
+        le64_to_cpu(header.nb_clusters) != s->nb_clusters) {
+        error_setg(errp, "The index does not match the size of the image");
+        return -EINVAL;
+    }
+
+    s->map = g_try_new0(uint64_t, s->nb_clusters);
+    if (s->nb_clusters && !s->map) {
+        error_setg(errp, "Could not allocate the index");
+        return -ENOMEM;
+    }
+
+    /* Entries after the end of the index are 0 */
+    map_len = MIN(s->nb_clusters * sizeof(uint64_t),
+                  MAX(index_len - DEDUP_INDEX_MAP_OFFSET, 0));
+    if (map_len) {
+        ret = bdrv_pread(s->index, DEDUP_INDEX_MAP_OFFSET, s->map, map_len);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the index");
+            return ret;
+        }
+    }
+    for (i = 0; i < s->nb_clusters; i++) {
+        s->map[i] = le64_to_cpu(s->map[i]);
+    }
+
+    return 0;
+}
+
+static int dedup_open(BlockDriverState *bs, QDict *options, int flags,
+                      Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+    BdrvChild *store_child = NULL;
+    QemuOpts *opts;
+    uint64_t i;
+    int ret = -EINVAL;
+
+    opts = qemu_opts_create(&dedup_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_DATA | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        goto out;
+    }
+
+    /* Only attached until the store holds a reference of its own */
+    store_child = bdrv_open_child(NULL, options, "store", bs, &child_of_bds,
+                                  BDRV_CHILD_DATA, false, errp);
+    if (!store_child) {
+        goto out;
+    }
+
+    s->index = bdrv_open_child(NULL, options, "index", bs, &child_of_bds,
+                               BDRV_CHILD_METADATA, false, errp);
+    if (!s->index) {
+        goto out;
+    }
+
+    ret = dedup_load_index(bs, opts, errp);
+    if (ret < 0) {
+        goto out;
+    }
+
+    s->store = dedup_store_get(store_child->bs, s->cluster_size, errp);
+    if (!s->store) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    for (i = 0; i < s->nb_clusters; i++) {
+        if (s->map[i] > s->store->nb_clusters) {
+            error_setg(errp, "The index refers to cluster %" PRIu64 " of a "
+                       "store with %" PRIu64 " clusters", s->map[i] - 1,
+                       s->store->nb_clusters);
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    qemu_co_mutex_init(&s->lock);
+    ret = 0;
+
+out:
+    bdrv_unref_child(bs, store_child);
+    if (ret < 0) {
+        dedup_store_put(s->store);
+        s->store = NULL;
+        g_free(s->map);
+        s->map = NULL;
+    }
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void dedup_close(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    dedup_store_put(s->store);
+    g_free(s->map);
+    bdrv_unref_child(bs, s->index);
+    s->index = NULL;
+}
+
+static void dedup_child_perm(BlockDriverState *bs, BdrvChild *c,
+                             BdrvChildRole role,
+                             BlockReopenQueue *reopen_queue,
+                             uint64_t perm, uint64_t shared,
+                             uint64_t *nperm, uint64_t *nshared)
+{
+    if (role & BDRV_CHILD_PRIMARY) {
+        bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                           nperm, nshared);
+        return;
+    }
+
+    if (!(role & BDRV_CHILD_METADATA)) {
+        /* The store is only used through its BlockBackend, see above */
+        *nperm = 0;
+        *nshared = BLK_PERM_ALL;
+        return;
+    }
+
+    /* The index grows on writes */
+    *nperm = BLK_PERM_CONSISTENT_READ;
+    if (perm & BLK_PERM_WRITE) {
+        *nperm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+    *nshared = BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE_UNCHANGED;
+}
+
+static int64_t dedup_getlength(BlockDriverState *bs)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    return s->size;
+}
+
+static void dedup_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    BDRVDedupState *s = bs->opaque;
+
+    /* Zero writes are emulated, let them cover whole clusters */
+    bs->bl.pwrite_zeroes_alignment = s->cluster_size;
+}
+
+static int coroutine_fn dedup_co_preadv_part(BlockDriverState *bs,
+                                             int64_t offset, int64_t bytes,
+                                             QEMUIOVector *qiov,
+                                             size_t qiov_offset,
+                                             BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    int ret;
+
+    while (bytes) {
+        uint64_t cluster = offset / s->cluster_size;
+        uint64_t entry = s->map[cluster];
+        uint64_t in_cluster = offset % s->cluster_size;
+        uint64_t n = s->cluster_size - in_cluster;
+
+        /* Merge clusters that are contiguous in file or in the store */
+        while (n < bytes && cluster + 1 < s->nb_clusters &&
+               s->map[cluster + 1] == (entry ? entry + 1 : 0)) {
+            cluster++;
+            entry = entry ? entry + 1 : 0;
+            n += s->cluster_size;
+        }
+        n = MIN(n, bytes);
+
+        if (!s->map[offset / s->cluster_size]) {
+            ret = bdrv_co_preadv_part(bs->file, offset, n, qiov, qiov_offset,
+                                      flags);
+        } else {
+            uint64_t store_offset =
+                (s->map[offset / s->cluster_size] - 1) * s->cluster_size +
+                in_cluster;
+            QEMUIOVector local_qiov;
+
+            qemu_iovec_init_slice(&local_qiov, qiov, qiov_offset, n);
+            ret = blk_co_preadv(s->store->blk, store_offset, n, &local_qiov,
+                                flags);
+            qemu_iovec_destroy(&local_qiov);
+        }
+        if (ret < 0) {
+            return ret;
+        }
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    return 0;
+}
+
+/* Called with s->lock held */
+static int coroutine_fn dedup_set_entry(BlockDriverState *bs,
+                                        uint64_t cluster, uint64_t entry)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t le_entry = cpu_to_le64(entry);
+    int ret;
+
+    if (!s->index_initialized) {
+        DedupIndexHeader header = {
+            .magic = cpu_to_le32(DEDUP_INDEX_MAGIC),
+            .version = cpu_to_le32(DEDUP_INDEX_VERSION),
+            .cluster_size = cpu_to_le32(s->cluster_size),
+            .nb_clusters = cpu_to_le64(s->nb_clusters),
+        };
+
+        ret = bdrv_co_pwrite(s->index, 0, sizeof(header), &header, 0);
+        if (ret < 0) {
+            return ret;
+        }
+        s->index_initialized = true;
+    }
+
+    ret = bdrv_co_pwrite(s->index,
+                         DEDUP_INDEX_MAP_OFFSET + cluster * sizeof(uint64_t),
+                         sizeof(le_entry), &le_entry, 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    s->map[cluster] = entry;
+    return 0;
+}
+
+/* Called with s->lock held */
+static int coroutine_fn dedup_write_cluster(BlockDriverState *bs,
+                                            uint64_t cluster,
+                                            QEMUIOVector *qiov,
+                                            size_t qiov_offset)
+{
+    BDRVDedupState *s = bs->opaque;
+    DedupStore *store = s->store;
+    DedupStoreEntry key, *e;
+    uint64_t store_cluster;
+    uint8_t *buf;
+    bool found;
+    int ret;
+
+    ret = dedup_store_load(store);
+    if (ret < 0) {
+        return ret;
+    }
+
+    buf = blk_try_blockalign(store->blk, s->cluster_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    qemu_iovec_to_buf(qiov, qiov_offset, buf, s->cluster_size);
+
+    ret = dedup_digest(buf, s->cluster_size, key.digest);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_mutex_lock(&store->lock);
+    e = g_hash_table_lookup(store->entries, &key);
+    found = e != NULL;
+    store_cluster = found ? e->cluster : store->nb_clusters++;
+    qemu_mutex_unlock(&store->lock);
+
+    trace_dedup_write_cluster(bs, cluster, store_cluster, found);
+
+    if (!found) {
+        ret = blk_co_pwrite(store->blk, store_cluster * s->cluster_size,
+                            s->cluster_size, buf, 0);
+        if (ret >= 0) {
+            ret = blk_co_flush(store->blk);
+        }
+        if (ret < 0) {
+            goto out;
+        }
+
+        /* Only now may other writers refer to it */
+        qemu_mutex_lock(&store->lock);
+        dedup_store_insert(store, key.digest, store_cluster);
+        qemu_mutex_unlock(&store->lock);
+    }
+
+    if (s->map[cluster] != store_cluster + 1) {
+        ret = dedup_set_entry(bs, cluster, store_cluster + 1);
+    }
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+/* Called with s->lock held */
+static int coroutine_fn dedup_write_partial(BlockDriverState *bs,
+                                            int64_t offset, int64_t bytes,
+                                            QEMUIOVector *qiov,
+                                            size_t qiov_offset,
+                                            BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    uint64_t cluster = offset / s->cluster_size;
+    uint64_t in_cluster = offset % s->cluster_size;
+    uint8_t *buf;
+    int ret;
+
+    if (!s->map[cluster]) {
+        return bdrv_co_pwritev_part(bs->file, offset, bytes, qiov,
+                                    qiov_offset, flags);
+    }
+
+    /* Copy the cluster from the store back to file, with the new data */
+    buf = qemu_try_blockalign(bs->file->bs, s->cluster_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    ret = blk_co_pread(s->store->blk,
+                       (s->map[cluster] - 1) * s->cluster_size,
+                       s->cluster_size, buf, 0);
+    if (ret < 0) {
+        goto out;
+    }
+    qemu_iovec_to_buf(qiov, qiov_offset, buf + in_cluster, bytes);
+
+    ret = bdrv_co_pwrite(bs->file, cluster * s->cluster_size,
+                         s->cluster_size, buf, flags);
+    if (ret >= 0) {
+        ret = bdrv_co_flush(bs->file->bs);
+    }
+    if (ret < 0) {
+        goto out;
+    }
+
+    ret = dedup_set_entry(bs, cluster, 0);
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn dedup_co_pwritev_part(BlockDriverState *bs,
+                                              int64_t offset, int64_t bytes,
+                                              QEMUIOVector *qiov,
+                                              size_t qiov_offset,
+                                              BdrvRequestFlags flags)
+{
+    BDRVDedupState *s = bs->opaque;
+    int ret = 0;
+
+    qemu_co_mutex_lock(&s->lock);
+    while (bytes && ret == 0) {
+        uint64_t in_cluster = offset % s->cluster_size;
+        uint64_t n = MIN(bytes, s->cluster_size - in_cluster);
+
+        /* A short last cluster of the image is never deduplicated */
+        if (n == s->cluster_size && offset + n <= s->size) {
+            ret = dedup_write_cluster(bs, offset / s->cluster_size, qiov,
+                                      qiov_offset);
+        } else {
+            ret = dedup_write_partial(bs, offset, n, qiov, qiov_offset,
+                                      flags);
+        }
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static BlockDriver bdrv_dedup = {
+    .format_name                        = "dedup",
+    .instance_size                      = sizeof(BDRVDedupState),
+
+    .bdrv_open                          = dedup_open,
+    .bdrv_close                         = dedup_close,
+    .bdrv_child_perm                    = dedup_child_perm,
+    .bdrv_refresh_limits                = dedup_refresh_limits,
+
+    .bdrv_getlength                     = dedup_getlength,
+
+    .bdrv_co_preadv_part                = dedup_co_preadv_part,
+    .bdrv_co_pwritev_part               = dedup_co_pwritev_part,
+};
+
+static void bdrv_dedup_init(void)
+{
+    bdrv_register(&bdrv_dedup);
+}
+
+block_init(bdrv_dedup_init);
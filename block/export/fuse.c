@@ -61,6 +61,20 @@ typedef struct FuseExport {
     gid_t st_gid;
 } FuseExport;
 
+/*
+ * A read or write request that is processed in a coroutine, so that the
+ * next FUSE request can be received while it waits for I/O.
+ */
+typedef struct FuseIORequest {
+    FuseExport *exp;
+    fuse_req_t req;
+    int64_t offset;
+    size_t size;
+    void *buf;
+    /* For writes: the receive buffer that was taken over from libfuse */
+    void *fuse_mem;
+} FuseIORequest;
+
 static GHashTable *exports;
 static const struct fuse_lowlevel_ops fuse_ops;
 
@@ -508,13 +522,30 @@ static void fuse_open(fuse_req_t req, fuse_ino_t inode,
 /**
  * Handle client reads from the exported image.
  */
+static void coroutine_fn fuse_co_read(void *opaque)
+{
+    FuseIORequest *r = opaque;
+    int ret;
+
+    ret = blk_co_pread(r->exp->common.blk, r->offset, r->size, r->buf, 0);
+    if (ret >= 0) {
+        fuse_reply_buf(r->req, r->buf, r->size);
+    } else {
+        fuse_reply_err(r->req, -ret);
+    }
+
+    qemu_vfree(r->buf);
+    blk_exp_unref(&r->exp->common);
+    g_free(r);
+}
+
 static void fuse_read(fuse_req_t req, fuse_ino_t inode,
                       size_t size, off_t offset, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
+    FuseIORequest *r;
     int64_t length;
     void *buf;
-    int ret;
 
     /* Limited by max_read, should not happen */
     if (size > FUSE_MAX_BOUNCE_BYTES) {
@@ -542,23 +573,48 @@ static void fuse_read(fuse_req_t req, fuse_ino_t inode,
         return;
     }
 
-    ret = blk_pread(exp->common.blk, offset, buf, size);
+    r = g_new(FuseIORequest, 1);
+    *r = (FuseIORequest) {
+        .exp    = exp,
+        .req    = req,
+        .offset = offset,
+        .size   = size,
+        .buf    = buf,
+    };
+    blk_exp_ref(&exp->common);
+    qemu_coroutine_enter(qemu_coroutine_create(fuse_co_read, r));
+}
+
+/**
+ * Handle client writes to the exported image.
+ */
+static void coroutine_fn fuse_co_write(void *opaque)
+{
+    FuseIORequest *r = opaque;
+    int ret;
+
+    ret = blk_co_pwrite(r->exp->common.blk, r->offset, r->size, r->buf, 0);
     if (ret >= 0) {
-        fuse_reply_buf(req, buf, size);
+        fuse_reply_write(r->req, r->size);
     } else {
-        fuse_reply_err(req, -ret);
+        fuse_reply_err(r->req, -ret);
     }
 
-    qemu_vfree(buf);
+    if (r->fuse_mem) {
+        free(r->fuse_mem);
+    } else {
+        g_free(r->buf);
+    }
+    blk_exp_unref(&r->exp->common);
+    g_free(r);
 }
 
-/**
- * Handle client writes to the exported image.
- */
 static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
                        size_t size, off_t offset, struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
+    FuseIORequest *r;
+    const char *fuse_mem = exp->fuse_buf.mem;
     int64_t length;
     int ret;
 
@@ -595,12 +651,30 @@ static void fuse_write(fuse_req_t req, fuse_ino_t inode, const char *buf,
         }
     }
 
-    ret = blk_pwrite(exp->common.blk, offset, buf, size, 0);
-    if (ret >= 0) {
-        fuse_reply_write(req, size);
+    r = g_new(FuseIORequest, 1);
+    *r = (FuseIORequest) {
+        .exp    = exp,
+        .req    = req,
+        .offset = offset,
+        .size   = size,
+    };
+
+    /*
+     * The data lives in the receive buffer, which is reused for the next
+     * request.  Take the buffer over instead of copying the data; libfuse
+     * allocates a new one on the next receive.
+     */
+    if (fuse_mem && buf >= fuse_mem &&
+        buf + size <= fuse_mem + exp->fuse_buf.size) {
+        r->fuse_mem = exp->fuse_buf.mem;
+        r->buf = (void *)buf;
+        exp->fuse_buf.mem = NULL;
     } else {
-        fuse_reply_err(req, -ret);
+        r->buf = g_memdup2(buf, size);
     }
+
+    blk_exp_ref(&exp->common);
+    qemu_coroutine_enter(qemu_coroutine_create(fuse_co_write, r));
 }
 
 /**
@@ -295,8 +295,15 @@ err:
 static void vu_blk_process_vq(VuDev *vu_dev, int idx)
 {
     VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+    VuBlkExport *vexp = container_of(server, VuBlkExport, vu_server);
     VuVirtq *vq = vu_get_queue(vu_dev, idx);
 
+    /*
+     * Submit everything that is available at once.  After a reconnect this
+     * includes all requests that were inflight when the previous connection
+     * went away.
+     */
+    blk_io_plug(vexp->export.blk);
     while (1) {
         VuBlkReq *req;
 
@@ -312,6 +319,7 @@ static void vu_blk_process_vq(VuDev *vu_dev, int idx)
             qemu_coroutine_create(vu_blk_virtio_process_req, req);
         qemu_coroutine_enter(co);
     }
+    blk_io_unplug(vexp->export.blk);
 }
 
 static void vu_blk_queue_set_started(VuDev *vu_dev, int idx, bool started)
@@ -130,6 +130,21 @@
 #define RAW_LOCK_PERM_BASE             100
 #define RAW_LOCK_SHARED_BASE           200
 
+/* Number of allocation extents remembered with extent-cache=on */
+#define RAW_EXTENT_CACHE_SIZE          64
+
+typedef struct RawExtent {
+    int64_t start;
+    int64_t end;    /* INT64_MAX for a trailing hole, start for a free slot */
+    bool data;
+} RawExtent;
+
+typedef struct RawExtentCache {
+    RawExtent extents[RAW_EXTENT_CACHE_SIZE];
+    int next;       /* Slot to replace when the cache is full */
+    int writes_in_flight;
+} RawExtentCache;
+
 typedef struct BDRVRawState {
     int fd;
     bool use_lock;
@@ -157,12 +172,15 @@ typedef struct BDRVRawState {
     bool discard_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    bool aio_sqpoll:1;
+    bool aio_register_buffers:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
     bool force_alignment;
     bool drop_cache;
     bool check_cache_dropped;
+    RawExtentCache *extent_cache;   /* NULL unless extent-cache=on */
     struct {
         uint64_t discard_nb_ok;
         uint64_t discard_nb_failed;
@@ -170,6 +188,15 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * Dedicated io_uring for aio-sqpoll and aio-register-buffers, with s->fd
+     * registered as a fixed file.  NULL if the node uses the io_uring of its
+     * AioContext.
+     */
+    LuringState *luring;
+#endif
 } BDRVRawState;
 
 typedef struct BDRVRawReopenState {
@@ -178,6 +205,122 @@ typedef struct BDRVRawReopenState {
     bool check_cache_dropped;
 } BDRVRawReopenState;
 
+/*
+ * The extent cache remembers what find_allocation() returned, so that
+ * repeated block status queries do not need to call lseek() again.  This is
+ * only correct as long as nobody but us modifies the file, so all requests
+ * that may change the allocation status of a range must be surrounded by
+ * raw_extent_cache_write_begin() and raw_extent_cache_write_end().  While
+ * such requests are in flight, nothing is added to the cache, because
+ * lseek() may or may not see their effect yet.
+ *
+ * All accesses happen in the AioContext of the node, so no locking is
+ * needed.
+ */
+static void raw_extent_cache_drop(BDRVRawState *s, int64_t offset,
+                                  int64_t bytes)
+{
+    RawExtentCache *c = s->extent_cache;
+    int64_t end = bytes < 0 ? INT64_MAX : offset + bytes;
+    int i;
+
+    if (!c) {
+        return;
+    }
+
+    for (i = 0; i < RAW_EXTENT_CACHE_SIZE; i++) {
+        RawExtent *e = &c->extents[i];
+
+        if (e->start < end && offset < e->end) {
+            e->end = e->start;
+        }
+    }
+}
+
+static void raw_extent_cache_drop_all(BDRVRawState *s)
+{
+    raw_extent_cache_drop(s, 0, -1);
+}
+
+static void raw_extent_cache_write_begin(BDRVRawState *s, int64_t offset,
+                                         int64_t bytes)
+{
+    if (s->extent_cache) {
+        raw_extent_cache_drop(s, offset, bytes);
+        s->extent_cache->writes_in_flight++;
+    }
+}
+
+static void raw_extent_cache_write_end(BDRVRawState *s)
+{
+    if (s->extent_cache) {
+        assert(s->extent_cache->writes_in_flight > 0);
+        s->extent_cache->writes_in_flight--;
+    }
+}
+
+/*
+ * Looks up @start in the extent cache.  On a hit, returns what
+ * find_allocation() would return and sets @data and @hole accordingly.
+ * Returns -ENOENT on a miss.
+ */
+static int raw_extent_cache_lookup(BDRVRawState *s, int64_t start,
+                                   off_t *data, off_t *hole)
+{
+    RawExtentCache *c = s->extent_cache;
+    int i;
+
+    for (i = 0; i < RAW_EXTENT_CACHE_SIZE; i++) {
+        RawExtent *e = &c->extents[i];
+
+        if (e->start <= start && start < e->end) {
+            if (e->data) {
+                *data = start;
+                *hole = e->end;
+            } else if (e->end == INT64_MAX) {
+                return -ENXIO;
+            } else {
+                *hole = start;
+                *data = e->end;
+            }
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static void raw_extent_cache_insert(BDRVRawState *s, int64_t start,
+                                    int64_t end, bool data)
+{
+    RawExtentCache *c = s->extent_cache;
+    RawExtent *e;
+    int i;
+
+    if (c->writes_in_flight) {
+        return;
+    }
+
+    raw_extent_cache_drop(s, start, end - start);
+
+    /* Reuse a free slot if there is one, the next victim otherwise */
+    e = &c->extents[c->next];
+    for (i = 0; i < RAW_EXTENT_CACHE_SIZE; i++) {
+        if (c->extents[i].start == c->extents[i].end) {
+            e = &c->extents[i];
+            break;
+        }
+    }
+    if (e == &c->extents[c->next]) {
+        c->next = (c->next + 1) % RAW_EXTENT_CACHE_SIZE;
+    }
+
+    *e = (RawExtent) {
+        .start  = start,
+        .end    = end,
+        .data   = data,
+    };
+}
+
 static int fd_open(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -550,6 +693,17 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "aio-sqpoll",
+            .type = QEMU_OPT_BOOL,
+            .help = "poll the io_uring submission queue from a kernel thread "
+                    "(default: off)",
+        },
+        {
+            .name = "aio-register-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM with io_uring (default: off)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -572,6 +726,11 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "check that page cache was dropped on live migration (default: off)"
         },
+        {
+            .name = "extent-cache",
+            .type = QEMU_OPT_BOOL,
+            .help = "cache the results of SEEK_DATA/SEEK_HOLE (default: off)",
+        },
         { /* end of list */ }
     },
 };
@@ -631,6 +790,17 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
 
+    s->aio_sqpoll = qemu_opt_get_bool(opts, "aio-sqpoll", false);
+    s->aio_register_buffers = qemu_opt_get_bool(opts, "aio-register-buffers",
+                                                false);
+    if ((s->aio_sqpoll || s->aio_register_buffers) &&
+        aio != BLOCKDEV_AIO_OPTIONS_IO_URING) {
+        error_setg(errp, "aio-sqpoll and aio-register-buffers require "
+                   "aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
                               ON_OFF_AUTO_AUTO, &local_err);
@@ -672,6 +842,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->drop_cache = qemu_opt_get_bool(opts, "drop-cache", true);
     s->check_cache_dropped = qemu_opt_get_bool(opts, "x-check-cache-dropped",
                                                false);
+    if (qemu_opt_get_bool(opts, "extent-cache", false)) {
+        s->extent_cache = g_new0(RawExtentCache, 1);
+    }
 
     s->open_flags = open_flags;
     raw_parse_flags(bdrv_flags, &s->open_flags, false);
@@ -724,7 +897,19 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 #endif /* !defined(CONFIG_LINUX_AIO) */
 
 #ifdef CONFIG_LINUX_IO_URING
-    if (s->use_linux_io_uring) {
+    if (s->use_linux_io_uring && (s->aio_sqpoll || s->aio_register_buffers)) {
+        s->luring = luring_init((s->aio_sqpoll ? LURING_SQPOLL : 0) |
+                                (s->aio_register_buffers ?
+                                 LURING_REGISTER_BUFFERS : 0), errp);
+        if (!s->luring) {
+            error_prepend(errp, "Unable to use io_uring: ");
+            ret = -EINVAL;
+            goto fail;
+        }
+        luring_attach_aio_context(s->luring, bdrv_get_aio_context(bs));
+        /* Not fatal, requests just use the plain file descriptor */
+        luring_register_file(s->luring, s->fd);
+    } else if (s->use_linux_io_uring) {
         if (!aio_setup_linux_io_uring(bdrv_get_aio_context(bs), errp)) {
             error_prepend(errp, "Unable to use io_uring: ");
             goto fail;
@@ -806,9 +991,20 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     }
     ret = 0;
 fail:
+#ifdef CONFIG_LINUX_IO_URING
+    if (ret < 0 && s->luring) {
+        luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+        luring_cleanup(s->luring);
+        s->luring = NULL;
+    }
+#endif
     if (ret < 0 && s->fd != -1) {
         qemu_close(s->fd);
     }
+    if (ret < 0) {
+        g_free(s->extent_cache);
+        s->extent_cache = NULL;
+    }
     if (filename && (bdrv_flags & BDRV_O_TEMPORARY)) {
         unlink(filename);
     }
@@ -1150,6 +1346,7 @@ static void raw_reopen_commit(BDRVReopenState *state)
     s->drop_cache = rs->drop_cache;
     s->check_cache_dropped = rs->check_cache_dropped;
     s->open_flags = rs->open_flags;
+    raw_extent_cache_drop_all(s);
     g_free(state->opaque);
     state->opaque = NULL;
 
@@ -1786,6 +1983,42 @@ static off_t copy_file_range(int in_fd, off_t *in_off, int out_fd,
 }
 #endif
 
+/*
+ * Tries to share the extents of the source with the destination instead of
+ * copying the data, which file systems like XFS and btrfs can do as a pure
+ * metadata operation.  Returns false if the range could not be cloned (e.g.
+ * because the files are on different file systems or the range is not
+ * aligned to the file system block size), and the caller must copy it.
+ */
+static bool raw_clone_range(RawPosixAIOData *aiocb)
+{
+#ifdef FICLONERANGE
+    struct file_clone_range fcr = {
+        .src_fd = aiocb->aio_fildes,
+        .src_offset = aiocb->aio_offset,
+        .src_length = aiocb->aio_nbytes,
+        .dest_offset = aiocb->copy_range.aio_offset2,
+    };
+    int ret;
+
+    /* A length of 0 would clone everything up to the end of the source */
+    if (!aiocb->aio_nbytes) {
+        return false;
+    }
+
+    do {
+        ret = ioctl(aiocb->copy_range.aio_fd2, FICLONERANGE, &fcr);
+    } while (ret == -1 && errno == EINTR);
+    trace_file_clone_range(aiocb->bs, aiocb->aio_fildes, aiocb->aio_offset,
+                           aiocb->copy_range.aio_fd2,
+                           aiocb->copy_range.aio_offset2, aiocb->aio_nbytes,
+                           ret == -1 ? -errno : 0);
+    return ret == 0;
+#else
+    return false;
+#endif
+}
+
 static int handle_aiocb_copy_range(void *opaque)
 {
     RawPosixAIOData *aiocb = opaque;
@@ -1793,6 +2026,10 @@ static int handle_aiocb_copy_range(void *opaque)
     off_t in_off = aiocb->aio_offset;
     off_t out_off = aiocb->copy_range.aio_offset2;
 
+    if (raw_clone_range(aiocb)) {
+        return 0;
+    }
+
     while (bytes) {
         ssize_t ret = copy_file_range(aiocb->aio_fildes, &in_off,
                                       aiocb->copy_range.aio_fd2, &out_off,
@@ -2046,6 +2283,18 @@ static int coroutine_fn raw_thread_pool_submit(BlockDriverState *bs,
     return thread_pool_submit_co(pool, func, arg);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static LuringState *raw_get_luring(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->luring) {
+        return s->luring;
+    }
+    return aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+}
+#endif
+
 static int coroutine_fn raw_co_prw(BlockDriverState *bs, uint64_t offset,
                                    uint64_t bytes, QEMUIOVector *qiov, int type)
 {
@@ -2065,7 +2314,7 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, uint64_t offset,
         type |= QEMU_AIO_MISALIGNED;
 #ifdef CONFIG_LINUX_IO_URING
     } else if (s->use_linux_io_uring) {
-        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        LuringState *aio = raw_get_luring(bs);
         assert(qiov->size == bytes);
         return luring_co_submit(bs, aio, s->fd, offset, qiov, type);
 #endif
@@ -2105,8 +2354,14 @@ static int coroutine_fn raw_co_pwritev(BlockDriverState *bs, int64_t offset,
                                        int64_t bytes, QEMUIOVector *qiov,
                                        BdrvRequestFlags flags)
 {
+    BDRVRawState *s = bs->opaque;
+    int ret;
+
     assert(flags == 0);
-    return raw_co_prw(bs, offset, bytes, qiov, QEMU_AIO_WRITE);
+    raw_extent_cache_write_begin(s, offset, bytes);
+    ret = raw_co_prw(bs, offset, bytes, qiov, QEMU_AIO_WRITE);
+    raw_extent_cache_write_end(s);
+    return ret;
 }
 
 static void raw_aio_plug(BlockDriverState *bs)
@@ -2120,7 +2375,7 @@ static void raw_aio_plug(BlockDriverState *bs)
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        LuringState *aio = raw_get_luring(bs);
         luring_io_plug(bs, aio);
     }
 #endif
@@ -2137,7 +2392,7 @@ static void raw_aio_unplug(BlockDriverState *bs)
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        LuringState *aio = raw_get_luring(bs);
         luring_io_unplug(bs, aio);
     }
 #endif
@@ -2162,13 +2417,24 @@ static int raw_co_flush_to_disk(BlockDriverState *bs)
 
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+        LuringState *aio = raw_get_luring(bs);
         return luring_co_submit(bs, aio, s->fd, 0, NULL, QEMU_AIO_FLUSH);
     }
 #endif
     return raw_thread_pool_submit(bs, handle_aiocb_flush, &acb);
 }
 
+static void raw_aio_detach_aio_context(BlockDriverState *bs)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    BDRVRawState *s = bs->opaque;
+
+    if (s->luring) {
+        luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+    }
+#endif
+}
+
 static void raw_aio_attach_aio_context(BlockDriverState *bs,
                                        AioContext *new_context)
 {
@@ -2184,7 +2450,9 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
     }
 #endif
 #ifdef CONFIG_LINUX_IO_URING
-    if (s->use_linux_io_uring) {
+    if (s->luring) {
+        luring_attach_aio_context(s->luring, new_context);
+    } else if (s->use_linux_io_uring) {
         Error *local_err = NULL;
         if (!aio_setup_linux_io_uring(new_context, &local_err)) {
             error_reportf_err(local_err, "Unable to use linux io_uring, "
@@ -2199,10 +2467,19 @@ static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->luring) {
+        luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+        luring_cleanup(s->luring);
+        s->luring = NULL;
+    }
+#endif
     if (s->fd >= 0) {
         qemu_close(s->fd);
         s->fd = -1;
     }
+    g_free(s->extent_cache);
+    s->extent_cache = NULL;
 }
 
 /**
@@ -2247,7 +2524,10 @@ static int coroutine_fn raw_co_truncate(BlockDriverState *bs, int64_t offset,
 
     if (S_ISREG(st.st_mode)) {
         /* Always resizes to the exact @offset */
-        return raw_regular_truncate(bs, s->fd, offset, prealloc, errp);
+        raw_extent_cache_write_begin(s, 0, -1);
+        ret = raw_regular_truncate(bs, s->fd, offset, prealloc, errp);
+        raw_extent_cache_write_end(s);
+        return ret;
     }
 
     if (prealloc != PREALLOC_MODE_OFF) {
@@ -2771,6 +3051,7 @@ static int coroutine_fn raw_co_block_status(BlockDriverState *bs,
                                             int64_t *map,
                                             BlockDriverState **file)
 {
+    BDRVRawState *s = bs->opaque;
     off_t data = 0, hole = 0;
     int ret;
 
@@ -2788,7 +3069,27 @@ static int coroutine_fn raw_co_block_status(BlockDriverState *bs,
         return BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
     }
 
-    ret = find_allocation(bs, offset, &data, &hole);
+    if (s->extent_cache) {
+        ret = raw_extent_cache_lookup(s, offset, &data, &hole);
+        if (ret == -ENOENT) {
+            ret = find_allocation(bs, offset, &data, &hole);
+            if (ret == -ENXIO) {
+                raw_extent_cache_insert(s, offset, INT64_MAX, false);
+            } else if (ret == 0 && data == offset) {
+                /*
+                 * A partial sector at EOF is rounded up below; do not cache
+                 * that, the file may grow behind it
+                 */
+                if (QEMU_IS_ALIGNED(hole, bs->bl.request_alignment)) {
+                    raw_extent_cache_insert(s, offset, hole, true);
+                }
+            } else if (ret == 0) {
+                raw_extent_cache_insert(s, offset, data, false);
+            }
+        }
+    } else {
+        ret = find_allocation(bs, offset, &data, &hole);
+    }
     if (ret == -ENXIO) {
         /* Trailing hole */
         *pnum = bytes;
@@ -2909,6 +3210,9 @@ static void coroutine_fn raw_co_invalidate_cache(BlockDriverState *bs,
         return;
     }
 
+    /* The migration source may have changed the file */
+    raw_extent_cache_drop_all(s);
+
     if (!s->drop_cache) {
         return;
     }
@@ -2978,7 +3282,9 @@ raw_do_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes,
         acb.aio_type |= QEMU_AIO_BLKDEV;
     }
 
+    raw_extent_cache_write_begin(s, offset, bytes);
     ret = raw_thread_pool_submit(bs, handle_aiocb_discard, &acb);
+    raw_extent_cache_write_end(s);
     raw_account_discard(s, bytes, ret);
     return ret;
 }
@@ -2996,6 +3302,7 @@ raw_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
     BDRVRawState *s = bs->opaque;
     RawPosixAIOData acb;
     ThreadPoolFunc *handler;
+    int ret;
 
 #ifdef CONFIG_FALLOCATE
     if (offset + bytes > bs->total_sectors * BDRV_SECTOR_SIZE) {
@@ -3053,7 +3360,10 @@ raw_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
         handler = handle_aiocb_write_zeroes;
     }
 
-    return raw_thread_pool_submit(bs, handler, &acb);
+    raw_extent_cache_write_begin(s, offset, bytes);
+    ret = raw_thread_pool_submit(bs, handler, &acb);
+    raw_extent_cache_write_end(s);
+    return ret;
 }
 
 static int coroutine_fn raw_co_pwrite_zeroes(
@@ -3195,6 +3505,11 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        if (s->luring) {
+            luring_register_file(s->luring, s->perm_change_fd);
+        }
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3241,6 +3556,7 @@ static int coroutine_fn raw_co_copy_range_to(BlockDriverState *bs,
     RawPosixAIOData acb;
     BDRVRawState *s = bs->opaque;
     BDRVRawState *src_s;
+    int ret;
 
     assert(dst->bs == bs);
     if (src->bs->drv->bdrv_co_copy_range_to != raw_co_copy_range_to) {
@@ -3264,7 +3580,10 @@ static int coroutine_fn raw_co_copy_range_to(BlockDriverState *bs,
         },
     };
 
-    return raw_thread_pool_submit(bs, handle_aiocb_copy_range, &acb);
+    raw_extent_cache_write_begin(s, dst_offset, bytes);
+    ret = raw_thread_pool_submit(bs, handle_aiocb_copy_range, &acb);
+    raw_extent_cache_write_end(s);
+    return ret;
 }
 
 BlockDriver bdrv_file = {
@@ -3296,6 +3615,7 @@ BlockDriver bdrv_file = {
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate = raw_co_truncate,
@@ -3662,6 +3982,7 @@ static BlockDriver bdrv_host_device = {
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate       = raw_co_truncate,
@@ -3786,6 +4107,7 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate    = raw_co_truncate,
@@ -3916,6 +4238,7 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate    = raw_co_truncate,
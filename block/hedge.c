@@ -0,0 +1,294 @@
+/*
+ * Hedged reads filter
+ *
+ * Network storage occasionally takes much longer than usual to complete a
+ * request, and a single slow read then stalls the guest.  This filter sends
+ * a read that is still pending after a deadline a second time, to the
+ * "alternate" child if there is one (another path or replica serving the
+ * same data) or to "file" again, and completes the request with whichever
+ * read succeeds first.  The deadline is either fixed or derived from the
+ * 99th percentile of recent read latencies.  All other requests go to
+ * "file" only.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "block/hedged-read.h"
+#include "qemu/host-utils.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define HEDGE_OPT_DEADLINE "deadline"
+
+/* The adaptive deadline is only used after this many reads */
+#define HEDGE_MIN_SAMPLES   100
+/* The histogram is halved after this many reads, so that old ones fade */
+#define HEDGE_DECAY_SAMPLES 1024
+/* Bucket i counts reads that took less than 2^i microseconds */
+#define HEDGE_BUCKETS       32
+
+typedef struct BDRVHedgeState {
+    BdrvChild *alternate;       /* NULL if reads are sent to file again */
+    int64_t deadline_ns;        /* 0 for the adaptive deadline */
+    uint32_t histogram[HEDGE_BUCKETS];
+    uint32_t samples;
+} BDRVHedgeState;
+
+static QemuOptsList hedge_runtime_opts = {
+    .name = "hedge",
+    .head = QTAILQ_HEAD_INITIALIZER(hedge_runtime_opts.head),
+    .desc = {
+        {
+            .name = HEDGE_OPT_DEADLINE,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Time in ms after which a pending read is sent again "
+                    "(default: 99th percentile of recent reads)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static int hedge_open(BlockDriverState *bs, QDict *options, int flags,
+                      Error **errp)
+{
+    ERRP_GUARD();
+    BDRVHedgeState *s = bs->opaque;
+    QemuOpts *opts;
+    int ret = -EINVAL;
+
+    opts = qemu_opts_create(&hedge_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+    s->deadline_ns = qemu_opt_get_number(opts, HEDGE_OPT_DEADLINE, 0);
+    if (s->deadline_ns < 0 || s->deadline_ns > INT64_MAX / SCALE_MS) {
+        error_setg(errp, "deadline is out of range");
+        goto out;
+    }
+    s->deadline_ns *= SCALE_MS;
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        goto out;
+    }
+
+    s->alternate = bdrv_open_child(NULL, options, "alternate", bs,
+                                   &child_of_bds, BDRV_CHILD_DATA, true, errp);
+    if (*errp) {
+        goto out;
+    }
+    if (s->alternate &&
+        bdrv_getlength(s->alternate->bs) != bdrv_getlength(bs->file->bs)) {
+        error_setg(errp, "alternate and file must have the same size");
+        goto out;
+    }
+
+    bs->supported_read_flags = bs->file->bs->supported_read_flags;
+    if (s->alternate) {
+        bs->supported_read_flags &= s->alternate->bs->supported_read_flags;
+    }
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    ret = 0;
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void hedge_close(BlockDriverState *bs)
+{
+    BDRVHedgeState *s = bs->opaque;
+
+    bdrv_unref_child(bs, s->alternate);
+    s->alternate = NULL;
+}
+
+static void hedge_child_perm(BlockDriverState *bs, BdrvChild *c,
+                             BdrvChildRole role,
+                             BlockReopenQueue *reopen_queue,
+                             uint64_t perm, uint64_t shared,
+                             uint64_t *nperm, uint64_t *nshared)
+{
+    if (!(role & BDRV_CHILD_PRIMARY)) {
+        /*
+         * Alternate child: it is only read from, and shows writes done
+         * through file, so let others do anything
+         */
+        *nperm = perm & BLK_PERM_CONSISTENT_READ;
+        *nshared = BLK_PERM_ALL;
+        return;
+    }
+
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                       nperm, nshared);
+}
+
+static int64_t hedge_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static void hedge_account(BDRVHedgeState *s, int64_t latency_ns)
+{
+    uint64_t us = latency_ns / SCALE_US;
+    int i;
+
+    i = us ? MIN(64 - clz64(us), HEDGE_BUCKETS - 1) : 0;
+    s->histogram[i]++;
+
+    if (++s->samples == HEDGE_DECAY_SAMPLES) {
+        s->samples = 0;
+        for (i = 0; i < HEDGE_BUCKETS; i++) {
+            s->histogram[i] /= 2;
+            s->samples += s->histogram[i];
+        }
+    }
+}
+
+/* Returns 0 if reads should not be hedged yet */
+static int64_t hedge_deadline(BDRVHedgeState *s)
+{
+    uint32_t target, count = 0;
+    int i;
+
+    if (s->deadline_ns) {
+        return s->deadline_ns;
+    }
+    if (s->samples < HEDGE_MIN_SAMPLES) {
+        return 0;
+    }
+
+    /* The upper bound of the bucket that holds the 99th percentile */
+    target = s->samples - s->samples / 100;
+    for (i = 0; i < HEDGE_BUCKETS - 1; i++) {
+        count += s->histogram[i];
+        if (count >= target) {
+            break;
+        }
+    }
+    return (1LL << i) * SCALE_US;
+}
+
+static void hedge_read_done(BlockDriverState *bs, BdrvChild *child,
+                            int64_t offset, int64_t bytes, int ret,
+                            int64_t latency_ns)
+{
+    if (ret == 0) {
+        hedge_account(bs->opaque, latency_ns);
+    }
+}
+
+static int coroutine_fn hedge_co_preadv_part(BlockDriverState *bs,
+                                             int64_t offset, int64_t bytes,
+                                             QEMUIOVector *qiov,
+                                             size_t qiov_offset,
+                                             BdrvRequestFlags flags)
+{
+    BDRVHedgeState *s = bs->opaque;
+    int64_t deadline = hedge_deadline(s);
+    HedgedRead *r;
+    bool hedged = false;
+    int ret;
+
+    /* Prefetches have no data to return, so there is nothing to win */
+    if (!deadline || (flags & BDRV_REQ_PREFETCH)) {
+        int64_t start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+        ret = bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                  flags);
+        if (ret == 0) {
+            hedge_account(s, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start);
+        }
+        return ret;
+    }
+
+    r = hedged_read_new(bs, offset, bytes, flags, hedge_read_done);
+    hedged_read_start(r, bs->file);
+    while (!hedged_read_succeeded(r)) {
+        if (!hedged_read_in_flight(r)) {
+            /* Fail over to the alternate child once */
+            if (hedged || !s->alternate) {
+                break;
+            }
+            hedged = true;
+            hedged_read_start(r, s->alternate);
+        } else if (!hedged) {
+            hedged_read_wait(r, deadline);
+            if (!hedged_read_succeeded(r) && hedged_read_in_flight(r)) {
+                trace_hedge_read(bs, offset, bytes, deadline);
+                hedged = true;
+                hedged_read_start(r, s->alternate ?: bs->file);
+            }
+        } else {
+            hedged_read_wait(r, 0);
+        }
+    }
+
+    return hedged_read_finish(r, qiov, qiov_offset);
+}
+
+static int coroutine_fn hedge_co_pwritev_part(BlockDriverState *bs,
+                                              int64_t offset, int64_t bytes,
+                                              QEMUIOVector *qiov,
+                                              size_t qiov_offset,
+                                              BdrvRequestFlags flags)
+{
+    return bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                flags);
+}
+
+static int coroutine_fn hedge_co_pwrite_zeroes(BlockDriverState *bs,
+                                               int64_t offset, int64_t bytes,
+                                               BdrvRequestFlags flags)
+{
+    return bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+}
+
+static int coroutine_fn hedge_co_pdiscard(BlockDriverState *bs,
+                                          int64_t offset, int64_t bytes)
+{
+    return bdrv_co_pdiscard(bs->file, offset, bytes);
+}
+
+static const char *const hedge_strong_runtime_opts[] = {
+    NULL
+};
+
+static BlockDriver bdrv_hedge = {
+    .format_name                        = "hedge",
+    .instance_size                      = sizeof(BDRVHedgeState),
+
+    .bdrv_open                          = hedge_open,
+    .bdrv_close                         = hedge_close,
+    .bdrv_child_perm                    = hedge_child_perm,
+
+    .bdrv_getlength                     = hedge_getlength,
+
+    .bdrv_co_preadv_part                = hedge_co_preadv_part,
+    .bdrv_co_pwritev_part               = hedge_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = hedge_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = hedge_co_pdiscard,
+
+    .is_filter                          = true,
+    .strong_runtime_opts                = hedge_strong_runtime_opts,
+};
+
+static void bdrv_hedge_init(void)
+{
+    bdrv_register(&bdrv_hedge);
+}
+
+block_init(bdrv_hedge_init);
@@ -0,0 +1,138 @@
+/*
+ * Reads sent to several children, completed by the first that succeeds
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "block/hedged-read.h"
+#include "qemu/coroutine.h"
+
+struct HedgedRead {
+    BlockDriverState *bs;
+    HedgedReadDoneFunc *done;
+    QemuCoSleep w;              /* the request waits here for child reads */
+    int64_t offset;
+    int64_t bytes;
+    BdrvRequestFlags flags;
+    int refcnt;                 /* the request and the child reads */
+    int in_flight;              /* child reads */
+    uint8_t *buf;               /* data of the first successful child read */
+    int ret;                    /* error of the last failed child read */
+};
+
+typedef struct HedgedReadCo {
+    HedgedRead *r;
+    BdrvChild *child;
+} HedgedReadCo;
+
+HedgedRead *hedged_read_new(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, BdrvRequestFlags flags,
+                            HedgedReadDoneFunc *done)
+{
+    HedgedRead *r = g_new(HedgedRead, 1);
+
+    *r = (HedgedRead) {
+        .bs = bs,
+        .done = done,
+        .offset = offset,
+        .bytes = bytes,
+        .flags = flags,
+        .refcnt = 1,
+        .ret = -EIO,
+    };
+    return r;
+}
+
+static void hedged_read_unref(HedgedRead *r)
+{
+    if (--r->refcnt == 0) {
+        qemu_vfree(r->buf);
+        g_free(r);
+    }
+}
+
+static void coroutine_fn hedged_read_entry(void *opaque)
+{
+    HedgedReadCo *co = opaque;
+    HedgedRead *r = co->r;
+    BdrvChild *child = co->child;
+    int64_t start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    QEMUIOVector qiov;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(child->bs, r->bytes);
+    if (!buf) {
+        ret = -ENOMEM;
+    } else {
+        qemu_iovec_init_buf(&qiov, buf, r->bytes);
+        ret = bdrv_co_preadv(child, r->offset, r->bytes, &qiov, r->flags);
+    }
+
+    r->done(r->bs, child, r->offset, r->bytes, ret,
+            qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start);
+    if (ret == 0 && !r->buf) {
+        r->buf = buf;
+        buf = NULL;
+    } else if (ret < 0) {
+        r->ret = ret;
+    }
+    qemu_vfree(buf);
+
+    r->in_flight--;
+    qemu_co_sleep_wake(&r->w);
+    bdrv_dec_in_flight(r->bs);
+    hedged_read_unref(r);
+}
+
+void coroutine_fn hedged_read_start(HedgedRead *r, BdrvChild *child)
+{
+    HedgedReadCo data = {
+        .r = r,
+        .child = child,
+    };
+    Coroutine *co;
+
+    r->in_flight++;
+    r->refcnt++;
+    /* Keep the node around if the request completes first */
+    bdrv_inc_in_flight(r->bs);
+
+    co = qemu_coroutine_create(hedged_read_entry, &data);
+    qemu_coroutine_enter(co);
+}
+
+bool hedged_read_succeeded(HedgedRead *r)
+{
+    return r->buf;
+}
+
+int hedged_read_in_flight(HedgedRead *r)
+{
+    return r->in_flight;
+}
+
+void coroutine_fn hedged_read_wait(HedgedRead *r, int64_t timeout_ns)
+{
+    if (timeout_ns) {
+        qemu_co_sleep_ns_wakeable(&r->w, QEMU_CLOCK_REALTIME, timeout_ns);
+    } else {
+        qemu_co_sleep(&r->w);
+    }
+}
+
+int hedged_read_finish(HedgedRead *r, QEMUIOVector *qiov, size_t qiov_offset)
+{
+    int ret = 0;
+
+    if (r->buf) {
+        qemu_iovec_from_buf(qiov, qiov_offset, r->buf, r->bytes);
+    } else {
+        ret = r->ret;
+    }
+    hedged_read_unref(r);
+    return ret;
+}
@@ -31,6 +31,7 @@
 #include "block/block_int.h"
 #include "block/coroutines.h"
 #include "block/write-threshold.h"
+#include "qemu/coroutine-prof.h"
 #include "qemu/cutils.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -742,6 +743,8 @@ static void tracked_request_end(BdrvTrackedRequest *req)
     QLIST_REMOVE(req, list);
     qemu_co_queue_restart_all(&req->wait_queue);
     qemu_co_mutex_unlock(&req->bs->reqs_lock);
+
+    coroutine_prof_pop_tag(req->prof_tag);
 }
 
 /**
@@ -771,6 +774,8 @@ static void tracked_request_begin(BdrvTrackedRequest *req,
     qemu_co_mutex_lock(&bs->reqs_lock);
     QLIST_INSERT_HEAD(&bs->tracked_requests, req, list);
     qemu_co_mutex_unlock(&bs->reqs_lock);
+
+    req->prof_tag = coroutine_prof_push_tag(bs->node_name);
 }
 
 static bool tracked_request_overlaps(BdrvTrackedRequest *req,
@@ -926,6 +931,28 @@ void bdrv_dec_in_flight(BlockDriverState *bs)
     bdrv_wakeup(bs);
 }
 
+/*
+ * Returns the start time of a request to @bs for bdrv_latency_done(), or -1
+ * if latencies are not accounted for @bs.  The caller must hold an in-flight
+ * reference, so that accounting cannot be switched on or off in between.
+ */
+static int64_t bdrv_latency_start(BlockDriverState *bs)
+{
+    if (!qatomic_read(&bs->latency_log_histogram)) {
+        return -1;
+    }
+    return block_latency_log_histogram_start();
+}
+
+static void bdrv_latency_done(BlockDriverState *bs, enum BlockAcctType type,
+                              int64_t start_time_ns)
+{
+    if (start_time_ns >= 0) {
+        block_latency_log_histogram_account(bs->latency_log_histogram, type,
+                                            start_time_ns);
+    }
+}
+
 static bool coroutine_fn bdrv_wait_serialising_requests(BdrvTrackedRequest *self)
 {
     BlockDriverState *bs = self->bs;
@@ -1808,6 +1835,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     BlockDriverState *bs = child->bs;
     BdrvTrackedRequest req;
     BdrvRequestPadding pad;
+    int64_t start_time_ns;
     int ret;
 
     trace_bdrv_co_preadv_part(bs, offset, bytes, flags);
@@ -1834,6 +1862,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_time_ns = bdrv_latency_start(bs);
 
     /* Don't do copy-on-read if we read data before write operation */
     if (qatomic_read(&bs->copy_on_read)) {
@@ -1854,6 +1883,7 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     bdrv_padding_destroy(&pad);
 
 fail:
+    bdrv_latency_done(bs, BLOCK_ACCT_READ, start_time_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
@@ -2241,6 +2271,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     BdrvTrackedRequest req;
     uint64_t align = bs->bl.request_alignment;
     BdrvRequestPadding pad;
+    int64_t start_time_ns;
     int ret;
     bool padded = false;
 
@@ -2292,6 +2323,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
     }
 
     bdrv_inc_in_flight(bs);
+    start_time_ns = bdrv_latency_start(bs);
     tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_WRITE);
 
     if (flags & BDRV_REQ_ZERO_WRITE) {
@@ -2318,6 +2350,7 @@ int coroutine_fn bdrv_co_pwritev_part(BdrvChild *child,
 
 out:
     tracked_request_end(&req);
+    bdrv_latency_done(bs, BLOCK_ACCT_WRITE, start_time_ns);
     bdrv_dec_in_flight(bs);
 
     return ret;
@@ -2619,6 +2652,140 @@ early_out:
     return ret;
 }
 
+/*
+ * Deep backing chains make every block status query walk all layers above
+ * the one that actually holds the data.  For such queries, @bs remembers in
+ * bs->chain_cache at which depth below it each queried range was found to be
+ * allocated, so that later queries can go straight to that layer.
+ *
+ * Entries are sorted by offset and do not overlap.  An entry is only valid
+ * as long as none of the skipped layers has been written to and the graph
+ * has not changed; this is detected by comparing the sum of their write_gen
+ * and bdrv_graph_gen.  Writes to @bs itself or to the layer that holds the
+ * data do not matter, because both are queried anyway.
+ */
+#define BDRV_CHAIN_CACHE_MIN_DEPTH      8
+#define BDRV_CHAIN_CACHE_MAX_ENTRIES    4096
+
+typedef struct BdrvChainCacheEntry {
+    int64_t start;
+    int64_t end;
+    unsigned int write_gen;     /* Sum of write_gen of skipped layers */
+    unsigned int graph_gen;
+    int depth;                  /* Layer holding the data, counted from @bs */
+    bool want_zero;
+} BdrvChainCacheEntry;
+
+/* Returns the index of the first entry that ends after @offset */
+static guint bdrv_chain_cache_find(GArray *cache, int64_t offset)
+{
+    guint lo = 0, hi = cache->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (g_array_index(cache, BdrvChainCacheEntry, mid).end <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Looks up @offset in the chain cache of @bs.  On a hit, returns the number
+ * of layers below @bs that can be skipped, sets *@p to the layer that holds
+ * the data, *@write_gen to the sum of the skipped layers' write_gen, and
+ * limits *@bytes to the cached range.  Returns 0 on a miss.
+ */
+static int coroutine_fn
+bdrv_chain_cache_lookup(BlockDriverState *bs, BlockDriverState *base,
+                        bool include_base, bool want_zero, int64_t offset,
+                        int64_t *bytes, unsigned int graph_gen,
+                        BlockDriverState **p, unsigned int *write_gen)
+{
+    BdrvChainCacheEntry e;
+    BlockDriverState *q = bs;
+    unsigned int gen = 0;
+    guint i;
+    int d;
+
+    if (!bs->chain_cache) {
+        return 0;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&bs->chain_cache_lock) {
+        i = bdrv_chain_cache_find(bs->chain_cache, offset);
+        if (i == bs->chain_cache->len) {
+            return 0;
+        }
+        e = g_array_index(bs->chain_cache, BdrvChainCacheEntry, i);
+    }
+
+    if (e.start > offset || e.want_zero != want_zero ||
+        e.graph_gen != graph_gen) {
+        return 0;
+    }
+
+    for (d = 1; d <= e.depth; d++) {
+        q = bdrv_filter_or_cow_bs(q);
+        if (!q || (q == base && (d < e.depth || !include_base))) {
+            /* Stop at @base as the uncached walk would */
+            return 0;
+        }
+        if (d < e.depth) {
+            gen += qatomic_read(&q->write_gen);
+        }
+    }
+    if (gen != e.write_gen) {
+        return 0;
+    }
+
+    *p = q;
+    *write_gen = gen;
+    *bytes = MIN(*bytes, e.end - offset);
+    return e.depth - 1;
+}
+
+static void coroutine_fn
+bdrv_chain_cache_fill(BlockDriverState *bs, bool want_zero, int64_t offset,
+                      int64_t bytes, int depth, unsigned int write_gen,
+                      unsigned int graph_gen)
+{
+    BdrvChainCacheEntry e = {
+        .start = offset,
+        .end = offset + bytes,
+        .write_gen = write_gen,
+        .graph_gen = graph_gen,
+        .depth = depth,
+        .want_zero = want_zero,
+    };
+    guint i, n;
+
+    QEMU_LOCK_GUARD(&bs->chain_cache_lock);
+
+    if (!bs->chain_cache) {
+        bs->chain_cache = g_array_new(false, false,
+                                      sizeof(BdrvChainCacheEntry));
+    } else if (bs->chain_cache->len >= BDRV_CHAIN_CACHE_MAX_ENTRIES) {
+        g_array_set_size(bs->chain_cache, 0);
+    }
+
+    /* Replace all entries that overlap the new one */
+    i = bdrv_chain_cache_find(bs->chain_cache, e.start);
+    for (n = 0; i + n < bs->chain_cache->len; n++) {
+        if (g_array_index(bs->chain_cache, BdrvChainCacheEntry,
+                          i + n).start >= e.end) {
+            break;
+        }
+    }
+    if (n) {
+        g_array_remove_range(bs->chain_cache, i, n);
+    }
+    g_array_insert_val(bs->chain_cache, i, e);
+}
+
 int coroutine_fn
 bdrv_co_common_block_status_above(BlockDriverState *bs,
                                   BlockDriverState *base,
@@ -2635,6 +2802,9 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
     BlockDriverState *p;
     int64_t eof = 0;
     int dummy;
+    int skipped;
+    unsigned int write_gen = 0;
+    unsigned int graph_gen = bdrv_get_graph_gen();
 
     assert(!include_base || base); /* Can't include NULL base */
 
@@ -2661,9 +2831,15 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
     assert(*pnum <= bytes);
     bytes = *pnum;
 
-    for (p = bdrv_filter_or_cow_bs(bs); include_base || p != base;
-         p = bdrv_filter_or_cow_bs(p))
-    {
+    p = bdrv_filter_or_cow_bs(bs);
+    skipped = bdrv_chain_cache_lookup(bs, base, include_base, want_zero,
+                                      offset, &bytes, graph_gen, &p,
+                                      &write_gen);
+    *depth += skipped;
+
+    for (; include_base || p != base; p = bdrv_filter_or_cow_bs(p)) {
+        unsigned int p_gen = qatomic_read(&p->write_gen);
+
         ret = bdrv_co_block_status(p, want_zero, offset, bytes, pnum, map,
                                    file);
         ++*depth;
@@ -2697,6 +2873,10 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
              * below.
              */
             ret &= ~BDRV_BLOCK_EOF;
+            if (!skipped && *depth - 1 >= BDRV_CHAIN_CACHE_MIN_DEPTH) {
+                bdrv_chain_cache_fill(bs, want_zero, offset, *pnum,
+                                      *depth - 1, write_gen, graph_gen);
+            }
             break;
         }
 
@@ -2711,6 +2891,7 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
          */
         assert(*pnum <= bytes);
         bytes = *pnum;
+        write_gen += p_gen;
     }
 
     if (offset + *pnum == eof) {
@@ -2934,10 +3115,12 @@ int coroutine_fn bdrv_co_flush(BlockDriverState *bs)
 {
     BdrvChild *primary_child = bdrv_primary_child(bs);
     BdrvChild *child;
+    int64_t start_time_ns;
     int current_gen;
     int ret = 0;
 
     bdrv_inc_in_flight(bs);
+    start_time_ns = bdrv_latency_start(bs);
 
     if (!bdrv_is_inserted(bs) || bdrv_is_read_only(bs) ||
         bdrv_is_sg(bs)) {
@@ -3049,6 +3232,7 @@ out:
     qemu_co_mutex_unlock(&bs->reqs_lock);
 
 early_exit:
+    bdrv_latency_done(bs, BLOCK_ACCT_FLUSH, start_time_ns);
     bdrv_dec_in_flight(bs);
     return ret;
 }
@@ -3058,7 +3242,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
 {
     BdrvTrackedRequest req;
     int ret;
-    int64_t max_pdiscard;
+    int64_t max_pdiscard, start_time_ns;
     int head, tail, align;
     BlockDriverState *bs = child->bs;
 
@@ -3098,6 +3282,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
     tail = (offset + bytes) % align;
 
     bdrv_inc_in_flight(bs);
+    start_time_ns = bdrv_latency_start(bs);
     tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_DISCARD);
 
     ret = bdrv_co_write_req_prepare(child, offset, bytes, &req, 0);
@@ -3168,6 +3353,7 @@ int coroutine_fn bdrv_co_pdiscard(BdrvChild *child, int64_t offset,
 out:
     bdrv_co_write_req_finish(child, req.offset, req.bytes, &req, ret);
     tracked_request_end(&req);
+    bdrv_latency_done(bs, BLOCK_ACCT_UNMAP, start_time_ns);
     bdrv_dec_in_flight(bs);
     return ret;
 }
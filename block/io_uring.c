@@ -16,15 +16,23 @@
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
+#include "qemu/error-report.h"
 #include "qapi/error.h"
+#include "exec/memory.h"
+#include "exec/ramlist.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* The kernel refuses to register buffers larger than 1 GiB */
+#define MAX_FIXED_BUF_SIZE (1ULL << 30)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
+    LuringState *s;
     struct io_uring_sqe sqeq;
+    AioUringRequest req; /* only with LURING_SHARED_RING */
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
@@ -49,7 +57,32 @@ typedef struct LuringQueue {
 typedef struct LuringState {
     AioContext *aio_context;
 
-    struct io_uring ring;
+    /*
+     * Either private_ring, or with LURING_SHARED_RING the io_uring used by
+     * the AioContext for file descriptor monitoring.  The latter lets a
+     * single io_uring_enter(2) submit requests and wait for both their
+     * completions and file descriptor events.
+     */
+    struct io_uring *ring;
+    struct io_uring private_ring;
+
+    /* LURING_* flags passed to luring_init() */
+    int flags;
+
+    /* File descriptor registered as fixed file 0, or -1 */
+    int fixed_fd;
+
+    /*
+     * Guest RAM registered as fixed buffers, as an array of struct iovec of
+     * at most MAX_FIXED_BUF_SIZE bytes each.  RAM blocks come and go in the
+     * main loop, so this is protected by buf_lock rather than by the
+     * AioContext lock.
+     */
+    QemuMutex buf_lock;
+    RAMBlockNotifier ram_notifier;
+    GArray *bufs;
+    bool bufs_registered;
+    bool bufs_ready;
 
     /* io queue for submit at batch.  Protected by AioContext lock. */
     LuringQueue io_q;
@@ -102,7 +135,11 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     qemu_iovec_concat(resubmit_qiov, luringcb->qiov, luringcb->total_read,
                       remaining);
 
-    /* Update sqe */
+    /* Update sqe, the remaining part does not match a fixed buffer anymore */
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.opcode = IORING_OP_READV;
+        luringcb->sqeq.buf_index = 0;
+    }
     luringcb->sqeq.off = nread;
     luringcb->sqeq.addr = (__u64)(uintptr_t)luringcb->resubmit_qiov.iov;
     luringcb->sqeq.len = luringcb->resubmit_qiov.niov;
@@ -110,6 +147,77 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luring_resubmit(s, luringcb);
 }
 
+/*
+ * Completes @luringcb, whose request returned @ret, or resubmits it.  The
+ * caller must ensure that ioq_submit() is called later in the latter case.
+ */
+static void luring_process_completion(LuringState *s, LuringAIOCB *luringcb,
+                                      int ret)
+{
+    int total_bytes;
+
+    /* Change counters one-by-one because we can be nested. */
+    s->io_q.in_flight--;
+    trace_luring_process_completion(s, luringcb, ret);
+
+    /* total_read is non-zero only for resubmitted read requests */
+    total_bytes = ret + luringcb->total_read;
+
+    if (ret < 0) {
+        /*
+         * Only writev/readv/fsync requests on regular files or host block
+         * devices are submitted. Therefore -EAGAIN is not expected but it's
+         * known to happen sometimes with Linux SCSI. Submit again and hope
+         * the request completes successfully.
+         *
+         * For more information, see:
+         * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
+         *
+         * If the code is changed to submit other types of requests in the
+         * future, then this workaround may need to be extended to deal with
+         * genuine -EAGAIN results that should not be resubmitted
+         * immediately.
+         */
+        if (ret == -EINTR || ret == -EAGAIN) {
+            luring_resubmit(s, luringcb);
+            return;
+        }
+    } else if (!luringcb->qiov) {
+        goto end;
+    } else if (total_bytes == luringcb->qiov->size) {
+        ret = 0;
+    /* Only read/write */
+    } else {
+        /* Short Read/Write */
+        if (luringcb->is_read) {
+            if (ret > 0) {
+                luring_resubmit_short_read(s, luringcb, ret);
+                return;
+            } else {
+                /* Pad with zeroes */
+                qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
+                                  luringcb->qiov->size - total_bytes);
+                ret = 0;
+            }
+        } else {
+            ret = -ENOSPC;
+        }
+    }
+end:
+    luringcb->ret = ret;
+    qemu_iovec_destroy(&luringcb->resubmit_qiov);
+
+    /*
+     * If the coroutine is already entered it must be in ioq_submit()
+     * and will notice luringcb->ret has been filled in when it
+     * eventually runs later. Coroutines cannot be entered recursively
+     * so avoid doing that!
+     */
+    if (!qemu_coroutine_entered(luringcb->co)) {
+        aio_co_wake(luringcb->co);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -126,7 +234,6 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 static void luring_process_completions(LuringState *s)
 {
     struct io_uring_cqe *cqes;
-    int total_bytes;
     /*
      * Request completion callbacks can run the nested event loop.
      * Schedule ourselves so the nested event loop will "see" remaining
@@ -144,7 +251,7 @@ static void luring_process_completions(LuringState *s)
      */
     qemu_bh_schedule(s->completion_bh);
 
-    while (io_uring_peek_cqe(&s->ring, &cqes) == 0) {
+    while (io_uring_peek_cqe(s->ring, &cqes) == 0) {
         LuringAIOCB *luringcb;
         int ret;
 
@@ -154,71 +261,38 @@ static void luring_process_completions(LuringState *s)
 
         luringcb = io_uring_cqe_get_data(cqes);
         ret = cqes->res;
-        io_uring_cqe_seen(&s->ring, cqes);
+        io_uring_cqe_seen(s->ring, cqes);
         cqes = NULL;
 
-        /* Change counters one-by-one because we can be nested. */
-        s->io_q.in_flight--;
-        trace_luring_process_completion(s, luringcb, ret);
-
-        /* total_read is non-zero only for resubmitted read requests */
-        total_bytes = ret + luringcb->total_read;
-
-        if (ret < 0) {
-            /*
-             * Only writev/readv/fsync requests on regular files or host block
-             * devices are submitted. Therefore -EAGAIN is not expected but it's
-             * known to happen sometimes with Linux SCSI. Submit again and hope
-             * the request completes successfully.
-             *
-             * For more information, see:
-             * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
-             *
-             * If the code is changed to submit other types of requests in the
-             * future, then this workaround may need to be extended to deal with
-             * genuine -EAGAIN results that should not be resubmitted
-             * immediately.
-             */
-            if (ret == -EINTR || ret == -EAGAIN) {
-                luring_resubmit(s, luringcb);
-                continue;
-            }
-        } else if (!luringcb->qiov) {
-            goto end;
-        } else if (total_bytes == luringcb->qiov->size) {
-            ret = 0;
-        /* Only read/write */
-        } else {
-            /* Short Read/Write */
-            if (luringcb->is_read) {
-                if (ret > 0) {
-                    luring_resubmit_short_read(s, luringcb, ret);
-                    continue;
-                } else {
-                    /* Pad with zeroes */
-                    qemu_iovec_memset(luringcb->qiov, total_bytes, 0,
-                                      luringcb->qiov->size - total_bytes);
-                    ret = 0;
-                }
-            } else {
-                ret = -ENOSPC;
-            }
-        }
-end:
-        luringcb->ret = ret;
-        qemu_iovec_destroy(&luringcb->resubmit_qiov);
+        luring_process_completion(s, luringcb, ret);
+    }
+    qemu_bh_cancel(s->completion_bh);
+}
 
-        /*
-         * If the coroutine is already entered it must be in ioq_submit()
-         * and will notice luringcb->ret has been filled in when it
-         * eventually runs later. Coroutines cannot be entered recursively
-         * so avoid doing that!
-         */
-        if (!qemu_coroutine_entered(luringcb->co)) {
-            aio_co_wake(luringcb->co);
+/*
+ * With LURING_SHARED_RING, requests are only queued on the ring here and
+ * submitted by the next aio_poll()
+ */
+static void ioq_queue_shared(LuringState *s)
+{
+    LuringAIOCB *luringcb, *luringcb_next;
+
+    QSIMPLEQ_FOREACH_SAFE(luringcb, &s->io_q.submit_queue, next,
+                          luringcb_next) {
+        struct io_uring_sqe *sqes = aio_get_sqe(s->aio_context);
+        if (!sqes) {
+            break;
         }
+        *sqes = luringcb->sqeq;
+        aio_sqe_set_request(sqes, &luringcb->req);
+        QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
+        s->io_q.in_flight++;
+        s->io_q.in_queue--;
     }
-    qemu_bh_cancel(s->completion_bh);
+    trace_luring_io_uring_submit(s, 0);
+
+    /* The queue is retried when a request completes */
+    s->io_q.blocked = (s->io_q.in_queue > 0);
 }
 
 static int ioq_submit(LuringState *s)
@@ -226,6 +300,11 @@ static int ioq_submit(LuringState *s)
     int ret = 0;
     LuringAIOCB *luringcb, *luringcb_next;
 
+    if (s->flags & LURING_SHARED_RING) {
+        ioq_queue_shared(s);
+        return 0;
+    }
+
     while (s->io_q.in_queue > 0) {
         /*
          * Try to fetch sqes from the ring for requests waiting in
@@ -233,7 +312,7 @@ static int ioq_submit(LuringState *s)
          */
         QSIMPLEQ_FOREACH_SAFE(luringcb, &s->io_q.submit_queue, next,
                               luringcb_next) {
-            struct io_uring_sqe *sqes = io_uring_get_sqe(&s->ring);
+            struct io_uring_sqe *sqes = io_uring_get_sqe(s->ring);
             if (!sqes) {
                 break;
             }
@@ -241,7 +320,7 @@ static int ioq_submit(LuringState *s)
             *sqes = luringcb->sqeq;
             QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
         }
-        ret = io_uring_submit(&s->ring);
+        ret = io_uring_submit(s->ring);
         trace_luring_io_uring_submit(s, ret);
         /* Prevent infinite loop if submission is refused */
         if (ret <= 0) {
@@ -292,7 +371,7 @@ static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
 
-    return io_uring_cq_ready(&s->ring);
+    return io_uring_cq_ready(s->ring);
 }
 
 static void qemu_luring_poll_ready(void *opaque)
@@ -302,6 +381,20 @@ static void qemu_luring_poll_ready(void *opaque)
     luring_process_completions_and_submit(s);
 }
 
+static void luring_shared_request_done(AioUringRequest *req)
+{
+    LuringAIOCB *luringcb = container_of(req, LuringAIOCB, req);
+    LuringState *s = luringcb->s;
+
+    aio_context_acquire(s->aio_context);
+    luring_process_completion(s, luringcb, req->res);
+
+    if (!s->io_q.plugged && s->io_q.in_queue > 0) {
+        ioq_submit(s);
+    }
+    aio_context_release(s->aio_context);
+}
+
 static void ioq_init(LuringQueue *io_q)
 {
     QSIMPLEQ_INIT(&io_q->submit_queue);
@@ -328,6 +421,45 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
     }
 }
 
+/**
+ * luring_find_fixed_buf:
+ * @s: AIO state
+ * @qiov: request I/O vector
+ *
+ * Returns the index of the registered buffer that contains @qiov, or -1 if
+ * the request cannot be submitted as a fixed buffer read or write.  Only
+ * single-element vectors qualify, which is the common case for guest
+ * requests that are not split by the block layer.
+ */
+static int luring_find_fixed_buf(LuringState *s, QEMUIOVector *qiov)
+{
+    uintptr_t start, end;
+    unsigned int i;
+    int ret = -1;
+
+    if (!(s->flags & LURING_REGISTER_BUFFERS) || qiov->niov != 1) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+
+    qemu_mutex_lock(&s->buf_lock);
+    if (s->bufs_registered) {
+        for (i = 0; i < s->bufs->len; i++) {
+            struct iovec *iov = &g_array_index(s->bufs, struct iovec, i);
+            uintptr_t base = (uintptr_t)iov->iov_base;
+
+            if (start >= base && end <= base + iov->iov_len) {
+                ret = i;
+                break;
+            }
+        }
+    }
+    qemu_mutex_unlock(&s->buf_lock);
+    return ret;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -342,17 +474,31 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
 static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
-    int ret;
+    int ret, buf_index;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        buf_index = luring_find_fixed_buf(s, luringcb->qiov);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->iov[0].iov_len, offset,
+                                      buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        buf_index = luring_find_fixed_buf(s, luringcb->qiov);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->iov[0].iov_len, offset,
+                                     buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -362,6 +508,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fd == s->fixed_fd) {
+        sqes->fd = 0;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -384,6 +534,8 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
     int ret;
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
+        .s          = s,
+        .req.cb     = luring_shared_request_done,
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
@@ -404,7 +556,14 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
 
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
-    aio_set_fd_handler(old_context, s->ring.ring_fd, false,
+    if (s->flags & LURING_SHARED_RING) {
+        /* The ring belongs to the AioContext */
+        s->ring = NULL;
+        s->aio_context = NULL;
+        return;
+    }
+
+    aio_set_fd_handler(old_context, s->ring->ring_fd, false,
                        NULL, NULL, NULL, NULL, s);
     qemu_bh_delete(s->completion_bh);
     s->aio_context = NULL;
@@ -413,27 +572,175 @@ void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 void luring_attach_aio_context(LuringState *s, AioContext *new_context)
 {
     s->aio_context = new_context;
+
+    if (s->flags & LURING_SHARED_RING) {
+        /* Completions are dispatched by aio_poll() */
+        s->ring = &new_context->fdmon_io_uring;
+        return;
+    }
+
     s->completion_bh = aio_bh_new(new_context, qemu_luring_completion_bh, s);
-    aio_set_fd_handler(s->aio_context, s->ring.ring_fd, false,
+    aio_set_fd_handler(s->aio_context, s->ring->ring_fd, false,
                        qemu_luring_completion_cb, NULL,
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+int luring_register_file(LuringState *s, int fd)
+{
+    int ret;
+
+    if (s->fixed_fd >= 0) {
+        ret = io_uring_register_files_update(s->ring, 0, &fd, 1);
+    } else {
+        ret = io_uring_register_files(s->ring, &fd, 1);
+    }
+    trace_luring_register_file(s, fd, ret);
+    if (ret < 0) {
+        /* Never leave a stale file behind a file descriptor number */
+        luring_unregister_file(s);
+        return ret;
+    }
+
+    s->fixed_fd = fd;
+    return 0;
+}
+
+void luring_unregister_file(LuringState *s)
+{
+    if (s->fixed_fd >= 0) {
+        io_uring_unregister_files(s->ring);
+        s->fixed_fd = -1;
+    }
+}
+
+/* Called with buf_lock held */
+static void luring_register_buffers(LuringState *s)
+{
+    int ret;
+
+    if (s->bufs_registered) {
+        io_uring_unregister_buffers(s->ring);
+        s->bufs_registered = false;
+    }
+    if (!s->bufs->len) {
+        return;
+    }
+
+    ret = io_uring_register_buffers(s->ring, (struct iovec *)s->bufs->data,
+                                    s->bufs->len);
+    trace_luring_register_buffers(s, s->bufs->len, ret);
+    if (ret < 0) {
+        warn_report("io_uring: failed to register guest RAM as fixed "
+                    "buffers (%s), falling back to unregistered buffers",
+                    strerror(-ret));
+        return;
+    }
+    s->bufs_registered = true;
+}
+
+static void luring_ram_block_added(RAMBlockNotifier *n, void *host,
+                                   size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    size_t offset;
+
+    qemu_mutex_lock(&s->buf_lock);
+    for (offset = 0; offset < max_size; offset += MAX_FIXED_BUF_SIZE) {
+        struct iovec iov = {
+            .iov_base = host + offset,
+            .iov_len = MIN(max_size - offset, MAX_FIXED_BUF_SIZE),
+        };
+        g_array_append_val(s->bufs, iov);
+    }
+    if (s->bufs_ready) {
+        luring_register_buffers(s);
+    }
+    qemu_mutex_unlock(&s->buf_lock);
+}
+
+static void luring_ram_block_removed(RAMBlockNotifier *n, void *host,
+                                     size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    uintptr_t start = (uintptr_t)host;
+    unsigned int i;
+
+    if (!host) {
+        return;
+    }
+
+    qemu_mutex_lock(&s->buf_lock);
+    for (i = 0; i < s->bufs->len; ) {
+        struct iovec *iov = &g_array_index(s->bufs, struct iovec, i);
+        uintptr_t base = (uintptr_t)iov->iov_base;
+
+        if (base >= start && base < start + max_size) {
+            g_array_remove_index(s->bufs, i);
+        } else {
+            i++;
+        }
+    }
+    luring_register_buffers(s);
+    qemu_mutex_unlock(&s->buf_lock);
+}
+
+LuringState *luring_init(int flags, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
-    struct io_uring *ring = &s->ring;
+    struct io_uring *ring = &s->private_ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (flags & LURING_SHARED_RING) {
+        /* The ring is only known when attaching to the AioContext */
+        assert(!(flags & (LURING_SQPOLL | LURING_REGISTER_BUFFERS)));
+        s->flags = flags;
+        s->fixed_fd = -1;
+        ioq_init(&s->io_q);
+        return s;
+    }
+
+    /*
+     * The kernel submission thread idles after 1 second without requests,
+     * io_uring_submit() wakes it up again when needed.
+     */
+    rc = io_uring_queue_init(MAX_ENTRIES, ring,
+                             flags & LURING_SQPOLL ? IORING_SETUP_SQPOLL : 0);
     if (rc < 0) {
         error_setg_errno(errp, errno, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
 
+    s->ring = ring;
+    s->flags = flags;
+    s->fixed_fd = -1;
+
+    if (flags & LURING_REGISTER_BUFFERS) {
+        /* Registered buffers are pinned, like VFIO DMA mappings */
+        rc = ram_block_discard_disable(true);
+        if (rc) {
+            error_setg_errno(errp, -rc, "cannot register guest RAM with "
+                             "io_uring while RAM discards are in use");
+            io_uring_queue_exit(ring);
+            g_free(s);
+            return NULL;
+        }
+
+        qemu_mutex_init(&s->buf_lock);
+        s->bufs = g_array_new(FALSE, FALSE, sizeof(struct iovec));
+        s->ram_notifier.ram_block_added = luring_ram_block_added;
+        s->ram_notifier.ram_block_removed = luring_ram_block_removed;
+        ram_block_notifier_add(&s->ram_notifier);
+
+        /* Register all existing RAM blocks in one go */
+        qemu_mutex_lock(&s->buf_lock);
+        s->bufs_ready = true;
+        luring_register_buffers(s);
+        qemu_mutex_unlock(&s->buf_lock);
+    }
+
     ioq_init(&s->io_q);
     return s;
 
@@ -441,7 +748,17 @@ LuringState *luring_init(Error **errp)
 
 void luring_cleanup(LuringState *s)
 {
-    io_uring_queue_exit(&s->ring);
+    if (s->flags & LURING_REGISTER_BUFFERS) {
+        ram_block_notifier_remove(&s->ram_notifier);
+    }
+    if (!(s->flags & LURING_SHARED_RING)) {
+        io_uring_queue_exit(&s->private_ring);
+    }
+    if (s->flags & LURING_REGISTER_BUFFERS) {
+        g_array_free(s->bufs, TRUE);
+        qemu_mutex_destroy(&s->buf_lock);
+        ram_block_discard_disable(false);
+    }
     trace_luring_cleanup_state(s);
     g_free(s);
 }
@@ -62,14 +62,25 @@ QEMU_BUILD_BUG_ON((int)SCSI_XFER_NONE != (int)ISCSI_XFER_NONE);
 #include <scsi/sg.h>
 #endif
 
+/* A session to the target.  Reads and writes are spread over all of them. */
+typedef struct IscsiSession {
+    struct IscsiLun *iscsilun;
+    struct iscsi_context *iscsi;
+    int events;
+} IscsiSession;
+
 typedef struct IscsiLun {
+    /* The first session, used for everything but reads and writes */
     struct iscsi_context *iscsi;
+    IscsiSession *sessions;
+    int num_sessions;
+    int next_session;
+    bool poll;
     AioContext *aio_context;
     int lun;
     enum scsi_inquiry_peripheral_device_type type;
     int block_size;
     uint64_t num_blocks;
-    int events;
     QEMUTimer *nop_timer;
     QEMUTimer *event_timer;
     QemuMutex mutex;
@@ -136,6 +147,7 @@ typedef struct IscsiAIOCB {
 #define EVENT_INTERVAL 1000
 #define NOP_INTERVAL 5000
 #define MAX_NOP_FAILURES 3
+#define ISCSI_MAX_SESSIONS 16
 #define ISCSI_CMD_RETRIES ARRAY_SIZE(iscsi_retry_times)
 static const unsigned iscsi_retry_times[] = {8, 32, 128, 512, 2048, 8192, 32768};
 
@@ -351,35 +363,80 @@ static const AIOCBInfo iscsi_aiocb_info = {
 static void iscsi_process_read(void *arg);
 static void iscsi_process_write(void *arg);
 
+/*
+ * With poll=on, busy-poll the socket for replies instead of waiting for the
+ * AioContext to report it readable.  Only IOThreads with poll-max-ns set
+ * use it.
+ */
+static bool iscsi_poll_cb(void *opaque)
+{
+    IscsiSession *session = opaque;
+    struct pollfd pfd = {
+        .fd = iscsi_get_fd(session->iscsi),
+        .events = POLLIN,
+    };
+
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
 /* Called with QemuMutex held.  */
 static void
-iscsi_set_events(IscsiLun *iscsilun)
+iscsi_session_set_events(IscsiSession *session)
 {
-    struct iscsi_context *iscsi = iscsilun->iscsi;
+    IscsiLun *iscsilun = session->iscsilun;
+    struct iscsi_context *iscsi = session->iscsi;
     int ev = iscsi_which_events(iscsi);
+    bool poll = iscsilun->poll && (ev & POLLIN);
 
-    if (ev != iscsilun->events) {
+    if (ev != session->events) {
         aio_set_fd_handler(iscsilun->aio_context, iscsi_get_fd(iscsi),
                            false,
                            (ev & POLLIN) ? iscsi_process_read : NULL,
                            (ev & POLLOUT) ? iscsi_process_write : NULL,
-                           NULL, NULL,
-                           iscsilun);
-        iscsilun->events = ev;
+                           poll ? iscsi_poll_cb : NULL,
+                           poll ? iscsi_process_read : NULL,
+                           session);
+        session->events = ev;
     }
 }
 
+/* Called with QemuMutex held.  */
+static void
+iscsi_set_events(IscsiLun *iscsilun)
+{
+    int i;
+
+    for (i = 0; i < iscsilun->num_sessions; i++) {
+        iscsi_session_set_events(&iscsilun->sessions[i]);
+    }
+}
+
+/* Called with QemuMutex held.  Returns the session for the next request. */
+static struct iscsi_context *iscsi_next_session(IscsiLun *iscsilun)
+{
+    IscsiSession *session = &iscsilun->sessions[iscsilun->next_session];
+
+    iscsilun->next_session = (iscsilun->next_session + 1) %
+                             iscsilun->num_sessions;
+    return session->iscsi;
+}
+
 static void iscsi_timed_check_events(void *opaque)
 {
     IscsiLun *iscsilun = opaque;
+    int i;
 
     WITH_QEMU_LOCK_GUARD(&iscsilun->mutex) {
         /* check for timed out requests */
-        iscsi_service(iscsilun->iscsi, 0);
+        for (i = 0; i < iscsilun->num_sessions; i++) {
+            iscsi_service(iscsilun->sessions[i].iscsi, 0);
+        }
 
         if (iscsilun->request_timed_out) {
             iscsilun->request_timed_out = false;
-            iscsi_reconnect(iscsilun->iscsi);
+            for (i = 0; i < iscsilun->num_sessions; i++) {
+                iscsi_reconnect(iscsilun->sessions[i].iscsi);
+            }
         }
 
         /*
@@ -396,24 +453,24 @@ static void iscsi_timed_check_events(void *opaque)
 static void
 iscsi_process_read(void *arg)
 {
-    IscsiLun *iscsilun = arg;
-    struct iscsi_context *iscsi = iscsilun->iscsi;
+    IscsiSession *session = arg;
+    IscsiLun *iscsilun = session->iscsilun;
 
     qemu_mutex_lock(&iscsilun->mutex);
-    iscsi_service(iscsi, POLLIN);
-    iscsi_set_events(iscsilun);
+    iscsi_service(session->iscsi, POLLIN);
+    iscsi_session_set_events(session);
     qemu_mutex_unlock(&iscsilun->mutex);
 }
 
 static void
 iscsi_process_write(void *arg)
 {
-    IscsiLun *iscsilun = arg;
-    struct iscsi_context *iscsi = iscsilun->iscsi;
+    IscsiSession *session = arg;
+    IscsiLun *iscsilun = session->iscsilun;
 
     qemu_mutex_lock(&iscsilun->mutex);
-    iscsi_service(iscsi, POLLOUT);
-    iscsi_set_events(iscsilun);
+    iscsi_service(session->iscsi, POLLOUT);
+    iscsi_session_set_events(session);
     qemu_mutex_unlock(&iscsilun->mutex);
 }
 
@@ -603,6 +660,7 @@ iscsi_co_writev(BlockDriverState *bs, int64_t sector_num, int nb_sectors,
                 QEMUIOVector *iov, int flags)
 {
     IscsiLun *iscsilun = bs->opaque;
+    struct iscsi_context *iscsi;
     struct IscsiTask iTask;
     uint64_t lba;
     uint32_t num_sectors;
@@ -624,28 +682,29 @@ iscsi_co_writev(BlockDriverState *bs, int64_t sector_num, int nb_sectors,
     num_sectors = sector_qemu2lun(nb_sectors, iscsilun);
     iscsi_co_init_iscsitask(iscsilun, &iTask);
     qemu_mutex_lock(&iscsilun->mutex);
+    iscsi = iscsi_next_session(iscsilun);
 retry:
     if (iscsilun->use_16_for_rw) {
 #if LIBISCSI_API_VERSION >= (20160603)
-        iTask.task = iscsi_write16_iov_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_write16_iov_task(iscsi, iscsilun->lun, lba,
                                             NULL, num_sectors * iscsilun->block_size,
                                             iscsilun->block_size, 0, 0, fua, 0, 0,
                                             iscsi_co_generic_cb, &iTask,
                                             (struct scsi_iovec *)iov->iov, iov->niov);
     } else {
-        iTask.task = iscsi_write10_iov_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_write10_iov_task(iscsi, iscsilun->lun, lba,
                                             NULL, num_sectors * iscsilun->block_size,
                                             iscsilun->block_size, 0, 0, fua, 0, 0,
                                             iscsi_co_generic_cb, &iTask,
                                             (struct scsi_iovec *)iov->iov, iov->niov);
     }
 #else
-        iTask.task = iscsi_write16_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_write16_task(iscsi, iscsilun->lun, lba,
                                         NULL, num_sectors * iscsilun->block_size,
                                         iscsilun->block_size, 0, 0, fua, 0, 0,
                                         iscsi_co_generic_cb, &iTask);
     } else {
-        iTask.task = iscsi_write10_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_write10_task(iscsi, iscsilun->lun, lba,
                                         NULL, num_sectors * iscsilun->block_size,
                                         iscsilun->block_size, 0, 0, fua, 0, 0,
                                         iscsi_co_generic_cb, &iTask);
@@ -799,6 +858,7 @@ static int coroutine_fn iscsi_co_readv(BlockDriverState *bs,
                                        QEMUIOVector *iov)
 {
     IscsiLun *iscsilun = bs->opaque;
+    struct iscsi_context *iscsi;
     struct IscsiTask iTask;
     uint64_t lba;
     uint32_t num_sectors;
@@ -856,16 +916,17 @@ static int coroutine_fn iscsi_co_readv(BlockDriverState *bs,
 
     iscsi_co_init_iscsitask(iscsilun, &iTask);
     qemu_mutex_lock(&iscsilun->mutex);
+    iscsi = iscsi_next_session(iscsilun);
 retry:
     if (iscsilun->use_16_for_rw) {
 #if LIBISCSI_API_VERSION >= (20160603)
-        iTask.task = iscsi_read16_iov_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_read16_iov_task(iscsi, iscsilun->lun, lba,
                                            num_sectors * iscsilun->block_size,
                                            iscsilun->block_size, 0, 0, 0, 0, 0,
                                            iscsi_co_generic_cb, &iTask,
                                            (struct scsi_iovec *)iov->iov, iov->niov);
     } else {
-        iTask.task = iscsi_read10_iov_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_read10_iov_task(iscsi, iscsilun->lun, lba,
                                            num_sectors * iscsilun->block_size,
                                            iscsilun->block_size,
                                            0, 0, 0, 0, 0,
@@ -873,12 +934,12 @@ retry:
                                            (struct scsi_iovec *)iov->iov, iov->niov);
     }
 #else
-        iTask.task = iscsi_read16_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_read16_task(iscsi, iscsilun->lun, lba,
                                        num_sectors * iscsilun->block_size,
                                        iscsilun->block_size, 0, 0, 0, 0, 0,
                                        iscsi_co_generic_cb, &iTask);
     } else {
-        iTask.task = iscsi_read10_task(iscsilun->iscsi, iscsilun->lun, lba,
+        iTask.task = iscsi_read10_task(iscsi, iscsilun->lun, lba,
                                        num_sectors * iscsilun->block_size,
                                        iscsilun->block_size,
                                        0, 0, 0, 0, 0,
@@ -1407,14 +1468,20 @@ static char *get_initiator_name(QemuOpts *opts)
 static void iscsi_nop_timed_event(void *opaque)
 {
     IscsiLun *iscsilun = opaque;
+    int i;
 
     QEMU_LOCK_GUARD(&iscsilun->mutex);
-    if (iscsi_get_nops_in_flight(iscsilun->iscsi) >= MAX_NOP_FAILURES) {
-        error_report("iSCSI: NOP timeout. Reconnecting...");
-        iscsilun->request_timed_out = true;
-    } else if (iscsi_nop_out_async(iscsilun->iscsi, NULL, NULL, 0, NULL) != 0) {
-        error_report("iSCSI: failed to sent NOP-Out. Disabling NOP messages.");
-        return;
+    for (i = 0; i < iscsilun->num_sessions; i++) {
+        struct iscsi_context *iscsi = iscsilun->sessions[i].iscsi;
+
+        if (iscsi_get_nops_in_flight(iscsi) >= MAX_NOP_FAILURES) {
+            error_report("iSCSI: NOP timeout. Reconnecting...");
+            iscsilun->request_timed_out = true;
+        } else if (iscsi_nop_out_async(iscsi, NULL, NULL, 0, NULL) != 0) {
+            error_report("iSCSI: failed to sent NOP-Out. "
+                         "Disabling NOP messages.");
+            return;
+        }
     }
 
     timer_mod(iscsilun->nop_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + NOP_INTERVAL);
@@ -1532,10 +1599,15 @@ fail_with_err:
 static void iscsi_detach_aio_context(BlockDriverState *bs)
 {
     IscsiLun *iscsilun = bs->opaque;
+    int i;
 
-    aio_set_fd_handler(iscsilun->aio_context, iscsi_get_fd(iscsilun->iscsi),
-                       false, NULL, NULL, NULL, NULL, NULL);
-    iscsilun->events = 0;
+    for (i = 0; i < iscsilun->num_sessions; i++) {
+        IscsiSession *session = &iscsilun->sessions[i];
+
+        aio_set_fd_handler(iscsilun->aio_context, iscsi_get_fd(session->iscsi),
+                           false, NULL, NULL, NULL, NULL, NULL);
+        session->events = 0;
+    }
 
     if (iscsilun->nop_timer) {
         timer_free(iscsilun->nop_timer);
@@ -1758,6 +1830,14 @@ static QemuOptsList runtime_opts = {
             .name = "timeout",
             .type = QEMU_OPT_NUMBER,
         },
+        {
+            .name = "sessions",
+            .type = QEMU_OPT_NUMBER,
+        },
+        {
+            .name = "poll",
+            .type = QEMU_OPT_BOOL,
+        },
         { /* end of list */ }
     },
 };
@@ -1786,75 +1866,51 @@ static void iscsi_save_designator(IscsiLun *lun,
     }
 }
 
-static int iscsi_open(BlockDriverState *bs, QDict *options, int flags,
-                      Error **errp)
+static bool iscsi_transport_valid(const char *transport_name)
 {
-    IscsiLun *iscsilun = bs->opaque;
-    struct iscsi_context *iscsi = NULL;
-    struct scsi_task *task = NULL;
-    struct scsi_inquiry_standard *inq = NULL;
-    struct scsi_inquiry_supported_pages *inq_vpd;
-    char *initiator_name = NULL;
-    QemuOpts *opts;
-    Error *local_err = NULL;
-    const char *transport_name, *portal, *target;
 #if LIBISCSI_API_VERSION >= (20160603)
-    enum iscsi_transport_type transport;
-#endif
-    int i, ret = 0, timeout = 0, lun;
-
-    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
-    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
-        ret = -EINVAL;
-        goto out;
-    }
-
-    transport_name = qemu_opt_get(opts, "transport");
-    portal = qemu_opt_get(opts, "portal");
-    target = qemu_opt_get(opts, "target");
-    lun = qemu_opt_get_number(opts, "lun", 0);
-
-    if (!transport_name || !portal || !target) {
-        error_setg(errp, "Need all of transport, portal and target options");
-        ret = -EINVAL;
-        goto out;
+    if (!strcmp(transport_name, "iser")) {
+        return true;
     }
+#endif
+    /* TCP is what older libiscsi versions always use */
+    return !strcmp(transport_name, "tcp");
+}
 
-    if (!strcmp(transport_name, "tcp")) {
+/*
+ * Log in to the LUN described by @opts, which iscsi_open() has already
+ * validated.  Every call creates a new session.
+ */
+static int iscsi_connect(QemuOpts *opts, const char *initiator_name,
+                         struct iscsi_context **piscsi, Error **errp)
+{
 #if LIBISCSI_API_VERSION >= (20160603)
-        transport = TCP_TRANSPORT;
-    } else if (!strcmp(transport_name, "iser")) {
-        transport = ISER_TRANSPORT;
-#else
-        /* TCP is what older libiscsi versions always use */
+    const char *transport_name = qemu_opt_get(opts, "transport");
 #endif
-    } else {
-        error_setg(errp, "Unknown transport: %s", transport_name);
-        ret = -EINVAL;
-        goto out;
-    }
-
-    memset(iscsilun, 0, sizeof(IscsiLun));
-
-    initiator_name = get_initiator_name(opts);
+    const char *portal = qemu_opt_get(opts, "portal");
+    const char *target = qemu_opt_get(opts, "target");
+    int lun = qemu_opt_get_number(opts, "lun", 0);
+    struct iscsi_context *iscsi;
+    Error *local_err = NULL;
+    int ret, timeout;
 
     iscsi = iscsi_create_context(initiator_name);
     if (iscsi == NULL) {
         error_setg(errp, "iSCSI: Failed to create iSCSI context.");
-        ret = -ENOMEM;
-        goto out;
+        return -ENOMEM;
     }
 #if LIBISCSI_API_VERSION >= (20160603)
-    if (iscsi_init_transport(iscsi, transport)) {
+    if (iscsi_init_transport(iscsi, strcmp(transport_name, "iser") ?
+                                    TCP_TRANSPORT : ISER_TRANSPORT)) {
         error_setg(errp, ("Error initializing transport."));
         ret = -EINVAL;
-        goto out;
+        goto fail;
     }
 #endif
     if (iscsi_set_targetname(iscsi, target)) {
         error_setg(errp, "iSCSI: Failed to set target name.");
         ret = -EINVAL;
-        goto out;
+        goto fail;
     }
 
     /* check if we got CHAP username/password via the options */
@@ -1862,13 +1918,13 @@ static int iscsi_open(BlockDriverState *bs, QDict *options, int flags,
     if (local_err != NULL) {
         error_propagate(errp, local_err);
         ret = -EINVAL;
-        goto out;
+        goto fail;
     }
 
     if (iscsi_set_session_type(iscsi, ISCSI_SESSION_NORMAL) != 0) {
         error_setg(errp, "iSCSI: Failed to set session type to normal.");
         ret = -EINVAL;
-        goto out;
+        goto fail;
     }
 
     /* check if we got HEADER_DIGEST via the options */
@@ -1876,7 +1932,7 @@ static int iscsi_open(BlockDriverState *bs, QDict *options, int flags,
     if (local_err != NULL) {
         error_propagate(errp, local_err);
         ret = -EINVAL;
-        goto out;
+        goto fail;
     }
 
     /* timeout handling is broken in libiscsi before 1.15.0 */
@@ -1893,10 +1949,99 @@ static int iscsi_open(BlockDriverState *bs, QDict *options, int flags,
         error_setg(errp, "iSCSI: Failed to connect to LUN : %s",
             iscsi_get_error(iscsi));
         ret = -EINVAL;
+        goto fail;
+    }
+
+    *piscsi = iscsi;
+    return 0;
+
+fail:
+    if (iscsi_is_logged_in(iscsi)) {
+        iscsi_logout_sync(iscsi);
+    }
+    iscsi_destroy_context(iscsi);
+    return ret;
+}
+
+/* Log out of all sessions */
+static void iscsi_disconnect(IscsiLun *iscsilun)
+{
+    int i;
+
+    for (i = 0; i < iscsilun->num_sessions; i++) {
+        struct iscsi_context *iscsi = iscsilun->sessions[i].iscsi;
+
+        if (iscsi_is_logged_in(iscsi)) {
+            iscsi_logout_sync(iscsi);
+        }
+        iscsi_destroy_context(iscsi);
+    }
+    g_free(iscsilun->sessions);
+}
+
+static int iscsi_open(BlockDriverState *bs, QDict *options, int flags,
+                      Error **errp)
+{
+    IscsiLun *iscsilun = bs->opaque;
+    struct iscsi_context *iscsi = NULL;
+    struct scsi_task *task = NULL;
+    struct scsi_inquiry_standard *inq = NULL;
+    struct scsi_inquiry_supported_pages *inq_vpd;
+    char *initiator_name = NULL;
+    QemuOpts *opts;
+    Error *local_err = NULL;
+    const char *transport_name, *portal, *target;
+    int i, ret = 0, lun, num_sessions;
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    transport_name = qemu_opt_get(opts, "transport");
+    portal = qemu_opt_get(opts, "portal");
+    target = qemu_opt_get(opts, "target");
+    lun = qemu_opt_get_number(opts, "lun", 0);
+
+    if (!transport_name || !portal || !target) {
+        error_setg(errp, "Need all of transport, portal and target options");
+        ret = -EINVAL;
         goto out;
     }
 
+    if (!iscsi_transport_valid(transport_name)) {
+        error_setg(errp, "Unknown transport: %s", transport_name);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    num_sessions = qemu_opt_get_number(opts, "sessions", 1);
+    if (num_sessions < 1 || num_sessions > ISCSI_MAX_SESSIONS) {
+        error_setg(errp, "sessions must be between 1 and %d",
+                   ISCSI_MAX_SESSIONS);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    memset(iscsilun, 0, sizeof(IscsiLun));
+
+    initiator_name = get_initiator_name(opts);
+
+    iscsilun->sessions = g_new0(IscsiSession, num_sessions);
+    for (i = 0; i < num_sessions; i++) {
+        ret = iscsi_connect(opts, initiator_name, &iscsi, errp);
+        if (ret < 0) {
+            goto out;
+        }
+        iscsilun->sessions[i].iscsilun = iscsilun;
+        iscsilun->sessions[i].iscsi = iscsi;
+        iscsilun->num_sessions++;
+    }
+
+    iscsi = iscsilun->sessions[0].iscsi;
     iscsilun->iscsi = iscsi;
+    iscsilun->poll = qemu_opt_get_bool(opts, "poll", false);
     iscsilun->aio_context = bdrv_get_aio_context(bs);
     iscsilun->lun = lun;
     iscsilun->has_write_same = true;
@@ -2024,12 +2169,7 @@ out:
     }
 
     if (ret) {
-        if (iscsi != NULL) {
-            if (iscsi_is_logged_in(iscsi)) {
-                iscsi_logout_sync(iscsi);
-            }
-            iscsi_destroy_context(iscsi);
-        }
+        iscsi_disconnect(iscsilun);
         memset(iscsilun, 0, sizeof(IscsiLun));
     }
 
@@ -2039,13 +2179,9 @@ out:
 static void iscsi_close(BlockDriverState *bs)
 {
     IscsiLun *iscsilun = bs->opaque;
-    struct iscsi_context *iscsi = iscsilun->iscsi;
 
     iscsi_detach_aio_context(bs);
-    if (iscsi_is_logged_in(iscsi)) {
-        iscsi_logout_sync(iscsi);
-    }
-    iscsi_destroy_context(iscsi);
+    iscsi_disconnect(iscsilun);
     if (iscsilun->dd) {
         g_free(iscsilun->dd->designator);
         g_free(iscsilun->dd);
@@ -0,0 +1,1006 @@
+/*
+ * Local cache filter
+ *
+ * Keeps recently used clusters of a remote image ("file", e.g. NBD, RBD or
+ * iSCSI) in a local image ("cache", e.g. a partition of a local NVMe
+ * drive), so that reads that hit the cache are served at local latency.
+ * Reads that miss fetch the whole cluster and add it to the cache, evicting
+ * the least recently used clusters when it is full.
+ *
+ * In write-through mode writes go to "file" and update the cached copy.  In
+ * write-back mode writes of cached clusters and of full clusters only go to
+ * the cache, and a flush only makes them durable in the cache; the data is
+ * written to "file" when the cluster is evicted, when the node is closed or
+ * inactivated for migration.  Other writes go to "file".
+ *
+ * The cache persists across restarts and belongs to one remote image, which
+ * nobody else may write while it is cached.  Cache layout: a
+ * LocalCacheHeader, then from LOCAL_CACHE_META_OFFSET one LocalCacheMeta
+ * entry per slot, then the slots, each one cluster of data.  Metadata
+ * updates are ordered against data writes so that after a crash a slot
+ * never claims data it does not hold:
+ *
+ * - a slot is only reused once its "free" metadata is durable
+ * - a new slot is durably written before its metadata
+ * - an existing slot is durably marked dirty before it is written
+ * - a dirty slot is marked clean once "file" has durably received its data
+ *
+ * An image that does not start with a valid header is initialized on the
+ * first use.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define LOCAL_CACHE_OPT_WRITEBACK       "writeback"
+#define LOCAL_CACHE_OPT_CLUSTER_SIZE    "cluster-size"
+#define LOCAL_CACHE_CLUSTER_SIZE_DEFAULT (64 * KiB)
+
+#define LOCAL_CACHE_MAGIC               0x514c4343 /* "QLCC" */
+#define LOCAL_CACHE_VERSION             1
+#define LOCAL_CACHE_META_OFFSET         4096
+
+#define LOCAL_CACHE_DIRTY               1
+
+/* Number of slots that are evicted at once, to share the flushes */
+#define LOCAL_CACHE_EVICT_BATCH         32
+
+typedef struct LocalCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t cluster_size;
+    uint32_t reserved;
+    uint64_t nb_slots;
+    uint64_t remote_size;
+} QEMU_PACKED LocalCacheHeader;
+
+typedef struct LocalCacheMeta {
+    uint64_t cluster;           /* remote cluster plus one, 0 if free */
+    uint32_t flags;
+    uint32_t reserved;
+} QEMU_PACKED LocalCacheMeta;
+
+typedef struct LocalCacheSlot {
+    uint64_t cluster;           /* hash table key, valid while in use */
+    bool in_use;
+    bool dirty;
+    unsigned int pinned;        /* unlocked data I/O in flight */
+    uint64_t gen;               /* bumped by writes to the cached data */
+    QTAILQ_ENTRY(LocalCacheSlot) next;
+} LocalCacheSlot;
+
+typedef QTAILQ_HEAD(, LocalCacheSlot) LocalCacheList;
+
+typedef struct BDRVLocalCacheState {
+    BdrvChild *cache;
+    bool writeback;
+    uint32_t cluster_size;
+    int64_t size;
+
+    bool initialized;
+    uint64_t nb_slots;
+    uint64_t data_offset;
+    LocalCacheSlot *slots;
+    GHashTable *map;            /* remote cluster -> slot */
+
+    /*
+     * Every slot is on one of the lists, except while it is being filled.
+     * Slots on @pending are free on disk, but that is not durable yet.
+     */
+    LocalCacheList lru;         /* in use, most recently used first */
+    LocalCacheList free;
+    LocalCacheList pending;
+    uint64_t nb_dirty;
+
+    /*
+     * Bumped when writes start and complete; a fetched cluster is only
+     * added if no write overlapped with fetching it
+     */
+    uint64_t write_gen;
+    unsigned int writes_in_flight;
+
+    CoMutex lock;
+} BDRVLocalCacheState;
+
+static QemuOptsList local_cache_runtime_opts = {
+    .name = "local-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(local_cache_runtime_opts.head),
+    .desc = {
+        {
+            .name = LOCAL_CACHE_OPT_WRITEBACK,
+            .type = QEMU_OPT_BOOL,
+            .help = "Keep written data in the cache only (default: off)",
+        },
+        {
+            .name = LOCAL_CACHE_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Cache granularity (default: 64k)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static uint64_t local_cache_meta_offset(LocalCacheSlot *slot,
+                                        BDRVLocalCacheState *s)
+{
+    return LOCAL_CACHE_META_OFFSET + (slot - s->slots) * sizeof(LocalCacheMeta);
+}
+
+static uint64_t local_cache_data_offset(LocalCacheSlot *slot,
+                                        BDRVLocalCacheState *s)
+{
+    return s->data_offset + (slot - s->slots) * (uint64_t)s->cluster_size;
+}
+
+/* Filling the cache may evict dirty slots, which are written to file */
+static bool local_cache_can_fill(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    return (s->cache->perm & BLK_PERM_WRITE) &&
+           (bs->file->perm & BLK_PERM_WRITE);
+}
+
+static int local_cache_write_meta(BDRVLocalCacheState *s, LocalCacheSlot *slot)
+{
+    LocalCacheMeta meta = {
+        .cluster = cpu_to_le64(slot->in_use ? slot->cluster + 1 : 0),
+        .flags = cpu_to_le32(slot->dirty ? LOCAL_CACHE_DIRTY : 0),
+    };
+    int ret;
+
+    ret = bdrv_pwrite(s->cache, local_cache_meta_offset(slot, s), &meta,
+                      sizeof(meta));
+    return ret < 0 ? ret : 0;
+}
+
+static void local_cache_geometry(BDRVLocalCacheState *s, int64_t cache_size)
+{
+    uint64_t n = 0;
+
+    if (cache_size > LOCAL_CACHE_META_OFFSET) {
+        n = (cache_size - LOCAL_CACHE_META_OFFSET) /
+            (s->cluster_size + sizeof(LocalCacheMeta));
+    }
+    for (; n; n--) {
+        s->data_offset = ROUND_UP(LOCAL_CACHE_META_OFFSET +
+                                  n * sizeof(LocalCacheMeta), s->cluster_size);
+        if (s->data_offset + n * s->cluster_size <= cache_size) {
+            break;
+        }
+    }
+    s->nb_slots = n;
+}
+
+static int local_cache_load(BlockDriverState *bs, QemuOpts *opts, Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheHeader header;
+    LocalCacheMeta *meta = NULL;
+    int64_t cache_size;
+    uint64_t cluster_size, i, nb_slots;
+    int ret;
+
+    cache_size = bdrv_getlength(s->cache->bs);
+    if (cache_size < 0) {
+        error_setg_errno(errp, -cache_size, "Could not get the cache size");
+        return cache_size;
+    }
+
+    ret = bdrv_pread(s->cache, 0, &header, sizeof(header));
+    if (ret < 0 && cache_size >= sizeof(header)) {
+        error_setg_errno(errp, -ret, "Could not read the cache header");
+        return ret;
+    }
+    if (ret < 0 || le32_to_cpu(header.magic) != LOCAL_CACHE_MAGIC) {
+        memset(&header, 0, sizeof(header));
+    }
+
+    cluster_size = qemu_opt_get_size(opts, LOCAL_CACHE_OPT_CLUSTER_SIZE,
+                                     header.magic ?
+                                     le32_to_cpu(header.cluster_size) :
+                                     LOCAL_CACHE_CLUSTER_SIZE_DEFAULT);
+    if (cluster_size < BDRV_SECTOR_SIZE || cluster_size > 2 * MiB ||
+        !is_power_of_2(cluster_size)) {
+        error_setg(errp, "cluster-size must be a power of two between 512 "
+                   "and 2M");
+        return -EINVAL;
+    }
+    s->cluster_size = cluster_size;
+    local_cache_geometry(s, cache_size);
+    if (!s->nb_slots) {
+        error_setg(errp, "The cache is too small for cluster-size");
+        return -EINVAL;
+    }
+
+    s->slots = g_new0(LocalCacheSlot, s->nb_slots);
+    s->map = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&s->lru);
+    QTAILQ_INIT(&s->free);
+    QTAILQ_INIT(&s->pending);
+
+    if (!header.magic) {
+        /* Uninitialized: the whole cache is free once the table is zeroed */
+        for (i = 0; i < s->nb_slots; i++) {
+            QTAILQ_INSERT_TAIL(&s->free, &s->slots[i], next);
+        }
+        return 0;
+    }
+
+    nb_slots = le64_to_cpu(header.nb_slots);
+    if (le32_to_cpu(header.version) != LOCAL_CACHE_VERSION) {
+        error_setg(errp, "Unsupported cache version %" PRIu32,
+                   le32_to_cpu(header.version));
+        return -ENOTSUP;
+    }
+    if (le32_to_cpu(header.cluster_size) != s->cluster_size) {
+        error_setg(errp, "The cache uses a cluster size of %" PRIu32,
+                   le32_to_cpu(header.cluster_size));
+        return -EINVAL;
+    }
+    if (le64_to_cpu(header.remote_size) != s->size) {
+        error_setg(errp, "The cache belongs to an image of %" PRIu64
+                   " bytes", le64_to_cpu(header.remote_size));
+        return -EINVAL;
+    }
+    if (nb_slots != s->nb_slots) {
+        error_setg(errp, "The cache was created with %" PRIu64 " slots, "
+                   "but the cache image has room for %" PRIu64, nb_slots,
+                   s->nb_slots);
+        return -EINVAL;
+    }
+
+    meta = g_try_new(LocalCacheMeta, s->nb_slots);
+    if (!meta) {
+        error_setg(errp, "Could not allocate the cache metadata");
+        return -ENOMEM;
+    }
+    ret = bdrv_pread(s->cache, LOCAL_CACHE_META_OFFSET, meta,
+                     s->nb_slots * sizeof(*meta));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the cache metadata");
+        goto out;
+    }
+
+    for (i = 0; i < s->nb_slots; i++) {
+        LocalCacheSlot *slot = &s->slots[i];
+        uint64_t cluster = le64_to_cpu(meta[i].cluster);
+
+        if (!cluster) {
+            QTAILQ_INSERT_TAIL(&s->free, slot, next);
+            continue;
+        }
+        if (cluster - 1 >= DIV_ROUND_UP(s->size, s->cluster_size) ||
+            g_hash_table_contains(s->map, &cluster)) {
+            error_setg(errp, "Corrupt cache metadata in slot %" PRIu64, i);
+            ret = -EINVAL;
+            goto out;
+        }
+        slot->cluster = cluster - 1;
+        slot->in_use = true;
+        slot->dirty = le32_to_cpu(meta[i].flags) & LOCAL_CACHE_DIRTY;
+        s->nb_dirty += slot->dirty;
+        g_hash_table_insert(s->map, &slot->cluster, slot);
+        QTAILQ_INSERT_TAIL(&s->lru, slot, next);
+    }
+    s->initialized = true;
+    ret = 0;
+
+out:
+    g_free(meta);
+    return ret;
+}
+
+static void local_cache_free(BDRVLocalCacheState *s)
+{
+    if (s->map) {
+        g_hash_table_destroy(s->map);
+        s->map = NULL;
+    }
+    g_free(s->slots);
+    s->slots = NULL;
+}
+
+static int local_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                            Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    QemuOpts *opts;
+    int ret = -EINVAL;
+
+    opts = qemu_opts_create(&local_cache_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+    s->writeback = qemu_opt_get_bool(opts, LOCAL_CACHE_OPT_WRITEBACK, false);
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_DATA | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        goto out;
+    }
+
+    s->cache = bdrv_open_child(NULL, options, "cache", bs, &child_of_bds,
+                               BDRV_CHILD_DATA, false, errp);
+    if (!s->cache) {
+        goto out;
+    }
+
+    if (!bdrv_is_read_only(bs) && bdrv_is_read_only(s->cache->bs)) {
+        error_setg(errp, "The cache must be writable");
+        goto out;
+    }
+
+    s->size = bdrv_getlength(bs->file->bs);
+    if (s->size < 0) {
+        ret = s->size;
+        error_setg_errno(errp, -ret, "Could not get the image size");
+        goto out;
+    }
+
+    ret = local_cache_load(bs, opts, errp);
+    if (ret < 0) {
+        local_cache_free(s);
+        goto out;
+    }
+    trace_local_cache_open(bs, s->nb_slots, g_hash_table_size(s->map),
+                           s->nb_dirty);
+
+    qemu_co_mutex_init(&s->lock);
+    ret = 0;
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+/*
+ * Writes the dirty slots in @slots back to file, and marks them clean in
+ * the cache once file has made them durable, unless they were written
+ * again meanwhile.  Does not touch the lists.  If @locked, the caller
+ * holds s->lock, which is dropped around the I/O to file.
+ */
+static int local_cache_writeback(BlockDriverState *bs, LocalCacheSlot **slots,
+                                 int nb_slots, bool locked)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    uint64_t gen[LOCAL_CACHE_EVICT_BATCH];
+    bool dirty = false;
+    uint8_t *buf;
+    int i, ret = 0;
+
+    assert(nb_slots <= LOCAL_CACHE_EVICT_BATCH);
+    for (i = 0; i < nb_slots; i++) {
+        gen[i] = slots[i]->gen;
+        dirty |= slots[i]->dirty;
+    }
+    if (!dirty) {
+        return 0;
+    }
+
+    buf = qemu_try_blockalign(s->cache->bs, s->cluster_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    if (locked) {
+        qemu_co_mutex_unlock(&s->lock);
+    }
+    for (i = 0; i < nb_slots && ret >= 0; i++) {
+        LocalCacheSlot *slot = slots[i];
+        int64_t offset = slot->cluster * s->cluster_size;
+        int64_t bytes = MIN(s->cluster_size, s->size - offset);
+
+        if (!slot->dirty) {
+            continue;
+        }
+        trace_local_cache_writeback(bs, slot->cluster);
+        ret = bdrv_pread(s->cache, local_cache_data_offset(slot, s), buf,
+                         bytes);
+        if (ret >= 0) {
+            ret = bdrv_pwrite(bs->file, offset, buf, bytes);
+        }
+    }
+    if (ret >= 0) {
+        ret = bdrv_flush(bs->file->bs);
+    }
+    if (locked) {
+        qemu_co_mutex_lock(&s->lock);
+    }
+    if (ret < 0) {
+        goto out;
+    }
+
+    for (i = 0; i < nb_slots; i++) {
+        if (slots[i]->dirty && slots[i]->gen == gen[i]) {
+            slots[i]->dirty = false;
+            s->nb_dirty--;
+            ret = local_cache_write_meta(s, slots[i]);
+            if (ret < 0) {
+                goto out;
+            }
+        }
+    }
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int local_cache_writeback_all(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheSlot *slots[LOCAL_CACHE_EVICT_BATCH];
+    LocalCacheSlot *slot;
+    int n = 0, ret;
+
+    if (!s->nb_dirty || !local_cache_can_fill(bs)) {
+        return 0;
+    }
+
+    /* Only called when nobody else uses the node, so without s->lock */
+    QTAILQ_FOREACH(slot, &s->lru, next) {
+        if (slot->dirty) {
+            slots[n++] = slot;
+        }
+        if (n == LOCAL_CACHE_EVICT_BATCH) {
+            ret = local_cache_writeback(bs, slots, n, false);
+            if (ret < 0) {
+                return ret;
+            }
+            n = 0;
+        }
+    }
+    if (n) {
+        ret = local_cache_writeback(bs, slots, n, false);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return bdrv_flush(s->cache->bs);
+}
+
+static int local_cache_init_metadata(BDRVLocalCacheState *s)
+{
+    LocalCacheHeader header = {
+        .magic = cpu_to_le32(LOCAL_CACHE_MAGIC),
+        .version = cpu_to_le32(LOCAL_CACHE_VERSION),
+        .cluster_size = cpu_to_le32(s->cluster_size),
+        .nb_slots = cpu_to_le64(s->nb_slots),
+        .remote_size = cpu_to_le64(s->size),
+    };
+    int ret;
+
+    ret = bdrv_pwrite_zeroes(s->cache, LOCAL_CACHE_META_OFFSET,
+                             s->nb_slots * sizeof(LocalCacheMeta), 0);
+    if (ret < 0) {
+        return ret;
+    }
+    /* Only write a header once the metadata is known to be free */
+    ret = bdrv_flush(s->cache->bs);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_pwrite(s->cache, 0, &header, sizeof(header));
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_flush(s->cache->bs);
+    if (ret < 0) {
+        return ret;
+    }
+    s->initialized = true;
+    return 0;
+}
+
+/* Marks @slot as free on disk; it can be reused after the next flush */
+static int local_cache_drop(BDRVLocalCacheState *s, LocalCacheSlot *slot)
+{
+    if (slot->dirty) {
+        s->nb_dirty--;
+    }
+    g_hash_table_remove(s->map, &slot->cluster);
+    QTAILQ_REMOVE(&s->lru, slot, next);
+    slot->in_use = false;
+    slot->dirty = false;
+    QTAILQ_INSERT_TAIL(&s->pending, slot, next);
+    return local_cache_write_meta(s, slot);
+}
+
+/*
+ * Returns a durably free slot, which is on none of the lists, or NULL if
+ * there is none and no slot can be evicted.  Called with s->lock held,
+ * which is dropped while evicted slots are written back.
+ */
+static LocalCacheSlot *coroutine_fn
+local_cache_alloc(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    LocalCacheSlot *victims[LOCAL_CACHE_EVICT_BATCH];
+    LocalCacheSlot *slot;
+    int i, n = 0, ret;
+
+    if (!s->initialized && local_cache_init_metadata(s) < 0) {
+        return NULL;
+    }
+
+    if (QTAILQ_EMPTY(&s->free) && QTAILQ_EMPTY(&s->pending)) {
+        QTAILQ_FOREACH_REVERSE(slot, &s->lru, next) {
+            if (!slot->pinned) {
+                victims[n++] = slot;
+                if (n == LOCAL_CACHE_EVICT_BATCH) {
+                    break;
+                }
+            }
+        }
+
+        /*
+         * The victims stay usable while they are written back without
+         * s->lock; the ones that were used or written again meanwhile
+         * are kept.
+         */
+        for (i = 0; i < n; i++) {
+            victims[i]->pinned++;
+        }
+        ret = local_cache_writeback(bs, victims, n, true);
+        for (i = 0; i < n; i++) {
+            victims[i]->pinned--;
+        }
+        if (ret < 0) {
+            return NULL;
+        }
+        for (i = 0; i < n; i++) {
+            slot = victims[i];
+            if (!slot->in_use || slot->pinned || slot->dirty) {
+                continue;
+            }
+            trace_local_cache_evict(bs, slot->cluster);
+            if (local_cache_drop(s, slot) < 0) {
+                return NULL;
+            }
+        }
+    }
+
+    if (QTAILQ_EMPTY(&s->free) && !QTAILQ_EMPTY(&s->pending)) {
+        if (bdrv_co_flush(s->cache->bs) < 0) {
+            return NULL;
+        }
+        QTAILQ_CONCAT(&s->free, &s->pending);
+    }
+
+    slot = QTAILQ_FIRST(&s->free);
+    if (slot) {
+        QTAILQ_REMOVE(&s->free, slot, next);
+    }
+    return slot;
+}
+
+/* Makes a filled slot visible.  Called with s->lock held. */
+static int coroutine_fn local_cache_insert(BDRVLocalCacheState *s,
+                                           LocalCacheSlot *slot,
+                                           uint64_t cluster, bool dirty)
+{
+    int ret;
+
+    slot->cluster = cluster;
+    slot->in_use = true;
+    slot->dirty = dirty;
+    ret = bdrv_co_flush(s->cache->bs);
+    if (ret >= 0) {
+        ret = local_cache_write_meta(s, slot);
+    }
+    if (ret < 0) {
+        slot->in_use = false;
+        slot->dirty = false;
+        QTAILQ_INSERT_TAIL(&s->pending, slot, next);
+        return ret;
+    }
+    s->nb_dirty += dirty;
+    g_hash_table_insert(s->map, &slot->cluster, slot);
+    QTAILQ_INSERT_HEAD(&s->lru, slot, next);
+    return 0;
+}
+
+static LocalCacheSlot *local_cache_lookup(BDRVLocalCacheState *s,
+                                          uint64_t cluster)
+{
+    LocalCacheSlot *slot = g_hash_table_lookup(s->map, &cluster);
+
+    if (slot) {
+        QTAILQ_REMOVE(&s->lru, slot, next);
+        QTAILQ_INSERT_HEAD(&s->lru, slot, next);
+    }
+    return slot;
+}
+
+static void local_cache_close(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE) &&
+        local_cache_writeback_all(bs) < 0) {
+        error_report("local-cache: Could not write back %" PRIu64 " dirty "
+                     "clusters; they are kept in the cache", s->nb_dirty);
+    }
+
+    local_cache_free(s);
+    bdrv_unref_child(bs, s->cache);
+    s->cache = NULL;
+}
+
+static int local_cache_inactivate(BlockDriverState *bs)
+{
+    /* The destination has another cache, so file must be up to date */
+    return local_cache_writeback_all(bs);
+}
+
+static void coroutine_fn local_cache_co_invalidate_cache(BlockDriverState *bs,
+                                                         Error **errp)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    uint64_t i;
+    int ret;
+
+    /*
+     * The guest ran somewhere else since this cache was filled, so nothing
+     * in it can be trusted.  The metadata is reset right away, so that a
+     * later open does not trust it either.
+     */
+    if (s->nb_dirty) {
+        warn_report("local-cache: Dropping %" PRIu64 " dirty clusters that "
+                    "predate the migration", s->nb_dirty);
+    }
+    g_hash_table_remove_all(s->map);
+    QTAILQ_INIT(&s->lru);
+    QTAILQ_INIT(&s->free);
+    QTAILQ_INIT(&s->pending);
+    for (i = 0; i < s->nb_slots; i++) {
+        s->slots[i].in_use = false;
+        s->slots[i].dirty = false;
+        QTAILQ_INSERT_TAIL(&s->free, &s->slots[i], next);
+    }
+    s->nb_dirty = 0;
+    s->initialized = false;
+
+    if (!(s->cache->perm & BLK_PERM_WRITE)) {
+        return;
+    }
+    qemu_co_mutex_lock(&s->lock);
+    ret = local_cache_init_metadata(s);
+    qemu_co_mutex_unlock(&s->lock);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not reset the cache metadata");
+    }
+}
+
+static void local_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                   BdrvChildRole role,
+                                   BlockReopenQueue *reopen_queue,
+                                   uint64_t perm, uint64_t shared,
+                                   uint64_t *nperm, uint64_t *nshared)
+{
+    if (role & BDRV_CHILD_PRIMARY) {
+        bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                           nperm, nshared);
+        /* Write-back and eviction write even for read-only parents */
+        if (!(bs->open_flags & BDRV_O_INACTIVE) &&
+            !bdrv_is_read_only(c->bs)) {
+            *nperm |= BLK_PERM_WRITE;
+        }
+        return;
+    }
+
+    /*
+     * Reads fill the cache, so it is written whenever possible.  It
+     * belongs to this node, nobody else may change it.
+     */
+    *nperm = BLK_PERM_CONSISTENT_READ;
+    if (!(bs->open_flags & BDRV_O_INACTIVE) && !bdrv_is_read_only(c->bs)) {
+        *nperm |= BLK_PERM_WRITE;
+    }
+    *nshared = BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE_UNCHANGED;
+}
+
+static int64_t local_cache_getlength(BlockDriverState *bs)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+
+    return s->size;
+}
+
+static int coroutine_fn local_cache_read_cluster(BlockDriverState *bs,
+                                                 uint64_t cluster,
+                                                 int64_t offset, int64_t bytes,
+                                                 QEMUIOVector *qiov,
+                                                 size_t qiov_offset)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t cluster_offset = cluster * s->cluster_size;
+    int64_t cluster_bytes = MIN(s->cluster_size, s->size - cluster_offset);
+    LocalCacheSlot *slot;
+    QEMUIOVector local_qiov;
+    uint64_t gen;
+    bool clean;
+    uint8_t *buf;
+    int ret;
+
+    qemu_co_mutex_lock(&s->lock);
+    slot = local_cache_lookup(s, cluster);
+    if (slot) {
+        slot->pinned++;
+        qemu_co_mutex_unlock(&s->lock);
+
+        ret = bdrv_co_preadv_part(s->cache, local_cache_data_offset(slot, s) +
+                                  offset - cluster_offset, bytes, qiov,
+                                  qiov_offset, 0);
+
+        qemu_co_mutex_lock(&s->lock);
+        slot->pinned--;
+        qemu_co_mutex_unlock(&s->lock);
+        return ret;
+    }
+    gen = s->write_gen;
+    clean = !s->writes_in_flight;
+    qemu_co_mutex_unlock(&s->lock);
+
+    if (!local_cache_can_fill(bs)) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   0);
+    }
+
+    /* Fetch the whole cluster so that it can be cached */
+    buf = qemu_try_blockalign(bs, cluster_bytes);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    qemu_iovec_init_buf(&local_qiov, buf, cluster_bytes);
+    ret = bdrv_co_preadv(bs->file, cluster_offset, cluster_bytes,
+                         &local_qiov, 0);
+    if (ret < 0) {
+        goto out;
+    }
+    qemu_iovec_from_buf(qiov, qiov_offset, buf + offset - cluster_offset,
+                        bytes);
+
+    qemu_co_mutex_lock(&s->lock);
+    if (clean && gen == s->write_gen && !g_hash_table_contains(s->map,
+                                                               &cluster)) {
+        slot = local_cache_alloc(bs);
+        if (slot && (gen != s->write_gen ||
+                     g_hash_table_contains(s->map, &cluster))) {
+            QTAILQ_INSERT_HEAD(&s->free, slot, next);
+            slot = NULL;
+        }
+    }
+    if (slot) {
+        /* Not caching the cluster does not fail the read */
+        trace_local_cache_fill(bs, cluster);
+        if (bdrv_co_pwritev(s->cache, local_cache_data_offset(slot, s),
+                            cluster_bytes, &local_qiov, 0) < 0) {
+            QTAILQ_INSERT_TAIL(&s->pending, slot, next);
+        } else {
+            local_cache_insert(s, slot, cluster, false);
+        }
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int coroutine_fn local_cache_co_preadv_part(BlockDriverState *bs,
+                                                   int64_t offset,
+                                                   int64_t bytes,
+                                                   QEMUIOVector *qiov,
+                                                   size_t qiov_offset,
+                                                   BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    while (bytes) {
+        uint64_t cluster = offset / s->cluster_size;
+        int64_t n = MIN(bytes, (cluster + 1) * s->cluster_size - offset);
+
+        ret = local_cache_read_cluster(bs, cluster, offset, n, qiov,
+                                       qiov_offset);
+        if (ret < 0) {
+            return ret;
+        }
+        offset += n;
+        bytes -= n;
+        qiov_offset += n;
+    }
+    return 0;
+}
+
+/*
+ * Writes a part of a cluster to the cache in write-back mode.  Returns 1 if
+ * the data must be written to file instead.  Called with s->lock held.
+ */
+static int coroutine_fn local_cache_write_cluster(BlockDriverState *bs,
+                                                  uint64_t cluster,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int64_t cluster_offset = cluster * s->cluster_size;
+    LocalCacheSlot *slot;
+    int ret;
+
+retry:
+    slot = local_cache_lookup(s, cluster);
+    if (slot) {
+        if (!slot->dirty) {
+            slot->dirty = true;
+            s->nb_dirty++;
+            ret = local_cache_write_meta(s, slot);
+            if (ret >= 0) {
+                ret = bdrv_co_flush(s->cache->bs);
+            }
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        slot->gen++;
+        return bdrv_co_pwritev_part(s->cache,
+                                    local_cache_data_offset(slot, s) +
+                                    offset - cluster_offset, bytes, qiov,
+                                    qiov_offset, 0);
+    }
+
+    /* Only full clusters are added, partial ones would need a read */
+    if (bytes != MIN(s->cluster_size, s->size - cluster_offset)) {
+        return 1;
+    }
+    slot = local_cache_alloc(bs);
+    if (!slot) {
+        return 1;
+    }
+    if (g_hash_table_contains(s->map, &cluster)) {
+        /* Cached while local_cache_alloc() dropped the lock */
+        QTAILQ_INSERT_HEAD(&s->free, slot, next);
+        goto retry;
+    }
+    ret = bdrv_co_pwritev_part(s->cache, local_cache_data_offset(slot, s),
+                               bytes, qiov, qiov_offset, 0);
+    if (ret < 0) {
+        QTAILQ_INSERT_TAIL(&s->pending, slot, next);
+        return ret;
+    }
+    return local_cache_insert(s, slot, cluster, true);
+}
+
+static int coroutine_fn local_cache_co_pwritev_writeback(BlockDriverState *bs,
+                                                         int64_t offset,
+                                                         int64_t bytes,
+                                                         QEMUIOVector *qiov,
+                                                         size_t qiov_offset,
+                                                         BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret = 0;
+
+    while (bytes && ret >= 0) {
+        uint64_t cluster = offset / s->cluster_size;
+        int64_t n = MIN(bytes, (cluster + 1) * s->cluster_size - offset);
+
+        ret = local_cache_write_cluster(bs, cluster, offset, n, qiov,
+                                        qiov_offset);
+        if (ret == 1) {
+            ret = bdrv_co_pwritev_part(bs->file, offset, n, qiov,
+                                       qiov_offset, flags);
+        }
+        offset += n;
+        bytes -= n;
+        qiov_offset += n;
+    }
+
+    return ret < 0 ? ret : 0;
+}
+
+static int coroutine_fn local_cache_co_pwritev_writethrough(
+        BlockDriverState *bs, int64_t offset, int64_t bytes,
+        QEMUIOVector *qiov, size_t qiov_offset, BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+
+    qemu_co_mutex_lock(&s->lock);
+    while (bytes) {
+        uint64_t cluster = offset / s->cluster_size;
+        int64_t n = MIN(bytes, (cluster + 1) * s->cluster_size - offset);
+        LocalCacheSlot *slot = g_hash_table_lookup(s->map, &cluster);
+
+        /* Drop the cached copy if it cannot be updated */
+        if (slot && (ret < 0 ||
+                     bdrv_co_pwritev_part(s->cache,
+                                          local_cache_data_offset(slot, s) +
+                                          offset - cluster * s->cluster_size,
+                                          n, qiov, qiov_offset, 0) < 0)) {
+            local_cache_drop(s, slot);
+        }
+        offset += n;
+        bytes -= n;
+        qiov_offset += n;
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static int coroutine_fn local_cache_co_pwritev_part(BlockDriverState *bs,
+                                                    int64_t offset,
+                                                    int64_t bytes,
+                                                    QEMUIOVector *qiov,
+                                                    size_t qiov_offset,
+                                                    BdrvRequestFlags flags)
+{
+    BDRVLocalCacheState *s = bs->opaque;
+    int ret;
+
+    s->write_gen++;
+    s->writes_in_flight++;
+
+    if (s->writeback) {
+        qemu_co_mutex_lock(&s->lock);
+        ret = local_cache_co_pwritev_writeback(bs, offset, bytes, qiov,
+                                               qiov_offset, flags);
+        qemu_co_mutex_unlock(&s->lock);
+    } else {
+        ret = local_cache_co_pwritev_writethrough(bs, offset, bytes, qiov,
+                                                  qiov_offset, flags);
+    }
+
+    s->writes_in_flight--;
+    s->write_gen++;
+    return ret;
+}
+
+static const char *const local_cache_strong_runtime_opts[] = {
+    LOCAL_CACHE_OPT_CLUSTER_SIZE,
+
+    NULL
+};
+
+static BlockDriver bdrv_local_cache = {
+    .format_name                        = "local-cache",
+    .instance_size                      = sizeof(BDRVLocalCacheState),
+
+    .bdrv_open                          = local_cache_open,
+    .bdrv_close                         = local_cache_close,
+    .bdrv_child_perm                    = local_cache_child_perm,
+    .bdrv_inactivate                    = local_cache_inactivate,
+    .bdrv_co_invalidate_cache           = local_cache_co_invalidate_cache,
+
+    .bdrv_getlength                     = local_cache_getlength,
+
+    .bdrv_co_preadv_part                = local_cache_co_preadv_part,
+    .bdrv_co_pwritev_part               = local_cache_co_pwritev_part,
+
+    .strong_runtime_opts                = local_cache_strong_runtime_opts,
+};
+
+static void bdrv_local_cache_init(void)
+{
+    bdrv_register(&bdrv_local_cache);
+}
+
+block_init(bdrv_local_cache_init);
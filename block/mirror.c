@@ -28,6 +28,14 @@
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
+/*
+ * In write-batching mode, the longest time that an active write waits for
+ * adjacent writes before it is written to the target, and the largest
+ * request that batching creates
+ */
+#define WRITE_BATCH_WINDOW_NS (500 * SCALE_US)
+#define WRITE_BATCH_MAX_BYTES (4 * MAX_IO_BYTES)
+
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
  */
@@ -36,6 +44,7 @@ typedef struct MirrorBuffer {
 } MirrorBuffer;
 
 typedef struct MirrorOp MirrorOp;
+typedef struct MirrorWriteBatch MirrorWriteBatch;
 
 typedef struct MirrorBlockJob {
     BlockJob common;
@@ -81,6 +90,8 @@ typedef struct MirrorBlockJob {
     int max_iov;
     bool initial_zeroing_ongoing;
     int in_active_write_counter;
+    /* Batch of active writes that adjacent writes can still join */
+    MirrorWriteBatch *open_batch;
     bool prepared;
     bool in_drain;
 } MirrorBlockJob;
@@ -117,6 +128,26 @@ typedef enum MirrorMethod {
     MIRROR_METHOD_DISCARD,
 } MirrorMethod;
 
+/*
+ * Active writes that are written to the target with a single request.  The
+ * first write owns @op, which is extended to cover every write that joins
+ * the batch, so that they don't have to wait for each other.
+ */
+struct MirrorWriteBatch {
+    MirrorOp *op;
+    uint64_t offset;
+    uint64_t bytes;
+    int flags;
+    QEMUIOVector qiov;
+
+    /* Number of joined writes that are still writing to the source */
+    int pending;
+    bool done;
+    int refcnt;
+    QemuCoSleep sleep;
+    CoQueue waiters;
+};
+
 static BlockErrorAction mirror_error_action(MirrorBlockJob *s, bool read,
                                             int error)
 {
@@ -1372,14 +1403,10 @@ static MirrorOp *coroutine_fn active_write_prepare(MirrorBlockJob *s,
     return op;
 }
 
-static void coroutine_fn active_write_settle(MirrorOp *op)
+static void active_write_finish(MirrorBlockJob *s)
 {
-    uint64_t start_chunk = op->offset / op->s->granularity;
-    uint64_t end_chunk = DIV_ROUND_UP(op->offset + op->bytes,
-                                      op->s->granularity);
-
-    if (!--op->s->in_active_write_counter && op->s->actively_synced) {
-        BdrvChild *source = op->s->mirror_top_bs->backing;
+    if (!--s->in_active_write_counter && s->actively_synced) {
+        BdrvChild *source = s->mirror_top_bs->backing;
 
         if (QLIST_FIRST(&source->bs->parents) == source &&
             QLIST_NEXT(source, next_parent) == NULL)
@@ -1388,15 +1415,173 @@ static void coroutine_fn active_write_settle(MirrorOp *op)
              * operations are settled.
              * Note that we can only assert this if the mirror node
              * is the source node's only parent. */
-            assert(!bdrv_get_dirty_count(op->s->dirty_bitmap));
+            assert(!bdrv_get_dirty_count(s->dirty_bitmap));
         }
     }
+}
+
+static void coroutine_fn active_write_settle(MirrorOp *op)
+{
+    uint64_t start_chunk = op->offset / op->s->granularity;
+    uint64_t end_chunk = DIV_ROUND_UP(op->offset + op->bytes,
+                                      op->s->granularity);
+
+    active_write_finish(op->s);
     bitmap_clear(op->s->in_flight_bitmap, start_chunk, end_chunk - start_chunk);
     QTAILQ_REMOVE(&op->s->ops_in_flight, op, next);
     qemu_co_queue_restart_all(&op->waiting_requests);
     g_free(op);
 }
 
+static void write_batch_unref(MirrorWriteBatch *batch)
+{
+    if (--batch->refcnt == 0) {
+        qemu_iovec_destroy(&batch->qiov);
+        g_free(batch);
+    }
+}
+
+/*
+ * Adds a guest write that has not been written to the source yet to the open
+ * batch if it directly follows it, and returns the batch.  Returns NULL if the
+ * write must be handled on its own.
+ */
+static MirrorWriteBatch *write_batch_join(MirrorBlockJob *s, uint64_t offset,
+                                          uint64_t bytes, QEMUIOVector *qiov,
+                                          int flags)
+{
+    MirrorWriteBatch *batch = s->open_batch;
+    uint64_t start_chunk = offset / s->granularity;
+    uint64_t nb_chunks = DIV_ROUND_UP(offset + bytes, s->granularity) -
+                         start_chunk;
+    uint64_t old_end_chunk, new_end_chunk;
+    MirrorOp *op;
+
+    if (!batch || batch->offset + batch->bytes != offset ||
+        batch->flags != flags ||
+        batch->bytes + bytes > WRITE_BATCH_MAX_BYTES ||
+        batch->qiov.niov + qiov->niov > s->max_iov)
+    {
+        return NULL;
+    }
+
+    /* The batch may only be extended over areas that nobody else uses */
+    QTAILQ_FOREACH(op, &s->ops_in_flight, next) {
+        uint64_t op_start_chunk = op->offset / s->granularity;
+        uint64_t op_nb_chunks = DIV_ROUND_UP(op->offset + op->bytes,
+                                             s->granularity) -
+                                op_start_chunk;
+
+        if (op != batch->op &&
+            ranges_overlap(start_chunk, nb_chunks,
+                           op_start_chunk, op_nb_chunks))
+        {
+            return NULL;
+        }
+    }
+
+    old_end_chunk = DIV_ROUND_UP(batch->op->offset + batch->op->bytes,
+                                 s->granularity);
+    batch->op->bytes += bytes;
+    new_end_chunk = DIV_ROUND_UP(batch->op->offset + batch->op->bytes,
+                                 s->granularity);
+    bitmap_set(s->in_flight_bitmap, old_end_chunk,
+               new_end_chunk - old_end_chunk);
+
+    qemu_iovec_concat(&batch->qiov, qiov, 0, bytes);
+    batch->bytes += bytes;
+    batch->pending++;
+    batch->refcnt++;
+    s->in_active_write_counter++;
+
+    trace_mirror_write_batch_join(s, batch->offset, batch->bytes);
+
+    if (batch->bytes >= WRITE_BATCH_MAX_BYTES) {
+        s->open_batch = NULL;
+        qemu_co_sleep_wake(&batch->sleep);
+    }
+
+    return batch;
+}
+
+/*
+ * Called by a write that joined @batch once it has been written to the
+ * source.  Returns when the batch has been written to the target.
+ */
+static void coroutine_fn write_batch_finish_joined(MirrorBlockJob *s,
+                                                   MirrorWriteBatch *batch,
+                                                   uint64_t offset,
+                                                   uint64_t bytes, int ret)
+{
+    batch->pending--;
+    qemu_co_queue_restart_all(&batch->waiters);
+
+    while (!batch->done) {
+        qemu_co_queue_wait(&batch->waiters, NULL);
+    }
+
+    if (ret < 0) {
+        /*
+         * The data has been written to the target anyway, as part of the
+         * batch, but the source may differ now.  Copy the area again.
+         */
+        bdrv_set_dirty_bitmap(s->dirty_bitmap,
+                              QEMU_ALIGN_DOWN(offset, s->granularity),
+                              QEMU_ALIGN_UP(offset + bytes, s->granularity) -
+                              QEMU_ALIGN_DOWN(offset, s->granularity));
+        s->actively_synced = false;
+    }
+
+    active_write_finish(s);
+    write_batch_unref(batch);
+}
+
+/*
+ * Waits for adjacent writes to join the write described by @op, which has
+ * been written to the source, and copies all of them to the target.
+ */
+static void coroutine_fn write_batch_run(MirrorBlockJob *s, MirrorOp *op,
+                                         QEMUIOVector *qiov, int flags)
+{
+    MirrorWriteBatch *batch;
+
+    if (s->open_batch) {
+        /* Only the most recent batch may grow */
+        do_sync_target_write(s, MIRROR_METHOD_COPY, op->offset, op->bytes,
+                             qiov, flags);
+        return;
+    }
+
+    batch = g_new0(MirrorWriteBatch, 1);
+    batch->op = op;
+    batch->offset = op->offset;
+    batch->bytes = op->bytes;
+    batch->flags = flags;
+    batch->refcnt = 1;
+    qemu_iovec_init(&batch->qiov, qiov->niov);
+    qemu_iovec_concat(&batch->qiov, qiov, 0, op->bytes);
+    qemu_co_queue_init(&batch->waiters);
+
+    s->open_batch = batch;
+    qemu_co_sleep_ns_wakeable(&batch->sleep, QEMU_CLOCK_REALTIME,
+                              WRITE_BATCH_WINDOW_NS);
+    if (s->open_batch == batch) {
+        s->open_batch = NULL;
+    }
+
+    while (batch->pending) {
+        qemu_co_queue_wait(&batch->waiters, NULL);
+    }
+
+    trace_mirror_write_batch_submit(s, batch->offset, batch->bytes);
+    do_sync_target_write(s, MIRROR_METHOD_COPY, batch->offset, batch->bytes,
+                         &batch->qiov, flags);
+
+    batch->done = true;
+    qemu_co_queue_restart_all(&batch->waiters);
+    write_batch_unref(batch);
+}
+
 static int coroutine_fn bdrv_mirror_top_preadv(BlockDriverState *bs,
     int64_t offset, int64_t bytes, QEMUIOVector *qiov, BdrvRequestFlags flags)
 {
@@ -1408,13 +1593,25 @@ static int coroutine_fn bdrv_mirror_top_do_write(BlockDriverState *bs,
     int flags)
 {
     MirrorOp *op = NULL;
+    MirrorWriteBatch *batch = NULL;
     MirrorBDSOpaque *s = bs->opaque;
     int ret = 0;
-    bool copy_to_target;
+    bool copy_to_target, batching;
 
     copy_to_target = s->job->ret >= 0 &&
                      !job_is_cancelled(&s->job->common.job) &&
-                     s->job->copy_mode == MIRROR_COPY_MODE_WRITE_BLOCKING;
+                     s->job->copy_mode != MIRROR_COPY_MODE_BACKGROUND;
+    batching = copy_to_target && method == MIRROR_METHOD_COPY &&
+               s->job->copy_mode == MIRROR_COPY_MODE_WRITE_BATCHING;
+
+    if (batching) {
+        batch = write_batch_join(s->job, offset, bytes, qiov, flags);
+        if (batch) {
+            ret = bdrv_co_pwritev(bs->backing, offset, bytes, qiov, flags);
+            write_batch_finish_joined(s->job, batch, offset, bytes, ret);
+            return ret;
+        }
+    }
 
     if (copy_to_target) {
         op = active_write_prepare(s->job, offset, bytes);
@@ -1441,7 +1638,9 @@ static int coroutine_fn bdrv_mirror_top_do_write(BlockDriverState *bs,
         goto out;
     }
 
-    if (copy_to_target) {
+    if (batching) {
+        write_batch_run(s->job, op, qiov, flags);
+    } else if (copy_to_target) {
         do_sync_target_write(s->job, method, offset, bytes, qiov, flags);
     }
 
@@ -1463,7 +1662,7 @@ static int coroutine_fn bdrv_mirror_top_pwritev(BlockDriverState *bs,
 
     copy_to_target = s->job->ret >= 0 &&
                      !job_is_cancelled(&s->job->common.job) &&
-                     s->job->copy_mode == MIRROR_COPY_MODE_WRITE_BLOCKING;
+                     s->job->copy_mode != MIRROR_COPY_MODE_BACKGROUND;
 
     if (copy_to_target) {
         /* The guest might concurrently modify the data to write; but
@@ -1756,7 +1955,7 @@ static BlockJob *mirror_start_job(
     if (!s->dirty_bitmap) {
         goto fail;
     }
-    if (s->copy_mode == MIRROR_COPY_MODE_WRITE_BLOCKING) {
+    if (s->copy_mode != MIRROR_COPY_MODE_BACKGROUND) {
         bdrv_disable_dirty_bitmap(s->dirty_bitmap);
     }
 
@@ -36,6 +36,7 @@
 #include "qemu/cutils.h"
 #include "qemu/main-loop.h"
 #include "qemu/atomic.h"
+#include "qemu/error-report.h"
 
 #include "qapi/qapi-visit-sockets.h"
 #include "qapi/qmp/qstring.h"
@@ -50,9 +51,10 @@
 
 #define EN_OPTSTR ":exportname="
 #define MAX_NBD_REQUESTS    16
+#define MAX_MULTI_CONN      16
 
-#define HANDLE_TO_INDEX(bs, handle) ((handle) ^ (uint64_t)(intptr_t)(bs))
-#define INDEX_TO_HANDLE(bs, index)  ((index)  ^ (uint64_t)(intptr_t)(bs))
+#define HANDLE_TO_INDEX(cs, handle) ((handle) ^ (uint64_t)(intptr_t)(cs))
+#define INDEX_TO_HANDLE(cs, index)  ((index)  ^ (uint64_t)(intptr_t)(cs))
 
 typedef struct {
     Coroutine *coroutine;
@@ -68,7 +70,14 @@ typedef enum NBDClientState {
     NBD_CLIENT_QUIT
 } NBDClientState;
 
-typedef struct BDRVNBDState {
+typedef struct BDRVNBDState BDRVNBDState;
+
+/*
+ * One connection to the server.  With multi-conn, requests are spread over
+ * several of them; each one reconnects on its own.
+ */
+typedef struct NBDConnState {
+    BDRVNBDState *s;
     QIOChannel *ioc; /* The current I/O channel */
     NBDExportInfo info;
 
@@ -80,10 +89,25 @@ typedef struct BDRVNBDState {
     NBDClientState state;
 
     QEMUTimer *reconnect_delay_timer;
-    QEMUTimer *open_timer;
 
     NBDClientRequest requests[MAX_NBD_REQUESTS];
     NBDReply reply;
+
+    NBDClientConnection *conn;
+} NBDConnState;
+
+struct BDRVNBDState {
+    /* Export information, as negotiated by the first connection */
+    NBDExportInfo info;
+
+    NBDConnState *conns[MAX_MULTI_CONN];
+    unsigned int multi_conn;    /* Number of elements of conns in use */
+    unsigned int next_conn;     /* Round robin index into conns */
+
+    bool plugged;   /* Keep the channels corked until bdrv_io_unplug() */
+
+    QEMUTimer *open_timer;
+
     BlockDriverState *bs;
 
     /* Connection parameters */
@@ -95,18 +119,21 @@ typedef struct BDRVNBDState {
     const char *hostname;
     char *x_dirty_bitmap;
     bool alloc_depth;
-
-    NBDClientConnection *conn;
-} BDRVNBDState;
+};
 
 static void nbd_yank(void *opaque);
 
 static void nbd_clear_bdrvstate(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
 
-    nbd_client_connection_release(s->conn);
-    s->conn = NULL;
+    for (i = 0; i < s->multi_conn; i++) {
+        nbd_client_connection_release(s->conns[i]->conn);
+        g_free(s->conns[i]);
+        s->conns[i] = NULL;
+    }
+    s->multi_conn = 0;
 
     yank_unregister_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name));
 
@@ -121,9 +148,9 @@ static void nbd_clear_bdrvstate(BlockDriverState *bs)
     s->x_dirty_bitmap = NULL;
 }
 
-static bool nbd_client_connected(BDRVNBDState *s)
+static bool nbd_client_connected(NBDConnState *cs)
 {
-    return qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTED;
+    return qatomic_load_acquire(&cs->state) == NBD_CLIENT_CONNECTED;
 }
 
 static bool nbd_recv_coroutine_wake_one(NBDClientRequest *req)
@@ -137,87 +164,86 @@ static bool nbd_recv_coroutine_wake_one(NBDClientRequest *req)
     return false;
 }
 
-static void nbd_recv_coroutines_wake(BDRVNBDState *s, bool all)
+static void nbd_recv_coroutines_wake(NBDConnState *cs, bool all)
 {
     int i;
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (nbd_recv_coroutine_wake_one(&s->requests[i]) && !all) {
+        if (nbd_recv_coroutine_wake_one(&cs->requests[i]) && !all) {
             return;
         }
     }
 }
 
-static void nbd_channel_error(BDRVNBDState *s, int ret)
+static void nbd_channel_error(NBDConnState *cs, int ret)
 {
-    if (nbd_client_connected(s)) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    if (nbd_client_connected(cs)) {
+        qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
     }
 
     if (ret == -EIO) {
-        if (nbd_client_connected(s)) {
-            s->state = s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
-                                            NBD_CLIENT_CONNECTING_NOWAIT;
+        if (nbd_client_connected(cs)) {
+            cs->state = cs->s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
+                                                 NBD_CLIENT_CONNECTING_NOWAIT;
         }
     } else {
-        s->state = NBD_CLIENT_QUIT;
+        cs->state = NBD_CLIENT_QUIT;
     }
 
-    nbd_recv_coroutines_wake(s, true);
+    nbd_recv_coroutines_wake(cs, true);
 }
 
-static void reconnect_delay_timer_del(BDRVNBDState *s)
+static void reconnect_delay_timer_del(NBDConnState *cs)
 {
-    if (s->reconnect_delay_timer) {
-        timer_free(s->reconnect_delay_timer);
-        s->reconnect_delay_timer = NULL;
+    if (cs->reconnect_delay_timer) {
+        timer_free(cs->reconnect_delay_timer);
+        cs->reconnect_delay_timer = NULL;
     }
 }
 
 static void reconnect_delay_timer_cb(void *opaque)
 {
-    BDRVNBDState *s = opaque;
+    NBDConnState *cs = opaque;
 
-    if (qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-        nbd_co_establish_connection_cancel(s->conn);
-        while (qemu_co_enter_next(&s->free_sema, NULL)) {
+    if (qatomic_load_acquire(&cs->state) == NBD_CLIENT_CONNECTING_WAIT) {
+        cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        nbd_co_establish_connection_cancel(cs->conn);
+        while (qemu_co_enter_next(&cs->free_sema, NULL)) {
             /* Resume all queued requests */
         }
     }
 
-    reconnect_delay_timer_del(s);
+    reconnect_delay_timer_del(cs);
 }
 
-static void reconnect_delay_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
+static void reconnect_delay_timer_init(NBDConnState *cs,
+                                       uint64_t expire_time_ns)
 {
-    if (qatomic_load_acquire(&s->state) != NBD_CLIENT_CONNECTING_WAIT) {
+    if (qatomic_load_acquire(&cs->state) != NBD_CLIENT_CONNECTING_WAIT) {
         return;
     }
 
-    assert(!s->reconnect_delay_timer);
-    s->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(s->bs),
-                                             QEMU_CLOCK_REALTIME,
-                                             SCALE_NS,
-                                             reconnect_delay_timer_cb, s);
-    timer_mod(s->reconnect_delay_timer, expire_time_ns);
+    assert(!cs->reconnect_delay_timer);
+    cs->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(cs->s->bs),
+                                              QEMU_CLOCK_REALTIME,
+                                              SCALE_NS,
+                                              reconnect_delay_timer_cb, cs);
+    timer_mod(cs->reconnect_delay_timer, expire_time_ns);
 }
 
-static void nbd_teardown_connection(BlockDriverState *bs)
+static void nbd_teardown_connection(NBDConnState *cs)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
-
-    assert(!s->in_flight);
+    assert(!cs->in_flight);
 
-    if (s->ioc) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+    if (cs->ioc) {
+        qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(cs->s->bs->node_name),
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
     }
 
-    s->state = NBD_CLIENT_QUIT;
+    cs->state = NBD_CLIENT_QUIT;
 }
 
 static void open_timer_del(BDRVNBDState *s)
@@ -232,7 +258,7 @@ static void open_timer_cb(void *opaque)
 {
     BDRVNBDState *s = opaque;
 
-    nbd_co_establish_connection_cancel(s->conn);
+    nbd_co_establish_connection_cancel(s->conns[0]->conn);
     open_timer_del(s);
 }
 
@@ -246,16 +272,16 @@ static void open_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
     timer_mod(s->open_timer, expire_time_ns);
 }
 
-static bool nbd_client_connecting(BDRVNBDState *s)
+static bool nbd_client_connecting(NBDConnState *cs)
 {
-    NBDClientState state = qatomic_load_acquire(&s->state);
+    NBDClientState state = qatomic_load_acquire(&cs->state);
     return state == NBD_CLIENT_CONNECTING_WAIT ||
         state == NBD_CLIENT_CONNECTING_NOWAIT;
 }
 
-static bool nbd_client_connecting_wait(BDRVNBDState *s)
+static bool nbd_client_connecting_wait(NBDConnState *cs)
 {
-    return qatomic_load_acquire(&s->state) == NBD_CLIENT_CONNECTING_WAIT;
+    return qatomic_load_acquire(&cs->state) == NBD_CLIENT_CONNECTING_WAIT;
 }
 
 /*
@@ -303,24 +329,50 @@ static int nbd_handle_updated_info(BlockDriverState *bs, Error **errp)
     return 0;
 }
 
-int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
-                                                Error **errp)
+/*
+ * All connections of a node must see the same export; requests are sent on
+ * any of them and must behave the same.
+ */
+static int nbd_check_multi_conn_info(NBDConnState *cs, Error **errp)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    BDRVNBDState *s = cs->s;
+
+    if (cs->info.size != s->info.size || cs->info.flags != s->info.flags ||
+        cs->info.min_block != s->info.min_block ||
+        cs->info.max_block != s->info.max_block ||
+        cs->info.structured_reply != s->info.structured_reply ||
+        cs->info.base_allocation != s->info.base_allocation)
+    {
+        error_setg(errp, "Export changed between connections");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn nbd_co_conn_establish(NBDConnState *cs, Error **errp)
+{
+    BDRVNBDState *s = cs->s;
+    BlockDriverState *bs = s->bs;
     int ret;
-    bool blocking = nbd_client_connecting_wait(s);
+    bool blocking = nbd_client_connecting_wait(cs);
 
-    assert(!s->ioc);
+    assert(!cs->ioc);
 
-    s->ioc = nbd_co_establish_connection(s->conn, &s->info, blocking, errp);
-    if (!s->ioc) {
+    cs->ioc = nbd_co_establish_connection(cs->conn, &cs->info, blocking, errp);
+    if (!cs->ioc) {
         return -ECONNREFUSED;
     }
 
-    yank_register_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name), nbd_yank,
-                           bs);
+    yank_register_function(BLOCKDEV_YANK_INSTANCE(bs->node_name), nbd_yank,
+                           cs);
 
-    ret = nbd_handle_updated_info(s->bs, NULL);
+    if (cs == s->conns[0]) {
+        s->info = cs->info;
+        ret = nbd_handle_updated_info(bs, errp);
+    } else {
+        ret = nbd_check_multi_conn_info(cs, errp);
+    }
     if (ret < 0) {
         /*
          * We have connected, but must fail for other reasons.
@@ -328,40 +380,86 @@ int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
          */
         NBDRequest request = { .type = NBD_CMD_DISC };
 
-        nbd_send_request(s->ioc, &request);
+        nbd_send_request(cs->ioc, &request);
 
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(bs->node_name),
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
 
         return ret;
     }
 
-    qio_channel_set_blocking(s->ioc, false, NULL);
-    qio_channel_attach_aio_context(s->ioc, bdrv_get_aio_context(bs));
+    qio_channel_set_blocking(cs->ioc, false, NULL);
+    qio_channel_attach_aio_context(cs->ioc, bdrv_get_aio_context(bs));
+    if (s->plugged) {
+        qio_channel_set_cork(cs->ioc, true);
+    }
 
     /* successfully connected */
-    s->state = NBD_CLIENT_CONNECTED;
-    qemu_co_queue_restart_all(&s->free_sema);
+    cs->state = NBD_CLIENT_CONNECTED;
+    qemu_co_queue_restart_all(&cs->free_sema);
+
+    return 0;
+}
+
+/*
+ * Establishes the connections of @bs when opening it.  Additional
+ * connections are only opened once the first one has shown that the server
+ * supports multi-conn.
+ */
+int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
+                                                Error **errp)
+{
+    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
+    int ret;
+
+    ret = nbd_co_conn_establish(s->conns[0], errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (s->multi_conn > 1 && !(s->info.flags & NBD_FLAG_CAN_MULTI_CONN)) {
+        warn_report("NBD server does not support multi-conn, "
+                    "using a single connection");
+        for (i = 1; i < s->multi_conn; i++) {
+            nbd_client_connection_release(s->conns[i]->conn);
+            g_free(s->conns[i]);
+            s->conns[i] = NULL;
+        }
+        s->multi_conn = 1;
+    }
+
+    for (i = 1; i < s->multi_conn; i++) {
+        ret = nbd_co_conn_establish(s->conns[i], errp);
+        if (ret < 0) {
+            error_prepend(errp, "Could not open NBD connection %u: ", i);
+            return ret;
+        }
+    }
+
+    trace_nbd_client_multi_conn(s->export, s->multi_conn);
 
     return 0;
 }
 
-/* called under s->send_mutex */
-static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
+/* called under cs->send_mutex */
+static coroutine_fn void nbd_reconnect_attempt(NBDConnState *cs)
 {
-    assert(nbd_client_connecting(s));
-    assert(s->in_flight == 0);
+    BDRVNBDState *s = cs->s;
 
-    if (nbd_client_connecting_wait(s) && s->reconnect_delay &&
-        !s->reconnect_delay_timer)
+    assert(nbd_client_connecting(cs));
+    assert(cs->in_flight == 0);
+
+    if (nbd_client_connecting_wait(cs) && s->reconnect_delay &&
+        !cs->reconnect_delay_timer)
     {
         /*
          * It's first reconnect attempt after switching to
          * NBD_CLIENT_CONNECTING_WAIT
          */
-        reconnect_delay_timer_init(s,
+        reconnect_delay_timer_init(cs,
             qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
             s->reconnect_delay * NANOSECONDS_PER_SECOND);
     }
@@ -372,44 +470,44 @@ static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
      */
 
     /* Finalize previous connection if any */
-    if (s->ioc) {
-        qio_channel_detach_aio_context(QIO_CHANNEL(s->ioc));
+    if (cs->ioc) {
+        qio_channel_detach_aio_context(QIO_CHANNEL(cs->ioc));
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
     }
 
-    nbd_co_do_establish_connection(s->bs, NULL);
+    nbd_co_conn_establish(cs, NULL);
 }
 
-static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
+static coroutine_fn int nbd_receive_replies(NBDConnState *cs, uint64_t handle)
 {
     int ret;
-    uint64_t ind = HANDLE_TO_INDEX(s, handle), ind2;
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    uint64_t ind = HANDLE_TO_INDEX(cs, handle), ind2;
+    QEMU_LOCK_GUARD(&cs->receive_mutex);
 
     while (true) {
-        if (s->reply.handle == handle) {
+        if (cs->reply.handle == handle) {
             /* We are done */
             return 0;
         }
 
-        if (!nbd_client_connected(s)) {
+        if (!nbd_client_connected(cs)) {
             return -EIO;
         }
 
-        if (s->reply.handle != 0) {
+        if (cs->reply.handle != 0) {
             /*
              * Some other request is being handled now. It should already be
-             * woken by whoever set s->reply.handle (or never wait in this
+             * woken by whoever set cs->reply.handle (or never wait in this
              * yield). So, we should not wake it here.
              */
-            ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-            assert(!s->requests[ind2].receiving);
+            ind2 = HANDLE_TO_INDEX(cs, cs->reply.handle);
+            assert(!cs->requests[ind2].receiving);
 
-            s->requests[ind].receiving = true;
-            qemu_co_mutex_unlock(&s->receive_mutex);
+            cs->requests[ind].receiving = true;
+            qemu_co_mutex_unlock(&cs->receive_mutex);
 
             qemu_coroutine_yield();
             /*
@@ -418,68 +516,97 @@ static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
              *    handle is received.
              * 2. From nbd_channel_error(), when connection is lost.
              * 3. From nbd_co_receive_one_chunk(), when previous request is
-             *    finished and s->reply.handle set to 0.
+             *    finished and cs->reply.handle set to 0.
              * Anyway, it's OK to lock the mutex and go to the next iteration.
              */
 
-            qemu_co_mutex_lock(&s->receive_mutex);
-            assert(!s->requests[ind].receiving);
+            qemu_co_mutex_lock(&cs->receive_mutex);
+            assert(!cs->requests[ind].receiving);
             continue;
         }
 
         /* We are under mutex and handle is 0. We have to do the dirty work. */
-        assert(s->reply.handle == 0);
-        ret = nbd_receive_reply(s->bs, s->ioc, &s->reply, NULL);
+        assert(cs->reply.handle == 0);
+        ret = nbd_receive_reply(cs->s->bs, cs->ioc, &cs->reply, NULL);
         if (ret <= 0) {
             ret = ret ? ret : -EIO;
-            nbd_channel_error(s, ret);
+            nbd_channel_error(cs, ret);
             return ret;
         }
-        if (nbd_reply_is_structured(&s->reply) && !s->info.structured_reply) {
-            nbd_channel_error(s, -EINVAL);
+        if (nbd_reply_is_structured(&cs->reply) &&
+            !cs->info.structured_reply) {
+            nbd_channel_error(cs, -EINVAL);
             return -EINVAL;
         }
-        if (s->reply.handle == handle) {
+        if (cs->reply.handle == handle) {
             /* We are done */
             return 0;
         }
-        ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-        if (ind2 >= MAX_NBD_REQUESTS || !s->requests[ind2].reply_possible) {
-            nbd_channel_error(s, -EINVAL);
+        ind2 = HANDLE_TO_INDEX(cs, cs->reply.handle);
+        if (ind2 >= MAX_NBD_REQUESTS || !cs->requests[ind2].reply_possible) {
+            nbd_channel_error(cs, -EINVAL);
             return -EINVAL;
         }
-        nbd_recv_coroutine_wake_one(&s->requests[ind2]);
+        nbd_recv_coroutine_wake_one(&cs->requests[ind2]);
+    }
+}
+
+/*
+ * Picks the connection for the next request: the next connected one with a
+ * free request slot in round robin order, or simply the next one if none is
+ * available, so that the request waits for it.
+ */
+static NBDConnState *nbd_choose_conn(BDRVNBDState *s)
+{
+    unsigned int start = s->next_conn++ % s->multi_conn;
+    unsigned int i;
+
+    for (i = 0; i < s->multi_conn; i++) {
+        NBDConnState *cs = s->conns[(start + i) % s->multi_conn];
+
+        if (nbd_client_connected(cs) && cs->in_flight < MAX_NBD_REQUESTS) {
+            return cs;
+        }
     }
+
+    return s->conns[start];
 }
 
+/*
+ * Sends @request on one of the connections of @bs, which is returned in
+ * @pcs; the reply must be received on the same connection.
+ */
 static int nbd_co_send_request(BlockDriverState *bs,
                                NBDRequest *request,
-                               QEMUIOVector *qiov)
+                               QEMUIOVector *qiov,
+                               NBDConnState **pcs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs = nbd_choose_conn(s);
     int rc, i = -1;
 
-    qemu_co_mutex_lock(&s->send_mutex);
+    *pcs = cs;
+    qemu_co_mutex_lock(&cs->send_mutex);
 
-    while (s->in_flight == MAX_NBD_REQUESTS ||
-           (!nbd_client_connected(s) && s->in_flight > 0))
+    while (cs->in_flight == MAX_NBD_REQUESTS ||
+           (!nbd_client_connected(cs) && cs->in_flight > 0))
     {
-        qemu_co_queue_wait(&s->free_sema, &s->send_mutex);
+        qemu_co_queue_wait(&cs->free_sema, &cs->send_mutex);
     }
 
-    if (nbd_client_connecting(s)) {
-        nbd_reconnect_attempt(s);
+    if (nbd_client_connecting(cs)) {
+        nbd_reconnect_attempt(cs);
     }
 
-    if (!nbd_client_connected(s)) {
+    if (!nbd_client_connected(cs)) {
         rc = -EIO;
         goto err;
     }
 
-    s->in_flight++;
+    cs->in_flight++;
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (s->requests[i].coroutine == NULL) {
+        if (cs->requests[i].coroutine == NULL) {
             break;
         }
     }
@@ -487,41 +614,45 @@ static int nbd_co_send_request(BlockDriverState *bs,
     g_assert(qemu_in_coroutine());
     assert(i < MAX_NBD_REQUESTS);
 
-    s->requests[i].coroutine = qemu_coroutine_self();
-    s->requests[i].offset = request->from;
-    s->requests[i].receiving = false;
-    s->requests[i].reply_possible = true;
+    cs->requests[i].coroutine = qemu_coroutine_self();
+    cs->requests[i].offset = request->from;
+    cs->requests[i].receiving = false;
+    cs->requests[i].reply_possible = true;
 
-    request->handle = INDEX_TO_HANDLE(s, i);
+    request->handle = INDEX_TO_HANDLE(cs, i);
 
-    assert(s->ioc);
+    assert(cs->ioc);
 
     if (qiov) {
-        qio_channel_set_cork(s->ioc, true);
-        rc = nbd_send_request(s->ioc, request);
-        if (nbd_client_connected(s) && rc >= 0) {
-            if (qio_channel_writev_all(s->ioc, qiov->iov, qiov->niov,
+        if (!s->plugged) {
+            qio_channel_set_cork(cs->ioc, true);
+        }
+        rc = nbd_send_request(cs->ioc, request);
+        if (nbd_client_connected(cs) && rc >= 0) {
+            if (qio_channel_writev_all(cs->ioc, qiov->iov, qiov->niov,
                                        NULL) < 0) {
                 rc = -EIO;
             }
         } else if (rc >= 0) {
             rc = -EIO;
         }
-        qio_channel_set_cork(s->ioc, false);
+        if (!s->plugged) {
+            qio_channel_set_cork(cs->ioc, false);
+        }
     } else {
-        rc = nbd_send_request(s->ioc, request);
+        rc = nbd_send_request(cs->ioc, request);
     }
 
 err:
     if (rc < 0) {
-        nbd_channel_error(s, rc);
+        nbd_channel_error(cs, rc);
         if (i != -1) {
-            s->requests[i].coroutine = NULL;
-            s->in_flight--;
-            qemu_co_queue_next(&s->free_sema);
+            cs->requests[i].coroutine = NULL;
+            cs->in_flight--;
+            qemu_co_queue_next(&cs->free_sema);
         }
     }
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_unlock(&cs->send_mutex);
     return rc;
 }
 
@@ -543,7 +674,7 @@ static inline uint64_t payload_advance64(uint8_t **payload)
     return ldq_be_p(*payload - 8);
 }
 
-static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
+static int nbd_parse_offset_hole_payload(NBDConnState *cs,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_offset,
                                          QEMUIOVector *qiov, Error **errp)
@@ -566,8 +697,8 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
                          " region");
         return -EINVAL;
     }
-    if (s->info.min_block &&
-        !QEMU_IS_ALIGNED(hole_size, s->info.min_block)) {
+    if (cs->info.min_block &&
+        !QEMU_IS_ALIGNED(hole_size, cs->info.min_block)) {
         trace_nbd_structured_read_compliance("hole");
     }
 
@@ -581,7 +712,7 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
  * Based on our request, we expect only one extent in reply, for the
  * base:allocation context.
  */
-static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
+static int nbd_parse_blockstatus_payload(NBDConnState *cs,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_length,
                                          NBDExtent *extent, Error **errp)
@@ -596,11 +727,11 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
     }
 
     context_id = payload_advance32(&payload);
-    if (s->info.context_id != context_id) {
+    if (cs->info.context_id != context_id) {
         error_setg(errp, "Protocol error: unexpected context id %d for "
                          "NBD_REPLY_TYPE_BLOCK_STATUS, when negotiated context "
                          "id is %d", context_id,
-                         s->info.context_id);
+                         cs->info.context_id);
         return -EINVAL;
     }
 
@@ -625,14 +756,14 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
      * up to the full block and change the status to fully-allocated
      * (always a safe status, even if it loses information).
      */
-    if (s->info.min_block && !QEMU_IS_ALIGNED(extent->length,
-                                                   s->info.min_block)) {
+    if (cs->info.min_block && !QEMU_IS_ALIGNED(extent->length,
+                                               cs->info.min_block)) {
         trace_nbd_parse_blockstatus_compliance("extent length is unaligned");
-        if (extent->length > s->info.min_block) {
+        if (extent->length > cs->info.min_block) {
             extent->length = QEMU_ALIGN_DOWN(extent->length,
-                                             s->info.min_block);
+                                             cs->info.min_block);
         } else {
-            extent->length = s->info.min_block;
+            extent->length = cs->info.min_block;
             extent->flags = 0;
         }
     }
@@ -659,7 +790,7 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
      * since nbd_client_co_block_status is only expecting the low two
      * bits to be set.
      */
-    if (s->alloc_depth && extent->flags > 2) {
+    if (cs->s->alloc_depth && extent->flags > 2) {
         extent->flags = 2;
     }
 
@@ -708,7 +839,7 @@ static int nbd_parse_error_payload(NBDStructuredReplyChunk *chunk,
     return 0;
 }
 
-static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
+static int nbd_co_receive_offset_data_payload(NBDConnState *cs,
                                               uint64_t orig_offset,
                                               QEMUIOVector *qiov, Error **errp)
 {
@@ -716,9 +847,9 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
     uint64_t offset;
     size_t data_size;
     int ret;
-    NBDStructuredReplyChunk *chunk = &s->reply.structured;
+    NBDStructuredReplyChunk *chunk = &cs->reply.structured;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
     /* The NBD spec requires at least one byte of payload */
     if (chunk->length <= sizeof(offset)) {
@@ -727,7 +858,7 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
         return -EINVAL;
     }
 
-    if (nbd_read64(s->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
+    if (nbd_read64(cs->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
         return -EIO;
     }
 
@@ -739,13 +870,14 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
                          " region");
         return -EINVAL;
     }
-    if (s->info.min_block && !QEMU_IS_ALIGNED(data_size, s->info.min_block)) {
+    if (cs->info.min_block &&
+        !QEMU_IS_ALIGNED(data_size, cs->info.min_block)) {
         trace_nbd_structured_read_compliance("data");
     }
 
     qemu_iovec_init(&sub_qiov, qiov->niov);
     qemu_iovec_concat(&sub_qiov, qiov, offset - orig_offset, data_size);
-    ret = qio_channel_readv_all(s->ioc, sub_qiov.iov, sub_qiov.niov, errp);
+    ret = qio_channel_readv_all(cs->ioc, sub_qiov.iov, sub_qiov.niov, errp);
     qemu_iovec_destroy(&sub_qiov);
 
     return ret < 0 ? -EIO : 0;
@@ -753,14 +885,14 @@ static int nbd_co_receive_offset_data_payload(BDRVNBDState *s,
 
 #define NBD_MAX_MALLOC_PAYLOAD 1000
 static coroutine_fn int nbd_co_receive_structured_payload(
-        BDRVNBDState *s, void **payload, Error **errp)
+        NBDConnState *cs, void **payload, Error **errp)
 {
     int ret;
     uint32_t len;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
-    len = s->reply.structured.length;
+    len = cs->reply.structured.length;
 
     if (len == 0) {
         return 0;
@@ -777,7 +909,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
     }
 
     *payload = g_new(char, len);
-    ret = nbd_read(s->ioc, *payload, len, "structured payload", errp);
+    ret = nbd_read(cs->ioc, *payload, len, "structured payload", errp);
     if (ret < 0) {
         g_free(*payload);
         *payload = NULL;
@@ -803,11 +935,11 @@ static coroutine_fn int nbd_co_receive_structured_payload(
  * corresponding to the server's error reply), and errp is unchanged.
  */
 static coroutine_fn int nbd_co_do_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *cs, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, void **payload, Error **errp)
 {
     int ret;
-    int i = HANDLE_TO_INDEX(s, handle);
+    int i = HANDLE_TO_INDEX(cs, handle);
     void *local_payload = NULL;
     NBDStructuredReplyChunk *chunk;
 
@@ -816,34 +948,34 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
     }
     *request_ret = 0;
 
-    nbd_receive_replies(s, handle);
-    if (!nbd_client_connected(s)) {
+    nbd_receive_replies(cs, handle);
+    if (!nbd_client_connected(cs)) {
         error_setg(errp, "Connection closed");
         return -EIO;
     }
-    assert(s->ioc);
+    assert(cs->ioc);
 
-    assert(s->reply.handle == handle);
+    assert(cs->reply.handle == handle);
 
-    if (nbd_reply_is_simple(&s->reply)) {
+    if (nbd_reply_is_simple(&cs->reply)) {
         if (only_structured) {
             error_setg(errp, "Protocol error: simple reply when structured "
                              "reply chunk was expected");
             return -EINVAL;
         }
 
-        *request_ret = -nbd_errno_to_system_errno(s->reply.simple.error);
+        *request_ret = -nbd_errno_to_system_errno(cs->reply.simple.error);
         if (*request_ret < 0 || !qiov) {
             return 0;
         }
 
-        return qio_channel_readv_all(s->ioc, qiov->iov, qiov->niov,
+        return qio_channel_readv_all(cs->ioc, qiov->iov, qiov->niov,
                                      errp) < 0 ? -EIO : 0;
     }
 
     /* handle structured reply chunk */
-    assert(s->info.structured_reply);
-    chunk = &s->reply.structured;
+    assert(cs->info.structured_reply);
+    chunk = &cs->reply.structured;
 
     if (chunk->type == NBD_REPLY_TYPE_NONE) {
         if (!(chunk->flags & NBD_REPLY_FLAG_DONE)) {
@@ -865,7 +997,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
             return -EINVAL;
         }
 
-        return nbd_co_receive_offset_data_payload(s, s->requests[i].offset,
+        return nbd_co_receive_offset_data_payload(cs, cs->requests[i].offset,
                                                   qiov, errp);
     }
 
@@ -873,7 +1005,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
         payload = &local_payload;
     }
 
-    ret = nbd_co_receive_structured_payload(s, payload, errp);
+    ret = nbd_co_receive_structured_payload(cs, payload, errp);
     if (ret < 0) {
         return ret;
     }
@@ -893,23 +1025,23 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
  * Return value is a fatal error code or normal nbd reply error code
  */
 static coroutine_fn int nbd_co_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *cs, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, NBDReply *reply, void **payload,
         Error **errp)
 {
-    int ret = nbd_co_do_receive_one_chunk(s, handle, only_structured,
+    int ret = nbd_co_do_receive_one_chunk(cs, handle, only_structured,
                                           request_ret, qiov, payload, errp);
 
     if (ret < 0) {
         memset(reply, 0, sizeof(*reply));
-        nbd_channel_error(s, ret);
+        nbd_channel_error(cs, ret);
     } else {
         /* For assert at loop start in nbd_connection_entry */
-        *reply = s->reply;
+        *reply = cs->reply;
     }
-    s->reply.handle = 0;
+    cs->reply.handle = 0;
 
-    nbd_recv_coroutines_wake(s, false);
+    nbd_recv_coroutines_wake(cs, false);
 
     return ret;
 }
@@ -950,16 +1082,16 @@ static void nbd_iter_request_error(NBDReplyChunkIter *iter, int ret)
  * NBD_FOREACH_REPLY_CHUNK
  * The pointer stored in @payload requires g_free() to free it.
  */
-#define NBD_FOREACH_REPLY_CHUNK(s, iter, handle, structured, \
+#define NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, structured, \
                                 qiov, reply, payload) \
     for (iter = (NBDReplyChunkIter) { .only_structured = structured }; \
-         nbd_reply_chunk_iter_receive(s, &iter, handle, qiov, reply, payload);)
+         nbd_reply_chunk_iter_receive(cs, &iter, handle, qiov, reply, payload);)
 
 /*
  * nbd_reply_chunk_iter_receive
  * The pointer stored in @payload requires g_free() to free it.
  */
-static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
+static bool nbd_reply_chunk_iter_receive(NBDConnState *cs,
                                          NBDReplyChunkIter *iter,
                                          uint64_t handle,
                                          QEMUIOVector *qiov, NBDReply *reply,
@@ -969,7 +1101,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     NBDReply local_reply;
     NBDStructuredReplyChunk *chunk;
     Error *local_err = NULL;
-    if (!nbd_client_connected(s)) {
+    if (!nbd_client_connected(cs)) {
         error_setg(&local_err, "Connection closed");
         nbd_iter_channel_error(iter, -EIO, &local_err);
         goto break_loop;
@@ -984,7 +1116,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
         reply = &local_reply;
     }
 
-    ret = nbd_co_receive_one_chunk(s, handle, iter->only_structured,
+    ret = nbd_co_receive_one_chunk(cs, handle, iter->only_structured,
                                    &request_ret, qiov, reply, payload,
                                    &local_err);
     if (ret < 0) {
@@ -994,7 +1126,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     }
 
     /* Do not execute the body of NBD_FOREACH_REPLY_CHUNK for simple reply. */
-    if (nbd_reply_is_simple(reply) || !nbd_client_connected(s)) {
+    if (nbd_reply_is_simple(reply) || !nbd_client_connected(cs)) {
         goto break_loop;
     }
 
@@ -1016,22 +1148,22 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     return true;
 
 break_loop:
-    s->requests[HANDLE_TO_INDEX(s, handle)].coroutine = NULL;
+    cs->requests[HANDLE_TO_INDEX(cs, handle)].coroutine = NULL;
 
-    qemu_co_mutex_lock(&s->send_mutex);
-    s->in_flight--;
-    qemu_co_queue_next(&s->free_sema);
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_lock(&cs->send_mutex);
+    cs->in_flight--;
+    qemu_co_queue_next(&cs->free_sema);
+    qemu_co_mutex_unlock(&cs->send_mutex);
 
     return false;
 }
 
-static int nbd_co_receive_return_code(BDRVNBDState *s, uint64_t handle,
+static int nbd_co_receive_return_code(NBDConnState *cs, uint64_t handle,
                                       int *request_ret, Error **errp)
 {
     NBDReplyChunkIter iter;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, NULL, NULL) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, false, NULL, NULL, NULL) {
         /* nbd_reply_chunk_iter_receive does all the work */
     }
 
@@ -1040,7 +1172,7 @@ static int nbd_co_receive_return_code(BDRVNBDState *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
+static int nbd_co_receive_cmdread_reply(NBDConnState *cs, uint64_t handle,
                                         uint64_t offset, QEMUIOVector *qiov,
                                         int *request_ret, Error **errp)
 {
@@ -1049,7 +1181,7 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
     void *payload = NULL;
     Error *local_err = NULL;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, s->info.structured_reply,
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, cs->info.structured_reply,
                             qiov, &reply, &payload)
     {
         int ret;
@@ -1065,17 +1197,17 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
              */
             break;
         case NBD_REPLY_TYPE_OFFSET_HOLE:
-            ret = nbd_parse_offset_hole_payload(s, &reply.structured, payload,
+            ret = nbd_parse_offset_hole_payload(cs, &reply.structured, payload,
                                                 offset, qiov, &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
                 /* not allowed reply type */
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) for CMD_READ",
                            chunk->type, nbd_reply_type_lookup(chunk->type));
@@ -1092,7 +1224,7 @@ static int nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
+static int nbd_co_receive_blockstatus_reply(NBDConnState *cs,
                                             uint64_t handle, uint64_t length,
                                             NBDExtent *extent,
                                             int *request_ret, Error **errp)
@@ -1104,7 +1236,7 @@ static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
     bool received = false;
 
     assert(!extent->length);
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, &reply, &payload) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, false, NULL, &reply, &payload) {
         int ret;
         NBDStructuredReplyChunk *chunk = &reply.structured;
 
@@ -1113,23 +1245,23 @@ static int nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
         switch (chunk->type) {
         case NBD_REPLY_TYPE_BLOCK_STATUS:
             if (received) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err, "Several BLOCK_STATUS chunks in reply");
                 nbd_iter_channel_error(&iter, -EINVAL, &local_err);
             }
             received = true;
 
-            ret = nbd_parse_blockstatus_payload(s, &reply.structured,
+            ret = nbd_parse_blockstatus_payload(cs, &reply.structured,
                                                 payload, length, extent,
                                                 &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) "
                            "for CMD_BLOCK_STATUS",
@@ -1157,7 +1289,7 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
 {
     int ret, request_ret;
     Error *local_err = NULL;
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
 
     assert(request->type != NBD_CMD_READ);
     if (write_qiov) {
@@ -1168,12 +1300,12 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     }
 
     do {
-        ret = nbd_co_send_request(bs, request, write_qiov);
+        ret = nbd_co_send_request(bs, request, write_qiov, &cs);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_return_code(s, request->handle,
+        ret = nbd_co_receive_return_code(cs, request->handle,
                                          &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request->from, request->len,
@@ -1184,7 +1316,7 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(cs));
 
     return ret ? ret : request_ret;
 }
@@ -1196,6 +1328,7 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -1228,12 +1361,12 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
     }
 
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        ret = nbd_co_send_request(bs, &request, NULL, &cs);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_cmdread_reply(s, request.handle, offset, qiov,
+        ret = nbd_co_receive_cmdread_reply(cs, request.handle, offset, qiov,
                                            &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request.from, request.len, request.handle,
@@ -1243,7 +1376,7 @@ static int nbd_client_co_preadv(BlockDriverState *bs, int64_t offset,
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(cs));
 
     return ret ? ret : request_ret;
 }
@@ -1350,6 +1483,7 @@ static int coroutine_fn nbd_client_co_block_status(
     int ret, request_ret;
     NBDExtent extent = { 0 };
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     Error *local_err = NULL;
 
     NBDRequest request = {
@@ -1385,12 +1519,12 @@ static int coroutine_fn nbd_client_co_block_status(
         assert(QEMU_IS_ALIGNED(request.len, s->info.min_block));
     }
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        ret = nbd_co_send_request(bs, &request, NULL, &cs);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_blockstatus_reply(s, request.handle, bytes,
+        ret = nbd_co_receive_blockstatus_reply(cs, request.handle, bytes,
                                                &extent, &request_ret,
                                                &local_err);
         if (local_err) {
@@ -1401,7 +1535,7 @@ static int coroutine_fn nbd_client_co_block_status(
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_connecting_wait(s));
+    } while (ret < 0 && nbd_client_connecting_wait(cs));
 
     if (ret < 0 || request_ret < 0) {
         return ret ? ret : request_ret;
@@ -1430,23 +1564,27 @@ static int nbd_client_reopen_prepare(BDRVReopenState *state,
 
 static void nbd_yank(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs = opaque;
 
-    qatomic_store_release(&s->state, NBD_CLIENT_QUIT);
-    qio_channel_shutdown(QIO_CHANNEL(s->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    qatomic_store_release(&cs->state, NBD_CLIENT_QUIT);
+    qio_channel_shutdown(QIO_CHANNEL(cs->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
 }
 
 static void nbd_client_close(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     NBDRequest request = { .type = NBD_CMD_DISC };
+    unsigned int i;
 
-    if (s->ioc) {
-        nbd_send_request(s->ioc, &request);
-    }
+    for (i = 0; i < s->multi_conn; i++) {
+        NBDConnState *cs = s->conns[i];
 
-    nbd_teardown_connection(bs);
+        if (cs->ioc) {
+            nbd_send_request(cs->ioc, &request);
+        }
+
+        nbd_teardown_connection(cs);
+    }
 }
 
 
@@ -1779,6 +1917,12 @@ static QemuOptsList nbd_runtime_opts = {
                     "attempts until successful or until @open-timeout seconds "
                     "have elapsed. Default 0",
         },
+        {
+            .name = "multi-conn",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of connections to open to the server if it "
+                    "supports multi-conn. Default 1",
+        },
         { /* end of list */ }
     },
 };
@@ -1836,6 +1980,15 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     s->reconnect_delay = qemu_opt_get_number(opts, "reconnect-delay", 0);
     s->open_timeout = qemu_opt_get_number(opts, "open-timeout", 0);
 
+    s->multi_conn = qemu_opt_get_number(opts, "multi-conn", 1);
+    if (s->multi_conn < 1 || s->multi_conn > MAX_MULTI_CONN) {
+        error_setg(errp, "multi-conn must be between 1 and %d",
+                   MAX_MULTI_CONN);
+        s->multi_conn = 0;
+        ret = -EINVAL;
+        goto error;
+    }
+
     ret = 0;
 
  error:
@@ -1847,12 +2000,10 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
 {
     int ret;
+    unsigned int i;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
 
     s->bs = bs;
-    qemu_co_mutex_init(&s->send_mutex);
-    qemu_co_queue_init(&s->free_sema);
-    qemu_co_mutex_init(&s->receive_mutex);
 
     if (!yank_register_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name), errp)) {
         return -EEXIST;
@@ -1863,26 +2014,41 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
-    s->conn = nbd_client_connection_new(s->saddr, true, s->export,
-                                        s->x_dirty_bitmap, s->tlscreds);
+    for (i = 0; i < s->multi_conn; i++) {
+        NBDConnState *cs = g_new0(NBDConnState, 1);
+
+        cs->s = s;
+        qemu_co_mutex_init(&cs->send_mutex);
+        qemu_co_queue_init(&cs->free_sema);
+        qemu_co_mutex_init(&cs->receive_mutex);
+        cs->conn = nbd_client_connection_new(s->saddr, true, s->export,
+                                             s->x_dirty_bitmap, s->tlscreds);
+        cs->state = NBD_CLIENT_CONNECTING_WAIT;
+        s->conns[i] = cs;
+    }
 
     if (s->open_timeout) {
-        nbd_client_connection_enable_retry(s->conn);
+        nbd_client_connection_enable_retry(s->conns[0]->conn);
         open_timer_init(s, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
                         s->open_timeout * NANOSECONDS_PER_SECOND);
     }
 
-    s->state = NBD_CLIENT_CONNECTING_WAIT;
     ret = nbd_do_establish_connection(bs, errp);
+    /* The timer must not access s->conns[0] after this point */
+    open_timer_del(s);
     if (ret < 0) {
         goto fail;
     }
 
-    nbd_client_connection_enable_retry(s->conn);
+    for (i = 0; i < s->multi_conn; i++) {
+        nbd_client_connection_enable_retry(s->conns[i]->conn);
+    }
 
     return 0;
 
 fail:
+    /* Some of the connections may have been established */
+    nbd_client_close(bs);
     nbd_clear_bdrvstate(bs);
     return ret;
 }
@@ -2025,15 +2191,47 @@ static const char *const nbd_strong_runtime_opts[] = {
 static void nbd_cancel_in_flight(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
+
+    for (i = 0; i < s->multi_conn; i++) {
+        NBDConnState *cs = s->conns[i];
+
+        reconnect_delay_timer_del(cs);
 
-    reconnect_delay_timer_del(s);
+        if (cs->state == NBD_CLIENT_CONNECTING_WAIT) {
+            cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
+            qemu_co_queue_restart_all(&cs->free_sema);
+        }
+
+        nbd_co_establish_connection_cancel(cs->conn);
+    }
+}
+
+/*
+ * While plugged, requests are queued in the corked socket instead of being
+ * sent one by one, so that a whole batch of requests (with their payload)
+ * goes out in as few packets as possible when the batch is unplugged.
+ */
+static void nbd_set_cork(BDRVNBDState *s, bool enabled)
+{
+    unsigned int i;
 
-    if (s->state == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-        qemu_co_queue_restart_all(&s->free_sema);
+    s->plugged = enabled;
+    for (i = 0; i < s->multi_conn; i++) {
+        if (s->conns[i]->ioc) {
+            qio_channel_set_cork(s->conns[i]->ioc, enabled);
+        }
     }
+}
 
-    nbd_co_establish_connection_cancel(s->conn);
+static void nbd_io_plug(BlockDriverState *bs)
+{
+    nbd_set_cork(bs->opaque, true);
+}
+
+static void nbd_io_unplug(BlockDriverState *bs)
+{
+    nbd_set_cork(bs->opaque, false);
 }
 
 static BlockDriver bdrv_nbd = {
@@ -2059,6 +2257,8 @@ static BlockDriver bdrv_nbd = {
     .bdrv_dirname               = nbd_dirname,
     .strong_runtime_opts        = nbd_strong_runtime_opts,
     .bdrv_cancel_in_flight      = nbd_cancel_in_flight,
+    .bdrv_io_plug               = nbd_io_plug,
+    .bdrv_io_unplug             = nbd_io_unplug,
 };
 
 static BlockDriver bdrv_nbd_tcp = {
@@ -2084,6 +2284,8 @@ static BlockDriver bdrv_nbd_tcp = {
     .bdrv_dirname               = nbd_dirname,
     .strong_runtime_opts        = nbd_strong_runtime_opts,
     .bdrv_cancel_in_flight      = nbd_cancel_in_flight,
+    .bdrv_io_plug               = nbd_io_plug,
+    .bdrv_io_unplug             = nbd_io_unplug,
 };
 
 static BlockDriver bdrv_nbd_unix = {
@@ -2109,6 +2311,8 @@ static BlockDriver bdrv_nbd_unix = {
     .bdrv_dirname               = nbd_dirname,
     .strong_runtime_opts        = nbd_strong_runtime_opts,
     .bdrv_cancel_in_flight      = nbd_cancel_in_flight,
+    .bdrv_io_plug               = nbd_io_plug,
+    .bdrv_io_unplug             = nbd_io_unplug,
 };
 
 static void bdrv_nbd_init(void)
@@ -38,6 +38,7 @@
  * head == tail + 1.
  */
 #define NVME_NUM_REQS (NVME_QUEUE_SIZE - 1)
+#define NVME_MAX_IO_QUEUES 64
 
 typedef struct BDRVNVMeState BDRVNVMeState;
 
@@ -62,6 +63,7 @@ typedef struct {
 typedef struct {
     BlockCompletionFunc *cb;
     void *opaque;
+    uint32_t *result;  /* if set, receives dword 0 of the completion */
     int cid;
     void *prp_list_page;
     uint64_t prp_list_iova;
@@ -95,6 +97,7 @@ struct BDRVNVMeState {
     AioContext *aio_context;
     QEMUVFIOState *vfio;
     void *bar0_wo_map;
+    size_t bar0_wo_map_size;
     /* Memory mapped registers */
     volatile struct {
         uint32_t sq_tail;
@@ -106,6 +109,8 @@ struct BDRVNVMeState {
      */
     NVMeQueuePair **queues;
     unsigned queue_count;
+    /* I/O queue that the next request tries first */
+    unsigned next_io_queue;
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -140,6 +145,7 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_QUEUES "queues"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -157,6 +163,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs",
+        },
         { /* end of list */ }
     },
 };
@@ -336,6 +347,30 @@ static void nvme_wake_free_req_locked(NVMeQueuePair *q)
     }
 }
 
+/*
+ * Returns the I/O queue for a new request.  Requests are distributed round
+ * robin, skipping queues that have no free request.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    unsigned nr_io_queues = s->queue_count - INDEX_IO(0);
+    unsigned i, n = s->next_io_queue;
+
+    assert(nr_io_queues > 0);
+    s->next_io_queue = (n + 1) % nr_io_queues;
+
+    for (i = 0; i < nr_io_queues; i++) {
+        NVMeQueuePair *q = s->queues[INDEX_IO((n + i) % nr_io_queues)];
+
+        /* Only a hint, nvme_get_free_req() waits if the queue became full */
+        if (qatomic_read(&q->free_req_head) != -1) {
+            return q;
+        }
+    }
+
+    return s->queues[INDEX_IO(n)];
+}
+
 /* Insert a request in the freelist and wake waiters */
 static void nvme_put_free_req_and_wake(NVMeQueuePair *q, NVMeRequest *req)
 {
@@ -420,8 +455,12 @@ static bool nvme_process_completion(NVMeQueuePair *q)
         req = *preq;
         assert(req.cid == cid);
         assert(req.cb);
+        if (req.result) {
+            *req.result = le32_to_cpu(c->result);
+        }
         nvme_put_free_req_locked(q, preq);
         preq->cb = preq->opaque = NULL;
+        preq->result = NULL;
         q->inflight--;
         qemu_mutex_unlock(&q->lock);
         req.cb(req.opaque, ret);
@@ -498,7 +537,9 @@ static void nvme_admin_cmd_sync_cb(void *opaque, int ret)
     aio_wait_kick();
 }
 
-static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+/* Also stores dword 0 of the completion in *@result, if @result is not NULL */
+static int nvme_admin_cmd_sync_result(BlockDriverState *bs, NvmeCmd *cmd,
+                                      uint32_t *result)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q = s->queues[INDEX_ADMIN];
@@ -509,12 +550,18 @@ static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
     if (!req) {
         return -EBUSY;
     }
+    req->result = result;
     nvme_submit_command(q, req, cmd, nvme_admin_cmd_sync_cb, &ret);
 
     AIO_WAIT_WHILE(aio_context, ret == -EINPROGRESS);
     return ret;
 }
 
+static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+{
+    return nvme_admin_cmd_sync_result(bs, cmd, NULL);
+}
+
 /* Returns true on success, false on failure. */
 static bool nvme_identify(BlockDriverState *bs, int namespace, Error **errp)
 {
@@ -712,6 +759,42 @@ static bool nvme_poll_cb(void *opaque)
     return false;
 }
 
+/*
+ * Asks the controller for @nr_io_queues I/O queue pairs.  Returns the number
+ * of queue pairs to create, which is less if the controller granted fewer
+ * submission or completion queues.
+ */
+static unsigned nvme_set_queue_count(BlockDriverState *bs,
+                                     unsigned nr_io_queues)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+        .cdw11 = cpu_to_le32(((nr_io_queues - 1) << 16) | (nr_io_queues - 1)),
+    };
+    uint32_t result;
+    unsigned granted;
+
+    if (nr_io_queues == 1) {
+        return 1;
+    }
+
+    if (nvme_admin_cmd_sync_result(bs, &cmd, &result)) {
+        warn_report("NVMe controller does not support %u I/O queues, using a "
+                    "single one", nr_io_queues);
+        return 1;
+    }
+
+    /* NSQA in bits 15:0 and NCQA in bits 31:16, both 0's based */
+    granted = MIN(extract32(result, 0, 16), extract32(result, 16, 16)) + 1;
+    if (granted < nr_io_queues) {
+        warn_report("NVMe controller granted %u of %u I/O queues",
+                    granted, nr_io_queues);
+        return granted;
+    }
+    return nr_io_queues;
+}
+
 static void nvme_poll_ready(EventNotifier *e)
 {
     BDRVNVMeState *s = container_of(e, BDRVNVMeState,
@@ -721,7 +804,7 @@ static void nvme_poll_ready(EventNotifier *e)
 }
 
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned nr_io_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
@@ -804,8 +887,12 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
         }
     }
 
-    s->bar0_wo_map = qemu_vfio_pci_map_bar(s->vfio, 0, 0,
-                                           sizeof(NvmeBar) + NVME_DOORBELL_SIZE,
+    /* Each queue pair has a submission and a completion queue doorbell */
+    s->bar0_wo_map_size = sizeof(NvmeBar) +
+        MAX(NVME_DOORBELL_SIZE,
+            ROUND_UP(INDEX_IO(nr_io_queues) * s->doorbell_scale *
+                     sizeof(*s->doorbells), qemu_real_host_page_size));
+    s->bar0_wo_map = qemu_vfio_pci_map_bar(s->vfio, 0, 0, s->bar0_wo_map_size,
                                            PROT_WRITE, errp);
     s->doorbells = (void *)((uintptr_t)s->bar0_wo_map + sizeof(NvmeBar));
     if (!s->doorbells) {
@@ -861,8 +948,19 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
+    nr_io_queues = nvme_set_queue_count(bs, nr_io_queues);
     if (!nvme_add_io_queue(bs, errp)) {
         ret = -EIO;
+        goto out;
+    }
+    while (s->queue_count < INDEX_IO(nr_io_queues)) {
+        Error *local_err = NULL;
+
+        if (!nvme_add_io_queue(bs, &local_err)) {
+            warn_reportf_err(local_err, "Using only %u I/O queues: ",
+                             s->queue_count - INDEX_IO(0));
+            break;
+        }
     }
 out:
     if (regs) {
@@ -941,7 +1039,7 @@ static void nvme_close(BlockDriverState *bs)
                            false, NULL, NULL, NULL);
     event_notifier_cleanup(&s->irq_notifier[MSIX_SHARED_IRQ_IDX]);
     qemu_vfio_pci_unmap_bar(s->vfio, 0, s->bar0_wo_map,
-                            0, sizeof(NvmeBar) + NVME_DOORBELL_SIZE);
+                            0, s->bar0_wo_map_size);
     qemu_vfio_close(s->vfio);
 
     g_free(s->device);
@@ -953,6 +1051,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t nr_io_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -968,7 +1067,15 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    nr_io_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_QUEUES, 1);
+    if (nr_io_queues < 1 || nr_io_queues > NVME_MAX_IO_QUEUES) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_QUEUES "' must be between 1 and "
+                   "%d", NVME_MAX_IO_QUEUES);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+
+    ret = nvme_init(bs, device, namespace, nr_io_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1168,7 +1275,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1287,7 +1394,7 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
@@ -1318,7 +1425,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1381,7 +1488,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
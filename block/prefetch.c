@@ -0,0 +1,623 @@
+/*
+ * Boot trace prefetch filter
+ *
+ * Booting from a remote image issues many small scattered reads, each of
+ * which waits for a network round trip.  If the "trace" child does not
+ * hold a trace yet, this filter records the ranges read during the first
+ * minutes after opening and saves them when the node is closed.  When it
+ * is opened with a trace, it reads the recorded ranges into memory ahead of
+ * the guest, several at a time, and serves guest reads from there.  Writes
+ * drop any prefetched data they overlap.
+ *
+ * Prefetched data is dropped once the guest has read all of it.  To keep
+ * it for later boots as well, put a local-cache node below this filter.
+ *
+ * Trace layout: a PrefetchTraceHeader, then from PREFETCH_TRACE_OFFSET one
+ * PrefetchTraceEntry per recorded range, in the order they were first read.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block_int.h"
+#include "qemu/bswap.h"
+#include "qemu/coroutine.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "trace.h"
+
+#define PREFETCH_OPT_DEPTH          "depth"
+#define PREFETCH_OPT_MEMORY         "memory"
+#define PREFETCH_DEPTH_DEFAULT      16
+#define PREFETCH_MEMORY_DEFAULT     (64 * MiB)
+
+#define PREFETCH_TRACE_MAGIC        0x51504654 /* "QPFT" */
+#define PREFETCH_TRACE_VERSION      1
+#define PREFETCH_TRACE_OFFSET       512
+
+/* Reads are recorded for this long after opening, or up to this many */
+#define PREFETCH_RECORD_NS          (300 * NANOSECONDS_PER_SECOND)
+#define PREFETCH_RECORD_MAX         65536
+/* A recorded range grows while the reads that follow it are contiguous */
+#define PREFETCH_MAX_RANGE          (1 * MiB)
+
+typedef struct PrefetchTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nb_entries;
+} QEMU_PACKED PrefetchTraceHeader;
+
+typedef struct PrefetchTraceEntry {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t reserved;
+} QEMU_PACKED PrefetchTraceEntry;
+
+/* A prefetched range; it is freed once it has been read completely */
+typedef struct PrefetchExtent {
+    int64_t offset;
+    int64_t bytes;
+    int64_t unread;             /* bytes the guest has not read yet */
+    int refcnt;                 /* the prefetch read and waiting guest reads */
+    uint8_t *buf;
+    bool done;
+    bool stale;                 /* overlapped with a write */
+    int ret;
+    CoQueue waiters;            /* guest reads waiting for @buf */
+    QTAILQ_ENTRY(PrefetchExtent) next;
+} PrefetchExtent;
+
+typedef struct BDRVPrefetchState {
+    BdrvChild *trace;
+
+    /* Recording */
+    bool recording;
+    int64_t record_end_ns;
+    GArray *record;             /* PrefetchTraceEntry, in host endianness */
+
+    /* Replay */
+    PrefetchTraceEntry *entries;
+    uint64_t nb_entries;
+    uint64_t next_entry;
+    int depth;
+    int in_flight;
+    int64_t memory;
+    int64_t buffered;
+    QTAILQ_HEAD(, PrefetchExtent) extents;
+} BDRVPrefetchState;
+
+static QemuOptsList prefetch_runtime_opts = {
+    .name = "prefetch",
+    .head = QTAILQ_HEAD_INITIALIZER(prefetch_runtime_opts.head),
+    .desc = {
+        {
+            .name = PREFETCH_OPT_DEPTH,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of ranges that are read ahead in parallel "
+                    "(default: 16)",
+        },
+        {
+            .name = PREFETCH_OPT_MEMORY,
+            .type = QEMU_OPT_SIZE,
+            .help = "Memory for prefetched data that the guest has not read "
+                    "yet (default: 64M)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static int prefetch_load_trace(BlockDriverState *bs, Error **errp)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    PrefetchTraceHeader header;
+    int64_t size;
+    uint64_t i;
+    int ret;
+
+    size = bdrv_getlength(s->trace->bs);
+    if (size < 0) {
+        error_setg_errno(errp, -size, "Could not get the trace size");
+        return size;
+    }
+
+    if (size < PREFETCH_TRACE_OFFSET) {
+        memset(&header, 0, sizeof(header));
+    } else {
+        ret = bdrv_pread(s->trace, 0, &header, sizeof(header));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Could not read the trace header");
+            return ret;
+        }
+    }
+
+    if (le32_to_cpu(header.magic) != PREFETCH_TRACE_MAGIC) {
+        /* No trace yet, record one if it can be saved */
+        s->recording = !bdrv_is_read_only(s->trace->bs);
+        s->record_end_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                           PREFETCH_RECORD_NS;
+        s->record = g_array_new(false, false, sizeof(PrefetchTraceEntry));
+        return 0;
+    }
+    if (le32_to_cpu(header.version) != PREFETCH_TRACE_VERSION) {
+        error_setg(errp, "Unsupported trace version %" PRIu32,
+                   le32_to_cpu(header.version));
+        return -ENOTSUP;
+    }
+
+    s->nb_entries = le64_to_cpu(header.nb_entries);
+    if (s->nb_entries > PREFETCH_RECORD_MAX) {
+        error_setg(errp, "The trace has too many entries");
+        return -EINVAL;
+    }
+    s->entries = g_new(PrefetchTraceEntry, s->nb_entries);
+    ret = bdrv_pread(s->trace, PREFETCH_TRACE_OFFSET, s->entries,
+                     s->nb_entries * sizeof(*s->entries));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read the trace");
+        return ret;
+    }
+    for (i = 0; i < s->nb_entries; i++) {
+        s->entries[i].offset = le64_to_cpu(s->entries[i].offset);
+        s->entries[i].bytes = le32_to_cpu(s->entries[i].bytes);
+    }
+    return 0;
+}
+
+static int prefetch_open(BlockDriverState *bs, QDict *options, int flags,
+                         Error **errp)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    QemuOpts *opts;
+    int ret = -EINVAL;
+
+    opts = qemu_opts_create(&prefetch_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        goto out;
+    }
+    s->depth = qemu_opt_get_number(opts, PREFETCH_OPT_DEPTH,
+                                   PREFETCH_DEPTH_DEFAULT);
+    if (s->depth < 1 || s->depth > 256) {
+        error_setg(errp, "depth must be between 1 and 256");
+        goto out;
+    }
+    s->memory = qemu_opt_get_size(opts, PREFETCH_OPT_MEMORY,
+                                  PREFETCH_MEMORY_DEFAULT);
+    if (s->memory < PREFETCH_MAX_RANGE || s->memory > INT64_MAX / 2) {
+        error_setg(errp, "memory must be at least 1M");
+        goto out;
+    }
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        goto out;
+    }
+
+    s->trace = bdrv_open_child(NULL, options, "trace", bs, &child_of_bds,
+                               BDRV_CHILD_METADATA, false, errp);
+    if (!s->trace) {
+        goto out;
+    }
+
+    QTAILQ_INIT(&s->extents);
+    ret = prefetch_load_trace(bs, errp);
+    if (ret < 0) {
+        goto out;
+    }
+    trace_prefetch_open(bs, s->recording, s->nb_entries);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    ret = 0;
+out:
+    if (ret < 0) {
+        if (s->record) {
+            g_array_free(s->record, true);
+            s->record = NULL;
+        }
+        g_free(s->entries);
+        s->entries = NULL;
+    }
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static int prefetch_save_trace(BlockDriverState *bs)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    PrefetchTraceHeader header = {
+        .magic = cpu_to_le32(PREFETCH_TRACE_MAGIC),
+        .version = cpu_to_le32(PREFETCH_TRACE_VERSION),
+        .nb_entries = cpu_to_le64(s->record->len),
+    };
+    PrefetchTraceEntry *entries;
+    guint i;
+    int ret;
+
+    if (!s->recording || !s->record->len ||
+        !(s->trace->perm & BLK_PERM_WRITE)) {
+        return 0;
+    }
+    s->recording = false;
+
+    entries = g_new0(PrefetchTraceEntry, s->record->len);
+    for (i = 0; i < s->record->len; i++) {
+        PrefetchTraceEntry *e = &g_array_index(s->record, PrefetchTraceEntry,
+                                               i);
+
+        entries[i].offset = cpu_to_le64(e->offset);
+        entries[i].bytes = cpu_to_le32(e->bytes);
+    }
+
+    /* The header goes last, so that a partial trace is not used */
+    ret = bdrv_pwrite(s->trace, PREFETCH_TRACE_OFFSET, entries,
+                      s->record->len * sizeof(*entries));
+    g_free(entries);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_flush(s->trace->bs);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = bdrv_pwrite(s->trace, 0, &header, sizeof(header));
+    if (ret < 0) {
+        return ret;
+    }
+    trace_prefetch_save_trace(bs, s->record->len);
+    return bdrv_flush(s->trace->bs);
+}
+
+static int prefetch_inactivate(BlockDriverState *bs)
+{
+    return prefetch_save_trace(bs);
+}
+
+static void prefetch_extent_free(BDRVPrefetchState *s, PrefetchExtent *e)
+{
+    QTAILQ_REMOVE(&s->extents, e, next);
+    s->buffered -= e->bytes;
+    qemu_vfree(e->buf);
+    g_free(e);
+}
+
+static void prefetch_close(BlockDriverState *bs)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    PrefetchExtent *e, *next_e;
+    int ret;
+
+    if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+        ret = prefetch_save_trace(bs);
+        if (ret < 0) {
+            error_report("prefetch: Could not save the trace: %s",
+                         strerror(-ret));
+        }
+    }
+
+    /* Draining waited for the prefetch reads */
+    QTAILQ_FOREACH_SAFE(e, &s->extents, next, next_e) {
+        assert(!e->refcnt);
+        prefetch_extent_free(s, e);
+    }
+    if (s->record) {
+        g_array_free(s->record, true);
+    }
+    g_free(s->entries);
+    bdrv_unref_child(bs, s->trace);
+    s->trace = NULL;
+}
+
+static void prefetch_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                BdrvChildRole role,
+                                BlockReopenQueue *reopen_queue,
+                                uint64_t perm, uint64_t shared,
+                                uint64_t *nperm, uint64_t *nshared)
+{
+    if (role & BDRV_CHILD_PRIMARY) {
+        bdrv_default_perms(bs, c, role, reopen_queue, perm, shared,
+                           nperm, nshared);
+        return;
+    }
+
+    /* The trace is saved on close even for read-only parents */
+    *nperm = BLK_PERM_CONSISTENT_READ;
+    if (!(bs->open_flags & BDRV_O_INACTIVE) && !bdrv_is_read_only(c->bs)) {
+        *nperm |= BLK_PERM_WRITE | BLK_PERM_RESIZE;
+    }
+    *nshared = BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE_UNCHANGED;
+}
+
+static int64_t prefetch_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static void prefetch_record(BDRVPrefetchState *s, int64_t offset,
+                            int64_t bytes)
+{
+    PrefetchTraceEntry *last;
+
+    if (s->record->len >= PREFETCH_RECORD_MAX ||
+        qemu_clock_get_ns(QEMU_CLOCK_REALTIME) > s->record_end_ns) {
+        return;
+    }
+
+    if (s->record->len) {
+        last = &g_array_index(s->record, PrefetchTraceEntry,
+                              s->record->len - 1);
+        if (last->offset + last->bytes == offset &&
+            last->bytes + bytes <= PREFETCH_MAX_RANGE) {
+            last->bytes += bytes;
+            return;
+        }
+    }
+
+    while (bytes) {
+        PrefetchTraceEntry e = {
+            .offset = offset,
+            .bytes = MIN(bytes, PREFETCH_MAX_RANGE),
+        };
+
+        g_array_append_val(s->record, e);
+        offset += e.bytes;
+        bytes -= e.bytes;
+    }
+}
+
+static void prefetch_extent_unref(BDRVPrefetchState *s, PrefetchExtent *e)
+{
+    if (--e->refcnt == 0 && (e->stale || e->ret < 0 || e->unread <= 0)) {
+        prefetch_extent_free(s, e);
+    }
+}
+
+static void prefetch_kick(BlockDriverState *bs);
+
+typedef struct PrefetchCo {
+    BlockDriverState *bs;
+    PrefetchExtent *e;
+} PrefetchCo;
+
+static void coroutine_fn prefetch_read_entry(void *opaque)
+{
+    PrefetchCo *co = opaque;
+    BlockDriverState *bs = co->bs;
+    BDRVPrefetchState *s = bs->opaque;
+    PrefetchExtent *e = co->e;
+    QEMUIOVector qiov;
+
+    qemu_iovec_init_buf(&qiov, e->buf, e->bytes);
+    e->ret = bdrv_co_preadv(bs->file, e->offset, e->bytes, &qiov, 0);
+    e->done = true;
+    s->in_flight--;
+    qemu_co_queue_restart_all(&e->waiters);
+    prefetch_extent_unref(s, e);
+
+    prefetch_kick(bs);
+    bdrv_dec_in_flight(bs);
+}
+
+/*
+ * Drops the oldest prefetched data that nobody waits for, until there is
+ * room for more.  The guest reads roughly in trace order, so it most likely
+ * went past that data already.
+ */
+static void prefetch_make_room(BDRVPrefetchState *s)
+{
+    PrefetchExtent *e, *next_e;
+
+    QTAILQ_FOREACH_SAFE(e, &s->extents, next, next_e) {
+        if (s->buffered < s->memory) {
+            break;
+        }
+        if (e->done && !e->refcnt) {
+            prefetch_extent_free(s, e);
+        }
+    }
+}
+
+/* Starts prefetch reads until the depth or the memory limit is reached */
+static void prefetch_kick(BlockDriverState *bs)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    int64_t size = bdrv_getlength(bs->file->bs);
+
+    if (s->buffered >= s->memory) {
+        prefetch_make_room(s);
+    }
+
+    while (s->next_entry < s->nb_entries && s->in_flight < s->depth &&
+           s->buffered < s->memory && !qatomic_read(&bs->quiesce_counter)) {
+        PrefetchTraceEntry *t = &s->entries[s->next_entry++];
+        PrefetchExtent *e;
+        PrefetchCo data;
+        Coroutine *co;
+
+        if (!t->bytes || t->bytes > PREFETCH_MAX_RANGE || size < 0 ||
+            t->offset > size || t->bytes > size - t->offset) {
+            continue;
+        }
+
+        e = g_new0(PrefetchExtent, 1);
+        e->buf = qemu_try_blockalign(bs->file->bs, t->bytes);
+        if (!e->buf) {
+            g_free(e);
+            s->next_entry--;
+            return;
+        }
+        e->offset = t->offset;
+        e->bytes = e->unread = t->bytes;
+        e->refcnt = 1;
+        qemu_co_queue_init(&e->waiters);
+        QTAILQ_INSERT_TAIL(&s->extents, e, next);
+        s->buffered += e->bytes;
+        s->in_flight++;
+
+        data = (PrefetchCo) {
+            .bs = bs,
+            .e = e,
+        };
+        /* Drain waits for the read, and it keeps the node around */
+        bdrv_inc_in_flight(bs);
+        co = qemu_coroutine_create(prefetch_read_entry, &data);
+        qemu_coroutine_enter(co);
+    }
+}
+
+/* Returns the extent that holds all of the range, or NULL */
+static PrefetchExtent *prefetch_find(BDRVPrefetchState *s, int64_t offset,
+                                     int64_t bytes)
+{
+    PrefetchExtent *e;
+
+    QTAILQ_FOREACH(e, &s->extents, next) {
+        if (!e->stale && e->offset <= offset &&
+            offset + bytes <= e->offset + e->bytes) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int coroutine_fn prefetch_co_preadv_part(BlockDriverState *bs,
+                                                int64_t offset, int64_t bytes,
+                                                QEMUIOVector *qiov,
+                                                size_t qiov_offset,
+                                                BdrvRequestFlags flags)
+{
+    BDRVPrefetchState *s = bs->opaque;
+    PrefetchExtent *e;
+
+    if (s->recording) {
+        prefetch_record(s, offset, bytes);
+    }
+    if (!s->nb_entries) {
+        goto passthrough;
+    }
+    prefetch_kick(bs);
+
+    e = prefetch_find(s, offset, bytes);
+    if (!e) {
+        goto passthrough;
+    }
+    e->refcnt++;
+    while (!e->done) {
+        qemu_co_queue_wait(&e->waiters, NULL);
+    }
+    if (e->ret < 0 || e->stale) {
+        prefetch_extent_unref(s, e);
+        goto passthrough;
+    }
+
+    trace_prefetch_hit(bs, offset, bytes);
+    qemu_iovec_from_buf(qiov, qiov_offset, e->buf + offset - e->offset,
+                        bytes);
+    e->unread -= bytes;
+    prefetch_extent_unref(s, e);
+    prefetch_kick(bs);
+    return 0;
+
+passthrough:
+    return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+}
+
+/*
+ * Drops the prefetched data that a write makes outdated.  Writes call this
+ * both before and after they go to the child: a prefetch read that starts
+ * while the write is in flight may return the old data.
+ */
+static void prefetch_invalidate(BDRVPrefetchState *s, int64_t offset,
+                                int64_t bytes)
+{
+    PrefetchExtent *e, *next_e;
+
+    QTAILQ_FOREACH_SAFE(e, &s->extents, next, next_e) {
+        if (e->offset < offset + bytes && offset < e->offset + e->bytes) {
+            e->stale = true;
+            if (!e->refcnt) {
+                prefetch_extent_free(s, e);
+            }
+        }
+    }
+}
+
+static int coroutine_fn prefetch_co_pwritev_part(BlockDriverState *bs,
+                                                 int64_t offset, int64_t bytes,
+                                                 QEMUIOVector *qiov,
+                                                 size_t qiov_offset,
+                                                 BdrvRequestFlags flags)
+{
+    int ret;
+
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn prefetch_co_pwrite_zeroes(BlockDriverState *bs,
+                                                  int64_t offset, int64_t bytes,
+                                                  BdrvRequestFlags flags)
+{
+    int ret;
+
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn prefetch_co_pdiscard(BlockDriverState *bs,
+                                             int64_t offset, int64_t bytes)
+{
+    int ret;
+
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    prefetch_invalidate(bs->opaque, offset, bytes);
+    return ret;
+}
+
+static const char *const prefetch_strong_runtime_opts[] = {
+    NULL
+};
+
+static BlockDriver bdrv_prefetch = {
+    .format_name                        = "prefetch",
+    .instance_size                      = sizeof(BDRVPrefetchState),
+
+    .bdrv_open                          = prefetch_open,
+    .bdrv_close                         = prefetch_close,
+    .bdrv_child_perm                    = prefetch_child_perm,
+    .bdrv_inactivate                    = prefetch_inactivate,
+
+    .bdrv_getlength                     = prefetch_getlength,
+
+    .bdrv_co_preadv_part                = prefetch_co_preadv_part,
+    .bdrv_co_pwritev_part               = prefetch_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = prefetch_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = prefetch_co_pdiscard,
+
+    .is_filter                          = true,
+    .strong_runtime_opts                = prefetch_strong_runtime_opts,
+};
+
+static void bdrv_prefetch_init(void)
+{
+    bdrv_register(&bdrv_prefetch);
+}
+
+block_init(bdrv_prefetch_init);
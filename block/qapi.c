@@ -28,6 +28,7 @@
 #include "block/block_int.h"
 #include "block/throttle-groups.h"
 #include "block/write-threshold.h"
+#include "qapi/clone-visitor.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block-core.h"
 #include "qapi/qobject-output-visitor.h"
@@ -41,9 +42,16 @@
 #include "sysemu/block-backend.h"
 #include "qemu/cutils.h"
 
+/*
+ * @image_cache, if not NULL, maps nodes to their ImageInfo (without
+ * backing_image).  A query that covers many nodes passes the same table for
+ * all of them, so that each image in a shared backing chain is only
+ * examined once.
+ */
 BlockDeviceInfo *bdrv_block_device_info(BlockBackend *blk,
                                         BlockDriverState *bs,
                                         bool flat,
+                                        GHashTable *image_cache,
                                         Error **errp)
 {
     ImageInfo **p_image_info;
@@ -151,11 +159,24 @@ BlockDeviceInfo *bdrv_block_device_info(BlockBackend *blk,
     info->backing_file_depth = 0;
     while (1) {
         Error *local_err = NULL;
-        bdrv_query_image_info(bs0, p_image_info, &local_err);
-        if (local_err) {
-            error_propagate(errp, local_err);
-            qapi_free_BlockDeviceInfo(info);
-            return NULL;
+        ImageInfo *cached = NULL;
+
+        if (image_cache) {
+            cached = g_hash_table_lookup(image_cache, bs0);
+        }
+        if (cached) {
+            *p_image_info = QAPI_CLONE(ImageInfo, cached);
+        } else {
+            bdrv_query_image_info(bs0, p_image_info, &local_err);
+            if (local_err) {
+                error_propagate(errp, local_err);
+                qapi_free_BlockDeviceInfo(info);
+                return NULL;
+            }
+            if (image_cache) {
+                g_hash_table_insert(image_cache, bs0,
+                                    QAPI_CLONE(ImageInfo, *p_image_info));
+            }
         }
 
         /* stop gathering data for flat output */
@@ -351,7 +372,7 @@ out:
 
 /* @p_info will be set only on success. */
 static void bdrv_query_info(BlockBackend *blk, BlockInfo **p_info,
-                            Error **errp)
+                            GHashTable *image_cache, Error **errp)
 {
     BlockInfo *info = g_malloc0(sizeof(*info));
     BlockDriverState *bs = blk_bs(blk);
@@ -385,7 +406,8 @@ static void bdrv_query_info(BlockBackend *blk, BlockInfo **p_info,
 
     if (bs && bs->drv) {
         info->has_inserted = true;
-        info->inserted = bdrv_block_device_info(blk, bs, false, errp);
+        info->inserted = bdrv_block_device_info(blk, bs, false, image_cache,
+                                                errp);
         if (info->inserted == NULL) {
             goto err;
         }
@@ -424,6 +446,32 @@ static void bdrv_latency_histogram_stats(BlockLatencyHistogram *hist,
     }
 }
 
+static BlockLatencyLogBinList *
+bdrv_latency_log_histogram_bins(BlockLatencyLogHistogram *hist,
+                                enum BlockAcctType type)
+{
+    BlockLatencyLogBinList *head = NULL, **tail = &head;
+    int i;
+
+    for (i = 0; i < BLOCK_LOG_HISTOGRAM_BINS; i++) {
+        uint64_t count = stat64_get(&hist->bins[type][i]);
+        BlockLatencyLogBin *bin;
+
+        if (!count) {
+            continue;
+        }
+
+        bin = g_new(BlockLatencyLogBin, 1);
+        bin->start = block_latency_log_histogram_bin_start(i);
+        bin->end = i + 1 < BLOCK_LOG_HISTOGRAM_BINS ?
+                   block_latency_log_histogram_bin_start(i + 1) : UINT64_MAX;
+        bin->count = count;
+        QAPI_LIST_APPEND(tail, bin);
+    }
+
+    return head;
+}
+
 static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
 {
     BlockAcctStats *stats = blk_get_stats(blk);
@@ -537,6 +585,21 @@ static BlockStats *bdrv_query_bds_stats(BlockDriverState *bs,
         s->has_driver_specific = true;
     }
 
+    if (bs->latency_log_histogram) {
+        BlockLatencyLogHistogram *hist = bs->latency_log_histogram;
+
+        s->has_latency_histogram = true;
+        s->latency_histogram = g_new(BlockLatencyLogHistogramInfo, 1);
+        s->latency_histogram->read =
+            bdrv_latency_log_histogram_bins(hist, BLOCK_ACCT_READ);
+        s->latency_histogram->write =
+            bdrv_latency_log_histogram_bins(hist, BLOCK_ACCT_WRITE);
+        s->latency_histogram->flush =
+            bdrv_latency_log_histogram_bins(hist, BLOCK_ACCT_FLUSH);
+        s->latency_histogram->discard =
+            bdrv_latency_log_histogram_bins(hist, BLOCK_ACCT_UNMAP);
+    }
+
     parent_child = bdrv_primary_child(bs);
     if (!parent_child ||
         !(parent_child->role & (BDRV_CHILD_DATA | BDRV_CHILD_FILTERED)))
@@ -587,6 +650,9 @@ BlockInfoList *qmp_query_block(Error **errp)
     BlockInfoList *head = NULL, **p_next = &head;
     BlockBackend *blk;
     Error *local_err = NULL;
+    g_autoptr(GHashTable) image_cache =
+        g_hash_table_new_full(NULL, NULL, NULL,
+                              (GDestroyNotify)qapi_free_ImageInfo);
 
     for (blk = blk_all_next(NULL); blk; blk = blk_all_next(blk)) {
         BlockInfoList *info;
@@ -596,7 +662,7 @@ BlockInfoList *qmp_query_block(Error **errp)
         }
 
         info = g_malloc0(sizeof(*info));
-        bdrv_query_info(blk, &info->value, &local_err);
+        bdrv_query_info(blk, &info->value, image_cache, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             g_free(info);
@@ -661,6 +727,33 @@ BlockStatsList *qmp_query_blockstats(bool has_query_nodes,
     return head;
 }
 
+void qmp_block_node_latency_histogram_set(const char *node_name, bool enable,
+                                          Error **errp)
+{
+    BlockDriverState *bs;
+    BlockLatencyLogHistogram *old;
+    AioContext *ctx;
+
+    bs = bdrv_find_node(node_name);
+    if (!bs) {
+        error_setg(errp, "Node '%s' not found", node_name);
+        return;
+    }
+
+    ctx = bdrv_get_aio_context(bs);
+    aio_context_acquire(ctx);
+
+    /* No request may see the histogram change between its start and end */
+    bdrv_drained_begin(bs);
+    old = bs->latency_log_histogram;
+    qatomic_set(&bs->latency_log_histogram,
+                enable ? g_new0(BlockLatencyLogHistogram, 1) : NULL);
+    bdrv_drained_end(bs);
+
+    aio_context_release(ctx);
+    g_free(old);
+}
+
 void bdrv_snapshot_dump(QEMUSnapshotInfo *sn)
 {
     char clock_buf[128];
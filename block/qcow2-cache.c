@@ -31,6 +31,7 @@ typedef struct Qcow2CachedTable {
     uint64_t lru_counter;
     int      ref;
     bool     dirty;
+    QTAILQ_ENTRY(Qcow2CachedTable) lru_entry;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -42,6 +43,15 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /* Cached tables by offset, keyed by &entries[i].offset */
+    GHashTable             *offsets;
+
+    /*
+     * Unreferenced tables, least recently used first.  Empty entries are
+     * kept at the head so that they are replaced before any cached table.
+     */
+    QTAILQ_HEAD(, Qcow2CachedTable) lru;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -57,6 +67,48 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static void qcow2_cache_set_offset(Qcow2Cache *c, int i, int64_t offset)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->offset) {
+        g_hash_table_remove(c->offsets, &t->offset);
+    }
+    t->offset = offset;
+    if (offset) {
+        g_hash_table_insert(c->offsets, &t->offset, t);
+    }
+}
+
+/* Reset entry @i to empty and make it the first candidate for replacement */
+static void qcow2_cache_reset_entry(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    assert(t->ref == 0);
+    qcow2_cache_set_offset(c, i, 0);
+    t->lru_counter = 0;
+    QTAILQ_REMOVE(&c->lru, t, lru_entry);
+    QTAILQ_INSERT_HEAD(&c->lru, t, lru_entry);
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int64_t key = offset;
+    Qcow2CachedTable *t = g_hash_table_lookup(c->offsets, &key);
+
+    return t ? t - c->entries : -1;
+}
+
+static void qcow2_cache_entry_ref(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->ref++ == 0) {
+        QTAILQ_REMOVE(&c->lru, t, lru_entry);
+    }
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -104,8 +156,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_reset_entry(c, i);
             i++;
             to_clean++;
         }
@@ -123,6 +174,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -140,7 +192,13 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
         qemu_vfree(c->table_array);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    c->offsets = g_hash_table_new(g_int64_hash, g_int64_equal);
+    QTAILQ_INIT(&c->lru);
+    for (i = 0; i < num_tables; i++) {
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_entry);
     }
 
     return c;
@@ -154,6 +212,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
     }
 
+    g_hash_table_destroy(c->offsets);
     qemu_vfree(c->table_array);
     g_free(c->entries);
     g_free(c);
@@ -304,9 +363,7 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
     }
 
     for (i = 0; i < c->size; i++) {
-        assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
-        c->entries[i].lru_counter = 0;
+        qcow2_cache_reset_entry(c, i);
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -320,11 +377,9 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     uint64_t offset, void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
+    Qcow2CachedTable *victim;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -339,29 +394,20 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    i = qcow2_cache_lookup(c, offset);
+    if (i >= 0) {
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    victim = QTAILQ_FIRST(&c->lru);
+    if (!victim) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
+    i = victim - c->entries;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -372,25 +418,36 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    /*
+     * Lookups without s->lock must not find the table before it has been
+     * read completely, so unhash it while bdrv_pread() yields.
+     */
+    qcow2_cache_set_offset(c, i, 0);
     if (read_from_disk) {
+        void *table = qcow2_cache_get_table_addr(c, i);
+        bool shared = c == s->l2_table_cache && s->shared_l2_cache;
+
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
         }
 
-        ret = bdrv_pread(bs->file, offset,
-                         qcow2_cache_get_table_addr(c, i),
-                         c->table_size);
-        if (ret < 0) {
-            return ret;
+        if (!shared || !qcow2_shared_cache_read(s->shared_l2_cache, offset,
+                                                table)) {
+            ret = bdrv_pread(bs->file, offset, table, c->table_size);
+            if (ret < 0) {
+                return ret;
+            }
+            if (shared) {
+                qcow2_shared_cache_write(s->shared_l2_cache, offset, table);
+            }
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_set_offset(c, i, offset);
 
     /* And return the right table */
 found:
-    c->entries[i].ref++;
+    qcow2_cache_entry_ref(c, i);
     *table = qcow2_cache_get_table_addr(c, i);
 
     trace_qcow2_cache_get_done(qemu_coroutine_self(),
@@ -411,6 +468,24 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     return qcow2_cache_do_get(bs, c, offset, table, false);
 }
 
+/*
+ * Like qcow2_cache_get(), but only returns tables that are already cached.
+ * This never yields, so unlike the other functions it may be called without
+ * s->lock.  Returns -EAGAIN if the table is not cached.
+ */
+int qcow2_cache_try_get(Qcow2Cache *c, uint64_t offset, void **table)
+{
+    int i = qcow2_cache_lookup(c, offset);
+
+    if (i < 0) {
+        return -EAGAIN;
+    }
+
+    qcow2_cache_entry_ref(c, i);
+    *table = qcow2_cache_get_table_addr(c, i);
+    return 0;
+}
+
 void qcow2_cache_put(Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(c, *table);
@@ -420,6 +495,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        QTAILQ_INSERT_TAIL(&c->lru, &c->entries[i], lru_entry);
     }
 
     assert(c->entries[i].ref >= 0);
@@ -434,24 +510,16 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
 {
     int i = qcow2_cache_get_table_idx(c, table);
 
-    assert(c->entries[i].ref == 0);
-
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_reset_entry(c, i);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
@@ -215,6 +215,18 @@ static int l2_load(BlockDriverState *bs, uint64_t offset,
                            (void **)l2_slice);
 }
 
+/* Like l2_load(), but fails with -EAGAIN instead of reading from disk */
+static int l2_try_load(BlockDriverState *bs, uint64_t offset,
+                       uint64_t l2_offset, uint64_t **l2_slice)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int start_of_slice = l2_entry_size(s) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+
+    return qcow2_cache_try_get(s->l2_table_cache, l2_offset + start_of_slice,
+                               (void **)l2_slice);
+}
+
 /*
  * Writes an L1 entry to disk (note that depending on the alignment
  * requirements this function may write more that just one entry in
@@ -580,10 +592,14 @@ static int coroutine_fn do_perform_cow_write(BlockDriverState *bs,
  * Compressed clusters are always processed one by one.
  *
  * Returns 0 on success, -errno in error cases.
+ *
+ * If @nowait is true, the lookup fails with -EAGAIN instead of yielding,
+ * i.e. when the L2 slice is not cached or when the image would have to be
+ * marked corrupt.  The output parameters are undefined in that case.
  */
-int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
-                          unsigned int *bytes, uint64_t *host_offset,
-                          QCow2SubclusterType *subcluster_type)
+static int get_host_offset(BlockDriverState *bs, uint64_t offset,
+                           unsigned int *bytes, uint64_t *host_offset,
+                           QCow2SubclusterType *subcluster_type, bool nowait)
 {
     BDRVQcow2State *s = bs->opaque;
     unsigned int l2_index, sc_index;
@@ -625,6 +641,9 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     }
 
     if (offset_into_cluster(s, l2_offset)) {
+        if (nowait) {
+            return -EAGAIN;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "L2 table offset %#" PRIx64
                                 " unaligned (L1 index: %#" PRIx64 ")",
                                 l2_offset, l1_index);
@@ -633,7 +652,11 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
 
     /* load the l2 slice in memory */
 
-    ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    if (nowait) {
+        ret = l2_try_load(bs, offset, l2_offset, &l2_slice);
+    } else {
+        ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    }
     if (ret < 0) {
         return ret;
     }
@@ -654,6 +677,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     type = qcow2_get_subcluster_type(bs, l2_entry, l2_bitmap, sc_index);
     if (s->qcow_version < 3 && (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
                                 type == QCOW2_SUBCLUSTER_ZERO_ALLOC)) {
+        if (nowait) {
+            ret = -EAGAIN;
+            goto fail;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "Zero cluster entry found"
                                 " in pre-v3 image (L2 offset: %#" PRIx64
                                 ", L2 index: %#x)", l2_offset, l2_index);
@@ -665,6 +692,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
         break; /* This is handled by count_contiguous_subclusters() below */
     case QCOW2_SUBCLUSTER_COMPRESSED:
         if (has_data_file(bs)) {
+            if (nowait) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1, "Compressed cluster "
                                     "entry found in image with external data "
                                     "file (L2 offset: %#" PRIx64 ", L2 index: "
@@ -683,6 +714,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
         uint64_t host_cluster_offset = l2_entry & L2E_OFFSET_MASK;
         *host_offset = host_cluster_offset + offset_in_cluster;
         if (offset_into_cluster(s, host_cluster_offset)) {
+            if (nowait) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "Cluster allocation offset %#"
                                     PRIx64 " unaligned (L2 offset: %#" PRIx64
@@ -692,6 +727,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
             goto fail;
         }
         if (has_data_file(bs) && *host_offset != offset) {
+            if (nowait) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "External data file host cluster offset %#"
                                     PRIx64 " does not match guest cluster "
@@ -710,6 +749,10 @@ int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
     sc = count_contiguous_subclusters(bs, nb_clusters, sc_index,
                                       l2_slice, &l2_index);
     if (sc < 0) {
+        if (nowait) {
+            ret = -EAGAIN;
+            goto fail;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "Invalid cluster entry found "
                                 " (L2 offset: %#" PRIx64 ", L2 index: %#x)",
                                 l2_offset, l2_index);
@@ -740,6 +783,31 @@ fail:
     return ret;
 }
 
+int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
+                          unsigned int *bytes, uint64_t *host_offset,
+                          QCow2SubclusterType *subcluster_type)
+{
+    return get_host_offset(bs, offset, bytes, host_offset, subcluster_type,
+                           false);
+}
+
+/*
+ * Like qcow2_get_host_offset(), but returns -EAGAIN instead of yielding.
+ *
+ * All requests to a qcow2 node run in its AioContext, so a lookup that does
+ * not yield cannot observe other requests halfway through a metadata update
+ * and does not need s->lock.  L2 slices are only visible in the cache once
+ * they have been read completely.  Callers retry with s->lock held and
+ * qcow2_get_host_offset() on -EAGAIN.
+ */
+int qcow2_try_get_host_offset(BlockDriverState *bs, uint64_t offset,
+                              unsigned int *bytes, uint64_t *host_offset,
+                              QCow2SubclusterType *subcluster_type)
+{
+    return get_host_offset(bs, offset, bytes, host_offset, subcluster_type,
+                           true);
+}
+
 /*
  * get_cluster_table
  *
@@ -1611,6 +1679,16 @@ static int do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
 
     /* Allocate new clusters */
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
+    if (s->alloc_pool_size) {
+        int64_t pool_offset = qcow2_alloc_pool_take(bs, *host_offset,
+                                                    nb_clusters);
+        if (pool_offset < 0) {
+            return pool_offset;
+        } else if (pool_offset > 0) {
+            *host_offset = pool_offset;
+            return 0;
+        }
+    }
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
             qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
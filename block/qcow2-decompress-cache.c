@@ -0,0 +1,178 @@
+/*
+ * Cache of decompressed qcow2 clusters
+ *
+ * Reads from compressed images (typically read-only base images shared by
+ * many guests) tend to hit the same clusters over and over, for example
+ * while booting.  Keeping the decompressed data around saves both the
+ * read of the compressed data and the zlib/zstd work.
+ *
+ * Entries are keyed by the host offset of the compressed data.  Compressed
+ * clusters are never modified in place, so an entry stays valid until the
+ * last reference to its compressed data is dropped; callers must then call
+ * qcow2_decompress_cache_invalidate().  Requests that missed the cache
+ * before an invalidation do not add what they read, because the data may
+ * already be stale.
+ *
+ * All accesses happen in the AioContext of the node and never yield, so no
+ * locking is needed.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/queue.h"
+#include "qcow2.h"
+#include "trace.h"
+
+typedef struct Qcow2DecompressCacheEntry {
+    uint64_t coffset;
+    void *data;
+    QTAILQ_ENTRY(Qcow2DecompressCacheEntry) next;
+} Qcow2DecompressCacheEntry;
+
+struct Qcow2DecompressCache {
+    GHashTable *entries;
+    QTAILQ_HEAD(, Qcow2DecompressCacheEntry) lru;
+    size_t cluster_size;
+    int max_entries;
+    int nb_entries;
+    uint64_t generation;    /* Incremented by every invalidation */
+};
+
+static void decompress_cache_entry_free(gpointer p)
+{
+    Qcow2DecompressCacheEntry *e = p;
+
+    qemu_vfree(e->data);
+    g_free(e);
+}
+
+Qcow2DecompressCache *qcow2_decompress_cache_create(size_t cluster_size,
+                                                    uint64_t size)
+{
+    Qcow2DecompressCache *c;
+
+    if (size < cluster_size) {
+        return NULL;
+    }
+
+    c = g_new0(Qcow2DecompressCache, 1);
+    c->entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                       decompress_cache_entry_free);
+    QTAILQ_INIT(&c->lru);
+    c->cluster_size = cluster_size;
+    c->max_entries = MIN(size / cluster_size, INT_MAX);
+
+    return c;
+}
+
+void qcow2_decompress_cache_destroy(Qcow2DecompressCache *c)
+{
+    if (!c) {
+        return;
+    }
+
+    g_hash_table_destroy(c->entries);
+    g_free(c);
+}
+
+/*
+ * Copies @bytes bytes at @offset_in_cluster from the decompressed cluster
+ * whose compressed data starts at @coffset into @qiov.
+ *
+ * Returns true on a hit.  Returns false if the cluster is not cached and sets
+ * *@generation, which must be passed to qcow2_decompress_cache_insert().
+ */
+bool qcow2_decompress_cache_read(Qcow2DecompressCache *c, uint64_t coffset,
+                                 size_t offset_in_cluster, size_t bytes,
+                                 QEMUIOVector *qiov, size_t qiov_offset,
+                                 uint64_t *generation)
+{
+    Qcow2DecompressCacheEntry *e;
+
+    assert(offset_in_cluster + bytes <= c->cluster_size);
+
+    e = g_hash_table_lookup(c->entries, &coffset);
+    if (!e) {
+        *generation = c->generation;
+        return false;
+    }
+
+    QTAILQ_REMOVE(&c->lru, e, next);
+    QTAILQ_INSERT_HEAD(&c->lru, e, next);
+
+    qemu_iovec_from_buf(qiov, qiov_offset, e->data + offset_in_cluster,
+                        bytes);
+    return true;
+}
+
+/*
+ * Adds the decompressed cluster @data whose compressed data starts at
+ * @coffset, evicting the least recently used entry if the cache is full.
+ * @data must have been allocated with qemu_blockalign() and is owned by the
+ * cache afterwards.  @generation is the value returned by the cache miss.
+ */
+void qcow2_decompress_cache_insert(Qcow2DecompressCache *c, uint64_t coffset,
+                                   void *data, uint64_t generation)
+{
+    Qcow2DecompressCacheEntry *e;
+
+    /*
+     * Either another request decompressed the same cluster meanwhile, or
+     * clusters were freed while we were reading and @data may be stale
+     */
+    if (generation != c->generation ||
+        g_hash_table_contains(c->entries, &coffset)) {
+        qemu_vfree(data);
+        return;
+    }
+
+    if (c->nb_entries == c->max_entries) {
+        e = QTAILQ_LAST(&c->lru);
+        trace_qcow2_decompress_cache_evict(c, e->coffset);
+        QTAILQ_REMOVE(&c->lru, e, next);
+        g_hash_table_remove(c->entries, &e->coffset);
+        c->nb_entries--;
+    }
+
+    e = g_new(Qcow2DecompressCacheEntry, 1);
+    e->coffset = coffset;
+    e->data = data;
+    QTAILQ_INSERT_HEAD(&c->lru, e, next);
+    g_hash_table_insert(c->entries, &e->coffset, e);
+    c->nb_entries++;
+}
+
+/* Drops the entry for the compressed data at @coffset, if any */
+void qcow2_decompress_cache_invalidate(Qcow2DecompressCache *c,
+                                       uint64_t coffset)
+{
+    Qcow2DecompressCacheEntry *e;
+
+    if (!c) {
+        return;
+    }
+
+    c->generation++;
+    e = g_hash_table_lookup(c->entries, &coffset);
+    if (e) {
+        QTAILQ_REMOVE(&c->lru, e, next);
+        g_hash_table_remove(c->entries, &coffset);
+        c->nb_entries--;
+    }
+}
+
+/* Drops all entries */
+void qcow2_decompress_cache_empty(Qcow2DecompressCache *c)
+{
+    if (!c) {
+        return;
+    }
+
+    c->generation++;
+    QTAILQ_INIT(&c->lru);
+    g_hash_table_remove_all(c->entries);
+    c->nb_entries = 0;
+}
@@ -28,6 +28,7 @@
 #include "qemu/range.h"
 #include "qemu/bswap.h"
 #include "qemu/cutils.h"
+#include "block/aio_task.h"
 #include "trace.h"
 
 static int64_t alloc_clusters_noref(BlockDriverState *bs, uint64_t size,
@@ -1063,6 +1064,79 @@ int64_t qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
     return i;
 }
 
+/*
+ * Takes up to *nb_clusters data clusters from the allocation pool, refilling
+ * it with a single refcount update if it is empty.  If @host_offset is not
+ * INV_OFFSET, clusters are only taken if they start at @host_offset.
+ *
+ * Returns the offset of the first cluster and updates *nb_clusters, 0 if the
+ * pool cannot serve this allocation and the caller must allocate the clusters
+ * itself, or -errno.
+ */
+int64_t qcow2_alloc_pool_take(BlockDriverState *bs, uint64_t host_offset,
+                              uint64_t *nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t pool_clusters = s->alloc_pool_size >> s->cluster_bits;
+    int64_t offset, n;
+
+    if (*nb_clusters >= pool_clusters) {
+        return 0;
+    }
+
+    if (!s->alloc_pool_clusters) {
+        if (host_offset == INV_OFFSET) {
+            offset = qcow2_alloc_clusters(bs, pool_clusters << s->cluster_bits);
+            if (offset < 0) {
+                return offset;
+            }
+            n = pool_clusters;
+        } else {
+            /* Keep growing the current contiguous area if possible */
+            offset = host_offset;
+            n = qcow2_alloc_clusters_at(bs, offset, pool_clusters);
+            if (n <= 0) {
+                return n;
+            }
+        }
+        s->alloc_pool_offset = offset;
+        s->alloc_pool_clusters = n;
+        trace_qcow2_alloc_pool_refill(offset, n);
+    }
+
+    if (host_offset != INV_OFFSET && host_offset != s->alloc_pool_offset) {
+        return 0;
+    }
+
+    offset = s->alloc_pool_offset;
+    *nb_clusters = MIN(*nb_clusters, s->alloc_pool_clusters);
+    s->alloc_pool_offset += *nb_clusters << s->cluster_bits;
+    s->alloc_pool_clusters -= *nb_clusters;
+
+    return offset;
+}
+
+/*
+ * Frees the clusters left in the allocation pool.  Must be called before
+ * anything that expects all allocated clusters to be referenced, like image
+ * checks, truncation, or closing and inactivating the image.
+ */
+void qcow2_alloc_pool_release(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->alloc_pool_clusters) {
+        return;
+    }
+
+    trace_qcow2_alloc_pool_release(s->alloc_pool_offset,
+                                   s->alloc_pool_clusters);
+    qcow2_free_clusters(bs, s->alloc_pool_offset,
+                        s->alloc_pool_clusters << s->cluster_bits,
+                        QCOW2_DISCARD_OTHER);
+    s->alloc_pool_clusters = 0;
+}
+
 /* only used to allocate compressed sectors. We try to allocate
    contiguous sectors. size must be <= cluster_size */
 int64_t qcow2_alloc_bytes(BlockDriverState *bs, int size)
@@ -1181,6 +1255,7 @@ void qcow2_free_any_cluster(BlockDriverState *bs, uint64_t l2_entry,
             int csize;
 
             qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+            qcow2_decompress_cache_invalidate(s->decompress_cache, coffset);
             qcow2_free_clusters(bs, coffset, csize, type);
         }
         break;
@@ -1324,6 +1399,10 @@ int qcow2_update_snapshot_refcount(BlockDriverState *bs,
 
                             qcow2_parse_compressed_l2_entry(bs, entry,
                                                             &coffset, &csize);
+                            if (addend < 0) {
+                                qcow2_decompress_cache_invalidate(
+                                    s->decompress_cache, coffset);
+                            }
                             ret = update_refcount(
                                 bs, coffset, csize,
                                 abs(addend), addend < 0,
@@ -1649,8 +1728,8 @@ fail:
 
 /*
  * Increases the refcount in the given refcount table for the all clusters
- * referenced in the L2 table. While doing so, performs some checks on L2
- * entries.
+ * referenced in the L2 table at @l2_offset, which the caller has read into
+ * @l2_table. While doing so, performs some checks on L2 entries.
  *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
@@ -1658,24 +1737,15 @@ fail:
 static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                               void **refcount_table,
                               int64_t *refcount_table_size, int64_t l2_offset,
+                              uint64_t *l2_table,
                               int flags, BdrvCheckMode fix, bool active)
 {
     BDRVQcow2State *s = bs->opaque;
     uint64_t l2_entry, l2_bitmap;
     uint64_t next_contiguous_offset = 0;
     int i, ret;
-    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
-    g_autofree uint64_t *l2_table = g_malloc(l2_size_bytes);
     bool metadata_overlap;
 
-    /* Read L2 table from disk */
-    ret = bdrv_pread(bs->file, l2_offset, l2_table, l2_size_bytes);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
-        res->check_errors++;
-        return ret;
-    }
-
     /* Do the actual checks */
     for (i = 0; i < s->l2_size; i++) {
         uint64_t coffset;
@@ -1846,6 +1916,77 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
     return 0;
 }
 
+/* Upper limit for the L2 tables that check_refcounts_l1() reads at once */
+#define CHECK_L2_READAHEAD_SIZE (16 * MiB)
+
+typedef struct CheckL2ReadTask {
+    AioTask task;
+    BlockDriverState *bs;
+    int64_t offset;
+    void *buf;
+    int *ret;
+} CheckL2ReadTask;
+
+static int coroutine_fn check_l2_read_task_entry(AioTask *task)
+{
+    CheckL2ReadTask *t = container_of(task, CheckL2ReadTask, task);
+    BDRVQcow2State *s = t->bs->opaque;
+
+    *t->ret = bdrv_co_pread(t->bs->file, t->offset,
+                            s->l2_size * l2_entry_size(s), t->buf, 0);
+    /* Errors are reported in order by check_refcounts_l1() */
+    return 0;
+}
+
+/*
+ * Reads the L2 tables referenced by L1 entries [@start, @end) into @bufs,
+ * one table per entry, and stores the result of each read in @rets.  In
+ * coroutine context, the reads are issued in parallel.
+ */
+static void check_read_l2_tables(BlockDriverState *bs,
+                                 const uint64_t *l1_table, int start, int end,
+                                 uint8_t *bufs, int *rets)
+{
+    BDRVQcow2State *s = bs->opaque;
+    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
+    AioTaskPool *pool = NULL;
+    int i;
+
+    if (qemu_in_coroutine()) {
+        pool = aio_task_pool_new(QCOW2_MAX_WORKERS);
+    }
+
+    for (i = start; i < end; i++) {
+        uint64_t l2_offset = l1_table[i] & L1E_OFFSET_MASK;
+        uint8_t *buf = bufs + (i - start) * l2_size_bytes;
+
+        if (!l1_table[i]) {
+            continue;
+        }
+
+        if (pool) {
+            CheckL2ReadTask *t = g_new(CheckL2ReadTask, 1);
+
+            *t = (CheckL2ReadTask) {
+                .task.func = check_l2_read_task_entry,
+                .bs = bs,
+                .offset = l2_offset,
+                .buf = buf,
+                .ret = &rets[i - start],
+            };
+            aio_task_pool_start_task(pool, &t->task);
+        } else {
+            rets[i - start] = bdrv_pread(bs->file, l2_offset, buf,
+                                         l2_size_bytes);
+        }
+    }
+
+    if (pool) {
+        aio_task_pool_wait_all(pool);
+        aio_task_pool_free(pool);
+    }
+}
+
 /*
  * Increases the refcount for the L1 table, its L2 tables and all referenced
  * clusters in the given refcount table. While doing so, performs some checks
@@ -1863,9 +2004,12 @@ static int check_refcounts_l1(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     size_t l1_size_bytes = l1_size * L1E_SIZE;
+    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
     g_autofree uint64_t *l1_table = NULL;
+    g_autofree uint8_t *l2_tables = NULL;
+    g_autofree int *l2_rets = NULL;
     uint64_t l2_offset;
-    int i, ret;
+    int i, ret, window, window_start = 0, window_end = 0;
 
     if (!l1_size) {
         return 0;
@@ -1896,12 +2040,28 @@ static int check_refcounts_l1(BlockDriverState *bs,
         be64_to_cpus(&l1_table[i]);
     }
 
+    /* L2 tables are read ahead in windows of up to CHECK_L2_READAHEAD_SIZE */
+    window = MIN(l1_size, MAX(1, CHECK_L2_READAHEAD_SIZE / l2_size_bytes));
+    l2_tables = g_try_malloc(window * l2_size_bytes);
+    l2_rets = g_new(int, window);
+    if (l2_tables == NULL) {
+        res->check_errors++;
+        return -ENOMEM;
+    }
+
     /* Do the actual checks */
     for (i = 0; i < l1_size; i++) {
         if (!l1_table[i]) {
             continue;
         }
 
+        if (i >= window_end) {
+            window_start = i;
+            window_end = MIN(l1_size, i + window);
+            check_read_l2_tables(bs, l1_table, window_start, window_end,
+                                 l2_tables, l2_rets);
+        }
+
         if (l1_table[i] & L1E_RESERVED_MASK) {
             fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
                     "%" PRIx64 "\n", l1_table[i]);
@@ -1925,10 +2085,18 @@ static int check_refcounts_l1(BlockDriverState *bs,
             res->corruptions++;
         }
 
+        if (l2_rets[i - window_start] < 0) {
+            fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
+            res->check_errors++;
+            return l2_rets[i - window_start];
+        }
+
         /* Process and check L2 entries */
         ret = check_refcounts_l2(bs, res, refcount_table,
-                                 refcount_table_size, l2_offset, flags,
-                                 fix, active);
+                                 refcount_table_size, l2_offset,
+                                 (uint64_t *)(l2_tables + (i - window_start) *
+                                              l2_size_bytes),
+                                 flags, fix, active);
         if (ret < 0) {
             return ret;
         }
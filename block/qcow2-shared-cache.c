@@ -0,0 +1,271 @@
+/*
+ * L2 table cache for read-only qcow2 images, shared between processes
+ *
+ * Many VMs on a host often use the same read-only backing file.  Their data
+ * is already shared through the host page cache (unless cache.direct=on),
+ * but every process loads and caches the same L2 tables again.  This cache
+ * lives in a file mapped by all processes, typically on tmpfs, so an L2
+ * table only has to be read from the image once per host.
+ *
+ * The file starts with a header that identifies the image, followed by an
+ * array of direct-mapped slots.  Each slot is protected by a sequence lock:
+ * writers claim it by making the sequence odd, readers retry (i.e. fall back
+ * to reading the image) if the sequence changed while they copied the table.
+ * The image must not change while the cache file exists, as nothing checks
+ * cached tables against the image after the header has been validated.  A
+ * process that dies while writing a slot leaves it locked; it is then never
+ * used again until the file is recreated.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include "qapi/error.h"
+#include "qemu/crc32c.h"
+#include "qemu/seqlock.h"
+#include "qcow2.h"
+#include "trace.h"
+
+#define QCOW2_SHARED_CACHE_MAGIC    0x51325343 /* "Q2SC" */
+#define QCOW2_SHARED_CACHE_VERSION  1
+
+typedef struct Qcow2SharedCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t table_size;
+    uint32_t nb_slots;
+    /* Image identity */
+    uint64_t image_size;
+    uint64_t l1_table_offset;
+    uint32_t l1_size;
+    uint32_t l1_crc;
+} Qcow2SharedCacheHeader;
+
+typedef struct Qcow2SharedCacheSlot {
+    QemuSeqLock seq;
+    uint32_t reserved;
+    uint64_t offset;
+} Qcow2SharedCacheSlot;
+
+struct Qcow2SharedCache {
+    int fd;
+    void *map;
+    size_t map_size;
+    Qcow2SharedCacheHeader *header;
+    Qcow2SharedCacheSlot *slots;
+    uint8_t *tables;
+    uint32_t table_size;
+    uint32_t nb_slots;
+};
+
+static size_t shared_cache_tables_offset(uint32_t nb_slots)
+{
+    return ROUND_UP(sizeof(Qcow2SharedCacheHeader) +
+                    nb_slots * sizeof(Qcow2SharedCacheSlot),
+                    qemu_real_host_page_size);
+}
+
+static size_t shared_cache_file_size(uint32_t table_size, uint32_t nb_slots)
+{
+    return shared_cache_tables_offset(nb_slots) +
+           (size_t)nb_slots * table_size;
+}
+
+static int shared_cache_lock(int fd, short type)
+{
+    struct flock fl = {
+        .l_whence = SEEK_SET,
+        .l_start  = 0,
+        .l_len    = 1,
+        .l_type   = type,
+    };
+    int ret;
+
+    do {
+        ret = fcntl(fd, F_SETLKW, &fl);
+    } while (ret == -1 && errno == EINTR);
+    return ret == -1 ? -errno : 0;
+}
+
+/*
+ * Opens (and creates, if it does not exist yet) the shared L2 cache file
+ * at @path for @bs, which must be a read-only image whose L1 table has been
+ * loaded.  @table_size is the size of the tables in the L2 cache of @bs, and
+ * @size is the size of the new cache if the file needs to be created.
+ */
+Qcow2SharedCache *qcow2_shared_cache_open(BlockDriverState *bs,
+                                          const char *path,
+                                          uint32_t table_size, uint64_t size,
+                                          Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2SharedCache *sc;
+    Qcow2SharedCacheHeader key = {
+        .magic = QCOW2_SHARED_CACHE_MAGIC,
+        .version = QCOW2_SHARED_CACHE_VERSION,
+        .table_size = table_size,
+        .image_size = bs->total_sectors * BDRV_SECTOR_SIZE,
+        .l1_table_offset = s->l1_table_offset,
+        .l1_size = s->l1_size,
+        .l1_crc = crc32c(0xffffffff, (uint8_t *)s->l1_table,
+                         s->l1_size * L1E_SIZE),
+    };
+    Qcow2SharedCacheHeader hdr;
+    struct stat st;
+    int fd, ret;
+
+    fd = qemu_create(path, O_RDWR, 0600, errp);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    /* Only one process initializes the file */
+    ret = shared_cache_lock(fd, F_WRLCK);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not lock shared L2 cache '%s'",
+                         path);
+        goto fail;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        error_setg_errno(errp, errno, "Could not stat shared L2 cache '%s'",
+                         path);
+        goto fail;
+    }
+
+    if (st.st_size == 0) {
+        key.nb_slots = MIN(size / table_size, UINT32_MAX);
+        if (key.nb_slots == 0) {
+            error_setg(errp, "Shared L2 cache size must be at least %" PRIu32
+                       " bytes", table_size);
+            goto fail;
+        }
+        if (ftruncate(fd, shared_cache_file_size(table_size,
+                                                 key.nb_slots)) < 0) {
+            error_setg_errno(errp, errno, "Could not resize shared L2 cache "
+                             "'%s'", path);
+            goto fail;
+        }
+        /* The file is zeroed, so all slots start out empty */
+        if (pwrite(fd, &key, sizeof(key), 0) != sizeof(key)) {
+            error_setg_errno(errp, errno, "Could not initialize shared L2 "
+                             "cache '%s'", path);
+            goto fail;
+        }
+        hdr = key;
+    } else {
+        if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+            error_setg(errp, "Could not read shared L2 cache header of '%s'",
+                       path);
+            goto fail;
+        }
+        key.nb_slots = hdr.nb_slots;
+        if (memcmp(&hdr, &key, sizeof(key))) {
+            error_setg(errp, "Shared L2 cache '%s' belongs to a different "
+                       "image or uses a different L2 cache entry size", path);
+            goto fail;
+        }
+        if (hdr.nb_slots == 0 ||
+            st.st_size < shared_cache_file_size(table_size, hdr.nb_slots)) {
+            error_setg(errp, "Shared L2 cache '%s' is truncated", path);
+            goto fail;
+        }
+    }
+
+    shared_cache_lock(fd, F_UNLCK);
+
+    sc = g_new0(Qcow2SharedCache, 1);
+    sc->fd = fd;
+    sc->table_size = table_size;
+    sc->nb_slots = hdr.nb_slots;
+    sc->map_size = shared_cache_file_size(table_size, hdr.nb_slots);
+    sc->map = mmap(NULL, sc->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (sc->map == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Could not map shared L2 cache '%s'",
+                         path);
+        close(fd);
+        g_free(sc);
+        return NULL;
+    }
+    sc->header = sc->map;
+    sc->slots = sc->map + sizeof(Qcow2SharedCacheHeader);
+    sc->tables = sc->map + shared_cache_tables_offset(hdr.nb_slots);
+
+    trace_qcow2_shared_cache_open(bs, path, sc->nb_slots);
+    return sc;
+
+fail:
+    close(fd);
+    return NULL;
+}
+
+void qcow2_shared_cache_close(Qcow2SharedCache *sc)
+{
+    if (!sc) {
+        return;
+    }
+
+    munmap(sc->map, sc->map_size);
+    close(sc->fd);
+    g_free(sc);
+}
+
+static Qcow2SharedCacheSlot *shared_cache_slot(Qcow2SharedCache *sc,
+                                               uint64_t offset,
+                                               uint8_t **table)
+{
+    uint32_t i = (offset / sc->table_size) % sc->nb_slots;
+
+    *table = sc->tables + (size_t)i * sc->table_size;
+    return &sc->slots[i];
+}
+
+/*
+ * Copies the table at image offset @offset into @buf.  Returns false if it
+ * is not in the cache (or is being replaced concurrently).
+ */
+bool qcow2_shared_cache_read(Qcow2SharedCache *sc, uint64_t offset, void *buf)
+{
+    Qcow2SharedCacheSlot *slot;
+    uint8_t *table;
+    unsigned seq;
+
+    slot = shared_cache_slot(sc, offset, &table);
+    seq = seqlock_read_begin(&slot->seq);
+    if (slot->offset != offset) {
+        return false;
+    }
+    memcpy(buf, table, sc->table_size);
+
+    return !seqlock_read_retry(&slot->seq, seq);
+}
+
+/*
+ * Stores the table at image offset @offset, which has just been read from
+ * the image, in the cache.  If another process is writing the same slot,
+ * the table is simply not cached.
+ */
+void qcow2_shared_cache_write(Qcow2SharedCache *sc, uint64_t offset,
+                              const void *buf)
+{
+    Qcow2SharedCacheSlot *slot;
+    uint8_t *table;
+    unsigned seq;
+
+    slot = shared_cache_slot(sc, offset, &table);
+    seq = qatomic_read(&slot->seq.sequence);
+    if ((seq & 1) ||
+        qatomic_cmpxchg(&slot->seq.sequence, seq, seq + 1) != seq) {
+        return;
+    }
+    /* Make the slot odd before updating it, as in seqlock_write_begin() */
+    smp_wmb();
+
+    slot->offset = offset;
+    memcpy(table, buf, sc->table_size);
+
+    seqlock_write_end(&slot->seq);
+}
@@ -605,12 +605,20 @@ static int coroutine_fn qcow2_co_check_locked(BlockDriverState *bs,
                                               BdrvCheckResult *result,
                                               BdrvCheckMode fix)
 {
+    BDRVQcow2State *s = bs->opaque;
     BdrvCheckResult snapshot_res = {};
     BdrvCheckResult refcount_res = {};
     int ret;
 
     memset(result, 0, sizeof(*result));
 
+    /* Pooled clusters are not referenced yet and would show up as leaks */
+    qcow2_alloc_pool_release(bs);
+    if (fix) {
+        /* Repairing may free compressed clusters behind our back */
+        qcow2_decompress_cache_empty(s->decompress_cache);
+    }
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -697,6 +705,10 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_ALLOC_POOL_SIZE,
+    QCOW2_OPT_DECOMPRESS_CACHE_SIZE,
+    QCOW2_OPT_SHARED_L2_CACHE,
+    QCOW2_OPT_SHARED_L2_CACHE_SIZE,
     NULL
 };
 
@@ -808,6 +820,29 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_ALLOC_POOL_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Size of the pool of pre-allocated data clusters "
+                    "(0 = disabled)",
+        },
+        {
+            .name = QCOW2_OPT_DECOMPRESS_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Maximum size of the cache of decompressed clusters "
+                    "(0 = disabled)",
+        },
+        {
+            .name = QCOW2_OPT_SHARED_L2_CACHE,
+            .type = QEMU_OPT_STRING,
+            .help = "File for an L2 table cache shared with other processes "
+                    "while the image is read-only",
+        },
+        {
+            .name = QCOW2_OPT_SHARED_L2_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Size of the shared L2 table cache when it is created",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -969,6 +1004,9 @@ typedef struct Qcow2ReopenState {
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     uint64_t cache_clean_interval;
+    uint64_t alloc_pool_size;
+    uint64_t decompress_cache_size;
+    Qcow2SharedCache *shared_l2_cache;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -980,6 +1018,7 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
     BDRVQcow2State *s = bs->opaque;
     QemuOpts *opts = NULL;
     const char *opt_overlap_check, *opt_overlap_check_template;
+    const char *shared_l2_cache_path;
     int overlap_check_template = 0;
     uint64_t l2_cache_size, l2_cache_entry_size, refcount_cache_size;
     int i;
@@ -1023,6 +1062,9 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
         goto fail;
     }
 
+    /* Return unused pooled clusters before the refcounts are flushed */
+    qcow2_alloc_pool_release(bs);
+
     /* alloc new L2 table/refcount block cache, flush old one */
     if (s->l2_table_cache) {
         ret = qcow2_cache_flush(bs, s->l2_table_cache);
@@ -1070,6 +1112,41 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
         goto fail;
     }
 
+    r->alloc_pool_size = qemu_opt_get_size(opts, QCOW2_OPT_ALLOC_POOL_SIZE, 0);
+    if (r->alloc_pool_size > QCOW2_MAX_ALLOC_POOL_SIZE) {
+        error_setg(errp, "Allocation pool size must not exceed %" PRId64
+                   " MB", QCOW2_MAX_ALLOC_POOL_SIZE / MiB);
+        ret = -EINVAL;
+        goto fail;
+    }
+    r->alloc_pool_size = QEMU_ALIGN_DOWN(r->alloc_pool_size, s->cluster_size);
+
+    r->decompress_cache_size =
+        qemu_opt_get_size(opts, QCOW2_OPT_DECOMPRESS_CACHE_SIZE, 0);
+
+    /* The shared L2 cache is only used while the image is read-only */
+    shared_l2_cache_path = qemu_opt_get(opts, QCOW2_OPT_SHARED_L2_CACHE);
+#ifndef CONFIG_POSIX
+    if (shared_l2_cache_path) {
+        error_setg(errp, QCOW2_OPT_SHARED_L2_CACHE
+                   " not supported on this host");
+        ret = -EINVAL;
+        goto fail;
+    }
+#else
+    if (shared_l2_cache_path && !(flags & BDRV_O_RDWR)) {
+        r->shared_l2_cache = qcow2_shared_cache_open(
+            bs, shared_l2_cache_path, l2_cache_entry_size,
+            qemu_opt_get_size(opts, QCOW2_OPT_SHARED_L2_CACHE_SIZE,
+                              DEFAULT_SHARED_L2_CACHE_SIZE),
+            errp);
+        if (!r->shared_l2_cache) {
+            ret = -EINVAL;
+            goto fail;
+        }
+    }
+#endif
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1225,6 +1302,19 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    s->alloc_pool_size = r->alloc_pool_size;
+
+    if (s->decompress_cache_size != r->decompress_cache_size) {
+        qcow2_decompress_cache_destroy(s->decompress_cache);
+        s->decompress_cache_size = r->decompress_cache_size;
+        s->decompress_cache =
+            qcow2_decompress_cache_create(s->cluster_size,
+                                          s->decompress_cache_size);
+    }
+
+    qcow2_shared_cache_close(s->shared_l2_cache);
+    s->shared_l2_cache = r->shared_l2_cache;
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1238,6 +1328,7 @@ static void qcow2_update_options_abort(BlockDriverState *bs,
     if (r->refcount_block_cache) {
         qcow2_cache_destroy(r->refcount_block_cache);
     }
+    qcow2_shared_cache_close(r->shared_l2_cache);
     qapi_free_QCryptoBlockOpenOptions(r->crypto_opts);
 }
 
@@ -1833,6 +1924,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
+    qemu_co_queue_init(&s->compress_order_queue);
 
     return ret;
 
@@ -1856,6 +1948,10 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
     if (s->refcount_block_cache) {
         qcow2_cache_destroy(s->refcount_block_cache);
     }
+    qcow2_decompress_cache_destroy(s->decompress_cache);
+    s->decompress_cache = NULL;
+    qcow2_shared_cache_close(s->shared_l2_cache);
+    s->shared_l2_cache = NULL;
     qcrypto_block_free(s->crypto);
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     return ret;
@@ -2081,17 +2177,26 @@ static int coroutine_fn qcow2_co_block_status(BlockDriverState *bs,
     QCow2SubclusterType type;
     int ret, status = 0;
 
-    qemu_co_mutex_lock(&s->lock);
-
-    if (!s->metadata_preallocation_checked) {
-        ret = qcow2_detect_metadata_preallocation(bs);
-        s->metadata_preallocation = (ret == 1);
-        s->metadata_preallocation_checked = true;
+    bytes = MIN(INT_MAX, count);
+    ret = -EAGAIN;
+    if (s->metadata_preallocation_checked) {
+        ret = qcow2_try_get_host_offset(bs, offset, &bytes, &host_offset,
+                                        &type);
     }
 
-    bytes = MIN(INT_MAX, count);
-    ret = qcow2_get_host_offset(bs, offset, &bytes, &host_offset, &type);
-    qemu_co_mutex_unlock(&s->lock);
+    if (ret == -EAGAIN) {
+        qemu_co_mutex_lock(&s->lock);
+
+        if (!s->metadata_preallocation_checked) {
+            ret = qcow2_detect_metadata_preallocation(bs);
+            s->metadata_preallocation = (ret == 1);
+            s->metadata_preallocation_checked = true;
+        }
+
+        bytes = MIN(INT_MAX, count);
+        ret = qcow2_get_host_offset(bs, offset, &bytes, &host_offset, &type);
+        qemu_co_mutex_unlock(&s->lock);
+    }
     if (ret < 0) {
         return ret;
     }
@@ -2330,10 +2435,15 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
                             QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size);
         }
 
-        qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
-                                    &host_offset, &type);
-        qemu_co_mutex_unlock(&s->lock);
+        /* Allocated clusters with a cached L2 slice need no s->lock */
+        ret = qcow2_try_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+        if (ret == -EAGAIN) {
+            qemu_co_mutex_lock(&s->lock);
+            ret = qcow2_get_host_offset(bs, offset, &cur_bytes,
+                                        &host_offset, &type);
+            qemu_co_mutex_unlock(&s->lock);
+        }
         if (ret < 0) {
             goto out;
         }
@@ -2692,6 +2802,8 @@ static int qcow2_inactivate(BlockDriverState *bs)
                           bdrv_get_device_or_node_name(bs));
     }
 
+    qcow2_alloc_pool_release(bs);
+
     ret = qcow2_cache_flush(bs, s->l2_table_cache);
     if (ret) {
         result = ret;
@@ -2727,6 +2839,10 @@ static void qcow2_close(BlockDriverState *bs)
     cache_clean_timer_del(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
+    qcow2_decompress_cache_destroy(s->decompress_cache);
+    s->decompress_cache = NULL;
+    qcow2_shared_cache_close(s->shared_l2_cache);
+    s->shared_l2_cache = NULL;
 
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
@@ -4201,6 +4317,8 @@ static int coroutine_fn qcow2_co_truncate(BlockDriverState *bs, int64_t offset,
 
     qemu_co_mutex_lock(&s->lock);
 
+    qcow2_alloc_pool_release(bs);
+
     /*
      * Even though we store snapshot size for all images, it was not
      * required until v3, so it is not safe to proceed for v2.
@@ -4551,6 +4669,22 @@ fail:
     return ret;
 }
 
+/* Must be called with s->lock held */
+static void coroutine_fn qcow2_compress_wait_turn(BDRVQcow2State *s,
+                                                  uint64_t ticket)
+{
+    while (s->compress_ticket_done != ticket) {
+        qemu_co_queue_wait(&s->compress_order_queue, &s->lock);
+    }
+}
+
+/* Must be called with s->lock held */
+static void coroutine_fn qcow2_compress_end_turn(BDRVQcow2State *s)
+{
+    s->compress_ticket_done++;
+    qemu_co_queue_restart_all(&s->compress_order_queue);
+}
+
 static coroutine_fn int
 qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
                                  uint64_t offset, uint64_t bytes,
@@ -4561,6 +4695,7 @@ qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
     ssize_t out_len;
     uint8_t *buf, *out_buf;
     uint64_t cluster_offset;
+    uint64_t ticket = s->compress_ticket_next++;
 
     assert(bytes == s->cluster_size || (bytes < s->cluster_size &&
            (offset + bytes == bs->total_sectors << BDRV_SECTOR_BITS)));
@@ -4576,21 +4711,28 @@ qcow2_co_pwritev_compressed_task(BlockDriverState *bs,
 
     out_len = qcow2_co_compress(bs, out_buf, s->cluster_size - 1,
                                 buf, s->cluster_size);
-    if (out_len == -ENOMEM) {
-        /* could not compress: write normal cluster */
-        ret = qcow2_co_pwritev_part(bs, offset, bytes, qiov, qiov_offset, 0);
-        if (ret < 0) {
-            goto fail;
+
+    qemu_co_mutex_lock(&s->lock);
+    qcow2_compress_wait_turn(s, ticket);
+    if (out_len < 0) {
+        qcow2_compress_end_turn(s);
+        qemu_co_mutex_unlock(&s->lock);
+        if (out_len == -ENOMEM) {
+            /* could not compress: write normal cluster */
+            ret = qcow2_co_pwritev_part(bs, offset, bytes, qiov, qiov_offset,
+                                        0);
+            if (ret < 0) {
+                goto fail;
+            }
+            goto success;
         }
-        goto success;
-    } else if (out_len < 0) {
         ret = -EINVAL;
         goto fail;
     }
 
-    qemu_co_mutex_lock(&s->lock);
     ret = qcow2_alloc_compressed_cluster_offset(bs, offset, out_len,
                                                 &cluster_offset);
+    qcow2_compress_end_turn(s);
     if (ret < 0) {
         qemu_co_mutex_unlock(&s->lock);
         goto fail;
@@ -4702,12 +4844,20 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     int ret = 0, csize;
-    uint64_t coffset;
+    uint64_t coffset, generation = 0;
     uint8_t *buf, *out_buf;
     int offset_in_cluster = offset_into_cluster(s, offset);
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
+    if (s->decompress_cache &&
+        qcow2_decompress_cache_read(s->decompress_cache, coffset,
+                                    offset_in_cluster, bytes,
+                                    qiov, qiov_offset, &generation))
+    {
+        return 0;
+    }
+
     buf = g_try_malloc(csize);
     if (!buf) {
         return -ENOMEM;
@@ -4728,6 +4878,12 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 
     qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
 
+    if (s->decompress_cache) {
+        qcow2_decompress_cache_insert(s->decompress_cache, coffset, out_buf,
+                                      generation);
+        out_buf = NULL;
+    }
+
 fail:
     qemu_vfree(out_buf);
     g_free(buf);
@@ -4759,6 +4915,8 @@ static int make_completely_empty(BlockDriverState *bs)
         goto fail;
     }
 
+    qcow2_decompress_cache_empty(s->decompress_cache);
+
     /* Refcounts will be broken utterly */
     ret = qcow2_mark_dirty(bs);
     if (ret < 0) {
@@ -4893,6 +5051,8 @@ static int qcow2_make_empty(BlockDriverState *bs)
     int step = QEMU_ALIGN_DOWN(INT_MAX, s->cluster_size);
     int l1_clusters, ret = 0;
 
+    qcow2_alloc_pool_release(bs);
+
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
@@ -5116,6 +5276,7 @@ static int qcow2_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     bdi->cluster_size = s->cluster_size;
     bdi->vm_state_offset = qcow2_vm_state_offset(s);
     bdi->is_dirty = s->incompatible_features & QCOW2_INCOMPAT_DIRTY;
+    bdi->ordered_compressed_writes = true;
     return 0;
 }
 
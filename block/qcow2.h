@@ -128,6 +128,10 @@
 
 #define DEFAULT_CLUSTER_SIZE 65536
 
+#define DEFAULT_SHARED_L2_CACHE_SIZE (32 * MiB)
+
+#define QCOW2_MAX_ALLOC_POOL_SIZE (1 * GiB)
+
 #define QCOW2_OPT_DATA_FILE "data-file"
 #define QCOW2_OPT_LAZY_REFCOUNTS "lazy-refcounts"
 #define QCOW2_OPT_DISCARD_REQUEST "pass-discard-request"
@@ -149,6 +153,10 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_ALLOC_POOL_SIZE "alloc-pool-size"
+#define QCOW2_OPT_DECOMPRESS_CACHE_SIZE "decompress-cache-size"
+#define QCOW2_OPT_SHARED_L2_CACHE "shared-l2-cache"
+#define QCOW2_OPT_SHARED_L2_CACHE_SIZE "shared-l2-cache-size"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -230,6 +238,9 @@ typedef struct QCowSnapshot {
 struct Qcow2Cache;
 typedef struct Qcow2Cache Qcow2Cache;
 
+typedef struct Qcow2DecompressCache Qcow2DecompressCache;
+typedef struct Qcow2SharedCache Qcow2SharedCache;
+
 typedef struct Qcow2CryptoHeaderExtension {
     uint64_t offset;
     uint64_t length;
@@ -344,9 +355,21 @@ typedef struct BDRVQcow2State {
 
     Qcow2Cache *l2_table_cache;
     Qcow2Cache *refcount_block_cache;
+    Qcow2DecompressCache *decompress_cache;
+    uint64_t decompress_cache_size;
+    Qcow2SharedCache *shared_l2_cache;
     QEMUTimer *cache_clean_timer;
     unsigned cache_clean_interval;
 
+    /*
+     * Data clusters that have been allocated in the refcount table, but are
+     * not referenced yet.  Allocating writes take clusters from here so that
+     * only one in alloc_pool_size / cluster_size of them updates refcounts.
+     */
+    uint64_t alloc_pool_size;
+    uint64_t alloc_pool_offset;
+    uint64_t alloc_pool_clusters;
+
     QLIST_HEAD(, QCowL2Meta) cluster_allocs;
 
     uint64_t *refcount_table;
@@ -408,6 +431,15 @@ typedef struct BDRVQcow2State {
     CoQueue thread_task_queue;
     int nb_threads;
 
+    /*
+     * Compressed writes take a ticket when they are submitted and allocate
+     * their clusters in ticket order, so that the image layout does not
+     * depend on the order in which compression finishes.  Protected by lock.
+     */
+    uint64_t compress_ticket_next;
+    uint64_t compress_ticket_done;
+    CoQueue compress_order_queue;
+
     BdrvChild *data_file;
 
     bool metadata_preallocation_checked;
@@ -865,6 +897,9 @@ int64_t qcow2_alloc_clusters(BlockDriverState *bs, uint64_t size);
 int64_t qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                                 int64_t nb_clusters);
 int64_t qcow2_alloc_bytes(BlockDriverState *bs, int size);
+int64_t qcow2_alloc_pool_take(BlockDriverState *bs, uint64_t host_offset,
+                              uint64_t *nb_clusters);
+void qcow2_alloc_pool_release(BlockDriverState *bs);
 void qcow2_free_clusters(BlockDriverState *bs,
                           int64_t offset, int64_t size,
                           enum qcow2_discard_type type);
@@ -908,6 +943,9 @@ int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
 int qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                           unsigned int *bytes, uint64_t *host_offset,
                           QCow2SubclusterType *subcluster_type);
+int qcow2_try_get_host_offset(BlockDriverState *bs, uint64_t offset,
+                              unsigned int *bytes, uint64_t *host_offset,
+                              QCow2SubclusterType *subcluster_type);
 int qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
                             unsigned int *bytes, uint64_t *host_offset,
                             QCowL2Meta **m);
@@ -973,10 +1011,53 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
+int qcow2_cache_try_get(Qcow2Cache *c, uint64_t offset, void **table);
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
 
+/* qcow2-decompress-cache.c functions */
+Qcow2DecompressCache *qcow2_decompress_cache_create(size_t cluster_size,
+                                                    uint64_t size);
+void qcow2_decompress_cache_destroy(Qcow2DecompressCache *c);
+bool qcow2_decompress_cache_read(Qcow2DecompressCache *c, uint64_t coffset,
+                                 size_t offset_in_cluster, size_t bytes,
+                                 QEMUIOVector *qiov, size_t qiov_offset,
+                                 uint64_t *generation);
+void qcow2_decompress_cache_insert(Qcow2DecompressCache *c, uint64_t coffset,
+                                   void *data, uint64_t generation);
+void qcow2_decompress_cache_invalidate(Qcow2DecompressCache *c,
+                                       uint64_t coffset);
+void qcow2_decompress_cache_empty(Qcow2DecompressCache *c);
+
+/* qcow2-shared-cache.c functions */
+#ifdef CONFIG_POSIX
+Qcow2SharedCache *qcow2_shared_cache_open(BlockDriverState *bs,
+                                          const char *path,
+                                          uint32_t table_size, uint64_t size,
+                                          Error **errp);
+void qcow2_shared_cache_close(Qcow2SharedCache *sc);
+bool qcow2_shared_cache_read(Qcow2SharedCache *sc, uint64_t offset, void *buf);
+void qcow2_shared_cache_write(Qcow2SharedCache *sc, uint64_t offset,
+                              const void *buf);
+#else
+/* Never opened, the option is rejected on these hosts */
+static inline void qcow2_shared_cache_close(Qcow2SharedCache *sc)
+{
+}
+
+static inline bool qcow2_shared_cache_read(Qcow2SharedCache *sc,
+                                           uint64_t offset, void *buf)
+{
+    return false;
+}
+
+static inline void qcow2_shared_cache_write(Qcow2SharedCache *sc,
+                                            uint64_t offset, const void *buf)
+{
+}
+#endif
+
 /* qcow2-bitmap.c functions */
 int qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
                                   void **refcount_table,
@@ -19,6 +19,7 @@
 #include "qemu/option.h"
 #include "block/block_int.h"
 #include "block/coroutines.h"
+#include "block/hedged-read.h"
 #include "block/qdict.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-block.h"
@@ -36,6 +37,13 @@
 #define QUORUM_OPT_BLKVERIFY      "blkverify"
 #define QUORUM_OPT_REWRITE        "rewrite-corrupted"
 #define QUORUM_OPT_READ_PATTERN   "read-pattern"
+#define QUORUM_OPT_HEDGE_THRESHOLD "hedge-threshold"
+
+/*
+ * With read-pattern=latency, a child whose read failed is only used as a
+ * last resort for this long
+ */
+#define QUORUM_ERROR_PENALTY_NS   NANOSECONDS_PER_SECOND
 
 /* This union holds a vote hash value */
 typedef union QuorumVoteValue {
@@ -68,6 +76,12 @@ typedef struct QuorumVotes {
     bool (*compare)(QuorumVoteValue *a, QuorumVoteValue *b);
 } QuorumVotes;
 
+/* Read statistics of a child, used with read-pattern=latency */
+typedef struct QuorumChildStats {
+    int64_t latency_ns;    /* moving average of successful reads */
+    int64_t error_time;    /* QEMU_CLOCK_REALTIME of the last failed read */
+} QuorumChildStats;
+
 /* the following structure holds the state of one quorum instance */
 typedef struct BDRVQuorumState {
     BdrvChild **children;  /* children BlockDriverStates */
@@ -91,6 +105,8 @@ typedef struct BDRVQuorumState {
                             */
 
     QuorumReadPattern read_pattern;
+    QuorumChildStats *child_stats; /* indexed like children */
+    int64_t hedge_threshold_ns;    /* 0 if reads are never hedged */
 } BDRVQuorumState;
 
 typedef struct QuorumAIOCB QuorumAIOCB;
@@ -663,6 +679,108 @@ static int read_fifo_child(QuorumAIOCB *acb)
     return ret;
 }
 
+static bool quorum_child_healthy(QuorumChildStats *stats, int64_t now)
+{
+    return !stats->error_time ||
+           now - stats->error_time >= QUORUM_ERROR_PENALTY_NS;
+}
+
+static void read_latency_child_done(BlockDriverState *bs, BdrvChild *child,
+                                    int64_t offset, int64_t bytes, int ret,
+                                    int64_t latency_ns)
+{
+    BDRVQuorumState *s = bs->opaque;
+    QuorumChildStats *stats;
+    int i;
+
+    /* Draining waits for child reads, so the child is still there */
+    for (i = 0; s->children[i] != child; i++) {
+        assert(i < s->num_children - 1);
+    }
+    stats = &s->child_stats[i];
+
+    if (ret == 0) {
+        /* Exponentially weighted moving average with alpha = 1/8 */
+        stats->latency_ns = stats->latency_ns ?
+            stats->latency_ns + (latency_ns - stats->latency_ns) / 8 :
+            latency_ns;
+    } else {
+        stats->error_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        quorum_report_bad(QUORUM_OP_TYPE_READ, offset, bytes,
+                          child->bs->node_name, ret);
+    }
+}
+
+/*
+ * Starts a read from the healthy child with the lowest average latency that
+ * has not been tried yet.  Returns false if all children have been tried.
+ */
+static bool coroutine_fn quorum_latency_read_start(BlockDriverState *bs,
+                                                   HedgedRead *r, bool *tried)
+{
+    BDRVQuorumState *s = bs->opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int i, best = -1;
+
+    for (i = 0; i < s->num_children; i++) {
+        QuorumChildStats *stats = &s->child_stats[i];
+
+        if (tried[i]) {
+            continue;
+        }
+        if (best >= 0) {
+            QuorumChildStats *best_stats = &s->child_stats[best];
+            bool healthy = quorum_child_healthy(stats, now);
+
+            if (healthy != quorum_child_healthy(best_stats, now)) {
+                if (!healthy) {
+                    continue;
+                }
+            } else if (stats->latency_ns >= best_stats->latency_ns) {
+                continue;
+            }
+        }
+        best = i;
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    tried[best] = true;
+    hedged_read_start(r, s->children[best]);
+    return true;
+}
+
+static int coroutine_fn read_latency_children(QuorumAIOCB *acb)
+{
+    BDRVQuorumState *s = acb->bs->opaque;
+    g_autofree bool *tried = g_new0(bool, s->num_children);
+    HedgedRead *r;
+    bool hedged = false;
+
+    r = hedged_read_new(acb->bs, acb->offset, acb->bytes, acb->flags,
+                        read_latency_child_done);
+    while (!hedged_read_succeeded(r)) {
+        if (hedged_read_in_flight(r) == 0) {
+            /* Nothing started yet, or all reads so far failed */
+            if (!quorum_latency_read_start(acb->bs, r, tried)) {
+                break;
+            }
+        } else if (s->hedge_threshold_ns && !hedged) {
+            hedged_read_wait(r, s->hedge_threshold_ns);
+            if (!hedged_read_succeeded(r) && hedged_read_in_flight(r)) {
+                /* Too slow, try another child and use whichever is first */
+                hedged = true;
+                quorum_latency_read_start(acb->bs, r, tried);
+            }
+        } else {
+            hedged_read_wait(r, 0);
+        }
+    }
+
+    return hedged_read_finish(r, acb->qiov, 0);
+}
+
 static int quorum_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                             QEMUIOVector *qiov, BdrvRequestFlags flags)
 {
@@ -673,10 +791,16 @@ static int quorum_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     acb->is_read = true;
     acb->children_read = 0;
 
-    if (s->read_pattern == QUORUM_READ_PATTERN_QUORUM) {
+    switch (s->read_pattern) {
+    case QUORUM_READ_PATTERN_QUORUM:
         ret = read_quorum_children(acb);
-    } else {
+        break;
+    case QUORUM_READ_PATTERN_LATENCY:
+        ret = read_latency_children(acb);
+        break;
+    default:
         ret = read_fifo_child(acb);
+        break;
     }
     quorum_aio_finalize(acb);
 
@@ -905,7 +1029,13 @@ static QemuOptsList quorum_runtime_opts = {
         {
             .name = QUORUM_OPT_READ_PATTERN,
             .type = QEMU_OPT_STRING,
-            .help = "Allowed pattern: quorum, fifo. Quorum is default",
+            .help = "Allowed pattern: quorum, fifo, latency. Quorum is default",
+        },
+        {
+            .name = QUORUM_OPT_HEDGE_THRESHOLD,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Time in ms after which a latency read is also sent "
+                    "to another child",
         },
         { /* end of list */ }
     },
@@ -972,11 +1102,27 @@ static int quorum_open(BlockDriverState *bs, QDict *options, int flags,
                               -EINVAL, NULL);
     }
     if (ret < 0) {
-        error_setg(errp, "Please set read-pattern as fifo or quorum");
+        error_setg(errp, "Please set read-pattern as fifo, quorum or latency");
         goto exit;
     }
     s->read_pattern = ret;
 
+    s->hedge_threshold_ns = qemu_opt_get_number(opts,
+                                                QUORUM_OPT_HEDGE_THRESHOLD, 0);
+    if (s->hedge_threshold_ns &&
+        s->read_pattern != QUORUM_READ_PATTERN_LATENCY) {
+        error_setg(errp, "hedge-threshold requires read-pattern=latency");
+        ret = -EINVAL;
+        goto exit;
+    }
+    if (s->hedge_threshold_ns < 0 ||
+        s->hedge_threshold_ns > INT64_MAX / SCALE_MS) {
+        error_setg(errp, "hedge-threshold is out of range");
+        ret = -EINVAL;
+        goto exit;
+    }
+    s->hedge_threshold_ns *= SCALE_MS;
+
     if (s->read_pattern == QUORUM_READ_PATTERN_QUORUM) {
         s->is_blkverify = qemu_opt_get_bool(opts, QUORUM_OPT_BLKVERIFY, false);
         if (s->is_blkverify && (s->num_children != 2 || s->threshold != 2)) {
@@ -998,6 +1144,7 @@ static int quorum_open(BlockDriverState *bs, QDict *options, int flags,
 
     /* allocate the children array */
     s->children = g_new0(BdrvChild *, s->num_children);
+    s->child_stats = g_new0(QuorumChildStats, s->num_children);
     opened = g_new0(bool, s->num_children);
 
     for (i = 0; i < s->num_children; i++) {
@@ -1032,6 +1179,7 @@ close_exit:
         bdrv_unref_child(bs, s->children[i]);
     }
     g_free(s->children);
+    g_free(s->child_stats);
     g_free(opened);
 exit:
     qemu_opts_del(opts);
@@ -1048,6 +1196,7 @@ static void quorum_close(BlockDriverState *bs)
     }
 
     g_free(s->children);
+    g_free(s->child_stats);
 }
 
 static void quorum_add_child(BlockDriverState *bs, BlockDriverState *child_bs,
@@ -1089,6 +1238,9 @@ static void quorum_add_child(BlockDriverState *bs, BlockDriverState *child_bs,
         goto out;
     }
     s->children = g_renew(BdrvChild *, s->children, s->num_children + 1);
+    s->child_stats = g_renew(QuorumChildStats, s->child_stats,
+                             s->num_children + 1);
+    s->child_stats[s->num_children] = (QuorumChildStats) { 0 };
     s->children[s->num_children++] = child;
     quorum_refresh_flags(bs);
 
@@ -1132,7 +1284,11 @@ static void quorum_del_child(BlockDriverState *bs, BdrvChild *child,
     /* We can safely remove this child now */
     memmove(&s->children[i], &s->children[i + 1],
             (s->num_children - i - 1) * sizeof(BdrvChild *));
+    memmove(&s->child_stats[i], &s->child_stats[i + 1],
+            (s->num_children - i - 1) * sizeof(QuorumChildStats));
     s->children = g_renew(BdrvChild *, s->children, --s->num_children);
+    s->child_stats = g_renew(QuorumChildStats, s->child_stats,
+                             s->num_children);
     bdrv_unref_child(bs, child);
 
     quorum_refresh_flags(bs);
@@ -18,6 +18,7 @@
 #include "qemu/error-report.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
+#include "qemu/units.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
 #include "crypto/secret.h"
@@ -59,6 +60,12 @@
 
 #define RBD_MAX_SNAPS 100
 
+/*
+ * qemu_rbd_co_block_status() looks this far ahead of the request, so that the
+ * cached extent also answers the requests that follow it.
+ */
+#define RBD_STATUS_LOOKAHEAD (1 * GiB)
+
 #define RBD_ENCRYPTION_LUKS_HEADER_VERIFICATION_LEN 8
 
 static const char rbd_luks_header_verification[
@@ -88,6 +95,21 @@ typedef struct BDRVRBDState {
     char *namespace;
     uint64_t image_size;
     uint64_t object_size;
+
+    /* Requests in flight, at most queue_depth unless it is 0 */
+    uint32_t queue_depth;
+    uint32_t in_flight;
+    CoQueue queue;
+
+    /*
+     * Last extent found by qemu_rbd_co_block_status(), valid if status_bytes
+     * is not 0.  status_gen changes whenever the allocation status may have
+     * changed, so that lookups that raced with a change are not cached.
+     */
+    uint64_t status_offset;
+    uint64_t status_bytes;
+    bool status_exists;
+    uint64_t status_gen;
 } BDRVRBDState;
 
 typedef struct RBDTask {
@@ -958,6 +980,8 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
 
     s->snap = g_strdup(opts->snapshot);
     s->image_name = g_strdup(opts->image);
+    s->queue_depth = opts->has_queue_depth ? opts->queue_depth : 0;
+    qemu_co_queue_init(&s->queue);
 
     /* rbd_open is always r/w */
     r = rbd_open(s->io_ctx, s->image_name, &s->image, s->snap);
@@ -1053,12 +1077,20 @@ static void qemu_rbd_close(BlockDriverState *bs)
     rados_shutdown(s->cluster);
 }
 
+/* Forget the cached allocation status */
+static void qemu_rbd_status_invalidate(BDRVRBDState *s)
+{
+    s->status_bytes = 0;
+    s->status_gen++;
+}
+
 /* Resize the RBD image and update the 'image_size' with the current size */
 static int qemu_rbd_resize(BlockDriverState *bs, uint64_t size)
 {
     BDRVRBDState *s = bs->opaque;
     int r;
 
+    qemu_rbd_status_invalidate(s);
     r = rbd_resize(s->image, size);
     if (r < 0) {
         return r;
@@ -1093,12 +1125,12 @@ static void qemu_rbd_completion_cb(rbd_completion_t c, RBDTask *task)
                             qemu_rbd_finish_bh, task);
 }
 
-static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
-                                          uint64_t offset,
-                                          uint64_t bytes,
-                                          QEMUIOVector *qiov,
-                                          int flags,
-                                          RBDAIOCmd cmd)
+static int coroutine_fn qemu_rbd_submit_co(BlockDriverState *bs,
+                                           uint64_t offset,
+                                           uint64_t bytes,
+                                           QEMUIOVector *qiov,
+                                           int flags,
+                                           RBDAIOCmd cmd)
 {
     BDRVRBDState *s = bs->opaque;
     RBDTask task = { .bs = bs, .co = qemu_coroutine_self() };
@@ -1169,6 +1201,37 @@ static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
     return 0;
 }
 
+static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
+                                          uint64_t offset,
+                                          uint64_t bytes,
+                                          QEMUIOVector *qiov,
+                                          int flags,
+                                          RBDAIOCmd cmd)
+{
+    BDRVRBDState *s = bs->opaque;
+    bool changes_allocation = cmd == RBD_AIO_WRITE ||
+                              cmd == RBD_AIO_DISCARD ||
+                              cmd == RBD_AIO_WRITE_ZEROES;
+    int r;
+
+    while (s->queue_depth && s->in_flight >= s->queue_depth) {
+        qemu_co_queue_wait(&s->queue, NULL);
+    }
+    s->in_flight++;
+
+    if (changes_allocation) {
+        qemu_rbd_status_invalidate(s);
+    }
+    r = qemu_rbd_submit_co(bs, offset, bytes, qiov, flags, cmd);
+    if (changes_allocation) {
+        qemu_rbd_status_invalidate(s);
+    }
+
+    s->in_flight--;
+    qemu_co_queue_next(&s->queue);
+    return r;
+}
+
 static int
 coroutine_fn qemu_rbd_co_preadv(BlockDriverState *bs, int64_t offset,
                                 int64_t bytes, QEMUIOVector *qiov,
@@ -1320,6 +1383,8 @@ static int coroutine_fn qemu_rbd_co_block_status(BlockDriverState *bs,
     int status, r;
     RBDDiffIterateReq req = { .offs = offset };
     uint64_t features, flags;
+    uint64_t gen = s->status_gen;
+    int64_t len;
 
     assert(offset + bytes <= s->image_size);
 
@@ -1329,6 +1394,15 @@ static int coroutine_fn qemu_rbd_co_block_status(BlockDriverState *bs,
     *file = bs;
     *pnum = bytes;
 
+    if (s->status_bytes && offset >= s->status_offset &&
+        offset - s->status_offset < s->status_bytes) {
+        *pnum = MIN(bytes, s->status_offset + s->status_bytes - offset);
+        if (!s->status_exists) {
+            status = BDRV_BLOCK_ZERO | BDRV_BLOCK_OFFSET_VALID;
+        }
+        return status;
+    }
+
     /* check if RBD image supports fast-diff */
     r = rbd_get_features(s->image, &features);
     if (r < 0) {
@@ -1347,12 +1421,18 @@ static int coroutine_fn qemu_rbd_co_block_status(BlockDriverState *bs,
         return status;
     }
 
-    r = rbd_diff_iterate2(s->image, NULL, offset, bytes, true, true,
+    /*
+     * The walk stops at the first change of allocation status, so looking
+     * past the request costs little and lets a sequential walk, which asks
+     * for the offset just after the extent it was given, hit the cache.
+     */
+    len = MIN(s->image_size - offset, MAX(bytes, RBD_STATUS_LOOKAHEAD));
+    r = rbd_diff_iterate2(s->image, NULL, offset, len, true, true,
                           qemu_rbd_diff_iterate_cb, &req);
     if (r < 0 && r != QEMU_RBD_EXIT_DIFF_ITERATE2) {
         return status;
     }
-    assert(req.bytes <= bytes);
+    assert(req.bytes <= len);
     if (!req.exists) {
         if (r == 0) {
             /*
@@ -1361,12 +1441,18 @@ static int coroutine_fn qemu_rbd_co_block_status(BlockDriverState *bs,
              * invoked at all (req.bytes == 0).
              */
             assert(req.bytes == 0);
-            req.bytes = bytes;
+            req.bytes = len;
         }
         status = BDRV_BLOCK_ZERO | BDRV_BLOCK_OFFSET_VALID;
     }
 
-    *pnum = req.bytes;
+    if (s->status_gen == gen) {
+        s->status_offset = offset;
+        s->status_bytes = req.bytes;
+        s->status_exists = req.exists;
+    }
+
+    *pnum = MIN(bytes, req.bytes);
     return status;
 }
 
@@ -1523,7 +1609,10 @@ static void coroutine_fn qemu_rbd_co_invalidate_cache(BlockDriverState *bs,
                                                       Error **errp)
 {
     BDRVRBDState *s = bs->opaque;
-    int r = rbd_invalidate_cache(s->image);
+    int r;
+
+    qemu_rbd_status_invalidate(s);
+    r = rbd_invalidate_cache(s->image);
     if (r < 0) {
         error_setg_errno(errp, -r, "Failed to invalidate the cache");
     }
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "trace.h"
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
 #include "qapi/error.h"
@@ -29,6 +30,9 @@ enum {
      * that populating contiguous regions of the image is efficient.
      */
     STREAM_CHUNK = 512 * 1024, /* in bytes */
+
+    /* Number of chunks populated in parallel */
+    STREAM_MAX_WORKERS = 8,
 };
 
 typedef struct StreamBlockJob {
@@ -41,8 +45,31 @@ typedef struct StreamBlockJob {
     BlockdevOnError on_error;
     char *backing_file_str;
     bool bs_read_only;
+
+    /*
+     * Chunks that are not counted as progress yet, in offset order.  Only
+     * the chunks up to the first unfinished one are counted, so that the
+     * progress is where an error stopped the job, as with one chunk at a
+     * time.
+     */
+    QSIMPLEQ_HEAD(, StreamChunk) chunks;
+    int err_ret;                /* set when a chunk failed */
 } StreamBlockJob;
 
+typedef struct StreamChunk {
+    int64_t offset;
+    int64_t bytes;
+    bool done;
+    int ret;
+    QSIMPLEQ_ENTRY(StreamChunk) next;
+} StreamChunk;
+
+typedef struct StreamTask {
+    AioTask task;
+    StreamBlockJob *s;
+    StreamChunk *chunk;
+} StreamTask;
+
 static int coroutine_fn stream_populate(BlockBackend *blk,
                                         int64_t offset, uint64_t bytes)
 {
@@ -51,6 +78,60 @@ static int coroutine_fn stream_populate(BlockBackend *blk,
     return blk_co_preadv(blk, offset, bytes, NULL, BDRV_REQ_PREFETCH);
 }
 
+static StreamChunk *stream_add_chunk(StreamBlockJob *s, int64_t offset,
+                                     int64_t bytes)
+{
+    StreamChunk *chunk = g_new0(StreamChunk, 1);
+
+    chunk->offset = offset;
+    chunk->bytes = bytes;
+    QSIMPLEQ_INSERT_TAIL(&s->chunks, chunk, next);
+    return chunk;
+}
+
+static void stream_chunk_done(StreamBlockJob *s, StreamChunk *chunk, int ret)
+{
+    StreamChunk *first;
+
+    chunk->done = true;
+    chunk->ret = ret;
+    if (ret < 0) {
+        s->err_ret = ret;
+    }
+
+    /* Publish progress */
+    while ((first = QSIMPLEQ_FIRST(&s->chunks)) && first->done &&
+           first->ret >= 0) {
+        job_progress_update(&s->common.job, first->bytes);
+        QSIMPLEQ_REMOVE_HEAD(&s->chunks, next);
+        g_free(first);
+    }
+}
+
+/* Drops the chunks left, counting them as progress if @count */
+static void stream_drop_chunks(StreamBlockJob *s, bool count)
+{
+    StreamChunk *chunk;
+
+    while ((chunk = QSIMPLEQ_FIRST(&s->chunks))) {
+        if (count) {
+            job_progress_update(&s->common.job, chunk->bytes);
+        }
+        QSIMPLEQ_REMOVE_HEAD(&s->chunks, next);
+        g_free(chunk);
+    }
+}
+
+static int coroutine_fn stream_task_entry(AioTask *task)
+{
+    StreamTask *t = container_of(task, StreamTask, task);
+
+    stream_chunk_done(t->s, t->chunk,
+                      stream_populate(t->s->blk, t->chunk->offset,
+                                      t->chunk->bytes));
+    return 0;
+}
+
 static int stream_prepare(Job *job)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
@@ -111,6 +192,7 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
     BlockDriverState *unfiltered_bs = bdrv_skip_filters(s->target_bs);
+    AioTaskPool *aio;
     int64_t len;
     int64_t offset = 0;
     uint64_t delay_ns = 0;
@@ -128,18 +210,55 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
     }
     job_progress_set_remaining(&s->common.job, len);
 
-    for ( ; offset < len; offset += n) {
+    aio = aio_task_pool_new(STREAM_MAX_WORKERS);
+
+    for ( ; ; offset += n) {
         bool copy;
         int ret;
 
-        /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+        if (offset >= len) {
+            /* The last chunks may still fail */
+            aio_task_pool_wait_all(aio);
+            if (!s->err_ret) {
+                break;
+            }
+        }
+
+        /*
+         * Note that even when no rate limit is applied we need to yield
+         * here so that bdrv_drain_all() returns.
          */
         job_sleep_ns(&s->common.job, delay_ns);
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
 
+        if (s->err_ret) {
+            BlockErrorAction action;
+            StreamChunk *failed;
+
+            /* All chunks are done, the first one left is the first failure */
+            aio_task_pool_wait_all(aio);
+            failed = QSIMPLEQ_FIRST(&s->chunks);
+            action = block_job_error_action(&s->common, s->on_error, true,
+                                            -failed->ret);
+            if (action == BLOCK_ERROR_ACTION_STOP) {
+                /* Nothing from the failed chunk on is counted yet */
+                offset = failed->offset;
+            } else if (error == 0) {
+                error = failed->ret;
+            }
+            /* Only ignored chunks count as done */
+            stream_drop_chunks(s, action == BLOCK_ERROR_ACTION_IGNORE);
+            s->err_ret = 0;
+            n = 0;
+            delay_ns = 0;
+            if (action == BLOCK_ERROR_ACTION_REPORT) {
+                break;
+            }
+            continue;
+        }
+
         copy = false;
 
         ret = bdrv_is_allocated(unfiltered_bs, offset, STREAM_CHUNK, &n);
@@ -159,33 +278,32 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
             copy = (ret > 0);
         }
         trace_stream_one_iteration(s, offset, n, ret);
-        if (copy) {
-            ret = stream_populate(s->blk, offset, n);
-        }
         if (ret < 0) {
-            BlockErrorAction action =
-                block_job_error_action(&s->common, s->on_error, true, -ret);
-            if (action == BLOCK_ERROR_ACTION_STOP) {
-                n = 0;
-                continue;
-            }
-            if (error == 0) {
-                error = ret;
-            }
-            if (action == BLOCK_ERROR_ACTION_REPORT) {
-                break;
-            }
+            stream_chunk_done(s, stream_add_chunk(s, offset, 0), ret);
+            n = 0;
+            continue;
         }
 
-        /* Publish progress */
-        job_progress_update(&s->common.job, n);
         if (copy) {
+            StreamTask *t = g_new(StreamTask, 1);
+
+            *t = (StreamTask) {
+                .task.func = stream_task_entry,
+                .s = s,
+                .chunk = stream_add_chunk(s, offset, n),
+            };
+            aio_task_pool_start_task(aio, &t->task);
             delay_ns = block_job_ratelimit_get_delay(&s->common, n);
         } else {
+            stream_chunk_done(s, stream_add_chunk(s, offset, n), 0);
             delay_ns = 0;
         }
     }
 
+    aio_task_pool_wait_all(aio);
+    aio_task_pool_free(aio);
+    stream_drop_chunks(s, false);
+
     /* Do not remove the backing file if an error was there but ignored. */
     return error;
 }
@@ -351,6 +469,7 @@ void stream_start(const char *job_id, BlockDriverState *bs,
     s->bs_read_only = bs_read_only;
 
     s->on_error = on_error;
+    QSIMPLEQ_INIT(&s->chunks);
     trace_stream_start(bs, base, s);
     job_start(&s->common.job);
     return;
@@ -35,6 +35,9 @@
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
 
+/* Number of requests that a member may prepay when there is no contention */
+#define THROTTLE_GROUP_CREDIT_REQS 8
+
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 static void timer_cb(ThrottleGroupMember *tgm, bool is_write);
@@ -70,13 +73,20 @@ struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
-    QemuMutex lock; /* This lock protects the following four fields */
+    QemuMutex lock; /* This lock protects the following five fields */
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
     ThrottleGroupMember *tokens[2];
     bool any_timer_armed[2];
+    unsigned pending_reqs[2]; /* Sum of the members' pending_reqs */
     QEMUClockType clock_type;
 
+    /*
+     * Incremented (under the lock) to revoke the credit of all members,
+     * read without the lock.  See throttle_group_co_io_limits_intercept().
+     */
+    unsigned credit_gen[2];
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
@@ -349,10 +359,90 @@ static void schedule_next_request(ThrottleGroupMember *tgm, bool is_write)
     }
 }
 
+/*
+ * Try to pay for an I/O request with the member's credit.  Return whether
+ * it succeeded, in which case the request may be executed right away.
+ *
+ * This is called without tg->lock.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @is_write:  the type of operation (read/write)
+ */
+static bool throttle_group_use_credit(ThrottleGroupMember *tgm,
+                                      int64_t bytes, bool is_write)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    double units;
+
+    if (tgm->credit[is_write].gen != qatomic_read(&tg->credit_gen[is_write])) {
+        return false;
+    }
+
+    units = throttle_op_units(tgm->credit[is_write].op_size, bytes);
+    if (tgm->credit[is_write].bytes < bytes ||
+        tgm->credit[is_write].units < units) {
+        return false;
+    }
+
+    tgm->credit[is_write].bytes -= bytes;
+    tgm->credit[is_write].units -= units;
+    return true;
+}
+
+/*
+ * Give a member credit for the next THROTTLE_GROUP_CREDIT_REQS requests that
+ * are like the current one, if nobody else in the group is waiting and the
+ * limits allow it.  Any remaining credit of the member is forfeited.
+ *
+ * Prepaying requests makes them count earlier than they are executed, so
+ * this can only make the limits stricter.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes of the current I/O
+ * @is_write:  the type of operation (read/write)
+ */
+static void throttle_group_refill_credit(ThrottleGroupMember *tgm,
+                                         int64_t bytes, bool is_write)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    double units = throttle_op_units(ts->cfg.op_size, bytes) *
+                   THROTTLE_GROUP_CREDIT_REQS;
+    uint64_t credit_bytes = bytes * THROTTLE_GROUP_CREDIT_REQS;
+
+    tgm->credit[is_write].units = 0;
+    tgm->credit[is_write].bytes = 0;
+
+    if (tg->any_timer_armed[is_write] || tg->pending_reqs[is_write] ||
+        qatomic_read(&tgm->io_limits_disabled)) {
+        return;
+    }
+
+    throttle_account_units(ts, is_write, units, credit_bytes);
+    if (throttle_would_wait(ts, is_write)) {
+        /* This would exceed the limits, take it back */
+        throttle_account_units(ts, is_write, -units, -(double)credit_bytes);
+        return;
+    }
+
+    tgm->credit[is_write].units = units;
+    tgm->credit[is_write].bytes = credit_bytes;
+    tgm->credit[is_write].op_size = ts->cfg.op_size;
+    tgm->credit[is_write].gen = tg->credit_gen[is_write];
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
  *
+ * As long as no request of the group has to wait, a member's requests are
+ * paid from its credit without taking tg->lock at all.  As soon as a request
+ * has to wait, the credit of all members is revoked, so that they all take
+ * part in the round robin again.
+ *
  * @tgm:       the current ThrottleGroupMember
  * @bytes:     the number of bytes for this I/O
  * @is_write:  the type of operation (read/write)
@@ -367,6 +457,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     assert(bytes >= 0);
 
+    if (throttle_group_use_credit(tgm, bytes, is_write)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -375,7 +469,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* Wait if there's a timer set or queued requests of this type */
     if (must_wait || tgm->pending_reqs[is_write]) {
+        /* Make the other members queue up behind this request */
+        qatomic_inc(&tg->credit_gen[is_write]);
         tgm->pending_reqs[is_write]++;
+        tg->pending_reqs[is_write]++;
         qemu_mutex_unlock(&tg->lock);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
         qemu_co_queue_wait(&tgm->throttled_reqs[is_write],
@@ -383,10 +480,12 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
         qemu_co_mutex_unlock(&tgm->throttled_reqs_lock);
         qemu_mutex_lock(&tg->lock);
         tgm->pending_reqs[is_write]--;
+        tg->pending_reqs[is_write]--;
     }
 
     /* The I/O will be executed, so do the accounting */
     throttle_account(tgm->throttle_state, is_write, bytes);
+    throttle_group_refill_credit(tgm, bytes, is_write);
 
     /* Schedule the next request */
     schedule_next_request(tgm, is_write);
@@ -475,6 +574,9 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    /* Credit was computed with the old limits */
+    qatomic_inc(&tg->credit_gen[0]);
+    qatomic_inc(&tg->credit_gen[1]);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -550,6 +652,10 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     qatomic_set(&tgm->restart_pending, 0);
 
     QEMU_LOCK_GUARD(&tg->lock);
+    for (i = 0; i < 2; i++) {
+        tgm->credit[i].units = 0;
+        tgm->credit[i].bytes = 0;
+    }
     /* If the ThrottleGroup is new set this ThrottleGroupMember as the token */
     for (i = 0; i < 2; i++) {
         if (!tg->tokens[i]) {
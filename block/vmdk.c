@@ -35,6 +35,7 @@
 #include "qemu/bswap.h"
 #include "migration/blocker.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include <zlib.h>
 
 #define VMDK3_MAGIC (('C' << 24) | ('O' << 16) | ('W' << 8) | 'D')
@@ -130,7 +131,12 @@ typedef struct VMDKSESparseVolatileHeader {
     uint8_t pad[480];
 } QEMU_PACKED VMDKSESparseVolatileHeader;
 
+/*
+ * Each extent caches at least L2_CACHE_SIZE grain tables, and as many as
+ * fit in L2_CACHE_MAX_BYTES if the extent has that many.
+ */
 #define L2_CACHE_SIZE 16
+#define L2_CACHE_MAX_BYTES (1 * MiB)
 
 typedef struct VmdkExtent {
     BdrvChild *file;
@@ -155,8 +161,9 @@ typedef struct VmdkExtent {
 
     unsigned int l2_size;
     void *l2_cache;
-    uint32_t l2_cache_offsets[L2_CACHE_SIZE];
-    uint32_t l2_cache_counts[L2_CACHE_SIZE];
+    unsigned int l2_cache_size;
+    uint32_t *l2_cache_offsets;
+    uint32_t *l2_cache_counts;
 
     int64_t cluster_sectors;
     int64_t next_cluster_sector;
@@ -271,6 +278,8 @@ static void vmdk_free_extents(BlockDriverState *bs)
         e = &s->extents[i];
         g_free(e->l1_table);
         g_free(e->l2_cache);
+        g_free(e->l2_cache_offsets);
+        g_free(e->l2_cache_counts);
         g_free(e->l1_backup_table);
         g_free(e->type);
         if (e->file != bs->file) {
@@ -526,7 +535,7 @@ static int vmdk_init_tables(BlockDriverState *bs, VmdkExtent *extent,
                             Error **errp)
 {
     int ret;
-    size_t l1_size;
+    size_t l1_size, l2_size_bytes;
     int i;
 
     /* read the L1 table */
@@ -579,8 +588,13 @@ static int vmdk_init_tables(BlockDriverState *bs, VmdkExtent *extent,
         }
     }
 
-    extent->l2_cache =
-        g_malloc(extent->entry_size * extent->l2_size * L2_CACHE_SIZE);
+    l2_size_bytes = extent->entry_size * extent->l2_size;
+    extent->l2_cache_size = MIN(extent->l1_size,
+                                MAX(L2_CACHE_SIZE,
+                                    L2_CACHE_MAX_BYTES / l2_size_bytes));
+    extent->l2_cache = g_malloc(l2_size_bytes * extent->l2_cache_size);
+    extent->l2_cache_offsets = g_new0(uint32_t, extent->l2_cache_size);
+    extent->l2_cache_counts = g_new0(uint32_t, extent->l2_cache_size);
     return 0;
  fail_l1b:
     g_free(extent->l1_backup_table);
@@ -1555,11 +1569,11 @@ static int get_cluster_offset(BlockDriverState *bs,
     if (!l2_offset) {
         return VMDK_UNALLOC;
     }
-    for (i = 0; i < L2_CACHE_SIZE; i++) {
+    for (i = 0; i < extent->l2_cache_size; i++) {
         if (l2_offset == extent->l2_cache_offsets[i]) {
             /* increment the hit count */
             if (++extent->l2_cache_counts[i] == 0xffffffff) {
-                for (j = 0; j < L2_CACHE_SIZE; j++) {
+                for (j = 0; j < extent->l2_cache_size; j++) {
                     extent->l2_cache_counts[j] >>= 1;
                 }
             }
@@ -1570,7 +1584,7 @@ static int get_cluster_offset(BlockDriverState *bs,
     /* not found: load a new entry in the least used one */
     min_index = 0;
     min_count = 0xffffffff;
-    for (i = 0; i < L2_CACHE_SIZE; i++) {
+    for (i = 0; i < extent->l2_cache_size; i++) {
         if (extent->l2_cache_counts[i] < min_count) {
             min_count = extent->l2_cache_counts[i];
             min_index = i;
@@ -1929,8 +1943,10 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
                 /* qcow2 emits this on bs->file instead of bs->backing */
                 BLKDBG_EVENT(bs->file, BLKDBG_READ_BACKING_AIO);
+                qemu_co_mutex_unlock(&s->lock);
                 ret = bdrv_co_preadv(bs->backing, offset, n_bytes,
                                      &local_qiov, 0);
+                qemu_co_mutex_lock(&s->lock);
                 if (ret < 0) {
                     goto fail;
                 }
@@ -1941,8 +1957,14 @@ vmdk_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             qemu_iovec_reset(&local_qiov);
             qemu_iovec_concat(&local_qiov, qiov, bytes_done, n_bytes);
 
+            /*
+             * Allocated grains never move, so the data can be read without
+             * the lock while other requests look up or load grain tables.
+             */
+            qemu_co_mutex_unlock(&s->lock);
             ret = vmdk_read_extent(extent, cluster_offset, offset_in_cluster,
                                    &local_qiov, n_bytes);
+            qemu_co_mutex_lock(&s->lock);
             if (ret) {
                 goto fail;
             }
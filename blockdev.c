@@ -2803,6 +2803,9 @@ static BlockJob *do_backup_common(BackupCommon *backup,
         if (backup->x_perf->has_max_chunk) {
             perf.max_chunk = backup->x_perf->max_chunk;
         }
+        if (backup->x_perf->has_adaptive) {
+            perf.adaptive = backup->x_perf->adaptive;
+        }
     }
 
     if ((backup->sync == MIRROR_SYNC_MODE_BITMAP) ||
@@ -104,38 +104,123 @@ static int tcp_chr_read_poll(void *opaque);
 static void tcp_chr_disconnect_locked(Chardev *chr);
 
 /* Called with chr_write_lock held.  */
-static int tcp_chr_write(Chardev *chr, const uint8_t *buf, int len)
+static int tcp_chr_send(Chardev *chr, const uint8_t *buf, int len,
+                        int *fds, size_t nfds)
 {
     SocketChardev *s = SOCKET_CHARDEV(chr);
+    int ret = io_channel_send_full(s->ioc, buf, len, fds, nfds);
 
-    if (s->state == TCP_CHARDEV_STATE_CONNECTED) {
-        int ret =  io_channel_send_full(s->ioc, buf, len,
-                                        s->write_msgfds,
-                                        s->write_msgfds_num);
+    /*
+     * free the written msgfds in any cases
+     * other than ret < 0 && errno == EAGAIN
+     */
+    if (!(ret < 0 && EAGAIN == errno)
+        && s->write_msgfds_num && fds) {
+        g_free(s->write_msgfds);
+        s->write_msgfds = 0;
+        s->write_msgfds_num = 0;
+    }
 
-        /* free the written msgfds in any cases
-         * other than ret < 0 && errno == EAGAIN
-         */
-        if (!(ret < 0 && EAGAIN == errno)
-            && s->write_msgfds_num) {
-            g_free(s->write_msgfds);
-            s->write_msgfds = 0;
-            s->write_msgfds_num = 0;
+    if (ret < 0 && errno != EAGAIN) {
+        if (tcp_chr_read_poll(chr) <= 0) {
+            /* Perform disconnect and return error. */
+            tcp_chr_disconnect_locked(chr);
+        } /* else let the read handler finish it properly */
+    }
+
+    return ret;
+}
+
+/*
+ * Send the coalesced writes.  Returns 0 once they are all gone, or -1 with
+ * errno set if some are left.  Called with chr_write_lock held.
+ */
+static int tcp_chr_flush_locked(Chardev *chr)
+{
+    SocketChardev *s = SOCKET_CHARDEV(chr);
+    size_t done = 0;
+
+    while (done < s->wbuf_len) {
+        int ret = tcp_chr_send(chr, s->wbuf + done, s->wbuf_len - done,
+                               NULL, 0);
+        if (ret < 0) {
+            break;
         }
+        done += ret;
+    }
+
+    if (s->state != TCP_CHARDEV_STATE_CONNECTED) {
+        /* The buffer went away with the connection */
+        return -1;
+    }
+    if (done) {
+        memmove(s->wbuf, s->wbuf + done, s->wbuf_len - done);
+        s->wbuf_len -= done;
+    }
+    return s->wbuf_len ? -1 : 0;
+}
 
-        if (ret < 0 && errno != EAGAIN) {
-            if (tcp_chr_read_poll(chr) <= 0) {
-                /* Perform disconnect and return error. */
-                tcp_chr_disconnect_locked(chr);
-            } /* else let the read handler finish it properly */
+static gboolean tcp_chr_flush_timeout(gpointer opaque)
+{
+    Chardev *chr = CHARDEV(opaque);
+    SocketChardev *s = SOCKET_CHARDEV(opaque);
+
+    qemu_mutex_lock(&chr->chr_write_lock);
+    if (s->flush_timer) {
+        g_source_unref(s->flush_timer);
+        s->flush_timer = NULL;
+        if (tcp_chr_flush_locked(chr) < 0 && s->wbuf_len) {
+            /* The peer is not reading, try again later */
+            s->flush_timer = qemu_chr_timeout_add_ms(chr, s->coalesce_ms,
+                                                     tcp_chr_flush_timeout,
+                                                     chr);
         }
+    }
+    qemu_mutex_unlock(&chr->chr_write_lock);
 
-        return ret;
-    } else {
+    return G_SOURCE_REMOVE;
+}
+
+static void tcp_chr_flush_timer_cancel(SocketChardev *s)
+{
+    if (s->flush_timer) {
+        g_source_destroy(s->flush_timer);
+        g_source_unref(s->flush_timer);
+        s->flush_timer = NULL;
+    }
+}
+
+/* Called with chr_write_lock held.  */
+static int tcp_chr_write(Chardev *chr, const uint8_t *buf, int len)
+{
+    SocketChardev *s = SOCKET_CHARDEV(chr);
+
+    if (s->state != TCP_CHARDEV_STATE_CONNECTED) {
         /* Indicate an error. */
         errno = EIO;
         return -1;
     }
+
+    if (s->coalesce_ms) {
+        if (s->wbuf_len + len > TCP_CHR_WBUF_SIZE || s->write_msgfds_num) {
+            /* Keep the order: what is buffered goes out first */
+            if (tcp_chr_flush_locked(chr) < 0) {
+                return -1;
+            }
+        }
+        if (len <= TCP_CHR_WBUF_SIZE && !s->write_msgfds_num) {
+            memcpy(s->wbuf + s->wbuf_len, buf, len);
+            s->wbuf_len += len;
+            if (!s->flush_timer) {
+                s->flush_timer = qemu_chr_timeout_add_ms(chr, s->coalesce_ms,
+                                                         tcp_chr_flush_timeout,
+                                                         chr);
+            }
+            return len;
+        }
+    }
+
+    return tcp_chr_send(chr, buf, len, s->write_msgfds, s->write_msgfds_num);
 }
 
 static int tcp_chr_read_poll(void *opaque)
@@ -369,6 +454,9 @@ static void tcp_chr_free_connection(Chardev *chr)
 
     remove_hup_source(s);
 
+    tcp_chr_flush_timer_cancel(s);
+    s->wbuf_len = 0;
+
     tcp_set_msgfds(chr, NULL, 0);
     remove_fd_in_watch(chr);
     if (s->registered_yank &&
@@ -1058,8 +1146,13 @@ static void char_socket_finalize(Object *obj)
     Chardev *chr = CHARDEV(obj);
     SocketChardev *s = SOCKET_CHARDEV(obj);
 
+    if (s->wbuf_len && s->state == TCP_CHARDEV_STATE_CONNECTED) {
+        /* Best effort, the peer may not be reading */
+        tcp_chr_flush_locked(chr);
+    }
     tcp_chr_free_connection(chr);
     tcp_chr_reconn_timer_cancel(s);
+    g_free(s->wbuf);
     qapi_free_SocketAddress(s->addr);
     tcp_chr_telnet_destroy(s);
     g_free(s->telnet_init);
@@ -1330,8 +1423,18 @@ static void qmp_chardev_open_socket(Chardev *chr,
     bool is_waitconnect = sock->has_wait    ? sock->wait    : false;
     bool is_websock     = sock->has_websocket ? sock->websocket : false;
     int64_t reconnect   = sock->has_reconnect ? sock->reconnect : 0;
+    int64_t coalesce    = sock->has_coalesce ? sock->coalesce : 0;
     SocketAddress *addr;
 
+    if (coalesce < 0 || coalesce > 1000) {
+        error_setg(errp, "'coalesce' must be between 0 and 1000 ms");
+        return;
+    }
+    s->coalesce_ms = coalesce;
+    if (coalesce) {
+        s->wbuf = g_malloc(TCP_CHR_WBUF_SIZE);
+    }
+
     s->is_listen = is_listen;
     s->is_telnet = is_telnet;
     s->is_tn3270 = is_tn3270;
@@ -1465,6 +1568,8 @@ static void qemu_chr_parse_socket(QemuOpts *opts, ChardevBackend *backend,
     sock->wait = qemu_opt_get_bool(opts, "wait", true);
     sock->has_reconnect = qemu_opt_find(opts, "reconnect");
     sock->reconnect = qemu_opt_get_number(opts, "reconnect", 0);
+    sock->has_coalesce = qemu_opt_find(opts, "coalesce");
+    sock->coalesce = qemu_opt_get_number(opts, "coalesce", 0);
     sock->has_tls_creds = qemu_opt_get(opts, "tls-creds");
     sock->tls_creds = g_strdup(qemu_opt_get(opts, "tls-creds"));
     sock->has_tls_authz = qemu_opt_get(opts, "tls-authz");
@@ -32,6 +32,17 @@
 
 
 #include <gnutls/x509.h>
+#ifdef CONFIG_KTLS
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
 
 
 struct QCryptoTLSSession {
@@ -549,6 +560,130 @@ qcrypto_tls_session_get_peer_name(QCryptoTLSSession *session)
 }
 
 
+#ifdef CONFIG_KTLS
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *session,
+                                   int fd,
+                                   Error **errp)
+{
+    union {
+        struct tls_crypto_info info;
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+        struct tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+    } crypto = {};
+    gnutls_datum_t mac_key, iv, key;
+    unsigned char seq[8];
+    gnutls_protocol_t version;
+    gnutls_cipher_algorithm_t cipher;
+    size_t size;
+    int ret;
+
+    if (!session->creds->ktls) {
+        return 0;
+    }
+
+    /*
+     * With TLS 1.3 the peer may ask at any time for the write keys to be
+     * updated.  gnutls answers a KeyUpdate from within the next call to
+     * gnutls_record_send(), which never happens once the kernel owns the
+     * transmit side, and the kernel cannot rekey the offloaded state either.
+     * Keep such sessions in user space rather than let them break later.
+     */
+    version = gnutls_protocol_get_version(session->handle);
+    if (version == GNUTLS_TLS1_3) {
+        trace_qcrypto_tls_session_ktls_tx_skip(
+            session, gnutls_protocol_get_name(version));
+        return 0;
+    }
+    if (version != GNUTLS_TLS1_2) {
+        error_setg(errp, "Kernel TLS does not support %s",
+                   gnutls_protocol_get_name(version));
+        return -1;
+    }
+    crypto.info.version = TLS_1_2_VERSION;
+
+    ret = gnutls_record_get_state(session->handle, 0,
+                                  &mac_key, &iv, &key, seq);
+    if (ret < 0) {
+        error_setg(errp, "Cannot get TLS session state: %s",
+                   gnutls_strerror(ret));
+        return -1;
+    }
+
+    /*
+     * The explicit part of the GCM nonce is chosen by the sender; like
+     * gnutls itself, the kernel uses the record sequence number.
+     */
+    cipher = gnutls_cipher_get(session->handle);
+    switch (cipher) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        memcpy(crypto.aes128.salt, iv.data, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+        memcpy(crypto.aes128.iv, seq, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+        memcpy(crypto.aes128.key, key.data, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+        memcpy(crypto.aes128.rec_seq, seq,
+               TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+        size = sizeof(crypto.aes128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        memcpy(crypto.aes256.salt, iv.data, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+        memcpy(crypto.aes256.iv, seq, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+        memcpy(crypto.aes256.key, key.data, TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+        memcpy(crypto.aes256.rec_seq, seq,
+               TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+        size = sizeof(crypto.aes256);
+        break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case GNUTLS_CIPHER_CHACHA20_POLY1305:
+        crypto.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        memcpy(crypto.chacha.iv, iv.data, TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+        memcpy(crypto.chacha.key, key.data,
+               TLS_CIPHER_CHACHA20_POLY1305_KEY_SIZE);
+        memcpy(crypto.chacha.rec_seq, seq,
+               TLS_CIPHER_CHACHA20_POLY1305_REC_SEQ_SIZE);
+        size = sizeof(crypto.chacha);
+        break;
+#endif
+    default:
+        error_setg(errp, "Kernel TLS does not support cipher %s",
+                   gnutls_cipher_get_name(cipher));
+        return -1;
+    }
+
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+        error_setg_errno(errp, errno, "Cannot enable kernel TLS");
+        return -1;
+    }
+    ret = setsockopt(fd, SOL_TLS, TLS_TX, &crypto, size);
+    memset(&crypto, 0, sizeof(crypto));
+    if (ret < 0) {
+        error_setg_errno(errp, errno, "Cannot install kernel TLS keys");
+        return -1;
+    }
+
+    trace_qcrypto_tls_session_ktls_tx(session,
+                                      gnutls_cipher_get_name(cipher));
+    return 1;
+}
+#else
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *session,
+                                   int fd G_GNUC_UNUSED,
+                                   Error **errp)
+{
+    if (!session->creds->ktls) {
+        return 0;
+    }
+    error_setg(errp, "Kernel TLS is not supported on this host");
+    return -1;
+}
+#endif
+
+
 #else /* ! CONFIG_GNUTLS */
 
 
@@ -634,6 +769,16 @@ qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
 }
 
 
+int
+qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *sess,
+                                   int fd,
+                                   Error **errp)
+{
+    error_setg(errp, "TLS requires GNUTLS support");
+    return -1;
+}
+
+
 char *
 qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess)
 {
@@ -99,6 +99,50 @@ static inline void xts_tweak_encdec(const void *ctx,
 }
 
 
+/* Number of blocks passed to the cipher function at once */
+#define XTS_BATCH_BLOCKS 16
+
+/**
+ * xts_batch_encdec:
+ * @param ctxt: the cipher context
+ * @param func: the cipher function
+ * @src: buffer providing the input text of @n * XTS_BLOCK_SIZE bytes
+ * @dst: buffer to output the output text of @n * XTS_BLOCK_SIZE bytes
+ * @n: the number of blocks, at most XTS_BATCH_BLOCKS
+ * @iv: the initialization vector tweak of XTS_BLOCK_SIZE bytes
+ *
+ * Encrypt/decrypt @n blocks with consecutive tweaks.  The cipher function
+ * is called once for all of them, so that backends that process several
+ * blocks in parallel (e.g. with AES-NI or VAES) can do so, and the cost
+ * of the indirect call is paid once per batch.
+ */
+static void xts_batch_encdec(const void *ctx,
+                             xts_cipher_func *func,
+                             const uint8_t *src,
+                             uint8_t *dst,
+                             unsigned long n,
+                             xts_uint128 *iv)
+{
+    xts_uint128 tweak[XTS_BATCH_BLOCKS];
+    xts_uint128 buf[XTS_BATCH_BLOCKS];
+    unsigned long i;
+
+    memcpy(buf, src, n * XTS_BLOCK_SIZE);
+    for (i = 0; i < n; i++) {
+        tweak[i] = *iv;
+        xts_uint128_xor(&buf[i], &buf[i], &tweak[i]);
+        xts_mult_x(iv);
+    }
+
+    func(ctx, n * XTS_BLOCK_SIZE, buf[0].b, buf[0].b);
+
+    for (i = 0; i < n; i++) {
+        xts_uint128_xor(&buf[i], &buf[i], &tweak[i]);
+    }
+    memcpy(dst, buf, n * XTS_BLOCK_SIZE);
+}
+
+
 void xts_decrypt(const void *datactx,
                  const void *tweakctx,
                  xts_cipher_func *encfunc,
@@ -109,7 +153,7 @@ void xts_decrypt(const void *datactx,
                  const uint8_t *src)
 {
     xts_uint128 PP, CC, T;
-    unsigned long i, m, mo, lim;
+    unsigned long i, n, m, mo, lim;
 
     /* get number of blocks */
     m = length >> 4;
@@ -127,23 +171,11 @@ void xts_decrypt(const void *datactx,
     /* encrypt the iv */
     encfunc(tweakctx, XTS_BLOCK_SIZE, T.b, iv);
 
-    if (QEMU_PTR_IS_ALIGNED(src, sizeof(uint64_t)) &&
-        QEMU_PTR_IS_ALIGNED(dst, sizeof(uint64_t))) {
-        xts_uint128 *S = (xts_uint128 *)src;
-        xts_uint128 *D = (xts_uint128 *)dst;
-        for (i = 0; i < lim; i++, S++, D++) {
-            xts_tweak_encdec(datactx, decfunc, S, D, &T);
-        }
-    } else {
-        xts_uint128 D;
-
-        for (i = 0; i < lim; i++) {
-            memcpy(&D, src, XTS_BLOCK_SIZE);
-            xts_tweak_encdec(datactx, decfunc, &D, &D, &T);
-            memcpy(dst, &D, XTS_BLOCK_SIZE);
-            src += XTS_BLOCK_SIZE;
-            dst += XTS_BLOCK_SIZE;
-        }
+    for (i = 0; i < lim; i += n) {
+        n = MIN(lim - i, XTS_BATCH_BLOCKS);
+        xts_batch_encdec(datactx, decfunc, src, dst, n, &T);
+        src += n * XTS_BLOCK_SIZE;
+        dst += n * XTS_BLOCK_SIZE;
     }
 
     /* if length is not a multiple of XTS_BLOCK_SIZE then */
@@ -185,7 +217,7 @@ void xts_encrypt(const void *datactx,
                  const uint8_t *src)
 {
     xts_uint128 PP, CC, T;
-    unsigned long i, m, mo, lim;
+    unsigned long i, n, m, mo, lim;
 
     /* get number of blocks */
     m = length >> 4;
@@ -203,24 +235,11 @@ void xts_encrypt(const void *datactx,
     /* encrypt the iv */
     encfunc(tweakctx, XTS_BLOCK_SIZE, T.b, iv);
 
-    if (QEMU_PTR_IS_ALIGNED(src, sizeof(uint64_t)) &&
-        QEMU_PTR_IS_ALIGNED(dst, sizeof(uint64_t))) {
-        xts_uint128 *S = (xts_uint128 *)src;
-        xts_uint128 *D = (xts_uint128 *)dst;
-        for (i = 0; i < lim; i++, S++, D++) {
-            xts_tweak_encdec(datactx, encfunc, S, D, &T);
-        }
-    } else {
-        xts_uint128 D;
-
-        for (i = 0; i < lim; i++) {
-            memcpy(&D, src, XTS_BLOCK_SIZE);
-            xts_tweak_encdec(datactx, encfunc, &D, &D, &T);
-            memcpy(dst, &D, XTS_BLOCK_SIZE);
-
-            dst += XTS_BLOCK_SIZE;
-            src += XTS_BLOCK_SIZE;
-        }
+    for (i = 0; i < lim; i += n) {
+        n = MIN(lim - i, XTS_BATCH_BLOCKS);
+        xts_batch_encdec(datactx, encfunc, src, dst, n, &T);
+        src += n * XTS_BLOCK_SIZE;
+        dst += n * XTS_BLOCK_SIZE;
     }
 
     /* if length is not a multiple of XTS_BLOCK_SIZE then */
@@ -0,0 +1,285 @@
+/*
+ * Live guest memory dump
+ *
+ * The guest is only stopped while the dump collects its CPU state and
+ * writes the headers.  Its RAM is then write-protected with userfaultfd, as
+ * for background snapshots, and the guest runs again.  The first write to a
+ * page that has not been dumped yet makes the fault thread save a copy of
+ * the page before the write proceeds, so the dump sees guest memory as it
+ * was when the guest was stopped.  Pages are released once dumped, so the
+ * copies only cover pages written ahead of the dump.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "exec/cpu-common.h"
+#include "dump-live.h"
+
+#ifdef CONFIG_LINUX
+#include <poll.h>
+#include "qemu/error-report.h"
+#include "qemu/event_notifier.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/userfaultfd.h"
+
+/* Maximum number of fault events read at once */
+#define DUMP_LIVE_FAULT_BATCH   16
+
+struct DumpLiveTracker {
+    int uffd;
+    GuestPhysBlockList *blocks;
+    QemuMutex lock;
+    GHashTable *copies;         /* page address -> copy saved on a fault */
+    GHashTable *dumped;         /* pages that the dump has read in full */
+    EventNotifier quit;
+    QemuThread fault_thread;
+};
+
+/* Returns the host page that contains @host, in *@page */
+static size_t dump_live_page(void *host, uint8_t **page)
+{
+    ram_addr_t offset;
+    RAMBlock *rb;
+    size_t size;
+
+    RCU_READ_LOCK_GUARD();
+    rb = qemu_ram_block_from_host(host, false, &offset);
+    size = rb ? qemu_ram_pagesize(rb) : qemu_real_host_page_size;
+    *page = (uint8_t *)QEMU_ALIGN_PTR_DOWN(host, size);
+    return size;
+}
+
+/* Returns the host range of @block, in whole host pages of *@page_size */
+static size_t dump_live_block_range(GuestPhysBlock *block, uint8_t **start,
+                                    size_t *page_size)
+{
+    uint8_t *end = block->host_addr + (block->target_end - block->target_start);
+
+    *page_size = dump_live_page(block->host_addr, start);
+    return (uint8_t *)QEMU_ALIGN_PTR_UP(end, *page_size) - *start;
+}
+
+static void dump_live_fault(DumpLiveTracker *t, uint64_t addr)
+{
+    uint8_t *page;
+    size_t size = dump_live_page((void *)(uintptr_t)addr, &page);
+
+    qemu_mutex_lock(&t->lock);
+    /*
+     * The fault may have been queued before dump_live_read() released the
+     * page; the dump has its contents already, so don't keep a copy that
+     * nobody would read.
+     */
+    if (!g_hash_table_contains(t->dumped, page) &&
+        !g_hash_table_contains(t->copies, page)) {
+        g_hash_table_insert(t->copies, page, g_memdup2(page, size));
+    }
+    uffd_change_protection(t->uffd, page, size, false, false);
+    qemu_mutex_unlock(&t->lock);
+}
+
+static void *dump_live_fault_thread(void *opaque)
+{
+    DumpLiveTracker *t = opaque;
+    struct uffd_msg msgs[DUMP_LIVE_FAULT_BATCH];
+    struct pollfd pfd[2] = {
+        { .fd = t->uffd, .events = POLLIN },
+        { .fd = event_notifier_get_fd(&t->quit), .events = POLLIN },
+    };
+
+    rcu_register_thread();
+
+    while (true) {
+        int i, n;
+
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_report("%s: poll() failed: %s", __func__, strerror(errno));
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+
+        n = uffd_read_events(t->uffd, msgs, DUMP_LIVE_FAULT_BATCH);
+        if (n < 0) {
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                dump_live_fault(t, msgs[i].arg.pagefault.address);
+            }
+        }
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/* Removes the write protection of the blocks before @last, or of all */
+static void dump_live_release(DumpLiveTracker *t, GuestPhysBlock *last,
+                              bool unregister)
+{
+    GuestPhysBlock *block;
+
+    QTAILQ_FOREACH(block, &t->blocks->head, next) {
+        uint8_t *start;
+        size_t page_size;
+        size_t len = dump_live_block_range(block, &start, &page_size);
+
+        if (block == last) {
+            break;
+        }
+
+        uffd_change_protection(t->uffd, start, len, false, false);
+        if (unregister) {
+            uffd_unregister_memory(t->uffd, start, len);
+        }
+    }
+}
+
+/*
+ * Write-protects the guest memory in @blocks, which must stay valid until
+ * dump_live_stop().  The guest must be stopped.
+ */
+DumpLiveTracker *dump_live_start(GuestPhysBlockList *blocks, Error **errp)
+{
+    DumpLiveTracker *t = g_new0(DumpLiveTracker, 1);
+    GuestPhysBlock *block;
+
+    t->blocks = blocks;
+    t->uffd = uffd_create_fd(UFFD_FEATURE_PAGEFAULT_FLAG_WP, true);
+    if (t->uffd < 0) {
+        error_setg(errp, "Live dump needs userfaultfd write protection");
+        g_free(t);
+        return NULL;
+    }
+
+    QTAILQ_FOREACH(block, &blocks->head, next) {
+        uint8_t *start;
+        size_t page_size;
+        size_t len = dump_live_block_range(block, &start, &page_size);
+        size_t offset;
+
+        /*
+         * Write protection silently skips pages that are not populated yet,
+         * so read a byte of each page first, as ram_block_populate_read()
+         * does.
+         */
+        for (offset = 0; offset < len; offset += page_size) {
+            char tmp = *((char *)start + offset);
+
+            /* Don't optimize the read out */
+            asm volatile("" : "+r" (tmp));
+        }
+
+        if (uffd_register_memory(t->uffd, start, len,
+                                 UFFDIO_REGISTER_MODE_WP, NULL) ||
+            uffd_change_protection(t->uffd, start, len, true, false)) {
+            error_setg(errp, "Could not write-protect guest memory at 0x%"
+                       HWADDR_PRIx " for live dump", block->target_start);
+            dump_live_release(t, block, true);
+            uffd_close_fd(t->uffd);
+            g_free(t);
+            return NULL;
+        }
+    }
+
+    if (event_notifier_init(&t->quit, false)) {
+        error_setg(errp, "Could not create the live dump fault thread");
+        dump_live_release(t, NULL, true);
+        uffd_close_fd(t->uffd);
+        g_free(t);
+        return NULL;
+    }
+    qemu_mutex_init(&t->lock);
+    t->copies = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    t->dumped = g_hash_table_new(NULL, NULL);
+    qemu_thread_create(&t->fault_thread, "dump-live-fault",
+                       dump_live_fault_thread, t, QEMU_THREAD_JOINABLE);
+    return t;
+}
+
+/*
+ * Copies @size bytes of guest memory at @host, as they were when tracking
+ * started, into @buf.  Host pages are released when their last byte is
+ * read; a page that is read again after that keeps what the guest wrote
+ * since, and is reported.
+ */
+void dump_live_read(DumpLiveTracker *t, uint8_t *host, size_t size,
+                    uint8_t *buf)
+{
+    while (size) {
+        uint8_t *page, *copy;
+        size_t page_size = dump_live_page(host, &page);
+        size_t offset = host - page;
+        size_t len = MIN(size, page_size - offset);
+
+        qemu_mutex_lock(&t->lock);
+        if (g_hash_table_contains(t->dumped, page)) {
+            warn_report_once("live dump read guest memory at %p twice, "
+                             "the dump may be inconsistent", page);
+        }
+        copy = g_hash_table_lookup(t->copies, page);
+        memcpy(buf, copy ? copy + offset : host, len);
+        if (offset + len == page_size) {
+            g_hash_table_add(t->dumped, page);
+            if (copy) {
+                g_hash_table_remove(t->copies, page);
+            } else {
+                uffd_change_protection(t->uffd, page, page_size, false, false);
+            }
+        }
+        qemu_mutex_unlock(&t->lock);
+
+        host += len;
+        buf += len;
+        size -= len;
+    }
+}
+
+void dump_live_stop(DumpLiveTracker *t)
+{
+    if (!t) {
+        return;
+    }
+
+    /* No new faults once the memory is unprotected, and pending ones wake up */
+    dump_live_release(t, NULL, false);
+    event_notifier_set(&t->quit);
+    qemu_thread_join(&t->fault_thread);
+    event_notifier_cleanup(&t->quit);
+    dump_live_release(t, NULL, true);
+
+    uffd_close_fd(t->uffd);
+    g_hash_table_destroy(t->copies);
+    g_hash_table_destroy(t->dumped);
+    qemu_mutex_destroy(&t->lock);
+    g_free(t);
+}
+
+#else
+
+DumpLiveTracker *dump_live_start(GuestPhysBlockList *blocks, Error **errp)
+{
+    error_setg(errp, "Live dump is not supported on this host");
+    return NULL;
+}
+
+void dump_live_read(DumpLiveTracker *t, uint8_t *host, size_t size,
+                    uint8_t *buf)
+{
+    g_assert_not_reached();
+}
+
+void dump_live_stop(DumpLiveTracker *t)
+{
+}
+
+#endif /* CONFIG_LINUX */
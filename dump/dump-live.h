@@ -0,0 +1,20 @@
+/*
+ * Live guest memory dump
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef DUMP_LIVE_H
+#define DUMP_LIVE_H
+
+#include "sysemu/memory_mapping.h"
+
+typedef struct DumpLiveTracker DumpLiveTracker;
+
+DumpLiveTracker *dump_live_start(GuestPhysBlockList *blocks, Error **errp);
+void dump_live_read(DumpLiveTracker *t, uint8_t *host, size_t size,
+                    uint8_t *buf);
+void dump_live_stop(DumpLiveTracker *t);
+
+#endif
@@ -31,6 +31,8 @@
 #include "hw/misc/vmcoreinfo.h"
 #include "migration/blocker.h"
 
+#include "dump-live.h"
+
 #ifdef TARGET_X86_64
 #include "win_dump.h"
 #endif
@@ -42,12 +44,19 @@
 #ifdef CONFIG_SNAPPY
 #include <snappy-c.h>
 #endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 #ifndef ELF_MACHINE_UNAME
 #define ELF_MACHINE_UNAME "Unknown"
 #endif
 
 #define MAX_GUEST_NOTE_SIZE (1 << 20) /* 1MB should be enough */
 
+/* Page compression threads for the kdump-compressed formats */
+#define DUMP_COMPRESS_THREADS_DEFAULT   16
+#define DUMP_COMPRESS_THREADS_MAX       256
+
 static Error *dump_migration_blocker;
 
 #define ELF_NOTE_SIZE(hdr_size, name_size, desc_size)   \
@@ -90,6 +99,8 @@ uint64_t cpu_to_dump64(DumpState *s, uint64_t val)
 
 static int dump_cleanup(DumpState *s)
 {
+    dump_live_stop(s->live_tracker);
+    s->live_tracker = NULL;
     guest_phys_blocks_free(&s->guest_phys_blocks);
     memory_mapping_list_free(&s->list);
     close(s->fd);
@@ -386,16 +397,58 @@ static void write_data(DumpState *s, void *buf, int length, Error **errp)
     }
 }
 
+/*
+ * For a live dump, start tracking writes to guest memory and let the guest
+ * run again.  Everything that depends on the state of the CPUs must have
+ * been written before.
+ */
+static void dump_live_resume(DumpState *s, Error **errp)
+{
+    if (!s->live) {
+        return;
+    }
+
+    s->live_tracker = dump_live_start(&s->guest_phys_blocks, errp);
+    if (!s->live_tracker) {
+        return;
+    }
+
+    /* live dumps are always detached */
+    if (s->resume) {
+        qemu_mutex_lock_iothread();
+        vm_start();
+        qemu_mutex_unlock_iothread();
+        s->resume = false;
+    }
+}
+
+/* write guest memory that will not be accessed again by the dump */
+static void write_guest_data(DumpState *s, uint8_t *host, int length,
+                             uint8_t *live_buf, Error **errp)
+{
+    if (s->live_tracker) {
+        dump_live_read(s->live_tracker, host, length, live_buf);
+        host = live_buf;
+    }
+    write_data(s, host, length, errp);
+}
+
 /* write the memory to vmcore. 1 page per I/O. */
 static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
                          int64_t size, Error **errp)
 {
+    g_autofree uint8_t *live_buf = NULL;
     int64_t i;
     Error *local_err = NULL;
 
+    if (s->live_tracker) {
+        live_buf = g_malloc(s->dump_info.page_size);
+    }
+
     for (i = 0; i < size / s->dump_info.page_size; i++) {
-        write_data(s, block->host_addr + start + i * s->dump_info.page_size,
-                   s->dump_info.page_size, &local_err);
+        write_guest_data(s,
+                         block->host_addr + start + i * s->dump_info.page_size,
+                         s->dump_info.page_size, live_buf, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -403,8 +456,9 @@ static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
     }
 
     if ((size % s->dump_info.page_size) != 0) {
-        write_data(s, block->host_addr + start + i * s->dump_info.page_size,
-                   size % s->dump_info.page_size, &local_err);
+        write_guest_data(s,
+                         block->host_addr + start + i * s->dump_info.page_size,
+                         size % s->dump_info.page_size, live_buf, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -677,6 +731,12 @@ static void create_vmcore(DumpState *s, Error **errp)
         return;
     }
 
+    dump_live_resume(s, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
     dump_iterate(s, errp);
 }
 
@@ -850,6 +910,11 @@ static void create_header32(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -962,6 +1027,11 @@ static void create_header64(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -1289,6 +1359,305 @@ static size_t get_len_buf_out(size_t page_size, uint32_t flag_compress)
     case DUMP_DH_COMPRESSED_SNAPPY:
         return snappy_max_compressed_length(page_size);
 #endif
+
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        return ZSTD_compressBound(page_size);
+#endif
+    }
+    return 0;
+}
+
+/*
+ * Pages are compressed by a pool of threads, DUMP_JOB_PAGES at a time, and
+ * written in order by the dump thread.  Jobs are queued and completed in the
+ * order of a ring, so that the dump thread can write a job as soon as it is
+ * done, while the threads keep compressing the following ones.
+ */
+#define DUMP_JOB_PAGES          64
+#define DUMP_JOBS_PER_THREAD    4
+
+typedef struct DumpCompressor {
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+} DumpCompressor;
+
+typedef enum DumpJobState {
+    DUMP_JOB_FREE,
+    DUMP_JOB_QUEUED,
+    DUMP_JOB_DONE,
+} DumpJobState;
+
+typedef struct DumpPageJob {
+    DumpJobState state;
+    int nr_pages;
+    uint8_t *pages[DUMP_JOB_PAGES];
+    /* result: data to write for each page, none for a zero page */
+    uint32_t flags[DUMP_JOB_PAGES];
+    size_t size[DUMP_JOB_PAGES];
+    uint8_t *data[DUMP_JOB_PAGES];
+    uint8_t *buf_out;
+    /* for a live dump, the pages are copied here */
+    uint8_t *copy;
+} DumpPageJob;
+
+typedef struct DumpCompressPool {
+    DumpState *s;
+    size_t len_buf_out;
+    QemuMutex lock;
+    QemuCond cond;              /* a job was queued or done, or quit is set */
+    DumpPageJob *jobs;
+    int nr_jobs;
+    int next_compress;          /* next job for the threads */
+    bool quit;
+    int nr_threads;
+    QemuThread *threads;
+} DumpCompressPool;
+
+static void dump_compressor_init(DumpCompressor *c, DumpState *s)
+{
+#ifdef CONFIG_LZO
+    c->wrkmem = NULL;
+    if (s->flag_compress == DUMP_DH_COMPRESSED_LZO) {
+        c->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+    }
+#endif
+#ifdef CONFIG_ZSTD
+    c->zstd = NULL;
+    if (s->flag_compress == DUMP_DH_COMPRESSED_ZSTD) {
+        /* on failure, the pages are written uncompressed */
+        c->zstd = ZSTD_createCCtx();
+    }
+#endif
+}
+
+static void dump_compressor_fini(DumpCompressor *c)
+{
+#ifdef CONFIG_LZO
+    g_free(c->wrkmem);
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCCtx(c->zstd);
+#endif
+}
+
+/*
+ * Compress the page at @buf into @out, which is *@size_out bytes long.
+ * Returns the compression format, or 0 if the page must be saved in
+ * plaintext because compression failed or did not make it smaller.
+ */
+static uint32_t dump_compress_page(DumpState *s, DumpCompressor *c,
+                                   const uint8_t *buf, uint8_t *out,
+                                   size_t *size_out)
+{
+    size_t page_size = s->dump_info.page_size;
+    size_t len = *size_out;
+
+    switch (s->flag_compress) {
+    case DUMP_DH_COMPRESSED_ZLIB: {
+        uLongf zlen = len;
+
+        if (compress2(out, &zlen, buf, page_size, Z_BEST_SPEED) != Z_OK) {
+            return 0;
+        }
+        len = zlen;
+        break;
+    }
+#ifdef CONFIG_LZO
+    case DUMP_DH_COMPRESSED_LZO: {
+        lzo_uint llen = len;
+
+        if (lzo1x_1_compress(buf, page_size, out, &llen,
+                             c->wrkmem) != LZO_E_OK) {
+            return 0;
+        }
+        len = llen;
+        break;
+    }
+#endif
+#ifdef CONFIG_SNAPPY
+    case DUMP_DH_COMPRESSED_SNAPPY:
+        if (snappy_compress((const char *)buf, page_size,
+                            (char *)out, &len) != SNAPPY_OK) {
+            return 0;
+        }
+        break;
+#endif
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        if (!c->zstd) {
+            return 0;
+        }
+        len = ZSTD_compressCCtx(c->zstd, out, len, buf, page_size, 1);
+        if (ZSTD_isError(len)) {
+            return 0;
+        }
+        break;
+#endif
+    default:
+        return 0;
+    }
+
+    if (len >= page_size) {
+        return 0;
+    }
+    *size_out = len;
+    return s->flag_compress;
+}
+
+static void dump_compress_job(DumpCompressPool *pool, DumpCompressor *c,
+                              DumpPageJob *job)
+{
+    DumpState *s = pool->s;
+    int i;
+
+    for (i = 0; i < job->nr_pages; i++) {
+        uint8_t *buf = job->pages[i];
+        uint8_t *out = job->buf_out + i * pool->len_buf_out;
+        size_t size_out = pool->len_buf_out;
+
+        /* zero pages all share the first page of the page section */
+        if (buffer_is_zero(buf, s->dump_info.page_size)) {
+            job->size[i] = 0;
+            continue;
+        }
+
+        job->flags[i] = dump_compress_page(s, c, buf, out, &size_out);
+        if (job->flags[i]) {
+            job->data[i] = out;
+            job->size[i] = size_out;
+        } else {
+            job->data[i] = buf;
+            job->size[i] = s->dump_info.page_size;
+        }
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressPool *pool = opaque;
+    DumpCompressor c;
+    DumpPageJob *job;
+
+    dump_compressor_init(&c, pool->s);
+
+    qemu_mutex_lock(&pool->lock);
+    for (;;) {
+        job = &pool->jobs[pool->next_compress];
+        if (job->state != DUMP_JOB_QUEUED) {
+            if (pool->quit) {
+                break;
+            }
+            qemu_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        pool->next_compress = (pool->next_compress + 1) % pool->nr_jobs;
+        qemu_mutex_unlock(&pool->lock);
+
+        dump_compress_job(pool, &c, job);
+
+        qemu_mutex_lock(&pool->lock);
+        job->state = DUMP_JOB_DONE;
+        qemu_cond_broadcast(&pool->cond);
+    }
+    qemu_mutex_unlock(&pool->lock);
+
+    dump_compressor_fini(&c);
+    return NULL;
+}
+
+static void dump_compress_pool_init(DumpCompressPool *pool, DumpState *s,
+                                    size_t len_buf_out)
+{
+    int i;
+
+    pool->s = s;
+    pool->len_buf_out = len_buf_out;
+    pool->next_compress = 0;
+    pool->quit = false;
+    /* with a single thread, the dump thread compresses the pages itself */
+    pool->nr_threads = s->compress_threads > 1 ? s->compress_threads : 0;
+    pool->nr_jobs = MAX(pool->nr_threads * DUMP_JOBS_PER_THREAD, 1);
+    pool->jobs = g_new0(DumpPageJob, pool->nr_jobs);
+    for (i = 0; i < pool->nr_jobs; i++) {
+        pool->jobs[i].buf_out = g_malloc(DUMP_JOB_PAGES * len_buf_out);
+        if (s->live_tracker) {
+            pool->jobs[i].copy = g_malloc(DUMP_JOB_PAGES *
+                                          s->dump_info.page_size);
+        }
+    }
+
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->cond);
+    pool->threads = g_new0(QemuThread, pool->nr_threads);
+    for (i = 0; i < pool->nr_threads; i++) {
+        qemu_thread_create(&pool->threads[i], "dump-compress",
+                           dump_compress_thread, pool, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void dump_compress_pool_fini(DumpCompressPool *pool)
+{
+    int i;
+
+    qemu_mutex_lock(&pool->lock);
+    pool->quit = true;
+    qemu_cond_broadcast(&pool->cond);
+    qemu_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nr_threads; i++) {
+        qemu_thread_join(&pool->threads[i]);
+    }
+    g_free(pool->threads);
+    qemu_cond_destroy(&pool->cond);
+    qemu_mutex_destroy(&pool->lock);
+
+    for (i = 0; i < pool->nr_jobs; i++) {
+        g_free(pool->jobs[i].buf_out);
+        g_free(pool->jobs[i].copy);
+    }
+    g_free(pool->jobs);
+}
+
+static int write_dump_job(DumpState *s, DumpPageJob *job,
+                          DataCache *page_desc, DataCache *page_data,
+                          PageDescriptor *pd_zero, off_t *offset_data,
+                          Error **errp)
+{
+    PageDescriptor pd;
+    int i;
+
+    for (i = 0; i < job->nr_pages; i++) {
+        if (!job->size[i]) {
+            if (write_cache(page_desc, pd_zero, sizeof(PageDescriptor),
+                            false) < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return -1;
+            }
+            s->written_size += s->dump_info.page_size;
+            continue;
+        }
+
+        if (write_cache(page_data, job->data[i], job->size[i], false) < 0) {
+            error_setg(errp, "dump: failed to write page data");
+            return -1;
+        }
+
+        pd.flags = cpu_to_dump32(s, job->flags[i]);
+        pd.size = cpu_to_dump32(s, job->size[i]);
+        pd.page_flags = cpu_to_dump64(s, 0);
+        pd.offset = cpu_to_dump64(s, *offset_data);
+        *offset_data += job->size[i];
+
+        if (write_cache(page_desc, &pd, sizeof(PageDescriptor), false) < 0) {
+            error_setg(errp, "dump: failed to write page desc");
+            return -1;
+        }
+        s->written_size += s->dump_info.page_size;
     }
     return 0;
 }
@@ -1297,16 +1666,17 @@ static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    DumpCompressPool pool;
+    DumpCompressor c;
+    DumpPageJob *job;
+    size_t len_buf_out;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
+    int next_fill = 0, next_write = 0;
+    bool more = true;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1319,11 +1689,8 @@ static void write_dump_pages(DumpState *s, Error **errp)
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
+    dump_compressor_init(&c, s);
+    dump_compress_pool_init(&pool, s, len_buf_out);
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1344,100 +1711,64 @@ static void write_dump_pages(DumpState *s, Error **errp)
     offset_data += s->dump_info.page_size;
 
     /*
-     * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * dump memory to vmcore page by page: queue pages for compression as
+     * long as there is a free job, otherwise write the oldest job.  Only one
+     * compression format will be used, for s->flag_compress is set; when
+     * compression fails to work, pages are saved in plaintext.
      */
-    while (get_next_page(&block_iter, &pfn_iter, &buf, s)) {
-        /* check zero page */
-        if (buffer_is_zero(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
+    for (;;) {
+        job = &pool.jobs[next_fill];
+        if (more && job->state == DUMP_JOB_FREE) {
+            job->nr_pages = 0;
+            while (job->nr_pages < DUMP_JOB_PAGES &&
+                   (more = get_next_page(&block_iter, &pfn_iter, &buf, s))) {
+                if (s->live_tracker) {
+                    uint8_t *copy = job->copy +
+                                    job->nr_pages * s->dump_info.page_size;
+
+                    dump_live_read(s->live_tracker, buf,
+                                   s->dump_info.page_size, copy);
+                    buf = copy;
                 }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
+                job->pages[job->nr_pages++] = buf;
+            }
+            if (!job->nr_pages) {
+                continue;
+            }
+
+            if (!pool.nr_threads) {
+                dump_compress_job(&pool, &c, job);
+                job->state = DUMP_JOB_DONE;
             } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
+                qemu_mutex_lock(&pool.lock);
+                job->state = DUMP_JOB_QUEUED;
+                qemu_cond_broadcast(&pool.cond);
+                qemu_mutex_unlock(&pool.lock);
             }
+            next_fill = (next_fill + 1) % pool.nr_jobs;
+            continue;
+        }
 
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+        job = &pool.jobs[next_write];
+        qemu_mutex_lock(&pool.lock);
+        while (job->state == DUMP_JOB_QUEUED) {
+            qemu_cond_wait(&pool.cond, &pool.lock);
+        }
+        qemu_mutex_unlock(&pool.lock);
+        if (job->state == DUMP_JOB_FREE) {
+            /* all pages are written */
+            break;
+        }
 
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
+        ret = write_dump_job(s, job, &page_desc, &page_data, &pd_zero,
+                             &offset_data, errp);
+        if (ret < 0) {
+            goto out;
         }
-        s->written_size += s->dump_info.page_size;
+        qemu_mutex_lock(&pool.lock);
+        job->state = DUMP_JOB_FREE;
+        qemu_mutex_unlock(&pool.lock);
+        next_write = (next_write + 1) % pool.nr_jobs;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1452,14 +1783,10 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
 out:
+    dump_compress_pool_fini(&pool);
+    dump_compressor_fini(&c);
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
-
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1501,6 +1828,12 @@ static void create_kdump_vmcore(DumpState *s, Error **errp)
         return;
     }
 
+    dump_live_resume(s, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
     write_dump_bitmap(s, &local_err);
     if (local_err) {
         error_propagate(errp, local_err);
@@ -1800,6 +2133,10 @@ static void dump_init(DumpState *s, int fd, bool has_format,
             s->flag_compress = DUMP_DH_COMPRESSED_SNAPPY;
             break;
 
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD:
+            s->flag_compress = DUMP_DH_COMPRESSED_ZSTD;
+            break;
+
         default:
             s->flag_compress = 0;
         }
@@ -1915,7 +2252,9 @@ void qmp_dump_guest_memory(bool paging, const char *file,
                            bool has_detach, bool detach,
                            bool has_begin, int64_t begin, bool has_length,
                            int64_t length, bool has_format,
-                           DumpGuestMemoryFormat format, Error **errp)
+                           DumpGuestMemoryFormat format, bool has_threads,
+                           int64_t threads, bool has_live, bool live,
+                           Error **errp)
 {
     const char *p;
     int fd = -1;
@@ -1972,6 +2311,42 @@ void qmp_dump_guest_memory(bool paging, const char *file,
     }
 #endif
 
+#ifndef CONFIG_ZSTD
+    if (has_format && format == DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD) {
+        error_setg(errp, "kdump-zstd is not available now");
+        return;
+    }
+#endif
+
+    if (has_threads) {
+        if (!has_format || format == DUMP_GUEST_MEMORY_FORMAT_ELF ||
+            format == DUMP_GUEST_MEMORY_FORMAT_WIN_DMP) {
+            error_setg(errp, "'threads' is only supported by kdump-compressed "
+                       "formats");
+            return;
+        }
+        if (threads < 1 || threads > DUMP_COMPRESS_THREADS_MAX) {
+            error_setg(errp, "'threads' must be between 1 and %d",
+                       DUMP_COMPRESS_THREADS_MAX);
+            return;
+        }
+    } else {
+        long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = MIN(MAX(nprocs, 1), DUMP_COMPRESS_THREADS_DEFAULT);
+    }
+
+    if (has_live && live) {
+        if (!detach_p) {
+            error_setg(errp, "'live' requires 'detach'");
+            return;
+        }
+        if (has_format && format == DUMP_GUEST_MEMORY_FORMAT_WIN_DMP) {
+            error_setg(errp, "'live' is not supported by win-dmp");
+            return;
+        }
+    }
+
 #ifndef TARGET_X86_64
     if (has_format && format == DUMP_GUEST_MEMORY_FORMAT_WIN_DMP) {
         error_setg(errp, "Windows dump is only available for x86-64");
@@ -2018,6 +2393,8 @@ void qmp_dump_guest_memory(bool paging, const char *file,
 
     s = &dump_state_global;
     dump_state_prepare(s);
+    s->compress_threads = threads;
+    s->live = has_live && live;
 
     dump_init(s, fd, has_format, format, paging, has_begin,
               begin, length, &local_err);
@@ -2060,6 +2437,11 @@ DumpGuestMemoryCapability *qmp_query_dump_guest_memory_capability(Error **errp)
     QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY);
 #endif
 
+    /* add new item if kdump-zstd is available */
+#ifdef CONFIG_ZSTD
+    QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD);
+#endif
+
     /* Windows dump is available only if target is x86_64 */
 #ifdef TARGET_X86_64
     QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_WIN_DMP);
@@ -34,6 +34,29 @@ bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
     return false;
 }
 
+bool ebpf_rss_has_flow_table(struct EBPFRSSContext *ctx)
+{
+    return false;
+}
+
+bool ebpf_rss_set_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key, uint16_t queue)
+{
+    return false;
+}
+
+bool ebpf_rss_del_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key)
+{
+    return false;
+}
+
+bool ebpf_rss_get_queue_stats(struct EBPFRSSContext *ctx, uint64_t *packets,
+                              unsigned int nb_queues)
+{
+    return false;
+}
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx)
 {
 
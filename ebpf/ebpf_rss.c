@@ -65,6 +65,10 @@ bool ebpf_rss_load(struct EBPFRSSContext *ctx)
             rss_bpf_ctx->maps.tap_rss_map_indirection_table);
     ctx->map_toeplitz_key = bpf_map__fd(
             rss_bpf_ctx->maps.tap_rss_map_toeplitz_key);
+    ctx->map_flow_table = bpf_map__fd(
+            rss_bpf_ctx->maps.tap_rss_map_flow_table);
+    ctx->map_queue_stats = bpf_map__fd(
+            rss_bpf_ctx->maps.tap_rss_map_queue_stats);
 
     return true;
 error:
@@ -154,6 +158,67 @@ bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
     return true;
 }
 
+bool ebpf_rss_has_flow_table(struct EBPFRSSContext *ctx)
+{
+    return ebpf_rss_is_loaded(ctx);
+}
+
+bool ebpf_rss_set_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key, uint16_t queue)
+{
+    if (!ebpf_rss_has_flow_table(ctx) || queue >= EBPF_RSS_MAX_QUEUES) {
+        return false;
+    }
+    if (bpf_map_update_elem(ctx->map_flow_table, key, &queue, 0) < 0) {
+        trace_ebpf_error("eBPF RSS", "can not update flow table");
+        return false;
+    }
+    return true;
+}
+
+bool ebpf_rss_del_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key)
+{
+    if (!ebpf_rss_has_flow_table(ctx)) {
+        return false;
+    }
+    return bpf_map_delete_elem(ctx->map_flow_table, key) == 0;
+}
+
+/* Fills @packets with the number of packets steered to each queue */
+bool ebpf_rss_get_queue_stats(struct EBPFRSSContext *ctx, uint64_t *packets,
+                              unsigned int nb_queues)
+{
+    g_autofree uint64_t *values = NULL;
+    int nb_cpus;
+    uint32_t i;
+
+    if (!ebpf_rss_is_loaded(ctx) || nb_queues > EBPF_RSS_MAX_QUEUES) {
+        return false;
+    }
+
+    /* Per-CPU maps return one (8-byte aligned) value per possible CPU */
+    nb_cpus = libbpf_num_possible_cpus();
+    if (nb_cpus <= 0) {
+        return false;
+    }
+    values = g_new(uint64_t, nb_cpus);
+
+    for (i = 0; i < nb_queues; i++) {
+        int cpu;
+
+        if (bpf_map_lookup_elem(ctx->map_queue_stats, &i, values) < 0) {
+            trace_ebpf_error("eBPF RSS", "can not read queue statistics");
+            return false;
+        }
+        packets[i] = 0;
+        for (cpu = 0; cpu < nb_cpus; cpu++) {
+            packets[i] += values[cpu];
+        }
+    }
+    return true;
+}
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx)
 {
     if (!ebpf_rss_is_loaded(ctx)) {
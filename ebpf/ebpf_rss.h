@@ -14,12 +14,18 @@
 #ifndef QEMU_EBPF_RSS_H
 #define QEMU_EBPF_RSS_H
 
+/* Sizes of the flow table and queue statistics maps of the program */
+#define EBPF_RSS_FLOW_TABLE_SIZE 1024
+#define EBPF_RSS_MAX_QUEUES 256
+
 struct EBPFRSSContext {
     void *obj;
     int program_fd;
     int map_configuration;
     int map_toeplitz_key;
     int map_indirections_table;
+    int map_flow_table;
+    int map_queue_stats;
 };
 
 struct EBPFRSSConfig {
@@ -30,6 +36,21 @@ struct EBPFRSSConfig {
     uint16_t default_queue;
 } __attribute__((packed));
 
+/*
+ * Key of the flow table.  Addresses and ports are in network byte order,
+ * IPv4 addresses use the first 4 bytes and ports are 0 unless @protocol is
+ * TCP or UDP.  Unused bytes must be zero.
+ */
+struct EBPFRSSFlowKey {
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t protocol;
+    uint8_t is_ipv6;
+    uint8_t padding[2];
+} __attribute__((packed));
+
 void ebpf_rss_init(struct EBPFRSSContext *ctx);
 
 bool ebpf_rss_is_loaded(struct EBPFRSSContext *ctx);
@@ -39,6 +60,17 @@ bool ebpf_rss_load(struct EBPFRSSContext *ctx);
 bool ebpf_rss_set_all(struct EBPFRSSContext *ctx, struct EBPFRSSConfig *config,
                       uint16_t *indirections_table, uint8_t *toeplitz_key);
 
+bool ebpf_rss_has_flow_table(struct EBPFRSSContext *ctx);
+
+bool ebpf_rss_set_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key, uint16_t queue);
+
+bool ebpf_rss_del_flow(struct EBPFRSSContext *ctx,
+                       const struct EBPFRSSFlowKey *key);
+
+bool ebpf_rss_get_queue_stats(struct EBPFRSSContext *ctx, uint64_t *packets,
+                              unsigned int nb_queues);
+
 void ebpf_rss_unload(struct EBPFRSSContext *ctx);
 
 #endif /* QEMU_EBPF_RSS_H */
@@ -232,6 +232,17 @@ GEN_INPUT_FLUSH3(float64_input_flush3, float64)
 # define QEMU_SOFTFLOAT_ATTR QEMU_FLATTEN __attribute__((noinline))
 #endif
 
+/*
+ * Conversions to integer compute the inexact flag themselves instead of
+ * relying on it being already set, so they can use the host FPU even on
+ * targets that clear the flags.  They still require exact IEEE semantics.
+ */
+#if defined(__FAST_MATH__)
+# define QEMU_NO_HARDFLOAT_TO_INT 1
+#else
+# define QEMU_NO_HARDFLOAT_TO_INT 0
+#endif
+
 static inline bool can_use_fpu(const float_status *s)
 {
     if (QEMU_NO_HARDFLOAT) {
@@ -2805,6 +2816,28 @@ float32 float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (can_use_fpu(s)) {
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        float64_input_flush1(&ud.s, s);
+        if (float64_is_zero(ud.s)) {
+            return float32_set_sign(float32_zero, float64_is_neg(ud.s));
+        }
+        if (likely(float64_is_normal(ud.s))) {
+            /*
+             * Narrowing may be inexact, which is already set.  Leave
+             * overflow and anything that might be tiny to softfloat.
+             */
+            uf.h = ud.h;
+            if (likely(isless(fabsf(uf.h), FLT_MAX) &&
+                       isgreater(fabsf(uf.h), FLT_MIN))) {
+                return uf.s;
+            }
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2814,6 +2847,11 @@ float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
 
+    /* bfloat16 is the top half of a float32 */
+    if (likely(bfloat16_is_normal(a) || bfloat16_is_zero(a))) {
+        return make_float32((uint32_t)a << 16);
+    }
+
     bfloat16_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float32_round_pack_canonical(&p, s);
@@ -2823,6 +2861,10 @@ float64 bfloat16_to_float64(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
 
+    if (likely(bfloat16_is_normal(a) || bfloat16_is_zero(a))) {
+        return float32_to_float64(make_float32((uint32_t)a << 16), s);
+    }
+
     bfloat16_unpack_canonical(&p, a, s);
     parts_float_to_float(&p, s);
     return float64_round_pack_canonical(&p, s);
@@ -3064,10 +3106,55 @@ int16_t float32_to_int16_scalbn(float32 a, FloatRoundMode rmode, int scale,
     return parts_float_to_sint(&p, rmode, scale, INT16_MIN, INT16_MAX, s);
 }
 
+/*
+ * Convert @d to an integer no larger than @max in magnitude with the host
+ * FPU.  Returns false if the conversion has to be done in software, i.e.
+ * for NaNs, values out of range and rounding modes other than nearest-even
+ * (which the host FPU is assumed to use) and round-to-zero.
+ */
+static inline bool hard_float_to_sint(double d, FloatRoundMode rmode,
+                                      int scale, int64_t max,
+                                      float_status *s, int64_t *ret)
+{
+    double r;
+
+    if (QEMU_NO_HARDFLOAT_TO_INT || scale != 0) {
+        return false;
+    }
+    if (!(d > -(double)max && d < (double)max)) {
+        return false;
+    }
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        r = rint(d);
+        break;
+    case float_round_to_zero:
+        r = trunc(d);
+        break;
+    default:
+        return false;
+    }
+
+    if (r != d) {
+        float_raise(float_flag_inexact, s);
+    }
+    *ret = r;
+    return true;
+}
+
 int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    int64_t ret;
+
+    ua.s = a;
+    float32_input_flush1(&ua.s, s);
+    if (hard_float_to_sint(ua.h, rmode, scale, INT32_MAX, s, &ret)) {
+        return ret;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3077,6 +3164,14 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float32 ua;
+    int64_t ret;
+
+    ua.s = a;
+    float32_input_flush1(&ua.s, s);
+    if (hard_float_to_sint(ua.h, rmode, scale, INT64_MAX, s, &ret)) {
+        return ret;
+    }
 
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3095,6 +3190,14 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    int64_t ret;
+
+    ua.s = a;
+    float64_input_flush1(&ua.s, s);
+    if (hard_float_to_sint(ua.h, rmode, scale, INT32_MAX, s, &ret)) {
+        return ret;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
@@ -3104,6 +3207,14 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
     FloatParts64 p;
+    union_float64 ua;
+    int64_t ret;
+
+    ua.s = a;
+    float64_input_flush1(&ua.s, s);
+    if (hard_float_to_sint(ua.h, rmode, scale, INT64_MAX, s, &ret)) {
+        return ret;
+    }
 
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
@@ -3999,6 +4110,21 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
 static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float32 ua, ub;
+
+    ua.s = a;
+    ub.s = b;
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag)) {
+        float32_input_flush2(&ua.s, &ub.s, s);
+        /* Equal values may still be zeroes of different sign */
+        if (f32_is_zon2(ua, ub) && ua.h != ub.h) {
+            bool a_less = isless(ua.h, ub.h);
+
+            return a_less == !!(flags & minmax_ismin) ? ua.s : ub.s;
+        }
+        a = ua.s;
+        b = ub.s;
+    }
 
     float32_unpack_canonical(&pa, a, s);
     float32_unpack_canonical(&pb, b, s);
@@ -4010,6 +4136,21 @@ static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
+    union_float64 ua, ub;
+
+    ua.s = a;
+    ub.s = b;
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag)) {
+        float64_input_flush2(&ua.s, &ub.s, s);
+        /* Equal values may still be zeroes of different sign */
+        if (f64_is_zon2(ua, ub) && ua.h != ub.h) {
+            bool a_less = isless(ua.h, ub.h);
+
+            return a_less == !!(flags & minmax_ismin) ? ua.s : ub.s;
+        }
+        a = ua.s;
+        b = ub.s;
+    }
 
     float64_unpack_canonical(&pa, a, s);
     float64_unpack_canonical(&pb, b, s);
@@ -167,6 +167,35 @@ SRST
     Show the interrupts statistics (if available).
 ERST
 
+    {
+        .name       = "rcu",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show RCU grace period and callback statistics",
+        .cmd_info_hrt = qmp_x_query_rcu,
+    },
+
+SRST
+  ``info rcu``
+    Show the number and latency of RCU grace periods and the number of
+    RCU callbacks that were run.
+ERST
+
+    {
+        .name       = "coroutine-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the samples of the coroutine profiler",
+        .cmd_info_hrt = qmp_x_query_coroutine_profile,
+    },
+
+SRST
+  ``info coroutine-profile``
+    Show the samples recorded by the coroutine profiler (see the QMP command
+    ``x-coroutine-profile``) in the folded stack format used by flame graph
+    tools.
+ERST
+
     {
         .name       = "pic",
         .args_type  = "",
@@ -281,6 +310,21 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the most executed translation blocks",
+    },
+#endif
+
+SRST
+  ``info tb-stats``
+    Show execution, translation and invalidation counts of the most
+    executed translation blocks. Requires ``-accel tcg,tb-stats=on``.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -305,6 +349,11 @@ SRST
     When different objects that share the same call site are coalesced,
     the "Object" field shows---enclosed in brackets---the number of objects
     being coalesced.
+
+    Besides mutexes and condition variables, the profile covers coroutine
+    mutexes, rwlocks and queues, and threads waiting for RCU grace periods.
+    The same data is available through the QMP command
+    ``x-query-sync-profile``.
 ERST
 
     {
@@ -865,6 +914,19 @@ SRST
     Display the vcpu dirty rate information.
 ERST
 
+    {
+        .name       = "vcpu_dirty_limit",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show dirty page limit information of all vCPU",
+        .cmd        = hmp_info_vcpu_dirty_limit,
+    },
+
+SRST
+  ``info vcpu_dirty_limit``
+    Display the vcpu dirty page limit information.
+ERST
+
 #if defined(TARGET_I386)
     {
         .name       = "sgx",
@@ -43,13 +43,40 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /*
+     * With the iothreads property, virtqueue i is serviced by
+     * iothreads[i % num_iothreads] and vq_ctx[i] is its AioContext.  The
+     * BlockBackend stays in iothreads[0], i.e. s->ctx, and requests from
+     * the other IOThreads are submitted with s->ctx acquired.
+     */
+    IOThread **iothreads;
+    unsigned num_iothreads;
+    AioContext **vq_ctx;
+
+    /* External events of the vq_ctx other than s->ctx are disabled */
+    bool vq_ctx_quiesced;
 };
 
+/* Is @ctx one of the AioContexts that service the virtqueues? */
+static bool virtio_blk_data_plane_uses_ctx(VirtIOBlockDataPlane *s,
+                                            AioContext *ctx, unsigned n)
+{
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        if (s->vq_ctx[i] == ctx) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /* Raise an interrupt to signal guest, if necessary */
 void virtio_blk_data_plane_notify(VirtIOBlockDataPlane *s, VirtQueue *vq)
 {
     if (s->batch_notifications) {
-        set_bit(virtio_get_queue_index(vq), s->batch_notify_vqs);
+        set_bit_atomic(virtio_get_queue_index(vq), s->batch_notify_vqs);
         qemu_bh_schedule(s->bh);
     } else {
         virtio_notify_irqfd(s->vdev, vq);
@@ -63,9 +90,12 @@ static void notify_guest_bh(void *opaque)
     unsigned long bitmap[BITS_TO_LONGS(nvqs)];
     unsigned j;
 
-    memcpy(bitmap, s->batch_notify_vqs, sizeof(bitmap));
-    memset(s->batch_notify_vqs, 0, sizeof(bitmap));
+    /* Requests can be completed from any of the virtqueue IOThreads */
+    for (j = 0; j < BITS_TO_LONGS(nvqs); j++) {
+        bitmap[j] = qatomic_xchg(&s->batch_notify_vqs[j], 0);
+    }
 
+    aio_context_acquire(s->ctx);
     for (j = 0; j < nvqs; j += BITS_PER_LONG) {
         unsigned long bits = bitmap[j / BITS_PER_LONG];
 
@@ -78,6 +108,7 @@ static void notify_guest_bh(void *opaque)
             bits &= bits - 1; /* clear right-most bit */
         }
     }
+    aio_context_release(s->ctx);
 }
 
 /* Context: QEMU global mutex held */
@@ -88,10 +119,16 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     VirtIOBlockDataPlane *s;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    unsigned i;
 
     *dataplane = NULL;
 
-    if (conf->iothread) {
+    if (conf->iothread && conf->num_iothreads) {
+        error_setg(errp, "iothread and iothreads cannot be used together");
+        return false;
+    }
+
+    if (conf->iothread || conf->num_iothreads) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -120,13 +157,42 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s->vdev = vdev;
     s->conf = conf;
 
-    if (conf->iothread) {
+    if (conf->num_iothreads) {
+        s->iothreads = g_new0(IOThread *, conf->num_iothreads);
+        for (i = 0; i < conf->num_iothreads; i++) {
+            IOThread *iothread = iothread_by_id(conf->iothreads[i] ?: "");
+
+            if (!iothread) {
+                error_setg(errp, "IOThread '%s' not found",
+                           conf->iothreads[i] ?: "");
+                while (i--) {
+                    object_unref(OBJECT(s->iothreads[i]));
+                }
+                g_free(s->iothreads);
+                g_free(s);
+                return false;
+            }
+            object_ref(OBJECT(iothread));
+            s->iothreads[i] = iothread;
+        }
+        s->num_iothreads = conf->num_iothreads;
+        s->iothread = s->iothreads[0];
+        object_ref(OBJECT(s->iothread));
+        s->ctx = iothread_get_aio_context(s->iothread);
+    } else if (conf->iothread) {
         s->iothread = conf->iothread;
         object_ref(OBJECT(s->iothread));
         s->ctx = iothread_get_aio_context(s->iothread);
     } else {
         s->ctx = qemu_get_aio_context();
     }
+
+    s->vq_ctx = g_new(AioContext *, conf->num_queues);
+    for (i = 0; i < conf->num_queues; i++) {
+        s->vq_ctx[i] = s->num_iothreads ?
+            iothread_get_aio_context(s->iothreads[i % s->num_iothreads]) :
+            s->ctx;
+    }
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
 
@@ -139,6 +205,7 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 {
     VirtIOBlock *vblk;
+    unsigned i;
 
     if (!s) {
         return;
@@ -151,6 +218,11 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
     if (s->iothread) {
         object_unref(OBJECT(s->iothread));
     }
+    for (i = 0; i < s->num_iothreads; i++) {
+        object_unref(OBJECT(s->iothreads[i]));
+    }
+    g_free(s->iothreads);
+    g_free(s->vq_ctx);
     g_free(s);
 }
 
@@ -232,6 +304,13 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
         goto fail_aio_context;
     }
 
+    /* Completions, and thus interrupts, happen in the BlockBackend context */
+    for (i = 0; i < nvqs; i++) {
+        virtio_queue_set_coalescing(virtio_get_queue(s->vdev, i), s->ctx,
+                                    s->conf->coalesce_usecs,
+                                    s->conf->coalesce_frames);
+    }
+
     /* Process queued requests before the ones in vring */
     virtio_blk_process_queued_requests(vblk, false);
 
@@ -243,13 +322,13 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     }
 
     /* Get this show started by hooking up our callbacks */
-    aio_context_acquire(s->ctx);
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_attach_host_notifier(vq, s->ctx);
+        aio_context_acquire(s->vq_ctx[i]);
+        virtio_queue_aio_attach_host_notifier(vq, s->vq_ctx[i]);
+        aio_context_release(s->vq_ctx[i]);
     }
-    aio_context_release(s->ctx);
     return 0;
 
   fail_aio_context:
@@ -278,19 +357,86 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     return -ENOSYS;
 }
 
+typedef struct {
+    VirtIOBlockDataPlane *s;
+    AioContext *ctx;
+} VirtIOBlockDataPlaneStopBH;
+
 /* Stop notifications for new requests from guest.
  *
  * Context: BH in IOThread
  */
 static void virtio_blk_data_plane_stop_bh(void *opaque)
 {
-    VirtIOBlockDataPlane *s = opaque;
+    VirtIOBlockDataPlaneStopBH *data = opaque;
+    VirtIOBlockDataPlane *s = data->s;
     unsigned i;
 
     for (i = 0; i < s->conf->num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_detach_host_notifier(vq, s->ctx);
+        if (s->vq_ctx[i] == data->ctx) {
+            virtio_queue_aio_detach_host_notifier(vq, data->ctx);
+        }
+    }
+}
+
+/*
+ * Stop or resume guest notifications in the virtqueue AioContexts that the
+ * block layer does not know about, while the BlockBackend is drained.
+ *
+ * Context: BlockBackend AioContext acquired
+ */
+void virtio_blk_data_plane_drained_begin(VirtIOBlockDataPlane *s)
+{
+    VirtIOBlock *vblk = VIRTIO_BLK(s->vdev);
+    unsigned i;
+
+    if (!s->num_iothreads || !vblk->dataplane_started ||
+        vblk->dataplane_disabled || s->vq_ctx_quiesced) {
+        return;
+    }
+
+    for (i = 0; i < s->conf->num_queues; i++) {
+        if (s->vq_ctx[i] != s->ctx &&
+            !virtio_blk_data_plane_uses_ctx(s, s->vq_ctx[i], i)) {
+            aio_disable_external(s->vq_ctx[i]);
+        }
+    }
+    s->vq_ctx_quiesced = true;
+}
+
+void virtio_blk_data_plane_drained_end(VirtIOBlockDataPlane *s)
+{
+    unsigned i;
+
+    if (!s->vq_ctx_quiesced) {
+        return;
+    }
+
+    for (i = 0; i < s->conf->num_queues; i++) {
+        if (s->vq_ctx[i] != s->ctx &&
+            !virtio_blk_data_plane_uses_ctx(s, s->vq_ctx[i], i)) {
+            aio_enable_external(s->vq_ctx[i]);
+        }
+    }
+    s->vq_ctx_quiesced = false;
+}
+
+/*
+ * Moves the coalescing timers back to the main loop.  Runs in the IOThread,
+ * so that they cannot fire meanwhile.
+ */
+static void virtio_blk_data_plane_stop_coalescing_bh(void *opaque)
+{
+    VirtIOBlockDataPlane *s = opaque;
+    unsigned i;
+
+    for (i = 0; i < s->conf->num_queues; i++) {
+        virtio_queue_set_coalescing(virtio_get_queue(s->vdev, i),
+                                    qemu_get_aio_context(),
+                                    s->conf->coalesce_usecs,
+                                    s->conf->coalesce_frames);
     }
 }
 
@@ -317,8 +463,20 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     s->stopping = true;
     trace_virtio_blk_data_plane_stop(s);
 
+    for (i = 0; i < nvqs; i++) {
+        VirtIOBlockDataPlaneStopBH data = { .s = s, .ctx = s->vq_ctx[i] };
+
+        /* One BH for each AioContext */
+        if (virtio_blk_data_plane_uses_ctx(s, s->vq_ctx[i], i)) {
+            continue;
+        }
+        aio_context_acquire(data.ctx);
+        aio_wait_bh_oneshot(data.ctx, virtio_blk_data_plane_stop_bh, &data);
+        aio_context_release(data.ctx);
+    }
+    virtio_blk_data_plane_drained_end(s);
+
     aio_context_acquire(s->ctx);
-    aio_wait_bh_oneshot(s->ctx, virtio_blk_data_plane_stop_bh, s);
 
     /* Drain and try to switch bs back to the QEMU main loop. If other users
      * keep the BlockBackend in the iothread, that's ok */
@@ -349,6 +507,10 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     qemu_bh_cancel(s->bh);
     notify_guest_bh(s); /* final chance to notify guest */
 
+    aio_context_acquire(s->ctx);
+    aio_wait_bh_oneshot(s->ctx, virtio_blk_data_plane_stop_coalescing_bh, s);
+    aio_context_release(s->ctx);
+
     /* Clean up guest notifier (irq) */
     k->set_guest_notifiers(qbus->parent, nvqs, false);
 
@@ -17,6 +17,7 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine.h"
 #include "trace.h"
 #include "hw/block/block.h"
 #include "hw/qdev-properties.h"
@@ -69,7 +70,7 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_element_free(req->vq, req);
 }
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
@@ -90,6 +91,46 @@ static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
     }
 }
 
+/*
+ * Completes @n successful requests of the same virtqueue with a single
+ * update of the used ring and a single notification.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int n)
+{
+    VirtIOBlock *s = reqs[0]->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtQueue *vq = reqs[0]->vq;
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i;
+
+    assert(n <= VIRTIO_BLK_MAX_MERGE_REQS);
+    for (i = 0; i < n; i++) {
+        VirtIOBlockReq *req = reqs[i];
+
+        assert(req->vq == vq);
+        trace_virtio_blk_req_complete(vdev, req, VIRTIO_BLK_S_OK);
+        stb_p(&req->in->status, VIRTIO_BLK_S_OK);
+        iov_discard_undo(&req->inhdr_undo);
+        iov_discard_undo(&req->outhdr_undo);
+        elems[i] = &req->elem;
+        lens[i] = req->in_len;
+    }
+
+    virtqueue_push_batch(vq, elems, lens, n);
+    if (s->dataplane_started && !s->dataplane_disabled) {
+        virtio_blk_data_plane_notify(s->dataplane, vq);
+    } else {
+        virtio_notify(vdev, vq);
+    }
+
+    for (i = 0; i < n; i++) {
+        block_acct_done(blk_get_stats(s->blk), &reqs[i]->acct);
+        virtio_blk_free_request(reqs[i]);
+    }
+}
+
 static int virtio_blk_handle_rw_error(VirtIOBlockReq *req, int error,
     bool is_read, bool acct_failed)
 {
@@ -119,6 +160,8 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int num_done = 0;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
     while (next) {
@@ -149,9 +192,15 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-        block_acct_done(blk_get_stats(s->blk), &req->acct);
-        virtio_blk_free_request(req);
+        if (num_done && (done[0]->vq != req->vq ||
+                         num_done == ARRAY_SIZE(done))) {
+            virtio_blk_req_complete_batch(done, num_done);
+            num_done = 0;
+        }
+        done[num_done++] = req;
+    }
+    if (num_done) {
+        virtio_blk_req_complete_batch(done, num_done);
     }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
@@ -253,14 +302,17 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, n;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, max);
+    for (i = 0; i < n; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return n;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -767,10 +819,66 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     return 0;
 }
 
+/* Called with the AioContext of s->blk held */
+static void virtio_blk_submit_merge_window(VirtIOBlock *s)
+{
+    if (!s->merge_pending) {
+        return;
+    }
+
+    s->merge_pending = false;
+    if (s->merge_mrb->num_reqs) {
+        blk_io_plug(s->blk);
+        virtio_blk_submit_multireq(s->blk, s->merge_mrb);
+        blk_io_unplug(s->blk);
+    }
+    blk_dec_in_flight(s->blk);
+}
+
+static void virtio_blk_merge_timer_cb(void *opaque)
+{
+    VirtIOBlock *s = opaque;
+    AioContext *ctx = blk_get_aio_context(s->blk);
+
+    aio_context_acquire(ctx);
+    virtio_blk_submit_merge_window(s);
+    aio_context_release(ctx);
+}
+
+/*
+ * Keeps the requests left over by a pass over a virtqueue for up to
+ * merge-window-usecs, so that requests from other virtqueues can be merged
+ * with them.  They count as in flight, so draining submits them early.
+ * Called with the AioContext of s->blk held.
+ */
+static void virtio_blk_start_merge_window(VirtIOBlock *s)
+{
+    AioContext *ctx = blk_get_aio_context(s->blk);
+
+    if (s->merge_pending || !s->merge_mrb->num_reqs) {
+        return;
+    }
+
+    /* The BlockBackend moved, which drained it, so the timer is idle */
+    if (s->merge_timer_ctx != ctx) {
+        timer_free(s->merge_timer);
+        s->merge_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_US,
+                                       virtio_blk_merge_timer_cb, s);
+        s->merge_timer_ctx = ctx;
+    }
+
+    s->merge_pending = true;
+    blk_inc_in_flight(s->blk);
+    timer_mod(s->merge_timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) +
+                              s->conf.merge_window_usecs);
+}
+
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
-    MultiReqBuffer mrb = {};
+    VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, n;
+    MultiReqBuffer local_mrb = {};
+    MultiReqBuffer *mrb = s->merge_mrb ?: &local_mrb;
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
     aio_context_acquire(blk_get_aio_context(s->blk));
@@ -781,10 +889,18 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+        while ((n = virtio_blk_get_requests(s, vq, reqs, ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < n; i++) {
+                if (virtio_blk_handle_request(reqs[i], mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken, drop the rest of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -794,8 +910,10 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
         }
     } while (!virtio_queue_empty(vq));
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
+    if (mrb == s->merge_mrb) {
+        virtio_blk_start_merge_window(s);
+    } else if (mrb->num_reqs) {
+        virtio_blk_submit_multireq(s->blk, mrb);
     }
 
     blk_io_unplug(s->blk);
@@ -1130,8 +1248,28 @@ static void virtio_blk_resize(void *opaque)
     aio_bh_schedule_oneshot(qemu_get_aio_context(), virtio_resize_cb, vdev);
 }
 
+static void virtio_blk_drained_begin(void *opaque)
+{
+    VirtIOBlock *s = opaque;
+
+    if (s->dataplane) {
+        virtio_blk_data_plane_drained_begin(s->dataplane);
+    }
+}
+
+static void virtio_blk_drained_end(void *opaque)
+{
+    VirtIOBlock *s = opaque;
+
+    if (s->dataplane) {
+        virtio_blk_data_plane_drained_end(s->dataplane);
+    }
+}
+
 static const BlockDevOps virtio_block_ops = {
     .resize_cb = virtio_blk_resize,
+    .drained_begin = virtio_blk_drained_begin,
+    .drained_end = virtio_blk_drained_end,
 };
 
 static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
@@ -1212,7 +1350,12 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
 
     for (i = 0; i < conf->num_queues; i++) {
-        virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
+        VirtQueue *vq = virtio_add_queue(vdev, conf->queue_size,
+                                         virtio_blk_handle_output);
+
+        virtio_queue_set_coalescing(vq, qemu_get_aio_context(),
+                                    conf->coalesce_usecs,
+                                    conf->coalesce_frames);
     }
     virtio_blk_data_plane_create(vdev, conf, &s->dataplane, &err);
     if (err != NULL) {
@@ -1224,12 +1367,19 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (conf->merge_window_usecs && conf->request_merging) {
+        s->merge_mrb = g_new0(MultiReqBuffer, 1);
+    }
+
     s->change = qemu_add_vm_change_state_handler(virtio_blk_dma_restart_cb, s);
     blk_set_dev_ops(s->blk, &virtio_block_ops, s);
     blk_set_guest_block_size(s->blk, s->conf.conf.logical_block_size);
 
     blk_iostatus_enable(s->blk);
 
+    /* Each request in flight holds a coroutine */
+    qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
+
     add_boot_device_lchs(dev, "/disk@0,0",
                          conf->conf.lcyls,
                          conf->conf.lheads,
@@ -1244,6 +1394,7 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
     unsigned i;
 
     blk_drain(s->blk);
+    qemu_coroutine_dec_pool_size(conf->num_queues * conf->queue_size / 2);
     del_boot_device_lchs(dev, "/disk@0,0");
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
@@ -1251,6 +1402,8 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
         virtio_del_queue(vdev, i);
     }
     qemu_del_vm_change_state_handler(s->change);
+    timer_free(s->merge_timer);
+    g_free(s->merge_mrb);
     blockdev_mark_auto_del(s->blk);
     virtio_cleanup(vdev);
 }
@@ -1287,6 +1440,8 @@ static Property virtio_blk_properties[] = {
 #endif
     DEFINE_PROP_BIT("request-merging", VirtIOBlock, conf.request_merging, 0,
                     true),
+    DEFINE_PROP_UINT32("merge-window-usecs", VirtIOBlock,
+                       conf.merge_window_usecs, 0),
     DEFINE_PROP_UINT16("num-queues", VirtIOBlock, conf.num_queues,
                        VIRTIO_BLK_AUTO_NUM_QUEUES),
     DEFINE_PROP_UINT16("queue-size", VirtIOBlock, conf.queue_size, 256),
@@ -1303,6 +1458,9 @@ static Property virtio_blk_properties[] = {
                        conf.max_discard_sectors, BDRV_REQUEST_MAX_SECTORS),
     DEFINE_PROP_UINT32("max-write-zeroes-sectors", VirtIOBlock,
                        conf.max_write_zeroes_sectors, BDRV_REQUEST_MAX_SECTORS),
+    DEFINE_PROP_UINT32("coalesce-usecs", VirtIOBlock, conf.coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("coalesce-frames", VirtIOBlock, conf.coalesce_frames,
+                       0),
     DEFINE_PROP_BOOL("x-enable-wce-if-config-wce", VirtIOBlock,
                      conf.x_enable_wce_if_config_wce, true),
     DEFINE_PROP_END_OF_LIST(),
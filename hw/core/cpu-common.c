@@ -238,6 +238,7 @@ static void cpu_common_initfn(Object *obj)
     cpu->nr_threads = 1;
 
     qemu_mutex_init(&cpu->work_mutex);
+    qemu_lockcnt_init(&cpu->kvm_in_ioctl_lock);
     QSIMPLEQ_INIT(&cpu->work_list);
     QTAILQ_INIT(&cpu->breakpoints);
     QTAILQ_INIT(&cpu->watchpoints);
@@ -250,6 +251,7 @@ static void cpu_common_finalize(Object *obj)
     CPUState *cpu = CPU(obj);
 
     qemu_mutex_destroy(&cpu->work_mutex);
+    qemu_lockcnt_destroy(&cpu->kvm_in_ioctl_lock);
 }
 
 static int64_t cpu_common_get_arch_id(CPUState *cpu)
@@ -244,3 +244,23 @@ HumanReadableText *qmp_x_query_numa(Error **errp)
  done:
     return human_readable_text_from_str(buf);
 }
+
+InitPhaseInfoList *qmp_x_query_init_phases(Error **errp)
+{
+    InitPhaseInfoList *head = NULL, **tail = &head;
+    MachineInitPhase phase;
+
+    for (phase = PHASE_NO_MACHINE; phase <= PHASE_MACHINE_READY; phase++) {
+        InitPhaseInfo *info;
+
+        if (!phase_check(phase)) {
+            break;
+        }
+        info = g_new0(InitPhaseInfo, 1);
+        info->phase = g_strdup(phase_get_name(phase));
+        info->time = phase_get_time(phase) / SCALE_US;
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
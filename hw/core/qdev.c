@@ -33,6 +33,7 @@
 #include "qapi/visitor.h"
 #include "qemu/error-report.h"
 #include "qemu/option.h"
+#include "qemu/timer.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "hw/boards.h"
@@ -909,6 +910,15 @@ Object *qdev_get_machine(void)
 }
 
 static MachineInitPhase machine_phase;
+static int64_t machine_phase_time[PHASE_MACHINE_READY + 1];
+
+static const char *const machine_phase_name[] = {
+    [PHASE_NO_MACHINE] = "no-machine",
+    [PHASE_MACHINE_CREATED] = "machine-created",
+    [PHASE_ACCEL_CREATED] = "accel-created",
+    [PHASE_MACHINE_INITIALIZED] = "machine-initialized",
+    [PHASE_MACHINE_READY] = "machine-ready",
+};
 
 bool phase_check(MachineInitPhase phase)
 {
@@ -919,6 +929,23 @@ void phase_advance(MachineInitPhase phase)
 {
     assert(machine_phase == phase - 1);
     machine_phase = phase;
+    machine_phase_time[phase] = get_clock();
+    trace_phase_advance(machine_phase_name[phase],
+                        phase_get_time(phase) / SCALE_US);
+}
+
+const char *phase_get_name(MachineInitPhase phase)
+{
+    return machine_phase_name[phase];
+}
+
+int64_t phase_get_time(MachineInitPhase phase)
+{
+    /* Process start is when qemu-timer-common.c sets clock_start */
+    if (phase == PHASE_NO_MACHINE) {
+        return 0;
+    }
+    return machine_phase_time[phase] - clock_start;
 }
 
 static const TypeInfo device_type_info = {
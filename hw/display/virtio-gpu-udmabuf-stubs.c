@@ -17,6 +17,13 @@ void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
     /* nothing (stub) */
 }
 
+void *virtio_gpu_init_udmabuf_2d(struct virtio_gpu_simple_resource *res,
+                                 size_t size, bool use_udmabuf)
+{
+    res->dmabuf_fd = -1;
+    return res->iov_cnt == 1 ? res->iov[0].iov_base : NULL;
+}
+
 int virtio_gpu_update_dmabuf(VirtIOGPU *g,
                              uint32_t scanout_id,
                              struct virtio_gpu_simple_resource *res,
@@ -26,3 +33,8 @@ int virtio_gpu_update_dmabuf(VirtIOGPU *g,
     /* nothing (stub) */
     return 0;
 }
+
+void virtio_gpu_release_dmabuf(VirtIOGPU *g, uint32_t scanout_id)
+{
+    /* nothing (stub) */
+}
@@ -68,21 +68,24 @@ static void virtio_gpu_create_udmabuf(struct virtio_gpu_simple_resource *res)
     g_free(list);
 }
 
-static void virtio_gpu_remap_udmabuf(struct virtio_gpu_simple_resource *res)
+static void virtio_gpu_remap_udmabuf(struct virtio_gpu_simple_resource *res,
+                                     uint64_t size)
 {
-    res->remapped = mmap(NULL, res->blob_size, PROT_READ,
+    res->remapped = mmap(NULL, size, PROT_READ,
                          MAP_SHARED, res->dmabuf_fd, 0);
     if (res->remapped == MAP_FAILED) {
         warn_report("%s: dmabuf mmap failed: %s", __func__,
                     strerror(errno));
         res->remapped = NULL;
+        return;
     }
+    res->remapped_size = size;
 }
 
 static void virtio_gpu_destroy_udmabuf(struct virtio_gpu_simple_resource *res)
 {
     if (res->remapped) {
-        munmap(res->remapped, res->blob_size);
+        munmap(res->remapped, res->remapped_size);
         res->remapped = NULL;
     }
     if (res->dmabuf_fd >= 0) {
@@ -117,15 +120,14 @@ bool virtio_gpu_have_udmabuf(void)
     int udmabuf;
     bool memfd_backend = false;
 
-    udmabuf = udmabuf_fd();
-    if (udmabuf < 0) {
-        return false;
-    }
-
     memdev_root = object_resolve_path("/objects", NULL);
     object_child_foreach(memdev_root, find_memory_backend_type, &memfd_backend);
+    if (!memfd_backend) {
+        return false;
+    }
 
-    return memfd_backend;
+    udmabuf = udmabuf_fd();
+    return udmabuf >= 0;
 }
 
 void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
@@ -140,7 +142,7 @@ void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
         if (res->dmabuf_fd < 0) {
             return;
         }
-        virtio_gpu_remap_udmabuf(res);
+        virtio_gpu_remap_udmabuf(res, res->blob_size);
         if (!res->remapped) {
             return;
         }
@@ -150,11 +152,47 @@ void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
     res->blob = pdata;
 }
 
-void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
+/*
+ * Returns a contiguous mapping of the first @size bytes of the backing of a
+ * 2D resource, or NULL.  If @use_udmabuf, the backing is also exported as
+ * a dmabuf, which is needed to map several entries contiguously.
+ */
+void *virtio_gpu_init_udmabuf_2d(struct virtio_gpu_simple_resource *res,
+                                 size_t size, bool use_udmabuf)
 {
-    if (res->remapped) {
+    int i;
+
+    res->dmabuf_fd = -1;
+    for (i = 0; i < res->iov_cnt && use_udmabuf; i++) {
+        /* udmabuf only takes whole pages */
+        if (!QEMU_PTR_IS_ALIGNED(res->iov[i].iov_base,
+                                 qemu_real_host_page_size) ||
+            !QEMU_IS_ALIGNED(res->iov[i].iov_len, qemu_real_host_page_size)) {
+            use_udmabuf = false;
+        }
+    }
+
+    if (use_udmabuf) {
+        virtio_gpu_create_udmabuf(res);
+    }
+    if (res->iov_cnt == 1) {
+        return res->iov[0].iov_base;
+    }
+    if (res->dmabuf_fd < 0) {
+        return NULL;
+    }
+
+    virtio_gpu_remap_udmabuf(res, ROUND_UP(size, qemu_real_host_page_size));
+    if (!res->remapped) {
         virtio_gpu_destroy_udmabuf(res);
+        return NULL;
     }
+    return res->remapped;
+}
+
+void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    virtio_gpu_destroy_udmabuf(res);
 }
 
 static void virtio_gpu_free_dmabuf(VirtIOGPU *g, VGPUDMABuf *dmabuf)
@@ -228,3 +266,14 @@ int virtio_gpu_update_dmabuf(VirtIOGPU *g,
 
     return 0;
 }
+
+/* Stops backing @scanout_id with a dmabuf, once it shows something else */
+void virtio_gpu_release_dmabuf(VirtIOGPU *g, uint32_t scanout_id)
+{
+    VGPUDMABuf *primary = g->dmabuf.primary[scanout_id];
+
+    if (primary) {
+        g->dmabuf.primary[scanout_id] = NULL;
+        virtio_gpu_free_dmabuf(g, primary);
+    }
+}
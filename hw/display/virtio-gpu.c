@@ -467,6 +467,11 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
         return;
     }
 
+    if (res->zero_copy) {
+        /* the image already is the backing */
+        return;
+    }
+
     format = pixman_image_get_format(res->image);
     bpp = DIV_ROUND_UP(PIXMAN_FORMAT_BPP(format), 8);
     stride = pixman_image_get_stride(res->image);
@@ -548,6 +553,13 @@ static void virtio_gpu_resource_flush(VirtIOGPU *g,
         }
         scanout = &g->parent_obj.scanout[i];
 
+        if (res->zero_copy && res->dmabuf_fd >= 0 &&
+            console_has_gl(scanout->con)) {
+            dpy_gl_update(scanout->con, 0, 0, scanout->width,
+                          scanout->height);
+            continue;
+        }
+
         pixman_region_init(&finalregion);
         pixman_region_init_rect(&region, scanout->x, scanout->y,
                                 scanout->width, scanout->height);
@@ -625,14 +637,15 @@ static void virtio_gpu_do_set_scanout(VirtIOGPU *g,
 
     g->parent_obj.enable = 1;
 
-    if (res->blob) {
-        if (console_has_gl(scanout->con)) {
-            if (!virtio_gpu_update_dmabuf(g, scanout_id, res, fb, r)) {
-                virtio_gpu_update_scanout(g, scanout_id, res, r);
-                return;
-            }
+    if ((res->blob || (res->zero_copy && res->dmabuf_fd >= 0)) &&
+        console_has_gl(scanout->con)) {
+        if (!virtio_gpu_update_dmabuf(g, scanout_id, res, fb, r)) {
+            virtio_gpu_update_scanout(g, scanout_id, res, r);
+            return;
         }
+    }
 
+    if (res->blob) {
         data = res->blob;
     } else {
         data = (uint8_t *)pixman_image_get_data(res->image);
@@ -876,11 +889,115 @@ static void virtio_gpu_cleanup_mapping(VirtIOGPU *g,
     g_free(res->addrs);
     res->addrs = NULL;
 
-    if (res->blob) {
+    if (res->blob || res->zero_copy) {
         virtio_gpu_fini_udmabuf(res);
+        res->zero_copy = false;
     }
 }
 
+/*
+ * Make the image of a 2D resource point to its backing, so that transfers
+ * need no copy and the display can import it as a dmabuf.  This relies on
+ * the guest laying out the backing like the image, which transfers with the
+ * image stride already assume.
+ */
+static void virtio_gpu_zero_copy_attach(VirtIOGPU *g,
+                                        struct virtio_gpu_simple_resource *res)
+{
+    pixman_format_code_t format;
+    pixman_image_t *image;
+    uint32_t stride;
+    size_t size;
+    void *data;
+
+    /* the scanouts reference the current image */
+    if (!virtio_gpu_zero_copy_enabled(g->parent_obj.conf) ||
+        res->scanout_bitmask) {
+        return;
+    }
+
+    format = pixman_image_get_format(res->image);
+    stride = pixman_image_get_stride(res->image);
+    size = (size_t)stride * res->height;
+    if (PIXMAN_FORMAT_BPP(format) != 32 ||
+        iov_size(res->iov, res->iov_cnt) < size) {
+        return;
+    }
+
+    data = virtio_gpu_init_udmabuf_2d(res, size, g->zero_copy_udmabuf);
+    if (!data) {
+        virtio_gpu_fini_udmabuf(res);
+        return;
+    }
+
+    image = pixman_image_create_bits(format, res->width, res->height,
+                                     data, stride);
+    if (!image) {
+        virtio_gpu_fini_udmabuf(res);
+        return;
+    }
+
+    pixman_image_unref(res->image);
+    res->image = image;
+    res->zero_copy = true;
+    trace_virtio_gpu_zero_copy_attach(res->resource_id, res->iov_cnt,
+                                      res->dmabuf_fd >= 0);
+}
+
+static void virtio_gpu_free_image_data(pixman_image_t *image, void *data)
+{
+    g_free(data);
+}
+
+/*
+ * Give a zero-copy resource an image of its own before its backing goes
+ * away, keeping its content and the scanouts that show it.
+ */
+static void virtio_gpu_zero_copy_detach(VirtIOGPU *g,
+                                        struct virtio_gpu_simple_resource *res)
+{
+    pixman_image_t *image = res->image;
+    struct virtio_gpu_framebuffer fb = { 0 };
+    struct virtio_gpu_scanout *scanout;
+    struct virtio_gpu_rect r;
+    uint32_t error = 0;
+    size_t size;
+    void *data;
+    int i;
+
+    fb.format = pixman_image_get_format(image);
+    fb.bytes_pp = DIV_ROUND_UP(PIXMAN_FORMAT_BPP(fb.format), 8);
+    fb.width = pixman_image_get_width(image);
+    fb.height = pixman_image_get_height(image);
+    fb.stride = pixman_image_get_stride(image);
+
+    size = (size_t)fb.stride * fb.height;
+    data = g_memdup2(pixman_image_get_data(image), size);
+    res->image = pixman_image_create_bits(fb.format, fb.width, fb.height,
+                                          data, fb.stride);
+    pixman_image_set_destroy_function(res->image, virtio_gpu_free_image_data,
+                                      data);
+    res->zero_copy = false;
+
+    for (i = 0; i < g->parent_obj.conf.max_outputs; i++) {
+        if (!(res->scanout_bitmask & (1 << i))) {
+            continue;
+        }
+        scanout = &g->parent_obj.scanout[i];
+        r.x = scanout->x;
+        r.y = scanout->y;
+        r.width = scanout->width;
+        r.height = scanout->height;
+        fb.offset = r.x * fb.bytes_pp + r.y * fb.stride;
+        virtio_gpu_do_set_scanout(g, i, &fb, res, &r, &error);
+        /* The scanout shows the private image now, not the udmabuf */
+        virtio_gpu_release_dmabuf(g, i);
+    }
+
+    pixman_image_unref(image);
+    virtio_gpu_fini_udmabuf(res);
+}
+
 static void
 virtio_gpu_resource_attach_backing(VirtIOGPU *g,
                                    struct virtio_gpu_ctrl_command *cmd)
@@ -912,6 +1029,10 @@ virtio_gpu_resource_attach_backing(VirtIOGPU *g,
         cmd->error = VIRTIO_GPU_RESP_ERR_UNSPEC;
         return;
     }
+
+    if (!res->blob) {
+        virtio_gpu_zero_copy_attach(g, res);
+    }
 }
 
 static void
@@ -930,6 +1051,9 @@ virtio_gpu_resource_detach_backing(VirtIOGPU *g,
     if (!res) {
         return;
     }
+    if (res->zero_copy) {
+        virtio_gpu_zero_copy_detach(g, res);
+    }
     virtio_gpu_cleanup_mapping(g, res);
 }
 
@@ -1325,6 +1449,10 @@ void virtio_gpu_device_realize(DeviceState *qdev, Error **errp)
         }
     }
 
+    if (virtio_gpu_zero_copy_enabled(g->parent_obj.conf)) {
+        g->zero_copy_udmabuf = virtio_gpu_have_udmabuf();
+    }
+
     if (!virtio_gpu_base_device_realize(qdev,
                                         virtio_gpu_handle_ctrl_cb,
                                         virtio_gpu_handle_cursor_cb,
@@ -1420,6 +1548,8 @@ static Property virtio_gpu_properties[] = {
                      256 * MiB),
     DEFINE_PROP_BIT("blob", VirtIOGPU, parent_obj.conf.flags,
                     VIRTIO_GPU_FLAG_BLOB_ENABLED, false),
+    DEFINE_PROP_BIT("x-zero-copy", VirtIOGPU, parent_obj.conf.flags,
+                    VIRTIO_GPU_FLAG_ZERO_COPY_ENABLED, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
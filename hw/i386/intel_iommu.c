@@ -22,6 +22,7 @@
 #include "qemu/osdep.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/range.h"
 #include "qapi/error.h"
 #include "hw/sysbus.h"
 #include "intel_iommu_internal.h"
@@ -230,6 +231,145 @@ static gboolean vtd_hash_remove_by_page(gpointer key, gpointer value,
              (entry->gfn == gfn_tlb));
 }
 
+/* Must be called with IOMMU lock held. */
+static void vtd_trans_cache_flush_as_locked(VTDAddressSpace *vtd_as)
+{
+    int i;
+
+    seqlock_write_begin(&vtd_as->trans_cache_lock);
+    for (i = 0; i < VTD_TRANS_CACHE_SIZE; i++) {
+        vtd_as->trans_cache[i].gen = 0;
+    }
+    seqlock_write_end(&vtd_as->trans_cache_lock);
+}
+
+/*
+ * Drop the cached translations of all devices.  Must be called with IOMMU
+ * lock held.
+ */
+static void vtd_trans_cache_reset_locked(IntelIOMMUState *s)
+{
+    uint32_t gen = s->trans_cache_gen + 1;
+    VTDAddressSpace *vtd_as;
+    VTDBus *vtd_bus;
+    GHashTableIter bus_it;
+    uint32_t devfn_it;
+
+    if (gen) {
+        qatomic_set(&s->trans_cache_gen, gen);
+        return;
+    }
+
+    /*
+     * The generation wraps around.  Lockless lookups must never see 0, the
+     * generation of invalidated entries, so really clear all entries and
+     * restart from 1.
+     */
+    g_hash_table_iter_init(&bus_it, s->vtd_as_by_busptr);
+    while (g_hash_table_iter_next(&bus_it, NULL, (void **)&vtd_bus)) {
+        for (devfn_it = 0; devfn_it < PCI_DEVFN_MAX; ++devfn_it) {
+            vtd_as = vtd_bus->dev_as[devfn_it];
+            if (vtd_as) {
+                vtd_trans_cache_flush_as_locked(vtd_as);
+            }
+        }
+    }
+    qatomic_set(&s->trans_cache_gen, 1);
+}
+
+/*
+ * Drop the cached translations of @domain_id that overlap [@addr, @addr +
+ * @size).  Must be called with IOMMU lock held.
+ */
+static void vtd_trans_cache_invalidate_locked(IntelIOMMUState *s,
+                                              uint16_t domain_id,
+                                              hwaddr addr, hwaddr size)
+{
+    VTDAddressSpace *vtd_as;
+    VTDBus *vtd_bus;
+    GHashTableIter bus_it;
+    uint32_t devfn_it;
+    int i;
+
+    g_hash_table_iter_init(&bus_it, s->vtd_as_by_busptr);
+    while (g_hash_table_iter_next(&bus_it, NULL, (void **)&vtd_bus)) {
+        for (devfn_it = 0; devfn_it < PCI_DEVFN_MAX; ++devfn_it) {
+            vtd_as = vtd_bus->dev_as[devfn_it];
+            if (!vtd_as) {
+                continue;
+            }
+            seqlock_write_begin(&vtd_as->trans_cache_lock);
+            for (i = 0; i < VTD_TRANS_CACHE_SIZE; i++) {
+                VTDTransCacheEntry *e = &vtd_as->trans_cache[i];
+
+                if (e->gen == s->trans_cache_gen &&
+                    e->domain_id == domain_id &&
+                    ranges_overlap(e->iova, e->addr_mask + 1, addr, size)) {
+                    e->gen = 0;
+                }
+            }
+            seqlock_write_end(&vtd_as->trans_cache_lock);
+        }
+    }
+}
+
+/* Must be called with IOMMU lock held. */
+static void vtd_trans_cache_update_locked(VTDAddressSpace *vtd_as,
+                                          uint16_t domain_id,
+                                          const IOMMUTLBEntry *entry)
+{
+    IntelIOMMUState *s = vtd_as->iommu_state;
+    VTDTransCacheEntry *e;
+
+    e = &vtd_as->trans_cache[vtd_as->trans_cache_next];
+    vtd_as->trans_cache_next = (vtd_as->trans_cache_next + 1) %
+                               VTD_TRANS_CACHE_SIZE;
+
+    seqlock_write_begin(&vtd_as->trans_cache_lock);
+    e->gen = s->trans_cache_gen;
+    e->domain_id = domain_id;
+    e->perm = entry->perm;
+    e->iova = entry->iova;
+    e->translated_addr = entry->translated_addr;
+    e->addr_mask = entry->addr_mask;
+    seqlock_write_end(&vtd_as->trans_cache_lock);
+}
+
+/* Lockless; returns false if the translation must be done the slow way */
+static bool vtd_trans_cache_lookup(VTDAddressSpace *vtd_as, hwaddr addr,
+                                   bool is_write, IOMMUTLBEntry *entry)
+{
+    IntelIOMMUState *s = vtd_as->iommu_state;
+    IOMMUAccessFlags need = is_write ? IOMMU_WO : IOMMU_RO;
+    VTDTransCacheEntry e;
+    unsigned seq;
+    bool found;
+    int i;
+
+    do {
+        uint32_t gen = qatomic_read(&s->trans_cache_gen);
+
+        seq = seqlock_read_begin(&vtd_as->trans_cache_lock);
+        found = false;
+        for (i = 0; i < VTD_TRANS_CACHE_SIZE; i++) {
+            e = vtd_as->trans_cache[i];
+            if (e.gen == gen && (addr & ~e.addr_mask) == e.iova &&
+                (e.perm & need) == need) {
+                found = true;
+                break;
+            }
+        }
+    } while (seqlock_read_retry(&vtd_as->trans_cache_lock, seq));
+
+    if (found) {
+        entry->iova = e.iova;
+        entry->translated_addr = e.translated_addr;
+        entry->addr_mask = e.addr_mask;
+        entry->perm = e.perm;
+    }
+    return found;
+}
+
 /* Reset all the gen of VTDAddressSpace to zero and set the gen of
  * IntelIOMMUState to 1.  Must be called with IOMMU lock held.
  */
@@ -254,6 +394,7 @@ static void vtd_reset_context_cache_locked(IntelIOMMUState *s)
         }
     }
     s->context_cache_gen = 1;
+    vtd_trans_cache_reset_locked(s);
 }
 
 /* Must be called with IOMMU lock held. */
@@ -267,6 +408,7 @@ static void vtd_reset_iotlb(IntelIOMMUState *s)
 {
     vtd_iommu_lock(s);
     vtd_reset_iotlb_locked(s);
+    vtd_trans_cache_reset_locked(s);
     vtd_iommu_unlock(s);
 }
 
@@ -1708,6 +1850,7 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
     bool reads = true;
     bool writes = true;
     uint8_t access_flags;
+    uint16_t domain_id;
     VTDIOTLBEntry *iotlb_entry;
 
     /*
@@ -1728,6 +1871,7 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
         slpte = iotlb_entry->slpte;
         access_flags = iotlb_entry->access_flags;
         page_mask = iotlb_entry->mask;
+        domain_id = iotlb_entry->domain_id;
         goto out;
     }
 
@@ -1788,14 +1932,16 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
 
     page_mask = vtd_slpt_level_page_mask(level);
     access_flags = IOMMU_ACCESS_FLAG(reads, writes);
-    vtd_update_iotlb(s, source_id, vtd_get_domain_id(s, &ce), addr, slpte,
+    domain_id = vtd_get_domain_id(s, &ce);
+    vtd_update_iotlb(s, source_id, domain_id, addr, slpte,
                      access_flags, level);
 out:
-    vtd_iommu_unlock(s);
     entry->iova = addr & page_mask;
     entry->translated_addr = vtd_get_slpte_addr(slpte, s->aw_bits) & page_mask;
     entry->addr_mask = ~page_mask;
     entry->perm = access_flags;
+    vtd_trans_cache_update_locked(vtd_as, domain_id, entry);
+    vtd_iommu_unlock(s);
     return true;
 
 error:
@@ -1854,6 +2000,8 @@ static void vtd_context_global_invalidate(IntelIOMMUState *s)
     s->context_cache_gen++;
     if (s->context_cache_gen == VTD_CONTEXT_CACHE_GEN_MAX) {
         vtd_reset_context_cache_locked(s);
+    } else {
+        vtd_trans_cache_reset_locked(s);
     }
     vtd_iommu_unlock(s);
     vtd_address_space_refresh_all(s);
@@ -1911,6 +2059,7 @@ static void vtd_context_device_invalidate(IntelIOMMUState *s,
                                              VTD_PCI_FUNC(devfn_it));
                 vtd_iommu_lock(s);
                 vtd_as->context_cache_entry.context_cache_gen = 0;
+                vtd_trans_cache_flush_as_locked(vtd_as);
                 vtd_iommu_unlock(s);
                 /*
                  * Do switch address space when needed, in case if the
@@ -1978,6 +2127,7 @@ static void vtd_iotlb_domain_invalidate(IntelIOMMUState *s, uint16_t domain_id)
     vtd_iommu_lock(s);
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_domain,
                                 &domain_id);
+    vtd_trans_cache_invalidate_locked(s, domain_id, 0, UINT64_MAX);
     vtd_iommu_unlock(s);
 
     QLIST_FOREACH(vtd_as, &s->vtd_as_with_notifiers, next) {
@@ -2044,6 +2194,9 @@ static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
     info.mask = ~((1 << am) - 1);
     vtd_iommu_lock(s);
     g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_page, &info);
+    vtd_trans_cache_invalidate_locked(s, domain_id,
+                                      addr & ~((VTD_PAGE_SIZE << am) - 1),
+                                      VTD_PAGE_SIZE << am);
     vtd_iommu_unlock(s);
     vtd_iotlb_page_invalidate_notify(s, domain_id, addr, am);
 }
@@ -2993,7 +3146,9 @@ static IOMMUTLBEntry vtd_iommu_translate(IOMMUMemoryRegion *iommu, hwaddr addr,
     bool success;
 
     if (likely(s->dmar_enabled)) {
-        success = vtd_do_iommu_translate(vtd_as, vtd_as->bus, vtd_as->devfn,
+        success = vtd_trans_cache_lookup(vtd_as, addr, flag & IOMMU_WO,
+                                         &iotlb) ||
+                  vtd_do_iommu_translate(vtd_as, vtd_as->bus, vtd_as->devfn,
                                          addr, flag & IOMMU_WO, &iotlb);
     } else {
         /* DMAR disabled, passthrough, use 4k-page*/
@@ -3414,6 +3569,7 @@ VTDAddressSpace *vtd_find_add_as(IntelIOMMUState *s, PCIBus *bus, int devfn)
         vtd_dev_as->devfn = (uint8_t)devfn;
         vtd_dev_as->iommu_state = s;
         vtd_dev_as->context_cache_entry.context_cache_gen = 0;
+        seqlock_init(&vtd_dev_as->trans_cache_lock);
         vtd_dev_as->iova_tree = iova_tree_new();
 
         memory_region_init(&vtd_dev_as->root, OBJECT(s), name, UINT64_MAX);
@@ -3855,6 +4011,7 @@ static void vtd_realize(DeviceState *dev, Error **errp)
     /* No corresponding destroy */
     s->iotlb = g_hash_table_new_full(vtd_uint64_hash, vtd_uint64_equal,
                                      g_free, g_free);
+    s->trans_cache_gen = 1;
     s->vtd_as_by_busptr = g_hash_table_new_full(vtd_uint64_hash, vtd_uint64_equal,
                                               g_free, g_free);
     vtd_init(s);
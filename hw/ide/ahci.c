@@ -41,6 +41,7 @@
 
 static void check_cmd(AHCIState *s, int port);
 static int handle_cmd(AHCIState *s, int port, uint8_t slot);
+static void ahci_submit_ncq(AHCIDevice *ad);
 static void ahci_reset_port(AHCIState *s, int port);
 static bool ahci_write_fis_d2h(AHCIDevice *ad);
 static void ahci_init_d2h(AHCIDevice *ad);
@@ -596,6 +597,10 @@ static void check_cmd(AHCIState *s, int port)
             }
         }
     }
+
+    if (s->dev[port].ncq_pending) {
+        ahci_submit_ncq(&s->dev[port]);
+    }
 }
 
 static void ahci_check_cmd_bh(void *opaque)
@@ -659,6 +664,7 @@ static void ahci_reset_port(AHCIState *s, int port)
     pr->sig = 0xFFFFFFFF;
     d->busy_slot = -1;
     d->init_d2h_sent = false;
+    d->ncq_pending = 0;
 
     ide_state = &s->dev[port].port.ifs[0];
     if (!ide_state->blk) {
@@ -687,6 +693,10 @@ static void ahci_reset_port(AHCIState *s, int port)
         ncq_tfs->used = 0;
     }
 
+    /* Drop the completions of the commands that were just cancelled */
+    qemu_bh_cancel(d->sdb_bh);
+    d->finished = 0;
+
     s->dev[port].port_state = STATE_RUN;
     if (ide_state->drive_kind == IDE_CD) {
         ahci_set_signature(d, SATA_SIGNATURE_CDROM);\
@@ -770,9 +780,9 @@ static void ahci_unmap_clb_address(AHCIDevice *ad)
     ad->lst = NULL;
 }
 
-static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
+static void ahci_write_fis_sdb(AHCIDevice *ad)
 {
-    AHCIDevice *ad = ncq_tfs->drive;
+    AHCIState *s = ad->hba;
     AHCIPortRegs *pr = &ad->port_regs;
     IDEState *ide_state;
     SDBFIS *sdb_fis;
@@ -806,6 +816,13 @@ static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
     }
 }
 
+static void ahci_sdb_bh(void *opaque)
+{
+    AHCIDevice *ad = opaque;
+
+    ahci_write_fis_sdb(ad);
+}
+
 static void ahci_write_fis_pio(AHCIDevice *ad, uint16_t len, bool pio_fis_i)
 {
     AHCIPortRegs *pr = &ad->port_regs;
@@ -1004,15 +1021,26 @@ static void ncq_err(NCQTransferState *ncq_tfs)
 
 static void ncq_finish(NCQTransferState *ncq_tfs)
 {
-    /* If we didn't error out, set our finished bit. Errored commands
+    AHCIDevice *ad = ncq_tfs->drive;
+
+    /*
+     * If we didn't error out, set our finished bit. Errored commands
      * do not get a bit set for the SDB FIS ACT register, nor do they
-     * clear the outstanding bit in scr_act (PxSACT). */
-    if (!(ncq_tfs->drive->port_regs.scr_err & (1 << ncq_tfs->tag))) {
-        ncq_tfs->drive->finished |= (1 << ncq_tfs->tag);
+     * clear the outstanding bit in scr_act (PxSACT).
+     *
+     * Successful completions are reported together, with one SDB FIS and
+     * one interrupt for all the commands that complete in the same main
+     * loop iteration.  Errors are reported at once, so that the error
+     * status is not overwritten by later successful commands.
+     */
+    if (!(ad->port_regs.scr_err & (1 << ncq_tfs->tag))) {
+        ad->finished |= (1 << ncq_tfs->tag);
+        qemu_bh_schedule(ad->sdb_bh);
+    } else {
+        qemu_bh_cancel(ad->sdb_bh);
+        ahci_write_fis_sdb(ad);
     }
 
-    ahci_write_fis_sdb(ncq_tfs->drive->hba, ncq_tfs);
-
     trace_ncq_finish(ncq_tfs->drive->hba, ncq_tfs->drive->port_no,
                      ncq_tfs->tag);
 
@@ -1101,6 +1129,136 @@ static void execute_ncq_command(NCQTransferState *ncq_tfs)
     }
 }
 
+/*
+ * Adjacent NCQ reads or writes issued together are merged into a single
+ * request to the block layer.  Each command keeps its own scatter/gather
+ * list, so that it can still be restarted on its own after an error.
+ */
+typedef struct NCQMergedReq {
+    QEMUSGList sglist;
+    int count;
+    NCQTransferState *tfs[AHCI_MAX_CMDS];
+} NCQMergedReq;
+
+static void ncq_merged_cb(void *opaque, int ret)
+{
+    NCQMergedReq *req = opaque;
+    int i;
+
+    qemu_sglist_destroy(&req->sglist);
+    for (i = 0; i < req->count; i++) {
+        ncq_cb(req->tfs[i], ret);
+    }
+    g_free(req);
+}
+
+static void execute_ncq_merged(NCQTransferState **tfs, int count)
+{
+    AHCIDevice *ad = tfs[0]->drive;
+    IDEState *ide_state = &ad->port.ifs[0];
+    bool is_read = tfs[0]->cmd == READ_FPDMA_QUEUED;
+    enum BlockAcctType type = is_read ? BLOCK_ACCT_READ : BLOCK_ACCT_WRITE;
+    NCQMergedReq *req;
+    BlockAIOCB *aiocb;
+    int nsg = 0;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        nsg += tfs[i]->sglist.nsg;
+    }
+    req = g_new(NCQMergedReq, 1);
+    req->count = count;
+    qemu_sglist_init(&req->sglist, tfs[0]->sglist.dev, nsg, ad->hba->as);
+
+    for (i = 0; i < count; i++) {
+        NCQTransferState *ncq_tfs = tfs[i];
+
+        ncq_tfs->halt = false;
+        req->tfs[i] = ncq_tfs;
+        for (j = 0; j < ncq_tfs->sglist.nsg; j++) {
+            qemu_sglist_add(&req->sglist, ncq_tfs->sglist.sg[j].base,
+                            ncq_tfs->sglist.sg[j].len);
+        }
+        dma_acct_start(ide_state->blk, &ncq_tfs->acct, &ncq_tfs->sglist, type);
+    }
+    block_acct_merge_done(blk_get_stats(ide_state->blk), type, count - 1);
+
+    trace_execute_ncq_merged(ad->hba, ad->port_no, count, tfs[0]->lba,
+                             req->sglist.size >> BDRV_SECTOR_BITS);
+    if (is_read) {
+        aiocb = dma_blk_read(ide_state->blk, &req->sglist,
+                             tfs[0]->lba << BDRV_SECTOR_BITS,
+                             BDRV_SECTOR_SIZE, ncq_merged_cb, req);
+    } else {
+        aiocb = dma_blk_write(ide_state->blk, &req->sglist,
+                              tfs[0]->lba << BDRV_SECTOR_BITS,
+                              BDRV_SECTOR_SIZE, ncq_merged_cb, req);
+    }
+
+    /* Cancelling any of the commands cancels all of them */
+    for (i = 0; i < count; i++) {
+        tfs[i]->aiocb = aiocb;
+    }
+}
+
+static bool ncq_can_merge(const NCQTransferState *a,
+                          const NCQTransferState *b)
+{
+    /* A PRDT larger than the command would make the transfer overlap */
+    return (a->cmd == READ_FPDMA_QUEUED || a->cmd == WRITE_FPDMA_QUEUED) &&
+           a->cmd == b->cmd &&
+           a->lba + a->sector_count == b->lba &&
+           a->sglist.size == (uint64_t)a->sector_count << BDRV_SECTOR_BITS &&
+           b->sglist.size == (uint64_t)b->sector_count << BDRV_SECTOR_BITS;
+}
+
+static int ncq_compare(const void *a, const void *b)
+{
+    const NCQTransferState *x = *(NCQTransferState **)a;
+    const NCQTransferState *y = *(NCQTransferState **)b;
+
+    if (x->cmd != y->cmd) {
+        return x->cmd - y->cmd;
+    }
+    return x->lba < y->lba ? -1 : x->lba > y->lba;
+}
+
+static void ahci_submit_ncq(AHCIDevice *ad)
+{
+    NCQTransferState *reqs[AHCI_MAX_CMDS];
+    uint64_t max_bytes = blk_get_max_transfer(ad->port.ifs[0].blk);
+    int n = 0;
+    int start, i;
+
+    for (i = 0; i < AHCI_MAX_CMDS; i++) {
+        if (ad->ncq_pending & (1U << i)) {
+            reqs[n++] = &ad->ncq_tfs[i];
+        }
+    }
+    ad->ncq_pending = 0;
+
+    if (n > 1) {
+        qsort(reqs, n, sizeof(reqs[0]), ncq_compare);
+    }
+
+    for (start = 0; start < n; start = i) {
+        uint64_t bytes = reqs[start]->sglist.size;
+
+        for (i = start + 1; i < n; i++) {
+            if (!ncq_can_merge(reqs[i - 1], reqs[i]) ||
+                bytes + reqs[i]->sglist.size > max_bytes) {
+                break;
+            }
+            bytes += reqs[i]->sglist.size;
+        }
+
+        if (i - start == 1) {
+            execute_ncq_command(reqs[start]);
+        } else {
+            execute_ncq_merged(reqs + start, i - start);
+        }
+    }
+}
 
 static void process_ncq_command(AHCIState *s, int port, const uint8_t *cmd_fis,
                                 uint8_t slot)
@@ -1174,7 +1332,9 @@ static void process_ncq_command(AHCIState *s, int port, const uint8_t *cmd_fis,
                               ncq_fis->command,
                               ncq_tfs->lba,
                               ncq_tfs->lba + ncq_tfs->sector_count - 1);
-    execute_ncq_command(ncq_tfs);
+
+    /* Submitted by check_cmd() once all issued commands have been seen */
+    ad->ncq_pending |= 1U << tag;
 }
 
 static AHCICmdHdr *get_cmd_header(AHCIState *s, uint8_t port, uint8_t slot)
@@ -1559,6 +1719,7 @@ void ahci_realize(AHCIState *s, DeviceState *qdev, AddressSpace *as, int ports)
         ad->port_no = i;
         ad->port.dma = &ad->dma;
         ad->port.dma->ops = &ahci_dma_ops;
+        ad->sdb_bh = qemu_bh_new(ahci_sdb_bh, ad);
         ide_register_restart_cb(&ad->port);
     }
     g_free(irqs);
@@ -1576,6 +1737,7 @@ void ahci_uninit(AHCIState *s)
 
             ide_exit(s);
         }
+        qemu_bh_delete(ad->sdb_bh);
         object_unparent(OBJECT(&ad->port));
     }
 
@@ -1717,6 +1879,10 @@ static int ahci_state_post_load(void *opaque, int version_id)
             }
         }
 
+        /* Completions may not have been reported before migration */
+        if (ad->finished) {
+            qemu_bh_schedule(ad->sdb_bh);
+        }
 
         /*
          * If an error is present, ad->busy_slot will be valid and not -1.
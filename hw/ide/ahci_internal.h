@@ -314,6 +314,8 @@ struct AHCIDevice {
     AHCIPortRegs port_regs;
     struct AHCIState *hba;
     QEMUBH *check_bh;
+    QEMUBH *sdb_bh;             /* writes the SDB FIS for @finished */
+    uint32_t ncq_pending;       /* NCQ tags to submit at the end of check_cmd */
     uint8_t *lst;
     uint8_t *res_fis;
     bool done_first_drq;
@@ -125,6 +125,7 @@ enum ivshmem_registers {
     INTRSTATUS = 4,
     IVPOSITION = 8,
     DOORBELL = 12,
+    PENDING = 16,
 };
 
 static inline uint32_t ivshmem_has_feature(IVShmemState *ivs,
@@ -211,6 +212,44 @@ static void ivshmem_io_write(void *opaque, hwaddr addr,
     }
 }
 
+/*
+ * Return and clear the pending bits of the masked MSI-X vectors 0..31.
+ * Guests that mask the vectors and poll never take an interrupt for a
+ * notification.
+ */
+static uint32_t ivshmem_pending_read(IVShmemState *s)
+{
+    PCIDevice *pdev = PCI_DEVICE(s);
+    uint32_t ret = 0;
+    int vector;
+
+    if (!ivshmem_has_feature(s, IVSHMEM_MSI) || s->vm_id < 0 ||
+        s->vm_id >= s->nb_peers) {
+        return 0;
+    }
+
+    for (vector = 0; vector < MIN(s->vectors, 32); vector++) {
+        EventNotifier *n = &s->peers[s->vm_id].eventfds[vector];
+
+        if (vector >= s->peers[s->vm_id].nb_eventfds ||
+            !msix_is_masked(pdev, vector)) {
+            continue;
+        }
+
+        /*
+         * With irqfd, a masked vector's notifications stay in the eventfd;
+         * otherwise ivshmem_vector_notify() moved them to the pending bit.
+         */
+        if (event_notifier_test_and_clear(n) ||
+            msix_is_pending(pdev, vector)) {
+            msix_clr_pending(pdev, vector);
+            ret |= 1U << vector;
+        }
+    }
+
+    return ret;
+}
+
 static uint64_t ivshmem_io_read(void *opaque, hwaddr addr,
                                 unsigned size)
 {
@@ -232,6 +271,10 @@ static uint64_t ivshmem_io_read(void *opaque, hwaddr addr,
             ret = s->vm_id;
             break;
 
+        case PENDING:
+            ret = ivshmem_pending_read(s);
+            break;
+
         default:
             IVSHMEM_DPRINTF("why are we reading " TARGET_FMT_plx "\n", addr);
             ret = 0;
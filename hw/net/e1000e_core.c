@@ -35,6 +35,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "net/net.h"
 #include "net/tap.h"
 #include "hw/pci/msi.h"
@@ -902,37 +903,97 @@ e1000e_rx_ring_init(E1000ECore *core, E1000E_RxRing *rxr, int idx)
     rxr->i      = &i[idx];
 }
 
-static void
+/*
+ * Descriptors are read this many at a time, and at most E1000E_TX_BURST
+ * are processed before the main loop gets to run again
+ */
+#define E1000E_TX_BATCH     (32)
+#define E1000E_TX_BURST     (256)
+
+/* Returns true if descriptors are left for the next run */
+static bool
 e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 {
     dma_addr_t base;
-    struct e1000_tx_desc desc;
+    struct e1000_tx_desc desc[E1000E_TX_BATCH];
     bool ide = false;
     const E1000E_RingInfo *txi = txr->i;
     uint32_t cause = E1000_ICS_TXQE;
+    uint32_t budget = E1000E_TX_BURST;
+    uint32_t ring_size, i, n;
 
     if (!(core->mac[TCTL] & E1000_TCTL_EN)) {
         trace_e1000e_tx_disabled();
-        return;
+        return false;
     }
 
-    while (!e1000e_ring_empty(core, txi)) {
+    while (!e1000e_ring_empty(core, txi) && budget) {
         base = e1000e_ring_head_descr(core, txi);
 
-        pci_dma_read(core->owner, base, &desc, sizeof(desc));
+        /* Up to the tail or to the end of the ring, whichever comes first */
+        ring_size = e1000e_ring_len(core, txi) / E1000_RING_DESC_LEN;
+        if (core->mac[txi->dh] < ring_size) {
+            n = MIN(e1000e_ring_free_descr_num(core, txi),
+                    ring_size - core->mac[txi->dh]);
+            n = MIN(n, MIN(budget, E1000E_TX_BATCH));
+        } else {
+            n = 1;
+        }
+
+        pci_dma_read(core->owner, base, desc, n * sizeof(desc[0]));
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.buffer_addr,
-                              desc.lower.data, desc.upper.data);
+        for (i = 0; i < n; i++) {
+            trace_e1000e_tx_descr((void *)(intptr_t)desc[i].buffer_addr,
+                                  desc[i].lower.data, desc[i].upper.data);
 
-        e1000e_process_tx_desc(core, txr->tx, &desc, txi->idx);
-        cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
+            e1000e_process_tx_desc(core, txr->tx, &desc[i], txi->idx);
+            cause |= e1000e_txdesc_writeback(core,
+                                             base + i * sizeof(desc[0]),
+                                             &desc[i], &ide, txi->idx);
 
-        e1000e_ring_advance(core, txi, 1);
+            e1000e_ring_advance(core, txi, 1);
+        }
+        budget -= n;
     }
 
     if (!ide || !e1000e_intrmgr_delay_tx_causes(core, &cause)) {
         e1000e_set_interrupt_cause(core, cause);
     }
+
+    return !e1000e_ring_empty(core, txi);
+}
+
+static void
+e1000e_tx_bh(void *opaque)
+{
+    struct e1000e_tx *tx = opaque;
+    E1000ECore *core = tx->core;
+    E1000E_TxRing txr;
+
+    /* Resumed by e1000e_vm_state_change() */
+    if (!runstate_is_running()) {
+        return;
+    }
+
+    e1000e_tx_ring_init(core, &txr, tx - core->tx);
+    if (e1000e_start_xmit(core, &txr)) {
+        qemu_bh_schedule(tx->bh);
+    }
+}
+
+/*
+ * The ring is processed from a bottom half, so that the vCPU that wrote
+ * TDT does not wait for the packets to be sent, and so that several
+ * writes are handled with one pass over the ring
+ */
+static void
+e1000e_tx_kick(E1000ECore *core, int qidx)
+{
+    uint32_t tarc_reg = (qidx == 0) ? TARC0 : TARC1;
+
+    if (core->mac[tarc_reg] & E1000_TARC_ENABLE) {
+        qemu_bh_schedule(core->tx[qidx].bh);
+    }
 }
 
 static bool
@@ -1367,25 +1428,73 @@ typedef struct e1000e_ba_state_st {
     uint8_t cur_idx;
 } e1000e_ba_state;
 
+/*
+ * Descriptors are written back in batches, so that a packet spread over
+ * many buffers costs one DMA write per batch rather than per descriptor.
+ */
+#define E1000E_RX_WB_BATCH  (16)
+
+typedef struct E1000ERxWriteback {
+    uint8_t desc[E1000E_RX_WB_BATCH * E1000_MAX_RX_DESC_LEN];
+    dma_addr_t base;
+    unsigned n;
+} E1000ERxWriteback;
+
+static void
+e1000e_rx_wb_flush(E1000ECore *core, E1000ERxWriteback *wb)
+{
+    if (wb->n) {
+        pci_dma_write(core->owner, wb->base, wb->desc,
+                      wb->n * core->rx_desc_len);
+        wb->n = 0;
+    }
+}
+
+static void
+e1000e_rx_wb_add(E1000ECore *core, E1000ERxWriteback *wb,
+                 dma_addr_t base, const uint8_t *desc)
+{
+    if (wb->n == E1000E_RX_WB_BATCH ||
+        (wb->n && base != wb->base + wb->n * core->rx_desc_len)) {
+        e1000e_rx_wb_flush(core, wb);
+    }
+    if (!wb->n) {
+        wb->base = base;
+    }
+    memcpy(wb->desc + wb->n * core->rx_desc_len, desc, core->rx_desc_len);
+    wb->n++;
+}
+
 static inline void
 e1000e_write_hdr_to_rx_buffers(E1000ECore *core,
                                hwaddr (*ba)[MAX_PS_BUFFERS],
                                e1000e_ba_state *bastate,
-                               const char *data,
+                               struct NetRxPkt *pkt,
+                               size_t pkt_ofs,
                                dma_addr_t data_len)
 {
     assert(data_len <= core->rxbuf_sizes[0] - bastate->written[0]);
 
-    pci_dma_write(core->owner, (*ba)[0] + bastate->written[0], data, data_len);
+    if (data_len) {
+        net_rx_pkt_copy_to_guest(pkt, pkt_ofs,
+                                 pci_get_address_space(core->owner),
+                                 (*ba)[0] + bastate->written[0], data_len);
+    }
     bastate->written[0] += data_len;
 
     bastate->cur_idx = 1;
 }
 
+/*
+ * Copies @data_len bytes of @pkt from @pkt_ofs on, or from @data if @pkt
+ * is NULL, to the buffers of the descriptor.
+ */
 static void
 e1000e_write_to_rx_buffers(E1000ECore *core,
                            hwaddr (*ba)[MAX_PS_BUFFERS],
                            e1000e_ba_state *bastate,
+                           struct NetRxPkt *pkt,
+                           size_t pkt_ofs,
                            const char *data,
                            dma_addr_t data_len)
 {
@@ -1401,12 +1510,20 @@ e1000e_write_to_rx_buffers(E1000ECore *core,
                                         data,
                                         bytes_to_write);
 
-        pci_dma_write(core->owner,
-            (*ba)[bastate->cur_idx] + bastate->written[bastate->cur_idx],
-            data, bytes_to_write);
+        if (pkt) {
+            net_rx_pkt_copy_to_guest(pkt, pkt_ofs,
+                pci_get_address_space(core->owner),
+                (*ba)[bastate->cur_idx] + bastate->written[bastate->cur_idx],
+                bytes_to_write);
+            pkt_ofs += bytes_to_write;
+        } else {
+            pci_dma_write(core->owner,
+                (*ba)[bastate->cur_idx] + bastate->written[bastate->cur_idx],
+                data, bytes_to_write);
+            data += bytes_to_write;
+        }
 
         bastate->written[bastate->cur_idx] += bytes_to_write;
-        data += bytes_to_write;
         data_len -= bytes_to_write;
 
         if (bastate->written[bastate->cur_idx] == cur_buf_len) {
@@ -1491,11 +1608,11 @@ e1000e_write_packet_to_guest(E1000ECore *core, struct NetRxPkt *pkt,
     PCIDevice *d = core->owner;
     dma_addr_t base;
     uint8_t desc[E1000_MAX_RX_DESC_LEN];
+    E1000ERxWriteback wb = { .n = 0 };
     size_t desc_size;
     size_t desc_offset = 0;
-    size_t iov_ofs = 0;
+    size_t pkt_ofs = 0;
 
-    struct iovec *iov = net_rx_pkt_get_iovec(pkt);
     size_t size = net_rx_pkt_get_total_len(pkt);
     size_t total_size = size + e1000x_fcs_len(core->mac);
     const E1000E_RingInfo *rxi;
@@ -1517,6 +1634,7 @@ e1000e_write_packet_to_guest(E1000ECore *core, struct NetRxPkt *pkt,
         }
 
         if (e1000e_ring_empty(core, rxi)) {
+            e1000e_rx_wb_flush(core, &wb);
             return;
         }
 
@@ -1531,7 +1649,6 @@ e1000e_write_packet_to_guest(E1000ECore *core, struct NetRxPkt *pkt,
         if (ba[0]) {
             if (desc_offset < size) {
                 static const uint32_t fcs_pad;
-                size_t iov_copy;
                 size_t copy_size = size - desc_offset;
                 if (copy_size > core->rx_desc_buf_size) {
                     copy_size = core->rx_desc_buf_size;
@@ -1540,51 +1657,29 @@ e1000e_write_packet_to_guest(E1000ECore *core, struct NetRxPkt *pkt,
                 /* For PS mode copy the packet header first */
                 if (do_ps) {
                     if (is_first) {
-                        size_t ps_hdr_copied = 0;
-                        do {
-                            iov_copy = MIN(ps_hdr_len - ps_hdr_copied,
-                                           iov->iov_len - iov_ofs);
-
-                            e1000e_write_hdr_to_rx_buffers(core, &ba, &bastate,
-                                                      iov->iov_base, iov_copy);
-
-                            copy_size -= iov_copy;
-                            ps_hdr_copied += iov_copy;
-
-                            iov_ofs += iov_copy;
-                            if (iov_ofs == iov->iov_len) {
-                                iov++;
-                                iov_ofs = 0;
-                            }
-                        } while (ps_hdr_copied < ps_hdr_len);
+                        e1000e_write_hdr_to_rx_buffers(core, &ba, &bastate,
+                                                       pkt, pkt_ofs,
+                                                       ps_hdr_len);
+                        copy_size -= ps_hdr_len;
+                        pkt_ofs += ps_hdr_len;
 
                         is_first = false;
                     } else {
                         /* Leave buffer 0 of each descriptor except first */
                         /* empty as per spec 7.1.5.1                      */
                         e1000e_write_hdr_to_rx_buffers(core, &ba, &bastate,
-                                                       NULL, 0);
+                                                       NULL, 0, 0);
                     }
                 }
 
                 /* Copy packet payload */
-                while (copy_size) {
-                    iov_copy = MIN(copy_size, iov->iov_len - iov_ofs);
-
-                    e1000e_write_to_rx_buffers(core, &ba, &bastate,
-                                            iov->iov_base + iov_ofs, iov_copy);
-
-                    copy_size -= iov_copy;
-                    iov_ofs += iov_copy;
-                    if (iov_ofs == iov->iov_len) {
-                        iov++;
-                        iov_ofs = 0;
-                    }
-                }
+                e1000e_write_to_rx_buffers(core, &ba, &bastate, pkt, pkt_ofs,
+                                           NULL, copy_size);
+                pkt_ofs += copy_size;
 
                 if (desc_offset + desc_size >= total_size) {
                     /* Simulate FCS checksum presence in the last descriptor */
-                    e1000e_write_to_rx_buffers(core, &ba, &bastate,
+                    e1000e_write_to_rx_buffers(core, &ba, &bastate, NULL, 0,
                           (const char *) &fcs_pad, e1000x_fcs_len(core->mac));
                 }
             }
@@ -1598,13 +1693,14 @@ e1000e_write_packet_to_guest(E1000ECore *core, struct NetRxPkt *pkt,
 
         e1000e_write_rx_descr(core, desc, is_last ? core->rx_pkt : NULL,
                            rss_info, do_ps ? ps_hdr_len : 0, &bastate.written);
-        pci_dma_write(d, base, &desc, core->rx_desc_len);
+        e1000e_rx_wb_add(core, &wb, base, desc);
 
         e1000e_ring_advance(core, rxi,
                             core->rx_desc_len / E1000_MIN_RX_DESC_LEN);
 
     } while (desc_offset < total_size);
 
+    e1000e_rx_wb_flush(core, &wb);
     e1000e_update_rx_stats(core, size, total_size);
 }
 
@@ -2414,33 +2510,20 @@ e1000e_set_dbal(E1000ECore *core, int index, uint32_t val)
 static void
 e1000e_set_tctl(E1000ECore *core, int index, uint32_t val)
 {
-    E1000E_TxRing txr;
     core->mac[index] = val;
 
-    if (core->mac[TARC0] & E1000_TARC_ENABLE) {
-        e1000e_tx_ring_init(core, &txr, 0);
-        e1000e_start_xmit(core, &txr);
-    }
-
-    if (core->mac[TARC1] & E1000_TARC_ENABLE) {
-        e1000e_tx_ring_init(core, &txr, 1);
-        e1000e_start_xmit(core, &txr);
-    }
+    e1000e_tx_kick(core, 0);
+    e1000e_tx_kick(core, 1);
 }
 
 static void
 e1000e_set_tdt(E1000ECore *core, int index, uint32_t val)
 {
-    E1000E_TxRing txr;
     int qidx = e1000e_mq_queue_idx(TDT, index);
-    uint32_t tarc_reg = (qidx == 0) ? TARC0 : TARC1;
 
     core->mac[index] = val & 0xffff;
 
-    if (core->mac[tarc_reg] & E1000_TARC_ENABLE) {
-        e1000e_tx_ring_init(core, &txr, qidx);
-        e1000e_start_xmit(core, &txr);
-    }
+    e1000e_tx_kick(core, qidx);
 }
 
 static void
@@ -3304,10 +3387,14 @@ e1000e_vm_state_change(void *opaque, bool running, RunState state)
         trace_e1000e_vm_state_running();
         e1000e_intrmgr_resume(core);
         e1000e_autoneg_resume(core);
+        e1000e_tx_kick(core, 0);
+        e1000e_tx_kick(core, 1);
     } else {
         trace_e1000e_vm_state_stopped();
         e1000e_autoneg_pause(core);
         e1000e_intrmgr_pause(core);
+        qemu_bh_cancel(core->tx[0].bh);
+        qemu_bh_cancel(core->tx[1].bh);
     }
 }
 
@@ -3329,6 +3416,8 @@ e1000e_core_pci_realize(E1000ECore     *core,
     for (i = 0; i < E1000E_NUM_QUEUES; i++) {
         net_tx_pkt_init(&core->tx[i].tx_pkt, core->owner,
                         E1000E_MAX_TX_FRAGS, core->has_vnet);
+        core->tx[i].core = core;
+        core->tx[i].bh = qemu_bh_new(e1000e_tx_bh, &core->tx[i]);
     }
 
     net_rx_pkt_init(&core->rx_pkt, core->has_vnet);
@@ -3353,6 +3442,7 @@ e1000e_core_pci_uninit(E1000ECore *core)
     qemu_del_vm_change_state_handler(core->vmstate);
 
     for (i = 0; i < E1000E_NUM_QUEUES; i++) {
+        qemu_bh_delete(core->tx[i].bh);
         net_tx_pkt_reset(core->tx[i].tx_pkt);
         net_tx_pkt_uninit(core->tx[i].tx_pkt);
     }
@@ -3465,6 +3555,7 @@ e1000e_core_reset(E1000ECore *core)
     e1000x_reset_mac_addr(core->owner_nic, core->mac, core->permanent_mac);
 
     for (i = 0; i < ARRAY_SIZE(core->tx); i++) {
+        qemu_bh_cancel(core->tx[i].bh);
         net_tx_pkt_reset(core->tx[i].tx_pkt);
         memset(&core->tx[i].props, 0, sizeof(core->tx[i].props));
         core->tx[i].skip_cp = false;
@@ -20,6 +20,7 @@
 #include "net_rx_pkt.h"
 #include "net/checksum.h"
 #include "net/tap.h"
+#include "sysemu/dma.h"
 
 struct NetRxPkt {
     struct virtio_net_hdr virt_hdr;
@@ -435,6 +436,56 @@ bool net_rx_pkt_has_tcp_data(struct NetRxPkt *pkt)
     return false;
 }
 
+size_t net_rx_pkt_copy_to_guest(struct NetRxPkt *pkt, size_t offset,
+                                AddressSpace *as, hwaddr pa, size_t len)
+{
+    size_t copied = 0;
+    size_t iov_off = 0;
+    int i;
+
+    assert(pkt);
+
+    while (copied < len) {
+        dma_addr_t mapped = len - copied;
+        size_t done;
+        void *p;
+
+        p = dma_memory_map(as, pa + copied, &mapped,
+                           DMA_DIRECTION_FROM_DEVICE, MEMTXATTRS_UNSPECIFIED);
+        if (!p) {
+            break;
+        }
+        done = iov_to_buf(pkt->vec, pkt->vec_len, offset + copied, p, mapped);
+        dma_memory_unmap(as, p, mapped, DMA_DIRECTION_FROM_DEVICE, done);
+        copied += done;
+        if (done < mapped) {
+            return copied;
+        }
+    }
+
+    /*
+     * The buffer could not be mapped, e.g. because it is not RAM and the
+     * bounce buffer is in use.  Write the rest one element at a time.
+     */
+    offset += copied;
+    for (i = 0; i < pkt->vec_len && copied < len; i++) {
+        size_t iov_len = pkt->vec[i].iov_len;
+
+        if (offset < iov_off + iov_len) {
+            size_t chunk = MIN(iov_off + iov_len - offset, len - copied);
+
+            dma_memory_write(as, pa + copied,
+                             pkt->vec[i].iov_base + offset - iov_off, chunk,
+                             MEMTXATTRS_UNSPECIFIED);
+            copied += chunk;
+            offset += chunk;
+        }
+        iov_off += iov_len;
+    }
+
+    return copied;
+}
+
 struct iovec *net_rx_pkt_get_iovec(struct NetRxPkt *pkt)
 {
     assert(pkt);
@@ -19,6 +19,7 @@
 #define NET_RX_PKT_H
 
 #include "net/eth.h"
+#include "exec/hwaddr.h"
 
 /* defines to enable packet dump functions */
 /*#define NET_RX_PKT_DEBUG*/
@@ -293,6 +294,24 @@ struct iovec *net_rx_pkt_get_iovec(struct NetRxPkt *pkt);
 */
 uint16_t net_rx_pkt_get_iovec_len(struct NetRxPkt *pkt);
 
+/**
+ * copy part of the attached data to a guest buffer
+ *
+ * The guest buffer is mapped and the data is gathered straight into it,
+ * instead of being written by one DMA transfer per IOVec element.
+ *
+ * @pkt:            packet
+ * @offset:         offset of the data to copy in the packet
+ * @as:             address space of the device doing the DMA
+ * @pa:             guest address of the buffer
+ * @len:            number of bytes to copy
+ *
+ * Return:  number of bytes copied, less than @len if the packet is shorter
+ *
+ */
+size_t net_rx_pkt_copy_to_guest(struct NetRxPkt *pkt, size_t offset,
+                                AddressSpace *as, hwaddr pa, size_t len);
+
 /**
  * prints rx packet data if debug is enabled
  *
@@ -641,6 +641,17 @@ static int virtio_net_max_tx_queue_size(VirtIONet *n)
     return VIRTQUEUE_MAX_SIZE;
 }
 
+/*
+ * vhost-vdpa devices get the RSS configuration through their control
+ * virtqueue and steer the packets themselves, no eBPF program is needed.
+ */
+static bool virtio_net_rss_offloaded(VirtIONet *n)
+{
+    NetClientState *nc = qemu_get_queue(n->nic);
+
+    return nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_VHOST_VDPA;
+}
+
 static int peer_attach(VirtIONet *n, int index)
 {
     NetClientState *nc = qemu_get_subqueue(n->nic, index);
@@ -739,7 +750,7 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
         return features;
     }
 
-    if (!ebpf_rss_is_loaded(&n->ebpf_rss)) {
+    if (!ebpf_rss_is_loaded(&n->ebpf_rss) && !virtio_net_rss_offloaded(n)) {
         virtio_clear_feature(&features, VIRTIO_NET_F_RSS);
     }
     features = vhost_net_get_features(get_vhost_net(nc->peer), features);
@@ -1230,6 +1241,100 @@ static void virtio_net_unload_ebpf(VirtIONet *n)
     ebpf_rss_unload(&n->ebpf_rss);
 }
 
+static bool virtio_net_rss_flow_key(NetRssFlow *flow,
+                                    struct EBPFRSSFlowKey *key, Error **errp)
+{
+    memset(key, 0, sizeof(*key));
+    key->protocol = flow->protocol;
+
+    if (inet_pton(AF_INET, flow->src, key->src) == 1 &&
+        inet_pton(AF_INET, flow->dst, key->dst) == 1) {
+        key->is_ipv6 = 0;
+    } else if (inet_pton(AF_INET6, flow->src, key->src) == 1 &&
+               inet_pton(AF_INET6, flow->dst, key->dst) == 1) {
+        key->is_ipv6 = 1;
+    } else {
+        error_setg(errp, "'%s' and '%s' are not IP addresses of the same "
+                   "family", flow->src, flow->dst);
+        return false;
+    }
+
+    if (flow->protocol == IPPROTO_TCP || flow->protocol == IPPROTO_UDP) {
+        key->src_port = htons(flow->src_port);
+        key->dst_port = htons(flow->dst_port);
+    } else if (flow->has_src_port || flow->has_dst_port) {
+        error_setg(errp, "Ports can only be given for TCP and UDP flows");
+        return false;
+    }
+    return true;
+}
+
+static void virtio_net_set_rss_flow(NetClientState *nc, NetRssFlow *flow,
+                                    int queue, Error **errp)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    struct EBPFRSSFlowKey key;
+
+    if (!ebpf_rss_has_flow_table(&n->ebpf_rss)) {
+        error_setg(errp, "Flow steering needs the eBPF RSS program of "
+                   "rss=on with a tap backend");
+        return;
+    }
+    if (!virtio_net_rss_flow_key(flow, &key, errp)) {
+        return;
+    }
+
+    if (queue < 0) {
+        if (!ebpf_rss_del_flow(&n->ebpf_rss, &key)) {
+            error_setg(errp, "Flow not found");
+        }
+        return;
+    }
+
+    if (queue >= n->max_queue_pairs) {
+        error_setg(errp, "Queue %d out of range, the NIC has %u queues",
+                   queue, n->max_queue_pairs);
+        return;
+    }
+    if (queue >= EBPF_RSS_MAX_QUEUES) {
+        error_setg(errp, "Queue %d out of range, flows can only be steered "
+                   "to the first %d queues", queue, EBPF_RSS_MAX_QUEUES);
+        return;
+    }
+    if (!ebpf_rss_set_flow(&n->ebpf_rss, &key, queue)) {
+        error_setg(errp, "Could not add the flow, the flow table holds up "
+                   "to %d flows", EBPF_RSS_FLOW_TABLE_SIZE);
+    }
+}
+
+static NetRssQueueStatsList *virtio_net_query_rss_stats(NetClientState *nc,
+                                                        Error **errp)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    unsigned int nb_queues = MIN(n->max_queue_pairs, EBPF_RSS_MAX_QUEUES);
+    g_autofree uint64_t *packets = g_new(uint64_t, nb_queues);
+    NetRssQueueStatsList *list = NULL, **tail = &list;
+    unsigned int i;
+
+    if (!ebpf_rss_is_loaded(&n->ebpf_rss)) {
+        error_setg(errp, "eBPF RSS steering is not in use");
+        return NULL;
+    }
+    if (!ebpf_rss_get_queue_stats(&n->ebpf_rss, packets, nb_queues)) {
+        error_setg(errp, "Could not read the eBPF RSS queue statistics");
+        return NULL;
+    }
+
+    for (i = 0; i < nb_queues; i++) {
+        NetRssQueueStats *stats = g_new0(NetRssQueueStats, 1);
+
+        stats->queue = i;
+        stats->packets = packets[i];
+        QAPI_LIST_APPEND(tail, stats);
+    }
+    return list;
+}
+
 static uint16_t virtio_net_handle_rss(VirtIONet *n,
                                       struct iovec *iov,
                                       unsigned int iov_cnt,
@@ -1343,7 +1448,9 @@ static uint16_t virtio_net_handle_rss(VirtIONet *n,
     }
     n->rss_data.enabled = true;
 
-    if (!n->rss_data.populate_hash) {
+    if (virtio_net_rss_offloaded(n)) {
+        /* The device got the same command */
+    } else if (!n->rss_data.populate_hash) {
         if (!virtio_net_attach_epbf_rss(n)) {
             /* EBPF must be loaded for vhost */
             if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
@@ -1416,56 +1523,77 @@ static int virtio_net_handle_mq(VirtIONet *n, uint8_t cmd,
     return VIRTIO_NET_OK;
 }
 
-static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
+/*
+ * Apply the control command in @out_sg and write its status to @in_sg.
+ * Returns the number of bytes written to @in_sg, or 0 if the command is
+ * malformed.  vhost-vdpa also calls this to keep the device model in sync
+ * with the commands that it forwards to the device.
+ */
+size_t virtio_net_handle_ctrl_iov(VirtIODevice *vdev,
+                                  const struct iovec *in_sg, unsigned in_num,
+                                  const struct iovec *out_sg,
+                                  unsigned out_num)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     struct virtio_net_ctrl_hdr ctrl;
     virtio_net_ctrl_ack status = VIRTIO_NET_ERR;
-    VirtQueueElement *elem;
     size_t s;
     struct iovec *iov, *iov2;
-    unsigned int iov_cnt;
+
+    if (iov_size(in_sg, in_num) < sizeof(status) ||
+        iov_size(out_sg, out_num) < sizeof(ctrl)) {
+        virtio_error(vdev, "virtio-net ctrl missing headers");
+        return 0;
+    }
+
+    iov2 = iov = g_memdup2(out_sg, sizeof(struct iovec) * out_num);
+    s = iov_to_buf(iov, out_num, 0, &ctrl, sizeof(ctrl));
+    iov_discard_front(&iov, &out_num, sizeof(ctrl));
+    if (s != sizeof(ctrl)) {
+        status = VIRTIO_NET_ERR;
+    } else if (ctrl.class == VIRTIO_NET_CTRL_RX) {
+        status = virtio_net_handle_rx_mode(n, ctrl.cmd, iov, out_num);
+    } else if (ctrl.class == VIRTIO_NET_CTRL_MAC) {
+        status = virtio_net_handle_mac(n, ctrl.cmd, iov, out_num);
+    } else if (ctrl.class == VIRTIO_NET_CTRL_VLAN) {
+        status = virtio_net_handle_vlan_table(n, ctrl.cmd, iov, out_num);
+    } else if (ctrl.class == VIRTIO_NET_CTRL_ANNOUNCE) {
+        status = virtio_net_handle_announce(n, ctrl.cmd, iov, out_num);
+    } else if (ctrl.class == VIRTIO_NET_CTRL_MQ) {
+        status = virtio_net_handle_mq(n, ctrl.cmd, iov, out_num);
+    } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
+        status = virtio_net_handle_offloads(n, ctrl.cmd, iov, out_num);
+    }
+
+    s = iov_from_buf(in_sg, in_num, 0, &status, sizeof(status));
+    assert(s == sizeof(status));
+
+    g_free(iov2);
+    return sizeof(status);
+}
+
+static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtQueueElement *elem;
 
     for (;;) {
+        size_t written;
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
             break;
         }
-        if (iov_size(elem->in_sg, elem->in_num) < sizeof(status) ||
-            iov_size(elem->out_sg, elem->out_num) < sizeof(ctrl)) {
-            virtio_error(vdev, "virtio-net ctrl missing headers");
+
+        written = virtio_net_handle_ctrl_iov(vdev, elem->in_sg, elem->in_num,
+                                             elem->out_sg, elem->out_num);
+        if (written > 0) {
+            virtqueue_push(vq, elem, written);
+            virtio_notify(vdev, vq);
+            g_free(elem);
+        } else {
             virtqueue_detach_element(vq, elem, 0);
             g_free(elem);
             break;
         }
-
-        iov_cnt = elem->out_num;
-        iov2 = iov = g_memdup(elem->out_sg, sizeof(struct iovec) * elem->out_num);
-        s = iov_to_buf(iov, iov_cnt, 0, &ctrl, sizeof(ctrl));
-        iov_discard_front(&iov, &iov_cnt, sizeof(ctrl));
-        if (s != sizeof(ctrl)) {
-            status = VIRTIO_NET_ERR;
-        } else if (ctrl.class == VIRTIO_NET_CTRL_RX) {
-            status = virtio_net_handle_rx_mode(n, ctrl.cmd, iov, iov_cnt);
-        } else if (ctrl.class == VIRTIO_NET_CTRL_MAC) {
-            status = virtio_net_handle_mac(n, ctrl.cmd, iov, iov_cnt);
-        } else if (ctrl.class == VIRTIO_NET_CTRL_VLAN) {
-            status = virtio_net_handle_vlan_table(n, ctrl.cmd, iov, iov_cnt);
-        } else if (ctrl.class == VIRTIO_NET_CTRL_ANNOUNCE) {
-            status = virtio_net_handle_announce(n, ctrl.cmd, iov, iov_cnt);
-        } else if (ctrl.class == VIRTIO_NET_CTRL_MQ) {
-            status = virtio_net_handle_mq(n, ctrl.cmd, iov, iov_cnt);
-        } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
-            status = virtio_net_handle_offloads(n, ctrl.cmd, iov, iov_cnt);
-        }
-
-        s = iov_from_buf(elem->in_sg, elem->in_num, 0, &status, sizeof(status));
-        assert(s == sizeof(status));
-
-        virtqueue_push(vq, elem, sizeof(status));
-        virtio_notify(vdev, vq);
-        g_free(iov2);
-        g_free(elem);
     }
 }
 
@@ -2874,7 +3002,13 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
         }
     }
 
-    if (n->rss_data.enabled) {
+    if (n->rss_data.enabled && virtio_net_rss_offloaded(n)) {
+        /* Replayed to the device by vhost-vdpa when it starts */
+        n->rss_data.enabled_software_rss = false;
+        trace_virtio_net_rss_enable(n->rss_data.hash_types,
+                                    n->rss_data.indirections_len,
+                                    sizeof(n->rss_data.key));
+    } else if (n->rss_data.enabled) {
         n->rss_data.enabled_software_rss = n->rss_data.populate_hash;
         if (!n->rss_data.populate_hash) {
             if (!virtio_net_attach_epbf_rss(n)) {
@@ -3161,6 +3295,8 @@ static NetClientInfo net_virtio_info = {
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
+    .set_rss_flow = virtio_net_set_rss_flow,
+    .query_rss_stats = virtio_net_query_rss_stats,
 };
 
 static bool virtio_net_guest_notifier_pending(VirtIODevice *vdev, int idx)
@@ -937,36 +937,6 @@ nocsum:
     return;
 }
 
-static void
-vmxnet3_pci_dma_writev(PCIDevice *pci_dev,
-                       const struct iovec *iov,
-                       size_t start_iov_off,
-                       hwaddr target_addr,
-                       size_t bytes_to_copy)
-{
-    size_t curr_off = 0;
-    size_t copied = 0;
-
-    while (bytes_to_copy) {
-        if (start_iov_off < (curr_off + iov->iov_len)) {
-            size_t chunk_len =
-                MIN((curr_off + iov->iov_len) - start_iov_off, bytes_to_copy);
-
-            pci_dma_write(pci_dev, target_addr + copied,
-                          iov->iov_base + start_iov_off - curr_off,
-                          chunk_len);
-
-            copied += chunk_len;
-            start_iov_off += chunk_len;
-            curr_off = start_iov_off;
-            bytes_to_copy -= chunk_len;
-        } else {
-            curr_off += iov->iov_len;
-        }
-        iov++;
-    }
-}
-
 static void
 vmxnet3_pci_dma_write_rxcd(PCIDevice *pcidev, dma_addr_t pa,
                            struct Vmxnet3_RxCompDesc *rxcd)
@@ -990,7 +960,6 @@ vmxnet3_indicate_packet(VMXNET3State *s)
     uint32_t new_rxcd_gen = VMXNET3_INIT_GEN;
     hwaddr new_rxcd_pa = 0;
     hwaddr ready_rxcd_pa = 0;
-    struct iovec *data = net_rx_pkt_get_iovec(s->rx_pkt);
     size_t bytes_copied = 0;
     size_t bytes_left = net_rx_pkt_get_total_len(s->rx_pkt);
     uint16_t num_frags = 0;
@@ -1015,7 +984,9 @@ vmxnet3_indicate_packet(VMXNET3State *s)
         }
 
         chunk_size = MIN(bytes_left, rxd.len);
-        vmxnet3_pci_dma_writev(d, data, bytes_copied, rxd.addr, chunk_size);
+        net_rx_pkt_copy_to_guest(s->rx_pkt, bytes_copied,
+                                 pci_get_address_space(d), rxd.addr,
+                                 chunk_size);
         bytes_copied += chunk_size;
         bytes_left -= chunk_size;
 
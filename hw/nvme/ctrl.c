@@ -35,6 +35,8 @@
  *              mdts=<N[optional]>,vsl=<N[optional]>, \
  *              zoned.zasl=<N[optional]>, \
  *              zoned.auto_transition=<on|off[optional]>, \
+ *              ioeventfd=<on|off[optional]>, \
+ *              x-async-doorbells=<on|off[optional]>, \
  *              subsys=<subsys_id>
  *      -device nvme-ns,drive=<drive_id>,bus=<bus_name>,nsid=<nsid>,\
  *              zoned=<true|false[optional]>, \
@@ -106,6 +108,18 @@
  *   transitioned to zone state closed for resource management purposes.
  *   Defaults to 'on'.
  *
+ * - `ioeventfd`
+ *   Handle doorbell writes to I/O queues with eventfds instead of returning
+ *   to QEMU for every write. This only takes effect once the host has enabled
+ *   shadow doorbells with the Doorbell Buffer Config command, since the
+ *   written value is taken from the shadow doorbell. Defaults to 'off'.
+ *
+ * - `x-async-doorbells`
+ *   Record doorbell writes without taking the BQL in the vCPU thread and
+ *   process them in the main loop, coalescing repeated writes to the same
+ *   doorbell. Unlike `ioeventfd`, this works without shadow doorbells, but
+ *   every write still exits to QEMU. Defaults to 'off'.
+ *
  * nvme namespace device parameters
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * - `shared`
@@ -206,6 +220,8 @@ static const uint32_t nvme_feature_cap[NVME_FID_MAX] = {
     [NVME_ASYNCHRONOUS_EVENT_CONF]  = NVME_FEAT_CAP_CHANGE,
     [NVME_TIMESTAMP]                = NVME_FEAT_CAP_CHANGE,
     [NVME_COMMAND_SET_PROFILE]      = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_COALESCING]     = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_VECTOR_CONF]    = NVME_FEAT_CAP_CHANGE,
 };
 
 static const uint32_t nvme_cse_acs[256] = {
@@ -221,6 +237,7 @@ static const uint32_t nvme_cse_acs[256] = {
     [NVME_ADM_CMD_ASYNC_EV_REQ]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_NS_ATTACHMENT]    = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_NIC,
     [NVME_ADM_CMD_FORMAT_NVM]       = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_LBCC,
+    [NVME_ADM_CMD_DBBUF_CONFIG]     = NVME_CMD_EFF_CSUPP,
 };
 
 static const uint32_t nvme_cse_iocs_none[256];
@@ -437,6 +454,85 @@ static uint8_t nvme_sq_empty(NvmeSQueue *sq)
     return sq->head == sq->tail;
 }
 
+/*
+ * With the Doorbell Buffer Config command, the host writes new I/O queue
+ * doorbell values to a shadow doorbell in its memory and only writes the
+ * doorbell register once we have consumed everything up to the EventIdx.
+ * Publishing the value we have seen as EventIdx asks for a doorbell write
+ * as soon as the host goes beyond it.
+ */
+static void nvme_update_sq_tail(NvmeSQueue *sq)
+{
+    uint32_t tail;
+
+    if (pci_dma_read(&sq->ctrl->parent_obj, sq->db_addr, &tail,
+                     sizeof(tail))) {
+        trace_pci_nvme_err_addr_read(sq->db_addr);
+        return;
+    }
+
+    tail = le32_to_cpu(tail);
+    if (unlikely(tail >= sq->size)) {
+        NVME_GUEST_ERR(pci_nvme_ub_db_wr_invalid_sqtail,
+                       "shadow submission queue doorbell value beyond queue"
+                       " size, sqid=%"PRIu32", new_tail=%"PRIu16", ignoring",
+                       (uint32_t)sq->sqid, (uint16_t)tail);
+        return;
+    }
+
+    sq->tail = tail;
+}
+
+static void nvme_update_sq_eventidx(NvmeSQueue *sq)
+{
+    uint32_t v = cpu_to_le32(sq->tail);
+
+    trace_pci_nvme_update_sq_eventidx(sq->sqid, sq->tail);
+
+    pci_dma_write(&sq->ctrl->parent_obj, sq->ei_addr, &v, sizeof(v));
+
+    /*
+     * The EventIdx must be visible to the host before the shadow doorbell
+     * is read again, or a tail update that raced with it goes unnoticed
+     * and the host never rings the doorbell register.
+     */
+    smp_mb();
+}
+
+static void nvme_update_cq_head(NvmeCQueue *cq)
+{
+    uint32_t head;
+
+    if (pci_dma_read(&cq->ctrl->parent_obj, cq->db_addr, &head,
+                     sizeof(head))) {
+        trace_pci_nvme_err_addr_read(cq->db_addr);
+        return;
+    }
+
+    head = le32_to_cpu(head);
+    if (unlikely(head >= cq->size)) {
+        NVME_GUEST_ERR(pci_nvme_ub_db_wr_invalid_cqhead,
+                       "shadow completion queue doorbell value beyond queue"
+                       " size, cqid=%"PRIu32", new_head=%"PRIu16", ignoring",
+                       (uint32_t)cq->cqid, (uint16_t)head);
+        return;
+    }
+
+    cq->head = head;
+}
+
+static void nvme_update_cq_eventidx(NvmeCQueue *cq)
+{
+    uint32_t v = cpu_to_le32(cq->head);
+
+    trace_pci_nvme_update_cq_eventidx(cq->cqid, cq->head);
+
+    pci_dma_write(&cq->ctrl->parent_obj, cq->ei_addr, &v, sizeof(v));
+
+    /* Order against re-reading the head, see nvme_update_sq_eventidx() */
+    smp_mb();
+}
+
 static void nvme_irq_check(NvmeCtrl *n)
 {
     uint32_t intms = ldl_le_p(&n->bar.intms);
@@ -468,6 +564,49 @@ static void nvme_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+/*
+ * Interrupt Coalescing: the interrupt for @posted new completion entries is
+ * held back until the aggregation threshold is reached or the aggregation
+ * time has passed.  The Admin Completion Queue vector is never coalesced.
+ */
+static void nvme_irq_coalesce(NvmeCtrl *n, NvmeCQueue *cq, uint32_t posted)
+{
+    uint8_t thr = NVME_INTC_THR(n->features.int_coalescing);
+    uint8_t time = NVME_INTC_TIME(n->features.int_coalescing);
+
+    if (!time || !cq->irq_enabled || cq->vector == n->admin_cq.vector ||
+        test_bit(cq->vector, n->features.int_vector_cd)) {
+        nvme_irq_assert(n, cq);
+        return;
+    }
+
+    /* The threshold is a 0's based value */
+    cq->coalesced += posted;
+    if (cq->coalesced > thr) {
+        timer_del(cq->coalesce_timer);
+        cq->coalesced = 0;
+        nvme_irq_assert(n, cq);
+    } else if (!timer_pending(cq->coalesce_timer)) {
+        /* The aggregation time is in 100 microsecond increments */
+        int64_t delay = time * 100 * SCALE_US;
+
+        timer_mod(cq->coalesce_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+    }
+}
+
+static void nvme_irq_coalesce_timer(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    cq->coalesced = 0;
+
+    /* Nothing to signal if the host polled the entries meanwhile */
+    if (cq->tail != cq->head) {
+        nvme_irq_assert(cq->ctrl, cq);
+    }
+}
+
 static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
 {
     if (cq->irq_enabled) {
@@ -1272,8 +1411,23 @@ static void nvme_post_cqes(void *opaque)
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
     bool pending = cq->head != cq->tail;
+    uint32_t posted = 0;
     int ret;
 
+    if (cq->db_addr) {
+        nvme_update_cq_eventidx(cq);
+        nvme_update_cq_head(cq);
+
+        if (pending && cq->head == cq->tail) {
+            if (cq->irq_enabled) {
+                n->cq_pending--;
+            }
+
+            nvme_irq_deassert(n, cq);
+            pending = false;
+        }
+    }
+
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
         hwaddr addr;
@@ -1299,13 +1453,14 @@ static void nvme_post_cqes(void *opaque)
         nvme_inc_cq_tail(cq);
         nvme_sg_unmap(&req->sg);
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
+        posted++;
     }
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
             n->cq_pending++;
         }
 
-        nvme_irq_assert(n, cq);
+        nvme_irq_coalesce(n, cq, posted);
     }
 }
 
@@ -3928,10 +4083,80 @@ static uint16_t nvme_io_cmd(NvmeCtrl *n, NvmeRequest *req)
     return NVME_INVALID_OPCODE | NVME_DNR;
 }
 
+static void nvme_sq_notifier(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    if (!event_notifier_test_and_clear(e)) {
+        return;
+    }
+
+    nvme_process_sq(sq);
+}
+
+/*
+ * Returns the region that handles the doorbell at @offset from the start of
+ * the doorbells and turns @offset into an offset within that region
+ */
+static MemoryRegion *nvme_db_region(NvmeCtrl *n, hwaddr *offset)
+{
+    if (n->params.async_doorbells) {
+        return &n->db.mr;
+    }
+
+    *offset += sizeof(n->bar);
+    return &n->iomem;
+}
+
+static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
+{
+    NvmeCtrl *n = sq->ctrl;
+    hwaddr offset = sq->sqid << 3;
+    MemoryRegion *mr = nvme_db_region(n, &offset);
+    int ret;
+
+    ret = event_notifier_init(&sq->notifier, 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+    memory_region_add_eventfd(mr, offset, 4, false, 0, &sq->notifier);
+
+    return 0;
+}
+
+static void nvme_cleanup_ioeventfd(NvmeCtrl *n, EventNotifier *e,
+                                   hwaddr offset)
+{
+    MemoryRegion *mr = nvme_db_region(n, &offset);
+
+    memory_region_del_eventfd(mr, offset, 4, false, 0, e);
+    event_notifier_set_handler(e, NULL);
+    event_notifier_cleanup(e);
+}
+
+static void nvme_init_sq_dbbuf(NvmeSQueue *sq, NvmeCtrl *n)
+{
+    /*
+     * CAP.DSTRD is 0, so the doorbells of queue i are at offset i << 3, as
+     * in nvme_process_db()
+     */
+    sq->db_addr = n->dbbuf_dbs + (sq->sqid << 3);
+    sq->ei_addr = n->dbbuf_eis + (sq->sqid << 3);
+
+    if (n->params.ioeventfd && !sq->ioeventfd_enabled) {
+        sq->ioeventfd_enabled = !nvme_init_sq_ioeventfd(sq);
+    }
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     n->sq[sq->sqid] = NULL;
     timer_free(sq->timer);
+    if (sq->ioeventfd_enabled) {
+        nvme_cleanup_ioeventfd(n, &sq->notifier, sq->sqid << 3);
+    }
     g_free(sq->io_req);
     if (sq->sqid) {
         g_free(sq);
@@ -4001,6 +4226,11 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     }
     sq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_process_sq, sq);
 
+    /* The controller keeps using the doorbell registers for the admin queues */
+    if (n->dbbuf_enabled && sqid) {
+        nvme_init_sq_dbbuf(sq, n);
+    }
+
     assert(n->cq[cqid]);
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
@@ -4301,10 +4531,58 @@ static uint16_t nvme_get_log(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
+static void nvme_cq_notifier(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
+    NvmeSQueue *sq;
+
+    if (!event_notifier_test_and_clear(e)) {
+        return;
+    }
+
+    /* nvme_post_cqes() picks up the new head and deasserts the interrupt */
+    QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
+        timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+    }
+    nvme_post_cqes(cq);
+}
+
+static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
+{
+    NvmeCtrl *n = cq->ctrl;
+    hwaddr offset = (cq->cqid << 3) + (1 << 2);
+    MemoryRegion *mr = nvme_db_region(n, &offset);
+    int ret;
+
+    ret = event_notifier_init(&cq->notifier, 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
+    memory_region_add_eventfd(mr, offset, 4, false, 0, &cq->notifier);
+
+    return 0;
+}
+
+static void nvme_init_cq_dbbuf(NvmeCQueue *cq, NvmeCtrl *n)
+{
+    cq->db_addr = n->dbbuf_dbs + (cq->cqid << 3) + (1 << 2);
+    cq->ei_addr = n->dbbuf_eis + (cq->cqid << 3) + (1 << 2);
+
+    if (n->params.ioeventfd && !cq->ioeventfd_enabled) {
+        cq->ioeventfd_enabled = !nvme_init_cq_ioeventfd(cq);
+    }
+}
+
 static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 {
     n->cq[cq->cqid] = NULL;
     timer_free(cq->timer);
+    timer_free(cq->coalesce_timer);
+    if (cq->ioeventfd_enabled) {
+        nvme_cleanup_ioeventfd(n, &cq->notifier, (cq->cqid << 3) + (1 << 2));
+    }
     if (msix_enabled(&n->parent_obj)) {
         msix_vector_unuse(&n->parent_obj, cq->vector);
     }
@@ -4362,6 +4640,12 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     QTAILQ_INIT(&cq->sq_list);
     n->cq[cqid] = cq;
     cq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_post_cqes, cq);
+    cq->coalesce_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                      nvme_irq_coalesce_timer, cq);
+
+    if (n->dbbuf_enabled && cqid) {
+        nvme_init_cq_dbbuf(cq, n);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -4937,6 +5221,21 @@ static uint16_t nvme_get_feature(NvmeCtrl *n, NvmeRequest *req)
         goto out;
     case NVME_TIMESTAMP:
         return nvme_get_feature_timestamp(n, req);
+    case NVME_INTERRUPT_COALESCING:
+        result = n->features.int_coalescing;
+        goto out;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->params.max_ioqpairs + 1) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        result = iv;
+        if (iv == n->admin_cq.vector ||
+            test_bit(iv, n->features.int_vector_cd)) {
+            result |= NVME_INTVC_NOCOALESCING;
+        }
+        goto out;
     default:
         break;
     }
@@ -5006,6 +5305,7 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
     uint32_t nsid = le32_to_cpu(cmd->nsid);
     uint8_t fid = NVME_GETSETFEAT_FID(dw10);
     uint8_t save = NVME_SETFEAT_SAVE(dw10);
+    uint16_t iv;
     int i;
 
     trace_pci_nvme_setfeat(nvme_cid(req), nsid, fid, save, dw11);
@@ -5127,6 +5427,30 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
         break;
     case NVME_TIMESTAMP:
         return nvme_set_feature_timestamp(n, req);
+    case NVME_INTERRUPT_COALESCING:
+        trace_pci_nvme_setfeat_intc(NVME_INTC_THR(dw11), NVME_INTC_TIME(dw11));
+        n->features.int_coalescing = dw11 & 0xffff;
+        break;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->params.max_ioqpairs + 1) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        /* Coalescing cannot be enabled for the admin queue vector */
+        if (iv == n->admin_cq.vector) {
+            if (!(dw11 & NVME_INTVC_NOCOALESCING)) {
+                return NVME_INVALID_FIELD | NVME_DNR;
+            }
+            break;
+        }
+
+        if (dw11 & NVME_INTVC_NOCOALESCING) {
+            set_bit(iv, n->features.int_vector_cd);
+        } else {
+            clear_bit(iv, n->features.int_vector_cd);
+        }
+        break;
     case NVME_COMMAND_SET_PROFILE:
         if (dw11 & 0x1ff) {
             trace_pci_nvme_err_invalid_iocsci(dw11 & 0x1ff);
@@ -5470,6 +5794,45 @@ out:
     return status;
 }
 
+static uint16_t nvme_dbbuf_config(NvmeCtrl *n, const NvmeRequest *req)
+{
+    uint64_t dbs_addr = le64_to_cpu(req->cmd.dptr.prp1);
+    uint64_t eis_addr = le64_to_cpu(req->cmd.dptr.prp2);
+    int i;
+
+    trace_pci_nvme_dbbuf_config(dbs_addr, eis_addr);
+
+    /* Both buffers must be page aligned */
+    if ((dbs_addr | eis_addr) & (n->page_size - 1)) {
+        return NVME_INVALID_FIELD | NVME_DNR;
+    }
+
+    n->dbbuf_dbs = dbs_addr;
+    n->dbbuf_eis = eis_addr;
+    n->dbbuf_enabled = true;
+
+    /* Seed the shadow doorbells of existing I/O queues with their state */
+    for (i = 1; i < n->params.max_ioqpairs + 1; i++) {
+        NvmeSQueue *sq = n->sq[i];
+        NvmeCQueue *cq = n->cq[i];
+        uint32_t v;
+
+        if (sq) {
+            nvme_init_sq_dbbuf(sq, n);
+            v = cpu_to_le32(sq->tail);
+            pci_dma_write(&n->parent_obj, sq->db_addr, &v, sizeof(v));
+        }
+
+        if (cq) {
+            nvme_init_cq_dbbuf(cq, n);
+            v = cpu_to_le32(cq->head);
+            pci_dma_write(&n->parent_obj, cq->db_addr, &v, sizeof(v));
+        }
+    }
+
+    return NVME_SUCCESS;
+}
+
 static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
 {
     trace_pci_nvme_admin_cmd(nvme_cid(req), nvme_sqid(req), req->cmd.opcode,
@@ -5514,6 +5877,8 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
         return nvme_ns_attachment(n, req);
     case NVME_ADM_CMD_FORMAT_NVM:
         return nvme_format(n, req);
+    case NVME_ADM_CMD_DBBUF_CONFIG:
+        return nvme_dbbuf_config(n, req);
     default:
         assert(false);
     }
@@ -5532,6 +5897,10 @@ static void nvme_process_sq(void *opaque)
     NvmeCmd cmd;
     NvmeRequest *req;
 
+    if (sq->db_addr) {
+        nvme_update_sq_tail(sq);
+    }
+
     while (!(nvme_sq_empty(sq) || QTAILQ_EMPTY(&sq->req_list))) {
         addr = sq->dma_addr + sq->head * n->sqe_size;
         if (nvme_addr_read(n, addr, (void *)&cmd, sizeof(cmd))) {
@@ -5555,6 +5924,11 @@ static void nvme_process_sq(void *opaque)
             req->status = status;
             nvme_enqueue_req_completion(cq, req);
         }
+
+        if (sq->db_addr) {
+            nvme_update_sq_eventidx(sq);
+            nvme_update_sq_tail(sq);
+        }
     }
 }
 
@@ -5592,6 +5966,14 @@ static void nvme_ctrl_reset(NvmeCtrl *n)
     n->aer_queued = 0;
     n->outstanding_aers = 0;
     n->qs_created = false;
+
+    n->dbbuf_dbs = 0;
+    n->dbbuf_eis = 0;
+    n->dbbuf_enabled = false;
+
+    /* The per-queue coalescing state went away with the completion queues */
+    n->features.int_coalescing = 0;
+    bitmap_zero(n->features.int_vector_cd, n->params.max_ioqpairs + 1);
 }
 
 static void nvme_ctrl_shutdown(NvmeCtrl *n)
@@ -6020,6 +6402,11 @@ static uint64_t nvme_mmio_read(void *opaque, hwaddr addr, unsigned size)
         return 0;
     }
 
+    /* Doorbells written before this access must have taken effect */
+    if (n->params.async_doorbells) {
+        memory_region_doorbell_flush(&n->db);
+    }
+
     /*
      * When PMRWBM bit 1 is set then read from
      * from PMRSTS should ensure prior writes
@@ -6169,6 +6556,11 @@ static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
 
     trace_pci_nvme_mmio_write(addr, data, size);
 
+    /* Doorbells written before this access must be seen first */
+    if (n->params.async_doorbells) {
+        memory_region_doorbell_flush(&n->db);
+    }
+
     if (addr < sizeof(n->bar)) {
         nvme_write_bar(n, addr, data, size);
     } else {
@@ -6176,6 +6568,13 @@ static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
     }
 }
 
+static void nvme_async_db(void *opaque, hwaddr offset, uint32_t value)
+{
+    NvmeCtrl *n = opaque;
+
+    nvme_process_db(n, sizeof(n->bar) + offset, value);
+}
+
 static const MemoryRegionOps nvme_mmio_ops = {
     .read = nvme_mmio_read,
     .write = nvme_mmio_write,
@@ -6283,6 +6682,7 @@ static void nvme_init_state(NvmeCtrl *n)
     n->features.temp_thresh_hi = NVME_TEMPERATURE_WARNING;
     n->starttime_ms = qemu_clock_get_ms(QEMU_CLOCK_VIRTUAL);
     n->aer_reqs = g_new0(NvmeRequest *, n->params.aerl + 1);
+    n->features.int_vector_cd = bitmap_new(n->params.max_ioqpairs + 1);
 }
 
 static void nvme_init_cmb(NvmeCtrl *n, PCIDevice *pci_dev)
@@ -6367,6 +6767,18 @@ static int nvme_init_pci(NvmeCtrl *n, PCIDevice *pci_dev, Error **errp)
                           n->reg_size);
     memory_region_add_subregion(&n->bar0, 0, &n->iomem);
 
+    if (n->params.async_doorbells) {
+        ret = memory_region_doorbell_init(&n->db, OBJECT(n), "nvme-doorbells",
+                                          n->reg_size - sizeof(n->bar),
+                                          qemu_get_aio_context(),
+                                          nvme_async_db, n);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "could not create doorbell notifier");
+            return ret;
+        }
+        memory_region_add_subregion(&n->iomem, sizeof(n->bar), &n->db.mr);
+    }
+
     pci_register_bar(pci_dev, 0, PCI_BASE_ADDRESS_SPACE_MEMORY |
                      PCI_BASE_ADDRESS_MEM_TYPE_64, &n->bar0);
     ret = msix_init(pci_dev, n->params.msix_qsize,
@@ -6435,7 +6847,8 @@ static void nvme_init_ctrl(NvmeCtrl *n, PCIDevice *pci_dev)
 
     id->mdts = n->params.mdts;
     id->ver = cpu_to_le32(NVME_SPEC_VER);
-    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT);
+    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT |
+                           NVME_OACS_DBBUF);
     id->cntrltype = 0x1;
 
     /*
@@ -6594,6 +7007,7 @@ static void nvme_exit(PCIDevice *pci_dev)
     g_free(n->cq);
     g_free(n->sq);
     g_free(n->aer_reqs);
+    g_free(n->features.int_vector_cd);
 
     if (n->params.cmb_size_mb) {
         g_free(n->cmb.buf);
@@ -6603,6 +7017,10 @@ static void nvme_exit(PCIDevice *pci_dev)
         host_memory_backend_set_mapped(n->pmr.dev, false);
     }
     msix_uninit(pci_dev, &n->bar0, &n->bar0);
+    if (n->params.async_doorbells) {
+        memory_region_del_subregion(&n->iomem, &n->db.mr);
+        memory_region_doorbell_destroy(&n->db);
+    }
     memory_region_del_subregion(&n->bar0, &n->iomem);
 }
 
@@ -6623,6 +7041,9 @@ static Property nvme_props[] = {
     DEFINE_PROP_UINT8("vsl", NvmeCtrl, params.vsl, 7),
     DEFINE_PROP_BOOL("use-intel-id", NvmeCtrl, params.use_intel_id, false),
     DEFINE_PROP_BOOL("legacy-cmb", NvmeCtrl, params.legacy_cmb, false),
+    DEFINE_PROP_BOOL("ioeventfd", NvmeCtrl, params.ioeventfd, false),
+    DEFINE_PROP_BOOL("x-async-doorbells", NvmeCtrl, params.async_doorbells,
+                     false),
     DEFINE_PROP_UINT8("zoned.zasl", NvmeCtrl, params.zasl, 0),
     DEFINE_PROP_BOOL("zoned.auto_transition", NvmeCtrl,
                      params.auto_transition_zones, true),
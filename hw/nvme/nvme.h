@@ -19,8 +19,10 @@
 #define HW_NVME_INTERNAL_H
 
 #include "qemu/uuid.h"
+#include "qemu/event_notifier.h"
 #include "hw/pci/pci.h"
 #include "hw/block/block.h"
+#include "exec/doorbell.h"
 
 #include "block/nvme.h"
 
@@ -320,6 +322,7 @@ static inline const char *nvme_adm_opc_str(uint8_t opc)
     case NVME_ADM_CMD_GET_FEATURES:     return "NVME_ADM_CMD_GET_FEATURES";
     case NVME_ADM_CMD_ASYNC_EV_REQ:     return "NVME_ADM_CMD_ASYNC_EV_REQ";
     case NVME_ADM_CMD_NS_ATTACHMENT:    return "NVME_ADM_CMD_NS_ATTACHMENT";
+    case NVME_ADM_CMD_DBBUF_CONFIG:     return "NVME_ADM_CMD_DBBUF_CONFIG";
     case NVME_ADM_CMD_FORMAT_NVM:       return "NVME_ADM_CMD_FORMAT_NVM";
     default:                            return "NVME_ADM_CMD_UNKNOWN";
     }
@@ -351,7 +354,11 @@ typedef struct NvmeSQueue {
     uint32_t    tail;
     uint32_t    size;
     uint64_t    dma_addr;
+    uint64_t    db_addr;    /* shadow doorbell, if enabled */
+    uint64_t    ei_addr;    /* EventIdx, if enabled */
     QEMUTimer   *timer;
+    EventNotifier notifier;
+    bool        ioeventfd_enabled;
     NvmeRequest *io_req;
     QTAILQ_HEAD(, NvmeRequest) req_list;
     QTAILQ_HEAD(, NvmeRequest) out_req_list;
@@ -368,7 +375,14 @@ typedef struct NvmeCQueue {
     uint32_t    vector;
     uint32_t    size;
     uint64_t    dma_addr;
+    uint64_t    db_addr;    /* shadow doorbell, if enabled */
+    uint64_t    ei_addr;    /* EventIdx, if enabled */
     QEMUTimer   *timer;
+    EventNotifier notifier;
+    bool        ioeventfd_enabled;
+    /* Interrupt coalescing, per queue rather than per vector */
+    QEMUTimer   *coalesce_timer;
+    uint32_t    coalesced;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
 } NvmeCQueue;
@@ -391,12 +405,15 @@ typedef struct NvmeParams {
     uint8_t  zasl;
     bool     auto_transition_zones;
     bool     legacy_cmb;
+    bool     ioeventfd;
+    bool     async_doorbells;
 } NvmeParams;
 
 typedef struct NvmeCtrl {
     PCIDevice    parent_obj;
     MemoryRegion bar0;
     MemoryRegion iomem;
+    MemoryRegionDoorbell db;
     NvmeBar      bar;
     NvmeParams   params;
     NvmeBus      bus;
@@ -439,6 +456,11 @@ typedef struct NvmeCtrl {
 
     uint32_t    dmrsl;
 
+    /* Doorbell Buffer Config */
+    bool        dbbuf_enabled;
+    uint64_t    dbbuf_dbs;
+    uint64_t    dbbuf_eis;
+
     /* Namespace ID is started with 1 so bitmap should be 1-based */
 #define NVME_CHANGED_NSID_SIZE  (NVME_MAX_NAMESPACES + 1)
     DECLARE_BITMAP(changed_nsids, NVME_CHANGED_NSID_SIZE);
@@ -459,6 +481,9 @@ typedef struct NvmeCtrl {
             uint16_t temp_thresh_low;
         };
         uint32_t    async_config;
+        uint16_t    int_coalescing;
+        /* Vectors with Coalescing Disable set */
+        unsigned long *int_vector_cd;
     } features;
 } NvmeCtrl;
 
@@ -674,6 +674,28 @@ static const struct SCSIReqOps reqops_target_command = {
 };
 
 
+/*
+ * Requests of the size used most recently are kept around when they are
+ * freed, so that a steady stream of reads and writes does not go through
+ * the allocator twice per command.  They are protected by the same lock
+ * as the device's request list.
+ */
+#define SCSI_REQ_CACHE_MAX 64
+
+static void scsi_req_free(SCSIDevice *d, SCSIRequest *req)
+{
+    size_t size = req->ops->size;
+
+    if (d->nr_free_reqs == SCSI_REQ_CACHE_MAX ||
+        (d->nr_free_reqs && d->free_req_size != size)) {
+        g_free(req);
+        return;
+    }
+    d->free_req_size = size;
+    QTAILQ_INSERT_HEAD(&d->free_reqs, req, next);
+    d->nr_free_reqs++;
+}
+
 SCSIRequest *scsi_req_alloc(const SCSIReqOps *reqops, SCSIDevice *d,
                             uint32_t tag, uint32_t lun, void *hba_private)
 {
@@ -683,7 +705,13 @@ SCSIRequest *scsi_req_alloc(const SCSIReqOps *reqops, SCSIDevice *d,
     const int memset_off = offsetof(SCSIRequest, sense)
                            + sizeof(req->sense);
 
-    req = g_malloc(reqops->size);
+    req = QTAILQ_FIRST(&d->free_reqs);
+    if (req && d->free_req_size == reqops->size) {
+        QTAILQ_REMOVE(&d->free_reqs, req, next);
+        d->nr_free_reqs--;
+    } else {
+        req = g_malloc(reqops->size);
+    }
     memset((uint8_t *)req + memset_off, 0, reqops->size - memset_off);
     req->refcount = 1;
     req->bus = bus;
@@ -1364,7 +1392,8 @@ void scsi_req_unref(SCSIRequest *req)
 {
     assert(req->refcount > 0);
     if (--req->refcount == 0) {
-        BusState *qbus = req->dev->qdev.parent_bus;
+        SCSIDevice *d = req->dev;
+        BusState *qbus = d->qdev.parent_bus;
         SCSIBus *bus = DO_UPCAST(SCSIBus, qbus, qbus);
 
         if (bus->info->free_request && req->hba_private) {
@@ -1373,9 +1402,9 @@ void scsi_req_unref(SCSIRequest *req)
         if (req->ops->free_req) {
             req->ops->free_req(req);
         }
-        object_unref(OBJECT(req->dev));
+        scsi_req_free(d, req);
+        object_unref(OBJECT(d));
         object_unref(OBJECT(qbus->parent));
-        g_free(req);
     }
 }
 
@@ -1814,6 +1843,17 @@ static void scsi_dev_instance_init(Object *obj)
     device_add_bootindex_property(obj, &s->conf.bootindex,
                                   "bootindex", NULL,
                                   &s->qdev);
+    QTAILQ_INIT(&s->free_reqs);
+}
+
+static void scsi_dev_instance_finalize(Object *obj)
+{
+    SCSIDevice *s = SCSI_DEVICE(obj);
+    SCSIRequest *req, *tmp;
+
+    QTAILQ_FOREACH_SAFE(req, &s->free_reqs, next, tmp) {
+        g_free(req);
+    }
 }
 
 static const TypeInfo scsi_device_type_info = {
@@ -1824,6 +1864,7 @@ static const TypeInfo scsi_device_type_info = {
     .class_size = sizeof(SCSIDeviceClass),
     .class_init = scsi_device_class_init,
     .instance_init = scsi_dev_instance_init,
+    .instance_finalize = scsi_dev_instance_finalize,
 };
 
 static void scsi_bus_class_init(ObjectClass *klass, void *data)
@@ -28,8 +28,14 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    unsigned i;
 
-    if (vs->conf.iothread) {
+    if (vs->conf.iothread && vs->conf.num_iothreads) {
+        error_setg(errp, "iothread and iothreads cannot be used together");
+        return;
+    }
+
+    if (vs->conf.iothread || vs->conf.num_iothreads) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -40,6 +46,29 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
             error_setg(errp, "ioeventfd is required for iothread");
             return;
         }
+    }
+
+    if (vs->conf.num_iothreads) {
+        s->iothreads = g_new0(IOThread *, vs->conf.num_iothreads);
+        for (i = 0; i < vs->conf.num_iothreads; i++) {
+            IOThread *iothread = iothread_by_id(vs->conf.iothreads[i] ?: "");
+
+            if (!iothread) {
+                error_setg(errp, "IOThread '%s' not found",
+                           vs->conf.iothreads[i] ?: "");
+                while (i--) {
+                    object_unref(OBJECT(s->iothreads[i]));
+                }
+                g_free(s->iothreads);
+                s->iothreads = NULL;
+                return;
+            }
+            object_ref(OBJECT(iothread));
+            s->iothreads[i] = iothread;
+        }
+        s->num_iothreads = vs->conf.num_iothreads;
+        s->ctx = iothread_get_aio_context(s->iothreads[0]);
+    } else if (vs->conf.iothread) {
         s->ctx = iothread_get_aio_context(vs->conf.iothread);
     } else {
         if (!virtio_device_ioeventfd_enabled(vdev)) {
@@ -47,6 +76,42 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
         }
         s->ctx = qemu_get_aio_context();
     }
+
+    s->cmd_vq_ctx = g_new(AioContext *, vs->conf.num_queues);
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        s->cmd_vq_ctx[i] = s->num_iothreads ?
+            iothread_get_aio_context(s->iothreads[i % s->num_iothreads]) :
+            s->ctx;
+    }
+}
+
+/* Context: QEMU global mutex held */
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s)
+{
+    unsigned i;
+
+    for (i = 0; i < s->num_iothreads; i++) {
+        object_unref(OBJECT(s->iothreads[i]));
+    }
+    g_free(s->iothreads);
+    s->iothreads = NULL;
+    s->num_iothreads = 0;
+    g_free(s->cmd_vq_ctx);
+    s->cmd_vq_ctx = NULL;
+}
+
+/* Is @ctx the AioContext of one of the first @n request virtqueues? */
+static bool virtio_scsi_dataplane_uses_ctx(VirtIOSCSI *s, AioContext *ctx,
+                                           int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (s->cmd_vq_ctx[i] == ctx) {
+            return true;
+        }
+    }
+    return false;
 }
 
 static int virtio_scsi_set_host_notifier(VirtIOSCSI *s, VirtQueue *vq, int n)
@@ -66,20 +131,38 @@ static int virtio_scsi_set_host_notifier(VirtIOSCSI *s, VirtQueue *vq, int n)
     return 0;
 }
 
+typedef struct VirtIOSCSIDataPlaneStopBH {
+    VirtIOSCSI *s;
+    AioContext *ctx;
+} VirtIOSCSIDataPlaneStopBH;
+
 /* Context: BH in IOThread */
 static void virtio_scsi_dataplane_stop_bh(void *opaque)
 {
-    VirtIOSCSI *s = opaque;
+    VirtIOSCSIDataPlaneStopBH *data = opaque;
+    VirtIOSCSI *s = data->s;
     VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
     int i;
 
-    virtio_queue_aio_detach_host_notifier(vs->ctrl_vq, s->ctx);
-    virtio_queue_aio_detach_host_notifier(vs->event_vq, s->ctx);
+    if (data->ctx == s->ctx) {
+        virtio_queue_aio_detach_host_notifier(vs->ctrl_vq, s->ctx);
+        virtio_queue_aio_detach_host_notifier(vs->event_vq, s->ctx);
+    }
     for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_detach_host_notifier(vs->cmd_vqs[i], s->ctx);
+        if (s->cmd_vq_ctx[i] == data->ctx) {
+            virtio_queue_aio_detach_host_notifier(vs->cmd_vqs[i], data->ctx);
+        }
     }
 }
 
+/* Runs in the IOThread, so that the coalescing timers cannot fire meanwhile */
+static void virtio_scsi_dataplane_stop_coalescing_bh(void *opaque)
+{
+    VirtIOSCSI *s = opaque;
+
+    virtio_scsi_set_coalescing(s, qemu_get_aio_context());
+}
+
 /* Context: QEMU global mutex held */
 int virtio_scsi_dataplane_start(VirtIODevice *vdev)
 {
@@ -140,13 +223,18 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
     virtio_queue_aio_attach_host_notifier(vs->ctrl_vq, s->ctx);
     virtio_queue_aio_attach_host_notifier(vs->event_vq, s->ctx);
 
-    for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_attach_host_notifier(vs->cmd_vqs[i], s->ctx);
-    }
+    virtio_scsi_set_coalescing(s, s->ctx);
 
     s->dataplane_starting = false;
     s->dataplane_started = true;
     aio_context_release(s->ctx);
+
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        aio_context_acquire(s->cmd_vq_ctx[i]);
+        virtio_queue_aio_attach_host_notifier(vs->cmd_vqs[i],
+                                              s->cmd_vq_ctx[i]);
+        aio_context_release(s->cmd_vq_ctx[i]);
+    }
     return 0;
 
 fail_host_notifiers:
@@ -192,12 +280,28 @@ void virtio_scsi_dataplane_stop(VirtIODevice *vdev)
     }
     s->dataplane_stopping = true;
 
-    aio_context_acquire(s->ctx);
-    aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
-    aio_context_release(s->ctx);
+    for (i = -1; i < (int)vs->conf.num_queues; i++) {
+        VirtIOSCSIDataPlaneStopBH data = {
+            .s = s,
+            .ctx = i < 0 ? s->ctx : s->cmd_vq_ctx[i],
+        };
+
+        /* One BH for each AioContext, starting with the main one */
+        if (i >= 0 && (data.ctx == s->ctx ||
+                       virtio_scsi_dataplane_uses_ctx(s, data.ctx, i))) {
+            continue;
+        }
+        aio_context_acquire(data.ctx);
+        aio_wait_bh_oneshot(data.ctx, virtio_scsi_dataplane_stop_bh, &data);
+        aio_context_release(data.ctx);
+    }
 
     blk_drain_all(); /* ensure there are no in-flight requests */
 
+    aio_context_acquire(s->ctx);
+    aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_coalescing_bh, s);
+    aio_context_release(s->ctx);
+
     /*
      * Batch all the host notifiers in a single transaction to avoid
      * quadratic time complexity in address_space_update_ioeventfds().
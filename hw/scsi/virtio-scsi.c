@@ -58,11 +58,24 @@ void virtio_scsi_init_req(VirtIOSCSI *s, VirtQueue *vq, VirtIOSCSIReq *req)
     memset((uint8_t *)req + zero_skip, 0, sizeof(*req) - zero_skip);
 }
 
+/* Command queue interrupts are coalesced in @ctx, where requests complete */
+void virtio_scsi_set_coalescing(VirtIOSCSI *s, AioContext *ctx)
+{
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    int i;
+
+    for (i = 0; i < vs->conf.num_queues; i++) {
+        virtio_queue_set_coalescing(vs->cmd_vqs[i], ctx,
+                                    vs->conf.coalesce_usecs,
+                                    vs->conf.coalesce_frames);
+    }
+}
+
 void virtio_scsi_free_req(VirtIOSCSIReq *req)
 {
     qemu_iovec_destroy(&req->resp_iov);
     qemu_sglist_destroy(&req->qsgl);
-    g_free(req);
+    virtqueue_element_free(req->vq, req);
 }
 
 static void virtio_scsi_complete_req(VirtIOSCSIReq *req)
@@ -187,6 +200,23 @@ static VirtIOSCSIReq *virtio_scsi_pop_req(VirtIOSCSI *s, VirtQueue *vq)
     return req;
 }
 
+/* Number of command requests popped from the virtqueue at once */
+#define VIRTIO_SCSI_POP_BATCH 32
+
+static unsigned int virtio_scsi_pop_reqs(VirtIOSCSI *s, VirtQueue *vq,
+                                         VirtIOSCSIReq **reqs)
+{
+    VirtIOSCSICommon *vs = (VirtIOSCSICommon *)s;
+    unsigned int i, n;
+
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOSCSIReq) + vs->cdb_size,
+                            (void **)reqs, VIRTIO_SCSI_POP_BATCH);
+    for (i = 0; i < n; i++) {
+        virtio_scsi_init_req(s, vq, reqs[i]);
+    }
+    return n;
+}
+
 static void virtio_scsi_save_request(QEMUFile *f, SCSIRequest *sreq)
 {
     VirtIOSCSIReq *req = sreq->hba_private;
@@ -675,6 +705,8 @@ static void virtio_scsi_handle_cmd_req_submit(VirtIOSCSI *s, VirtIOSCSIReq *req)
 bool virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
 {
     VirtIOSCSIReq *req, *next;
+    VirtIOSCSIReq *batch[VIRTIO_SCSI_POP_BATCH];
+    unsigned int i, n;
     int ret = 0;
     bool suppress_notifications = virtio_queue_get_notification(vq);
     bool progress = false;
@@ -686,20 +718,32 @@ bool virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_scsi_pop_req(s, vq))) {
+        while (ret != -EINVAL && (n = virtio_scsi_pop_reqs(s, vq, batch))) {
             progress = true;
-            ret = virtio_scsi_handle_cmd_req_prepare(s, req);
-            if (!ret) {
-                QTAILQ_INSERT_TAIL(&reqs, req, next);
-            } else if (ret == -EINVAL) {
-                /* The device is broken and shouldn't process any request */
-                while (!QTAILQ_EMPTY(&reqs)) {
-                    req = QTAILQ_FIRST(&reqs);
-                    QTAILQ_REMOVE(&reqs, req, next);
-                    blk_io_unplug(req->sreq->dev->conf.blk);
-                    scsi_req_unref(req->sreq);
+            for (i = 0; i < n; i++) {
+                req = batch[i];
+                if (ret == -EINVAL) {
+                    /* Drop the rest of the batch */
                     virtqueue_detach_element(req->vq, &req->elem, 0);
                     virtio_scsi_free_req(req);
+                    continue;
+                }
+                ret = virtio_scsi_handle_cmd_req_prepare(s, req);
+                if (!ret) {
+                    QTAILQ_INSERT_TAIL(&reqs, req, next);
+                } else if (ret == -EINVAL) {
+                    /*
+                     * The device is broken and shouldn't process any
+                     * request
+                     */
+                    while (!QTAILQ_EMPTY(&reqs)) {
+                        req = QTAILQ_FIRST(&reqs);
+                        QTAILQ_REMOVE(&reqs, req, next);
+                        blk_io_unplug(req->sreq->dev->conf.blk);
+                        scsi_req_unref(req->sreq);
+                        virtqueue_detach_element(req->vq, &req->elem, 0);
+                        virtio_scsi_free_req(req);
+                    }
                 }
             }
         }
@@ -925,6 +969,7 @@ static void virtio_scsi_hotunplug(HotplugHandler *hotplug_dev, DeviceState *dev,
     VirtIOSCSI *s = VIRTIO_SCSI(vdev);
     SCSIDevice *sd = SCSI_DEVICE(dev);
     AioContext *ctx = s->ctx ?: qemu_get_aio_context();
+    unsigned i;
 
     if (virtio_vdev_has_feature(vdev, VIRTIO_SCSI_F_HOTPLUG)) {
         virtio_scsi_acquire(s);
@@ -934,8 +979,15 @@ static void virtio_scsi_hotunplug(HotplugHandler *hotplug_dev, DeviceState *dev,
         virtio_scsi_release(s);
     }
 
+    /* Request virtqueues in other IOThreads must not submit to @sd either */
     aio_disable_external(ctx);
+    for (i = 0; i < s->num_iothreads; i++) {
+        aio_disable_external(iothread_get_aio_context(s->iothreads[i]));
+    }
     qdev_simple_device_unplug_cb(hotplug_dev, dev, errp);
+    for (i = 0; i < s->num_iothreads; i++) {
+        aio_enable_external(iothread_get_aio_context(s->iothreads[i]));
+    }
     aio_enable_external(ctx);
 
     if (s->ctx) {
@@ -1019,6 +1071,8 @@ static void virtio_scsi_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    virtio_scsi_set_coalescing(s, qemu_get_aio_context());
+
     scsi_bus_init_named(&s->bus, sizeof(s->bus), dev,
                        &virtio_scsi_scsi_info, vdev->bus_name);
     /* override default SCSI bus hotplug-handler, with virtio-scsi's one */
@@ -1048,6 +1102,7 @@ static void virtio_scsi_device_unrealize(DeviceState *dev)
 
     qbus_set_hotplug_handler(BUS(&s->bus), NULL);
     virtio_scsi_common_unrealize(dev);
+    virtio_scsi_dataplane_cleanup(s);
 }
 
 static Property virtio_scsi_properties[] = {
@@ -1061,6 +1116,10 @@ static Property virtio_scsi_properties[] = {
                                                   0xFFFF),
     DEFINE_PROP_UINT32("cmd_per_lun", VirtIOSCSI, parent_obj.conf.cmd_per_lun,
                                                   128),
+    DEFINE_PROP_UINT32("coalesce-usecs", VirtIOSCSI,
+                       parent_obj.conf.coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("coalesce-frames", VirtIOSCSI,
+                       parent_obj.conf.coalesce_frames, 0),
     DEFINE_PROP_BIT("hotplug", VirtIOSCSI, host_features,
                                            VIRTIO_SCSI_F_HOTPLUG, true),
     DEFINE_PROP_BIT("param_change", VirtIOSCSI, host_features,
@@ -44,6 +44,8 @@
 #define TRB_LINK_LIMIT  32
 #define COMMAND_LIMIT   256
 #define TRANSFER_LIMIT  256
+/* Transfers in flight per endpoint, in addition to one per stream */
+#define XFER_LIMIT      64
 
 #define LEN_CAP         0x40
 #define LEN_OPER        (0x400 + 0x10 * XHCI_MAXPORTS)
@@ -562,17 +564,8 @@ static void xhci_intr_update(XHCIState *xhci, int v)
     }
 }
 
-static void xhci_intr_raise(XHCIState *xhci, int v)
+static void xhci_intr_deliver(XHCIState *xhci, int v)
 {
-    bool pending = (xhci->intr[v].erdp_low & ERDP_EHB);
-
-    xhci->intr[v].erdp_low |= ERDP_EHB;
-    xhci->intr[v].iman |= IMAN_IP;
-    xhci->usbsts |= USBSTS_EINT;
-
-    if (pending) {
-        return;
-    }
     if (!(xhci->intr[v].iman & IMAN_IE)) {
         return;
     }
@@ -587,6 +580,68 @@ static void xhci_intr_raise(XHCIState *xhci, int v)
     }
 }
 
+/* The moderation interval, IMODI, counts in units of 250 ns */
+static int64_t xhci_imod_interval(XHCIInterrupter *intr)
+{
+    return (intr->imod & 0xffff) * 250;
+}
+
+static void xhci_imod_timer(void *opaque)
+{
+    XHCIState *xhci = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int v;
+
+    for (v = 0; v < xhci->numintrs; v++) {
+        XHCIInterrupter *intr = &xhci->intr[v];
+
+        if (!intr->imod_pending) {
+            continue;
+        }
+        if (now < intr->imod_deadline) {
+            timer_mod_anticipate(xhci->imod_timer, intr->imod_deadline);
+            continue;
+        }
+        intr->imod_pending = false;
+        intr->imod_deadline = now + xhci_imod_interval(intr);
+        if (intr->iman & IMAN_IP) {
+            xhci_intr_deliver(xhci, v);
+        }
+    }
+}
+
+static void xhci_intr_raise(XHCIState *xhci, int v)
+{
+    XHCIInterrupter *intr = &xhci->intr[v];
+    bool pending = (intr->erdp_low & ERDP_EHB);
+    int64_t now;
+
+    intr->erdp_low |= ERDP_EHB;
+    intr->iman |= IMAN_IP;
+    xhci->usbsts |= USBSTS_EINT;
+
+    if (pending || intr->imod_pending) {
+        return;
+    }
+
+    /*
+     * Interrupt moderation: after an interrupt, the next one is held back
+     * until the interval programmed by the guest has passed, and then
+     * covers all the events written in the meantime.
+     */
+    if (xhci_imod_interval(intr)) {
+        now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        if (now < intr->imod_deadline) {
+            intr->imod_pending = true;
+            timer_mod_anticipate(xhci->imod_timer, intr->imod_deadline);
+            return;
+        }
+        intr->imod_deadline = now + xhci_imod_interval(intr);
+    }
+
+    xhci_intr_deliver(xhci, v);
+}
+
 static inline int xhci_running(XHCIState *xhci)
 {
     return !(xhci->usbsts & USBSTS_HCH);
@@ -1116,7 +1171,7 @@ static TRBCCode xhci_enable_ep(XHCIState *xhci, unsigned int slotid,
 static XHCITransfer *xhci_ep_alloc_xfer(XHCIEPContext *epctx,
                                         uint32_t length)
 {
-    uint32_t limit = epctx->nr_pstreams + 16;
+    uint32_t limit = epctx->nr_pstreams + XFER_LIMIT;
     XHCITransfer *xfer;
 
     if (epctx->xfer_count >= limit) {
@@ -2685,7 +2740,10 @@ static void xhci_reset(DeviceState *dev)
         xhci->intr[i].er_pcs = 1;
         xhci->intr[i].ev_buffer_put = 0;
         xhci->intr[i].ev_buffer_get = 0;
+        xhci->intr[i].imod_deadline = 0;
+        xhci->intr[i].imod_pending = false;
     }
+    timer_del(xhci->imod_timer);
 
     xhci->mfindex_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     xhci_mfwrap_update(xhci);
@@ -3365,6 +3423,7 @@ static void usb_xhci_realize(DeviceState *dev, Error **errp)
 
     usb_xhci_init(xhci);
     xhci->mfwrap_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, xhci_mfwrap_timer, xhci);
+    xhci->imod_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, xhci_imod_timer, xhci);
 
     memory_region_init(&xhci->mem, OBJECT(dev), "xhci", XHCI_LEN_REGS);
     memory_region_init_io(&xhci->mem_cap, OBJECT(dev), &xhci_cap_ops, xhci,
@@ -3406,6 +3465,10 @@ static void usb_xhci_unrealize(DeviceState *dev)
         timer_free(xhci->mfwrap_timer);
         xhci->mfwrap_timer = NULL;
     }
+    if (xhci->imod_timer) {
+        timer_free(xhci->imod_timer);
+        xhci->imod_timer = NULL;
+    }
 
     memory_region_del_subregion(&xhci->mem, &xhci->mem_cap);
     memory_region_del_subregion(&xhci->mem, &xhci->mem_oper);
@@ -3428,11 +3491,19 @@ static int usb_xhci_post_load(void *opaque, int version_id)
     dma_addr_t dcbaap, pctx;
     uint32_t slot_ctx[4];
     uint32_t ep_ctx[5];
-    int slotid, epid, state;
+    int slotid, epid, state, v;
     uint64_t addr;
 
     dcbaap = xhci_addr64(xhci->dcbaap_low, xhci->dcbaap_high);
 
+    /* An interrupt may have been held back by moderation */
+    for (v = 0; v < xhci->numintrs; v++) {
+        if (xhci->intr[v].iman & IMAN_IP) {
+            xhci->intr[v].imod_pending = true;
+            timer_mod(xhci->imod_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+        }
+    }
+
     for (slotid = 1; slotid <= xhci->numslots; slotid++) {
         slot = &xhci->slots[slotid-1];
         if (!slot->addressed) {
@@ -166,6 +166,10 @@ typedef struct XHCIInterrupter {
     uint32_t er_size;
     unsigned int er_ep_idx;
 
+    /* interrupt moderation, not migrated */
+    int64_t imod_deadline;      /* no interrupt before this time */
+    bool imod_pending;          /* an interrupt waits for imod_deadline */
+
     /* kept for live migration compat only */
     bool er_full_unused;
     XHCIEvent ev_buffer[EV_QUEUE];
@@ -215,6 +219,7 @@ typedef struct XHCIState {
     /* Runtime Registers */
     int64_t mfindex_start;
     QEMUTimer *mfwrap_timer;
+    QEMUTimer *imod_timer;
     XHCIInterrupter intr[XHCI_MAXINTRS];
 
     XHCIRing cmd_ring;
@@ -116,6 +116,10 @@ struct USBRedirDevice {
     CharBackend cs;
     bool enable_streams;
     bool suppress_remote_wake;
+    bool bulk_in_buffering;
+    uint8_t bulk_in_transfers;
+    uint32_t bulk_in_transfer_size;
+    uint32_t iso_latency;
     bool in_write;
     uint8_t debug;
     int32_t bootindex;
@@ -540,8 +544,12 @@ static void usbredir_handle_iso_data(USBRedirDevice *dev, USBPacket *p,
         } else {
             pkts_per_sec = 1000 / dev->endpoint[EP2I(ep)].interval;
         }
-        /* Testing has shown that we need circa 60 ms buffer */
-        dev->endpoint[EP2I(ep)].bufpq_target_size = (pkts_per_sec * 60) / 1000;
+        /*
+         * Testing has shown that we need circa 60 ms buffer on a LAN, more
+         * over links with more jitter; see the iso-latency property
+         */
+        dev->endpoint[EP2I(ep)].bufpq_target_size =
+            MAX((pkts_per_sec * dev->iso_latency) / 1000, 1);
 
         /* Aim for approx 100 interrupts / second on the client to
            balance latency and interrupt load */
@@ -561,6 +569,10 @@ static void usbredir_handle_iso_data(USBRedirDevice *dev, USBPacket *p,
             start_iso.no_urbs *= 2;
         }
         if (start_iso.no_urbs > 16) {
+            /* Use larger urbs rather than a shallower buffer */
+            start_iso.pkts_per_urb = MIN(DIV_ROUND_UP(start_iso.pkts_per_urb *
+                                                      start_iso.no_urbs, 16),
+                                         32);
             start_iso.no_urbs = 16;
         }
 
@@ -737,10 +749,11 @@ static void usbredir_handle_buffered_bulk_in_data(USBRedirDevice *dev,
         struct usb_redir_start_bulk_receiving_header start = {
             .endpoint = ep,
             .stream_id = 0,
-            .no_transfers = 5,
+            .no_transfers = dev->bulk_in_transfers,
         };
         /* Round bytes_per_transfer up to a multiple of max_packet_size */
-        bpt = 512 + dev->endpoint[EP2I(ep)].max_packet_size - 1;
+        bpt = dev->bulk_in_transfer_size +
+              dev->endpoint[EP2I(ep)].max_packet_size - 1;
         bpt /= dev->endpoint[EP2I(ep)].max_packet_size;
         bpt *= dev->endpoint[EP2I(ep)].max_packet_size;
         start.bytes_per_transfer = bpt;
@@ -1437,6 +1450,23 @@ static void usbredir_realize(USBDevice *udev, Error **errp)
         }
     }
 
+    if (!dev->bulk_in_transfers) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "bulk-in-transfers",
+                   "a value greater than 0");
+        return;
+    }
+    if (!dev->bulk_in_transfer_size ||
+        dev->bulk_in_transfer_size > 4 * MiB) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "bulk-in-transfer-size",
+                   "a value between 1 and 4 MiB");
+        return;
+    }
+    if (!dev->iso_latency || dev->iso_latency > 1000) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "iso-latency",
+                   "a value between 1 and 1000 ms");
+        return;
+    }
+
     dev->chardev_close_bh = qemu_bh_new(usbredir_chardev_close_bh, dev);
     dev->device_reject_bh = qemu_bh_new(usbredir_device_reject_bh, dev);
     dev->attach_timer = timer_new_ms(QEMU_CLOCK_VIRTUAL, usbredir_do_attach, dev);
@@ -1559,7 +1589,7 @@ static void usbredir_check_bulk_receiving(USBRedirDevice *dev)
                                 dev->interface_info.interface_class[i],
                                 dev->interface_info.interface_subclass[i],
                                 dev->interface_info.interface_protocol[i]);
-        if (!(quirks & USB_QUIRK_BUFFER_BULK_IN)) {
+        if (!(quirks & USB_QUIRK_BUFFER_BULK_IN) && !dev->bulk_in_buffering) {
             continue;
         }
         if (quirks & USB_QUIRK_IS_FTDI) {
@@ -2567,6 +2597,13 @@ static Property usbredir_properties[] = {
     DEFINE_PROP_BOOL("streams", USBRedirDevice, enable_streams, true),
     DEFINE_PROP_BOOL("suppress-remote-wake", USBRedirDevice,
                      suppress_remote_wake, true),
+    DEFINE_PROP_BOOL("bulk-in-buffering", USBRedirDevice,
+                     bulk_in_buffering, false),
+    DEFINE_PROP_UINT8("bulk-in-transfers", USBRedirDevice,
+                      bulk_in_transfers, 5),
+    DEFINE_PROP_UINT32("bulk-in-transfer-size", USBRedirDevice,
+                       bulk_in_transfer_size, 512),
+    DEFINE_PROP_UINT32("iso-latency", USBRedirDevice, iso_latency, 60),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -861,6 +861,107 @@ static void vfio_unregister_ram_discard_listener(VFIOContainer *container,
     g_free(vrdl);
 }
 
+/* A RAM mapping queued by region_add until the end of the transaction */
+typedef struct VFIODMAMap {
+    MemoryRegion *mr;
+    hwaddr iova;
+    ram_addr_t size;
+    void *vaddr;
+    bool readonly;
+    QSIMPLEQ_ENTRY(VFIODMAMap) next;
+} VFIODMAMap;
+
+static void vfio_dma_map_failed(VFIOContainer *container, MemoryRegion *mr,
+                                Error *err)
+{
+    /*
+     * On the initfn path, store the first error in the container so we
+     * can gracefully fail.  Runtime, there's not much we can do other
+     * than throw a hardware error.
+     */
+    if (!container->initialized) {
+        if (!container->error) {
+            error_propagate_prepend(&container->error, err,
+                                    "Region %s: ", memory_region_name(mr));
+        } else {
+            error_free(err);
+        }
+    } else {
+        error_report_err(err);
+        hw_error("vfio: DMA mapping failed, unable to continue");
+    }
+}
+
+/*
+ * Whether VFIO_IOMMU_MAP_DMA pins all pages of a mapping.  Containers whose
+ * groups all allow discarding RAM are normally used by mediated devices,
+ * whose vendor drivers only pin pages when they are accessed.
+ */
+static bool vfio_container_pins_all(VFIOContainer *container)
+{
+    VFIOGroup *group;
+
+    QLIST_FOREACH(group, &container->group_list, container_next) {
+        if (!group->ram_block_discard_allowed) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void vfio_listener_commit(MemoryListener *listener)
+{
+    VFIOContainer *container = container_of(listener, VFIOContainer, listener);
+    VFIODMAMap *map;
+    Error *err = NULL;
+    int ret;
+
+    if (QSIMPLEQ_EMPTY(&container->pending_maps)) {
+        return;
+    }
+
+    /*
+     * The kernel faults in and pins the pages of a mapping from the calling
+     * thread, under a lock that serializes all mappings of the container,
+     * which makes it slow for large guests.  While the guest cannot touch
+     * its memory yet, populate writable RAM from several threads first, so
+     * that pinning only needs to look up the pages.  Failing to do so is not
+     * fatal; the mapping then simply faults in the remaining pages.
+     */
+    if (!container->initialized && !runstate_is_running() &&
+        vfio_container_pins_all(container)) {
+        QSIMPLEQ_FOREACH(map, &container->pending_maps, next) {
+            if (map->readonly) {
+                continue;
+            }
+            trace_vfio_listener_prefault(map->iova, map->size);
+            os_mem_prealloc(memory_region_get_fd(map->mr), map->vaddr,
+                            map->size, INT_MAX, NULL, 0, false, &err);
+            if (err) {
+                trace_vfio_listener_prefault_failed(map->iova,
+                                                    error_get_pretty(err));
+                error_free(err);
+                err = NULL;
+            }
+        }
+    }
+
+    while ((map = QSIMPLEQ_FIRST(&container->pending_maps))) {
+        QSIMPLEQ_REMOVE_HEAD(&container->pending_maps, next);
+
+        ret = vfio_dma_map(container, map->iova, map->size, map->vaddr,
+                           map->readonly);
+        if (ret) {
+            error_setg(&err, "vfio_dma_map(%p, 0x%"HWADDR_PRIx", "
+                       "0x%"HWADDR_PRIx", %p) = %d (%m)",
+                       container, map->iova, map->size, map->vaddr, ret);
+            vfio_dma_map_failed(container, map->mr, err);
+            err = NULL;
+        }
+        g_free(map);
+    }
+}
+
 static void vfio_listener_region_add(MemoryListener *listener,
                                      MemoryRegionSection *section)
 {
@@ -871,6 +972,7 @@ static void vfio_listener_region_add(MemoryListener *listener,
     int ret;
     VFIOHostDMAWindow *hostwin;
     bool hostwin_found;
+    VFIODMAMap *map;
     Error *err = NULL;
 
     if (vfio_listener_skipped_section(section)) {
@@ -1058,22 +1160,30 @@ static void vfio_listener_region_add(MemoryListener *listener,
                 pgmask + 1);
             return;
         }
-    }
 
-    ret = vfio_dma_map(container, iova, int128_get64(llsize),
-                       vaddr, section->readonly);
-    if (ret) {
-        error_setg(&err, "vfio_dma_map(%p, 0x%"HWADDR_PRIx", "
-                   "0x%"HWADDR_PRIx", %p) = %d (%m)",
-                   container, iova, int128_get64(llsize), vaddr, ret);
-        if (memory_region_is_ram_device(section->mr)) {
+        ret = vfio_dma_map(container, iova, int128_get64(llsize),
+                           vaddr, section->readonly);
+        if (ret) {
             /* Allow unexpected mappings not to be fatal for RAM devices */
-            error_report_err(err);
-            return;
+            error_report("vfio_dma_map(%p, 0x%"HWADDR_PRIx", "
+                         "0x%"HWADDR_PRIx", %p) = %d (%m)",
+                         container, iova, int128_get64(llsize), vaddr, ret);
         }
-        goto fail;
+        return;
     }
 
+    /*
+     * Transactions only add sections after removing the old ones, so the
+     * mapping can be deferred to vfio_listener_commit() and done together
+     * with the other RAM added by the same transaction.
+     */
+    map = g_new(VFIODMAMap, 1);
+    map->mr = section->mr;
+    map->iova = iova;
+    map->size = int128_get64(llsize);
+    map->vaddr = vaddr;
+    map->readonly = section->readonly;
+    QSIMPLEQ_INSERT_TAIL(&container->pending_maps, map, next);
     return;
 
 fail:
@@ -1081,23 +1191,7 @@ fail:
         error_report("failed to vfio_dma_map. pci p2p may not work");
         return;
     }
-    /*
-     * On the initfn path, store the first error in the container so we
-     * can gracefully fail.  Runtime, there's not much we can do other
-     * than throw a hardware error.
-     */
-    if (!container->initialized) {
-        if (!container->error) {
-            error_propagate_prepend(&container->error, err,
-                                    "Region %s: ",
-                                    memory_region_name(section->mr));
-        } else {
-            error_free(err);
-        }
-    } else {
-        error_report_err(err);
-        hw_error("vfio: DMA mapping failed, unable to continue");
-    }
+    vfio_dma_map_failed(container, section->mr, err);
 }
 
 static void vfio_listener_region_del(MemoryListener *listener,
@@ -1446,6 +1540,7 @@ static const MemoryListener vfio_memory_listener = {
     .name = "vfio",
     .region_add = vfio_listener_region_add,
     .region_del = vfio_listener_region_del,
+    .commit = vfio_listener_commit,
     .log_global_start = vfio_listener_log_global_start,
     .log_global_stop = vfio_listener_log_global_stop,
     .log_sync = vfio_listener_log_sync,
@@ -2061,6 +2156,7 @@ static int vfio_connect_container(VFIOGroup *group, AddressSpace *as,
     QLIST_INIT(&container->giommu_list);
     QLIST_INIT(&container->hostwin_list);
     QLIST_INIT(&container->vrdl_list);
+    QSIMPLEQ_INIT(&container->pending_maps);
 
     ret = vfio_init_container(container, group->fd, errp);
     if (ret) {
@@ -10,6 +10,7 @@
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
 #include "qemu/cutils.h"
+#include "qemu/stats64.h"
 #include <linux/vfio.h>
 #include <sys/ioctl.h>
 
@@ -44,7 +45,7 @@
 #define VFIO_MIG_FLAG_DEV_SETUP_STATE   (0xffffffffef100003ULL)
 #define VFIO_MIG_FLAG_DEV_DATA_STATE    (0xffffffffef100004ULL)
 
-static int64_t bytes_transferred;
+static Stat64 bytes_transferred;
 
 static inline int vfio_mig_access(VFIODevice *vbasedev, void *val, int count,
                                   off_t off, bool iswrite)
@@ -256,12 +257,91 @@ static int vfio_save_buffer(QEMUFile *f, VFIODevice *vbasedev, uint64_t *size)
         *size = data_size;
     }
 
-    bytes_transferred += data_size;
+    stat64_add(&bytes_transferred, data_size);
     return ret;
 }
 
-static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
-                            uint64_t data_size)
+/*
+ * Read one buffer of device data and queue it on the multifd channels,
+ * split in chunks of at most SAVEVM_STATE_BUFFER_MAX_SIZE bytes.
+ */
+static int vfio_save_buffer_thread(SaveLiveCompletePrecopyThreadData *d,
+                                   VFIODevice *vbasedev, uint64_t *size,
+                                   Error **errp)
+{
+    VFIOMigration *migration = vbasedev->migration;
+    VFIORegion *region = &migration->region;
+    uint64_t data_offset = 0, data_size = 0, sz;
+    int ret;
+
+    ret = vfio_mig_read(vbasedev, &data_offset, sizeof(data_offset),
+                      region->fd_offset + VFIO_MIG_STRUCT_OFFSET(data_offset));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "%s: Failed to read data offset",
+                         vbasedev->name);
+        return ret;
+    }
+
+    ret = vfio_mig_read(vbasedev, &data_size, sizeof(data_size),
+                        region->fd_offset + VFIO_MIG_STRUCT_OFFSET(data_size));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "%s: Failed to read data size",
+                         vbasedev->name);
+        return ret;
+    }
+
+    trace_vfio_save_buffer(vbasedev->name, data_offset, data_size,
+                           migration->pending_bytes);
+
+    sz = data_size;
+    while (sz) {
+        uint64_t len = MIN(sz, SAVEVM_STATE_BUFFER_MAX_SIZE);
+        uint64_t done, sec_size;
+        char *buf;
+
+        buf = g_try_malloc(len);
+        if (!buf) {
+            error_setg(errp, "%s: Error allocating buffer", vbasedev->name);
+            return -ENOMEM;
+        }
+
+        for (done = 0; done < len; done += sec_size) {
+            void *ptr = get_data_section_size(region, data_offset, len - done,
+                                              &sec_size);
+
+            if (ptr) {
+                memcpy(buf + done, ptr, sec_size);
+            } else {
+                ret = vfio_mig_read(vbasedev, buf + done, sec_size,
+                                    region->fd_offset + data_offset);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "%s: Failed to read data",
+                                     vbasedev->name);
+                    g_free(buf);
+                    return ret;
+                }
+            }
+            data_offset += sec_size;
+        }
+
+        ret = qemu_savevm_queue_device_state(d, buf, len, errp);
+        if (ret) {
+            return ret;
+        }
+        sz -= len;
+    }
+
+    *size = data_size;
+    stat64_add(&bytes_transferred, data_size);
+    return 0;
+}
+
+/*
+ * Write @data_size bytes of device data, taken from @f or, if @f is
+ * NULL, from @data.
+ */
+static int vfio_load_buffer_common(QEMUFile *f, const char *data,
+                                   VFIODevice *vbasedev, uint64_t data_size)
 {
     VFIORegion *region = &vbasedev->migration->region;
     uint64_t data_offset = 0, size, report_size;
@@ -306,7 +386,12 @@ static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
                 buf_alloc = true;
             }
 
-            qemu_get_buffer(f, buf, sec_size);
+            if (f) {
+                qemu_get_buffer(f, buf, sec_size);
+            } else {
+                memcpy(buf, data, sec_size);
+                data += sec_size;
+            }
 
             if (buf_alloc) {
                 ret = vfio_mig_write(vbasedev, buf, sec_size,
@@ -331,6 +416,12 @@ static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
     return 0;
 }
 
+static int vfio_load_buffer(QEMUFile *f, VFIODevice *vbasedev,
+                            uint64_t data_size)
+{
+    return vfio_load_buffer_common(f, NULL, vbasedev, data_size);
+}
+
 static int vfio_update_pending(VFIODevice *vbasedev)
 {
     VFIOMigration *migration = vbasedev->migration;
@@ -524,6 +615,44 @@ static int vfio_save_iterate(QEMUFile *f, void *opaque)
     return 0;
 }
 
+/*
+ * With multifd-device-state, the precopy data goes on the multifd
+ * channels like the stop-copy data, so that the iterations of several
+ * devices and of RAM are not serialized on the main stream.
+ */
+static int vfio_save_iterate_buffers(SaveLiveCompletePrecopyThreadData *d,
+                                     Error **errp)
+{
+    VFIODevice *vbasedev = d->opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    uint64_t data_size;
+    int ret;
+
+    if (migration->pending_bytes == 0) {
+        ret = vfio_update_pending(vbasedev);
+        if (ret) {
+            error_setg_errno(errp, -ret, "%s: Failed to read pending bytes",
+                             vbasedev->name);
+            return ret;
+        }
+
+        if (migration->pending_bytes == 0) {
+            /* indicates data finished, goto complete phase */
+            return 1;
+        }
+    }
+
+    ret = vfio_save_buffer_thread(d, vbasedev, &data_size, errp);
+    if (ret) {
+        return ret;
+    }
+
+    /* As in vfio_save_iterate() */
+    migration->pending_bytes = 0;
+    trace_vfio_save_iterate(vbasedev->name, data_size);
+    return 0;
+}
+
 static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
 {
     VFIODevice *vbasedev = opaque;
@@ -539,6 +668,12 @@ static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    if (qemu_savevm_device_state_active()) {
+        /* vfio_save_complete_precopy_thread() sends the device data */
+        qemu_put_be64(f, VFIO_MIG_FLAG_END_OF_STATE);
+        return qemu_file_get_error(f);
+    }
+
     ret = vfio_update_pending(vbasedev);
     if (ret) {
         return ret;
@@ -579,6 +714,50 @@ static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
     return ret;
 }
 
+static int vfio_save_complete_precopy_thread(
+    SaveLiveCompletePrecopyThreadData *d, Error **errp)
+{
+    VFIODevice *vbasedev = d->opaque;
+    VFIOMigration *migration = vbasedev->migration;
+    uint64_t data_size;
+    int ret;
+
+    ret = vfio_update_pending(vbasedev);
+    if (ret) {
+        error_setg_errno(errp, -ret, "%s: Failed to read pending bytes",
+                         vbasedev->name);
+        return ret;
+    }
+
+    while (migration->pending_bytes > 0) {
+        ret = vfio_save_buffer_thread(d, vbasedev, &data_size, errp);
+        if (ret) {
+            return ret;
+        }
+
+        if (data_size == 0) {
+            break;
+        }
+
+        ret = vfio_update_pending(vbasedev);
+        if (ret) {
+            error_setg_errno(errp, -ret, "%s: Failed to read pending bytes",
+                             vbasedev->name);
+            return ret;
+        }
+    }
+
+    ret = vfio_migration_set_state(vbasedev, ~VFIO_DEVICE_STATE_SAVING, 0);
+    if (ret) {
+        error_setg_errno(errp, -ret, "%s: Failed to set state STOPPED",
+                         vbasedev->name);
+        return ret;
+    }
+
+    trace_vfio_save_complete_precopy(vbasedev->name);
+    return 0;
+}
+
 static void vfio_save_state(QEMUFile *f, void *opaque)
 {
     VFIODevice *vbasedev = opaque;
@@ -682,16 +861,34 @@ static int vfio_load_state(QEMUFile *f, void *opaque, int version_id)
     return ret;
 }
 
+static int vfio_load_state_buffer(void *opaque, char *buf, size_t len,
+                                  Error **errp)
+{
+    VFIODevice *vbasedev = opaque;
+    int ret;
+
+    ret = vfio_load_buffer_common(NULL, buf, vbasedev, len);
+    g_free(buf);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "%s: Failed to load device data",
+                         vbasedev->name);
+    }
+    return ret;
+}
+
 static SaveVMHandlers savevm_vfio_handlers = {
     .save_setup = vfio_save_setup,
     .save_cleanup = vfio_save_cleanup,
     .save_live_pending = vfio_save_pending,
     .save_live_iterate = vfio_save_iterate,
+    .save_live_iterate_buffers = vfio_save_iterate_buffers,
     .save_live_complete_precopy = vfio_save_complete_precopy,
+    .save_live_complete_precopy_thread = vfio_save_complete_precopy_thread,
     .save_state = vfio_save_state,
     .load_setup = vfio_load_setup,
     .load_cleanup = vfio_load_cleanup,
     .load_state = vfio_load_state,
+    .load_state_buffer = vfio_load_state_buffer,
 };
 
 /* ---------------------------------------------------------------------- */
@@ -766,7 +963,7 @@ static void vfio_migration_state_notifier(Notifier *notifier, void *data)
     case MIGRATION_STATUS_CANCELLING:
     case MIGRATION_STATUS_CANCELLED:
     case MIGRATION_STATUS_FAILED:
-        bytes_transferred = 0;
+        stat64_init(&bytes_transferred, 0);
         ret = vfio_migration_set_state(vbasedev,
                       ~(VFIO_DEVICE_STATE_SAVING | VFIO_DEVICE_STATE_RESUMING),
                       VFIO_DEVICE_STATE_RUNNING);
@@ -851,7 +1048,7 @@ err:
 
 int64_t vfio_mig_bytes_transferred(void)
 {
-    return bytes_transferred;
+    return stat64_get(&bytes_transferred);
 }
 
 int vfio_migration_probe(VFIODevice *vbasedev, Error **errp)
@@ -0,0 +1,836 @@
+/*
+ * vhost shadow virtqueue
+ *
+ * A shadow virtqueue (SVQ) sits between the guest's virtqueue and the vhost
+ * device: QEMU pops the buffers the guest makes available, exposes them to
+ * the device in a vring of its own and returns them to the guest when the
+ * device uses them.  Since QEMU writes the guest's used ring and
+ * the buffers are unmapped through the virtio core, all the memory the
+ * device writes is logged in the dirty bitmap.  This makes it possible to
+ * migrate devices that cannot log their writes themselves, like vDPA ones.
+ *
+ * Only split virtqueues are shadowed.  The device sees the buffers at the
+ * addresses allocated for guest memory in the IOVA tree.
+ *
+ * The owner of a shadow virtqueue can also handle the guest's buffers
+ * itself through VhostShadowVirtqueueOps, for example to send copies of
+ * them, and make buffers of its own available with vhost_svq_add().
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/eventfd.h>
+#include "hw/virtio/vhost-shadow-virtqueue.h"
+
+#include "qemu/error-report.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "trace.h"
+
+/* How long vhost_svq_poll() waits for the device */
+#define SVQ_POLL_TIMEOUT_US (10 * G_USEC_PER_SEC)
+
+/* Transport features a shadow virtqueue cannot relay */
+#define SVQ_UNSUPPORTED_FEATURES (BIT_ULL(VIRTIO_F_RING_PACKED) | \
+                                  BIT_ULL(VIRTIO_F_IN_ORDER))
+
+/**
+ * Remove the transport features that the shadow virtqueue does not support
+ * from the device features @features
+ */
+uint64_t vhost_svq_filter_features(uint64_t features)
+{
+    return features & ~SVQ_UNSUPPORTED_FEATURES;
+}
+
+/**
+ * Validate the transport device features that both guests can use with the
+ * SVQ and SVQs can use with the device.
+ *
+ * @features: The features
+ * @errp: Error pointer
+ */
+bool vhost_svq_valid_features(uint64_t features, Error **errp)
+{
+    if (!(features & BIT_ULL(VIRTIO_F_VERSION_1))) {
+        error_setg(errp, "Shadow virtqueues need VIRTIO_F_VERSION_1");
+        return false;
+    }
+
+    if (features & SVQ_UNSUPPORTED_FEATURES) {
+        error_setg(errp, "Shadow virtqueues do not support features 0x%"
+                   PRIx64, features & SVQ_UNSUPPORTED_FEATURES);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Number of descriptors that the SVQ can make available from the guest.
+ *
+ * @svq: The svq
+ */
+static uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
+{
+    return svq->num_free;
+}
+
+/**
+ * Set or clear the NO_INTERRUPT flag, or the used event, of the shadow vring
+ */
+static void vhost_svq_set_notification(VhostShadowVirtqueue *svq, bool enable)
+{
+    if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        if (enable) {
+            vring_used_event(&svq->vring) = cpu_to_le16(svq->last_used_idx);
+        }
+    } else if (enable) {
+        svq->vring.avail->flags &= ~cpu_to_le16(VRING_AVAIL_F_NO_INTERRUPT);
+    } else {
+        svq->vring.avail->flags |= cpu_to_le16(VRING_AVAIL_F_NO_INTERRUPT);
+    }
+}
+
+/**
+ * Translate the addresses of the guest's buffers to the device's IOVA
+ *
+ * @svq: Shadow VirtQueue
+ * @addrs: Destination IOVA addresses
+ * @iovec: Source qemu's VA addresses
+ * @num: Length of iovec and minimum length of addrs
+ */
+static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
+                                     hwaddr *addrs, const struct iovec *iovec,
+                                     size_t num)
+{
+    size_t i;
+
+    for (i = 0; i < num; ++i) {
+        DMAMap needle = {
+            .translated_addr = (hwaddr)(uintptr_t)iovec[i].iov_base,
+            .size = iovec[i].iov_len - 1,
+        };
+        const DMAMap *map;
+        hwaddr off;
+
+        if (!iovec[i].iov_len) {
+            addrs[i] = 0;
+            continue;
+        }
+
+        map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
+        /*
+         * Map cannot be NULL since iova map contains all guest space and
+         * qemu already has a physical address mapped
+         */
+        if (unlikely(!map)) {
+            error_report("Invalid address 0x%" HWADDR_PRIx " given by guest",
+                         needle.translated_addr);
+            return false;
+        }
+
+        off = needle.translated_addr - map->translated_addr;
+        if (unlikely(off + needle.size > map->size)) {
+            error_report("Guest buffer 0x%" HWADDR_PRIx "+0x%zx crosses a "
+                         "mapping boundary", needle.translated_addr,
+                         iovec[i].iov_len);
+            return false;
+        }
+        addrs[i] = map->iova + off;
+    }
+
+    return true;
+}
+
+static void vhost_vring_write_descs(VhostShadowVirtqueue *svq,
+                                    const struct iovec *iovec,
+                                    const hwaddr *addrs, size_t num,
+                                    bool more_descs, bool write,
+                                    unsigned *last)
+{
+    uint16_t i = svq->free_head, last_avail = i;
+    vring_desc_t *descs = svq->vring.desc;
+    uint16_t flags = write ? cpu_to_le16(VRING_DESC_F_WRITE) : 0;
+    size_t n;
+
+    for (n = 0; n < num; n++) {
+        if (more_descs || (n + 1 < num)) {
+            descs[i].flags = flags | cpu_to_le16(VRING_DESC_F_NEXT);
+        } else {
+            descs[i].flags = flags;
+        }
+        descs[i].addr = cpu_to_le64(addrs[n]);
+        descs[i].len = cpu_to_le32(iovec[n].iov_len);
+
+        last_avail = i;
+        i = le16_to_cpu(descs[i].next);
+    }
+
+    svq->free_head = i;
+    if (num) {
+        *last = last_avail;
+    }
+}
+
+static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
+                                const struct iovec *out_sg, size_t out_num,
+                                const struct iovec *in_sg, size_t in_num,
+                                unsigned *head)
+{
+    unsigned avail_idx, last = 0;
+    vring_avail_t *avail = svq->vring.avail;
+    g_autofree hwaddr *sgs = g_new(hwaddr, MAX(out_num, in_num));
+
+    *head = svq->free_head;
+
+    /* We need some descriptors here */
+    if (unlikely(!out_num && !in_num)) {
+        error_report("Guest provided element with no descriptors");
+        return false;
+    }
+
+    if (!vhost_svq_translate_addr(svq, sgs, out_sg, out_num)) {
+        return false;
+    }
+    vhost_vring_write_descs(svq, out_sg, sgs, out_num, in_num > 0, false,
+                            &last);
+
+    if (!vhost_svq_translate_addr(svq, sgs, in_sg, in_num)) {
+        return false;
+    }
+    vhost_vring_write_descs(svq, in_sg, sgs, in_num, false, true, &last);
+
+    svq->num_free -= out_num + in_num;
+
+    /*
+     * Put the entry in the available array (but don't update avail->idx until
+     * they do sync).
+     */
+    avail_idx = svq->shadow_avail_idx & (svq->vring.num - 1);
+    avail->ring[avail_idx] = cpu_to_le16(*head);
+    svq->shadow_avail_idx++;
+
+    /* Update the avail index after write the descriptor */
+    smp_wmb();
+    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
+
+    return true;
+}
+
+/*
+ * Add the buffers to the shadow vring without notifying the device.  On
+ * failure, the descriptors are left in the free list and the caller still
+ * owns @elem.
+ */
+static int vhost_svq_add_buf(VhostShadowVirtqueue *svq,
+                             const struct iovec *out_sg, size_t out_num,
+                             const struct iovec *in_sg, size_t in_num,
+                             VirtQueueElement *elem)
+{
+    unsigned qemu_head;
+    unsigned ndescs = in_num + out_num;
+    uint16_t free_head = svq->free_head;
+
+    if (unlikely(ndescs > vhost_svq_available_slots(svq))) {
+        return -ENOSPC;
+    }
+
+    if (unlikely(!vhost_svq_add_split(svq, out_sg, out_num, in_sg, in_num,
+                                      &qemu_head))) {
+        /* The descriptors written so far are still in the free list */
+        svq->free_head = free_head;
+        return -EINVAL;
+    }
+
+    svq->desc_state[qemu_head].elem = elem;
+    svq->desc_state[qemu_head].ndescs = ndescs;
+    return 0;
+}
+
+static void vhost_svq_kick(VhostShadowVirtqueue *svq, uint16_t old_avail_idx)
+{
+    bool needs_kick;
+
+    /*
+     * We need to expose the available array entries before checking the used
+     * flags or the avail event
+     */
+    smp_mb();
+
+    if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        uint16_t avail_event = le16_to_cpu(vring_avail_event(&svq->vring));
+
+        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx,
+                                      old_avail_idx);
+    } else {
+        needs_kick = !(svq->vring.used->flags &
+                       cpu_to_le16(VRING_USED_F_NO_NOTIFY));
+    }
+
+    if (needs_kick) {
+        event_notifier_set(&svq->hdev_kick);
+    }
+}
+
+/**
+ * Add an element to SVQ and notify the device.
+ *
+ * @svq: The shadow virtqueue
+ * @out_sg: The device readable buffers
+ * @out_num: Number of device readable buffers
+ * @in_sg: The device writable buffers
+ * @in_num: Number of device writable buffers
+ * @elem: The guest element the buffers belong to, or NULL
+ *
+ * The buffers must be in memory mapped in the IOVA tree.  Return -EINVAL if
+ * they are not, or -ENOSPC if the shadow vring is full.
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const struct iovec *in_sg, size_t in_num,
+                  VirtQueueElement *elem)
+{
+    uint16_t old_avail_idx = svq->shadow_avail_idx;
+    int r;
+
+    r = vhost_svq_add_buf(svq, out_sg, out_num, in_sg, in_num, elem);
+    if (unlikely(r != 0)) {
+        return r;
+    }
+
+    vhost_svq_kick(svq, old_avail_idx);
+    return 0;
+}
+
+/**
+ * Forward available buffers.
+ *
+ * @svq: Shadow VirtQueue
+ *
+ * Note that this function does not guarantee that all guest's available
+ * buffers are available to the device in SVQ avail ring. The guest may have
+ * exposed a GPA / GIOVA contiguous buffer, but it may not be contiguous in
+ * qemu vaddr.
+ *
+ * If that happens, guest's kick notifications will be disabled until the
+ * device uses some buffers.
+ */
+static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
+{
+    uint16_t old_avail_idx = svq->shadow_avail_idx;
+
+    /* Clear event notifier */
+    event_notifier_test_and_clear(&svq->svq_kick);
+
+    /* Forward to the device as many available buffers as possible */
+    do {
+        virtio_queue_set_notification(svq->vq, false);
+
+        while (true) {
+            VirtQueueElement *elem;
+
+            if (svq->next_guest_avail_elem) {
+                elem = g_steal_pointer(&svq->next_guest_avail_elem);
+            } else {
+                elem = virtqueue_pop(svq->vq, sizeof(*elem));
+            }
+
+            if (!elem) {
+                break;
+            }
+
+            if (elem->out_num + elem->in_num > vhost_svq_available_slots(svq)) {
+                /*
+                 * This condition is possible since a contiguous buffer in GPA
+                 * does not imply a contiguous buffer in qemu's VA
+                 * scatter-gather segments. If that happens, the buffer exposed
+                 * to the device needs to be a chain of descriptors at this
+                 * moment.
+                 *
+                 * SVQ cannot hold more available buffers if we are here:
+                 * queue the current guest descriptor and ignore further kicks
+                 * until some elements are used.
+                 */
+                svq->next_guest_avail_elem = elem;
+                goto out;
+            }
+
+            if (svq->ops) {
+                /* The callback owns the element from now on */
+                if (svq->ops->avail_handler(svq, elem, svq->ops_opaque)) {
+                    goto out;
+                }
+                continue;
+            }
+
+            if (unlikely(vhost_svq_add_buf(svq, elem->out_sg, elem->out_num,
+                                           elem->in_sg, elem->in_num,
+                                           elem))) {
+                virtio_error(svq->vdev, "Cannot relay guest buffer");
+                virtqueue_detach_element(svq->vq, elem, 0);
+                g_free(elem);
+                goto out;
+            }
+        }
+
+        virtio_queue_set_notification(svq->vq, true);
+    } while (!virtio_queue_empty(svq->vq));
+
+out:
+    trace_vhost_svq_handle_guest_kick(svq, svq->shadow_avail_idx -
+                                           old_avail_idx);
+    if (svq->shadow_avail_idx != old_avail_idx) {
+        vhost_svq_kick(svq, old_avail_idx);
+    }
+}
+
+/**
+ * Handle guest's kick.
+ *
+ * @n: guest kick event notifier, the one that guest set to notify svq.
+ */
+static void vhost_handle_guest_kick_notifier(EventNotifier *n)
+{
+    VhostShadowVirtqueue *svq = container_of(n, VhostShadowVirtqueue,
+                                             svq_kick);
+
+    vhost_handle_guest_kick(svq);
+}
+
+static bool vhost_svq_more_used(VhostShadowVirtqueue *svq)
+{
+    if (svq->last_used_idx != svq->shadow_used_idx) {
+        return true;
+    }
+
+    svq->shadow_used_idx = le16_to_cpu(svq->vring.used->idx);
+
+    return svq->last_used_idx != svq->shadow_used_idx;
+}
+
+static VirtQueueElement *vhost_svq_get_buf(VhostShadowVirtqueue *svq,
+                                           uint32_t *len)
+{
+    vring_desc_t *descs = svq->vring.desc;
+    const vring_used_t *used = svq->vring.used;
+    vring_used_elem_t used_elem;
+    uint16_t last_used, i, num;
+
+    if (!vhost_svq_more_used(svq)) {
+        return NULL;
+    }
+
+    /* Only get used array entries after they have been exposed by dev */
+    smp_rmb();
+    last_used = svq->last_used_idx & (svq->vring.num - 1);
+    used_elem.id = le32_to_cpu(used->ring[last_used].id);
+    used_elem.len = le32_to_cpu(used->ring[last_used].len);
+
+    svq->last_used_idx++;
+    if (unlikely(used_elem.id >= svq->vring.num)) {
+        virtio_error(svq->vdev, "Device %s says index %u is used",
+                     svq->vdev->name, used_elem.id);
+        return NULL;
+    }
+
+    num = svq->desc_state[used_elem.id].ndescs;
+    if (unlikely(!num)) {
+        virtio_error(svq->vdev,
+                     "Device %s says index %u is used, but it was not "
+                     "available", svq->vdev->name, used_elem.id);
+        return NULL;
+    }
+    svq->desc_state[used_elem.id].ndescs = 0;
+
+    /* Give the descriptors of the chain back to the free list */
+    svq->num_free += num;
+    for (i = used_elem.id; --num; ) {
+        i = le16_to_cpu(descs[i].next);
+    }
+    descs[i].next = cpu_to_le16(svq->free_head);
+    svq->free_head = used_elem.id;
+
+    *len = used_elem.len;
+    return g_steal_pointer(&svq->desc_state[used_elem.id].elem);
+}
+
+/**
+ * Push an element to the guest's used ring and notify the guest.
+ *
+ * @svq: Shadow virtqueue
+ * @elem: The guest element
+ * @len: Number of bytes written to the element's device writable buffers
+ */
+void vhost_svq_push_elem(VhostShadowVirtqueue *svq,
+                         const VirtQueueElement *elem, uint32_t len)
+{
+    virtqueue_push(svq->vq, elem, len);
+    if (svq->svq_call_fd >= 0) {
+        eventfd_write(svq->svq_call_fd, 1);
+    }
+}
+
+static void vhost_svq_flush(VhostShadowVirtqueue *svq,
+                            bool check_for_avail_queue)
+{
+    VirtQueue *vq = svq->vq;
+
+    /* Forward as many used buffers as possible. */
+    do {
+        unsigned i = 0;
+
+        vhost_svq_set_notification(svq, false);
+        while (vhost_svq_more_used(svq)) {
+            uint32_t len;
+            g_autofree VirtQueueElement *elem = vhost_svq_get_buf(svq, &len);
+
+            /* Either an error, or a buffer that QEMU added itself */
+            if (!elem) {
+                continue;
+            }
+
+            if (unlikely(i >= svq->vring.num)) {
+                virtio_error(svq->vdev,
+                             "More than %u used buffers obtained in a %u size "
+                             "SVQ", i, svq->vring.num);
+                virtqueue_detach_element(vq, elem, len);
+                virtqueue_flush(vq, i);
+                return;
+            }
+            virtqueue_fill(vq, elem, len, i++);
+        }
+
+        virtqueue_flush(vq, i);
+        if (i && svq->svq_call_fd >= 0) {
+            eventfd_write(svq->svq_call_fd, 1);
+        }
+        trace_vhost_svq_flush(svq, i);
+
+        if (check_for_avail_queue && svq->next_guest_avail_elem) {
+            /*
+             * Avail ring was full when vhost_svq_flush was called, so it's a
+             * good moment to make more descriptors available if possible.
+             */
+            vhost_handle_guest_kick(svq);
+        }
+
+        vhost_svq_set_notification(svq, true);
+        /* Check for used buffers the device wrote before it saw the flag */
+        smp_mb();
+    } while (vhost_svq_more_used(svq));
+}
+
+/**
+ * Wait for the device to use a buffer that was added with a NULL element.
+ *
+ * @svq: The svq
+ *
+ * Returns the number of bytes the device wrote, or 0 if it did not use the
+ * buffer within SVQ_POLL_TIMEOUT_US.
+ *
+ * The caller holds the BQL, so this sleeps on the call notifier of the device
+ * rather than spinning, and vhost_svq_handle_call() cannot run meanwhile.
+ */
+size_t vhost_svq_poll(VhostShadowVirtqueue *svq)
+{
+    int64_t deadline_us = g_get_monotonic_time() + SVQ_POLL_TIMEOUT_US;
+    GPollFD pfd = {
+        .fd = event_notifier_get_fd(&svq->hdev_call),
+        .events = G_IO_IN,
+    };
+    uint32_t len = 0;
+
+    vhost_svq_set_notification(svq, true);
+    /* Check for used buffers the device wrote before it saw the flag */
+    smp_mb();
+    while (!vhost_svq_more_used(svq)) {
+        int64_t now_us = g_get_monotonic_time();
+
+        if (unlikely(now_us >= deadline_us)) {
+            return 0;
+        }
+        qemu_poll_ns(&pfd, 1, (deadline_us - now_us) * SCALE_US);
+        event_notifier_test_and_clear(&svq->hdev_call);
+    }
+
+    vhost_svq_get_buf(svq, &len);
+    /* Leave any other used buffer to vhost_svq_handle_call() */
+    if (vhost_svq_more_used(svq)) {
+        event_notifier_set(&svq->hdev_call);
+    }
+    return len;
+}
+
+/**
+ * Forward used buffers.
+ *
+ * @n: hdev call event notifier, the one that device set to notify svq.
+ *
+ * Note that we are not making any buffers available in the loop, there is no
+ * way that it runs more than virtqueue size times.
+ */
+static void vhost_svq_handle_call(EventNotifier *n)
+{
+    VhostShadowVirtqueue *svq = container_of(n, VhostShadowVirtqueue,
+                                             hdev_call);
+
+    event_notifier_test_and_clear(n);
+    if (svq->vq) {
+        vhost_svq_flush(svq, true);
+    }
+}
+
+/**
+ * Set the call notifier for the SVQ to call the guest
+ *
+ * @svq: Shadow virtqueue
+ * @call_fd: call notifier, or -1 to stop notifying the guest
+ *
+ * Called on BQL context.
+ */
+void vhost_svq_set_svq_call_fd(VhostShadowVirtqueue *svq, int call_fd)
+{
+    svq->svq_call_fd = call_fd;
+}
+
+/**
+ * Get the shadow vq vring address.
+ * @svq: Shadow virtqueue
+ * @addr: Destination to store address
+ *
+ * The addresses are qemu's virtual addresses, the caller translates them to
+ * the device's IOVA.
+ */
+void vhost_svq_get_vring_addr(const VhostShadowVirtqueue *svq,
+                              struct vhost_vring_addr *addr)
+{
+    addr->desc_user_addr = (uint64_t)(uintptr_t)svq->vring.desc;
+    addr->avail_user_addr = (uint64_t)(uintptr_t)svq->vring.avail;
+    addr->used_user_addr = (uint64_t)(uintptr_t)svq->vring.used;
+}
+
+size_t vhost_svq_driver_area_size(const VhostShadowVirtqueue *svq)
+{
+    size_t desc_size = sizeof(vring_desc_t) * svq->vring.num;
+    size_t avail_size = offsetof(vring_avail_t, ring) +
+                        sizeof(uint16_t) * (svq->vring.num + 1);
+
+    return ROUND_UP(desc_size + avail_size, qemu_real_host_page_size);
+}
+
+size_t vhost_svq_device_area_size(const VhostShadowVirtqueue *svq)
+{
+    size_t used_size = offsetof(vring_used_t, ring) +
+                       sizeof(vring_used_elem_t) * svq->vring.num +
+                       sizeof(uint16_t);
+
+    return ROUND_UP(used_size, qemu_real_host_page_size);
+}
+
+/**
+ * Get the notifier that the device kicks, i.e. the one to pass to the device
+ * as its kick fd.
+ */
+const EventNotifier *vhost_svq_get_dev_kick_notifier(
+                                              const VhostShadowVirtqueue *svq)
+{
+    return &svq->hdev_kick;
+}
+
+/**
+ * Get the notifier the device calls, i.e. the one to pass to the device as
+ * its call fd.
+ */
+const EventNotifier *vhost_svq_get_svq_call_notifier(
+                                              const VhostShadowVirtqueue *svq)
+{
+    return &svq->hdev_call;
+}
+
+/**
+ * Set a new file descriptor for the guest to kick the SVQ.
+ *
+ * @svq: The svq
+ * @svq_kick_fd: The svq kick fd
+ *
+ * The fd is only polled while the SVQ is started.
+ */
+void vhost_svq_set_svq_kick_fd(VhostShadowVirtqueue *svq, int svq_kick_fd)
+{
+    bool started = svq->vq != NULL;
+
+    if (started) {
+        event_notifier_set_handler(&svq->svq_kick, NULL);
+    }
+
+    event_notifier_init_fd(&svq->svq_kick, svq_kick_fd);
+
+    if (started) {
+        event_notifier_set_handler(&svq->svq_kick,
+                                   vhost_handle_guest_kick_notifier);
+        /* Check for a kick that was sent before the fd was polled */
+        event_notifier_set(&svq->svq_kick);
+    }
+}
+
+/**
+ * Start the shadow virtqueue operation.
+ *
+ * @svq: Shadow Virtqueue
+ * @vdev: VirtIO device
+ * @vq: Virtqueue to shadow
+ *
+ * The guest kick fd must be set before.  The buffers the guest made
+ * available before the start are forwarded to the device right away.
+ */
+void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
+                     VirtQueue *vq)
+{
+    size_t desc_size, driver_size, device_size;
+    unsigned i;
+
+    svq->next_guest_avail_elem = NULL;
+    svq->shadow_avail_idx = 0;
+    svq->shadow_used_idx = 0;
+    svq->last_used_idx = 0;
+    svq->vdev = vdev;
+    svq->vq = vq;
+
+    svq->vring.num = virtio_queue_get_num(vdev, virtio_get_queue_index(vq));
+    driver_size = vhost_svq_driver_area_size(svq);
+    device_size = vhost_svq_device_area_size(svq);
+    svq->vring.desc = qemu_memalign(qemu_real_host_page_size, driver_size);
+    desc_size = sizeof(vring_desc_t) * svq->vring.num;
+    svq->vring.avail = (void *)((char *)svq->vring.desc + desc_size);
+    memset(svq->vring.desc, 0, driver_size);
+    svq->vring.used = qemu_memalign(qemu_real_host_page_size, device_size);
+    memset(svq->vring.used, 0, device_size);
+
+    svq->free_head = 0;
+    svq->num_free = svq->vring.num;
+    for (i = 0; i < svq->vring.num - 1; i++) {
+        svq->vring.desc[i].next = cpu_to_le16(i + 1);
+    }
+
+    svq->desc_state = g_new0(SVQDescState, svq->vring.num);
+    vhost_svq_set_notification(svq, true);
+
+    event_notifier_set_handler(&svq->svq_kick,
+                               vhost_handle_guest_kick_notifier);
+    event_notifier_set(&svq->svq_kick);
+    trace_vhost_svq_start(svq, svq->vring.num);
+}
+
+/**
+ * Stop the shadow virtqueue operation.
+ * @svq: Shadow Virtqueue
+ *
+ * The used buffers are returned to the guest and the in-flight ones are
+ * made available again, so that whoever processes the virtqueue next (the
+ * device itself, or a new SVQ) finds them at the last avail index that QEMU
+ * reports.  This assumes that the device uses the buffers in order, which
+ * is what network devices do in practice.
+ */
+void vhost_svq_stop(VhostShadowVirtqueue *svq)
+{
+    unsigned i;
+
+    if (!svq->vq) {
+        return;
+    }
+
+    event_notifier_set_handler(&svq->svq_kick, NULL);
+
+    /* Send all pending used descriptors to guest */
+    vhost_svq_flush(svq, false);
+
+    for (i = 0; i < svq->vring.num; ++i) {
+        g_autofree VirtQueueElement *elem = NULL;
+
+        elem = g_steal_pointer(&svq->desc_state[i].elem);
+        if (elem) {
+            virtqueue_unpop(svq->vq, elem, 0);
+        }
+    }
+
+    if (svq->next_guest_avail_elem) {
+        g_autofree VirtQueueElement *elem =
+            g_steal_pointer(&svq->next_guest_avail_elem);
+
+        virtqueue_unpop(svq->vq, elem, 0);
+    }
+
+    trace_vhost_svq_stop(svq);
+    svq->vq = NULL;
+    g_free(svq->desc_state);
+    svq->desc_state = NULL;
+    qemu_vfree(svq->vring.desc);
+    qemu_vfree(svq->vring.used);
+}
+
+/**
+ * Creates vhost shadow virtqueue, and instructs the vhost device to use the
+ * shadow methods and file descriptors.
+ *
+ * @iova_tree: Tree to translate the guest's buffers addresses
+ * @ops: SVQ owner callbacks, or NULL to relay the guest's buffers
+ * @ops_opaque: ops opaque pointer
+ *
+ * Returns the new virtqueue or NULL.
+ *
+ * In case of error, reason is reported through error_report.
+ */
+VhostShadowVirtqueue *vhost_svq_new(VhostIOVATree *iova_tree,
+                                    const VhostShadowVirtqueueOps *ops,
+                                    void *ops_opaque)
+{
+    g_autofree VhostShadowVirtqueue *svq = g_new0(VhostShadowVirtqueue, 1);
+    int r;
+
+    r = event_notifier_init(&svq->hdev_kick, 0);
+    if (r != 0) {
+        error_report("Couldn't create kick event notifier: %s (%d)",
+                     g_strerror(errno), errno);
+        goto err_init_hdev_kick;
+    }
+
+    r = event_notifier_init(&svq->hdev_call, 0);
+    if (r != 0) {
+        error_report("Couldn't create call event notifier: %s (%d)",
+                     g_strerror(errno), errno);
+        goto err_init_hdev_call;
+    }
+
+    event_notifier_init_fd(&svq->svq_kick, -1);
+    svq->svq_call_fd = -1;
+    svq->iova_tree = iova_tree;
+    svq->ops = ops;
+    svq->ops_opaque = ops_opaque;
+    event_notifier_set_handler(&svq->hdev_call, vhost_svq_handle_call);
+    return g_steal_pointer(&svq);
+
+err_init_hdev_call:
+    event_notifier_cleanup(&svq->hdev_kick);
+
+err_init_hdev_kick:
+    return NULL;
+}
+
+/**
+ * Free the resources of the shadow virtqueue.
+ *
+ * @pvq: gpointer to SVQ so it can be used by autofree functions.
+ */
+void vhost_svq_free(gpointer pvq)
+{
+    VhostShadowVirtqueue *vq = pvq;
+
+    vhost_svq_stop(vq);
+    event_notifier_cleanup(&vq->hdev_kick);
+    event_notifier_set_handler(&vq->hdev_call, NULL);
+    event_notifier_cleanup(&vq->hdev_call);
+    g_free(vq);
+}
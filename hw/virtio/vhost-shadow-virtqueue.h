@@ -0,0 +1,131 @@
+/*
+ * vhost shadow virtqueue
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef VHOST_SHADOW_VIRTQUEUE_H
+#define VHOST_SHADOW_VIRTQUEUE_H
+
+#include "qemu/event_notifier.h"
+#include "hw/virtio/virtio.h"
+#include "standard-headers/linux/vhost_types.h"
+#include "standard-headers/linux/virtio_ring.h"
+#include "hw/virtio/vhost-iova-tree.h"
+
+typedef struct SVQDescState {
+    /* Guest element, NULL for the buffers that QEMU itself made available */
+    VirtQueueElement *elem;
+
+    /* Descriptors exposed to the device, 0 if the head is not in use */
+    unsigned int ndescs;
+} SVQDescState;
+
+typedef struct VhostShadowVirtqueue VhostShadowVirtqueue;
+
+/**
+ * Callback to handle an avail buffer.
+ *
+ * @svq: Shadow virtqueue
+ * @elem: Element placed in the queue by the guest
+ * @vq_callback_opaque: Opaque
+ *
+ * Returns 0 if the vq is running as expected.  The callback owns @elem.
+ */
+typedef int (*ShadowVirtQueueAvailHandler)(VhostShadowVirtqueue *svq,
+                                           VirtQueueElement *elem,
+                                           void *vq_callback_opaque);
+
+typedef struct VhostShadowVirtqueueOps {
+    ShadowVirtQueueAvailHandler avail_handler;
+} VhostShadowVirtqueueOps;
+
+/* Shadow virtqueue to relay notifications */
+typedef struct VhostShadowVirtqueue {
+    /* Shadow vring */
+    struct vring vring;
+
+    /* Shadow kick notifier, sent to vhost */
+    EventNotifier hdev_kick;
+    /* Shadow call notifier, sent to vhost */
+    EventNotifier hdev_call;
+
+    /*
+     * Borrowed virtqueue's guest to host notifier.  Polled in the main loop
+     * while the shadow virtqueue is started.
+     */
+    EventNotifier svq_kick;
+
+    /* Guest's call notifier, where the SVQ calls guest. */
+    int svq_call_fd;
+
+    /* Virtio queue shadowing */
+    VirtQueue *vq;
+
+    /* Virtio device */
+    VirtIODevice *vdev;
+
+    /* IOVA mapping of guest memory and of the shadow vring */
+    VhostIOVATree *iova_tree;
+
+    /* State of each descriptor head of the shadow vring */
+    SVQDescState *desc_state;
+
+    /* Caller callbacks */
+    const VhostShadowVirtqueueOps *ops;
+
+    /* Caller callbacks opaque */
+    void *ops_opaque;
+
+    /* Next VirtQueue element that guest made available, if it did not fit */
+    VirtQueueElement *next_guest_avail_elem;
+
+    /* Next head to expose to the device */
+    uint16_t shadow_avail_idx;
+
+    /* Next free descriptor */
+    uint16_t free_head;
+
+    /* Last seen used idx */
+    uint16_t shadow_used_idx;
+
+    /* Next head to consume from the device */
+    uint16_t last_used_idx;
+
+    /* Number of free descriptors */
+    uint16_t num_free;
+} VhostShadowVirtqueue;
+
+uint64_t vhost_svq_filter_features(uint64_t features);
+bool vhost_svq_valid_features(uint64_t features, Error **errp);
+
+void vhost_svq_push_elem(VhostShadowVirtqueue *svq,
+                         const VirtQueueElement *elem, uint32_t len);
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const struct iovec *in_sg, size_t in_num,
+                  VirtQueueElement *elem);
+size_t vhost_svq_poll(VhostShadowVirtqueue *svq);
+
+void vhost_svq_set_svq_kick_fd(VhostShadowVirtqueue *svq, int svq_kick_fd);
+void vhost_svq_set_svq_call_fd(VhostShadowVirtqueue *svq, int call_fd);
+const EventNotifier *vhost_svq_get_dev_kick_notifier(
+                                            const VhostShadowVirtqueue *svq);
+const EventNotifier *vhost_svq_get_svq_call_notifier(
+                                            const VhostShadowVirtqueue *svq);
+void vhost_svq_get_vring_addr(const VhostShadowVirtqueue *svq,
+                              struct vhost_vring_addr *addr);
+size_t vhost_svq_driver_area_size(const VhostShadowVirtqueue *svq);
+size_t vhost_svq_device_area_size(const VhostShadowVirtqueue *svq);
+
+void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
+                     VirtQueue *vq);
+void vhost_svq_stop(VhostShadowVirtqueue *svq);
+
+VhostShadowVirtqueue *vhost_svq_new(VhostIOVATree *iova_tree,
+                                    const VhostShadowVirtqueueOps *ops,
+                                    void *ops_opaque);
+void vhost_svq_free(gpointer vq);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(VhostShadowVirtqueue, vhost_svq_free);
+
+#endif
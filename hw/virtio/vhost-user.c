@@ -443,6 +443,39 @@ static int process_message_reply(struct vhost_dev *dev,
     return msg_reply.payload.u64 ? -EIO : 0;
 }
 
+/*
+ * Collects the replies to @n messages like @msg, sent back to back without
+ * waiting for each reply.  The backend handles messages in order, so the
+ * replies arrive in order too.  All of them are read even if one reports
+ * an error, so that later requests see their own replies.
+ */
+static int process_message_replies(struct vhost_dev *dev,
+                                   const VhostUserMsg *msg, int n)
+{
+    VhostUserMsg msg_reply;
+    int i, ret, err = 0;
+
+    for (i = 0; i < n; i++) {
+        ret = vhost_user_read(dev, &msg_reply);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (msg_reply.hdr.request != msg->hdr.request) {
+            error_report("Received unexpected msg type. "
+                         "Expected %d received %d",
+                         msg->hdr.request, msg_reply.hdr.request);
+            return -EPROTO;
+        }
+
+        if (msg_reply.payload.u64 && !err) {
+            err = -EIO;
+        }
+    }
+
+    return err;
+}
+
 static bool vhost_user_one_time_request(VhostUserRequest request)
 {
     switch (request) {
@@ -731,9 +764,12 @@ static int send_remove_regions(struct vhost_dev *dev,
     struct vhost_user *u = dev->opaque;
     struct vhost_memory_region *shadow_reg;
     int i, fd, shadow_reg_idx, ret;
+    int nr_replies = 0;
     ram_addr_t offset;
     VhostUserMemoryRegion region_buffer;
 
+    msg->hdr.request = VHOST_USER_REM_MEM_REG;
+
     /*
      * The regions in remove_reg appear in the same order they do in the
      * shadow table. Therefore we can minimize memory copies by iterating
@@ -746,7 +782,6 @@ static int send_remove_regions(struct vhost_dev *dev,
         vhost_user_get_mr_data(shadow_reg->userspace_addr, &offset, &fd);
 
         if (fd > 0) {
-            msg->hdr.request = VHOST_USER_REM_MEM_REG;
             vhost_user_fill_msg_region(&region_buffer, shadow_reg, 0);
             msg->payload.mem_reg.region = region_buffer;
 
@@ -754,18 +789,14 @@ static int send_remove_regions(struct vhost_dev *dev,
             if (ret < 0) {
                 return ret;
             }
-
-            if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
-            }
+            nr_replies += reply_supported;
         }
 
         /*
-         * At this point we know the backend has unmapped the region. It is now
-         * safe to remove it from the shadow table.
+         * The backend handles the messages in order, so later ones (and
+         * the VHOST_USER_ADD_MEM_REG messages that follow) already see the
+         * region as unmapped.  If it fails to unmap it, the whole update
+         * fails below and the device is stopped anyway.
          */
         memmove(&u->shadow_regions[shadow_reg_idx],
                 &u->shadow_regions[shadow_reg_idx + 1],
@@ -774,7 +805,7 @@ static int send_remove_regions(struct vhost_dev *dev,
         u->num_shadow_regions--;
     }
 
-    return 0;
+    return process_message_replies(dev, msg, nr_replies);
 }
 
 static int send_add_regions(struct vhost_dev *dev,
@@ -784,6 +815,7 @@ static int send_add_regions(struct vhost_dev *dev,
 {
     struct vhost_user *u = dev->opaque;
     int i, fd, ret, reg_idx, reg_fd_idx;
+    int nr_replies = 0;
     struct vhost_memory_region *reg;
     MemoryRegion *mr;
     ram_addr_t offset;
@@ -860,11 +892,9 @@ static int send_add_regions(struct vhost_dev *dev,
                                  dev->mem->regions[reg_idx].guest_phys_addr);
                     return -EPROTO;
                 }
-            } else if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+            } else {
+                /* Without postcopy, the replies carry no data: pipeline */
+                nr_replies += reply_supported;
             }
         } else if (track_ramblocks) {
             u->region_rb_offset[reg_idx] = 0;
@@ -872,8 +902,9 @@ static int send_add_regions(struct vhost_dev *dev,
         }
 
         /*
-         * At this point, we know the backend has mapped in the new
-         * region, if the region has a valid file descriptor.
+         * At this point, the backend has mapped in the new region or will
+         * do so before processing any later message, if the region has a
+         * valid file descriptor.
          *
          * The region should now be added to the shadow table.
          */
@@ -886,7 +917,7 @@ static int send_add_regions(struct vhost_dev *dev,
         u->num_shadow_regions++;
     }
 
-    return 0;
+    return process_message_replies(dev, msg, nr_replies);
 }
 
 static int vhost_user_add_remove_regions(struct vhost_dev *dev,
@@ -17,6 +17,7 @@
 #include "hw/virtio/vhost.h"
 #include "hw/virtio/vhost-backend.h"
 #include "hw/virtio/virtio-net.h"
+#include "hw/virtio/vhost-shadow-virtqueue.h"
 #include "hw/virtio/vhost-vdpa.h"
 #include "exec/address-spaces.h"
 #include "qemu/main-loop.h"
@@ -69,8 +70,8 @@ static bool vhost_vdpa_listener_skipped_section(MemoryRegionSection *section,
     return false;
 }
 
-static int vhost_vdpa_dma_map(struct vhost_vdpa *v, hwaddr iova, hwaddr size,
-                              void *vaddr, bool readonly)
+int vhost_vdpa_dma_map(struct vhost_vdpa *v, hwaddr iova, hwaddr size,
+                       void *vaddr, bool readonly)
 {
     struct vhost_msg_v2 msg = {};
     int fd = v->device_fd;
@@ -95,8 +96,7 @@ static int vhost_vdpa_dma_map(struct vhost_vdpa *v, hwaddr iova, hwaddr size,
     return ret;
 }
 
-static int vhost_vdpa_dma_unmap(struct vhost_vdpa *v, hwaddr iova,
-                                hwaddr size)
+int vhost_vdpa_dma_unmap(struct vhost_vdpa *v, hwaddr iova, hwaddr size)
 {
     struct vhost_msg_v2 msg = {};
     int fd = v->device_fd;
@@ -173,6 +173,7 @@ static void vhost_vdpa_listener_region_add(MemoryListener *listener,
                                            MemoryRegionSection *section)
 {
     struct vhost_vdpa *v = container_of(listener, struct vhost_vdpa, listener);
+    DMAMap mem_region = {};
     hwaddr iova;
     Int128 llend, llsize;
     void *vaddr;
@@ -207,17 +208,41 @@ static void vhost_vdpa_listener_region_add(MemoryListener *listener,
                                          vaddr, section->readonly);
 
     llsize = int128_sub(llend, int128_make64(iova));
+    if (v->iova_tree) {
+        mem_region.translated_addr = (hwaddr)(uintptr_t)vaddr;
+        mem_region.size = int128_get64(llsize) - 1;
+        mem_region.perm = IOMMU_ACCESS_FLAG(true, !section->readonly);
+
+        if (v->shadow_data) {
+            ret = vhost_iova_tree_map_alloc(v->iova_tree, &mem_region);
+        } else {
+            /* Keep the allocations of shadow virtqueues out of guest RAM */
+            mem_region.iova = iova;
+            ret = vhost_iova_tree_insert(v->iova_tree, &mem_region);
+        }
+        if (unlikely(ret != IOVA_OK)) {
+            error_report("Can't allocate a mapping (%d)", ret);
+            goto fail;
+        }
+
+        iova = mem_region.iova;
+    }
 
     vhost_vdpa_iotlb_batch_begin_once(v);
     ret = vhost_vdpa_dma_map(v, iova, int128_get64(llsize),
                              vaddr, section->readonly);
     if (ret) {
         error_report("vhost vdpa map fail!");
-        goto fail;
+        goto fail_map;
     }
 
     return;
 
+fail_map:
+    if (v->iova_tree) {
+        vhost_iova_tree_remove(v->iova_tree, &mem_region);
+    }
+
 fail:
     /*
      * On the initfn path, store the first error in the container so we
@@ -259,12 +284,33 @@ static void vhost_vdpa_listener_region_del(MemoryListener *listener,
 
     llsize = int128_sub(llend, int128_make64(iova));
 
+    if (v->iova_tree) {
+        const DMAMap *result;
+        const void *vaddr = memory_region_get_ram_ptr(section->mr) +
+            section->offset_within_region +
+            (iova - section->offset_within_address_space);
+        DMAMap mem_region = {
+            .translated_addr = (hwaddr)(uintptr_t)vaddr,
+            .size = int128_get64(llsize) - 1,
+        };
+
+        result = vhost_iova_tree_find_iova(v->iova_tree, &mem_region);
+        if (unlikely(!result)) {
+            error_report("vhost_vdpa: no IOVA mapping for removed region");
+            goto out;
+        }
+        mem_region = *result;
+        iova = mem_region.iova;
+        vhost_iova_tree_remove(v->iova_tree, &mem_region);
+    }
+
     vhost_vdpa_iotlb_batch_begin_once(v);
     ret = vhost_vdpa_dma_unmap(v, iova, int128_get64(llsize));
     if (ret) {
         error_report("vhost_vdpa dma unmap error!");
     }
 
+out:
     memory_region_unref(section->mr);
 }
 /*
@@ -342,6 +388,47 @@ static bool vhost_vdpa_one_time_request(struct vhost_dev *dev)
     return v->index != 0;
 }
 
+static int vhost_vdpa_init_svq(struct vhost_dev *hdev, struct vhost_vdpa *v,
+                               Error **errp)
+{
+    g_autoptr(GPtrArray) shadow_vqs = NULL;
+    uint64_t dev_features;
+    unsigned n;
+    int r;
+
+    if (!v->shadow_vqs_migration) {
+        return 0;
+    }
+
+    r = vhost_vdpa_call(hdev, VHOST_GET_FEATURES, &dev_features);
+    if (r != 0) {
+        error_setg_errno(errp, -r, "Can't get vdpa device features");
+        return r;
+    }
+
+    dev_features = vhost_svq_filter_features(dev_features);
+    if (!vhost_svq_valid_features(dev_features, errp)) {
+        return -1;
+    }
+
+    shadow_vqs = g_ptr_array_new_full(hdev->nvqs, vhost_svq_free);
+    for (n = 0; n < hdev->nvqs; ++n) {
+        g_autoptr(VhostShadowVirtqueue) svq;
+
+        svq = vhost_svq_new(v->iova_tree, v->shadow_vq_ops,
+                            v->shadow_vq_ops_opaque);
+
+        if (unlikely(!svq)) {
+            error_setg(errp, "Cannot create svq %u", n);
+            return -1;
+        }
+        g_ptr_array_add(shadow_vqs, g_steal_pointer(&svq));
+    }
+
+    v->shadow_vqs = g_steal_pointer(&shadow_vqs);
+    return 0;
+}
+
 static int vhost_vdpa_init(struct vhost_dev *dev, void *opaque, Error **errp)
 {
     struct vhost_vdpa *v;
@@ -367,6 +454,12 @@ static int vhost_vdpa_init(struct vhost_dev *dev, void *opaque, Error **errp)
 
     vhost_vdpa_get_iova_range(v);
 
+    ret = vhost_vdpa_init_svq(dev, v, errp);
+    if (ret) {
+        ram_block_discard_disable(false);
+        return ret;
+    }
+
     if (vhost_vdpa_one_time_request(dev)) {
         return 0;
     }
@@ -467,6 +560,10 @@ static int vhost_vdpa_cleanup(struct vhost_dev *dev)
     trace_vhost_vdpa_cleanup(dev, v);
     vhost_vdpa_host_notifiers_uninit(dev, dev->nvqs);
     memory_listener_unregister(&v->listener);
+    if (v->shadow_vqs) {
+        g_ptr_array_free(v->shadow_vqs, true);
+        v->shadow_vqs = NULL;
+    }
 
     dev->opaque = NULL;
     ram_block_discard_disable(false);
@@ -509,17 +606,37 @@ static int vhost_vdpa_set_mem_table(struct vhost_dev *dev,
 static int vhost_vdpa_set_features(struct vhost_dev *dev,
                                    uint64_t features)
 {
+    struct vhost_vdpa *v = dev->opaque;
     int ret;
 
     if (vhost_vdpa_one_time_request(dev)) {
         return 0;
     }
 
+    if (v->shadow_vqs_migration) {
+        uint8_t status = 0;
+
+        /*
+         * VHOST_F_LOG_ALL is emulated by the shadow virtqueues, so only a
+         * device that was reset since the last call needs the features.
+         */
+        features &= ~BIT_ULL(VHOST_F_LOG_ALL);
+        ret = vhost_vdpa_call(dev, VHOST_VDPA_GET_STATUS, &status);
+        if (ret) {
+            return ret;
+        }
+        if ((status & VIRTIO_CONFIG_S_FEATURES_OK) &&
+            features == v->acked_features) {
+            return 0;
+        }
+    }
+
     trace_vhost_vdpa_set_features(dev, features);
     ret = vhost_vdpa_call(dev, VHOST_SET_FEATURES, &features);
     if (ret) {
         return ret;
     }
+    v->acked_features = features;
 
     return vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_FEATURES_OK);
 }
@@ -646,39 +763,245 @@ static int vhost_vdpa_get_config(struct vhost_dev *dev, uint8_t *config,
     return ret;
  }
 
+static VhostShadowVirtqueue *vhost_vdpa_get_svq(struct vhost_dev *dev,
+                                                unsigned int index)
+{
+    struct vhost_vdpa *v = dev->opaque;
+
+    return g_ptr_array_index(v->shadow_vqs, index - dev->vq_index);
+}
+
+/*
+ * Map a shadow vring area to the device, at an iova allocated for it.  The
+ * iova is returned in @needle->iova.
+ */
+static bool vhost_vdpa_svq_map_ring(struct vhost_vdpa *v, DMAMap *needle,
+                                    Error **errp)
+{
+    int r;
+
+    r = vhost_iova_tree_map_alloc(v->iova_tree, needle);
+    if (unlikely(r != IOVA_OK)) {
+        error_setg(errp, "Cannot allocate iova (%d)", r);
+        return false;
+    }
+
+    r = vhost_vdpa_dma_map(v, needle->iova, needle->size + 1,
+                           (void *)(uintptr_t)needle->translated_addr,
+                           needle->perm == IOMMU_RO);
+    if (unlikely(r != 0)) {
+        error_setg_errno(errp, -r, "Cannot map region to device");
+        vhost_iova_tree_remove(v->iova_tree, needle);
+    }
+
+    return r == 0;
+}
+
+static void vhost_vdpa_svq_unmap_ring(struct vhost_vdpa *v, hwaddr addr)
+{
+    const DMAMap needle = {
+        .translated_addr = addr,
+    };
+    const DMAMap *result;
+    DMAMap map;
+    int r;
+
+    result = vhost_iova_tree_find_iova(v->iova_tree, &needle);
+    if (unlikely(!result)) {
+        error_report("Unable to find SVQ address to unmap");
+        return;
+    }
+
+    map = *result;
+    r = vhost_vdpa_dma_unmap(v, map.iova, map.size + 1);
+    if (unlikely(r != 0)) {
+        error_report("Unable to unmap SVQ vring: %s (%d)", g_strerror(-r), -r);
+    }
+
+    vhost_iova_tree_remove(v->iova_tree, &map);
+}
+
+/*
+ * Map the shadow vring to the device, and fill @addr with the addresses
+ * that the device must use.
+ */
+static bool vhost_vdpa_svq_map_rings(struct vhost_dev *dev,
+                                     const VhostShadowVirtqueue *svq,
+                                     struct vhost_vring_addr *addr,
+                                     Error **errp)
+{
+    struct vhost_vdpa *v = dev->opaque;
+    DMAMap device_region, driver_region;
+    struct vhost_vring_addr svq_addr;
+    size_t device_size = vhost_svq_device_area_size(svq);
+    size_t driver_size = vhost_svq_driver_area_size(svq);
+    size_t avail_offset;
+
+    vhost_svq_get_vring_addr(svq, &svq_addr);
+
+    driver_region = (DMAMap) {
+        .translated_addr = svq_addr.desc_user_addr,
+        .size = driver_size - 1,
+        .perm = IOMMU_RO,
+    };
+    if (!vhost_vdpa_svq_map_ring(v, &driver_region, errp)) {
+        return false;
+    }
+    addr->desc_user_addr = driver_region.iova;
+    avail_offset = svq_addr.avail_user_addr - svq_addr.desc_user_addr;
+    addr->avail_user_addr = driver_region.iova + avail_offset;
+
+    device_region = (DMAMap) {
+        .translated_addr = svq_addr.used_user_addr,
+        .size = device_size - 1,
+        .perm = IOMMU_RW,
+    };
+    if (!vhost_vdpa_svq_map_ring(v, &device_region, errp)) {
+        vhost_vdpa_svq_unmap_ring(v, svq_addr.desc_user_addr);
+        return false;
+    }
+    addr->used_user_addr = device_region.iova;
+
+    trace_vhost_vdpa_svq_map_ring(dev, addr->index, driver_region.iova,
+                                  device_region.iova);
+    return true;
+}
+
+static void vhost_vdpa_svq_stop(struct vhost_dev *dev,
+                                VhostShadowVirtqueue *svq)
+{
+    struct vhost_vdpa *v = dev->opaque;
+    struct vhost_vring_addr addr;
+
+    if (!svq->vq) {
+        return;
+    }
+
+    vhost_svq_get_vring_addr(svq, &addr);
+    vhost_vdpa_svq_unmap_ring(v, addr.desc_user_addr);
+    vhost_vdpa_svq_unmap_ring(v, addr.used_user_addr);
+    vhost_svq_stop(svq);
+}
+
+static void vhost_vdpa_svqs_stop(struct vhost_dev *dev)
+{
+    struct vhost_vdpa *v = dev->opaque;
+    unsigned i;
+
+    if (!v->shadow_vqs) {
+        return;
+    }
+
+    for (i = 0; i < v->shadow_vqs->len; ++i) {
+        vhost_vdpa_svq_stop(dev, g_ptr_array_index(v->shadow_vqs, i));
+    }
+}
+
+/*
+ * Start relaying the guest's virtqueues through the shadow virtqueues.  The
+ * guest's kick and call file descriptors were already set.
+ */
+static bool vhost_vdpa_svqs_start(struct vhost_dev *dev)
+{
+    struct vhost_vdpa *v = dev->opaque;
+    Error *err = NULL;
+    unsigned i;
+
+    for (i = 0; i < v->shadow_vqs->len; ++i) {
+        VhostShadowVirtqueue *svq = g_ptr_array_index(v->shadow_vqs, i);
+        unsigned int vq_index = dev->vq_index + i;
+        struct vhost_vring_addr addr = {
+            .index = vq_index,
+        };
+        int r;
+
+        /* Not set up by the guest, vhost_virtqueue_start() skipped it too */
+        if (!virtio_queue_get_desc_addr(dev->vdev, vq_index)) {
+            continue;
+        }
+
+        vhost_svq_start(svq, dev->vdev, virtio_get_queue(dev->vdev, vq_index));
+        if (!vhost_vdpa_svq_map_rings(dev, svq, &addr, &err)) {
+            vhost_svq_stop(svq);
+            goto err;
+        }
+
+        r = vhost_vdpa_call(dev, VHOST_SET_VRING_ADDR, &addr);
+        if (unlikely(r != 0)) {
+            error_setg_errno(&err, -r, "Cannot set device address");
+            vhost_vdpa_svq_stop(dev, svq);
+            goto err;
+        }
+    }
+
+    return true;
+
+err:
+    error_reportf_err(err, "Cannot setup SVQ %u: ", i);
+    vhost_vdpa_svqs_stop(dev);
+    return false;
+}
+
 static int vhost_vdpa_dev_start(struct vhost_dev *dev, bool started)
 {
     struct vhost_vdpa *v = dev->opaque;
+    bool last = dev->vq_index + dev->nvqs == dev->vq_index_end;
     trace_vhost_vdpa_dev_start(dev, started);
 
-    if (started) {
-        vhost_vdpa_host_notifiers_init(dev);
-        vhost_vdpa_set_vring_ready(dev);
-    } else {
+    if (!started) {
+        vhost_vdpa_svqs_stop(dev);
         vhost_vdpa_host_notifiers_uninit(dev, dev->nvqs);
-    }
-
-    if (dev->vq_index + dev->nvqs != dev->vq_index_end) {
         return 0;
     }
 
-    if (started) {
+    /*
+     * Guest memory goes in the iova tree first, so that the shadow vrings
+     * of the last device (the control virtqueue) are allocated around it.
+     */
+    if (last) {
         memory_listener_register(&v->listener, &address_space_memory);
-        return vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_DRIVER_OK);
+    }
+
+    if (v->shadow_vqs_enabled) {
+        if (!vhost_vdpa_svqs_start(dev)) {
+            if (last) {
+                memory_listener_unregister(&v->listener);
+            }
+            return -1;
+        }
     } else {
-        vhost_vdpa_reset_device(dev);
-        vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_ACKNOWLEDGE |
-                                   VIRTIO_CONFIG_S_DRIVER);
-        memory_listener_unregister(&v->listener);
+        vhost_vdpa_host_notifiers_init(dev);
+    }
+    vhost_vdpa_set_vring_ready(dev);
 
-        return 0;
+    return last ? vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_DRIVER_OK) : 0;
+}
+
+/*
+ * The device is only reset after all its virtqueues have been stopped, so
+ * that the vring bases are read from a device that still has them.
+ */
+static void vhost_vdpa_reset_status(struct vhost_dev *dev)
+{
+    struct vhost_vdpa *v = dev->opaque;
+
+    if (dev->vq_index + dev->nvqs != dev->vq_index_end) {
+        return;
     }
+
+    vhost_vdpa_reset_device(dev);
+    vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_ACKNOWLEDGE |
+                               VIRTIO_CONFIG_S_DRIVER);
+    memory_listener_unregister(&v->listener);
 }
 
 static int vhost_vdpa_set_log_base(struct vhost_dev *dev, uint64_t base,
                                      struct vhost_log *log)
 {
-    if (vhost_vdpa_one_time_request(dev)) {
+    struct vhost_vdpa *v = dev->opaque;
+
+    /* The shadow virtqueues log the memory the device writes */
+    if (v->shadow_vqs_migration || vhost_vdpa_one_time_request(dev)) {
         return 0;
     }
 
@@ -690,11 +1013,21 @@ static int vhost_vdpa_set_log_base(struct vhost_dev *dev, uint64_t base,
 static int vhost_vdpa_set_vring_addr(struct vhost_dev *dev,
                                        struct vhost_vring_addr *addr)
 {
-    trace_vhost_vdpa_set_vring_addr(dev, addr->index, addr->flags,
-                                    addr->desc_user_addr, addr->used_user_addr,
-                                    addr->avail_user_addr,
-                                    addr->log_guest_addr);
-    return vhost_vdpa_call(dev, VHOST_SET_VRING_ADDR, addr);
+    struct vhost_vdpa *v = dev->opaque;
+    struct vhost_vring_addr dev_addr = *addr;
+
+    if (v->shadow_vqs_enabled) {
+        /* The device uses the shadow vring, set in vhost_vdpa_svqs_start() */
+        return 0;
+    }
+
+    dev_addr.flags &= ~(1 << VHOST_VRING_F_LOG);
+    trace_vhost_vdpa_set_vring_addr(dev, dev_addr.index, dev_addr.flags,
+                                    dev_addr.desc_user_addr,
+                                    dev_addr.used_user_addr,
+                                    dev_addr.avail_user_addr,
+                                    dev_addr.log_guest_addr);
+    return vhost_vdpa_call(dev, VHOST_SET_VRING_ADDR, &dev_addr);
 }
 
 static int vhost_vdpa_set_vring_num(struct vhost_dev *dev,
@@ -707,15 +1040,34 @@ static int vhost_vdpa_set_vring_num(struct vhost_dev *dev,
 static int vhost_vdpa_set_vring_base(struct vhost_dev *dev,
                                        struct vhost_vring_state *ring)
 {
-    trace_vhost_vdpa_set_vring_base(dev, ring->index, ring->num);
-    return vhost_vdpa_call(dev, VHOST_SET_VRING_BASE, ring);
+    struct vhost_vdpa *v = dev->opaque;
+    struct vhost_vring_state dev_ring = *ring;
+
+    if (v->shadow_vqs_enabled) {
+        /*
+         * The shadow vring always starts from the beginning, the guest's
+         * avail index is handled by the VirtQueue code.
+         */
+        dev_ring.num = 0;
+    }
+
+    trace_vhost_vdpa_set_vring_base(dev, dev_ring.index, dev_ring.num);
+    return vhost_vdpa_call(dev, VHOST_SET_VRING_BASE, &dev_ring);
 }
 
 static int vhost_vdpa_get_vring_base(struct vhost_dev *dev,
                                        struct vhost_vring_state *ring)
 {
+    struct vhost_vdpa *v = dev->opaque;
     int ret;
 
+    if (v->shadow_vqs_enabled) {
+        /* In-flight buffers were made available again by vhost_svq_stop() */
+        ring->num = virtio_queue_get_last_avail_idx(dev->vdev, ring->index);
+        trace_vhost_vdpa_get_vring_base(dev, ring->index, ring->num);
+        return 0;
+    }
+
     ret = vhost_vdpa_call(dev, VHOST_GET_VRING_BASE, ring);
     trace_vhost_vdpa_get_vring_base(dev, ring->index, ring->num);
     return ret;
@@ -724,23 +1076,55 @@ static int vhost_vdpa_get_vring_base(struct vhost_dev *dev,
 static int vhost_vdpa_set_vring_kick(struct vhost_dev *dev,
                                        struct vhost_vring_file *file)
 {
+    struct vhost_vdpa *v = dev->opaque;
+
     trace_vhost_vdpa_set_vring_kick(dev, file->index, file->fd);
+    if (v->shadow_vqs_enabled) {
+        VhostShadowVirtqueue *svq = vhost_vdpa_get_svq(dev, file->index);
+        struct vhost_vring_file dev_file = {
+            .index = file->index,
+            .fd = event_notifier_get_fd(vhost_svq_get_dev_kick_notifier(svq)),
+        };
+
+        vhost_svq_set_svq_kick_fd(svq, file->fd);
+        return vhost_vdpa_call(dev, VHOST_SET_VRING_KICK, &dev_file);
+    }
+
     return vhost_vdpa_call(dev, VHOST_SET_VRING_KICK, file);
 }
 
 static int vhost_vdpa_set_vring_call(struct vhost_dev *dev,
                                        struct vhost_vring_file *file)
 {
+    struct vhost_vdpa *v = dev->opaque;
+
     trace_vhost_vdpa_set_vring_call(dev, file->index, file->fd);
+    if (v->shadow_vqs_enabled) {
+        VhostShadowVirtqueue *svq = vhost_vdpa_get_svq(dev, file->index);
+        struct vhost_vring_file dev_file = {
+            .index = file->index,
+            .fd = event_notifier_get_fd(vhost_svq_get_svq_call_notifier(svq)),
+        };
+
+        vhost_svq_set_svq_call_fd(svq, file->fd);
+        return vhost_vdpa_call(dev, VHOST_SET_VRING_CALL, &dev_file);
+    }
+
     return vhost_vdpa_call(dev, VHOST_SET_VRING_CALL, file);
 }
 
 static int vhost_vdpa_get_features(struct vhost_dev *dev,
                                      uint64_t *features)
 {
+    struct vhost_vdpa *v = dev->opaque;
     int ret;
 
     ret = vhost_vdpa_call(dev, VHOST_GET_FEATURES, features);
+    if (ret == 0 && v->shadow_vqs_migration) {
+        /* Dirty pages are logged by the shadow virtqueues */
+        *features = vhost_svq_filter_features(*features) |
+                    BIT_ULL(VHOST_F_LOG_ALL);
+    }
     trace_vhost_vdpa_get_features(dev, *features);
     return ret;
 }
@@ -804,4 +1188,5 @@ const VhostOps vdpa_ops = {
         .vhost_get_device_id = vhost_vdpa_get_device_id,
         .vhost_vq_get_addr = vhost_vdpa_vq_get_addr,
         .vhost_force_iommu = vhost_vdpa_force_iommu,
+        .vhost_reset_status = vhost_vdpa_reset_status,
 };
@@ -17,6 +17,8 @@
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
+#include "block/aio-wait.h"
+#include "block/thread-pool.h"
 #include "hw/virtio/virtio.h"
 #include "hw/mem/pc-dimm.h"
 #include "hw/qdev-properties.h"
@@ -325,14 +327,170 @@ static void balloon_stats_set_poll_interval(Object *obj, Visitor *v,
     balloon_stats_change_timer(s, 0);
 }
 
+typedef struct VirtIOBalloonReportRange {
+    RAMBlock *rb;
+    ram_addr_t offset;
+    size_t size;
+} VirtIOBalloonReportRange;
+
+/* A batch of free page reports, discarded in a worker thread */
+typedef struct VirtIOBalloonReport {
+    VirtIOBalloon *dev;
+    GPtrArray *elems;
+    GArray *ranges;
+    guint next;                 /* range being discarded */
+} VirtIOBalloonReport;
+
+static gint virtio_balloon_report_range_cmp(gconstpointer a, gconstpointer b)
+{
+    const VirtIOBalloonReportRange *x = a, *y = b;
+
+    if (x->rb != y->rb) {
+        return x->rb < y->rb ? -1 : 1;
+    }
+    if (x->offset != y->offset) {
+        return x->offset < y->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Merge adjacent ranges, then shrink each range to whole pages of its
+ * RAMBlock, so that discarding never splits a host page.
+ */
+static void virtio_balloon_report_merge(GArray *ranges)
+{
+    VirtIOBalloonReportRange *r = (VirtIOBalloonReportRange *)ranges->data;
+    guint i, n = 0;
+
+    g_array_sort(ranges, virtio_balloon_report_range_cmp);
+    for (i = 0; i < ranges->len; i++) {
+        if (n && r[n - 1].rb == r[i].rb &&
+            r[n - 1].offset + r[n - 1].size >= r[i].offset) {
+            r[n - 1].size = MAX(r[n - 1].offset + r[n - 1].size,
+                                r[i].offset + r[i].size) - r[n - 1].offset;
+        } else {
+            r[n++] = r[i];
+        }
+    }
+    g_array_set_size(ranges, n);
+
+    for (i = 0, n = 0; i < ranges->len; i++) {
+        size_t align = qemu_ram_pagesize(r[i].rb);
+        ram_addr_t start, end;
+
+        start = ROUND_UP(r[i].offset, align);
+        end = QEMU_ALIGN_DOWN(r[i].offset + r[i].size, align);
+        if (start < end) {
+            r[n].rb = r[i].rb;
+            r[n].offset = start;
+            r[n++].size = end - start;
+        }
+    }
+    g_array_set_size(ranges, n);
+}
+
+/* The RAMBlocks stay alive while the elements are mapped */
+static int virtio_balloon_report_work(void *opaque)
+{
+    VirtIOBalloonReport *report = opaque;
+    VirtIOBalloonReportRange *r = &g_array_index(report->ranges,
+                                                 VirtIOBalloonReportRange,
+                                                 report->next);
+
+    ram_block_discard_range(r->rb, r->offset, r->size);
+    return 0;
+}
+
+static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq);
+static void virtio_balloon_report_range_done(void *opaque, int ret);
+static void virtio_balloon_report_done(void *opaque, int ret);
+
+/*
+ * Discard the ranges one at a time.  Discarding may be disabled, or
+ * postcopy may start, while the reports are processed; both only happen
+ * with the BQL held, so check before each range.
+ */
+static void virtio_balloon_report_next(VirtIOBalloonReport *report)
+{
+    ThreadPool *pool;
+
+    if (report->next == report->ranges->len || virtio_balloon_inhibited()) {
+        virtio_balloon_report_done(report, 0);
+        return;
+    }
+
+    pool = aio_get_thread_pool(qemu_get_aio_context());
+    thread_pool_submit_aio(pool, virtio_balloon_report_work, report,
+                           virtio_balloon_report_range_done, report);
+}
+
+static void virtio_balloon_report_range_done(void *opaque, int ret)
+{
+    VirtIOBalloonReport *report = opaque;
+
+    report->next++;
+    virtio_balloon_report_next(report);
+}
+
+/*
+ * Only now can the pages be handed back to the guest: it may reuse them
+ * as soon as the elements are pushed.
+ */
+static void virtio_balloon_report_done(void *opaque, int ret)
+{
+    VirtIOBalloonReport *report = opaque;
+    VirtIOBalloon *dev = report->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(dev);
+    guint i;
+
+    for (i = 0; i < report->elems->len; i++) {
+        VirtQueueElement *elem = g_ptr_array_index(report->elems, i);
+
+        virtqueue_push(dev->reporting_vq, elem, 0);
+        g_free(elem);
+    }
+    virtio_notify(vdev, dev->reporting_vq);
+    trace_virtio_balloon_report_done(report->elems->len, report->ranges->len);
+
+    g_ptr_array_free(report->elems, true);
+    g_array_free(report->ranges, true);
+    g_free(report);
+    dev->report_inflight = false;
+
+    /* Process the reports that arrived in the meantime */
+    if (vdev->vm_running && (vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
+        virtio_balloon_handle_report(vdev, dev->reporting_vq);
+    }
+}
+
+static void virtio_balloon_report_drain(VirtIOBalloon *dev)
+{
+    AIO_WAIT_WHILE(NULL, dev->report_inflight);
+}
+
 static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
+    VirtIOBalloonReport *report;
     VirtQueueElement *elem;
 
+    /* The reports are picked up when the current batch completes */
+    if (dev->report_inflight) {
+        return;
+    }
+
+    report = g_new0(VirtIOBalloonReport, 1);
+    report->dev = dev;
+    report->elems = g_ptr_array_new();
+    report->ranges = g_array_new(false, false,
+                                 sizeof(VirtIOBalloonReportRange));
+
     while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
         unsigned int i;
 
+        g_ptr_array_add(report->elems, elem);
+
         /*
          * When we discard the page it has the effect of removing the page
          * from the hypervisor itself and causing it to be zeroed when it
@@ -341,10 +499,11 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
          * expecting it to retain a non-zero value.
          */
         if (virtio_balloon_inhibited() || dev->poison_val) {
-            goto skip_element;
+            continue;
         }
 
         for (i = 0; i < elem->in_num; i++) {
+            VirtIOBalloonReportRange range;
             void *addr = elem->in_sg[i].iov_base;
             size_t size = elem->in_sg[i].iov_len;
             ram_addr_t ram_offset;
@@ -376,14 +535,23 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            range.rb = rb;
+            range.offset = ram_offset;
+            range.size = size;
+            g_array_append_val(report->ranges, range);
         }
+    }
 
-skip_element:
-        virtqueue_push(vq, elem, 0);
-        virtio_notify(vdev, vq);
-        g_free(elem);
+    if (!report->elems->len) {
+        g_ptr_array_free(report->elems, true);
+        g_array_free(report->ranges, true);
+        g_free(report);
+        return;
     }
+
+    virtio_balloon_report_merge(report->ranges);
+    dev->report_inflight = true;
+    virtio_balloon_report_next(report);
 }
 
 static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
@@ -934,6 +1102,7 @@ static void virtio_balloon_device_unrealize(DeviceState *dev)
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
     VirtIOBalloon *s = VIRTIO_BALLOON(dev);
 
+    virtio_balloon_report_drain(s);
     if (s->free_page_bh) {
         qemu_bh_delete(s->free_page_bh);
         object_unref(OBJECT(s->iothread));
@@ -959,6 +1128,7 @@ static void virtio_balloon_device_reset(VirtIODevice *vdev)
 {
     VirtIOBalloon *s = VIRTIO_BALLOON(vdev);
 
+    virtio_balloon_report_drain(s);
     if (virtio_balloon_free_page_support(s)) {
         virtio_balloon_free_page_stop(s);
     }
@@ -976,6 +1146,16 @@ static void virtio_balloon_set_status(VirtIODevice *vdev, uint8_t status)
 {
     VirtIOBalloon *s = VIRTIO_BALLOON(vdev);
 
+    if (s->reporting_vq) {
+        if (!vdev->vm_running) {
+            /* Hand the reported pages back before the state is saved */
+            virtio_balloon_report_drain(s);
+        } else if (status & VIRTIO_CONFIG_S_DRIVER_OK) {
+            /* Pick up the reports that arrived while the VM was stopped */
+            virtio_balloon_handle_report(vdev, s->reporting_vq);
+        }
+    }
+
     if (!s->stats_vq_elem && vdev->vm_running &&
         (status & VIRTIO_CONFIG_S_DRIVER_OK) && virtqueue_rewind(s->svq, 1)) {
         /* poll stats queue for the element we have discarded when the VM
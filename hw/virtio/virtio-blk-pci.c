@@ -44,6 +44,8 @@ static Property virtio_blk_pci_properties[] = {
                     VIRTIO_PCI_FLAG_USE_IOEVENTFD_BIT, true),
     DEFINE_PROP_UINT32("vectors", VirtIOPCIProxy, nvectors,
                        DEV_NVECTORS_UNSPECIFIED),
+    DEFINE_PROP_ARRAY("iothreads", VirtIOBlkPCI, vdev.conf.num_iothreads,
+                      vdev.conf.iothreads, qdev_prop_string, char *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -16,6 +16,8 @@
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/units.h"
+#include "block/aio-wait.h"
+#include "block/thread-pool.h"
 #include "sysemu/numa.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/reset.h"
@@ -445,114 +447,190 @@ static bool virtio_mem_valid_range(const VirtIOMEM *vmem, uint64_t gpa,
     return true;
 }
 
-static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
-                                      uint64_t size, bool plug)
+/* A plug or unplug request, processed in a worker thread */
+typedef struct VirtIOMEMRequest {
+    VirtIOMEM *vmem;
+    VirtQueueElement *elem;
+    uint64_t gpa;
+    uint64_t size;
+    bool plug;
+    Error *err;
+} VirtIOMEMRequest;
+
+/*
+ * Discard the unplugged blocks, or preallocate the plugged ones using the
+ * preallocation threads of the memory backend on its host NUMA nodes.
+ */
+static int virtio_mem_request_work(void *opaque)
 {
-    const uint64_t offset = start_gpa - vmem->addr;
+    VirtIOMEMRequest *req = opaque;
+    VirtIOMEM *vmem = req->vmem;
+    const uint64_t offset = req->gpa - vmem->addr;
     RAMBlock *rb = vmem->memdev->mr.ram_block;
 
-    if (virtio_mem_is_busy()) {
-        return -EBUSY;
+    if (!req->plug) {
+        return ram_block_discard_range(rb, offset, req->size) ? -EBUSY : 0;
     }
 
-    if (!plug) {
-        if (ram_block_discard_range(rb, offset, size)) {
+    if (vmem->prealloc) {
+        void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
+        int fd = memory_region_get_fd(&vmem->memdev->mr);
+
+        os_mem_prealloc(fd, area, req->size, vmem->memdev->prealloc_threads,
+                        vmem->memdev->host_nodes, MAX_NODES, false,
+                        &req->err);
+        if (req->err) {
             return -EBUSY;
         }
-        virtio_mem_notify_unplug(vmem, offset, size);
-    } else {
-        int ret = 0;
-
-        if (vmem->prealloc) {
-            void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-            int fd = memory_region_get_fd(&vmem->memdev->mr);
-            Error *local_err = NULL;
-
-            os_mem_prealloc(fd, area, size, 1, &local_err);
-            if (local_err) {
-                static bool warned;
-
-                /*
-                 * Warn only once, we don't want to fill the log with these
-                 * warnings.
-                 */
-                if (!warned) {
-                    warn_report_err(local_err);
-                    warned = true;
-                } else {
-                    error_free(local_err);
-                }
-                ret = -EBUSY;
-            }
+    }
+    return 0;
+}
+
+static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq);
+
+static void virtio_mem_request_done(void *opaque, int ret)
+{
+    VirtIOMEMRequest *req = opaque;
+    VirtIOMEM *vmem = req->vmem;
+    VirtIODevice *vdev = VIRTIO_DEVICE(vmem);
+    const uint64_t offset = req->gpa - vmem->addr;
+    uint16_t type = VIRTIO_MEM_RESP_ACK;
+
+    if (req->err) {
+        static bool warned;
+
+        /*
+         * Warn only once, we don't want to fill the log with these
+         * warnings.
+         */
+        if (!warned) {
+            warn_report_err(req->err);
+            warned = true;
+        } else {
+            error_free(req->err);
         }
-        if (!ret) {
-            ret = virtio_mem_notify_plug(vmem, offset, size);
+    }
+
+    /*
+     * Migration may have started meanwhile.  New blocks are not plugged
+     * then, but discarded blocks must be unplugged: they no longer hold
+     * what the listeners of the RAM discard manager have mapped.
+     */
+    if (!ret && req->plug && virtio_mem_is_busy()) {
+        ret = -EBUSY;
+    }
+
+    if (!ret) {
+        if (req->plug) {
+            ret = virtio_mem_notify_plug(vmem, offset, req->size);
+        } else {
+            virtio_mem_notify_unplug(vmem, offset, req->size);
         }
+    }
 
-        if (ret) {
+    if (ret) {
+        if (req->plug) {
             /* Could be preallocation or a notifier populated memory. */
-            ram_block_discard_range(vmem->memdev->mr.ram_block, offset, size);
-            return -EBUSY;
+            ram_block_discard_range(vmem->memdev->mr.ram_block, offset,
+                                    req->size);
         }
+        type = VIRTIO_MEM_RESP_BUSY;
+    } else {
+        virtio_mem_set_bitmap(vmem, req->gpa, req->size, req->plug);
+        if (req->plug) {
+            vmem->size += req->size;
+        } else {
+            vmem->size -= req->size;
+        }
+        notifier_list_notify(&vmem->size_change_notifiers, &vmem->size);
     }
-    virtio_mem_set_bitmap(vmem, start_gpa, size, plug);
-    return 0;
+
+    trace_virtio_mem_request_done(req->gpa, req->size, req->plug, ret);
+    virtio_mem_send_response_simple(vmem, req->elem, type);
+    g_free(req->elem);
+    g_free(req);
+    vmem->request_inflight = false;
+
+    /* Process the requests that arrived in the meantime */
+    if (!vmem->request_draining && vdev->vm_running &&
+        (vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
+        virtio_mem_handle_request(vdev, vmem->vq);
+    }
+}
+
+static void virtio_mem_request_drain(VirtIOMEM *vmem)
+{
+    vmem->request_draining = true;
+    AIO_WAIT_WHILE(NULL, vmem->request_inflight);
+    vmem->request_draining = false;
 }
 
-static int virtio_mem_state_change_request(VirtIOMEM *vmem, uint64_t gpa,
-                                           uint16_t nb_blocks, bool plug)
+/*
+ * Returns true if the request is being processed in a worker thread, which
+ * then owns @elem and sends the response.
+ */
+static bool virtio_mem_state_change_request(VirtIOMEM *vmem,
+                                            VirtQueueElement *elem,
+                                            uint64_t gpa, uint16_t nb_blocks,
+                                            bool plug)
 {
     const uint64_t size = nb_blocks * vmem->block_size;
-    int ret;
+    VirtIOMEMRequest *req;
+    ThreadPool *pool;
 
     if (!virtio_mem_valid_range(vmem, gpa, size)) {
-        return VIRTIO_MEM_RESP_ERROR;
+        virtio_mem_send_response_simple(vmem, elem, VIRTIO_MEM_RESP_ERROR);
+        return false;
     }
 
     if (plug && (vmem->size + size > vmem->requested_size)) {
-        return VIRTIO_MEM_RESP_NACK;
+        virtio_mem_send_response_simple(vmem, elem, VIRTIO_MEM_RESP_NACK);
+        return false;
     }
 
     /* test if really all blocks are in the opposite state */
     if (!virtio_mem_test_bitmap(vmem, gpa, size, !plug)) {
-        return VIRTIO_MEM_RESP_ERROR;
+        virtio_mem_send_response_simple(vmem, elem, VIRTIO_MEM_RESP_ERROR);
+        return false;
     }
 
-    ret = virtio_mem_set_block_state(vmem, gpa, size, plug);
-    if (ret) {
-        return VIRTIO_MEM_RESP_BUSY;
-    }
-    if (plug) {
-        vmem->size += size;
-    } else {
-        vmem->size -= size;
+    if (virtio_mem_is_busy()) {
+        virtio_mem_send_response_simple(vmem, elem, VIRTIO_MEM_RESP_BUSY);
+        return false;
     }
-    notifier_list_notify(&vmem->size_change_notifiers, &vmem->size);
-    return VIRTIO_MEM_RESP_ACK;
+
+    req = g_new0(VirtIOMEMRequest, 1);
+    req->vmem = vmem;
+    req->elem = elem;
+    req->gpa = gpa;
+    req->size = size;
+    req->plug = plug;
+    vmem->request_inflight = true;
+
+    pool = aio_get_thread_pool(qemu_get_aio_context());
+    thread_pool_submit_aio(pool, virtio_mem_request_work, req,
+                           virtio_mem_request_done, req);
+    return true;
 }
 
-static void virtio_mem_plug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
+static bool virtio_mem_plug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
                                     struct virtio_mem_req *req)
 {
     const uint64_t gpa = le64_to_cpu(req->u.plug.addr);
     const uint16_t nb_blocks = le16_to_cpu(req->u.plug.nb_blocks);
-    uint16_t type;
 
     trace_virtio_mem_plug_request(gpa, nb_blocks);
-    type = virtio_mem_state_change_request(vmem, gpa, nb_blocks, true);
-    virtio_mem_send_response_simple(vmem, elem, type);
+    return virtio_mem_state_change_request(vmem, elem, gpa, nb_blocks, true);
 }
 
-static void virtio_mem_unplug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
+static bool virtio_mem_unplug_request(VirtIOMEM *vmem, VirtQueueElement *elem,
                                       struct virtio_mem_req *req)
 {
     const uint64_t gpa = le64_to_cpu(req->u.unplug.addr);
     const uint16_t nb_blocks = le16_to_cpu(req->u.unplug.nb_blocks);
-    uint16_t type;
 
     trace_virtio_mem_unplug_request(gpa, nb_blocks);
-    type = virtio_mem_state_change_request(vmem, gpa, nb_blocks, false);
-    virtio_mem_send_response_simple(vmem, elem, type);
+    return virtio_mem_state_change_request(vmem, elem, gpa, nb_blocks, false);
 }
 
 static void virtio_mem_resize_usable_region(VirtIOMEM *vmem,
@@ -646,6 +724,11 @@ static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq)
     struct virtio_mem_req req;
     uint16_t type;
 
+    /* The requests are picked up when the current one completes */
+    if (vmem->request_inflight) {
+        return;
+    }
+
     while (true) {
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
@@ -673,10 +756,14 @@ static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq)
         type = le16_to_cpu(req.type);
         switch (type) {
         case VIRTIO_MEM_REQ_PLUG:
-            virtio_mem_plug_request(vmem, elem, &req);
+            if (virtio_mem_plug_request(vmem, elem, &req)) {
+                return;
+            }
             break;
         case VIRTIO_MEM_REQ_UNPLUG:
-            virtio_mem_unplug_request(vmem, elem, &req);
+            if (virtio_mem_unplug_request(vmem, elem, &req)) {
+                return;
+            }
             break;
         case VIRTIO_MEM_REQ_UNPLUG_ALL:
             virtio_mem_unplug_all_request(vmem, elem);
@@ -696,6 +783,22 @@ static void virtio_mem_handle_request(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+static void virtio_mem_set_status(VirtIODevice *vdev, uint8_t status)
+{
+    VirtIOMEM *vmem = VIRTIO_MEM(vdev);
+
+    if (!status || !vdev->vm_running) {
+        /*
+         * Respond to the request before the device is reset or the state
+         * is saved
+         */
+        virtio_mem_request_drain(vmem);
+    } else if (status & VIRTIO_CONFIG_S_DRIVER_OK) {
+        /* Pick up the requests that arrived while the VM was stopped */
+        virtio_mem_handle_request(vdev, vmem->vq);
+    }
+}
+
 static void virtio_mem_get_config(VirtIODevice *vdev, uint8_t *config_data)
 {
     VirtIOMEM *vmem = VIRTIO_MEM(vdev);
@@ -746,6 +849,7 @@ static void virtio_mem_system_reset(void *opaque)
      * region size. This is, however, not possible in all scenarios. Then,
      * the guest has to deal with this manually (VIRTIO_MEM_REQ_UNPLUG_ALL).
      */
+    virtio_mem_request_drain(vmem);
     virtio_mem_unplug_all(vmem);
 }
 
@@ -889,6 +993,7 @@ static void virtio_mem_device_unrealize(DeviceState *dev)
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
     VirtIOMEM *vmem = VIRTIO_MEM(dev);
 
+    virtio_mem_request_drain(vmem);
     /*
      * The unplug handler unmapped the memory region, it cannot be
      * found via an address space anymore. Unset ourselves.
@@ -1349,6 +1454,7 @@ static void virtio_mem_class_init(ObjectClass *klass, void *data)
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
     vdc->realize = virtio_mem_device_realize;
     vdc->unrealize = virtio_mem_device_unrealize;
+    vdc->set_status = virtio_mem_set_status;
     vdc->get_config = virtio_mem_get_config;
     vdc->get_features = virtio_mem_get_features;
     vdc->validate_features = virtio_mem_validate_features;
@@ -40,6 +40,9 @@ static Property virtio_scsi_pci_properties[] = {
                     VIRTIO_PCI_FLAG_USE_IOEVENTFD_BIT, true),
     DEFINE_PROP_UINT32("vectors", VirtIOPCIProxy, nvectors,
                        DEV_NVECTORS_UNSPECIFIED),
+    DEFINE_PROP_ARRAY("iothreads", VirtIOSCSIPCI,
+                      vdev.parent_obj.conf.num_iothreads,
+                      vdev.parent_obj.conf.iothreads, qdev_prop_string, char *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "cpu.h"
 #include "trace.h"
 #include "qemu/error-report.h"
@@ -22,6 +23,7 @@
 #include "hw/virtio/virtio.h"
 #include "migration/qemu-file-types.h"
 #include "qemu/atomic.h"
+#include "qemu/stats64.h"
 #include "hw/virtio/virtio-bus.h"
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio-access.h"
@@ -71,6 +73,16 @@ typedef struct VRingUsed
     VRingUsedElem ring[];
 } VRingUsed;
 
+/*
+ * Elements with at most this many in and out buffers come from the free
+ * element cache of their VirtQueue
+ */
+#define VIRTQUEUE_ELEMENT_CACHE_SG 16
+
+typedef struct VirtQueueFreeElement {
+    QSLIST_ENTRY(VirtQueueFreeElement) next;
+} VirtQueueFreeElement;
+
 typedef struct VRingMemoryRegionCaches {
     struct rcu_head rcu;
     MemoryRegionCache desc;
@@ -130,6 +142,23 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /* Interrupt coalescing, see virtio_queue_set_coalescing() */
+    QEMUTimer *coalesce_timer;
+    int64_t coalesce_ns;
+    uint32_t coalesce_frames;
+    uint32_t coalesce_pending;
+    bool coalesce_irqfd;
+    int64_t last_irq;
+    Stat64 notify_requests;
+    Stat64 notify_irqs;
+    Stat64 notify_deferred;
+
+    /* Freed elements, see virtqueue_element_free() */
+    QSLIST_HEAD(, VirtQueueFreeElement) free_elems;
+    unsigned int nr_free_elems;
+    size_t free_elem_sz;        /* Element size requested by the device */
+    size_t free_elem_size;      /* Allocated size of cached elements */
 };
 
 /* Called within call_rcu().  */
@@ -684,6 +713,10 @@ static void virtqueue_unmap_sg(VirtQueue *vq, const VirtQueueElement *elem,
                          elem->out_sg[i].iov_len);
 }
 
+static void virtqueue_in_order_fill(VirtQueue *vq,
+                                    const VirtQueueElement *elem,
+                                    unsigned int len);
+
 /* virtqueue_detach_element:
  * @vq: The #VirtQueue
  * @elem: The #VirtQueueElement
@@ -692,12 +725,20 @@ static void virtqueue_unmap_sg(VirtQueue *vq, const VirtQueueElement *elem,
  * Detach the element from the virtqueue.  This function is suitable for device
  * reset or other situations where a #VirtQueueElement is simply freed and will
  * not be pushed or discarded.
+ *
+ * With VIRTIO_F_IN_ORDER the element still holds its ring position, so it is
+ * completed with nothing written instead, and given back by the next flush.
  */
 void virtqueue_detach_element(VirtQueue *vq, const VirtQueueElement *elem,
                               unsigned int len)
 {
-    vq->inuse -= elem->ndescs;
     virtqueue_unmap_sg(vq, elem, len);
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER) &&
+        !virtio_device_disabled(vq->vdev)) {
+        virtqueue_in_order_fill(vq, elem, 0);
+        return;
+    }
+    vq->inuse -= elem->ndescs;
 }
 
 static void virtqueue_split_rewind(VirtQueue *vq, unsigned int num)
@@ -733,7 +774,9 @@ void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
         virtqueue_split_rewind(vq, 1);
     }
 
-    virtqueue_detach_element(vq, elem, len);
+    /* The next pop records the element again, even with VIRTIO_F_IN_ORDER */
+    vq->inuse -= elem->ndescs;
+    virtqueue_unmap_sg(vq, elem, len);
 }
 
 /* virtqueue_rewind:
@@ -825,6 +868,105 @@ static void virtqueue_packed_fill_desc(VirtQueue *vq,
     vring_packed_desc_write(vq->vdev, &desc, &caches->desc, head, strict_order);
 }
 
+/*
+ * With VIRTIO_F_IN_ORDER, buffers must be used in the order they were made
+ * available, but devices still complete them in any order.  used_elems is
+ * then indexed by ring position: popping an element records it at the
+ * position where its avail entry (split ring) or first descriptor (packed
+ * ring) was, filling it marks it complete, and flushing publishes the
+ * completed elements at the head of the ring.
+ */
+static void virtqueue_in_order_record(VirtQueue *vq, unsigned int pos,
+                                      unsigned int index, unsigned int ndescs)
+{
+    vq->used_elems[pos].index = index;
+    vq->used_elems[pos].ndescs = ndescs;
+    vq->used_elems[pos].in_order_filled = false;
+}
+
+static unsigned int virtqueue_in_order_head(VirtQueue *vq)
+{
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return vq->used_idx;
+    }
+    return vq->used_idx % vq->vring.num;
+}
+
+static void virtqueue_in_order_fill(VirtQueue *vq,
+                                    const VirtQueueElement *elem,
+                                    unsigned int len)
+{
+    unsigned int pos = virtqueue_in_order_head(vq);
+    unsigned int remaining = vq->inuse;
+
+    /* The element is normally close to the head, as requests are FIFO */
+    while (remaining) {
+        VirtQueueElement *e = &vq->used_elems[pos];
+
+        if (e->index == elem->index && !e->in_order_filled) {
+            e->len = len;
+            e->in_order_filled = true;
+            return;
+        }
+        if (e->ndescs == 0 || e->ndescs > remaining) {
+            break;
+        }
+        remaining -= e->ndescs;
+        pos += e->ndescs;
+        if (pos >= vq->vring.num) {
+            pos -= vq->vring.num;
+        }
+    }
+    virtio_error(vq->vdev, "Completed buffer %u is not in flight",
+                 elem->index);
+}
+
+/*
+ * Rebuilds the in-order records of the elements in flight after migration
+ * from the rings, which the driver does not touch until they are used.
+ * Called within rcu_read_lock().
+ */
+static void virtqueue_in_order_load(VirtQueue *vq)
+{
+    VRingMemoryRegionCaches *caches;
+    VRingPackedDesc desc;
+    unsigned int pos, n, inflight;
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        for (n = 0; n < vq->inuse; n++) {
+            pos = (uint16_t)(vq->used_idx + n) % vq->vring.num;
+            virtqueue_in_order_record(vq, pos, vring_avail_ring(vq, pos), 1);
+        }
+        return;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        return;
+    }
+
+    pos = vq->used_idx;
+    for (inflight = 0; inflight < vq->inuse; inflight += n) {
+        unsigned int start = pos;
+        uint16_t id;
+
+        vring_packed_desc_read(vq->vdev, &desc, &caches->desc, pos, false);
+        id = desc.id;
+        n = 1;
+        while (desc.flags & VRING_DESC_F_NEXT && n < vq->vring.num) {
+            if (++pos >= vq->vring.num) {
+                pos = 0;
+            }
+            vring_packed_desc_read(vq->vdev, &desc, &caches->desc, pos, false);
+            n++;
+        }
+        if (++pos >= vq->vring.num) {
+            pos = 0;
+        }
+        virtqueue_in_order_record(vq, start, id, n);
+    }
+}
+
 /* Called within rcu_read_lock().  */
 void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
                     unsigned int len, unsigned int idx)
@@ -837,7 +979,9 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
         return;
     }
 
-    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
+        virtqueue_in_order_fill(vq, elem, len);
+    } else if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         virtqueue_packed_fill(vq, elem, len, idx);
     } else {
         virtqueue_split_fill(vq, elem, len, idx);
@@ -888,6 +1032,120 @@ static void virtqueue_packed_flush(VirtQueue *vq, unsigned int count)
     }
 }
 
+/*
+ * Returns true if the used entry for used_elems[@pos] can be left out.  The
+ * driver learns from the next written entry that all buffers before it have
+ * been used, so this only loses the length; the element must therefore have
+ * a zero length and be followed by another completed one in this flush.
+ */
+static bool virtqueue_in_order_skip(VirtQueue *vq, unsigned int pos,
+                                    unsigned int next, unsigned int remaining)
+{
+    return vq->used_elems[pos].len == 0 &&
+           remaining > vq->used_elems[pos].ndescs &&
+           vq->used_elems[next].in_order_filled;
+}
+
+/* Called within rcu_read_lock().  */
+static void virtqueue_split_flush_in_order(VirtQueue *vq)
+{
+    unsigned int count = 0, batch = 0;
+    VRingUsedElem uelem;
+
+    if (unlikely(!vq->vring.used)) {
+        return;
+    }
+
+    while (count < vq->inuse) {
+        unsigned int pos = (vq->used_idx + count) % vq->vring.num;
+        unsigned int next = (pos + 1) % vq->vring.num;
+        VirtQueueElement *e = &vq->used_elems[pos];
+
+        if (!e->in_order_filled) {
+            break;
+        }
+        e->in_order_filled = false;
+        count++;
+        if (virtqueue_in_order_skip(vq, pos, next, vq->inuse - count + 1)) {
+            continue;
+        }
+
+        /* One entry at the start of the batch, for its last buffer */
+        uelem.id = e->index;
+        uelem.len = e->len;
+        vring_used_write(vq, &uelem,
+                         (vq->used_idx + batch) % vq->vring.num);
+        batch = count;
+    }
+
+    if (count) {
+        virtqueue_split_flush(vq, count);
+    }
+}
+
+static void virtqueue_packed_flush_in_order(VirtQueue *vq)
+{
+    unsigned int ndescs = 0, batch = 0;
+    VirtQueueElement first = {};
+    bool have_first = false;
+
+    if (unlikely(!vq->vring.desc)) {
+        return;
+    }
+
+    while (ndescs < vq->inuse) {
+        unsigned int pos = vq->used_idx + ndescs;
+        unsigned int next;
+        VirtQueueElement *e;
+
+        if (pos >= vq->vring.num) {
+            pos -= vq->vring.num;
+        }
+        e = &vq->used_elems[pos];
+        if (!e->in_order_filled || e->ndescs == 0) {
+            break;
+        }
+        e->in_order_filled = false;
+        next = pos + e->ndescs;
+        if (next >= vq->vring.num) {
+            next -= vq->vring.num;
+        }
+        if (virtqueue_in_order_skip(vq, pos, next, vq->inuse - ndescs)) {
+            ndescs += e->ndescs;
+            continue;
+        }
+        ndescs += e->ndescs;
+
+        /*
+         * One descriptor at the start of the batch, for its last buffer.
+         * The first batch is written last, so that the driver sees the
+         * others as soon as it sees the head of the ring become used.
+         */
+        if (batch == 0) {
+            first.index = e->index;
+            first.len = e->len;
+            have_first = true;
+        } else {
+            VirtQueueElement used = { .index = e->index, .len = e->len };
+
+            virtqueue_packed_fill_desc(vq, &used, batch, false);
+        }
+        batch = ndescs;
+    }
+
+    if (have_first) {
+        virtqueue_packed_fill_desc(vq, &first, 0, true);
+    }
+
+    vq->inuse -= ndescs;
+    vq->used_idx += ndescs;
+    if (vq->used_idx >= vq->vring.num) {
+        vq->used_idx -= vq->vring.num;
+        vq->used_wrap_counter ^= 1;
+        vq->signalled_used_valid = false;
+    }
+}
+
 void virtqueue_flush(VirtQueue *vq, unsigned int count)
 {
     if (virtio_device_disabled(vq->vdev)) {
@@ -895,7 +1153,13 @@ void virtqueue_flush(VirtQueue *vq, unsigned int count)
         return;
     }
 
-    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_IN_ORDER)) {
+        if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+            virtqueue_packed_flush_in_order(vq);
+        } else {
+            virtqueue_split_flush_in_order(vq);
+        }
+    } else if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         virtqueue_packed_flush(vq, count);
     } else {
         virtqueue_split_flush(vq, count);
@@ -910,6 +1174,26 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     virtqueue_flush(vq, 1);
 }
 
+/*
+ * Like virtqueue_push() for each of the @n elements in @elems, with the
+ * lengths in @lens, but publishes the used index only once.
+ */
+void virtqueue_push_batch(VirtQueue *vq, VirtQueueElement * const *elems,
+                          const unsigned int *lens, unsigned int n)
+{
+    unsigned int i;
+
+    if (!n) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < n; i++) {
+        virtqueue_fill(vq, elems[i], lens[i], i);
+    }
+    virtqueue_flush(vq, n);
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -1376,19 +1660,68 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
                                                                         false);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+static void virtqueue_free_elem_cache(VirtQueue *vq)
 {
-    VirtQueueElement *elem;
+    VirtQueueFreeElement *e;
+
+    while ((e = QSLIST_FIRST(&vq->free_elems))) {
+        QSLIST_REMOVE_HEAD(&vq->free_elems, next);
+        g_free(e);
+    }
+    vq->nr_free_elems = 0;
+}
+
+/*
+ * Returns a cached element of size @sz with room for
+ * VIRTQUEUE_ELEMENT_CACHE_SG in and out buffers, or NULL if there is none.
+ * *@alloc_size is set to the size that such elements are allocated with.
+ */
+static void *virtqueue_get_cached_element(VirtQueue *vq, size_t sz,
+                                          size_t *alloc_size)
+{
+    VirtQueueFreeElement *e;
+
+    if (sz != vq->free_elem_sz) {
+        virtqueue_free_elem_cache(vq);
+        vq->free_elem_sz = sz;
+        vq->free_elem_size =
+            QEMU_ALIGN_UP(QEMU_ALIGN_UP(sz, __alignof__(hwaddr)) +
+                          2 * VIRTQUEUE_ELEMENT_CACHE_SG * sizeof(hwaddr),
+                          __alignof__(struct iovec)) +
+            2 * VIRTQUEUE_ELEMENT_CACHE_SG * sizeof(struct iovec);
+    }
+
+    *alloc_size = vq->free_elem_size;
+    e = QSLIST_FIRST(&vq->free_elems);
+    if (e) {
+        QSLIST_REMOVE_HEAD(&vq->free_elems, next);
+        vq->nr_free_elems--;
+    }
+    return e;
+}
+
+static void *virtqueue_alloc_element(VirtQueue *vq, size_t sz,
+                                     unsigned out_num, unsigned in_num)
+{
+    VirtQueueElement *elem = NULL;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
     size_t out_addr_ofs = in_addr_ofs + in_num * sizeof(elem->in_addr[0]);
     size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
     size_t in_sg_ofs = QEMU_ALIGN_UP(out_addr_end, __alignof__(elem->in_sg[0]));
     size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
     size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
+    size_t alloc_size = out_sg_end;
 
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    if (vq && out_num <= VIRTQUEUE_ELEMENT_CACHE_SG &&
+        in_num <= VIRTQUEUE_ELEMENT_CACHE_SG) {
+        elem = virtqueue_get_cached_element(vq, sz, &alloc_size);
+    }
+    if (!elem) {
+        elem = g_malloc(alloc_size);
+    }
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
+    elem->alloc_size = alloc_size;
     elem->out_num = out_num;
     elem->in_num = in_num;
     elem->in_addr = (void *)elem + in_addr_ofs;
@@ -1398,7 +1731,8 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz,
+                                 bool set_avail_event)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -1435,7 +1769,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+    if (set_avail_event &&
+        virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
         vring_set_avail_event(vq, vq->last_avail_idx);
     }
 
@@ -1510,9 +1845,13 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     elem->index = head;
     elem->ndescs = 1;
+    if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+        virtqueue_in_order_record(vq, (uint16_t)(vq->last_avail_idx - 1) %
+                                      vq->vring.num, head, 1);
+    }
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1636,7 +1975,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1648,6 +1987,9 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 
     elem->index = id;
     elem->ndescs = (desc_cache == &indirect_desc_cache) ? 1 : elem_entries;
+    if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+        virtqueue_in_order_record(vq, vq->last_avail_idx, id, elem->ndescs);
+    }
     vq->last_avail_idx += elem->ndescs;
     vq->inuse += elem->ndescs;
 
@@ -1679,10 +2021,66 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         return virtqueue_packed_pop(vq, sz);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        return virtqueue_split_pop(vq, sz, true);
     }
 }
 
+/*
+ * Pops up to @max elements of size @sz into @elems and returns how many
+ * were popped.  Compared to calling virtqueue_pop() in a loop, this takes
+ * the RCU read lock once and, for split rings, writes the avail event
+ * index once for the whole batch.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    bool packed = virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED);
+    unsigned int n;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (n = 0; n < max; n++) {
+        elems[n] = packed ? virtqueue_packed_pop(vq, sz)
+                          : virtqueue_split_pop(vq, sz, false);
+        if (!elems[n]) {
+            break;
+        }
+    }
+
+    if (!packed && n &&
+        virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return n;
+}
+
+/*
+ * Frees an element returned by virtqueue_pop() or virtqueue_pop_batch() on
+ * @vq, or by qemu_get_virtqueue_element().  Instead of going back to the
+ * heap, up to one queue size worth of elements is kept for reuse by the
+ * next pops.  Must be called from the context that pops from @vq.
+ */
+void virtqueue_element_free(VirtQueue *vq, void *elem)
+{
+    VirtQueueElement *e = elem;
+    VirtQueueFreeElement *free_elem = elem;
+
+    if (!elem) {
+        return;
+    }
+
+    if (e->alloc_size == vq->free_elem_size &&
+        vq->nr_free_elems < vq->vring.num) {
+        QSLIST_INSERT_HEAD(&vq->free_elems, free_elem, next);
+        vq->nr_free_elems++;
+        return;
+    }
+    g_free(elem);
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -1720,6 +2118,11 @@ static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
                                                vq->vring.num, &idx, false)) {
             ++elem.ndescs;
         }
+        if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+            virtqueue_in_order_record(vq, vq->last_avail_idx, elem.index,
+                                      elem.ndescs);
+            vq->inuse += elem.ndescs;
+        }
         /*
          * immediately push the element, nothing to unmap
          * as both in_num and out_num are set to 0.
@@ -1750,6 +2153,10 @@ static unsigned int virtqueue_split_drop_all(VirtQueue *vq)
         if (!virtqueue_get_head(vq, vq->last_avail_idx, &elem.index)) {
             break;
         }
+        if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+            virtqueue_in_order_record(vq, vq->last_avail_idx % vq->vring.num,
+                                      elem.index, 1);
+        }
         vq->inuse++;
         vq->last_avail_idx++;
         if (fEventIdx) {
@@ -1818,7 +2225,7 @@ void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz)
     assert(ARRAY_SIZE(data.in_addr) >= data.in_num);
     assert(ARRAY_SIZE(data.out_addr) >= data.out_num);
 
-    elem = virtqueue_alloc_element(sz, data.out_num, data.in_num);
+    elem = virtqueue_alloc_element(NULL, sz, data.out_num, data.in_num);
     elem->index = data.index;
 
     for (i = 0; i < elem->in_num; i++) {
@@ -2015,6 +2422,10 @@ void virtio_reset(void *opaque)
         vdev->vq[i].notification = true;
         vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
         vdev->vq[i].inuse = 0;
+        if (vdev->vq[i].coalesce_timer) {
+            timer_del(vdev->vq[i].coalesce_timer);
+            vdev->vq[i].coalesce_pending = 0;
+        }
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
 }
@@ -2393,6 +2804,10 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    virtqueue_free_elem_cache(vq);
+    timer_free(vq->coalesce_timer);
+    vq->coalesce_timer = NULL;
+    vq->coalesce_pending = 0;
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -2494,14 +2909,33 @@ static bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
-void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_irq(VirtQueue *vq)
 {
+    virtio_set_isr(vq->vdev, 0x1);
+    virtio_notify_vector(vq->vdev, vq->vector);
+}
+
+static void virtio_queue_notify_now(VirtQueue *vq, bool irqfd)
+{
+    VirtIODevice *vdev = vq->vdev;
+
     WITH_RCU_READ_LOCK_GUARD() {
         if (!virtio_should_notify(vdev, vq)) {
             return;
         }
     }
 
+    stat64_inc(&vq->notify_irqs);
+    if (vq->coalesce_timer) {
+        vq->last_irq = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+
+    if (!irqfd) {
+        trace_virtio_notify(vdev, vq);
+        virtio_irq(vq);
+        return;
+    }
+
     trace_virtio_notify_irqfd(vdev, vq);
 
     /*
@@ -2523,22 +2957,97 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
     event_notifier_set(&vq->guest_notifier);
 }
 
-static void virtio_irq(VirtQueue *vq)
+static void virtio_queue_coalesce_timer_cb(void *opaque)
 {
-    virtio_set_isr(vq->vdev, 0x1);
-    virtio_notify_vector(vq->vdev, vq->vector);
+    VirtQueue *vq = opaque;
+
+    vq->coalesce_pending = 0;
+    virtio_queue_notify_now(vq, vq->coalesce_irqfd);
 }
 
-void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
+/*
+ * Returns true if the interrupt for @vq is deferred by coalescing.
+ *
+ * As long as interrupts are at least coalesce_ns apart, they are injected
+ * right away, so a lightly loaded queue sees no added latency.  Faster
+ * completions are collected until coalesce_ns after the previous interrupt,
+ * or until coalesce_frames of them are pending.  The delay thus follows the
+ * completion rate, up to the configured maximum.
+ */
+static bool virtio_queue_coalesce(VirtQueue *vq, bool irqfd)
 {
-    WITH_RCU_READ_LOCK_GUARD() {
-        if (!virtio_should_notify(vdev, vq)) {
-            return;
+    int64_t deadline;
+
+    if (!vq->coalesce_timer) {
+        return false;
+    }
+
+    vq->coalesce_irqfd = irqfd;
+    if (vq->coalesce_pending) {
+        if (vq->coalesce_frames &&
+            ++vq->coalesce_pending >= vq->coalesce_frames) {
+            timer_del(vq->coalesce_timer);
+            vq->coalesce_pending = 0;
+            return false;
         }
+        stat64_inc(&vq->notify_deferred);
+        return true;
+    }
+
+    deadline = vq->last_irq + vq->coalesce_ns;
+    if (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) >= deadline) {
+        return false;
     }
 
-    trace_virtio_notify(vdev, vq);
-    virtio_irq(vq);
+    trace_virtio_queue_coalesce(vq->vdev, vq, deadline);
+    vq->coalesce_pending = 1;
+    timer_mod(vq->coalesce_timer, deadline);
+    stat64_inc(&vq->notify_deferred);
+    return true;
+}
+
+/*
+ * Enables interrupt coalescing for @vq: interrupts are delayed by at most
+ * @usecs microseconds, or until @frames completions are pending if @frames
+ * is not zero.  A @usecs value of zero disables coalescing.  The timer runs
+ * in @ctx, which must be the context that notifies @vq.  Any interrupt that
+ * is still pending is injected before the settings change.
+ */
+void virtio_queue_set_coalescing(VirtQueue *vq, AioContext *ctx,
+                                 uint32_t usecs, uint32_t frames)
+{
+    if (vq->coalesce_timer) {
+        timer_free(vq->coalesce_timer);
+        vq->coalesce_timer = NULL;
+        if (vq->coalesce_pending) {
+            vq->coalesce_pending = 0;
+            virtio_queue_notify_now(vq, vq->coalesce_irqfd);
+        }
+    }
+
+    if (usecs) {
+        vq->coalesce_ns = usecs * SCALE_US;
+        vq->coalesce_frames = frames;
+        vq->coalesce_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_NS,
+                                           virtio_queue_coalesce_timer_cb,
+                                           vq);
+    }
+}
+
+void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
+{
+    stat64_inc(&vq->notify_requests);
+    if (!virtio_queue_coalesce(vq, true)) {
+        virtio_queue_notify_now(vq, true);
+    }
+}
+
+void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
+{
+    stat64_inc(&vq->notify_requests);
+    if (!virtio_queue_coalesce(vq, false)) {
+        virtio_queue_notify_now(vq, false);
+    }
 }
 
 void virtio_notify_config(VirtIODevice *vdev)
@@ -3124,6 +3633,9 @@ int virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
                 vdev->vq[i].shadow_avail_idx = vdev->vq[i].last_avail_idx;
                 vdev->vq[i].shadow_avail_wrap_counter =
                                         vdev->vq[i].last_avail_wrap_counter;
+                if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+                    virtqueue_in_order_load(&vdev->vq[i]);
+                }
                 continue;
             }
 
@@ -3159,6 +3671,9 @@ int virtio_load(VirtIODevice *vdev, QEMUFile *f, int version_id)
                              vdev->vq[i].used_idx);
                 return -1;
             }
+            if (virtio_vdev_has_feature(vdev, VIRTIO_F_IN_ORDER)) {
+                virtqueue_in_order_load(&vdev->vq[i]);
+            }
         }
     }
 
@@ -3183,6 +3698,7 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
     bool backend_run = running && virtio_device_started(vdev, vdev->status);
+    int i;
     vdev->vm_running = running;
 
     if (backend_run) {
@@ -3193,6 +3709,21 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
         k->vmstate_change(qbus->parent, backend_run);
     }
 
+    /*
+     * The coalescing timers run on the realtime clock.  Inject what they
+     * hold back now, through the main loop since dataplane has stopped,
+     * rather than while the VM is stopped or after its state was saved.
+     */
+    for (i = 0; !running && i < VIRTIO_QUEUE_MAX; i++) {
+        VirtQueue *vq = &vdev->vq[i];
+
+        if (vq->coalesce_pending) {
+            timer_del(vq->coalesce_timer);
+            vq->coalesce_pending = 0;
+            virtio_queue_notify_now(vq, false);
+        }
+    }
+
     if (!backend_run) {
         virtio_set_status(vdev, vdev->status);
     }
@@ -3666,6 +4197,8 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
         if (vdev->vq[i].vring.num == 0) {
             break;
         }
+        virtqueue_free_elem_cache(&vdev->vq[i]);
+        timer_free(vdev->vq[i].coalesce_timer);
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
     g_free(vdev->vq);
@@ -3810,6 +4343,24 @@ void virtio_device_release_ioeventfd(VirtIODevice *vdev)
     virtio_bus_release_ioeventfd(vbus);
 }
 
+static void virtio_device_get_notify_stat(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(obj);
+    size_t offset = (uintptr_t)opaque;
+    uint64_t value = 0;
+    int i;
+
+    for (i = 0; vdev->vq && i < VIRTIO_QUEUE_MAX; i++) {
+        if (vdev->vq[i].vring.num == 0) {
+            break;
+        }
+        value += stat64_get((Stat64 *)((void *)&vdev->vq[i] + offset));
+    }
+    visit_type_uint64(v, name, &value, errp);
+}
+
 static void virtio_device_class_init(ObjectClass *klass, void *data)
 {
     /* Set the default value here. */
@@ -3824,6 +4375,17 @@ static void virtio_device_class_init(ObjectClass *klass, void *data)
     vdc->stop_ioeventfd = virtio_device_stop_ioeventfd_impl;
 
     vdc->legacy_features |= VIRTIO_LEGACY_FEATURES;
+
+    /* Interrupt statistics, summed over all virtqueues */
+    object_class_property_add(klass, "x-notify-requests", "uint64",
+                              virtio_device_get_notify_stat, NULL, NULL,
+                              (void *)offsetof(VirtQueue, notify_requests));
+    object_class_property_add(klass, "x-notify-irqs", "uint64",
+                              virtio_device_get_notify_stat, NULL, NULL,
+                              (void *)offsetof(VirtQueue, notify_irqs));
+    object_class_property_add(klass, "x-notify-deferred", "uint64",
+                              virtio_device_get_notify_stat, NULL, NULL,
+                              (void *)offsetof(VirtQueue, notify_deferred));
 }
 
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev)
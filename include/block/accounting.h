@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-builtin-types.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -78,6 +79,21 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * Log-linear latency histogram, as used for block nodes.  Latencies below
+ * 2^BLOCK_LOG_HISTOGRAM_SUB_BITS ns get a bin each; above that, every power
+ * of two is split into 2^BLOCK_LOG_HISTOGRAM_SUB_BITS bins of equal width,
+ * so that the relative error stays below 1 / 2^BLOCK_LOG_HISTOGRAM_SUB_BITS
+ * for any latency.
+ */
+#define BLOCK_LOG_HISTOGRAM_SUB_BITS 3
+#define BLOCK_LOG_HISTOGRAM_BINS \
+    ((64 - BLOCK_LOG_HISTOGRAM_SUB_BITS + 1) << BLOCK_LOG_HISTOGRAM_SUB_BITS)
+
+typedef struct BlockLatencyLogHistogram {
+    Stat64 bins[BLOCK_MAX_IOTYPE][BLOCK_LOG_HISTOGRAM_BINS];
+} BlockLatencyLogHistogram;
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -119,5 +135,10 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+int64_t block_latency_log_histogram_start(void);
+void block_latency_log_histogram_account(BlockLatencyLogHistogram *hist,
+                                         enum BlockAcctType type,
+                                         int64_t start_time_ns);
+uint64_t block_latency_log_histogram_bin_start(int bin);
 
 #endif
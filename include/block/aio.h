@@ -121,6 +121,20 @@ struct BHListSlice {
 
 typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * A request submitted on the io_uring of an AioContext, see aio_get_sqe().
+ * @cb is called from aio_poll() once the request has completed, with @res
+ * set to the result of the request.
+ */
+typedef struct AioUringRequest AioUringRequest;
+struct AioUringRequest {
+    void (*cb)(AioUringRequest *req);
+    int res;
+    QSIMPLEQ_ENTRY(AioUringRequest) next;
+};
+#endif
+
 struct AioContext {
     GSource source;
 
@@ -214,6 +228,12 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+
+    /* Handlers of external clients that fired while those were disabled */
+    AioHandlerList parked_list;
+
+    /* Completed requests of aio_get_sqe() users, dispatched by aio_poll() */
+    QSIMPLEQ_HEAD(, AioUringRequest) completed_requests;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -226,8 +246,7 @@ struct AioContext {
     /* Number of AioHandlers without .io_poll() */
     int poll_disable_cnt;
 
-    /* Polling mode parameters */
-    int64_t poll_ns;        /* current polling time in nanoseconds */
+    /* Polling mode parameters, the polling time is tracked per AioHandler */
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
@@ -522,6 +541,42 @@ struct LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 struct LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+#ifdef CONFIG_LINUX_IO_URING
+/**
+ * aio_has_io_uring: Is file descriptor monitoring using io_uring?
+ * @ctx: the aio context
+ *
+ * Returns true if @ctx monitors file descriptors with an io_uring, that
+ * aio_get_sqe() can be used to submit requests on.
+ */
+bool aio_has_io_uring(AioContext *ctx);
+
+/**
+ * aio_get_sqe: Get an sqe on the io_uring of an AioContext
+ * @ctx: the aio context, which must be the current one
+ * @req: the request which the sqe is submitted for
+ *
+ * Returns an sqe that the caller must prepare and then pass to
+ * aio_sqe_set_request(), or %NULL if the submission queue is full.  The
+ * request is submitted by the next aio_poll(), together with the file
+ * descriptor monitoring requests and in the same system call that waits
+ * for completions, and @req->cb is called from aio_poll() when it
+ * completes.  May only be used if aio_has_io_uring() returns true.
+ */
+struct io_uring_sqe *aio_get_sqe(AioContext *ctx);
+
+/**
+ * aio_sqe_set_request: Associate an sqe with a request
+ * @sqe: an sqe prepared for @req, possibly copied from one returned by
+ *       aio_get_sqe()
+ * @req: the request whose @cb is called when @sqe completes
+ *
+ * Must be called after the sqe has been prepared, since preparing it resets
+ * its user data.
+ */
+void aio_sqe_set_request(struct io_uring_sqe *sqe, AioUringRequest *req);
+#endif
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
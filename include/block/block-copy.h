@@ -51,10 +51,15 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
  * must be > 0.
  *
  * @max_chunk means maximum length for one IO operation. Zero means unlimited.
+ *
+ * If @adaptive is true, the number of parallel coroutines and the length of
+ * IO operations start low and are tuned from the observed throughput and
+ * latency, within the @max_workers and @max_chunk limits.
  */
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque);
 
@@ -36,6 +36,11 @@ typedef struct BlockDriverInfo {
      * True if this block driver only supports compressed writes
      */
     bool needs_compressed_writes;
+    /*
+     * True if compressed writes are laid out in the order in which they
+     * were submitted, even if they complete out of order
+     */
+    bool ordered_compressed_writes;
 } BlockDriverInfo;
 
 typedef struct BlockFragInfo {
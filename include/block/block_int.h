@@ -92,6 +92,9 @@ typedef struct BdrvTrackedRequest {
     CoQueue wait_queue; /* coroutines blocked on this request */
 
     struct BdrvTrackedRequest *waiting_for;
+
+    /* Coroutine profiler tags of the parent request */
+    const char *prof_tag;
 } BdrvTrackedRequest;
 
 int bdrv_check_qiov_request(int64_t offset, int64_t bytes,
@@ -1008,6 +1011,12 @@ struct BlockDriverState {
     /* Offset after the highest byte written to */
     Stat64 wr_highest_offset;
 
+    /*
+     * Latencies of the requests to this node, or NULL if they are not
+     * accounted.  Only changed in a drained section, accessed with atomic ops.
+     */
+    BlockLatencyLogHistogram *latency_log_histogram;
+
     /* If true, copy read backing sectors into image.  Can be >1 if more
      * than one client has requested copy-on-read.  Accessed with atomic
      * ops.
@@ -1050,6 +1059,14 @@ struct BlockDriverState {
     CoMutex bsc_modify_lock;
     /* Always non-NULL, but must only be dereferenced under an RCU read guard */
     BdrvBlockStatusCache *block_status_cache;
+
+    /*
+     * Depths at which ranges are allocated in a deep backing chain below
+     * this node, see bdrv_co_common_block_status_above().  Protected by
+     * chain_cache_lock.
+     */
+    CoMutex chain_cache_lock;
+    GArray *chain_cache;
 };
 
 struct BlockBackendRootState {
@@ -1498,4 +1515,12 @@ void bdrv_bsc_invalidate_range(BlockDriverState *bs,
  */
 void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes);
 
+/**
+ * Returns a counter that is incremented on every change of the block
+ * graph, and whenever nodes may have changed behind QEMU's back.  Cached
+ * block status information about a backing chain must be dropped when it
+ * changes.
+ */
+unsigned int bdrv_get_graph_gen(void);
+
 #endif /* BLOCK_INT_H */
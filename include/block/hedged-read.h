@@ -0,0 +1,56 @@
+/*
+ * Reads sent to several children, completed by the first that succeeds
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BLOCK_HEDGED_READ_H
+#define BLOCK_HEDGED_READ_H
+
+#include "block/block.h"
+
+/*
+ * A read request of a node that may be sent to several of its children, for
+ * example because the first child is slow to answer.  The child reads use
+ * their own buffers and may finish after the request has been completed;
+ * each one holds an in-flight reference on the node, so that draining the
+ * node still waits for it.
+ */
+typedef struct HedgedRead HedgedRead;
+
+/*
+ * Called when a child read finishes, with its result and, if it succeeded,
+ * the time it took.  The request may already have been completed.
+ */
+typedef void HedgedReadDoneFunc(BlockDriverState *bs, BdrvChild *child,
+                                int64_t offset, int64_t bytes, int ret,
+                                int64_t latency_ns);
+
+HedgedRead *hedged_read_new(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, BdrvRequestFlags flags,
+                            HedgedReadDoneFunc *done);
+
+/* Sends the read to @child as well */
+void coroutine_fn hedged_read_start(HedgedRead *r, BdrvChild *child);
+
+/* Whether one of the child reads succeeded */
+bool hedged_read_succeeded(HedgedRead *r);
+
+/* Number of child reads that have not finished yet */
+int hedged_read_in_flight(HedgedRead *r);
+
+/*
+ * Waits until a child read finishes, or at most @timeout_ns nanoseconds if
+ * @timeout_ns is not 0.
+ */
+void coroutine_fn hedged_read_wait(HedgedRead *r, int64_t timeout_ns);
+
+/*
+ * Completes the request: copies the data of the successful child read to
+ * @qiov, or returns the error of the last failed one, and frees @r as far
+ * as child reads in flight allow.
+ */
+int hedged_read_finish(HedgedRead *r, QEMUIOVector *qiov, size_t qiov_offset);
+
+#endif /* BLOCK_HEDGED_READ_H */
@@ -62,8 +62,14 @@ void laio_io_unplug(BlockDriverState *bs, LinuxAioState *s,
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
 typedef struct LuringState LuringState;
-LuringState *luring_init(Error **errp);
+/* luring_init() flags */
+#define LURING_SQPOLL           (1 << 0) /* kernel thread polls the ring */
+#define LURING_REGISTER_BUFFERS (1 << 1) /* guest RAM as fixed buffers */
+#define LURING_SHARED_RING      (1 << 2) /* use the AioContext's io_uring */
+LuringState *luring_init(int flags, Error **errp);
 void luring_cleanup(LuringState *s);
+int luring_register_file(LuringState *s, int fd);
+void luring_unregister_file(LuringState *s);
 int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
                                 uint64_t offset, QEMUIOVector *qiov, int type);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
@@ -24,9 +24,19 @@ typedef int ThreadPoolFunc(void *opaque);
 
 typedef struct ThreadPool ThreadPool;
 
+/* Size of the bitmap passed to thread_pool_set_cpus() */
+#define THREAD_POOL_MAX_CPUS 1024
+
 ThreadPool *thread_pool_new(struct AioContext *ctx);
 void thread_pool_free(ThreadPool *pool);
 
+/*
+ * Makes worker threads that are started afterwards run on the host CPUs set
+ * in @cpus, instead of inheriting the affinity of the AioContext's thread.
+ */
+void thread_pool_set_cpus(ThreadPool *pool, const unsigned long *cpus,
+                          Error **errp);
+
 BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg,
         BlockCompletionFunc *cb, void *opaque);
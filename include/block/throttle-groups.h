@@ -49,6 +49,20 @@ typedef struct ThrottleGroupMember {
      */
     unsigned int restart_pending;
 
+    /*
+     * Operations and bytes that have already been accounted in the group's
+     * ThrottleState and that requests of this member can use without taking
+     * the ThrottleGroup lock.  The credit is only valid as long as @gen
+     * matches the group's credit generation.  These fields are only accessed
+     * from the member's AioContext.
+     */
+    struct {
+        double   units;
+        uint64_t bytes;
+        uint64_t op_size;
+        unsigned gen;
+    } credit[2];
+
     /* The following fields are protected by the ThrottleGroup lock.
      * See the ThrottleGroup documentation for details.
      * throttle_state tells us if I/O limits are configured. */
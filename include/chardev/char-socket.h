@@ -31,6 +31,7 @@
 #include "qom/object.h"
 
 #define TCP_MAX_FDS 16
+#define TCP_CHR_WBUF_SIZE 4096
 
 typedef struct {
     char buf[21];
@@ -76,6 +77,12 @@ struct SocketChardev {
     int64_t reconnect_time;
     bool connect_err_reported;
 
+    /* Small writes are coalesced for this many ms, if non-zero */
+    int64_t coalesce_ms;
+    uint8_t *wbuf;
+    size_t wbuf_len;
+    GSource *flush_timer;
+
     QIOTask *connect_task;
 };
 typedef struct SocketChardev SocketChardev;
@@ -321,4 +321,33 @@ int qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
  */
 char *qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess);
 
+/**
+ * qcrypto_tls_session_enable_ktls_tx:
+ * @sess: the TLS session object
+ * @fd: the TCP socket that carries the session
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * If the credentials of @sess ask for kernel TLS, hand
+ * the transmit half of the completed session over to
+ * the kernel: the current write keys and record sequence
+ * number are installed on @fd, after which the caller
+ * must write plain text directly to @fd and must no longer
+ * call qcrypto_tls_session_write(). Reading is still done
+ * with qcrypto_tls_session_read().
+ *
+ * This may only be called once the handshake is complete,
+ * and before any payload data has been written.
+ *
+ * Only TLS 1.2 sessions are offloaded: the transmit keys
+ * of a TLS 1.3 session can be updated at the peer's request,
+ * which the kernel cannot do, so they are left in user space.
+ *
+ * Returns: 1 if the kernel now encrypts outgoing data,
+ * 0 if kernel TLS was not requested or is not used for
+ * this session, or -1 on error
+ */
+int qcrypto_tls_session_enable_ktls_tx(QCryptoTLSSession *sess,
+                                       int fd,
+                                       Error **errp);
+
 #endif /* QCRYPTO_TLSSESSION_H */
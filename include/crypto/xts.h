@@ -29,6 +29,10 @@
 
 #define XTS_BLOCK_SIZE 16
 
+/*
+ * ECB-encrypt or decrypt @length bytes, a multiple of XTS_BLOCK_SIZE
+ * that can span several blocks.
+ */
 typedef void xts_cipher_func(const void *ctx,
                              size_t length,
                              uint8_t *dst,
@@ -76,8 +76,8 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/* use a fully associative victim tlb of 16 entries */
+#define CPU_VTLB_SIZE 16
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -163,6 +163,14 @@ typedef struct CPUTLBDesc {
      */
     target_ulong large_page_addr;
     target_ulong large_page_mask;
+    /*
+     * The range of page addresses allocated into the tlb (including the
+     * victim tlb) since the last flush of the whole tlb.  Range flushes
+     * only need to look at the part that overlaps with it.  The range is
+     * empty if used_addr_min > used_addr_max.
+     */
+    target_ulong used_addr_min;
+    target_ulong used_addr_max;
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -208,6 +216,8 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t victim_hit_count;
+    size_t fill_count;
 } CPUTLBCommon;
 
 /*
@@ -0,0 +1,85 @@
+/*
+ * MMIO doorbell regions dispatched to an AioContext
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_DOORBELL_H
+#define EXEC_DOORBELL_H
+
+#include "exec/memory.h"
+#include "qemu/event_notifier.h"
+
+/*
+ * @offset is the offset of the doorbell within the region, @value the last
+ * value written to it.
+ */
+typedef void MemoryRegionDoorbellHandler(void *opaque, hwaddr offset,
+                                         uint32_t value);
+
+typedef struct MemoryRegionDoorbell {
+    MemoryRegion mr;
+    AioContext *ctx;
+    EventNotifier notifier;
+    MemoryRegionDoorbellHandler *handler;
+    void *opaque;
+    unsigned nr;
+    uint32_t *values;
+    unsigned long *pending;
+} MemoryRegionDoorbell;
+
+/**
+ * memory_region_doorbell_init: Initialize a region of 32-bit doorbells
+ *
+ * Writes to the region neither take the BQL nor call into the device in the
+ * vCPU thread.  They only record the written value and kick @ctx, which then
+ * calls @handler for every doorbell written since the last call.  Doorbells
+ * that are written several times before @ctx runs are only reported once,
+ * with the last value, so this is only suitable for registers where the last
+ * value written supersedes the previous ones, like the queue heads and tails
+ * of most storage and network controllers.
+ *
+ * Reads return 0.  If the device has other registers whose accesses must be
+ * ordered against the doorbells, it must call memory_region_doorbell_flush()
+ * when they are accessed.
+ *
+ * @db: the #MemoryRegionDoorbell to initialize
+ * @owner: the object that owns the region
+ * @name: name of the memory region
+ * @size: size of the region in bytes, a multiple of 4
+ * @ctx: the #AioContext in which @handler runs
+ * @handler: called for each doorbell that has been written
+ * @opaque: passed to @handler
+ *
+ * Returns 0 on success, or a negative errno if the notifier could not be
+ * created.
+ */
+int memory_region_doorbell_init(MemoryRegionDoorbell *db, Object *owner,
+                                const char *name, uint64_t size,
+                                AioContext *ctx,
+                                MemoryRegionDoorbellHandler *handler,
+                                void *opaque);
+
+/**
+ * memory_region_doorbell_flush: Process pending doorbell writes
+ *
+ * Calls the handler for every doorbell that has been written but not
+ * processed yet.  Must be called from the #AioContext of @db or with the
+ * BQL held if that is the main loop context.
+ *
+ * @db: the #MemoryRegionDoorbell
+ */
+void memory_region_doorbell_flush(MemoryRegionDoorbell *db);
+
+/**
+ * memory_region_doorbell_destroy: Release the resources of a doorbell region
+ *
+ * Pending writes are dropped.  The region itself is finalized together with
+ * its owner and must not be mapped anymore.
+ *
+ * @db: the #MemoryRegionDoorbell
+ */
+void memory_region_doorbell_destroy(MemoryRegionDoorbell *db);
+
+#endif
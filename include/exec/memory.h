@@ -69,7 +69,10 @@ static inline void fuzz_dma_read_cb(size_t addr,
 /* Dirty tracking enabled because measuring dirty rate */
 #define GLOBAL_DIRTY_DIRTY_RATE (1U << 1)
 
-#define GLOBAL_DIRTY_MASK  (0x3)
+/* Dirty tracking enabled because dirty limit */
+#define GLOBAL_DIRTY_LIMIT      (1U << 2)
+
+#define GLOBAL_DIRTY_MASK  (0x7)
 
 extern unsigned int global_dirty_tracking;
 
@@ -203,6 +206,12 @@ typedef struct IOMMUTLBEvent {
 /* RAM that isn't accessible through normal means. */
 #define RAM_PROTECTED (1 << 8)
 
+/*
+ * RAM is not marked mergeable as a whole, but in chunks that are likely
+ * to be identical to other memory, see ram_block_merge_hint().
+ */
+#define RAM_MERGE_HINTS (1 << 9)
+
 static inline void iommu_notifier_init(IOMMUNotifier *n, IOMMUNotify fn,
                                        IOMMUNotifierFlag flags,
                                        hwaddr start, hwaddr end,
@@ -730,6 +739,8 @@ struct MemoryRegion {
     bool nonvolatile;
     bool rom_device;
     bool flush_coalesced_mmio;
+    bool lockless_io;
+    QemuMutex *lock;
     uint8_t dirty_log_mask;
     bool is_iommu;
     RAMBlock *ram_block;
@@ -751,6 +762,7 @@ struct MemoryRegion {
     MemoryRegion *alias;
     hwaddr alias_offset;
     int32_t priority;
+    uint64_t topology_gen; /* Last change that affects rendering */
     QTAILQ_HEAD(, MemoryRegion) subregions;
     QTAILQ_ENTRY(MemoryRegion) subregions_link;
     QTAILQ_HEAD(, CoalescedMemoryRange) coalesced;
@@ -1060,6 +1072,7 @@ struct FlatView {
     unsigned nr_allocated;
     struct AddressSpaceDispatch *dispatch;
     MemoryRegion *root;
+    uint64_t topology_gen;
 };
 
 static inline FlatView *address_space_to_flatview(AddressSpace *as)
@@ -2133,6 +2146,37 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL
+ *
+ * By default the BQL is taken around the read and write callbacks of MMIO
+ * regions.  After this call, accesses from vCPUs that do not hold it call
+ * the callbacks of @mr directly, so they must do their own synchronization.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
+/**
+ * memory_region_set_lock: Protect accesses to a region with a device lock
+ *
+ * Accesses to @mr hold @lock instead of the BQL, so that vCPUs accessing
+ * different devices do not serialize on the BQL.  @lock is taken even if the
+ * caller already holds the BQL (e.g. for accesses from the main loop), so it
+ * nests inside the BQL: the read and write callbacks of @mr must not take
+ * the BQL, nor call anything that needs it, like raising interrupts or
+ * changing the memory map.  Such work has to be deferred, for example to a
+ * bottom half in the main loop, which can then take @lock itself.
+ *
+ * Contention on @lock shows up in the "sync-profile" output.  The time it is
+ * held by each access can be traced with the memory_region_lock_hold trace
+ * event.
+ *
+ * @mr: the memory region to be updated, which must not be an alias.
+ * @lock: the lock that protects the device state accessed by @mr.
+ */
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -2515,6 +2559,45 @@ MemTxResult address_space_rw(AddressSpace *as, hwaddr addr,
                              MemTxAttrs attrs, void *buf,
                              hwaddr len, bool is_write);
 
+/**
+ * struct AddressSpaceSectionCache: the section of the last access made with
+ * address_space_rw_cached_section()
+ *
+ * @topology_gen: the generation of the FlatView that @section belongs to,
+ *                zero if @section is not valid
+ * @section: the #MemoryRegionSection of the last MMIO access
+ *
+ * Zero-initialize before first use.  A cache must not be used by several
+ * threads at once.
+ */
+struct AddressSpaceSectionCache {
+    uint64_t topology_gen;
+    MemoryRegionSection section;
+};
+
+/**
+ * address_space_rw_cached_section: read from or write to an address space,
+ * starting the lookup from the section of the previous access
+ *
+ * Like address_space_rw(), but the #MemoryRegionSection found for MMIO
+ * accesses is kept in @cache, so that repeated accesses to the same
+ * device do not walk the dispatch tree.  The cache is dropped whenever
+ * the memory topology of @as changes.  This is meant for the MMIO exits
+ * of a vCPU, each vCPU using its own cache.
+ *
+ * @as: #AddressSpace to be accessed
+ * @addr: address within that address space
+ * @attrs: memory transaction attributes
+ * @buf: buffer with the data transferred
+ * @len: the number of bytes to read or write
+ * @is_write: indicates the transfer direction
+ * @cache: the section of the previous access
+ */
+MemTxResult address_space_rw_cached_section(AddressSpace *as, hwaddr addr,
+                                            MemTxAttrs attrs, void *buf,
+                                            hwaddr len, bool is_write,
+                                            AddressSpaceSectionCache *cache);
+
 /**
  * address_space_write: write to address space.
  *
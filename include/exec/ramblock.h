@@ -69,6 +69,27 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * With the fixed-ram migration capability each page of the block
+     * lives at a fixed offset of the migration file.  @file_bmap has
+     * one bit per target page, set when the page was written to the
+     * file, and is itself stored at @bitmap_offset.  The pages start
+     * at @pages_offset.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    off_t pages_offset;
+    /*
+     * With fixed-ram-lazy, one bit per host page, set by the thread that
+     * loads the page from the file.
+     */
+    unsigned long *lazy_bmap;
+    /* With RAM_MERGE_HINTS, one bit per chunk that was marked mergeable */
+    unsigned long *merge_hint_bmap;
+    /* Number of separate runs of bits in merge_hint_bmap */
+    unsigned merge_hint_ranges;
+    QemuMutex merge_hint_lock;
 };
 #endif
 #endif
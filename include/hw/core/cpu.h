@@ -225,6 +225,13 @@ struct hvf_vcpu_state;
 
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/*
+ * Number of TBs in each jump cache set, ordered from the most to the least
+ * recently used.  More ways absorb conflicts between the indirect branch
+ * targets of guest interpreters and JITs, at the cost of a longer lookup
+ * on a miss.
+ */
+#define TB_JMP_CACHE_WAYS 2
 
 /* work queue */
 
@@ -304,6 +311,7 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @kvm_mmio_cache: The memory section of the last MMIO exit of this CPU.
  *
  * State of one CPU core or thread.
  */
@@ -355,7 +363,10 @@ struct CPUState {
     IcountDecr *icount_decr_ptr;
 
     /* Accessed in parallel; all accesses must be atomic */
-    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE][TB_JMP_CACHE_WAYS];
+    /* Written only by the vCPU thread, read atomically by "info jit" */
+    size_t tb_jmp_cache_hit_count;
+    size_t tb_jmp_cache_miss_count;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -381,7 +392,10 @@ struct CPUState {
     struct kvm_run *kvm_run;
     struct kvm_dirty_gfn *kvm_dirty_gfns;
     uint32_t kvm_fetch_index;
+    AddressSpaceSectionCache *kvm_mmio_cache;
     uint64_t dirty_pages;
+    /* Counts vCPU ioctls issued without the BQL */
+    QemuLockCnt kvm_in_ioctl_lock;
 
     /* Used for events with 'vcpu' and *without* the 'disabled' properties */
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
@@ -411,6 +425,12 @@ struct CPUState {
      */
     bool throttle_thread_scheduled;
 
+    /*
+     * Sleep time in microseconds for each dirty ring full exit, used by
+     * the dirty page rate limit
+     */
+    int64_t throttle_us_per_full;
+
     bool ignore_memory_transaction_failures;
 
     /* Used for user-only emulation of prctl(PR_SET_UNALIGN). */
@@ -437,10 +457,12 @@ extern __thread CPUState *current_cpu;
 
 static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
 {
-    unsigned int i;
+    unsigned int i, j;
 
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
-        qatomic_set(&cpu->tb_jmp_cache[i], NULL);
+        for (j = 0; j < TB_JMP_CACHE_WAYS; j++) {
+            qatomic_set(&cpu->tb_jmp_cache[i][j], NULL);
+        }
     }
 }
 
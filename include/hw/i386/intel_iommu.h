@@ -24,6 +24,7 @@
 
 #include "hw/i386/x86-iommu.h"
 #include "qemu/iova-tree.h"
+#include "qemu/seqlock.h"
 #include "qom/object.h"
 
 #define TYPE_INTEL_IOMMU_DEVICE "intel-iommu"
@@ -58,6 +59,7 @@ typedef struct VTDContextEntry VTDContextEntry;
 typedef struct VTDContextCacheEntry VTDContextCacheEntry;
 typedef struct VTDAddressSpace VTDAddressSpace;
 typedef struct VTDIOTLBEntry VTDIOTLBEntry;
+typedef struct VTDTransCacheEntry VTDTransCacheEntry;
 typedef struct VTDBus VTDBus;
 typedef union VTD_IR_TableEntry VTD_IR_TableEntry;
 typedef union VTD_IR_MSIAddress VTD_IR_MSIAddress;
@@ -85,6 +87,22 @@ struct VTDContextCacheEntry {
     struct VTDContextEntry context_entry;
 };
 
+/*
+ * Per-device cache of recent translations, looked up without taking the
+ * IOMMU lock.  Entries cover a whole (possibly large) page.
+ */
+#define VTD_TRANS_CACHE_SIZE 8
+
+struct VTDTransCacheEntry {
+    /* The entry is obsolete if gen != IntelIOMMUState.trans_cache_gen */
+    uint32_t gen;
+    uint16_t domain_id;
+    uint8_t perm;
+    hwaddr iova;
+    hwaddr translated_addr;
+    hwaddr addr_mask;
+};
+
 /* PASID Directory Entry */
 struct VTDPASIDDirEntry {
     uint64_t val;
@@ -105,6 +123,10 @@ struct VTDAddressSpace {
     MemoryRegion iommu_ir;      /* Interrupt region: 0xfeeXXXXX */
     IntelIOMMUState *iommu_state;
     VTDContextCacheEntry context_cache_entry;
+    /* Written with the IOMMU lock held */
+    QemuSeqLock trans_cache_lock;
+    VTDTransCacheEntry trans_cache[VTD_TRANS_CACHE_SIZE];
+    unsigned trans_cache_next;    /* the entry to replace next */
     QLIST_ENTRY(VTDAddressSpace) next;
     /* Superset of notifier flags that this address space has */
     IOMMUNotifierFlag notifier_flags;
@@ -251,6 +273,7 @@ struct IntelIOMMUState {
 
     uint32_t context_cache_gen;     /* Should be in [1,MAX] */
     GHashTable *iotlb;              /* IOTLB */
+    uint32_t trans_cache_gen;       /* Should not be 0 */
 
     GHashTable *vtd_as_by_busptr;   /* VTDBus objects indexed by PCIBus* reference */
     VTDBus *vtd_as_by_bus_num[VTD_PCI_BUS_MAX]; /* VTDBus objects indexed by bus number */
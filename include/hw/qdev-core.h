@@ -890,4 +890,8 @@ typedef enum MachineInitPhase {
 extern bool phase_check(MachineInitPhase phase);
 extern void phase_advance(MachineInitPhase phase);
 
+/* Name of @phase, and nanoseconds from process start until it was entered */
+extern const char *phase_get_name(MachineInitPhase phase);
+extern int64_t phase_get_time(MachineInitPhase phase);
+
 #endif
@@ -48,7 +48,7 @@ struct SCSIRequest {
     bool              dma_started;
     BlockAIOCB        *aiocb;
     QEMUSGList        *sg;
-    QTAILQ_ENTRY(SCSIRequest) next;
+    QTAILQ_ENTRY(SCSIRequest) next;     /* in requests or free_reqs */
 };
 
 #define TYPE_SCSI_DEVICE "scsi-device"
@@ -77,6 +77,10 @@ struct SCSIDevice
     uint8_t sense[SCSI_SENSE_BUF_SIZE];
     uint32_t sense_len;
     QTAILQ_HEAD(, SCSIRequest) requests;
+    /* Freed requests of free_req_size bytes, kept for reuse */
+    QTAILQ_HEAD(, SCSIRequest) free_reqs;
+    unsigned nr_free_reqs;
+    size_t free_req_size;
     uint32_t channel;
     uint32_t lun;
     int blocksize;
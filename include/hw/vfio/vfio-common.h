@@ -75,6 +75,7 @@ typedef struct VFIOAddressSpace {
 } VFIOAddressSpace;
 
 struct VFIOGroup;
+struct VFIODMAMap;
 
 typedef struct VFIOContainer {
     VFIOAddressSpace *space;
@@ -93,6 +94,7 @@ typedef struct VFIOContainer {
     QLIST_HEAD(, VFIOHostDMAWindow) hostwin_list;
     QLIST_HEAD(, VFIOGroup) group_list;
     QLIST_HEAD(, VFIORamDiscardListener) vrdl_list;
+    QSIMPLEQ_HEAD(, VFIODMAMap) pending_maps;
     QLIST_ENTRY(VFIOContainer) next;
 } VFIOContainer;
 
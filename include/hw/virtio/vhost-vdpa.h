@@ -12,6 +12,8 @@
 #ifndef HW_VIRTIO_VHOST_VDPA_H
 #define HW_VIRTIO_VHOST_VDPA_H
 
+#include "hw/virtio/vhost-iova-tree.h"
+#include "hw/virtio/vhost-shadow-virtqueue.h"
 #include "hw/virtio/virtio.h"
 #include "standard-headers/linux/vhost_types.h"
 
@@ -27,8 +29,33 @@ typedef struct vhost_vdpa {
     bool iotlb_batch_begin_sent;
     MemoryListener listener;
     struct vhost_vdpa_iova_range iova_range;
+    /*
+     * Offer VHOST_F_LOG_ALL and switch to shadow virtqueues while the
+     * guest is being migrated
+     */
+    bool shadow_vqs_migration;
+    /* The virtqueues are relayed through the shadow virtqueues */
+    bool shadow_vqs_enabled;
+    /*
+     * The data virtqueues are shadowed, so guest memory is mapped at iovas
+     * allocated in the tree rather than at guest physical addresses.  The
+     * control virtqueue can be shadowed while this is false.
+     */
+    bool shadow_data;
+    /* IOVA mapping used by the shadow virtqueues, shared by all queues */
+    VhostIOVATree *iova_tree;
+    GPtrArray *shadow_vqs;
+    /* Handles the guest's buffers instead of relaying them, if set */
+    const VhostShadowVirtqueueOps *shadow_vq_ops;
+    void *shadow_vq_ops_opaque;
+    /* Features acked to the device, without VHOST_F_LOG_ALL */
+    uint64_t acked_features;
     struct vhost_dev *dev;
     VhostVDPAHostNotifier notifier[VIRTIO_QUEUE_MAX];
 } VhostVDPA;
 
+int vhost_vdpa_dma_map(struct vhost_vdpa *v, hwaddr iova, hwaddr size,
+                       void *vaddr, bool readonly);
+int vhost_vdpa_dma_unmap(struct vhost_vdpa *v, hwaddr iova, hwaddr size);
+
 #endif
@@ -71,6 +71,8 @@ struct VirtIOBalloon {
 
     bool qemu_4_0_config_size;
     uint32_t poison_val;
+    /* A batch of free page reports is being discarded */
+    bool report_inflight;
 };
 
 #endif
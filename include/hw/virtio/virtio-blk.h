@@ -36,6 +36,8 @@ struct VirtIOBlkConf
 {
     BlockConf conf;
     IOThread *iothread;
+    uint32_t num_iothreads;
+    char **iothreads;
     char *serial;
     uint32_t request_merging;
     uint16_t num_queues;
@@ -44,12 +46,16 @@ struct VirtIOBlkConf
     bool report_discard_granularity;
     uint32_t max_discard_sectors;
     uint32_t max_write_zeroes_sectors;
+    uint32_t coalesce_usecs;
+    uint32_t coalesce_frames;
+    uint32_t merge_window_usecs;
     bool x_enable_wce_if_config_wce;
 };
 
 struct VirtIOBlockDataPlane;
 
 struct VirtIOBlockReq;
+struct MultiReqBuffer;
 struct VirtIOBlock {
     VirtIODevice parent_obj;
     BlockBackend *blk;
@@ -64,6 +70,12 @@ struct VirtIOBlock {
     struct VirtIOBlockDataPlane *dataplane;
     uint64_t host_features;
     size_t config_size;
+
+    /* Requests from all virtqueues waiting for merge-window-usecs */
+    struct MultiReqBuffer *merge_mrb;
+    QEMUTimer *merge_timer;
+    AioContext *merge_timer_ctx;
+    bool merge_pending;
 };
 
 typedef struct VirtIOBlockReq {
@@ -55,6 +55,9 @@ struct virtio_gpu_simple_resource {
     void *blob;
     int dmabuf_fd;
     uint8_t *remapped;
+    uint64_t remapped_size;
+    /* the image of a 2D resource points to its backing */
+    bool zero_copy;
 
     QTAILQ_ENTRY(virtio_gpu_simple_resource) next;
 };
@@ -90,6 +93,7 @@ enum virtio_gpu_base_conf_flags {
     VIRTIO_GPU_FLAG_EDID_ENABLED,
     VIRTIO_GPU_FLAG_DMABUF_ENABLED,
     VIRTIO_GPU_FLAG_BLOB_ENABLED,
+    VIRTIO_GPU_FLAG_ZERO_COPY_ENABLED,
 };
 
 #define virtio_gpu_virgl_enabled(_cfg) \
@@ -102,6 +106,8 @@ enum virtio_gpu_base_conf_flags {
     (_cfg.flags & (1 << VIRTIO_GPU_FLAG_DMABUF_ENABLED))
 #define virtio_gpu_blob_enabled(_cfg) \
     (_cfg.flags & (1 << VIRTIO_GPU_FLAG_BLOB_ENABLED))
+#define virtio_gpu_zero_copy_enabled(_cfg) \
+    (_cfg.flags & (1 << VIRTIO_GPU_FLAG_ZERO_COPY_ENABLED))
 
 struct virtio_gpu_base_conf {
     uint32_t max_outputs;
@@ -172,6 +178,8 @@ struct VirtIOGPU {
     QTAILQ_HEAD(, virtio_gpu_ctrl_command) fenceq;
 
     uint64_t hostmem;
+    /* 2D resources with several backing entries can be zero-copy */
+    bool zero_copy_udmabuf;
 
     bool processing_cmdq;
     QEMUTimer *fence_poll;
@@ -270,11 +278,14 @@ void virtio_gpu_update_cursor_data(VirtIOGPU *g,
 bool virtio_gpu_have_udmabuf(void);
 void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res);
 void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res);
+void *virtio_gpu_init_udmabuf_2d(struct virtio_gpu_simple_resource *res,
+                                 size_t size, bool use_udmabuf);
 int virtio_gpu_update_dmabuf(VirtIOGPU *g,
                              uint32_t scanout_id,
                              struct virtio_gpu_simple_resource *res,
                              struct virtio_gpu_framebuffer *fb,
                              struct virtio_gpu_rect *r);
+void virtio_gpu_release_dmabuf(VirtIOGPU *g, uint32_t scanout_id);
 
 /* virtio-gpu-3d.c */
 void virtio_gpu_virgl_process_cmd(VirtIOGPU *g,
@@ -74,6 +74,11 @@ struct VirtIOMEM {
     /* whether to prealloc memory when plugging new blocks */
     bool prealloc;
 
+    /* whether a plug or unplug request is being processed in a thread */
+    bool request_inflight;
+    /* whether no further requests are picked up once it completes */
+    bool request_draining;
+
     /* notifiers to notify when "size" changes */
     NotifierList size_change_notifiers;
 
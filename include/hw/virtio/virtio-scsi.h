@@ -55,6 +55,8 @@ struct VirtIOSCSIConf {
     bool seg_max_adjust;
     uint32_t max_sectors;
     uint32_t cmd_per_lun;
+    uint32_t coalesce_usecs;
+    uint32_t coalesce_frames;
 #ifdef CONFIG_VHOST_SCSI
     char *vhostfd;
     char *wwpn;
@@ -62,6 +64,8 @@ struct VirtIOSCSIConf {
     CharBackend chardev;
     uint32_t boot_tpgt;
     IOThread *iothread;
+    uint32_t num_iothreads;
+    char **iothreads;
 };
 
 struct VirtIOSCSI;
@@ -87,6 +91,16 @@ struct VirtIOSCSI {
     /* Fields for dataplane below */
     AioContext *ctx; /* one iothread per virtio-scsi-pci for now */
 
+    /*
+     * With the iothreads property, request virtqueue i is serviced by
+     * iothreads[i % num_iothreads] and cmd_vq_ctx[i] is its AioContext.
+     * The control and event virtqueues and all BlockBackends stay in
+     * iothreads[0], i.e. ctx, which virtio_scsi_acquire() takes.
+     */
+    IOThread **iothreads;
+    unsigned num_iothreads;
+    AioContext **cmd_vq_ctx;
+
     bool dataplane_started;
     bool dataplane_starting;
     bool dataplane_stopping;
@@ -156,10 +170,12 @@ bool virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq);
 bool virtio_scsi_handle_ctrl_vq(VirtIOSCSI *s, VirtQueue *vq);
 void virtio_scsi_init_req(VirtIOSCSI *s, VirtQueue *vq, VirtIOSCSIReq *req);
 void virtio_scsi_free_req(VirtIOSCSIReq *req);
+void virtio_scsi_set_coalescing(VirtIOSCSI *s, AioContext *ctx);
 void virtio_scsi_push_event(VirtIOSCSI *s, SCSIDevice *dev,
                             uint32_t event, uint32_t reason);
 
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp);
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s);
 int virtio_scsi_dataplane_start(VirtIODevice *s);
 void virtio_scsi_dataplane_stop(VirtIODevice *s);
 
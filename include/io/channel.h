@@ -32,12 +32,16 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 
 #define QIO_CHANNEL_ERR_BLOCK -2
 
+#define QIO_CHANNEL_WRITE_FLAG_ZERO_COPY 0x1
+
 typedef enum QIOChannelFeature QIOChannelFeature;
 
 enum QIOChannelFeature {
     QIO_CHANNEL_FEATURE_FD_PASS,
     QIO_CHANNEL_FEATURE_SHUTDOWN,
     QIO_CHANNEL_FEATURE_LISTEN,
+    QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY,
+    QIO_CHANNEL_FEATURE_SEEKABLE,
 };
 
 
@@ -104,6 +108,7 @@ struct QIOChannelClass {
                          size_t niov,
                          int *fds,
                          size_t nfds,
+                         int flags,
                          Error **errp);
     ssize_t (*io_readv)(QIOChannel *ioc,
                         const struct iovec *iov,
@@ -136,6 +141,18 @@ struct QIOChannelClass {
                                   IOHandler *io_read,
                                   IOHandler *io_write,
                                   void *opaque);
+    int (*io_flush)(QIOChannel *ioc,
+                    Error **errp);
+    ssize_t (*io_pwritev)(QIOChannel *ioc,
+                          const struct iovec *iov,
+                          size_t niov,
+                          off_t offset,
+                          Error **errp);
+    ssize_t (*io_preadv)(QIOChannel *ioc,
+                         const struct iovec *iov,
+                         size_t niov,
+                         off_t offset,
+                         Error **errp);
 };
 
 /* General I/O handling functions */
@@ -228,6 +245,7 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  * Write data to the IO channel, reading it from the
@@ -251,6 +269,14 @@ ssize_t qio_channel_readv_full(QIOChannel *ioc,
  * unless qio_channel_has_feature() returns a true
  * value for the QIO_CHANNEL_FEATURE_FD_PASS constant.
  *
+ * If @flags contains QIO_CHANNEL_WRITE_FLAG_ZERO_COPY,
+ * the kernel may keep referencing the memory regions in
+ * @iov after the function returns, so they must not be
+ * modified or freed until qio_channel_flush() has been
+ * called. It is an error to pass this flag unless
+ * qio_channel_has_feature() returns a true value for
+ * the QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY constant.
+ *
  * Returns: the number of bytes sent, or -1 on error,
  * or QIO_CHANNEL_ERR_BLOCK if no data is can be sent
  * and the channel is non-blocking
@@ -260,6 +286,7 @@ ssize_t qio_channel_writev_full(QIOChannel *ioc,
                                 size_t niov,
                                 int *fds,
                                 size_t nfds,
+                                int flags,
                                 Error **errp);
 
 /**
@@ -598,6 +625,48 @@ off_t qio_channel_io_seek(QIOChannel *ioc,
                           int whence,
                           Error **errp);
 
+/**
+ * qio_channel_pwritev:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to write data from
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel where to write
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Write all the data in @iov at @offset, without using or
+ * changing the current I/O position.  Only channels with the
+ * QIO_CHANNEL_FEATURE_SEEKABLE feature support this; several
+ * threads may write at different offsets at the same time.
+ *
+ * Returns: 0 if all bytes were written, or -1 on error
+ */
+int qio_channel_pwritev(QIOChannel *ioc,
+                        const struct iovec *iov,
+                        size_t niov,
+                        off_t offset,
+                        Error **errp);
+
+/**
+ * qio_channel_preadv:
+ * @ioc: the channel object
+ * @iov: the array of memory regions to read data into
+ * @niov: the length of the @iov array
+ * @offset: the position in the channel where to read
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Read enough data to fill all of @iov from @offset, without
+ * using or changing the current I/O position.  Reaching the end
+ * of the channel before @iov is full is an error.  Only channels
+ * with the QIO_CHANNEL_FEATURE_SEEKABLE feature support this.
+ *
+ * Returns: 0 if all bytes were read, or -1 on error
+ */
+int qio_channel_preadv(QIOChannel *ioc,
+                       const struct iovec *iov,
+                       size_t niov,
+                       off_t offset,
+                       Error **errp);
+
 
 /**
  * qio_channel_create_watch:
@@ -837,6 +906,7 @@ int qio_channel_readv_full_all(QIOChannel *ioc,
  * @niov: the length of the @iov array
  * @fds: an array of file handles to send
  * @nfds: number of file handles in @fds
+ * @flags: write flags (QIO_CHANNEL_WRITE_FLAG_*)
  * @errp: pointer to a NULL-initialized error object
  *
  *
@@ -846,6 +916,10 @@ int qio_channel_readv_full_all(QIOChannel *ioc,
  * to be written, yielding from the current coroutine
  * if required.
  *
+ * If QIO_CHANNEL_WRITE_FLAG_ZERO_COPY is passed in @flags,
+ * the memory regions in @iov must be kept unmodified until
+ * a subsequent call to qio_channel_flush() has returned.
+ *
  * Returns: 0 if all bytes were written, or -1 on error
  */
 
@@ -853,6 +927,27 @@ int qio_channel_writev_full_all(QIOChannel *ioc,
                                 const struct iovec *iov,
                                 size_t niov,
                                 int *fds, size_t nfds,
-                                Error **errp);
+                                int flags, Error **errp);
+
+/**
+ * qio_channel_flush:
+ * @ioc: the channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Will block until every packet queued with
+ * QIO_CHANNEL_WRITE_FLAG_ZERO_COPY has been sent,
+ * after which the memory regions referenced by those
+ * writes may be reused.
+ *
+ * If the channel does not implement flushing, this
+ * is a no-op and returns 0.
+ *
+ * Returns: 1 if all queued data was sent, but some of it
+ * had to fall back to being copied by the kernel, 0 if
+ * all data was sent using zero copy, or -1 on error.
+ */
+
+int qio_channel_flush(QIOChannel *ioc,
+                      Error **errp);
 
 #endif /* QIO_CHANNEL_H */
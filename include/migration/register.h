@@ -16,6 +16,17 @@
 
 #include "hw/vmstate-if.h"
 
+/* Largest buffer that can be passed to qemu_savevm_queue_device_state() */
+#define SAVEVM_STATE_BUFFER_MAX_SIZE (64 * 1024 * 1024)
+
+typedef struct SaveLiveCompletePrecopyThreadData {
+    const char *idstr;
+    uint32_t instance_id;
+    void *opaque;
+    /* index of the next buffer, the destination loads them in order */
+    uint64_t idx;
+} SaveLiveCompletePrecopyThreadData;
+
 typedef struct SaveVMHandlers {
     /* This runs inside the iothread lock.  */
     SaveStateHandler *save_state;
@@ -24,6 +35,17 @@ typedef struct SaveVMHandlers {
     int (*save_live_complete_postcopy)(QEMUFile *f, void *opaque);
     int (*save_live_complete_precopy)(QEMUFile *f, void *opaque);
 
+    /*
+     * With the multifd-device-state capability, this runs in its own
+     * thread, outside the iothread lock, right after
+     * save_live_complete_precopy.  It hands the device state to the
+     * multifd channels with qemu_savevm_queue_device_state(); the
+     * buffers are passed in order to load_state_buffer on the
+     * destination before the device's save_state section is loaded.
+     */
+    int (*save_live_complete_precopy_thread)(
+        SaveLiveCompletePrecopyThreadData *d, Error **errp);
+
     /* This runs both outside and inside the iothread lock.  */
     bool (*is_active)(void *opaque);
     bool (*has_postcopy)(void *opaque);
@@ -44,6 +66,17 @@ typedef struct SaveVMHandlers {
      */
     int (*save_live_iterate)(QEMUFile *f, void *opaque);
 
+    /*
+     * With the multifd-device-state capability, this is called instead
+     * of save_live_iterate, from the migration thread, and returns the
+     * same values.  Rather than writing a section, it hands the data to
+     * the multifd channels with qemu_savevm_queue_device_state(); the
+     * destination loads these buffers with load_state_buffer, before
+     * those of save_live_complete_precopy_thread.
+     */
+    int (*save_live_iterate_buffers)(SaveLiveCompletePrecopyThreadData *d,
+                                     Error **errp);
+
     /* This runs outside the iothread lock!  */
     int (*save_setup)(QEMUFile *f, void *opaque);
     void (*save_live_pending)(QEMUFile *f, void *opaque,
@@ -66,6 +99,13 @@ typedef struct SaveVMHandlers {
     LoadStateHandler *load_state;
     int (*load_setup)(QEMUFile *f, void *opaque);
     int (*load_cleanup)(void *opaque);
+    /*
+     * Load a buffer queued by save_live_iterate_buffers or
+     * save_live_complete_precopy_thread.  This runs in a multifd receive
+     * thread, outside the iothread lock, and takes ownership of @buf.
+     */
+    int (*load_state_buffer)(void *opaque, char *buf, size_t len,
+                             Error **errp);
     /* Called when postcopy migration wants to resume from failure */
     int (*resume_prepare)(MigrationState *s, void *opaque);
 } SaveVMHandlers;
@@ -78,4 +118,31 @@ int register_savevm_live(const char *idstr,
 
 void unregister_savevm(VMStateIf *obj, const char *idstr, void *opaque);
 
+/**
+ * qemu_savevm_queue_device_state: send a buffer of device state
+ *
+ * Queue @buf on a multifd channel; ownership of @buf is transferred
+ * even on failure.  Only valid from save_live_iterate_buffers and
+ * save_live_complete_precopy_thread.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @d: data passed to the handler
+ * @buf: g_malloc()ed buffer, at most SAVEVM_STATE_BUFFER_MAX_SIZE bytes
+ * @len: size of @buf
+ * @errp: pointer to an error
+ */
+int qemu_savevm_queue_device_state(SaveLiveCompletePrecopyThreadData *d,
+                                   char *buf, size_t len, Error **errp);
+
+/**
+ * qemu_savevm_device_state_active: check whether the device state
+ * goes through save_live_complete_precopy_thread
+ *
+ * Returns true if the migration in progress uses multifd-device-state,
+ * in which case save_live_complete_precopy must leave the device data
+ * to save_live_complete_precopy_thread.
+ */
+bool qemu_savevm_device_state_active(void);
+
 #endif
@@ -43,6 +43,8 @@ typedef struct NICConf {
 /* Net clients */
 
 typedef void (NetPoll)(NetClientState *, bool enable);
+typedef int (NetStart)(NetClientState *);
+typedef void (NetStop)(NetClientState *);
 typedef bool (NetCanReceive)(NetClientState *);
 typedef ssize_t (NetReceive)(NetClientState *, const uint8_t *, size_t);
 typedef ssize_t (NetReceiveIOV)(NetClientState *, const struct iovec *, int);
@@ -63,6 +65,8 @@ typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
+typedef void (SetRssFlow)(NetClientState *, NetRssFlow *, int, Error **);
+typedef NetRssQueueStatsList *(QueryRssStats)(NetClientState *, Error **);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -75,6 +79,8 @@ typedef struct NetClientInfo {
     LinkStatusChanged *link_status_changed;
     QueryRxFilter *query_rx_filter;
     NetPoll *poll;
+    NetStart *start; /* after its vhost device has been started */
+    NetStop *stop; /* after its vhost device has been stopped */
     HasUfo *has_ufo;
     HasVnetHdr *has_vnet_hdr;
     HasVnetHdrLen *has_vnet_hdr_len;
@@ -86,6 +92,8 @@ typedef struct NetClientInfo {
     NetAnnounce *announce;
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
+    SetRssFlow *set_rss_flow; /* a negative queue deletes the flow */
+    QueryRssStats *query_rss_stats;
 } NetClientInfo;
 
 struct NetClientState {
@@ -103,6 +111,9 @@ struct NetClientState {
     unsigned rxfilter_notify_enabled:1;
     int vring_enable;
     int vnet_hdr_len;
+    bool vnet_hdr_swap; /* vnet header is not in host endianness */
+    bool offload_csum;  /* last qemu_set_offload() enabled checksum offload */
+    bool offload_tso4;  /* last qemu_set_offload() enabled TSO for IPv4 */
     bool is_netdev;
     bool do_not_pad; /* do not pad to the minimum ethernet frame length */
     bool is_datapath;
@@ -129,6 +140,9 @@ struct SocketReadState {
 };
 
 int net_fill_rstate(SocketReadState *rs, const uint8_t *buf, int size);
+void net_rstate_frame_append(GByteArray *buf, bool vnet_hdr,
+                             uint32_t vnet_hdr_len,
+                             const struct iovec *iov, int iovcnt);
 char *qemu_mac_strdup_printf(const uint8_t *macaddr);
 NetClientState *qemu_find_netdev(const char *id);
 int qemu_find_net_clients_except(const char *id, NetClientState **ncs,
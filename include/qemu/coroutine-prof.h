@@ -0,0 +1,69 @@
+/*
+ * Coroutine-aware sampling profiler
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_COROUTINE_PROF_H
+#define QEMU_COROUTINE_PROF_H
+
+#include "qemu/coroutine.h"
+
+/* Set while a profile is being recorded; do not write outside this module */
+extern bool coroutine_prof_enabled;
+
+/**
+ * coroutine_prof_start:
+ * @interval_us: sampling interval in microseconds
+ *
+ * Discards previous samples and starts sampling the coroutine that each
+ * thread is running, every @interval_us microseconds.
+ */
+void coroutine_prof_start(unsigned int interval_us);
+
+/**
+ * coroutine_prof_stop:
+ *
+ * Stops sampling.  The samples are kept until the next
+ * coroutine_prof_start().
+ */
+void coroutine_prof_stop(void);
+
+/**
+ * coroutine_prof_dump:
+ * @buf: the buffer to append to
+ * @ctx_name: returns the name, to be freed with g_free(), of an AioContext
+ *
+ * Appends the samples to @buf in the folded stack format used by flame graph
+ * tools: one "context;entry;tag... count" line for each distinct sample.
+ */
+void coroutine_prof_dump(GString *buf, char *(*ctx_name)(AioContext *ctx));
+
+const char *coroutine_prof_push_tag__slowpath(const char *tag);
+void coroutine_prof_pop_tag__slowpath(const char *old);
+
+/**
+ * coroutine_prof_push_tag:
+ * @tag: a name for the work the current coroutine is about to do
+ *
+ * Appends @tag to the tags of the current coroutine while profiling, so that
+ * its samples show for example which block nodes it was working on.  Returns
+ * what must be passed to coroutine_prof_pop_tag() when the work is done.
+ */
+static inline const char *coroutine_fn coroutine_prof_push_tag(const char *tag)
+{
+    if (unlikely(qatomic_read(&coroutine_prof_enabled))) {
+        return coroutine_prof_push_tag__slowpath(tag);
+    }
+    return NULL;
+}
+
+static inline void coroutine_fn coroutine_prof_pop_tag(const char *old)
+{
+    if (unlikely(qatomic_read(&coroutine_prof_enabled))) {
+        coroutine_prof_pop_tag__slowpath(old);
+    }
+}
+
+#endif /* QEMU_COROUTINE_PROF_H */
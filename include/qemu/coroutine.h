@@ -159,7 +159,16 @@ void qemu_co_mutex_init(CoMutex *mutex);
  * Locks the mutex. If the lock cannot be taken immediately, control is
  * transferred to the caller of the current coroutine.
  */
-void coroutine_fn qemu_co_mutex_lock(CoMutex *mutex);
+#define qemu_co_mutex_lock(m) \
+    qemu_co_mutex_lock_impl(m, __FILE__, __LINE__)
+void coroutine_fn qemu_co_mutex_lock_impl(CoMutex *mutex, const char *file,
+                                          int line);
+
+/* For QemuLockable, which needs the address of the function */
+static inline void coroutine_fn (qemu_co_mutex_lock)(CoMutex *mutex)
+{
+    qemu_co_mutex_lock(mutex);
+}
 
 /**
  * Unlocks the mutex and schedules the next coroutine that was waiting for this
@@ -203,9 +212,11 @@ void qemu_co_queue_init(CoQueue *queue);
  * caller of the coroutine.  The mutex is unlocked during the wait and
  * locked again afterwards.
  */
-#define qemu_co_queue_wait(queue, lock) \
-    qemu_co_queue_wait_impl(queue, QEMU_MAKE_LOCKABLE(lock))
-void coroutine_fn qemu_co_queue_wait_impl(CoQueue *queue, QemuLockable *lock);
+#define qemu_co_queue_wait(queue, lock)                             \
+    qemu_co_queue_wait_impl(queue, QEMU_MAKE_LOCKABLE(lock),        \
+                            __FILE__, __LINE__)
+void coroutine_fn qemu_co_queue_wait_impl(CoQueue *queue, QemuLockable *lock,
+                                          const char *file, int line);
 
 /**
  * Removes the next coroutine from the CoQueue, and wake it up.
@@ -261,7 +272,9 @@ void qemu_co_rwlock_init(CoRwlock *lock);
  * of a parallel writer, control is transferred to the caller of the current
  * coroutine.
  */
-void qemu_co_rwlock_rdlock(CoRwlock *lock);
+#define qemu_co_rwlock_rdlock(lock) \
+    qemu_co_rwlock_rdlock_impl(lock, __FILE__, __LINE__)
+void qemu_co_rwlock_rdlock_impl(CoRwlock *lock, const char *file, int line);
 
 /**
  * Write Locks the CoRwlock from a reader.  This is a bit more efficient than
@@ -270,7 +283,9 @@ void qemu_co_rwlock_rdlock(CoRwlock *lock);
  * to the caller of the current coroutine; another writer might run while
  * @qemu_co_rwlock_upgrade blocks.
  */
-void qemu_co_rwlock_upgrade(CoRwlock *lock);
+#define qemu_co_rwlock_upgrade(lock) \
+    qemu_co_rwlock_upgrade_impl(lock, __FILE__, __LINE__)
+void qemu_co_rwlock_upgrade_impl(CoRwlock *lock, const char *file, int line);
 
 /**
  * Downgrades a write-side critical section to a reader.  Downgrading with
@@ -285,7 +300,9 @@ void qemu_co_rwlock_downgrade(CoRwlock *lock);
  * of a parallel reader, control is transferred to the caller of the current
  * coroutine.
  */
-void qemu_co_rwlock_wrlock(CoRwlock *lock);
+#define qemu_co_rwlock_wrlock(lock) \
+    qemu_co_rwlock_wrlock_impl(lock, __FILE__, __LINE__)
+void qemu_co_rwlock_wrlock_impl(CoRwlock *lock, const char *file, int line);
 
 /**
  * Unlocks the read/write lock and schedules the next coroutine that was
@@ -331,6 +348,20 @@ void qemu_co_sleep_wake(QemuCoSleep *w);
  */
 void coroutine_fn yield_until_fd_readable(int fd);
 
+/**
+ * Increase coroutine pool size
+ *
+ * Devices that may have many requests in flight at the same time call this
+ * so that the coroutine pool keeps enough coroutines (and their stacks)
+ * around to serve all of them.
+ */
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
+
+/**
+ * Decrease coroutine pool size, undoing qemu_coroutine_inc_pool_size()
+ */
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size);
+
 #include "qemu/lockable.h"
 
 #endif /* QEMU_COROUTINE_H */
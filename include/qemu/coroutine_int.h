@@ -67,11 +67,15 @@ struct Coroutine {
     QSIMPLEQ_HEAD(, Coroutine) co_queue_wakeup;
 
     QSLIST_ENTRY(Coroutine) co_scheduled_next;
+
+    /* Tags pushed by coroutine_prof_push_tag(), separated by semicolons */
+    const char *prof_tag;
 };
 
 Coroutine *qemu_coroutine_new(void);
 void qemu_coroutine_delete(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
+void coroutine_prof_switch(Coroutine *co);
 
 #endif
@@ -0,0 +1,22 @@
+/*
+ * Vector extensions of an x86 host, as used to pick accelerated routines
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_CPUINFO_H
+#define QEMU_CPUINFO_H
+
+#define CPUINFO_SSE2    (1u << 0)
+#define CPUINFO_SSE4_1  (1u << 1)
+#define CPUINFO_AVX2    (1u << 2)
+#define CPUINFO_AVX512F (1u << 3)
+
+/*
+ * Returns the CPUINFO_* extensions that the host supports and the OS has
+ * enabled.  Safe to call from constructors.
+ */
+unsigned cpuinfo_get(void);
+
+#endif /* QEMU_CPUINFO_H */
@@ -175,6 +175,11 @@ char *freq_to_str(uint64_t freq_hz);
 
 bool buffer_is_zero(const void *buf, size_t len);
 bool test_buffer_is_zero_next_accel(void);
+const char *buffer_is_zero_accel_name(void);
+size_t buffer_diff_chunks(const void *a, const void *b, size_t len,
+                          size_t chunk, unsigned long *bitmap);
+bool test_buffer_diff_next_accel(void);
+const char *buffer_diff_accel_name(void);
 
 /*
  * Implementation of ULEB128 (http://en.wikipedia.org/wiki/LEB128)
@@ -29,6 +29,7 @@
 #define  IOVA_OK           (0)
 #define  IOVA_ERR_INVALID  (-1) /* Invalid parameters */
 #define  IOVA_ERR_OVERLAP  (-2) /* IOVA range overlapped */
+#define  IOVA_ERR_NOMEM    (-3) /* Cannot allocate */
 
 typedef struct IOVATree IOVATree;
 typedef struct DMAMap {
@@ -107,6 +108,41 @@ const DMAMap *iova_tree_find(const IOVATree *tree, const DMAMap *map);
  */
 const DMAMap *iova_tree_find_address(const IOVATree *tree, hwaddr iova);
 
+/**
+ * iova_tree_find_iova:
+ *
+ * @tree: the iova tree to search from
+ * @map: the mapping to search
+ *
+ * Search for a mapping in the iova tree whose translated address range
+ * overlaps with the translated address range of @map.  Only
+ * @map->translated_addr and @map->size are used.  Unlike
+ * iova_tree_find(), this walks the whole tree.
+ *
+ * Return: the first matching mapping, or NULL if there is none.  The
+ * returned mapping must not be modified and is only valid until the tree
+ * is modified.
+ */
+const DMAMap *iova_tree_find_iova(const IOVATree *tree, const DMAMap *map);
+
+/**
+ * iova_tree_alloc_map:
+ *
+ * @tree: the iova tree to allocate from
+ * @map: the new map (as translated addr & size) to allocate in the iova region
+ * @iova_begin: the minimum address of the allocation
+ * @iova_last: the maximum address (inclusive) of the allocation
+ *
+ * Allocates a new region of @map->size + 1 bytes at the lowest free iova
+ * address within [@iova_begin, @iova_last] and inserts it in the tree.
+ * On success, @map->iova is set to the allocated address.
+ *
+ * Return: IOVA_OK if successful, IOVA_ERR_NOMEM if there is no hole big
+ * enough, or IOVA_ERR_INVALID if the parameters are invalid.
+ */
+int iova_tree_alloc_map(IOVATree *tree, DMAMap *map, hwaddr iova_begin,
+                        hwaddr iova_last);
+
 /**
  * iova_tree_foreach:
  *
@@ -694,8 +694,35 @@ unsigned long qemu_getauxval(unsigned long type);
 
 void qemu_set_tty_echo(int fd, bool echo);
 
+/**
+ * os_mem_prealloc:
+ * @fd: file descriptor backing @area, or -1
+ * @area: start of the memory to preallocate
+ * @sz: size of the memory to preallocate
+ * @smp_cpus: maximum number of threads to use
+ * @host_nodes: bitmap of the host NUMA nodes the memory is bound to, or NULL
+ * @maxnode: number of bits in @host_nodes
+ * @async: whether preallocation may still be running on return
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Preallocate memory by populating its pages.  The threads doing so run
+ * on the CPUs of @host_nodes, if any.  If @async is true, errors are only
+ * reported by os_mem_prealloc_finish(), which must be called before the
+ * memory is used; preallocation may still be synchronous, for example if
+ * the host does not support MADV_POPULATE_WRITE.
+ */
 void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
-                     Error **errp);
+                     const unsigned long *host_nodes, unsigned long maxnode,
+                     bool async, Error **errp);
+
+/**
+ * os_mem_prealloc_finish:
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait for all asynchronous preallocations started by os_mem_prealloc().
+ * Returns false if any of them failed.
+ */
+bool os_mem_prealloc_finish(Error **errp);
 
 /**
  * qemu_get_pid_name:
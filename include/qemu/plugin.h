@@ -88,9 +88,20 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_MEM_RING,     /* mem callbacks only */
     PLUGIN_N_CB_SUBTYPES,
 };
 
+/*
+ * Each vCPU's memory ring starts with this header, followed by the
+ * records.  head - tail is the number of pending records; both only ever
+ * increase and wrap around at 2^32.
+ */
+typedef struct PluginMemRingHeader {
+    uint32_t head;
+    uint32_t tail;
+} PluginMemRingHeader;
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -107,7 +118,14 @@ struct qemu_plugin_dyn_cb {
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            /* distance between vCPU elements, 0 for a single global */
+            size_t stride;
         } inline_insn;
+        struct {
+            void *base;         /* ring of vCPU 0 */
+            size_t stride;      /* distance between vCPU rings */
+            uint32_t mask;      /* number of records - 1 */
+        } mem_ring;
     };
 };
 
@@ -195,6 +213,8 @@ struct qemu_plugin_insn *qemu_plugin_tb_insn_get(struct qemu_plugin_tb *tb,
 void qemu_plugin_vcpu_init_hook(CPUState *cpu);
 void qemu_plugin_vcpu_exit_hook(CPUState *cpu);
 void qemu_plugin_tb_trans_cb(CPUState *cpu, struct qemu_plugin_tb *tb);
+void qemu_plugin_tb_mem_ring_records(struct qemu_plugin_tb *tb,
+                                     uint32_t n_records);
 void qemu_plugin_vcpu_idle_cb(CPUState *cpu);
 void qemu_plugin_vcpu_resume_cb(CPUState *cpu);
 void
@@ -50,7 +50,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -273,14 +273,85 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
  * enum qemu_plugin_op - describes an inline op
  *
  * @QEMU_PLUGIN_INLINE_ADD_U64: add an immediate value uint64_t
- *
- * Note: currently only a single inline op is supported.
+ * @QEMU_PLUGIN_INLINE_STORE_U64: store an immediate value uint64_t
  */
 
 enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
+    QEMU_PLUGIN_INLINE_STORE_U64,
 };
 
+/**
+ * struct qemu_plugin_scoreboard - per-vCPU storage for inline ops
+ *
+ * A scoreboard holds one element of a plugin-chosen size for every
+ * vCPU. Inline ops registered with the _per_vcpu variants of the
+ * registration functions only ever touch the element of the vCPU that
+ * executes them, so they give exact results without any locking even
+ * when vCPUs run in parallel.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of a scoreboard element
+ * @score: the scoreboard
+ * @offset: offset of the uint64_t in each element of @score
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a new scoreboard
+ * @element_size: size of the element of each vCPU
+ *
+ * All elements are zeroed, including those of vCPUs created later.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * Must not be called while translated code may still use @score, i.e.
+ * only from the atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get the element of a vCPU
+ * @score: scoreboard
+ * @vcpu_index: index of the vCPU
+ *
+ * The returned pointer is only valid until the next vCPU is created,
+ * because scoreboards may have to be moved to make room for it.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_get() - read the value of @entry for a vCPU
+ * @entry: scoreboard member
+ * @vcpu_index: index of the vCPU
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set the value of @entry for a vCPU
+ * @entry: scoreboard member
+ * @vcpu_index: index of the vCPU
+ * @val: new value
+ */
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - sum the values of @entry over all vCPUs
+ * @entry: scoreboard member
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -299,6 +370,22 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard member to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies to
+ * the element of @entry that belongs to the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -327,6 +414,22 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard member to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op applies
+ * to the element of @entry that belongs to the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -496,6 +599,99 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard member to operate on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_mem_inline(), but the op applies to the
+ * element of @entry that belongs to the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * typedef qemu_plugin_mem_record - a memory access logged in a ring
+ * @vaddr: virtual address of the access
+ * @info: the access, to be queried with the qemu_plugin_mem_* functions
+ * @reserved: padding
+ */
+typedef struct {
+    uint64_t vaddr;
+    qemu_plugin_meminfo_t info;
+    uint32_t reserved;
+} qemu_plugin_mem_record;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_ring_cb_t - memory ring drain callback
+ * @vcpu_index: the vCPU whose ring is drained
+ * @records: the oldest records in the ring
+ * @n: number of @records
+ * @lost: number of records that were overwritten before this drain
+ * @userdata: the pointer passed to qemu_plugin_mem_ring_new()
+ *
+ * A single drain may invoke the callback twice, when the records wrap
+ * around the end of the ring.
+ */
+typedef void
+(*qemu_plugin_vcpu_mem_ring_cb_t)(unsigned int vcpu_index,
+                                  const qemu_plugin_mem_record *records,
+                                  size_t n, uint64_t lost, void *userdata);
+
+/**
+ * struct qemu_plugin_mem_ring - per-vCPU ring of memory access records
+ *
+ * Accesses instrumented with qemu_plugin_register_vcpu_mem_ring() are
+ * appended to the ring of the executing vCPU by generated code, without
+ * calling into the plugin. The plugin gets the records in bulk through
+ * its drain callback, which runs in the vCPU thread before a TB whose
+ * records might not fit any more, and when the ring is full while
+ * logging accesses made by helpers.
+ *
+ * Records are only lost if a single TB performs more instrumented
+ * accesses than the ring can hold; the drain callback reports how many.
+ */
+struct qemu_plugin_mem_ring;
+
+/**
+ * qemu_plugin_mem_ring_new() - allocate memory access rings
+ * @n_records: records in the ring of each vCPU, rounded up to a power of 2
+ * @cb: drain callback
+ * @userdata: any plugin data to pass to @cb
+ */
+struct qemu_plugin_mem_ring *
+qemu_plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                         void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_mem_ring() - log memory accesses to a ring
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @ring: the ring to log the accesses to
+ */
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_mem_ring *ring);
+
+/**
+ * qemu_plugin_mem_ring_drain() - pass the pending records of a vCPU to
+ * the drain callback
+ * @ring: the ring
+ * @vcpu_index: the vCPU whose records are drained
+ *
+ * Must be called either from the thread of the vCPU, for example from
+ * its exit callback, or when no vCPU runs any more.
+ */
+void qemu_plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring,
+                                unsigned int vcpu_index);
+
 
 
 typedef void
@@ -16,8 +16,51 @@ enum QSPSortBy {
     QSP_SORT_BY_AVG_WAIT_TIME,
 };
 
+enum QSPType {
+    QSP_MUTEX,
+    QSP_BQL_MUTEX,
+    QSP_REC_MUTEX,
+    QSP_CONDVAR,
+    QSP_CO_MUTEX,
+    QSP_CO_RWLOCK,
+    QSP_CO_QUEUE,
+    QSP_RCU,
+};
+
+struct SyncProfileEntryList;
+
 void qsp_report(size_t max, enum QSPSortBy sort_by,
                 bool callsite_coalesce);
+struct SyncProfileEntryList *qsp_query(size_t max, enum QSPSortBy sort_by,
+                                       bool callsite_coalesce);
+
+/*
+ * Coroutine locks and RCU cannot be intercepted through function pointers
+ * like the thread primitives, so they time their waits themselves while the
+ * profiler is enabled:
+ *
+ *     int64_t t0 = qsp_wait_begin();
+ *     ...wait...
+ *     qsp_wait_end(obj, QSP_CO_MUTEX, file, line, t0);
+ */
+extern bool qsp_recording;
+
+int64_t qsp_clock(void);
+void qsp_wait_record(const void *obj, enum QSPType type, const char *file,
+                     int line, int64_t t0);
+
+static inline int64_t qsp_wait_begin(void)
+{
+    return unlikely(qatomic_read(&qsp_recording)) ? qsp_clock() : 0;
+}
+
+static inline void qsp_wait_end(const void *obj, enum QSPType type,
+                                const char *file, int line, int64_t t0)
+{
+    if (unlikely(t0)) {
+        qsp_wait_record(obj, type, file, line, t0);
+    }
+}
 
 bool qsp_is_enabled(void);
 void qsp_enable(void);
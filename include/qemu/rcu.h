@@ -64,6 +64,13 @@ struct rcu_reader_data {
 
     /* Data used by reader only */
     unsigned depth;
+    bool registered;
+
+    /*
+     * Callbacks queued by call_rcu1(), most recent first.  Pushed by the
+     * reader, taken by the call_rcu thread.
+     */
+    struct rcu_head *callbacks;
 
     /* Data used for registry, protected by rcu_registry_lock */
     QLIST_ENTRY(rcu_reader_data) node;
@@ -120,6 +127,25 @@ static inline void rcu_read_unlock(void)
 
 extern void synchronize_rcu(void);
 
+/*
+ * Like synchronize_rcu(), but asks readers to leave their critical sections
+ * and uses a faster, more intrusive process-wide barrier where available.
+ * Use it where the latency of the grace period matters more than the cost
+ * to the rest of the process.
+ */
+extern void synchronize_rcu_expedited(void);
+
+typedef struct RCUStats {
+    uint64_t grace_periods;
+    uint64_t expedited_grace_periods;
+    uint64_t grace_period_total_ns;
+    uint64_t grace_period_max_ns;
+    uint64_t callbacks;
+    uint64_t callback_batch_max;
+} RCUStats;
+
+void rcu_get_stats(RCUStats *stats);
+
 /*
  * Reader thread registration.
  */
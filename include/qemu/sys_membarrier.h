@@ -16,11 +16,14 @@
  */
 extern void smp_mb_global_init(void);
 extern void smp_mb_global(void);
+/* Faster than smp_mb_global(), but interrupts the CPUs running QEMU */
+extern void smp_mb_global_expedited(void);
 #define smp_mb_placeholder()       barrier()
 #else
 /* Keep it simple, execute a real memory barrier on both sides.  */
 static inline void smp_mb_global_init(void) {}
 #define smp_mb_global()            smp_mb()
+#define smp_mb_global_expedited()  smp_mb() /* same as smp_mb_global() */
 #define smp_mb_placeholder()       smp_mb()
 #endif
 
@@ -23,6 +23,7 @@
  */
 typedef struct AdapterInfo AdapterInfo;
 typedef struct AddressSpace AddressSpace;
+typedef struct AddressSpaceSectionCache AddressSpaceSectionCache;
 typedef struct AioContext AioContext;
 typedef struct Aml Aml;
 typedef struct AnnounceTimer AnnounceTimer;
@@ -0,0 +1,29 @@
+/*
+ * Dirty page rate limit common functions
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_DIRTYLIMIT_H
+#define QEMU_DIRTYLIMIT_H
+
+#include "hw/core/cpu.h"
+
+/**
+ * dirtylimit_in_service:
+ *
+ * Returns: true if a dirty page rate limit is set on any vCPU
+ */
+bool dirtylimit_in_service(void);
+
+/**
+ * dirtylimit_vcpu_execute:
+ * @cpu: the vCPU that exited because its dirty ring is full
+ *
+ * Put @cpu to sleep for the time computed by the dirty page rate
+ * limit, if any.  Called from the vCPU thread without the BQL.
+ */
+void dirtylimit_vcpu_execute(CPUState *cpu);
+
+#endif
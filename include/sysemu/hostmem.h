@@ -63,7 +63,7 @@ struct HostMemoryBackend {
 
     /* protected */
     uint64_t size;
-    bool merge, dump, use_canonical_path;
+    bool merge, merge_hints, dump, use_canonical_path;
     bool prealloc, is_mapped, share, reserve;
     uint32_t prealloc_threads;
     DECLARE_BITMAP(host_nodes, MAX_NODES + 1);
@@ -80,4 +80,11 @@ bool host_memory_backend_is_mapped(HostMemoryBackend *backend);
 size_t host_memory_backend_pagesize(HostMemoryBackend *memdev);
 char *host_memory_backend_get_name(HostMemoryBackend *backend);
 
+/*
+ * Waits for the preallocation of the backends created before the machine
+ * was ready, and drops the references that kept them alive meanwhile.
+ * Returns false if any preallocation failed.
+ */
+bool host_memory_backend_prealloc_finish(Error **errp);
+
 #endif
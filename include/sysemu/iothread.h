@@ -40,6 +40,9 @@ struct IOThread {
 
     /* AioContext AIO engine parameters */
     int64_t aio_max_batch;
+
+    /* Host CPUs of the thread pool workers, NULL to inherit our affinity */
+    unsigned long *thread_pool_cpus;
 };
 typedef struct IOThread IOThread;
 
@@ -16,6 +16,7 @@
 
 #include "qemu/queue.h"
 #include "hw/core/cpu.h"
+#include "exec/cpu-common.h"
 #include "exec/memattrs.h"
 #include "qemu/accel.h"
 #include "qom/object.h"
@@ -563,4 +564,19 @@ bool kvm_cpu_check_are_resettable(void);
 bool kvm_arch_cpu_check_are_resettable(void);
 
 bool kvm_dirty_ring_enabled(void);
+
+uint32_t kvm_dirty_ring_size(void);
+
+typedef void (*KVMDirtyRingPageHook)(ram_addr_t addr);
+
+/**
+ * kvm_dirty_ring_set_page_hook - get notified of reaped dirty pages
+ * @hook: function called with the ram address of every page collected
+ *        from the dirty rings, or NULL to remove the current hook
+ *
+ * The hook is called with the KVM slots lock held, from whatever thread
+ * reaps the dirty rings, so it must not block.  When this function
+ * returns, no call to a previously installed hook is in progress.
+ */
+void kvm_dirty_ring_set_page_hook(KVMDirtyRingPageHook hook);
 #endif
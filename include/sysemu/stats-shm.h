@@ -0,0 +1,58 @@
+/*
+ * Statistics published in shared memory
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_STATS_SHM_H
+#define SYSEMU_STATS_SHM_H
+
+#include "qom/object.h"
+
+#define TYPE_STATS_SHM "stats-shm"
+
+/*
+ * Layout of the file, see docs/interop/stats-shm.rst.  All fields are in
+ * host byte order.
+ */
+#define STATS_SHM_MAGIC     "QEMUSTAT"
+#define STATS_SHM_VERSION   1
+#define STATS_SHM_NAME_LEN  56
+
+typedef struct StatsShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t sequence;          /* odd while the entries are updated */
+    uint32_t nr_entries;
+    uint64_t size;              /* bytes used by the header and entries */
+    uint64_t timestamp_ns;      /* CLOCK_MONOTONIC of the last update */
+    uint64_t interval_ns;
+} StatsShmHeader;
+
+typedef struct StatsShmEntry {
+    char name[STATS_SHM_NAME_LEN];
+    uint64_t value;
+} StatsShmEntry;
+
+typedef struct StatsShmWriter StatsShmWriter;
+
+/*
+ * Called with the BQL held at every update, to add the statistics of a
+ * subsystem with stats_shm_add().
+ */
+typedef void StatsShmProvider(StatsShmWriter *w, void *opaque);
+
+#ifdef CONFIG_POSIX
+void stats_shm_register_provider(StatsShmProvider *fn, void *opaque);
+#else
+static inline void stats_shm_register_provider(StatsShmProvider *fn,
+                                               void *opaque)
+{
+}
+#endif
+void stats_shm_add(StatsShmWriter *w, const char *prefix, const char *name,
+                   uint64_t value);
+
+#endif
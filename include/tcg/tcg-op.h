@@ -1297,6 +1297,15 @@ static inline void tcg_gen_ext_i32_ptr(TCGv_ptr r, TCGv_i32 a)
 #endif
 }
 
+static inline void tcg_gen_extu_i32_ptr(TCGv_ptr r, TCGv_i32 a)
+{
+#if UINTPTR_MAX == UINT32_MAX
+    tcg_gen_mov_i32((NAT)r, a);
+#else
+    tcg_gen_extu_i32_i64((NAT)r, a);
+#endif
+}
+
 static inline void tcg_gen_trunc_i64_ptr(TCGv_ptr r, TCGv_i64 a)
 {
 #if UINTPTR_MAX == UINT32_MAX
@@ -801,6 +801,8 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+size_t tcg_region_evict(size_t n, GTraverseFunc invalidate);
+size_t tcg_region_count(void);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -35,6 +35,10 @@ qio_channel_file_new_fd(int fd)
 
     ioc->fd = fd;
 
+    if (lseek(fd, 0, SEEK_CUR) != (off_t)-1) {
+        qio_channel_set_feature(QIO_CHANNEL(ioc), QIO_CHANNEL_FEATURE_SEEKABLE);
+    }
+
     trace_qio_channel_file_new_fd(ioc, fd);
 
     return ioc;
@@ -59,6 +63,10 @@ qio_channel_file_new_path(const char *path,
         return NULL;
     }
 
+    if (lseek(ioc->fd, 0, SEEK_CUR) != (off_t)-1) {
+        qio_channel_set_feature(QIO_CHANNEL(ioc), QIO_CHANNEL_FEATURE_SEEKABLE);
+    }
+
     trace_qio_channel_file_new_path(ioc, path, flags, mode, ioc->fd);
 
     return ioc;
@@ -114,6 +122,7 @@ static ssize_t qio_channel_file_writev(QIOChannel *ioc,
                                        size_t niov,
                                        int *fds,
                                        size_t nfds,
+                                       int flags,
                                        Error **errp)
 {
     QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
@@ -135,6 +144,61 @@ static ssize_t qio_channel_file_writev(QIOChannel *ioc,
     return ret;
 }
 
+static ssize_t qio_channel_file_pwritev(QIOChannel *ioc,
+                                        const struct iovec *iov,
+                                        size_t niov,
+                                        off_t offset,
+                                        Error **errp)
+{
+    QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
+    ssize_t ret;
+
+ retry:
+#ifdef CONFIG_PREADV
+    ret = pwritev(fioc->fd, iov, niov, offset);
+#else
+    /* Partial writes are resumed by qio_channel_pwritev() */
+    ret = pwrite(fioc->fd, iov[0].iov_base, iov[0].iov_len, offset);
+#endif
+    if (ret <= 0) {
+        if (ret < 0 && errno == EINTR) {
+            goto retry;
+        }
+        error_setg_errno(errp, ret < 0 ? errno : EIO,
+                         "Unable to write to file at offset %lld",
+                         (long long int)offset);
+        return -1;
+    }
+    return ret;
+}
+
+static ssize_t qio_channel_file_preadv(QIOChannel *ioc,
+                                       const struct iovec *iov,
+                                       size_t niov,
+                                       off_t offset,
+                                       Error **errp)
+{
+    QIOChannelFile *fioc = QIO_CHANNEL_FILE(ioc);
+    ssize_t ret;
+
+ retry:
+#ifdef CONFIG_PREADV
+    ret = preadv(fioc->fd, iov, niov, offset);
+#else
+    ret = pread(fioc->fd, iov[0].iov_base, iov[0].iov_len, offset);
+#endif
+    if (ret < 0) {
+        if (errno == EINTR) {
+            goto retry;
+        }
+        error_setg_errno(errp, errno,
+                         "Unable to read from file at offset %lld",
+                         (long long int)offset);
+        return -1;
+    }
+    return ret;
+}
+
 static int qio_channel_file_set_blocking(QIOChannel *ioc,
                                          bool enabled,
                                          Error **errp)
@@ -213,6 +277,8 @@ static void qio_channel_file_class_init(ObjectClass *klass,
     ioc_klass->io_readv = qio_channel_file_readv;
     ioc_klass->io_set_blocking = qio_channel_file_set_blocking;
     ioc_klass->io_seek = qio_channel_file_seek;
+    ioc_klass->io_pwritev = qio_channel_file_pwritev;
+    ioc_klass->io_preadv = qio_channel_file_preadv;
     ioc_klass->io_close = qio_channel_file_close;
     ioc_klass->io_create_watch = qio_channel_file_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_file_set_aio_fd_handler;
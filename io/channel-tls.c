@@ -22,6 +22,7 @@
 #include "qapi/error.h"
 #include "qemu/module.h"
 #include "io/channel-tls.h"
+#include "io/channel-socket.h"
 #include "trace.h"
 #include "qemu/atomic.h"
 
@@ -152,6 +153,37 @@ static gboolean qio_channel_tls_handshake_io(QIOChannel *ioc,
                                              GIOCondition condition,
                                              gpointer user_data);
 
+/*
+ * Let the kernel encrypt outgoing records if the credentials ask for it.
+ * This needs the socket itself, so it is only done for TCP channels.
+ */
+static int qio_channel_tls_enable_ktls(QIOChannelTLS *ioc, Error **errp)
+{
+    QIOChannelSocket *sioc;
+    int ret;
+
+    if (!object_dynamic_cast(OBJECT(ioc->master), TYPE_QIO_CHANNEL_SOCKET)) {
+        return 0;
+    }
+    sioc = QIO_CHANNEL_SOCKET(ioc->master);
+    if (sioc->localAddr.ss_family != AF_INET &&
+        sioc->localAddr.ss_family != AF_INET6) {
+        return 0;
+    }
+
+    ret = qcrypto_tls_session_enable_ktls_tx(ioc->session, sioc->fd, errp);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    ioc->ktls_tx = true;
+    trace_qio_channel_tls_ktls_tx(ioc);
+    /* The kernel copies the data, so writes never need to be flushed */
+    qio_channel_set_feature(QIO_CHANNEL(ioc),
+                            QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    return 0;
+}
+
 static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
                                            QIOTask *task,
                                            GMainContext *context)
@@ -175,6 +207,9 @@ static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
             qio_task_set_error(task, err);
         } else {
             trace_qio_channel_tls_credentials_allow(ioc);
+            if (qio_channel_tls_enable_ktls(ioc, &err) < 0) {
+                qio_task_set_error(task, err);
+            }
         }
         qio_task_complete(task);
     } else {
@@ -301,12 +336,24 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
                                       size_t niov,
                                       int *fds,
                                       size_t nfds,
+                                      int flags,
                                       Error **errp)
 {
     QIOChannelTLS *tioc = QIO_CHANNEL_TLS(ioc);
     size_t i;
     ssize_t done = 0;
 
+    if (tioc->ktls_tx) {
+        /*
+         * The kernel encrypts the plain text.  It does not support
+         * MSG_ZEROCOPY on TLS sockets, but since it copies the data while
+         * encrypting it, the buffers can be reused as soon as this returns.
+         */
+        flags &= ~QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+        return qio_channel_writev_full(tioc->master, iov, niov, fds, nfds,
+                                       flags, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
@@ -17,8 +17,12 @@
 #include "qemu/module.h"
 #include "block/aio.h"
 #include "block/block.h"
+#include "block/thread-pool.h"
 #include "sysemu/iothread.h"
 #include "qapi/error.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
+#include "qemu/bitmap.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qemu/error-report.h"
 #include "qemu/rcu.h"
@@ -138,6 +142,7 @@ static void iothread_instance_finalize(Object *obj)
         g_main_loop_unref(iothread->main_loop);
         iothread->main_loop = NULL;
     }
+    g_free(iothread->thread_pool_cpus);
     qemu_sem_destroy(&iothread->init_done_sem);
 }
 
@@ -168,6 +173,15 @@ static void iothread_set_aio_context_params(IOThread *iothread, Error **errp)
     aio_context_set_aio_params(iothread->ctx,
                                iothread->aio_max_batch,
                                errp);
+    if (*errp) {
+        return;
+    }
+
+    if (iothread->thread_pool_cpus) {
+        /* The iothread is not running yet, so the pool can be created here */
+        thread_pool_set_cpus(aio_get_thread_pool(iothread->ctx),
+                             iothread->thread_pool_cpus, errp);
+    }
 }
 
 static void iothread_complete(UserCreatable *obj, Error **errp)
@@ -313,6 +327,66 @@ static void iothread_set_aio_param(Object *obj, Visitor *v,
     }
 }
 
+static void iothread_get_thread_pool_cpus(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    uint16List *cpus = NULL;
+    uint16List **tail = &cpus;
+    unsigned long cpu;
+
+    if (iothread->thread_pool_cpus) {
+        for (cpu = find_first_bit(iothread->thread_pool_cpus,
+                                  THREAD_POOL_MAX_CPUS);
+             cpu < THREAD_POOL_MAX_CPUS;
+             cpu = find_next_bit(iothread->thread_pool_cpus,
+                                 THREAD_POOL_MAX_CPUS, cpu + 1)) {
+            QAPI_LIST_APPEND(tail, cpu);
+        }
+    }
+
+    visit_type_uint16List(v, name, &cpus, errp);
+    qapi_free_uint16List(cpus);
+}
+
+static void iothread_set_thread_pool_cpus(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    uint16List *l, *cpus = NULL;
+
+    if (iothread->ctx) {
+        error_setg(errp, "Property '%s' cannot be changed after the iothread "
+                   "has started", name);
+        return;
+    }
+
+    if (!visit_type_uint16List(v, name, &cpus, errp)) {
+        return;
+    }
+
+    for (l = cpus; l; l = l->next) {
+        if (l->value >= THREAD_POOL_MAX_CPUS) {
+            error_setg(errp, "Invalid %s value: %d", name, l->value);
+            goto out;
+        }
+    }
+
+    g_free(iothread->thread_pool_cpus);
+    iothread->thread_pool_cpus = NULL;
+    if (cpus) {
+        iothread->thread_pool_cpus = bitmap_new(THREAD_POOL_MAX_CPUS);
+        for (l = cpus; l; l = l->next) {
+            set_bit(l->value, iothread->thread_pool_cpus);
+        }
+    }
+
+out:
+    qapi_free_uint16List(cpus);
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -334,6 +408,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_aio_param,
                               iothread_set_aio_param,
                               NULL, &aio_max_batch_info);
+    object_class_property_add(klass, "x-thread-pool-cpus", "uint16List",
+                              iothread_get_thread_pool_cpus,
+                              iothread_set_thread_pool_cpus,
+                              NULL, NULL);
 }
 
 static const TypeInfo iothread_info = {
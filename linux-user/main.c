@@ -375,6 +375,13 @@ static void handle_arg_singlestep(const char *arg)
     singlestep = 1;
 }
 
+static bool enable_perfmap;
+
+static void handle_arg_perfmap(const char *arg)
+{
+    enable_perfmap = true;
+}
+
 static void handle_arg_strace(const char *arg)
 {
     enable_strace = true;
@@ -455,6 +462,8 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "write a perf map of the generated code to /tmp"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_seed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
@@ -723,6 +732,10 @@ int main(int argc, char **argv, char **envp)
     {
         AccelClass *ac = ACCEL_GET_CLASS(current_accel());
 
+        if (enable_perfmap) {
+            object_property_set_bool(OBJECT(current_accel()), "perf-map",
+                                     true, &error_abort);
+        }
         accel_init_interfaces(ac);
         ac->init_machine(NULL);
     }
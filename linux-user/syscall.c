@@ -7690,6 +7690,18 @@ static inline abi_long host_to_target_statx(struct target_statx *host_stx,
     if (!lock_user_struct(VERIFY_WRITE, target_stx, target_addr,  0)) {
         return -TARGET_EFAULT;
     }
+
+#if defined(HOST_WORDS_BIGENDIAN) == defined(TARGET_WORDS_BIGENDIAN)
+    /*
+     * struct statx has the same layout on every architecture, so with
+     * matching byte order the buffer filled by the host kernel can be
+     * passed on as is.
+     */
+    QEMU_BUILD_BUG_ON(sizeof(struct target_statx) != 0x100);
+    QEMU_BUILD_BUG_ON(offsetof(struct target_statx, stx_atime) != 0x40);
+    QEMU_BUILD_BUG_ON(offsetof(struct target_statx, stx_rdev_major) != 0x80);
+    memcpy(target_stx, host_stx, sizeof(*target_stx));
+#else
     memset(target_stx, 0, sizeof(*target_stx));
 
     __put_user(host_stx->stx_mask, &target_stx->stx_mask);
@@ -7715,6 +7727,7 @@ static inline abi_long host_to_target_statx(struct target_statx *host_stx,
     __put_user(host_stx->stx_rdev_minor, &target_stx->stx_rdev_minor);
     __put_user(host_stx->stx_dev_major, &target_stx->stx_dev_major);
     __put_user(host_stx->stx_dev_minor, &target_stx->stx_dev_minor);
+#endif
 
     unlock_user_struct(target_stx, target_addr, 1);
 
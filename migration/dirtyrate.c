@@ -157,7 +157,7 @@ static void cleanup_dirtyrate_stat(struct DirtyRateConfig config)
 {
     /* last calc-dirty-rate qmp use dirty ring mode */
     if (dirtyrate_mode == DIRTY_RATE_MEASURE_MODE_DIRTY_RING) {
-        free(DirtyStat.dirty_ring.rates);
+        g_free(DirtyStat.dirty_ring.rates);
         DirtyStat.dirty_ring.rates = NULL;
     }
 }
@@ -421,17 +421,16 @@ static void dirtyrate_global_dirty_log_stop(void)
     qemu_mutex_unlock_iothread();
 }
 
-static int64_t do_calculate_dirtyrate_vcpu(DirtyPageRecord dirty_pages)
+static int64_t do_calculate_dirtyrate(DirtyPageRecord dirty_pages,
+                                      int64_t calc_time_ms)
 {
     uint64_t memory_size_MB;
-    int64_t time_s;
     uint64_t increased_dirty_pages =
         dirty_pages.end_pages - dirty_pages.start_pages;
 
     memory_size_MB = (increased_dirty_pages * TARGET_PAGE_SIZE) >> 20;
-    time_s = DirtyStat.calc_time;
 
-    return memory_size_MB / time_s;
+    return memory_size_MB * 1000 / calc_time_ms;
 }
 
 static inline void record_dirtypages_bitmap(DirtyPageRecord *dirty_pages,
@@ -444,9 +443,10 @@ static inline void record_dirtypages_bitmap(DirtyPageRecord *dirty_pages,
     }
 }
 
-static void do_calculate_dirtyrate_bitmap(DirtyPageRecord dirty_pages)
+static void do_calculate_dirtyrate_bitmap(DirtyPageRecord dirty_pages,
+                                          int64_t calc_time_ms)
 {
-    DirtyStat.dirty_rate = do_calculate_dirtyrate_vcpu(dirty_pages);
+    DirtyStat.dirty_rate = do_calculate_dirtyrate(dirty_pages, calc_time_ms);
 }
 
 static inline void dirtyrate_manual_reset_protect(void)
@@ -504,59 +504,77 @@ static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
 
     record_dirtypages_bitmap(&dirty_pages, false);
 
-    do_calculate_dirtyrate_bitmap(dirty_pages);
+    do_calculate_dirtyrate_bitmap(dirty_pages, msec);
 }
 
-static void calculate_dirtyrate_dirty_ring(struct DirtyRateConfig config)
+int64_t vcpu_calculate_dirtyrate(int64_t calc_time_ms, VcpuStat *stat)
 {
     CPUState *cpu;
-    int64_t msec = 0;
-    int64_t start_time;
-    uint64_t dirtyrate = 0;
-    uint64_t dirtyrate_sum = 0;
     DirtyPageRecord *dirty_pages;
+    int64_t start_time;
+    int64_t duration;
+    int64_t dirtyrate;
     int nvcpu = 0;
-    int i = 0;
+    int i;
 
     CPU_FOREACH(cpu) {
         nvcpu++;
     }
 
-    dirty_pages = malloc(sizeof(*dirty_pages) * nvcpu);
-
-    DirtyStat.dirty_ring.nvcpu = nvcpu;
-    DirtyStat.dirty_ring.rates = malloc(sizeof(DirtyRateVcpu) * nvcpu);
+    dirty_pages = g_new0(DirtyPageRecord, nvcpu);
 
-    dirtyrate_global_dirty_log_start();
+    stat->nvcpu = nvcpu;
+    stat->rates = g_new0(DirtyRateVcpu, nvcpu);
 
     CPU_FOREACH(cpu) {
         record_dirtypages(dirty_pages, cpu, true);
     }
 
     start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
-    DirtyStat.start_time = start_time / 1000;
+    duration = set_sample_page_period(calc_time_ms, start_time);
 
-    msec = config.sample_period_seconds * 1000;
-    msec = set_sample_page_period(msec, start_time);
-    DirtyStat.calc_time = msec / 1000;
-
-    dirtyrate_global_dirty_log_stop();
+    /* fetch the pages that are still sitting in the dirty rings */
+    qemu_mutex_lock_iothread();
+    memory_global_dirty_log_sync();
+    qemu_mutex_unlock_iothread();
 
     CPU_FOREACH(cpu) {
         record_dirtypages(dirty_pages, cpu, false);
     }
 
-    for (i = 0; i < DirtyStat.dirty_ring.nvcpu; i++) {
-        dirtyrate = do_calculate_dirtyrate_vcpu(dirty_pages[i]);
+    for (i = 0; i < nvcpu; i++) {
+        dirtyrate = do_calculate_dirtyrate(dirty_pages[i], duration);
         trace_dirtyrate_do_calculate_vcpu(i, dirtyrate);
 
-        DirtyStat.dirty_ring.rates[i].id = i;
-        DirtyStat.dirty_ring.rates[i].dirty_rate = dirtyrate;
-        dirtyrate_sum += dirtyrate;
+        stat->rates[i].id = i;
+        stat->rates[i].dirty_rate = dirtyrate;
+    }
+
+    g_free(dirty_pages);
+    return duration;
+}
+
+static void calculate_dirtyrate_dirty_ring(struct DirtyRateConfig config)
+{
+    int64_t msec;
+    uint64_t dirtyrate_sum = 0;
+    int i;
+
+    dirtyrate_global_dirty_log_start();
+
+    DirtyStat.start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) / 1000;
+
+    msec = vcpu_calculate_dirtyrate(config.sample_period_seconds * 1000,
+                                    &DirtyStat.dirty_ring);
+    DirtyStat.calc_time = msec / 1000;
+
+    dirtyrate_global_dirty_log_stop();
+
+    for (i = 0; i < DirtyStat.dirty_ring.nvcpu; i++) {
+        dirtyrate_sum += DirtyStat.dirty_ring.rates[i].dirty_rate;
     }
 
     DirtyStat.dirty_rate = dirtyrate_sum;
-    free(dirty_pages);
 }
 
 static void calculate_dirtyrate_sample_vm(struct DirtyRateConfig config)
@@ -85,4 +85,12 @@ struct DirtyRateStat {
 };
 
 void *get_dirtyrate_thread(void *arg);
+
+/*
+ * Measure the dirty page rate of every vCPU over @calc_time_ms, using the
+ * per-vCPU counters of the KVM dirty ring.  Dirty tracking must have been
+ * started by the caller.  @stat->rates is allocated and must be freed with
+ * g_free().  Returns the duration of the measurement in milliseconds.
+ */
+int64_t vcpu_calculate_dirtyrate(int64_t calc_time_ms, VcpuStat *stat);
 #endif
@@ -0,0 +1,174 @@
+/*
+ * QEMU live migration to and from a file
+ *
+ * The URI is "file:<path>[,offset=<offset>]".  The migration stream
+ * starts at the given offset of the file, which must be seekable when
+ * the fixed-ram capability is enabled.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qapi/error.h"
+#include "channel.h"
+#include "file.h"
+#include "migration.h"
+#include "multifd.h"
+#include "io/channel-file.h"
+#include "trace.h"
+
+#define OFFSET_OPTION ",offset="
+
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
+/* Remove the offset option from @filespec and return it in @offsetp. */
+static int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
+{
+    char *option = strstr(filespec, OFFSET_OPTION);
+    int ret;
+
+    if (option) {
+        *option = 0;
+        option += sizeof(OFFSET_OPTION) - 1;
+        ret = qemu_strtosz(option, NULL, offsetp);
+        if (ret) {
+            error_setg_errno(errp, -ret, "file URI has bad offset %s", option);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void file_send_channel_create(QIOTaskFunc f, void *data)
+{
+    QIOChannelFile *ioc;
+    QIOTask *task;
+    Error *err = NULL;
+    int flags = O_WRONLY;
+
+#ifdef O_DIRECT
+    if (migrate_direct_io()) {
+        flags |= O_DIRECT;
+    }
+#endif
+
+    ioc = qio_channel_file_new_path(outgoing_args.fname, flags, 0, &err);
+
+    task = qio_task_new(OBJECT(ioc), f, data, NULL);
+    if (!ioc) {
+        qio_task_set_error(task, err);
+    }
+    qio_task_complete(task);
+}
+
+int file_send_channel_destroy(QIOChannel *send)
+{
+    object_unref(OBJECT(send));
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = NULL;
+    return 0;
+}
+
+void file_start_outgoing_migration(MigrationState *s, const char *filespec,
+                                   Error **errp)
+{
+    g_autofree char *filename = g_strdup(filespec);
+    QIOChannelFile *fioc;
+    uint64_t offset = 0;
+    QIOChannel *ioc;
+
+    trace_migration_file_outgoing(filename);
+
+    if (file_parse_offset(filename, &offset, errp)) {
+        return;
+    }
+
+    if (migrate_use_multifd() && !migrate_fixed_ram()) {
+        error_setg(errp, "multifd to a file requires the fixed-ram "
+                   "capability");
+        return;
+    }
+
+    if (migrate_direct_io() &&
+        (!migrate_fixed_ram() || !migrate_use_multifd())) {
+        error_setg(errp, "direct-io requires the fixed-ram and multifd "
+                   "capabilities");
+        return;
+    }
+
+    fioc = qio_channel_file_new_path(filename, O_CREAT | O_WRONLY | O_TRUNC,
+                                     0600, errp);
+    if (!fioc) {
+        return;
+    }
+
+    ioc = QIO_CHANNEL(fioc);
+    if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
+        object_unref(OBJECT(ioc));
+        return;
+    }
+
+    if (migrate_fixed_ram() &&
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        error_setg(errp, "fixed-ram requires a seekable file");
+        object_unref(OBJECT(ioc));
+        return;
+    }
+
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = g_strdup(filename);
+
+    qio_channel_set_name(ioc, "migration-file-outgoing");
+    migration_channel_connect(s, ioc, NULL, NULL);
+    object_unref(OBJECT(ioc));
+}
+
+static gboolean file_accept_incoming_migration(QIOChannel *ioc,
+                                               GIOCondition condition,
+                                               gpointer opaque)
+{
+    migration_channel_process_incoming(ioc);
+    object_unref(OBJECT(ioc));
+    return G_SOURCE_REMOVE;
+}
+
+void file_start_incoming_migration(const char *filespec, Error **errp)
+{
+    g_autofree char *filename = g_strdup(filespec);
+    QIOChannelFile *fioc;
+    uint64_t offset = 0;
+    QIOChannel *ioc;
+
+    trace_migration_file_incoming(filename);
+
+    if (file_parse_offset(filename, &offset, errp)) {
+        return;
+    }
+
+    if (migrate_use_multifd() && !migrate_fixed_ram()) {
+        error_setg(errp, "multifd from a file requires the fixed-ram "
+                   "capability");
+        return;
+    }
+
+    fioc = qio_channel_file_new_path(filename, O_RDONLY, 0, errp);
+    if (!fioc) {
+        return;
+    }
+
+    ioc = QIO_CHANNEL(fioc);
+    if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
+        object_unref(OBJECT(ioc));
+        return;
+    }
+
+    qio_channel_set_name(ioc, "migration-file-incoming");
+    qio_channel_add_watch_full(ioc, G_IO_IN,
+                               file_accept_incoming_migration,
+                               NULL, NULL,
+                               g_main_context_get_thread_default());
+}
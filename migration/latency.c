@@ -0,0 +1,178 @@
+/*
+ * Latency histograms of the migration stages
+ *
+ * The samples are taken by the migration thread and by the multifd send
+ * threads concurrently, so the counters are Stat64 and the list of the
+ * stop-and-copy sections is protected by a lock.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/stats64.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/clone-visitor.h"
+#include "qapi/qapi-visit-migration.h"
+#include "latency.h"
+#include "trace.h"
+
+typedef struct LatencyHistogram {
+    Stat64 count;
+    Stat64 total;
+    Stat64 max;
+    Stat64 buckets[MIGRATION_LATENCY_BUCKETS];
+} LatencyHistogram;
+
+static const char *const latency_stage_names[MIGRATION_LATENCY__MAX] = {
+    [MIGRATION_LATENCY_BITMAP_SYNC] = "bitmap-sync",
+    [MIGRATION_LATENCY_FIND_DIRTY_BLOCK] = "find-dirty-block",
+    [MIGRATION_LATENCY_MULTIFD_SEND_PREPARE] = "multifd-send-prepare",
+    [MIGRATION_LATENCY_MULTIFD_SEND_WRITE] = "multifd-send-write",
+};
+
+static struct {
+    bool enabled;
+    LatencyHistogram stages[MIGRATION_LATENCY__MAX];
+    QemuMutex lock;
+    /* sections of the stop-and-copy phase, protected by @lock */
+    MigrationDeviceLatencyList *devices;
+    MigrationDeviceLatencyList **devices_tail;
+} latency;
+
+static void __attribute__((constructor)) migration_latency_init(void)
+{
+    qemu_mutex_init(&latency.lock);
+    latency.devices_tail = &latency.devices;
+}
+
+void migration_latency_reset(bool enable)
+{
+    int i;
+
+    for (i = 0; i < MIGRATION_LATENCY__MAX; i++) {
+        LatencyHistogram *h = &latency.stages[i];
+        int j;
+
+        stat64_init(&h->count, 0);
+        stat64_init(&h->total, 0);
+        stat64_init(&h->max, 0);
+        for (j = 0; j < MIGRATION_LATENCY_BUCKETS; j++) {
+            stat64_init(&h->buckets[j], 0);
+        }
+    }
+
+    qemu_mutex_lock(&latency.lock);
+    qapi_free_MigrationDeviceLatencyList(latency.devices);
+    latency.devices = NULL;
+    latency.devices_tail = &latency.devices;
+    qemu_mutex_unlock(&latency.lock);
+
+    qatomic_set(&latency.enabled, enable);
+}
+
+int64_t migration_latency_start(void)
+{
+    if (!qatomic_read(&latency.enabled) &&
+        !trace_event_get_state_backends(TRACE_MIGRATION_LATENCY) &&
+        !trace_event_get_state_backends(TRACE_MIGRATION_LATENCY_DEVICE)) {
+        return 0;
+    }
+    return qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+static uint64_t latency_since(int64_t start)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    return now > start ? now - start : 0;
+}
+
+void migration_latency_record(MigrationLatencyStage stage, uint64_t ns)
+{
+    LatencyHistogram *h = &latency.stages[stage];
+    unsigned bucket = ns ? 64 - clz64(ns) : 0;
+
+    trace_migration_latency(latency_stage_names[stage], ns);
+    if (!qatomic_read(&latency.enabled)) {
+        return;
+    }
+
+    stat64_add(&h->count, 1);
+    stat64_add(&h->total, ns);
+    stat64_max(&h->max, ns);
+    stat64_add(&h->buckets[MIN(bucket, MIGRATION_LATENCY_BUCKETS - 1)], 1);
+}
+
+void migration_latency_end(MigrationLatencyStage stage, int64_t start)
+{
+    if (start) {
+        migration_latency_record(stage, latency_since(start));
+    }
+}
+
+void migration_latency_device_end(const char *idstr, uint32_t instance_id,
+                                  bool iterable, int64_t start)
+{
+    MigrationDeviceLatency *dev;
+    uint64_t ns;
+
+    if (!start) {
+        return;
+    }
+
+    ns = latency_since(start);
+    trace_migration_latency_device(idstr, instance_id, iterable, ns);
+    if (!qatomic_read(&latency.enabled)) {
+        return;
+    }
+
+    dev = g_new0(MigrationDeviceLatency, 1);
+    dev->idstr = g_strdup(idstr);
+    dev->instance_id = instance_id;
+    dev->iterable = iterable;
+    dev->time = ns;
+
+    qemu_mutex_lock(&latency.lock);
+    QAPI_LIST_APPEND(latency.devices_tail, dev);
+    qemu_mutex_unlock(&latency.lock);
+}
+
+static MigrationLatencyHistogram *latency_histogram_query(LatencyHistogram *h)
+{
+    MigrationLatencyHistogram *info = g_new0(MigrationLatencyHistogram, 1);
+    uint64List **tail = &info->buckets;
+    int i;
+
+    info->count = stat64_get(&h->count);
+    info->total = stat64_get(&h->total);
+    info->max = stat64_get(&h->max);
+    for (i = 0; i < MIGRATION_LATENCY_BUCKETS; i++) {
+        QAPI_LIST_APPEND(tail, stat64_get(&h->buckets[i]));
+    }
+    return info;
+}
+
+MigrationLatencyStats *migration_latency_query(void)
+{
+    MigrationLatencyStats *info = g_new0(MigrationLatencyStats, 1);
+    LatencyHistogram *h = latency.stages;
+
+    info->bitmap_sync =
+        latency_histogram_query(&h[MIGRATION_LATENCY_BITMAP_SYNC]);
+    info->find_dirty_block =
+        latency_histogram_query(&h[MIGRATION_LATENCY_FIND_DIRTY_BLOCK]);
+    info->multifd_send_prepare =
+        latency_histogram_query(&h[MIGRATION_LATENCY_MULTIFD_SEND_PREPARE]);
+    info->multifd_send_write =
+        latency_histogram_query(&h[MIGRATION_LATENCY_MULTIFD_SEND_WRITE]);
+
+    qemu_mutex_lock(&latency.lock);
+    info->stop_and_copy = QAPI_CLONE(MigrationDeviceLatencyList,
+                                     latency.devices);
+    qemu_mutex_unlock(&latency.lock);
+
+    return info;
+}
@@ -0,0 +1,53 @@
+/*
+ * Latency histograms of the migration stages
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MIGRATION_LATENCY_H
+#define QEMU_MIGRATION_LATENCY_H
+
+#include "qapi/qapi-types-migration.h"
+
+/* Samples of 2^(MIGRATION_LATENCY_BUCKETS - 1) ns or more share a bucket */
+#define MIGRATION_LATENCY_BUCKETS 36
+
+typedef enum MigrationLatencyStage {
+    MIGRATION_LATENCY_BITMAP_SYNC,
+    MIGRATION_LATENCY_FIND_DIRTY_BLOCK,
+    MIGRATION_LATENCY_MULTIFD_SEND_PREPARE,
+    MIGRATION_LATENCY_MULTIFD_SEND_WRITE,
+    MIGRATION_LATENCY__MAX,
+} MigrationLatencyStage;
+
+/*
+ * Clear the histograms at the start of a migration, and collect the
+ * samples from now on if @enable is true.
+ */
+void migration_latency_reset(bool enable);
+
+/*
+ * Start time of a sample, to be given to migration_latency_end() or
+ * migration_latency_device_end().  Returns 0 if the samples are neither
+ * collected nor traced, so that the clock is not read for nothing.
+ */
+int64_t migration_latency_start(void);
+
+/* Record a sample of @stage that began at @start */
+void migration_latency_end(MigrationLatencyStage stage, int64_t start);
+
+/* Record a sample of @ns nanoseconds for @stage */
+void migration_latency_record(MigrationLatencyStage stage, uint64_t ns);
+
+/*
+ * Record the time spent since @start saving the section @idstr/@instance_id
+ * during the stop-and-copy phase.
+ */
+void migration_latency_device_end(const char *idstr, uint32_t instance_id,
+                                  bool iterable, int64_t start);
+
+/* Returns the histograms collected since the last reset */
+MigrationLatencyStats *migration_latency_query(void);
+
+#endif
@@ -20,10 +20,12 @@
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/stats-shm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -32,6 +34,7 @@
 #include "savevm.h"
 #include "qemu-file-channel.h"
 #include "qemu-file.h"
+#include "tls.h"
 #include "migration/vmstate.h"
 #include "block/block.h"
 #include "qapi/error.h"
@@ -57,10 +60,12 @@
 #include "net/announce.h"
 #include "qemu/queue.h"
 #include "multifd.h"
+#include "latency.h"
 #include "qemu/yank.h"
 #include "sysemu/cpus.h"
 #include "yank_functions.h"
 #include "sysemu/qtest.h"
+#include "sysemu/kvm.h"
 
 #define MAX_THROTTLE  (128 << 20)      /* Migration transfer speed throttling */
 
@@ -101,6 +106,14 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+/* Number of threads used to sync the dirty bitmap, 1 means no helpers */
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 1
+/* Let the multifd channels detect zero pages */
+#define DEFAULT_MIGRATE_MULTIFD_ZERO_PAGE true
+/* Number of postcopy fault threads on the destination */
+#define DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS 1
+#define DEFAULT_MIGRATE_DIRECT_IO false
+#define DEFAULT_MIGRATE_CPU_THROTTLE_PREDICTIVE false
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -155,7 +168,6 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_POSTCOPY_BLOCKTIME,
     MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE,
     MIGRATION_CAPABILITY_RETURN_PATH,
-    MIGRATION_CAPABILITY_MULTIFD,
     MIGRATION_CAPABILITY_PAUSE_BEFORE_SWITCHOVER,
     MIGRATION_CAPABILITY_AUTO_CONVERGE,
     MIGRATION_CAPABILITY_RELEASE_RAM,
@@ -187,11 +199,27 @@ static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp)
     return (a > b) - (a < b);
 }
 
+static void migration_stats_shm(StatsShmWriter *w, void *opaque)
+{
+    MigrationState *s = opaque;
+
+    stats_shm_add(w, "migration", "status", qatomic_read(&s->state));
+    stats_shm_add(w, "migration", "transferred", ram_counters.transferred);
+    stats_shm_add(w, "migration", "remaining", ram_bytes_remaining());
+    stats_shm_add(w, "migration", "dirty_pages_rate",
+                  ram_counters.dirty_pages_rate);
+    stats_shm_add(w, "migration", "dirty_sync_count",
+                  ram_counters.dirty_sync_count);
+    stats_shm_add(w, "migration", "postcopy_requests",
+                  ram_counters.postcopy_requests);
+}
+
 void migration_object_init(void)
 {
     /* This can only be called once. */
     assert(!current_migration);
     current_migration = MIGRATION_OBJ(object_new(TYPE_MIGRATION));
+    stats_shm_register_provider(migration_stats_shm, current_migration);
 
     /*
      * Init the migrate incoming object as well no matter whether
@@ -203,6 +231,7 @@ void migration_object_init(void)
     current_incoming->postcopy_remote_fds =
         g_array_new(FALSE, TRUE, sizeof(struct PostCopyFD));
     qemu_mutex_init(&current_incoming->rp_mutex);
+    qemu_mutex_init(&current_incoming->req_pages_mutex);
     qemu_event_init(&current_incoming->main_thread_load_event, false);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_dst, 0);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_fault, 0);
@@ -283,6 +312,11 @@ void migration_incoming_state_destroy(void)
         qemu_fclose(mis->from_src_file);
         mis->from_src_file = NULL;
     }
+    if (mis->postcopy_qemufile_dst) {
+        migration_ioc_unregister_yank_from_file(mis->postcopy_qemufile_dst);
+        qemu_fclose(mis->postcopy_qemufile_dst);
+        mis->postcopy_qemufile_dst = NULL;
+    }
     if (mis->postcopy_remote_fds) {
         g_array_free(mis->postcopy_remote_fds, TRUE);
         mis->postcopy_remote_fds = NULL;
@@ -375,10 +409,11 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
     *(uint32_t *)(bufc + 8) = cpu_to_be32((uint32_t)len);
 
     /*
-     * We maintain the last ramblock that we requested for page.  Note that we
-     * don't need locking because this function will only be called within the
-     * postcopy ram fault thread.
+     * We maintain the last ramblock that we requested for page.  There can
+     * be several fault threads, so the lock makes sure that the messages
+     * are sent in the same order as last_rb is updated.
      */
+    QEMU_LOCK_GUARD(&mis->req_pages_mutex);
     if (rb != mis->last_rb) {
         mis->last_rb = rb;
 
@@ -459,10 +494,28 @@ void migrate_add_address(SocketAddress *address)
                       QAPI_CLONE(SocketAddress, address));
 }
 
+/*
+ * exec: and fd: carry a single stream, so the multifd channels could never
+ * be opened and both sides would wait for them forever.
+ */
+static bool migrate_uri_check_multifd(const char *uri, Error **errp)
+{
+    if (migrate_use_multifd() &&
+        (strstart(uri, "exec:", NULL) || strstart(uri, "fd:", NULL))) {
+        error_setg(errp, "multifd is not supported by current protocol");
+        return false;
+    }
+    return true;
+}
+
 static void qemu_start_incoming_migration(const char *uri, Error **errp)
 {
     const char *p = NULL;
 
+    if (!migrate_uri_check_multifd(uri, errp)) {
+        return;
+    }
+
     migrate_protocol_allow_multifd(false); /* reset it anyway */
     qapi_event_send_migration(MIGRATION_STATUS_SETUP);
     if (strstart(uri, "tcp:", &p) ||
@@ -472,12 +525,16 @@ static void qemu_start_incoming_migration(const char *uri, Error **errp)
         socket_start_incoming_migration(p ? p : uri, errp);
 #ifdef CONFIG_RDMA
     } else if (strstart(uri, "rdma:", &p)) {
+        migrate_protocol_allow_multifd_rdma();
         rdma_start_incoming_migration(p, errp);
 #endif
     } else if (strstart(uri, "exec:", &p)) {
         exec_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        migrate_protocol_allow_multifd(true);
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -541,9 +598,14 @@ static void process_incoming_migration_bh(void *opaque)
      * observer sees this event they might start to prod at the VM assuming
      * it's ready to use.
      */
+    qemu_bh_delete(mis->bh);
+    if (mis->lazy_restore_ioc) {
+        /* RAM is still being loaded */
+        ram_lazy_restore_activate(mis);
+        return;
+    }
     migrate_set_state(&mis->state, MIGRATION_STATUS_ACTIVE,
                       MIGRATION_STATUS_COMPLETED);
-    qemu_bh_delete(mis->bh);
     migration_incoming_state_destroy();
 }
 
@@ -693,6 +755,11 @@ void migration_fd_process_incoming(QEMUFile *f, Error **errp)
     if (!migration_incoming_setup(f, errp)) {
         return;
     }
+
+    /* The last multifd channel to connect starts the migration */
+    if (!migration_has_all_channels()) {
+        return;
+    }
     migration_incoming_process();
 }
 
@@ -717,17 +784,23 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
 
         /*
          * Common migration only needs one channel, so we can start
-         * right now.  Multifd needs more than one channel, we wait.
+         * right now.  Multifd and postcopy preempt need more than one
+         * channel, we wait.
          */
-        start_migration = !migrate_use_multifd();
-    } else {
+        start_migration = !multifd_recv_use_channels() &&
+                          !migrate_postcopy_preempt();
+    } else if (multifd_recv_use_channels()) {
         /* Multiple connections */
-        assert(migrate_use_multifd());
         start_migration = multifd_recv_new_channel(ioc, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
         }
+    } else {
+        /* The second connection is the postcopy preempt channel */
+        assert(migrate_postcopy_preempt() && !mis->postcopy_qemufile_dst);
+        start_migration = postcopy_preempt_new_channel(mis,
+                                                qemu_fopen_channel_input(ioc));
     }
 
     if (start_migration) {
@@ -748,6 +821,10 @@ bool migration_has_all_channels(void)
 
     all_channels = multifd_recv_all_channels_created();
 
+    if (migrate_postcopy_preempt()) {
+        all_channels = all_channels && mis->postcopy_qemufile_dst != NULL;
+    }
+
     return all_channels && mis->from_src_file != NULL;
 }
 
@@ -907,6 +984,16 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->announce_rounds = s->parameters.announce_rounds;
     params->has_announce_step = true;
     params->announce_step = s->parameters.announce_step;
+    params->has_dirty_sync_threads = true;
+    params->dirty_sync_threads = s->parameters.dirty_sync_threads;
+    params->has_multifd_zero_page = true;
+    params->multifd_zero_page = s->parameters.multifd_zero_page;
+    params->has_postcopy_fault_threads = true;
+    params->postcopy_fault_threads = s->parameters.postcopy_fault_threads;
+    params->has_direct_io = true;
+    params->direct_io = s->parameters.direct_io;
+    params->has_cpu_throttle_predictive = true;
+    params->cpu_throttle_predictive = s->parameters.cpu_throttle_predictive;
 
     if (s->parameters.has_block_bitmap_mapping) {
         params->has_block_bitmap_mapping = true;
@@ -1014,6 +1101,9 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->page_size = page_size;
     info->ram->multifd_bytes = ram_counters.multifd_bytes;
     info->ram->pages_per_second = s->pages_per_second;
+    info->ram->zero_copy_bytes = ram_counters.zero_copy_bytes;
+    info->ram->dirty_sync_missed_zero_copy =
+        ram_counters.dirty_sync_missed_zero_copy;
 
     if (migrate_use_xbzrle()) {
         info->has_xbzrle_cache = true;
@@ -1061,6 +1151,14 @@ static void populate_disk_info(MigrationInfo *info)
     }
 }
 
+static void populate_latency_info(MigrationInfo *info)
+{
+    if (migrate_latency_stats()) {
+        info->has_latency = true;
+        info->latency = migration_latency_query();
+    }
+}
+
 static void fill_source_migration_info(MigrationInfo *info)
 {
     MigrationState *s = migrate_get_current();
@@ -1104,6 +1202,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_ram_info(info, s);
         populate_disk_info(info);
         populate_vfio_info(info);
+        populate_latency_info(info);
         break;
     case MIGRATION_STATUS_COLO:
         info->has_status = true;
@@ -1113,6 +1212,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         populate_vfio_info(info);
+        populate_latency_info(info);
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1248,6 +1348,113 @@ static bool migrate_caps_check(bool *cap_list,
                 return false;
             }
         }
+
+        /*
+         * The multifd channels release the write protection of each page
+         * they send, which must then cover a whole host page.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD] &&
+            qemu_real_host_page_size != qemu_target_page_size()) {
+            error_setg(errp, "Background-snapshot with multifd requires the "
+                       "host and target page sizes to match");
+            return false;
+        }
+#ifdef CONFIG_LINUX
+        /* The pages would be released before the kernel has sent them */
+        if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND]) {
+            error_setg(errp, "Background-snapshot is not compatible with "
+                       "zero-copy-send");
+            return false;
+        }
+#endif
+    }
+
+#ifdef CONFIG_LINUX
+    if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Zero copy only available for multifd migration");
+        return false;
+    }
+#endif
+
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_RING_PRECOPY] &&
+        !kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty-ring-precopy requires the KVM dirty ring "
+                   "to be enabled");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
+        if (!cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Postcopy preempt requires postcopy-ram");
+            return false;
+        }
+
+        /* Compressed pages are always flushed to the main channel */
+        if (cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
+            error_setg(errp, "Postcopy preempt not compatible with compress");
+            return false;
+        }
+
+        /*
+         * The destination tells the preempt channel apart from the main
+         * one by the order of the connections only.
+         */
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+            error_setg(errp, "Postcopy preempt not compatible with multifd");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE]) {
+        if (!cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+            error_setg(errp, "Multifd device state requires multifd");
+            return false;
+        }
+
+        /* The device threads only run in the precopy completion phase */
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Multifd device state not compatible with "
+                       "postcopy-ram");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_FIXED_RAM]) {
+        if (cap_list[MIGRATION_CAPABILITY_XBZRLE]) {
+            error_setg(errp, "Fixed-ram not compatible with xbzrle");
+            return false;
+        }
+
+        if (cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
+            error_setg(errp, "Fixed-ram not compatible with compress");
+            return false;
+        }
+
+        if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Fixed-ram not compatible with postcopy-ram");
+            return false;
+        }
+
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE]) {
+            error_setg(errp, "Fixed-ram not compatible with "
+                       "multifd-device-state");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_FIXED_RAM_LAZY]) {
+        if (!cap_list[MIGRATION_CAPABILITY_FIXED_RAM]) {
+            error_setg(errp, "Fixed-ram-lazy requires fixed-ram");
+            return false;
+        }
+
+        /* Pages are faulted in with the postcopy machinery */
+        if (runstate_check(RUN_STATE_INMIGRATE) &&
+            !postcopy_ram_supported_by_host(mis)) {
+            error_setg(errp, "Fixed-ram-lazy is not supported");
+            return false;
+        }
     }
 
     /* incoming side only */
@@ -1467,6 +1674,31 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
        return false;
     }
 
+    if (params->has_dirty_sync_threads &&
+        (params->dirty_sync_threads < 1 ||
+         params->dirty_sync_threads > 64)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "dirty_sync_threads",
+                   "a value between 1 and 64");
+        return false;
+    }
+
+    if (params->has_postcopy_fault_threads &&
+        (params->postcopy_fault_threads < 1 ||
+         params->postcopy_fault_threads > 32)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_fault_threads",
+                   "a value between 1 and 32");
+        return false;
+    }
+
+#ifndef O_DIRECT
+    if (params->has_direct_io && params->direct_io) {
+        error_setg(errp, "direct-io is not supported on this host");
+        return false;
+    }
+#endif
+
     if (params->has_block_bitmap_mapping &&
         !check_dirty_bitmap_mig_alias_map(params->block_bitmap_mapping, errp)) {
         error_prepend(errp, "Invalid mapping given for block-bitmap-mapping: ");
@@ -1567,6 +1799,21 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_announce_step) {
         dest->announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_multifd_zero_page) {
+        dest->multifd_zero_page = params->multifd_zero_page;
+    }
+    if (params->has_postcopy_fault_threads) {
+        dest->postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_direct_io) {
+        dest->direct_io = params->direct_io;
+    }
+    if (params->has_cpu_throttle_predictive) {
+        dest->cpu_throttle_predictive = params->cpu_throttle_predictive;
+    }
 
     if (params->has_block_bitmap_mapping) {
         dest->has_block_bitmap_mapping = true;
@@ -1684,6 +1931,21 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_announce_step) {
         s->parameters.announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_multifd_zero_page) {
+        s->parameters.multifd_zero_page = params->multifd_zero_page;
+    }
+    if (params->has_postcopy_fault_threads) {
+        s->parameters.postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_direct_io) {
+        s->parameters.direct_io = params->direct_io;
+    }
+    if (params->has_cpu_throttle_predictive) {
+        s->parameters.cpu_throttle_predictive = params->cpu_throttle_predictive;
+    }
 
     if (params->has_block_bitmap_mapping) {
         qapi_free_BitmapMigrationNodeAliasList(
@@ -1826,6 +2088,8 @@ static void migrate_fd_cleanup(MigrationState *s)
         qemu_fclose(tmp);
     }
 
+    postcopy_preempt_shutdown_file(s);
+
     assert(!migration_is_active(s));
 
     if (s->state == MIGRATION_STATUS_CANCELLING) {
@@ -2060,6 +2324,7 @@ void migrate_init(MigrationState *s)
     s->vm_was_running = false;
     s->iteration_initial_bytes = 0;
     s->threshold_size = 0;
+    migration_latency_reset(migrate_latency_stats());
 }
 
 int migrate_add_blocker_internal(Error *reason, Error **errp)
@@ -2279,6 +2544,22 @@ static bool migrate_prepare(MigrationState *s, bool blk, bool blk_inc,
         migrate_set_block_incremental(s, true);
     }
 
+#ifdef CONFIG_LINUX
+    /*
+     * With kernel TLS, the kernel encrypts into its own buffers and the
+     * guest pages are never copied by QEMU.
+     */
+    if (migrate_use_zero_copy_send() &&
+        (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE ||
+         (s->parameters.tls_creds && *s->parameters.tls_creds &&
+          !migration_tls_ktls_enabled(s)))) {
+        error_setg(errp,
+                   "Zero copy only available for non-compressed multifd "
+                   "migration, without TLS or with kernel TLS (ktls=on)");
+        return false;
+    }
+#endif
+
     migrate_init(s);
     /*
      * set ram_counters compression_counters memory to zero for a
@@ -2298,6 +2579,10 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
     MigrationState *s = migrate_get_current();
     const char *p = NULL;
 
+    if (!migrate_uri_check_multifd(uri, errp)) {
+        return;
+    }
+
     if (!migrate_prepare(s, has_blk && blk, has_inc && inc,
                          has_resume && resume, errp)) {
         /* Error detected, put into errp */
@@ -2318,12 +2603,16 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         socket_start_outgoing_migration(s, p ? p : uri, &local_err);
 #ifdef CONFIG_RDMA
     } else if (strstart(uri, "rdma:", &p)) {
+        migrate_protocol_allow_multifd_rdma();
         rdma_start_outgoing_migration(s, p, &local_err);
 #endif
     } else if (strstart(uri, "exec:", &p)) {
         exec_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        migrate_protocol_allow_multifd(true);
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         if (!(has_resume && resume)) {
             yank_unregister_instance(MIGRATION_YANK_INSTANCE);
@@ -2502,6 +2791,71 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_COPY_SEND];
+}
+#endif
+
+bool migrate_dirty_ring_precopy(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_RING_PRECOPY];
+}
+
+bool migrate_postcopy_preempt(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
+}
+
+bool migrate_multifd_device_state(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE];
+}
+
+bool migrate_fixed_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_FIXED_RAM];
+}
+
+bool migrate_fixed_ram_lazy(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_FIXED_RAM_LAZY];
+}
+
+bool migrate_latency_stats(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_LATENCY_STATS];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2548,6 +2902,51 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_zero_page;
+}
+
+int migrate_postcopy_fault_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_fault_threads;
+}
+
+bool migrate_direct_io(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.direct_io;
+}
+
+bool migrate_cpu_throttle_predictive(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.cpu_throttle_predictive;
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -3372,6 +3771,9 @@ static MigThrError postcopy_pause(MigrationState *s)
 {
     assert(s->state == MIGRATION_STATUS_POSTCOPY_ACTIVE);
 
+    /* The preempt channel is not recovered, urgent pages use the main one */
+    postcopy_preempt_shutdown_file(s);
+
     while (true) {
         QEMUFile *file;
 
@@ -3796,6 +4198,12 @@ static void *migration_thread(void *opaque)
     object_ref(OBJECT(s));
     update_iteration_initial_status(s);
 
+    if (postcopy_preempt_wait_channel(s)) {
+        migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
+                          MIGRATION_STATUS_FAILED);
+        goto out;
+    }
+
     qemu_savevm_state_header(s->to_dst_file);
 
     /*
@@ -3864,6 +4272,7 @@ static void *migration_thread(void *opaque)
     }
 
     trace_migration_thread_after_loop();
+out:
     migration_iteration_finish(s);
     object_unref(OBJECT(s));
     rcu_unregister_thread();
@@ -4113,6 +4522,15 @@ void migrate_fd_connect(MigrationState *s, Error *error_in)
         return;
     }
 
+    /* This must be the last step before the migration thread is created */
+    if (postcopy_preempt_setup(s, &local_err)) {
+        error_report_err(local_err);
+        migrate_set_state(&s->state, MIGRATION_STATUS_SETUP,
+                          MIGRATION_STATUS_FAILED);
+        migrate_fd_cleanup(s);
+        return;
+    }
+
     if (migrate_background_snapshot()) {
         qemu_thread_create(&s->thread, "bg_snapshot",
                 bg_migration_thread, s, QEMU_THREAD_JOINABLE);
@@ -4221,6 +4639,21 @@ static Property migration_properties[] = {
     DEFINE_PROP_SIZE("announce-step", MigrationState,
                       parameters.announce_step,
                       DEFAULT_MIGRATE_ANNOUNCE_STEP),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_BOOL("multifd-zero-page", MigrationState,
+                     parameters.multifd_zero_page,
+                     DEFAULT_MIGRATE_MULTIFD_ZERO_PAGE),
+    DEFINE_PROP_UINT8("postcopy-fault-threads", MigrationState,
+                      parameters.postcopy_fault_threads,
+                      DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS),
+    DEFINE_PROP_BOOL("direct-io", MigrationState,
+                     parameters.direct_io,
+                     DEFAULT_MIGRATE_DIRECT_IO),
+    DEFINE_PROP_BOOL("cpu-throttle-predictive", MigrationState,
+                     parameters.cpu_throttle_predictive,
+                     DEFAULT_MIGRATE_CPU_THROTTLE_PREDICTIVE),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -4237,6 +4670,22 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+#ifdef CONFIG_LINUX
+    DEFINE_PROP_MIG_CAP("x-zero-copy-send",
+            MIGRATION_CAPABILITY_ZERO_COPY_SEND),
+#endif
+    DEFINE_PROP_MIG_CAP("x-dirty-ring-precopy",
+            MIGRATION_CAPABILITY_DIRTY_RING_PRECOPY),
+    DEFINE_PROP_MIG_CAP("x-postcopy-preempt",
+            MIGRATION_CAPABILITY_POSTCOPY_PREEMPT),
+    DEFINE_PROP_MIG_CAP("x-multifd-device-state",
+            MIGRATION_CAPABILITY_MULTIFD_DEVICE_STATE),
+    DEFINE_PROP_MIG_CAP("x-fixed-ram",
+            MIGRATION_CAPABILITY_FIXED_RAM),
+    DEFINE_PROP_MIG_CAP("x-fixed-ram-lazy",
+            MIGRATION_CAPABILITY_FIXED_RAM_LAZY),
+    DEFINE_PROP_MIG_CAP("x-latency-stats",
+            MIGRATION_CAPABILITY_LATENCY_STATS),
 
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -4259,6 +4708,7 @@ static void migration_instance_finalize(Object *obj)
     g_free(params->tls_hostname);
     g_free(params->tls_creds);
     qemu_sem_destroy(&ms->wait_unplug_sem);
+    qemu_sem_destroy(&ms->postcopy_qemufile_src_sem);
     qemu_sem_destroy(&ms->rate_limit_sem);
     qemu_sem_destroy(&ms->pause_sem);
     qemu_sem_destroy(&ms->postcopy_pause_sem);
@@ -4304,12 +4754,18 @@ static void migration_instance_init(Object *obj)
     params->has_announce_max = true;
     params->has_announce_rounds = true;
     params->has_announce_step = true;
+    params->has_dirty_sync_threads = true;
+    params->has_multifd_zero_page = true;
+    params->has_postcopy_fault_threads = true;
+    params->has_direct_io = true;
+    params->has_cpu_throttle_predictive = true;
 
     qemu_sem_init(&ms->postcopy_pause_sem, 0);
     qemu_sem_init(&ms->postcopy_pause_rp_sem, 0);
     qemu_sem_init(&ms->rp_state.rp_sem, 0);
     qemu_sem_init(&ms->rate_limit_sem, 0);
     qemu_sem_init(&ms->wait_unplug_sem, 0);
+    qemu_sem_init(&ms->postcopy_qemufile_src_sem, 0);
     qemu_mutex_init(&ms->qemu_file_lock);
 }
 
@@ -45,6 +45,27 @@ struct PostcopyBlocktimeContext;
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/* Channels used to send RAM pages, see the postcopy-preempt capability */
+enum {
+    /* The main migration stream */
+    RAM_CHANNEL_PRECOPY = 0,
+    /* Only used for urgent postcopy page requests */
+    RAM_CHANNEL_POSTCOPY = 1,
+    RAM_CHANNEL_MAX,
+};
+
+/* A postcopy fault thread, serving its part of guest RAM */
+typedef struct PostcopyFaultThread {
+    MigrationIncomingState *mis;
+    /* Index of the thread, see postcopy_fault_thread_for() */
+    int id;
+    QemuThread thread;
+    /* For the kernel to send us notifications */
+    int userfault_fd;
+    /* To notify the thread to wake, e.g., when need to quit */
+    int event_fd;
+} PostcopyFaultThread;
+
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
@@ -64,7 +85,8 @@ struct MigrationIncomingState {
 
     size_t         largest_page_size;
     bool           have_fault_thread;
-    QemuThread     fault_thread;
+    PostcopyFaultThread *fault_threads;
+    int            nr_fault_threads;
     QemuSemaphore  fault_thread_sem;
     /* Set this when we want the fault thread to quit */
     bool           fault_thread_quit;
@@ -73,18 +95,32 @@ struct MigrationIncomingState {
     QemuThread     listen_thread;
     QemuSemaphore  listen_thread_sem;
 
-    /* For the kernel to send us notifications */
-    int       userfault_fd;
-    /* To notify the fault_thread to wake, e.g., when need to quit */
-    int       userfault_event_fd;
     QEMUFile *to_src_file;
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
-    /* RAMBlock of last request sent to source */
+    /* Serializes the page requests of the fault threads */
+    QemuMutex req_pages_mutex;
+    /* RAMBlock of last request sent to source, under req_pages_mutex */
     RAMBlock *last_rb;
-    void     *postcopy_tmp_page;
+    /* Temporary pages used to assemble host pages, one per RAM channel */
+    void     *postcopy_tmp_pages[RAM_CHANNEL_MAX];
     void     *postcopy_tmp_zero_page;
+    /* Last RAMBlock received on each RAM channel */
+    RAMBlock *last_recv_block[RAM_CHANNEL_MAX];
+    /* Channel for urgent page requests, when postcopy-preempt is enabled */
+    QEMUFile *postcopy_qemufile_dst;
+    bool      have_preempt_thread;
+    QemuThread preempt_thread;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
     GArray   *postcopy_remote_fds;
+    /*
+     * With fixed-ram-lazy, the file the fault threads and lazy_restore_thread
+     * load the pages from while the guest runs; NULL otherwise
+     */
+    QIOChannel *lazy_restore_ioc;
+    QemuThread lazy_restore_thread;
+    /* Set once lazy_restore_thread is done, with its result */
+    bool       lazy_restore_loaded;
+    int        lazy_restore_ret;
 
     QEMUBH *bh;
 
@@ -156,6 +192,13 @@ struct MigrationState {
     QEMUBH *cleanup_bh;
     /* Protected by qemu_file_lock */
     QEMUFile *to_dst_file;
+    /*
+     * Channel for urgent page requests in postcopy, when postcopy-preempt
+     * is enabled.  Only used by the migration thread once it is set up.
+     */
+    QEMUFile *postcopy_qemufile_src;
+    /* Posted once the connection of postcopy_qemufile_src is done */
+    QemuSemaphore postcopy_qemufile_src_sem;
     QIOChannelBuffer *bioc;
     /*
      * Protects to_dst_file/from_dst_file pointers.  We need to make sure we
@@ -334,10 +377,27 @@ bool migrate_validate_uuid(void);
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
 bool migrate_pause_before_switchover(void);
+bool migrate_latency_stats(void);
+bool migrate_fixed_ram(void);
+bool migrate_fixed_ram_lazy(void);
+bool migrate_multifd_device_state(void);
+bool migrate_postcopy_preempt(void);
+bool migrate_dirty_ring_precopy(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+bool migrate_cpu_throttle_predictive(void);
+bool migrate_direct_io(void);
+int migrate_postcopy_fault_threads(void);
+bool migrate_multifd_zero_page(void);
+int migrate_dirty_sync_threads(void);
+
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void);
+#else
+#define migrate_use_zero_copy_send() (false)
+#endif
 
 int migrate_use_xbzrle(void);
 uint64_t migrate_xbzrle_cache_size(void);
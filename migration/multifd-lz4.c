@@ -0,0 +1,285 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Every page is compressed independently, so that a page being
+ * modified by the guest while it is compressed can never corrupt its
+ * neighbours on the destination.  The packet payload is an array of
+ * big endian 32 bit compressed sizes, one for each page, followed by
+ * the compressed data.  A page that doesn't shrink is sent as is, and
+ * its size is then the target page size.
+ */
+
+struct lz4_data {
+    /* compression state */
+    void *state;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+};
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->state = g_try_malloc(LZ4_sizeofState());
+    /* To be safe, we reserve twice the size of the packet */
+    z->zbuff_len = MULTIFD_PACKET_SIZE * 2;
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->state || !z->zbuff) {
+        g_free(z->state);
+        g_free(z->zbuff);
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for lz4 buffers", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Return the memory used by the channel.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->state);
+    z->state = NULL;
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    size_t page_size = qemu_target_page_size();
+    uint32_t *sizes = (uint32_t *)z->zbuff;
+    uint32_t hdr_len = p->pages->num * sizeof(uint32_t);
+    uint8_t *out = z->zbuff + hdr_len;
+    uint32_t i;
+
+    /* Worst case is every page being sent uncompressed */
+    if (hdr_len + p->pages->num * page_size > z->zbuff_len) {
+        error_setg(errp, "multifd %d: lz4 buffer too small for %u pages",
+                   p->id, p->pages->num);
+        return -1;
+    }
+
+    for (i = 0; i < p->pages->num; i++) {
+        uint8_t *page = p->pages->block->host + p->pages->offset[i];
+        int ret;
+
+        /* Only accept results that are smaller than the page itself */
+        ret = LZ4_compress_fast_extState(z->state, (const char *)page,
+                                         (char *)out, page_size,
+                                         page_size - 1, 1);
+        if (ret <= 0) {
+            memcpy(out, page, page_size);
+            ret = page_size;
+        }
+        sizes[i] = cpu_to_be32(ret);
+        out += ret;
+    }
+    p->next_packet_size = out - z->zbuff;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return qio_channel_write_all(p->c, (void *)z->zbuff, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    /* To be safe, we reserve twice the size of the packet */
+    z->zbuff_len = MULTIFD_PACKET_SIZE * 2;
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return the memory used by the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    size_t page_size = qemu_target_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t hdr_len = p->pages->num * sizeof(uint32_t);
+    uint32_t *sizes = (uint32_t *)z->zbuff;
+    uint8_t *in;
+    uint8_t *in_end;
+    uint32_t i;
+    int ret;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len || in_size < hdr_len) {
+        error_setg(errp, "multifd %d: packet size received %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    in = z->zbuff + hdr_len;
+    in_end = z->zbuff + in_size;
+
+    for (i = 0; i < p->pages->num; i++) {
+        uint8_t *page = p->host + p->pages->offset[i];
+        uint32_t csize = be32_to_cpu(sizes[i]);
+
+        if (csize > page_size || csize > in_end - in) {
+            error_setg(errp, "multifd %d: page %u has invalid size %u",
+                       p->id, i, csize);
+            return -1;
+        }
+        if (csize == page_size) {
+            memcpy(page, in, page_size);
+        } else {
+            ret = LZ4_decompress_safe((const char *)in, (char *)page,
+                                      csize, page_size);
+            if (ret != page_size) {
+                error_setg(errp, "multifd %d: lz4 decompression of page %u "
+                           "failed with %d", p->id, i, ret);
+                return -1;
+            }
+        }
+        in += csize;
+    }
+    if (in != in_end) {
+        error_setg(errp, "multifd %d: packet size received %u size used %td",
+                   p->id, in_size, in - z->zbuff);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -0,0 +1,425 @@
+/*
+ * Multifd qpl compression accelerator implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qpl/qpl.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * The Intel Query Processing Library can offload deflate to the
+ * In-Memory Analytics Accelerator (IAA).  Each page is a separate QPL
+ * job so that all the pages of a packet are in flight on the device
+ * at the same time.  When no accelerator can be opened, the library
+ * software path is used instead, so the stream format doesn't depend
+ * on the hardware of either side.
+ *
+ * The packet payload is an array of big endian 32 bit compressed
+ * sizes, one for each page, followed by the compressed data.  A page
+ * that doesn't shrink is sent as is, and its size is then the target
+ * page size.
+ */
+
+struct qpl_data {
+    /* which QPL execution path the jobs were initialized for */
+    qpl_path_t path;
+    /* array of num_jobs QPL jobs, one per page */
+    qpl_job **jobs;
+    /* memory backing the jobs */
+    uint8_t *job_buf;
+    /* number of jobs, the maximum number of pages in a packet */
+    uint32_t num_jobs;
+    /* compressed data buffer, one page sized slot for each job */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+    /* compressed sizes header for the packet that is being sent */
+    uint32_t *sizes;
+    /* iovs used to send the header and the compressed pages */
+    struct iovec *iov;
+};
+
+static void multifd_qpl_free_jobs(struct qpl_data *qpl)
+{
+    uint32_t i;
+
+    if (!qpl->jobs) {
+        return;
+    }
+    for (i = 0; i < qpl->num_jobs; i++) {
+        if (qpl->jobs[i]) {
+            qpl_fini_job(qpl->jobs[i]);
+        }
+    }
+    g_free(qpl->jobs);
+    qpl->jobs = NULL;
+    g_free(qpl->job_buf);
+    qpl->job_buf = NULL;
+}
+
+static int multifd_qpl_init_jobs(struct qpl_data *qpl, qpl_path_t path)
+{
+    uint32_t job_size;
+    uint32_t i;
+
+    if (qpl_get_job_size(path, &job_size) != QPL_STS_OK) {
+        return -1;
+    }
+    qpl->path = path;
+    qpl->jobs = g_new0(qpl_job *, qpl->num_jobs);
+    qpl->job_buf = g_malloc0((size_t)job_size * qpl->num_jobs);
+    for (i = 0; i < qpl->num_jobs; i++) {
+        qpl_job *job = (qpl_job *)(qpl->job_buf + (size_t)job_size * i);
+
+        if (qpl_init_job(path, job) != QPL_STS_OK) {
+            multifd_qpl_free_jobs(qpl);
+            return -1;
+        }
+        qpl->jobs[i] = job;
+    }
+    return 0;
+}
+
+/**
+ * multifd_qpl_init: allocate the jobs and buffers of one channel
+ *
+ * Try to use the hardware path first and if that doesn't work,
+ * fall back to the software path.
+ *
+ * Returns a qpl_data structure or NULL on error
+ *
+ * @id: channel id, used for error messages and tracing
+ * @errp: pointer to an error
+ */
+static struct qpl_data *multifd_qpl_init(uint8_t id, Error **errp)
+{
+    struct qpl_data *qpl = g_new0(struct qpl_data, 1);
+    size_t page_size = qemu_target_page_size();
+
+    qpl->num_jobs = MULTIFD_PACKET_SIZE / page_size;
+    if (multifd_qpl_init_jobs(qpl, qpl_path_hardware) < 0 &&
+        multifd_qpl_init_jobs(qpl, qpl_path_software) < 0) {
+        g_free(qpl);
+        error_setg(errp, "multifd %d: qpl job initialization failed", id);
+        return NULL;
+    }
+    trace_multifd_qpl_init(id, qpl->path == qpl_path_hardware);
+
+    qpl->zbuff_len = qpl->num_jobs * page_size;
+    qpl->zbuff = g_try_malloc(qpl->zbuff_len);
+    if (!qpl->zbuff) {
+        multifd_qpl_free_jobs(qpl);
+        g_free(qpl);
+        error_setg(errp, "multifd %d: out of memory for zbuff", id);
+        return NULL;
+    }
+    qpl->sizes = g_new0(uint32_t, qpl->num_jobs);
+    qpl->iov = g_new0(struct iovec, qpl->num_jobs + 1);
+    return qpl;
+}
+
+static void multifd_qpl_cleanup(struct qpl_data *qpl)
+{
+    multifd_qpl_free_jobs(qpl);
+    g_free(qpl->zbuff);
+    g_free(qpl->sizes);
+    g_free(qpl->iov);
+    g_free(qpl);
+}
+
+/**
+ * multifd_qpl_submit: submit a job, retrying while the device is busy
+ *
+ * Returns the QPL status of the submission
+ *
+ * @job: the job to submit
+ */
+static qpl_status multifd_qpl_submit(qpl_job *job)
+{
+    qpl_status status;
+
+    do {
+        status = qpl_submit_job(job);
+    } while (status == QPL_STS_QUEUES_ARE_BUSY_ERR);
+
+    return status;
+}
+
+/* Multifd qpl compression */
+
+/**
+ * qpl_send_setup: setup send side
+ *
+ * Setup each channel with qpl compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    p->data = multifd_qpl_init(p->id, errp);
+    return p->data ? 0 : -1;
+}
+
+/**
+ * qpl_send_cleanup: cleanup send side
+ *
+ * Return the jobs and the memory used by the channel.
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void qpl_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    multifd_qpl_cleanup(p->data);
+    p->data = NULL;
+}
+
+/**
+ * qpl_send_prepare: prepare date to be able to send
+ *
+ * Submit one compression job for each page, then wait for all of
+ * them and build the iovs of the packet payload.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct qpl_data *qpl = p->data;
+    size_t page_size = qemu_target_page_size();
+    uint32_t size = p->pages->num * sizeof(uint32_t);
+    uint32_t i;
+
+    if (p->pages->num > qpl->num_jobs) {
+        error_setg(errp, "multifd %d: too many pages %u for qpl",
+                   p->id, p->pages->num);
+        return -1;
+    }
+
+    for (i = 0; i < p->pages->num; i++) {
+        qpl_job *job = qpl->jobs[i];
+
+        job->op = qpl_op_compress;
+        job->next_in_ptr = p->pages->block->host + p->pages->offset[i];
+        job->available_in = page_size;
+        job->next_out_ptr = qpl->zbuff + i * page_size;
+        /* Only accept results that are smaller than the page itself */
+        job->available_out = page_size - 1;
+        job->level = qpl_default_level;
+        job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST | QPL_FLAG_OMIT_VERIFY;
+        if (qpl->path == qpl_path_software) {
+            job->flags |= QPL_FLAG_DYNAMIC_HUFFMAN;
+        }
+        if (multifd_qpl_submit(job) != QPL_STS_OK) {
+            /* Let the submitted jobs finish before reporting the error */
+            while (i--) {
+                qpl_wait_job(qpl->jobs[i]);
+            }
+            error_setg(errp, "multifd %d: qpl job submission failed", p->id);
+            return -1;
+        }
+    }
+
+    qpl->iov[0].iov_base = qpl->sizes;
+    qpl->iov[0].iov_len = p->pages->num * sizeof(uint32_t);
+    for (i = 0; i < p->pages->num; i++) {
+        qpl_job *job = qpl->jobs[i];
+        qpl_status status = qpl_wait_job(job);
+
+        if (status == QPL_STS_OK && job->total_out < page_size) {
+            qpl->iov[i + 1].iov_base = qpl->zbuff + i * page_size;
+            qpl->iov[i + 1].iov_len = job->total_out;
+        } else if (status == QPL_STS_OK ||
+                   status == QPL_STS_MORE_OUTPUT_NEEDED) {
+            /* Incompressible page, send it as is */
+            qpl->iov[i + 1].iov_base = p->pages->iov[i].iov_base;
+            qpl->iov[i + 1].iov_len = page_size;
+        } else {
+            error_setg(errp, "multifd %d: qpl compression failed with %d",
+                       p->id, status);
+            while (++i < p->pages->num) {
+                qpl_wait_job(qpl->jobs[i]);
+            }
+            return -1;
+        }
+        qpl->sizes[i] = cpu_to_be32(qpl->iov[i + 1].iov_len);
+        size += qpl->iov[i + 1].iov_len;
+    }
+    p->next_packet_size = size;
+    p->flags |= MULTIFD_FLAG_QPL;
+
+    return 0;
+}
+
+/**
+ * qpl_send_write: do the actual write of the data
+ *
+ * Write the sizes header and the compressed pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int qpl_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct qpl_data *qpl = p->data;
+
+    return qio_channel_writev_all(p->c, qpl->iov, used + 1, errp);
+}
+
+/**
+ * qpl_recv_setup: setup receive side
+ *
+ * Create the decompression jobs and buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    p->data = multifd_qpl_init(p->id, errp);
+    return p->data ? 0 : -1;
+}
+
+/**
+ * qpl_recv_cleanup: cleanup receive side
+ *
+ * Return the jobs and the memory used by the channel.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void qpl_recv_cleanup(MultiFDRecvParams *p)
+{
+    multifd_qpl_cleanup(p->data);
+    p->data = NULL;
+}
+
+/**
+ * qpl_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and submit one decompression job for
+ * each page straight into guest memory.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int qpl_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    struct qpl_data *qpl = p->data;
+    uint32_t in_size = p->next_packet_size;
+    size_t page_size = qemu_target_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t hdr_len = p->pages->num * sizeof(uint32_t);
+    uint8_t *in, *in_end;
+    uint32_t i, submitted = 0;
+    int ret = 0;
+
+    if (flags != MULTIFD_FLAG_QPL) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_QPL);
+        return -1;
+    }
+    if (p->pages->num > qpl->num_jobs || hdr_len > in_size ||
+        in_size - hdr_len > qpl->zbuff_len) {
+        error_setg(errp, "multifd %d: packet size received %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+
+    if (qio_channel_read_all(p->c, (void *)qpl->sizes, hdr_len, errp) ||
+        qio_channel_read_all(p->c, (void *)qpl->zbuff, in_size - hdr_len,
+                             errp)) {
+        return -1;
+    }
+
+    in = qpl->zbuff;
+    in_end = qpl->zbuff + in_size - hdr_len;
+    for (i = 0; i < p->pages->num; i++) {
+        uint8_t *page = p->host + p->pages->offset[i];
+        uint32_t csize = be32_to_cpu(qpl->sizes[i]);
+        qpl_job *job = qpl->jobs[i];
+
+        if (csize == 0 || csize > page_size || csize > in_end - in) {
+            error_setg(errp, "multifd %d: page %u has invalid size %u",
+                       p->id, i, csize);
+            ret = -1;
+            break;
+        }
+        if (csize == page_size) {
+            memcpy(page, in, page_size);
+        } else {
+            job->op = qpl_op_decompress;
+            job->next_in_ptr = in;
+            job->available_in = csize;
+            job->next_out_ptr = page;
+            job->available_out = page_size;
+            job->flags = QPL_FLAG_FIRST | QPL_FLAG_LAST;
+            if (multifd_qpl_submit(job) != QPL_STS_OK) {
+                error_setg(errp, "multifd %d: qpl job submission failed",
+                           p->id);
+                ret = -1;
+                break;
+            }
+            submitted = i + 1;
+        }
+        in += csize;
+    }
+    if (!ret && in != in_end) {
+        error_setg(errp, "multifd %d: packet size received %u size used %td",
+                   p->id, in_size, in - qpl->zbuff + hdr_len);
+        ret = -1;
+    }
+
+    for (i = 0; i < submitted; i++) {
+        qpl_job *job = qpl->jobs[i];
+        qpl_status status;
+
+        if (be32_to_cpu(qpl->sizes[i]) == page_size) {
+            continue;
+        }
+        status = qpl_wait_job(job);
+        if (!ret && (status != QPL_STS_OK || job->total_out != page_size)) {
+            error_setg(errp, "multifd %d: qpl decompression of page %u "
+                       "failed with %d", p->id, i, status);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static MultiFDMethods multifd_qpl_ops = {
+    .send_setup = qpl_send_setup,
+    .send_cleanup = qpl_send_cleanup,
+    .send_prepare = qpl_send_prepare,
+    .send_write = qpl_send_write,
+    .recv_setup = qpl_recv_setup,
+    .recv_cleanup = qpl_recv_cleanup,
+    .recv_pages = qpl_recv_pages
+};
+
+static void multifd_qpl_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_QPL, &multifd_qpl_ops);
+}
+
+migration_init(multifd_qpl_register);
@@ -269,7 +269,7 @@ static int zlib_recv_pages(MultiFDRecvParams *p, Error **errp)
         }
 
         zs->avail_out = page_size;
-        zs->next_out = p->pages->block->host + p->pages->offset[i];
+        zs->next_out = p->host + p->pages->offset[i];
 
         /*
          * Welcome to inflate semantics
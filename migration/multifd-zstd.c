@@ -280,7 +280,7 @@ static int zstd_recv_pages(MultiFDRecvParams *p, Error **errp)
     z->in.pos = 0;
 
     for (i = 0; i < p->pages->num; i++) {
-        z->out.dst = p->pages->block->host + p->pages->offset[i];
+        z->out.dst = p->host + p->pages->offset[i];
         z->out.size = page_size;
         z->out.pos = 0;
 
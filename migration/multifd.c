@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
@@ -20,10 +21,16 @@
 #include "ram.h"
 #include "migration.h"
 #include "socket.h"
+#include "file.h"
+#include "rdma.h"
 #include "tls.h"
 #include "qemu-file.h"
+#include "savevm.h"
+#include "latency.h"
 #include "trace.h"
 #include "multifd.h"
+#include "migration/register.h"
+#include "migration/colo.h"
 
 #include "qemu/yank.h"
 #include "io/channel-socket.h"
@@ -94,7 +101,9 @@ static int nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 /**
  * nocomp_send_write: do the actual write of the data
  *
- * For no compression we just have to write the data.
+ * For no compression we just have to write the data.  When zero copy
+ * is enabled the pages are handed to the kernel without copying them;
+ * multifd_send_sync_main() flushes them before they can be reused.
  *
  * Returns 0 for success or -1 for error
  *
@@ -104,7 +113,8 @@ static int nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used, NULL, 0,
+                                       p->write_flags, errp);
 }
 
 /**
@@ -175,6 +185,16 @@ void multifd_register_ops(int method, MultiFDMethods *ops)
     multifd_ops[method] = ops;
 }
 
+static MultiFDMethods *multifd_get_ops(void)
+{
+#ifdef CONFIG_RDMA
+    if (multifd_use_rdma()) {
+        return &multifd_rdma_ops;
+    }
+#endif
+    return multifd_ops[migrate_multifd_compression()];
+}
+
 static int multifd_send_initial_packet(MultiFDSendParams *p, Error **errp)
 {
     MultiFDInit_t msg = {};
@@ -251,6 +271,7 @@ static MultiFDPages_t *multifd_pages_init(size_t size)
 static void multifd_pages_clear(MultiFDPages_t *pages)
 {
     pages->num = 0;
+    pages->zero_num = 0;
     pages->allocated = 0;
     pages->packet_num = 0;
     pages->block = NULL;
@@ -271,12 +292,13 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->pages_used = cpu_to_be32(p->pages->num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
+    packet->zero_pages = cpu_to_be32(p->pages->zero_num);
 
     if (p->pages->block) {
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
     }
 
-    for (i = 0; i < p->pages->num; i++) {
+    for (i = 0; i < p->pages->num + p->pages->zero_num; i++) {
         /* there are architectures where ram_addr_t is 32 bit */
         uint64_t temp = p->pages->offset[i];
 
@@ -338,10 +360,34 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->pages->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->pages->zero_num > packet->pages_alloc - p->pages->num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %d pages and %d zero pages and expected maximum "
+                   "pages are %d", p->pages->num, p->pages->zero_num,
+                   packet->pages_alloc);
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->pages->num == 0) {
+    if (p->flags & MULTIFD_FLAG_DEVICE_STATE) {
+        if (p->pages->num || p->pages->zero_num) {
+            error_setg(errp, "multifd: received device state packet "
+                       "with %d pages", p->pages->num + p->pages->zero_num);
+            return -1;
+        }
+        if (p->next_packet_size > SAVEVM_STATE_BUFFER_MAX_SIZE) {
+            error_setg(errp, "multifd: received device state of size %d "
+                       "and expected a maximum size of %d",
+                       p->next_packet_size, SAVEVM_STATE_BUFFER_MAX_SIZE);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (p->pages->num == 0 && p->pages->zero_num == 0) {
         return 0;
     }
 
@@ -355,7 +401,19 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     }
 
     p->pages->block = block;
-    for (i = 0; i < p->pages->num; i++) {
+    p->host = block->host;
+    if (migration_incoming_colo_enabled() &&
+        migration_incoming_in_colo_state()) {
+        /* Checkpoints are staged in the cache until colo_flush_ram_cache() */
+        if (!block->colo_cache) {
+            error_setg(errp, "multifd: no COLO cache for ram block %s",
+                       block->idstr);
+            return -1;
+        }
+        p->host = block->colo_cache;
+    }
+
+    for (i = 0; i < p->pages->num + p->pages->zero_num; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
 
         if (offset > (block->used_length - page_size)) {
@@ -365,13 +423,41 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
             return -1;
         }
         p->pages->offset[i] = offset;
-        p->pages->iov[i].iov_base = block->host + offset;
+        p->pages->iov[i].iov_base = p->host + offset;
         p->pages->iov[i].iov_len = page_size;
     }
 
     return 0;
 }
 
+/*
+ * On a COLO secondary, pages loaded into the cache are recorded to be
+ * flushed at the end of the checkpoint.  During the initial migration they
+ * are loaded into RAM and also copied into the cache, as in
+ * ram_load_precopy().
+ */
+static void multifd_recv_colo_pages(MultiFDRecvParams *p)
+{
+    RAMBlock *block = p->pages->block;
+    uint32_t num = p->pages->num + p->pages->zero_num;
+    size_t page_size = qemu_target_page_size();
+    uint32_t i;
+
+    if (p->host == block->colo_cache) {
+        colo_record_bitmap(block, p->pages->offset, num);
+        return;
+    }
+
+    if (!block->colo_cache) {
+        return;
+    }
+    for (i = 0; i < num; i++) {
+        ram_addr_t offset = p->pages->offset[i];
+
+        memcpy(block->colo_cache + offset, block->host + offset, page_size);
+    }
+}
+
 struct {
     MultiFDSendParams *params;
     /* array of pages to sent */
@@ -388,6 +474,21 @@ struct {
     int exiting;
     /* multifd ops */
     MultiFDMethods *ops;
+    /* do the channels detect zero pages */
+    bool zero_page;
+    /*
+     * Serializes the choice of a channel and the packet numbering
+     * between the migration thread and the device state threads.
+     */
+    QemuMutex channel_mutex;
+    /* this mutex protects the following parameters */
+    QemuMutex device_state_mutex;
+    /* signalled when a device state buffer has been written */
+    QemuCond device_state_cond;
+    /* device state buffers queued and not yet written */
+    unsigned int device_state_pending;
+    /* bytes queued by the device state threads, not yet accounted */
+    uint64_t device_state_bytes;
 } *multifd_send_state;
 
 /*
@@ -408,19 +509,46 @@ struct {
  * false.
  */
 
-static int multifd_send_pages(QEMUFile *f)
+/**
+ * multifd_send_account_zero_pages: update the statistics for zero pages
+ *
+ * Pages are accounted as normal pages when they are queued; once the
+ * channel has found that some of them were zero pages, move them to
+ * the duplicate counter and take out the bytes that were not sent.
+ *
+ * Called from the migration thread with the channel mutex held.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_account_zero_pages(MultiFDSendParams *p)
 {
-    int i;
-    static int next_channel;
-    MultiFDSendParams *p = NULL; /* make happy gcc */
-    MultiFDPages_t *pages = multifd_send_state->pages;
-    uint64_t transferred;
+    uint64_t bytes = p->zero_pages * qemu_target_page_size();
 
-    if (qatomic_read(&multifd_send_state->exiting)) {
-        return -1;
+    ram_counters.duplicate += p->zero_pages;
+    ram_counters.normal -= p->zero_pages;
+    ram_counters.multifd_bytes -= bytes;
+    ram_counters.transferred -= bytes;
+    if (p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+        ram_counters.zero_copy_bytes -= bytes;
     }
+    p->zero_pages = 0;
+}
+
+/**
+ * multifd_send_get_channel: pick an idle channel
+ *
+ * Reserve the next channel without a pending job.  The caller has
+ * already waited for channels_ready.
+ *
+ * Returns the channel with its mutex held, or NULL if a channel has
+ * quit.  Called with multifd_send_state->channel_mutex held.
+ */
+static MultiFDSendParams *multifd_send_get_channel(void)
+{
+    int i;
+    static int next_channel;
+    MultiFDSendParams *p;
 
-    qemu_sem_wait(&multifd_send_state->channels_ready);
     /*
      * next_channel can remain from a previous migration that was
      * using more channels, so ensure it doesn't overflow if the
@@ -434,26 +562,53 @@ static int multifd_send_pages(QEMUFile *f)
         if (p->quit) {
             error_report("%s: channel %d has already quit!", __func__, i);
             qemu_mutex_unlock(&p->mutex);
-            return -1;
+            return NULL;
         }
         if (!p->pending_job) {
             p->pending_job++;
             next_channel = (i + 1) % migrate_multifd_channels();
-            break;
+            return p;
         }
         qemu_mutex_unlock(&p->mutex);
     }
+}
+
+static int multifd_send_pages(QEMUFile *f)
+{
+    MultiFDSendParams *p;
+    MultiFDPages_t *pages = multifd_send_state->pages;
+    uint64_t transferred;
+
+    if (qatomic_read(&multifd_send_state->exiting)) {
+        return -1;
+    }
+
+    qemu_sem_wait(&multifd_send_state->channels_ready);
+    qemu_mutex_lock(&multifd_send_state->channel_mutex);
+    p = multifd_send_get_channel();
+    if (!p) {
+        qemu_mutex_unlock(&multifd_send_state->channel_mutex);
+        return -1;
+    }
     assert(!p->pages->num);
     assert(!p->pages->block);
 
+    multifd_send_account_zero_pages(p);
     p->packet_num = multifd_send_state->packet_num++;
+    qemu_mutex_unlock(&multifd_send_state->channel_mutex);
     multifd_send_state->pages = p->pages;
     p->pages = pages;
-    transferred = ((uint64_t) pages->num) * qemu_target_page_size()
-                + p->packet_len;
+    transferred = ((uint64_t) pages->num) * qemu_target_page_size();
+    if (!migrate_fixed_ram()) {
+        transferred += p->packet_len;
+    }
     qemu_file_update_transfer(f, transferred);
     ram_counters.multifd_bytes += transferred;
     ram_counters.transferred += transferred;
+    if (p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+        ram_counters.zero_copy_bytes +=
+            ((uint64_t) pages->num) * qemu_target_page_size();
+    }
     qemu_mutex_unlock(&p->mutex);
     qemu_sem_post(&p->sem);
 
@@ -490,6 +645,133 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset)
     return 1;
 }
 
+bool multifd_device_state_save_active(void)
+{
+    return migrate_multifd_device_state() && multifd_send_state;
+}
+
+/**
+ * multifd_queue_device_state: queue a buffer of device state
+ *
+ * Hand the buffer to the first idle channel, which takes ownership
+ * of it.  Called from the device state threads, or from the migration
+ * thread while iterating.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @idstr: savevm section of the device
+ * @instance_id: instance of the device
+ * @idx: index of the buffer for that device
+ * @buf: g_malloc()ed buffer, freed even on error
+ * @len: size of @buf
+ * @errp: pointer to an error
+ */
+int multifd_queue_device_state(const char *idstr, uint32_t instance_id,
+                               uint64_t idx, char *buf, size_t len,
+                               Error **errp)
+{
+    MultiFDDeviceState_t *ds;
+    MultiFDSendParams *p;
+
+    if (len > SAVEVM_STATE_BUFFER_MAX_SIZE) {
+        error_setg(errp, "multifd: device state of %s is too large (%zu)",
+                   idstr, len);
+        g_free(buf);
+        return -1;
+    }
+
+    if (qatomic_read(&multifd_send_state->exiting)) {
+        error_setg(errp, "multifd: channels have been shut down");
+        g_free(buf);
+        return -1;
+    }
+
+    ds = g_new0(MultiFDDeviceState_t, 1);
+    pstrcpy(ds->idstr, sizeof(ds->idstr), idstr);
+    ds->instance_id = instance_id;
+    ds->idx = idx;
+    ds->buf = buf;
+    ds->len = len;
+
+    qemu_sem_wait(&multifd_send_state->channels_ready);
+    qemu_mutex_lock(&multifd_send_state->channel_mutex);
+    p = multifd_send_get_channel();
+    if (!p) {
+        qemu_mutex_unlock(&multifd_send_state->channel_mutex);
+        error_setg(errp, "multifd: channels have been shut down");
+        g_free(ds->buf);
+        g_free(ds);
+        return -1;
+    }
+    ds->packet_num = multifd_send_state->packet_num++;
+    qemu_mutex_unlock(&multifd_send_state->channel_mutex);
+
+    assert(!p->device_state);
+    p->device_state = ds;
+
+    qemu_mutex_lock(&multifd_send_state->device_state_mutex);
+    multifd_send_state->device_state_pending++;
+    multifd_send_state->device_state_bytes += p->packet_len + len;
+    qemu_mutex_unlock(&multifd_send_state->device_state_mutex);
+
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&p->sem);
+
+    trace_multifd_queue_device_state(p->id, idstr, instance_id, idx, len);
+    return 0;
+}
+
+/**
+ * multifd_device_state_account: account the queued device state
+ *
+ * Add the device state queued since the last call to the migration
+ * statistics, without waiting for the channels to write it.
+ *
+ * @f: QEMUFile where to account the transferred bytes
+ */
+void multifd_device_state_account(QEMUFile *f)
+{
+    uint64_t bytes;
+
+    qemu_mutex_lock(&multifd_send_state->device_state_mutex);
+    bytes = multifd_send_state->device_state_bytes;
+    multifd_send_state->device_state_bytes = 0;
+    qemu_mutex_unlock(&multifd_send_state->device_state_mutex);
+
+    qemu_file_update_transfer(f, bytes);
+    ram_counters.multifd_bytes += bytes;
+    ram_counters.transferred += bytes;
+}
+
+/**
+ * multifd_device_state_flush: wait for the queued device state
+ *
+ * Wait until the channels have written all the device state buffers
+ * and account them in the migration statistics.  Called from the
+ * migration thread once the device state threads have finished.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @f: QEMUFile where to account the transferred bytes
+ */
+int multifd_device_state_flush(QEMUFile *f)
+{
+    qemu_mutex_lock(&multifd_send_state->device_state_mutex);
+    while (multifd_send_state->device_state_pending &&
+           !qatomic_read(&multifd_send_state->exiting)) {
+        qemu_cond_wait(&multifd_send_state->device_state_cond,
+                       &multifd_send_state->device_state_mutex);
+    }
+    qemu_mutex_unlock(&multifd_send_state->device_state_mutex);
+
+    multifd_device_state_account(f);
+
+    if (qatomic_read(&multifd_send_state->exiting)) {
+        return -1;
+    }
+    return 0;
+}
+
 static void multifd_send_terminate_threads(Error *err)
 {
     int i;
@@ -518,6 +800,11 @@ static void multifd_send_terminate_threads(Error *err)
         return;
     }
 
+    /* Wake up the migration thread if it waits for the device state */
+    qemu_mutex_lock(&multifd_send_state->device_state_mutex);
+    qemu_cond_broadcast(&multifd_send_state->device_state_cond);
+    qemu_mutex_unlock(&multifd_send_state->device_state_mutex);
+
     for (i = 0; i < migrate_multifd_channels(); i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
 
@@ -531,6 +818,19 @@ static void multifd_send_terminate_threads(Error *err)
     }
 }
 
+static void multifd_send_channel_destroy(QIOChannel *send)
+{
+    if (migrate_fixed_ram()) {
+        file_send_channel_destroy(send);
+#ifdef CONFIG_RDMA
+    } else if (multifd_use_rdma()) {
+        rdma_send_channel_destroy(send);
+#endif
+    } else {
+        socket_send_channel_destroy(send);
+    }
+}
+
 void multifd_save_cleanup(void)
 {
     int i;
@@ -553,7 +853,7 @@ void multifd_save_cleanup(void)
         if (p->registered_yank) {
             migration_ioc_unregister_yank(p->c);
         }
-        socket_send_channel_destroy(p->c);
+        multifd_send_channel_destroy(p->c);
         p->c = NULL;
         qemu_mutex_destroy(&p->mutex);
         qemu_sem_destroy(&p->sem);
@@ -564,6 +864,13 @@ void multifd_save_cleanup(void)
         p->tls_hostname = NULL;
         multifd_pages_clear(p->pages);
         p->pages = NULL;
+        if (p->device_state) {
+            g_free(p->device_state->buf);
+            g_free(p->device_state);
+            p->device_state = NULL;
+        }
+        g_free(p->zero);
+        p->zero = NULL;
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
@@ -574,6 +881,9 @@ void multifd_save_cleanup(void)
         }
     }
     qemu_sem_destroy(&multifd_send_state->channels_ready);
+    qemu_mutex_destroy(&multifd_send_state->channel_mutex);
+    qemu_mutex_destroy(&multifd_send_state->device_state_mutex);
+    qemu_cond_destroy(&multifd_send_state->device_state_cond);
     g_free(multifd_send_state->params);
     multifd_send_state->params = NULL;
     multifd_pages_clear(multifd_send_state->pages);
@@ -600,15 +910,18 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_signal(p->id);
 
+        qemu_mutex_lock(&multifd_send_state->channel_mutex);
         qemu_mutex_lock(&p->mutex);
 
         if (p->quit) {
             error_report("%s: channel %d has already quit", __func__, i);
             qemu_mutex_unlock(&p->mutex);
+            qemu_mutex_unlock(&multifd_send_state->channel_mutex);
             return;
         }
 
         p->packet_num = multifd_send_state->packet_num++;
+        qemu_mutex_unlock(&multifd_send_state->channel_mutex);
         p->flags |= MULTIFD_FLAG_SYNC;
         p->pending_job++;
         qemu_file_update_transfer(f, p->packet_len);
@@ -622,10 +935,143 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_send_account_zero_pages(p);
+        qemu_mutex_unlock(&p->mutex);
+
+        if (p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+            Error *err = NULL;
+            int ret = qio_channel_flush(p->c, &err);
+
+            if (ret < 0) {
+                error_report_err(err);
+                return;
+            } else if (ret == 1) {
+                ram_counters.dirty_sync_missed_zero_copy++;
+            }
+        }
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/**
+ * multifd_send_zero_page_detect: find the zero pages of a packet
+ *
+ * Move the zero pages after the normal ones, so that the compression
+ * methods only see the pages whose contents need to be sent.  The
+ * offsets of the zero pages are sent in the packet header.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t normal = 0;
+    uint32_t zero = 0;
+    int i;
+
+    for (i = 0; i < pages->num; i++) {
+        ram_addr_t offset = pages->offset[i];
+
+        if (buffer_is_zero(pages->block->host + offset, page_size)) {
+            ram_block_merge_hint(pages->block, offset, page_size);
+            p->zero[zero++] = offset;
+            continue;
+        }
+        pages->offset[normal] = offset;
+        pages->iov[normal] = pages->iov[i];
+        normal++;
+    }
+    memcpy(&pages->offset[normal], p->zero, zero * sizeof(ram_addr_t));
+    pages->num = normal;
+    pages->zero_num = zero;
+    p->zero_pages += zero;
+}
+
+/**
+ * multifd_send_device_state: write a buffer of device state
+ *
+ * The device state goes in the payload of a packet without pages.
+ * Called from the channel thread without the channel mutex.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @ds: the device state to write
+ * @errp: pointer to an error
+ */
+static int multifd_send_device_state(MultiFDSendParams *p,
+                                     MultiFDDeviceState_t *ds, Error **errp)
+{
+    MultiFDPacket_t *packet = p->packet;
+    struct iovec iov[2] = {
+        { .iov_base = packet, .iov_len = p->packet_len },
+        { .iov_base = ds->buf, .iov_len = ds->len },
+    };
+
+    packet->flags = cpu_to_be32(MULTIFD_FLAG_DEVICE_STATE);
+    packet->pages_alloc = cpu_to_be32(p->pages->allocated);
+    packet->pages_used = 0;
+    packet->zero_pages = 0;
+    packet->next_packet_size = cpu_to_be32(ds->len);
+    packet->packet_num = cpu_to_be64(ds->packet_num);
+    packet->instance_id = cpu_to_be32(ds->instance_id);
+    packet->state_idx = cpu_to_be64(ds->idx);
+    strncpy(packet->ramblock, ds->idstr, 256);
+
+    trace_multifd_send_device_state(p->id, ds->packet_num, ds->idstr,
+                                    ds->instance_id, ds->idx, ds->len);
+
+    return qio_channel_writev_all(p->c, iov, ds->len ? 2 : 1, errp);
+}
+
+/**
+ * multifd_send_fixed_ram: write the pages at their offset in the file
+ *
+ * With fixed-ram there are no packets: each run of contiguous pages is
+ * written with a single pwritev() at the offset reserved for the
+ * RAMBlock, and the file bitmap of the block records which pages are
+ * present.  Called from the channel thread without the channel mutex.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int multifd_send_fixed_ram(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    RAMBlock *block = pages->block;
+    size_t page_size = qemu_target_page_size();
+    uint32_t start, i, j;
+
+    for (i = pages->num; i < pages->num + pages->zero_num; i++) {
+        clear_bit_atomic(pages->offset[i] / page_size, block->file_bmap);
+    }
+
+    for (start = 0; start < pages->num; start = i) {
+        for (i = start + 1; i < pages->num && i - start < IOV_MAX; i++) {
+            if (pages->offset[i] != pages->offset[i - 1] + page_size) {
+                break;
+            }
+        }
+
+        if (qio_channel_pwritev(p->c, &pages->iov[start], i - start,
+                                block->pages_offset + pages->offset[start],
+                                errp) < 0) {
+            return -1;
+        }
+
+        for (j = start; j < i; j++) {
+            set_bit_atomic(pages->offset[j] / page_size, block->file_bmap);
+        }
+    }
+
+    return 0;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
@@ -635,7 +1081,9 @@ static void *multifd_send_thread(void *opaque)
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
+    /* A fixed-ram file has no room for the channel handshake */
+    if (!migrate_fixed_ram() &&
+        multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
         goto out;
     }
@@ -650,27 +1098,92 @@ static void *multifd_send_thread(void *opaque)
         }
         qemu_mutex_lock(&p->mutex);
 
-        if (p->pending_job) {
-            uint32_t used = p->pages->num;
+        if (p->device_state) {
+            MultiFDDeviceState_t *ds = p->device_state;
+
+            p->device_state = NULL;
+            p->num_packets++;
+            qemu_mutex_unlock(&p->mutex);
+
+            ret = multifd_send_device_state(p, ds, &local_err);
+            g_free(ds->buf);
+            g_free(ds);
+            if (ret != 0) {
+                break;
+            }
+
+            qemu_mutex_lock(&p->mutex);
+            p->pending_job--;
+            qemu_mutex_unlock(&p->mutex);
+
+            qemu_mutex_lock(&multifd_send_state->device_state_mutex);
+            multifd_send_state->device_state_pending--;
+            qemu_cond_broadcast(&multifd_send_state->device_state_cond);
+            qemu_mutex_unlock(&multifd_send_state->device_state_mutex);
+
+            qemu_sem_post(&multifd_send_state->channels_ready);
+        } else if (p->pending_job && migrate_fixed_ram()) {
+            uint32_t flags = p->flags;
+
+            p->flags = 0;
+            qemu_mutex_unlock(&p->mutex);
+
+            /* The pages stay ours until pending_job drops */
+            if (multifd_send_state->zero_page && p->pages->num) {
+                multifd_send_zero_page_detect(p);
+            }
+            if (p->pages->num + p->pages->zero_num) {
+                ret = multifd_send_fixed_ram(p, &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+
+            qemu_mutex_lock(&p->mutex);
+            p->num_pages += p->pages->num + p->pages->zero_num;
+            p->pages->num = 0;
+            p->pages->zero_num = 0;
+            p->pages->block = NULL;
+            p->pending_job--;
+            qemu_mutex_unlock(&p->mutex);
+
+            if (flags & MULTIFD_FLAG_SYNC) {
+                qemu_sem_post(&p->sem_sync);
+            }
+            qemu_sem_post(&multifd_send_state->channels_ready);
+        } else if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
             uint32_t flags = p->flags;
+            RAMBlock *block = p->pages->block;
+            uint32_t used, zero;
+
+            if (multifd_send_state->zero_page && p->pages->num) {
+                multifd_send_zero_page_detect(p);
+            }
+            used = p->pages->num;
+            zero = p->pages->zero_num;
 
             if (used) {
+                int64_t start = migration_latency_start();
+
                 ret = multifd_send_state->ops->send_prepare(p, &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
+                migration_latency_end(MIGRATION_LATENCY_MULTIFD_SEND_PREPARE,
+                                      start);
             }
             multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
-            p->num_pages += used;
+            p->num_pages += used + zero;
             p->pages->num = 0;
+            p->pages->zero_num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, used, flags,
+            trace_multifd_send(p->id, packet_num, used, zero, flags,
                                p->next_packet_size);
 
             ret = qio_channel_write_all(p->c, (void *)p->packet,
@@ -680,10 +1193,27 @@ static void *multifd_send_thread(void *opaque)
             }
 
             if (used) {
+                int64_t start = migration_latency_start();
+
                 ret = multifd_send_state->ops->send_write(p, used, &local_err);
                 if (ret != 0) {
                     break;
                 }
+                migration_latency_end(MIGRATION_LATENCY_MULTIFD_SEND_WRITE,
+                                      start);
+            }
+
+            /*
+             * Background snapshots keep the pages write protected until
+             * they are sent.  The offsets stay valid until pending_job is
+             * dropped, as p->pages isn't handed out before.
+             */
+            if (migrate_background_snapshot() && (used || zero) &&
+                ram_write_tracking_release(block, p->pages->offset,
+                                           used + zero)) {
+                error_setg(&local_err, "multifd %d: failed to release the "
+                           "write protection of the pages", p->id);
+                break;
             }
 
             qemu_mutex_lock(&p->mutex);
@@ -744,6 +1274,14 @@ static void multifd_tls_outgoing_handshake(QIOTask *task,
         trace_multifd_tls_outgoing_handshake_error(ioc, error_get_pretty(err));
     } else {
         trace_multifd_tls_outgoing_handshake_complete(ioc);
+        /* Zero copy over TLS relies on the kernel doing the encryption */
+        if ((p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+            !qio_channel_has_feature(ioc,
+                                     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&err, "multifd %d: zero copy send needs kernel TLS, "
+                       "which was not enabled for this session", p->id);
+            migrate_set_error(migrate_get_current(), err);
+        }
     }
 
     if (!multifd_channel_connect(p, ioc, err)) {
@@ -857,6 +1395,13 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
     if (qio_task_propagate_error(task, &local_err)) {
         goto cleanup;
     } else {
+        if ((p->write_flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) &&
+            !qio_channel_has_feature(sioc,
+                                     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&local_err, "multifd %d: zero copy send is not "
+                       "supported by this channel", p->id);
+            goto cleanup;
+        }
         p->c = QIO_CHANNEL(sioc);
         qio_channel_set_delay(p->c, false);
         p->running = true;
@@ -871,9 +1416,36 @@ cleanup:
 }
 
 static bool migrate_allow_multifd = true;
+static bool migrate_multifd_rdma;
 void migrate_protocol_allow_multifd(bool allow)
 {
     migrate_allow_multifd = allow;
+    migrate_multifd_rdma = false;
+}
+
+/* The channels are RDMA connections and the pages go as RDMA writes */
+void migrate_protocol_allow_multifd_rdma(void)
+{
+    migrate_allow_multifd = true;
+    migrate_multifd_rdma = true;
+}
+
+bool multifd_use_rdma(void)
+{
+    return migrate_use_multifd() && migrate_multifd_rdma;
+}
+
+static void multifd_send_channel_create(MultiFDSendParams *p)
+{
+    if (migrate_fixed_ram()) {
+        file_send_channel_create(multifd_new_send_channel_async, p);
+#ifdef CONFIG_RDMA
+    } else if (multifd_use_rdma()) {
+        rdma_send_channel_create(multifd_new_send_channel_async, p);
+#endif
+    } else {
+        socket_send_channel_create(multifd_new_send_channel_async, p);
+    }
 }
 
 bool migrate_multifd_is_allowed(void)
@@ -896,14 +1468,29 @@ int multifd_save_setup(Error **errp)
         return -1;
     }
 
+    if (migrate_fixed_ram() &&
+        migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+        error_setg(errp, "fixed-ram does not support multifd compression");
+        return -1;
+    }
+    if (multifd_use_rdma() &&
+        migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+        error_setg(errp, "multifd over RDMA does not support compression");
+        return -1;
+    }
+
     s = migrate_get_current();
     thread_count = migrate_multifd_channels();
     multifd_send_state = g_malloc0(sizeof(*multifd_send_state));
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
     multifd_send_state->pages = multifd_pages_init(page_count);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
+    qemu_mutex_init(&multifd_send_state->channel_mutex);
+    qemu_mutex_init(&multifd_send_state->device_state_mutex);
+    qemu_cond_init(&multifd_send_state->device_state_cond);
     qatomic_set(&multifd_send_state->exiting, 0);
-    multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_send_state->ops = multifd_get_ops();
+    multifd_send_state->zero_page = migrate_multifd_zero_page();
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -915,6 +1502,7 @@ int multifd_save_setup(Error **errp)
         p->pending_job = 0;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(uint64_t) * page_count;
         p->packet = g_malloc0(p->packet_len);
@@ -922,7 +1510,11 @@ int multifd_save_setup(Error **errp)
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
         p->name = g_strdup_printf("multifdsend_%d", i);
         p->tls_hostname = g_strdup(s->hostname);
-        socket_send_channel_create(multifd_new_send_channel_async, p);
+        p->write_flags = 0;
+        if (migrate_use_zero_copy_send()) {
+            p->write_flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+        }
+        multifd_send_channel_create(p);
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -949,8 +1541,60 @@ struct {
     uint64_t packet_num;
     /* multifd ops */
     MultiFDMethods *ops;
+    /* number of threads that have exited */
+    int exited;
 } *multifd_recv_state;
 
+/*
+ * With fixed-ram the destination reads the pages straight from the
+ * file, and multifd only decides how many threads do the reading.
+ */
+bool multifd_recv_use_channels(void)
+{
+    return migrate_use_multifd() && !migrate_fixed_ram();
+}
+
+bool multifd_device_state_load_active(void)
+{
+    return migrate_multifd_device_state() && multifd_recv_state;
+}
+
+/**
+ * multifd_recv_device_state: receive a buffer of device state
+ *
+ * Read the payload of a device state packet and pass it to savevm,
+ * which loads the buffers of each device in order.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int multifd_recv_device_state(MultiFDRecvParams *p, Error **errp)
+{
+    MultiFDPacket_t *packet = p->packet;
+    uint32_t instance_id = be32_to_cpu(packet->instance_id);
+    uint64_t idx = be64_to_cpu(packet->state_idx);
+    size_t len = p->next_packet_size;
+    char *buf = NULL;
+
+    /* make sure that the idstr is 0 terminated */
+    packet->ramblock[255] = 0;
+    trace_multifd_recv_device_state(p->id, p->packet_num, packet->ramblock,
+                                    instance_id, idx, len);
+
+    if (len) {
+        buf = g_malloc(len);
+        if (qio_channel_read_all(p->c, buf, len, errp) < 0) {
+            g_free(buf);
+            return -1;
+        }
+    }
+
+    return qemu_loadvm_load_state_buffer(packet->ramblock, instance_id, idx,
+                                         buf, len, errp);
+}
+
 static void multifd_recv_terminate_threads(Error *err)
 {
     int i;
@@ -989,7 +1633,7 @@ int multifd_load_cleanup(Error **errp)
 {
     int i;
 
-    if (!migrate_use_multifd() || !migrate_multifd_is_allowed()) {
+    if (!multifd_recv_use_channels() || !migrate_multifd_is_allowed()) {
         return 0;
     }
     multifd_recv_terminate_threads(NULL);
@@ -1036,7 +1680,7 @@ void multifd_recv_sync_main(void)
 {
     int i;
 
-    if (!migrate_use_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return;
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1070,7 +1714,9 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t zero;
         uint32_t flags;
+        uint32_t i;
 
         if (p->quit) {
             break;
@@ -1093,13 +1739,14 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->num;
+        zero = p->pages->zero_num;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, used, flags,
+        trace_multifd_recv(p->id, p->packet_num, used, zero, flags,
                            p->next_packet_size);
         p->num_packets++;
-        p->num_pages += used;
+        p->num_pages += used + zero;
         qemu_mutex_unlock(&p->mutex);
 
         if (used) {
@@ -1109,6 +1756,23 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        if (flags & MULTIFD_FLAG_DEVICE_STATE) {
+            ret = multifd_recv_device_state(p, &local_err);
+            if (ret != 0) {
+                break;
+            }
+            continue;
+        }
+
+        for (i = used; i < used + zero; i++) {
+            ram_handle_compressed(p->host + p->pages->offset[i],
+                                  0, qemu_target_page_size());
+        }
+
+        if ((used || zero) && migration_incoming_colo_enabled()) {
+            multifd_recv_colo_pages(p);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1117,8 +1781,19 @@ static void *multifd_recv_thread(void *opaque)
 
     if (local_err) {
         multifd_recv_terminate_threads(local_err);
+        qemu_loadvm_abort_state_buffers();
         error_free(local_err);
     }
+
+    /*
+     * Once all channels are gone no more device state can arrive,
+     * don't let the main thread wait for it.
+     */
+    if (qatomic_inc_fetch(&multifd_recv_state->exited) ==
+        migrate_multifd_channels()) {
+        qemu_loadvm_abort_state_buffers();
+    }
+
     qemu_mutex_lock(&p->mutex);
     p->running = false;
     qemu_mutex_unlock(&p->mutex);
@@ -1135,7 +1810,7 @@ int multifd_load_setup(Error **errp)
     uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
     uint8_t i;
 
-    if (!migrate_use_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return 0;
     }
     if (!migrate_multifd_is_allowed()) {
@@ -1146,8 +1821,9 @@ int multifd_load_setup(Error **errp)
     multifd_recv_state = g_malloc0(sizeof(*multifd_recv_state));
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
     qatomic_set(&multifd_recv_state->count, 0);
+    qatomic_set(&multifd_recv_state->exited, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
-    multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_recv_state->ops = multifd_get_ops();
 
     for (i = 0; i < thread_count; i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
@@ -1181,7 +1857,7 @@ bool multifd_recv_all_channels_created(void)
 {
     int thread_count = migrate_multifd_channels();
 
-    if (!migrate_use_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return true;
     }
 
@@ -15,15 +15,25 @@
 
 bool migrate_multifd_is_allowed(void);
 void migrate_protocol_allow_multifd(bool allow);
+void migrate_protocol_allow_multifd_rdma(void);
+bool multifd_use_rdma(void);
 int multifd_save_setup(Error **errp);
 void multifd_save_cleanup(void);
 int multifd_load_setup(Error **errp);
 int multifd_load_cleanup(Error **errp);
 bool multifd_recv_all_channels_created(void);
+bool multifd_recv_use_channels(void);
 bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
 void multifd_send_sync_main(QEMUFile *f);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
+bool multifd_device_state_save_active(void);
+bool multifd_device_state_load_active(void);
+int multifd_queue_device_state(const char *idstr, uint32_t instance_id,
+                               uint64_t idx, char *buf, size_t len,
+                               Error **errp);
+void multifd_device_state_account(QEMUFile *f);
+int multifd_device_state_flush(QEMUFile *f);
 
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
@@ -34,6 +44,11 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+#define MULTIFD_FLAG_QPL (4 << 1)
+
+/* The packet carries a buffer of device state instead of pages */
+#define MULTIFD_FLAG_DEVICE_STATE (1 << 4)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -48,7 +63,14 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* number of zero pages, their offsets follow the normal ones */
+    uint32_t zero_pages;
+    /* device state packets: instance of the device in ramblock */
+    uint32_t instance_id;
+    /* device state packets: index of the buffer for that device */
+    uint64_t state_idx;
+    uint64_t unused64[2];    /* Reserved for future use */
+    /* ramblock name, or savevm idstr for device state packets */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
@@ -56,6 +78,8 @@ typedef struct {
 typedef struct {
     /* number of used pages */
     uint32_t num;
+    /* number of zero pages, stored after the used ones */
+    uint32_t zero_num;
     /* number of allocated pages */
     uint32_t allocated;
     /* global number of generated multifd packets */
@@ -67,6 +91,19 @@ typedef struct {
     RAMBlock *block;
 } MultiFDPages_t;
 
+typedef struct {
+    /* savevm section of the device */
+    char idstr[256];
+    uint32_t instance_id;
+    /* index of this buffer for the device */
+    uint64_t idx;
+    /* global number of generated multifd packets */
+    uint64_t packet_num;
+    /* the device state, owned by the channel once queued */
+    char *buf;
+    size_t len;
+} MultiFDDeviceState_t;
+
 typedef struct {
     /* this fields are not changed once the thread is created */
     /* channel number */
@@ -89,10 +126,14 @@ typedef struct {
     bool quit;
     /* is the yank function registered */
     bool registered_yank;
+    /* flags used when writing pages to the channel */
+    int write_flags;
     /* thread has work to do */
     int pending_job;
     /* array of pages to sent */
     MultiFDPages_t *pages;
+    /* device state to send, if any */
+    MultiFDDeviceState_t *device_state;
     /* packet allocated len */
     uint32_t packet_len;
     /* pointer to the packet */
@@ -108,6 +149,10 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* zero pages found and not yet accounted by the migration thread */
+    uint64_t zero_pages;
+    /* scratch array used to sort the offsets of the zero pages */
+    ram_addr_t *zero;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* used for compression methods */
@@ -132,6 +177,8 @@ typedef struct {
     bool quit;
     /* array of pages to receive */
     MultiFDPages_t *pages;
+    /* where the pages are loaded: the RAM of the block or its COLO cache */
+    uint8_t *host;
     /* packet allocated len */
     uint32_t packet_len;
     /* pointer to the packet */
@@ -16,26 +16,45 @@
 
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
+#include "qemu/atomic.h"
 #include "qemu/host-utils.h"
+#include "qemu/processor.h"
+#include "qemu/rcu.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of consecutive entries where a page may be stored */
+#define CACHE_PROBE_LEN 4
+
+/* it_addr of an entry that holds no page */
+#define CACHE_ADDR_INVALID ((uint64_t)-1)
+
 typedef struct CacheItem CacheItem;
 
+/*
+ * An entry is owned by the thread that set it_locked, only this thread
+ * may look at or change the other fields.
+ */
 struct CacheItem {
+    uint32_t it_locked;
     uint64_t it_addr;
     uint64_t it_age;
-    uint8_t *it_data;
+    /* page and age that it_addr and it_age take if the entry is filled */
+    uint64_t it_new_addr;
+    uint64_t it_new_age;
 };
 
 struct PageCache {
+    struct rcu_head rcu;
     CacheItem *page_cache;
+    /* max_num_items pages, in the same order as page_cache */
+    uint8_t *data;
     size_t page_size;
     size_t max_num_items;
-    size_t num_items;
+    int hash_shift;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
@@ -58,14 +77,14 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     }
 
     /* We prefer not to abort if there is no memory */
-    cache = g_try_malloc(sizeof(*cache));
+    cache = g_try_malloc0(sizeof(*cache));
     if (!cache) {
         error_setg(errp, "Failed to allocate cache");
         return NULL;
     }
     cache->page_size = page_size;
-    cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->hash_shift = 64 - ctz64(num_pages);
 
     trace_migration_pagecache_init(cache->max_num_items);
 
@@ -78,98 +97,189 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
         return NULL;
     }
 
+    /*
+     * The pages are allocated at once, aligned so that the kernel can back
+     * them with huge pages: the cache is often several GiB large and is
+     * accessed randomly.  The memory is only populated when first written.
+     */
+    cache->data = qemu_try_memalign(QEMU_VMALLOC_ALIGN, num_pages * page_size);
+    if (!cache->data) {
+        error_setg(errp, "Failed to allocate page cache data");
+        g_free(cache->page_cache);
+        g_free(cache);
+        return NULL;
+    }
+    qemu_madvise(cache->data, num_pages * page_size, QEMU_MADV_HUGEPAGE);
+
     for (i = 0; i < cache->max_num_items; i++) {
-        cache->page_cache[i].it_data = NULL;
+        cache->page_cache[i].it_locked = 0;
         cache->page_cache[i].it_age = 0;
-        cache->page_cache[i].it_addr = -1;
+        cache->page_cache[i].it_addr = CACHE_ADDR_INVALID;
     }
 
     return cache;
 }
 
-void cache_fini(PageCache *cache)
+static void cache_free(PageCache *cache)
 {
-    int64_t i;
+    qemu_vfree(cache->data);
+    g_free(cache->page_cache);
+    g_free(cache);
+}
 
+void cache_fini(PageCache *cache)
+{
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    for (i = 0; i < cache->max_num_items; i++) {
-        g_free(cache->page_cache[i].it_data);
-    }
-
-    g_free(cache->page_cache);
-    cache->page_cache = NULL;
-    g_free(cache);
+    call_rcu(cache, cache_free, rcu);
 }
 
+/* first entry where @address may be stored */
 static size_t cache_get_cache_pos(const PageCache *cache,
                                   uint64_t address)
 {
+    uint64_t page = address / cache->page_size;
+
     g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    if (cache->max_num_items == 1) {
+        return 0;
+    }
+    /* Fibonacci hashing, so that neighbour pages don't share entries */
+    return (page * 0x9e3779b97f4a7c15ULL) >> cache->hash_shift;
+}
+
+/*
+ * Entries are only locked for the time it takes to look at them, or to
+ * update one page, so this doesn't have to wait for long.
+ */
+static void cache_item_lock(CacheItem *it)
+{
+    while (qatomic_read(&it->it_locked) ||
+           qatomic_cmpxchg(&it->it_locked, 0, 1)) {
+        cpu_relax();
+    }
+}
+
+static void cache_item_unlock(CacheItem *it)
+{
+    qatomic_store_release(&it->it_locked, 0);
 }
 
-static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+static uint8_t *cache_item_data(const PageCache *cache, const CacheItem *it)
 {
-    size_t pos;
+    return cache->data + (it - cache->page_cache) * cache->page_size;
+}
+
+/*
+ * Whether the entry can be given to a new page, and if so how good a choice
+ * it is: the lower the better.
+ */
+static bool cache_item_replaceable(const CacheItem *it, uint64_t current_age,
+                                   uint64_t *score)
+{
+    if (it->it_addr == CACHE_ADDR_INVALID) {
+        *score = 0;
+        return true;
+    }
+    if (it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+        /* the cache page is fresh, don't replace it */
+        return false;
+    }
+    *score = it->it_age + 1;
+    return true;
+}
+
+uint8_t *cache_lock_page(PageCache *cache, uint64_t addr,
+                         uint64_t current_age, bool *hit)
+{
+    size_t pos, probe_len;
+    CacheItem *victim = NULL;
+    uint64_t victim_score = 0, score;
+    size_t i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
     pos = cache_get_cache_pos(cache, addr);
+    probe_len = MIN(CACHE_PROBE_LEN, cache->max_num_items);
+
+    /*
+     * Only one entry is locked at a time, so that threads looking up
+     * pages that share entries can't deadlock.
+     */
+    for (i = 0; i < probe_len; i++) {
+        CacheItem *it;
+
+        it = &cache->page_cache[(pos + i) & (cache->max_num_items - 1)];
+        cache_item_lock(it);
+
+        if (it->it_addr == addr) {
+            /* update the it_age when the cache hit */
+            it->it_age = current_age;
+            it->it_new_addr = addr;
+            it->it_new_age = current_age;
+            *hit = true;
+            return cache_item_data(cache, it);
+        }
 
-    return &cache->page_cache[pos];
-}
+        if (cache_item_replaceable(it, current_age, &score) &&
+            (!victim || score < victim_score)) {
+            victim = it;
+            victim_score = score;
+        }
+        cache_item_unlock(it);
+    }
 
-uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
-{
-    return cache_get_by_addr(cache, addr)->it_data;
+    if (!victim) {
+        return NULL;
+    }
+
+    /*
+     * Nobody else inserts @addr, but the victim may have been taken by
+     * another page in the meantime.
+     */
+    cache_item_lock(victim);
+    if (!cache_item_replaceable(victim, current_age, &score)) {
+        cache_item_unlock(victim);
+        return NULL;
+    }
+
+    victim->it_new_addr = addr;
+    victim->it_new_age = current_age;
+    *hit = false;
+    return cache_item_data(cache, victim);
 }
 
-bool cache_is_cached(const PageCache *cache, uint64_t addr,
-                     uint64_t current_age)
+void cache_unlock_page(PageCache *cache, uint8_t *data, bool filled)
 {
     CacheItem *it;
 
-    it = cache_get_by_addr(cache, addr);
+    g_assert(data >= cache->data &&
+             data < cache->data + cache->max_num_items * cache->page_size);
 
-    if (it->it_addr == addr) {
-        /* update the it_age when the cache hit */
-        it->it_age = current_age;
-        return true;
+    it = &cache->page_cache[(data - cache->data) / cache->page_size];
+    if (filled) {
+        it->it_addr = it->it_new_addr;
+        it->it_age = it->it_new_age;
     }
-    return false;
+    cache_item_unlock(it);
 }
 
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
+    uint8_t *data;
+    bool hit;
 
-    CacheItem *it;
-
-    /* actual update of entry */
-    it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
+    data = cache_lock_page(cache, addr, current_age, &hit);
+    if (!data) {
+        trace_migration_pagecache_insert();
         return -1;
     }
-    /* allocate page */
-    if (!it->it_data) {
-        it->it_data = g_try_malloc(cache->page_size);
-        if (!it->it_data) {
-            trace_migration_pagecache_insert();
-            return -1;
-        }
-        cache->num_items++;
-    }
-
-    memcpy(it->it_data, pdata, cache->page_size);
 
-    it->it_age = current_age;
-    it->it_addr = addr;
+    memcpy(data, pdata, cache->page_size);
+    cache_unlock_page(cache, data, true);
 
     return 0;
 }
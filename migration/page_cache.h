@@ -31,31 +31,43 @@ typedef struct PageCache PageCache;
 PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
 /**
  * cache_fini: free all cache resources
+ *
+ * The memory is freed after an RCU grace period, so that threads that
+ * found the cache under rcu_read_lock() can finish using it.
+ *
  * @cache pointer to the PageCache struct
  */
 void cache_fini(PageCache *cache);
 
 /**
- * cache_is_cached: Checks to see if the page is cached
+ * cache_lock_page: find the cache entry for a page and lock it
+ *
+ * Returns a pointer to the data of the entry, or NULL if the page is not
+ * cached and no entry can take it.
  *
- * Returns %true if page is cached
+ * The entry stays locked until cache_unlock_page(), so that the cache can
+ * be used from several threads at once as long as they look up different
+ * pages.  Keep it locked for as short as possible: other threads looking
+ * up a page that may be stored in the same entry wait for it.
  *
  * @cache pointer to the PageCache struct
  * @addr: page addr
  * @current_age: current bitmap generation
+ * @hit: set to %true if the entry holds the data of @addr, to %false if
+ *       it is a free or stale entry that may be filled with it
  */
-bool cache_is_cached(const PageCache *cache, uint64_t addr,
-                     uint64_t current_age);
+uint8_t *cache_lock_page(PageCache *cache, uint64_t addr,
+                         uint64_t current_age, bool *hit);
 
 /**
- * get_cached_data: Get the data cached for an addr
- *
- * Returns pointer to the data cached or NULL if not cached
+ * cache_unlock_page: unlock an entry locked by cache_lock_page()
  *
  * @cache pointer to the PageCache struct
- * @addr: page addr
+ * @data: pointer returned by cache_lock_page()
+ * @filled: %true if the entry now holds the data of the page it was
+ *          locked for, %false to leave it as it was
  */
-uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
+void cache_unlock_page(PageCache *cache, uint8_t *data, bool filled);
 
 /**
  * cache_insert: insert the page into the cache. the page cache
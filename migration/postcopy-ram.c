@@ -32,6 +32,10 @@
 #include "trace.h"
 #include "hw/boards.h"
 #include "exec/ramblock.h"
+#include "socket.h"
+#include "multifd.h"
+#include "qemu-file-channel.h"
+#include "yank_functions.h"
 
 /* Arbitrary limit on size of each discard command,
  * keeps them around ~200 bytes
@@ -474,6 +478,59 @@ static int init_range(RAMBlock *rb, void *opaque)
     return 0;
 }
 
+/*
+ * Guest RAM is split between the fault threads: each RAMBlock is cut in
+ * nr_fault_threads parts of the same size, aligned to the host page size
+ * of the block, and part i is registered with the userfaultfd of thread i.
+ */
+static ram_addr_t postcopy_fault_chunk_size(MigrationIncomingState *mis,
+                                            RAMBlock *rb)
+{
+    return QEMU_ALIGN_UP(DIV_ROUND_UP(rb->postcopy_length,
+                                      mis->nr_fault_threads),
+                         qemu_ram_pagesize(rb));
+}
+
+/* Returns the fault thread serving @host_addr within @rb */
+static PostcopyFaultThread *
+postcopy_fault_thread_for(MigrationIncomingState *mis, RAMBlock *rb,
+                          void *host_addr)
+{
+    ram_addr_t offset;
+    int id;
+
+    if (mis->nr_fault_threads == 1) {
+        return &mis->fault_threads[0];
+    }
+
+    offset = (uintptr_t)host_addr - (uintptr_t)qemu_ram_get_host_addr(rb);
+    id = offset / postcopy_fault_chunk_size(mis, rb);
+    return &mis->fault_threads[MIN(id, mis->nr_fault_threads - 1)];
+}
+
+/*
+ * Close the file descriptors of the fault threads, which must not be
+ * running anymore.
+ */
+static void postcopy_fault_threads_close(MigrationIncomingState *mis)
+{
+    int i;
+
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        PostcopyFaultThread *pft = &mis->fault_threads[i];
+
+        if (pft->userfault_fd != -1) {
+            close(pft->userfault_fd);
+        }
+        if (pft->event_fd != -1) {
+            close(pft->event_fd);
+        }
+    }
+    g_free(mis->fault_threads);
+    mis->fault_threads = NULL;
+    mis->nr_fault_threads = 0;
+}
+
 /*
  * At the end of migration, undo the effects of init_range
  * opaque should be the MIS.
@@ -485,7 +542,9 @@ static int cleanup_range(RAMBlock *rb, void *opaque)
     ram_addr_t offset = qemu_ram_get_offset(rb);
     ram_addr_t length = rb->postcopy_length;
     MigrationIncomingState *mis = opaque;
+    ram_addr_t chunk = postcopy_fault_chunk_size(mis, rb);
     struct uffdio_range range_struct;
+    int i;
     trace_postcopy_cleanup_range(block_name, host_addr, offset, length);
 
     /*
@@ -499,13 +558,17 @@ static int cleanup_range(RAMBlock *rb, void *opaque)
      * pages.   It can be useful to leave it on to debug postcopy
      * if you're not sure it's always getting every page.
      */
-    range_struct.start = (uintptr_t)host_addr;
-    range_struct.len = length;
+    for (i = 0; i < mis->nr_fault_threads && i * chunk < length; i++) {
+        range_struct.start = (uintptr_t)host_addr + i * chunk;
+        range_struct.len = MIN(chunk, length - i * chunk);
 
-    if (ioctl(mis->userfault_fd, UFFDIO_UNREGISTER, &range_struct)) {
-        error_report("%s: userfault unregister %s", __func__, strerror(errno));
+        if (ioctl(mis->fault_threads[i].userfault_fd, UFFDIO_UNREGISTER,
+                  &range_struct)) {
+            error_report("%s: userfault unregister %s", __func__,
+                         strerror(errno));
 
-        return -1;
+            return -1;
+        }
     }
 
     return 0;
@@ -530,16 +593,26 @@ int postcopy_ram_incoming_init(MigrationIncomingState *mis)
  */
 int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
 {
+    int i;
+
     trace_postcopy_ram_incoming_cleanup_entry();
 
+    if (mis->have_preempt_thread) {
+        /* The source ends the preempt channel with RAM_SAVE_FLAG_EOS */
+        qemu_thread_join(&mis->preempt_thread);
+        mis->have_preempt_thread = false;
+    }
+
     if (mis->have_fault_thread) {
         Error *local_err = NULL;
 
-        /* Let the fault thread quit */
+        /* Let the fault threads quit */
         qatomic_set(&mis->fault_thread_quit, 1);
         postcopy_fault_thread_notify(mis);
         trace_postcopy_ram_incoming_cleanup_join();
-        qemu_thread_join(&mis->fault_thread);
+        for (i = 0; i < mis->nr_fault_threads; i++) {
+            qemu_thread_join(&mis->fault_threads[i].thread);
+        }
 
         if (postcopy_notify(POSTCOPY_NOTIFY_INBOUND_END, &local_err)) {
             error_report_err(local_err);
@@ -551,8 +624,7 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         }
 
         trace_postcopy_ram_incoming_cleanup_closeuf();
-        close(mis->userfault_fd);
-        close(mis->userfault_event_fd);
+        postcopy_fault_threads_close(mis);
         mis->have_fault_thread = false;
     }
 
@@ -566,9 +638,11 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         }
     }
 
-    if (mis->postcopy_tmp_page) {
-        munmap(mis->postcopy_tmp_page, mis->largest_page_size);
-        mis->postcopy_tmp_page = NULL;
+    for (i = 0; i < RAM_CHANNEL_MAX; i++) {
+        if (mis->postcopy_tmp_pages[i]) {
+            munmap(mis->postcopy_tmp_pages[i], mis->largest_page_size);
+            mis->postcopy_tmp_pages[i] = NULL;
+        }
     }
     if (mis->postcopy_tmp_zero_page) {
         munmap(mis->postcopy_tmp_zero_page, mis->largest_page_size);
@@ -630,20 +704,29 @@ int postcopy_ram_prepare_discard(MigrationIncomingState *mis)
 static int ram_block_enable_notify(RAMBlock *rb, void *opaque)
 {
     MigrationIncomingState *mis = opaque;
+    ram_addr_t chunk = postcopy_fault_chunk_size(mis, rb);
+    ram_addr_t length = rb->postcopy_length;
     struct uffdio_register reg_struct;
+    int i;
 
-    reg_struct.range.start = (uintptr_t)qemu_ram_get_host_addr(rb);
-    reg_struct.range.len = rb->postcopy_length;
-    reg_struct.mode = UFFDIO_REGISTER_MODE_MISSING;
-
-    /* Now tell our userfault_fd that it's responsible for this area */
-    if (ioctl(mis->userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
-        error_report("%s userfault register: %s", __func__, strerror(errno));
-        return -1;
-    }
-    if (!(reg_struct.ioctls & ((__u64)1 << _UFFDIO_COPY))) {
-        error_report("%s userfault: Region doesn't support COPY", __func__);
-        return -1;
+    for (i = 0; i < mis->nr_fault_threads && i * chunk < length; i++) {
+        reg_struct.range.start = (uintptr_t)qemu_ram_get_host_addr(rb) +
+                                 i * chunk;
+        reg_struct.range.len = MIN(chunk, length - i * chunk);
+        reg_struct.mode = UFFDIO_REGISTER_MODE_MISSING;
+
+        /* Now tell our userfault_fd that it's responsible for this area */
+        if (ioctl(mis->fault_threads[i].userfault_fd, UFFDIO_REGISTER,
+                  &reg_struct)) {
+            error_report("%s userfault register: %s", __func__,
+                         strerror(errno));
+            return -1;
+        }
+        if (!(reg_struct.ioctls & ((__u64)1 << _UFFDIO_COPY))) {
+            error_report("%s userfault: Region doesn't support COPY",
+                         __func__);
+            return -1;
+        }
     }
     if (reg_struct.ioctls & ((__u64)1 << _UFFDIO_ZEROPAGE)) {
         qemu_ram_set_uf_zeroable(rb);
@@ -691,6 +774,11 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
         return received ? 0 : postcopy_place_page_zero(mis, aligned, rb);
     }
 
+    /* With fixed-ram-lazy, the page is in the migration file */
+    if (mis->lazy_restore_ioc) {
+        return ram_lazy_restore_fault(mis, rb, start);
+    }
+
     return migrate_send_rp_req_pages(mis, rb, start, haddr);
 }
 
@@ -873,33 +961,91 @@ static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
     return true;
 }
 
+/*
+ * Request the page of a fault from the source
+ *
+ * Returns 0 on success, -1 on unrecoverable error
+ */
+static int postcopy_ram_fault_request(MigrationIncomingState *mis,
+                                      struct uffd_msg *msg)
+{
+    ram_addr_t rb_offset;
+    RAMBlock *rb;
+    int ret;
+
+    rb = qemu_ram_block_from_host((void *)(uintptr_t)msg->arg.pagefault.address,
+                                  true, &rb_offset);
+    if (!rb) {
+        error_report("postcopy_ram_fault_thread: Fault outside guest: %"
+                     PRIx64, (uint64_t)msg->arg.pagefault.address);
+        return -1;
+    }
+
+    rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
+    trace_postcopy_ram_fault_thread_request(msg->arg.pagefault.address,
+                                            qemu_ram_get_idstr(rb),
+                                            rb_offset,
+                                            msg->arg.pagefault.feat.ptid);
+    mark_postcopy_blocktime_begin((uintptr_t)(msg->arg.pagefault.address),
+                                  msg->arg.pagefault.feat.ptid, rb);
+
+retry:
+    /*
+     * Send the request to the source - we want to request one
+     * of our host page sizes (which is >= TPS)
+     */
+    ret = postcopy_request_page(mis, rb, rb_offset,
+                                msg->arg.pagefault.address);
+    if (ret) {
+        /* May be network failure, try to wait for recovery */
+        if (ret == -EIO && postcopy_pause_fault_thread(mis)) {
+            /* We got reconnected somehow, try to continue */
+            goto retry;
+        } else {
+            /* This is a unavoidable fault */
+            error_report("%s: postcopy_request_page() get %d",
+                         __func__, ret);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Number of userfault messages read at once by a fault thread */
+#define POSTCOPY_FAULT_BATCH 16
+
 /*
  * Handle faults detected by the USERFAULT markings
  */
 static void *postcopy_ram_fault_thread(void *opaque)
 {
-    MigrationIncomingState *mis = opaque;
+    PostcopyFaultThread *pft = opaque;
+    MigrationIncomingState *mis = pft->mis;
+    struct uffd_msg msgs[POSTCOPY_FAULT_BATCH];
     struct uffd_msg msg;
-    int ret;
+    int ret, i;
     size_t index;
-    RAMBlock *rb = NULL;
+    size_t nr_remote_fds;
 
-    trace_postcopy_ram_fault_thread_entry();
+    trace_postcopy_ram_fault_thread_entry(pft->id);
     rcu_register_thread();
-    mis->last_rb = NULL; /* last RAMBlock we sent part of */
     qemu_sem_post(&mis->fault_thread_sem);
 
     struct pollfd *pfd;
-    size_t pfd_len = 2 + mis->postcopy_remote_fds->len;
+    size_t pfd_len;
 
+    /* Requests from external processes are all handled by the first thread */
+    nr_remote_fds = pft->id ? 0 : mis->postcopy_remote_fds->len;
+    pfd_len = 2 + nr_remote_fds;
     pfd = g_new0(struct pollfd, pfd_len);
 
-    pfd[0].fd = mis->userfault_fd;
+    pfd[0].fd = pft->userfault_fd;
     pfd[0].events = POLLIN;
-    pfd[1].fd = mis->userfault_event_fd;
+    pfd[1].fd = pft->event_fd;
     pfd[1].events = POLLIN; /* Waiting for eventfd to go positive */
     trace_postcopy_ram_fault_thread_fds_core(pfd[0].fd, pfd[1].fd);
-    for (index = 0; index < mis->postcopy_remote_fds->len; index++) {
+    for (index = 0; index < nr_remote_fds; index++) {
         struct PostCopyFD *pcfd = &g_array_index(mis->postcopy_remote_fds,
                                                  struct PostCopyFD, index);
         pfd[2 + index].fd = pcfd->fd;
@@ -909,7 +1055,6 @@ static void *postcopy_ram_fault_thread(void *opaque)
     }
 
     while (true) {
-        ram_addr_t rb_offset;
         int poll_result;
 
         /*
@@ -924,7 +1069,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
             break;
         }
 
-        if (!mis->to_src_file) {
+        if (!mis->to_src_file && !mis->lazy_restore_ioc) {
             /*
              * Possibly someone tells us that the return path is
              * broken already using the event. We should hold until
@@ -943,7 +1088,7 @@ static void *postcopy_ram_fault_thread(void *opaque)
             uint64_t tmp64 = 0;
 
             /* Consume the signal */
-            if (read(mis->userfault_event_fd, &tmp64, 8) != 8) {
+            if (read(pft->event_fd, &tmp64, 8) != 8) {
                 /* Nothing obviously nicer than posting this error. */
                 error_report("%s: read() failed", __func__);
             }
@@ -955,9 +1100,11 @@ static void *postcopy_ram_fault_thread(void *opaque)
         }
 
         if (pfd[0].revents) {
+            int nr_msgs;
+
             poll_result--;
-            ret = read(mis->userfault_fd, &msg, sizeof(msg));
-            if (ret != sizeof(msg)) {
+            ret = read(pft->userfault_fd, msgs, sizeof(msgs));
+            if (ret < 0) {
                 if (errno == EAGAIN) {
                     /*
                      * if a wake up happens on the other thread just after
@@ -965,60 +1112,31 @@ static void *postcopy_ram_fault_thread(void *opaque)
                      */
                     continue;
                 }
-                if (ret < 0) {
-                    error_report("%s: Failed to read full userfault "
-                                 "message: %s",
-                                 __func__, strerror(errno));
-                    break;
-                } else {
-                    error_report("%s: Read %d bytes from userfaultfd "
-                                 "expected %zd",
-                                 __func__, ret, sizeof(msg));
-                    break; /* Lost alignment, don't know what we'd read next */
-                }
+                error_report("%s: Failed to read full userfault "
+                             "message: %s",
+                             __func__, strerror(errno));
+                break;
             }
-            if (msg.event != UFFD_EVENT_PAGEFAULT) {
-                error_report("%s: Read unexpected event %ud from userfaultfd",
-                             __func__, msg.event);
-                continue; /* It's not a page fault, shouldn't happen */
+            if (ret % sizeof(msgs[0])) {
+                error_report("%s: Read %d bytes from userfaultfd "
+                             "expected a multiple of %zd",
+                             __func__, ret, sizeof(msgs[0]));
+                break; /* Lost alignment, don't know what we'd read next */
             }
 
-            rb = qemu_ram_block_from_host(
-                     (void *)(uintptr_t)msg.arg.pagefault.address,
-                     true, &rb_offset);
-            if (!rb) {
-                error_report("postcopy_ram_fault_thread: Fault outside guest: %"
-                             PRIx64, (uint64_t)msg.arg.pagefault.address);
-                break;
+            nr_msgs = ret / sizeof(msgs[0]);
+            trace_postcopy_ram_fault_thread_batch(pft->id, nr_msgs);
+            ret = 0;
+            for (i = 0; i < nr_msgs && !ret; i++) {
+                if (msgs[i].event != UFFD_EVENT_PAGEFAULT) {
+                    error_report("%s: Read unexpected event %ud from "
+                                 "userfaultfd", __func__, msgs[i].event);
+                    continue; /* It's not a page fault, shouldn't happen */
+                }
+                ret = postcopy_ram_fault_request(mis, &msgs[i]);
             }
-
-            rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
-            trace_postcopy_ram_fault_thread_request(msg.arg.pagefault.address,
-                                                qemu_ram_get_idstr(rb),
-                                                rb_offset,
-                                                msg.arg.pagefault.feat.ptid);
-            mark_postcopy_blocktime_begin(
-                    (uintptr_t)(msg.arg.pagefault.address),
-                                msg.arg.pagefault.feat.ptid, rb);
-
-retry:
-            /*
-             * Send the request to the source - we want to request one
-             * of our host page sizes (which is >= TPS)
-             */
-            ret = postcopy_request_page(mis, rb, rb_offset,
-                                        msg.arg.pagefault.address);
             if (ret) {
-                /* May be network failure, try to wait for recovery */
-                if (ret == -EIO && postcopy_pause_fault_thread(mis)) {
-                    /* We got reconnected somehow, try to continue */
-                    goto retry;
-                } else {
-                    /* This is a unavoidable fault */
-                    error_report("%s: postcopy_request_page() get %d",
-                                 __func__, ret);
-                    break;
-                }
+                break;
             }
         }
 
@@ -1079,16 +1197,51 @@ retry:
         }
     }
     rcu_unregister_thread();
-    trace_postcopy_ram_fault_thread_exit();
+    trace_postcopy_ram_fault_thread_exit(pft->id);
     g_free(pfd);
     return NULL;
 }
 
-int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
+/*
+ * Load the urgent pages that the source sends on the preempt channel,
+ * until it sends RAM_SAVE_FLAG_EOS at the end of the migration.
+ */
+static void *postcopy_preempt_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    int ret = 0;
+
+    trace_postcopy_preempt_thread_entry();
+    rcu_register_thread();
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        ret = ram_load_postcopy(mis->postcopy_qemufile_dst,
+                                RAM_CHANNEL_POSTCOPY);
+    }
+    if (ret) {
+        /*
+         * Pages that were lost with the channel are sent again on the
+         * main channel when postcopy recovers.
+         */
+        error_report("%s: failed to load pages: %s", __func__,
+                     strerror(-ret));
+    }
+
+    rcu_unregister_thread();
+    trace_postcopy_preempt_thread_exit(ret);
+    return NULL;
+}
+
+/*
+ * Open the userfaultfd and the eventfd of a fault thread
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int postcopy_fault_thread_open(PostcopyFaultThread *pft)
 {
     /* Open the fd for the kernel to give us userfaults */
-    mis->userfault_fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
-    if (mis->userfault_fd == -1) {
+    pft->userfault_fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+    if (pft->userfault_fd == -1) {
         error_report("%s: Failed to open userfault fd: %s", __func__,
                      strerror(errno));
         return -1;
@@ -1098,23 +1251,53 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
      * Although the host check already tested the API, we need to
      * do the check again as an ABI handshake on the new fd.
      */
-    if (!ufd_check_and_apply(mis->userfault_fd, mis)) {
+    if (!ufd_check_and_apply(pft->userfault_fd, pft->mis)) {
         return -1;
     }
 
     /* Now an eventfd we use to tell the fault-thread to quit */
-    mis->userfault_event_fd = eventfd(0, EFD_CLOEXEC);
-    if (mis->userfault_event_fd == -1) {
+    pft->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (pft->event_fd == -1) {
         error_report("%s: Opening userfault_event_fd: %s", __func__,
                      strerror(errno));
-        close(mis->userfault_fd);
         return -1;
     }
 
+    return 0;
+}
+
+int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
+{
+    int i;
+
+    mis->nr_fault_threads = migrate_postcopy_fault_threads();
+    mis->fault_threads = g_new0(PostcopyFaultThread, mis->nr_fault_threads);
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        PostcopyFaultThread *pft = &mis->fault_threads[i];
+
+        pft->mis = mis;
+        pft->id = i;
+        pft->userfault_fd = -1;
+        pft->event_fd = -1;
+    }
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        if (postcopy_fault_thread_open(&mis->fault_threads[i])) {
+            postcopy_fault_threads_close(mis);
+            return -1;
+        }
+    }
+
+    mis->last_rb = NULL; /* last RAMBlock we sent part of */
     qemu_sem_init(&mis->fault_thread_sem, 0);
-    qemu_thread_create(&mis->fault_thread, "postcopy/fault",
-                       postcopy_ram_fault_thread, mis, QEMU_THREAD_JOINABLE);
-    qemu_sem_wait(&mis->fault_thread_sem);
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        PostcopyFaultThread *pft = &mis->fault_threads[i];
+        g_autofree char *name = i ? g_strdup_printf("postcopy/fault%d", i) :
+                                    g_strdup("postcopy/fault");
+
+        qemu_thread_create(&pft->thread, name, postcopy_ram_fault_thread,
+                           pft, QEMU_THREAD_JOINABLE);
+        qemu_sem_wait(&mis->fault_thread_sem);
+    }
     qemu_sem_destroy(&mis->fault_thread_sem);
     mis->have_fault_thread = true;
 
@@ -1124,14 +1307,20 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
-    mis->postcopy_tmp_page = mmap(NULL, mis->largest_page_size,
-                                  PROT_READ | PROT_WRITE, MAP_PRIVATE |
-                                  MAP_ANONYMOUS, -1, 0);
-    if (mis->postcopy_tmp_page == MAP_FAILED) {
-        mis->postcopy_tmp_page = NULL;
-        error_report("%s: Failed to map postcopy_tmp_page %s",
-                     __func__, strerror(errno));
-        return -1;
+    for (i = 0; i < RAM_CHANNEL_MAX; i++) {
+        void *page;
+
+        if (i == RAM_CHANNEL_POSTCOPY && !mis->postcopy_qemufile_dst) {
+            break;
+        }
+        page = mmap(NULL, mis->largest_page_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (page == MAP_FAILED) {
+            error_report("%s: Failed to map postcopy_tmp_page %s",
+                         __func__, strerror(errno));
+            return -1;
+        }
+        mis->postcopy_tmp_pages[i] = page;
     }
 
     /*
@@ -1150,6 +1339,13 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     }
     memset(mis->postcopy_tmp_zero_page, '\0', mis->largest_page_size);
 
+    if (mis->postcopy_qemufile_dst) {
+        qemu_thread_create(&mis->preempt_thread, "postcopy/preempt",
+                           postcopy_preempt_thread, mis,
+                           QEMU_THREAD_JOINABLE);
+        mis->have_preempt_thread = true;
+    }
+
     trace_postcopy_ram_enable_notify();
 
     return 0;
@@ -1158,7 +1354,8 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
 static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
                                void *from_addr, uint64_t pagesize, RAMBlock *rb)
 {
-    int userfault_fd = mis->userfault_fd;
+    int userfault_fd = postcopy_fault_thread_for(mis, rb,
+                                                 host_addr)->userfault_fd;
     int ret;
 
     if (from_addr) {
@@ -1337,15 +1534,18 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
 void postcopy_fault_thread_notify(MigrationIncomingState *mis)
 {
     uint64_t tmp64 = 1;
+    int i;
 
     /*
-     * Wakeup the fault_thread.  It's an eventfd that should currently
-     * be at 0, we're going to increment it to 1
+     * Wakeup the fault threads.  Each one has an eventfd that should
+     * currently be at 0, we're going to increment it to 1
      */
-    if (write(mis->userfault_event_fd, &tmp64, 8) != 8) {
-        /* Not much we can do here, but may as well report it */
-        error_report("%s: incrementing failed: %s", __func__,
-                     strerror(errno));
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        if (write(mis->fault_threads[i].event_fd, &tmp64, 8) != 8) {
+            /* Not much we can do here, but may as well report it */
+            error_report("%s: incrementing failed: %s", __func__,
+                         strerror(errno));
+        }
     }
 }
 
@@ -1469,3 +1669,97 @@ void postcopy_unregister_shared_ufd(struct PostCopyFD *pcfd)
         }
     }
 }
+
+static void postcopy_preempt_send_channel_new(QIOTask *task, gpointer opaque)
+{
+    MigrationState *s = opaque;
+    QIOChannel *ioc = QIO_CHANNEL(qio_task_get_source(task));
+    Error *local_err = NULL;
+
+    if (qio_task_propagate_error(task, &local_err)) {
+        migrate_set_error(s, local_err);
+        error_free(local_err);
+    } else {
+        migration_ioc_register_yank(ioc);
+        s->postcopy_qemufile_src = qemu_fopen_channel_output(ioc);
+        trace_postcopy_preempt_new_channel();
+    }
+    object_unref(OBJECT(ioc));
+    qemu_sem_post(&s->postcopy_qemufile_src_sem);
+}
+
+/*
+ * Start connecting the preempt channel on the source.  The migration
+ * thread waits for it with postcopy_preempt_wait_channel().
+ *
+ * Returns 0 on success, -1 on error
+ */
+int postcopy_preempt_setup(MigrationState *s, Error **errp)
+{
+    if (!migrate_postcopy_preempt()) {
+        return 0;
+    }
+
+    if (!migrate_multifd_is_allowed()) {
+        error_setg(errp, "postcopy-preempt is not supported by the current "
+                   "protocol");
+        return -1;
+    }
+
+    if (s->parameters.tls_creds && *s->parameters.tls_creds) {
+        error_setg(errp, "postcopy-preempt is not supported with TLS");
+        return -1;
+    }
+
+    socket_send_channel_create(postcopy_preempt_send_channel_new, s);
+    return 0;
+}
+
+/*
+ * Wait for the connection started by postcopy_preempt_setup() to be done.
+ *
+ * Returns 0 on success, -1 if the channel could not be created
+ */
+int postcopy_preempt_wait_channel(MigrationState *s)
+{
+    if (!migrate_postcopy_preempt()) {
+        return 0;
+    }
+
+    qemu_sem_wait(&s->postcopy_qemufile_src_sem);
+    return s->postcopy_qemufile_src ? 0 : -1;
+}
+
+/*
+ * Release the preempt channel of the source, e.g. when the migration
+ * finishes or when postcopy is paused.  Urgent pages then go through
+ * the main channel.
+ */
+void postcopy_preempt_shutdown_file(MigrationState *s)
+{
+    QEMUFile *file = s->postcopy_qemufile_src;
+
+    if (!file) {
+        return;
+    }
+
+    s->postcopy_qemufile_src = NULL;
+    migration_ioc_unregister_yank_from_file(file);
+    qemu_file_shutdown(file);
+    qemu_fclose(file);
+}
+
+/*
+ * The destination received the preempt channel, which is the second
+ * connection made by the source.
+ *
+ * Returns true if all the channels are there and the migration can start
+ */
+bool postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *f)
+{
+    /* The channel is only read by the preempt thread */
+    qemu_file_set_blocking(f, true);
+    mis->postcopy_qemufile_dst = f;
+    trace_postcopy_preempt_new_channel();
+    return true;
+}
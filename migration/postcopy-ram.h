@@ -106,6 +106,12 @@ PostcopyState postcopy_state_set(PostcopyState new_state);
 
 void postcopy_fault_thread_notify(MigrationIncomingState *mis);
 
+/* Channel for urgent page requests, see the postcopy-preempt capability */
+int postcopy_preempt_setup(MigrationState *s, Error **errp);
+int postcopy_preempt_wait_channel(MigrationState *s);
+void postcopy_preempt_shutdown_file(MigrationState *s);
+bool postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *f);
+
 /*
  * To be called once at the start before any device initialisation
  */
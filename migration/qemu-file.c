@@ -665,6 +665,134 @@ int64_t qemu_ftell(QEMUFile *f)
     return f->pos;
 }
 
+/*
+ * Write @buflen bytes at offset @pos of the underlying channel, without
+ * going through the buffer or moving the stream position.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = buflen };
+    Error *local_err = NULL;
+
+    if (f->last_error) {
+        return;
+    }
+
+    if (!ioc) {
+        qemu_file_set_error(f, -EINVAL);
+        return;
+    }
+
+    if (qio_channel_pwritev(ioc, &iov, 1, pos, &local_err) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return;
+    }
+
+    f->bytes_xfer += buflen;
+}
+
+/*
+ * Read @buflen bytes at offset @pos of the underlying channel, without
+ * going through the buffer or moving the stream position.
+ *
+ * Returns the number of bytes read, 0 on error.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                          off_t pos)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    struct iovec iov = { .iov_base = buf, .iov_len = buflen };
+    Error *local_err = NULL;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    if (!ioc) {
+        qemu_file_set_error(f, -EINVAL);
+        return 0;
+    }
+
+    if (qio_channel_preadv(ioc, &iov, 1, pos, &local_err) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return 0;
+    }
+
+    return buflen;
+}
+
+/*
+ * Return the offset of the underlying channel that corresponds to the
+ * current position in the stream, i.e. accounting for data still
+ * buffered on either side.  Only valid for seekable channels.
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    Error *local_err = NULL;
+    off_t off;
+
+    if (!ioc || !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        qemu_file_set_error(f, -EINVAL);
+        return -1;
+    }
+
+    if (qemu_file_is_writable(f)) {
+        /* Anything left in the buffer after this would be off by its size */
+        qemu_fflush(f);
+        if (qemu_file_get_error(f)) {
+            return -1;
+        }
+    }
+    off = qio_channel_io_seek(ioc, 0, SEEK_CUR, &local_err);
+    if (off < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+        return -1;
+    }
+
+    if (qemu_file_is_writable(f)) {
+        return off;
+    }
+
+    /* Data buffered for reading has not been consumed yet */
+    return off - (f->buf_size - f->buf_index);
+}
+
+/*
+ * Move the stream to @off (interpreted as for lseek()), discarding any
+ * read-ahead data and flushing pending writes first.
+ */
+void qemu_set_offset(QEMUFile *f, off_t off, int whence)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    Error *local_err = NULL;
+
+    if (!ioc || !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        qemu_file_set_error(f, -EINVAL);
+        return;
+    }
+
+    if (qemu_file_is_writable(f)) {
+        /* Don't let a failed flush write its leftovers at the new offset */
+        qemu_fflush(f);
+        if (qemu_file_get_error(f)) {
+            return;
+        }
+    } else {
+        if (whence == SEEK_CUR) {
+            off -= f->buf_size - f->buf_index;
+        }
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (qio_channel_io_seek(ioc, off, whence, &local_err) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_err);
+    }
+}
+
 int qemu_file_rate_limit(QEMUFile *f)
 {
     if (f->shutdown) {
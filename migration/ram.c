@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -39,6 +40,7 @@
 #include "qemu-file.h"
 #include "postcopy-ram.h"
 #include "page_cache.h"
+#include "latency.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "qapi/qapi-types-migration.h"
@@ -55,10 +57,13 @@
 #include "qemu/iov.h"
 #include "multifd.h"
 #include "sysemu/runstate.h"
+#include "sysemu/kvm.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
 
 #if defined(__linux__)
+#include <poll.h>
+#include "qemu/event_notifier.h"
 #include "qemu/userfaultfd.h"
 #endif /* defined(__linux__) */
 
@@ -81,6 +86,22 @@
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/*
+ * With fixed-ram, each RAMBlock entry of the MEM_SIZE record is followed
+ * by this header.  It locates the bitmap of the pages present in the
+ * file and the region holding the pages, which is aligned so that it
+ * can be accessed with O_DIRECT.
+ */
+#define FIXED_RAM_HDR_VERSION 1
+#define FIXED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+
+typedef struct FixedRamHeader {
+    uint32_t version;
+    uint64_t page_size;
+    uint64_t bitmap_offset;
+    uint64_t pages_offset;
+} QEMU_PACKED FixedRamHeader;
+
 XBZRLECacheStats xbzrle_counters;
 
 /* struct contains XBZRLE cache and a static page
@@ -90,7 +111,10 @@ static struct {
     uint8_t *encoded_buf;
     /* buffer for storing page content */
     uint8_t *current_buf;
-    /* Cache for XBZRLE, Protected by lock. */
+    /*
+     * Cache for XBZRLE, replaced or freed under lock and read under RCU,
+     * its entries have their own locks.
+     */
     PageCache *cache;
     QemuMutex lock;
     /* it will store a page full of zeros */
@@ -118,8 +142,9 @@ static void XBZRLE_cache_unlock(void)
  *
  * This function is called from migrate_params_apply in main
  * thread, possibly while a migration is in progress.  A running
- * migration may be using the cache and might finish during this call,
- * hence changes to the cache are protected by XBZRLE.lock().
+ * migration may finish during this call, hence changes to the cache
+ * are protected by XBZRLE.lock().  The old cache is freed once the
+ * migration thread has stopped using it, see cache_fini().
  *
  * Returns 0 for success or -1 for error
  *
@@ -153,7 +178,7 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp)
         }
 
         cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        qatomic_rcu_set(&XBZRLE.cache, new_cache);
     }
 out:
     XBZRLE_cache_unlock();
@@ -310,6 +335,9 @@ struct RAMState {
     uint32_t last_version;
     /* How many times we have dirty too many pages */
     int dirty_rate_high_cnt;
+    /* smoothed dirty rate and bandwidth of the predictive throttle, in B/s */
+    double throttle_dirty_rate;
+    double throttle_bandwidth;
     /* these variables are used for bitmap sync */
     /* last time we did a full bitmap_sync */
     int64_t time_last_bitmap_sync;
@@ -347,6 +375,37 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /*
+     * Pages reaped from the KVM dirty rings (dirty-ring-precopy).  The
+     * reapers fill dirty_ring_pending, which is moved over to
+     * dirty_ring_pages after each bitmap sync so that every queued page
+     * has its bit set in the migration bitmap.
+     */
+    QemuMutex dirty_ring_mutex;
+    ram_addr_t *dirty_ring_pending;
+    unsigned long dirty_ring_pending_num;
+    /* Only accessed by the migration thread */
+    ram_addr_t *dirty_ring_pages;
+    unsigned long dirty_ring_pages_num;
+    unsigned long dirty_ring_pages_pos;
+    /* Number of pages that didn't fit into the queue */
+    uint64_t dirty_ring_dropped;
+    /* RAM channel that rs->f points to (postcopy-preempt) */
+    unsigned int postcopy_channel;
+    /* last_sent_block of the channels not in use */
+    RAMBlock *postcopy_last_sent_block[RAM_CHANNEL_MAX];
+    /* Write fault thread of the background snapshot */
+    QemuThread wp_fault_thread;
+    EventNotifier wp_fault_quit;
+    bool wp_fault_thread_running;
+    /* Copy-out buffer of the write faulted pages, one host page per slot */
+    struct WPCopySlot *wp_copy_slots;
+    uint8_t *wp_copy_buf;
+    QemuMutex wp_copy_mutex;
+    QSLIST_HEAD(, WPCopySlot) wp_copy_free;
+    QSIMPLEQ_HEAD(, WPCopySlot) wp_copy_queue;
+    /* Set if the page being saved went to multifd, which releases it */
+    bool wp_multifd_queued;
 };
 typedef struct RAMState RAMState;
 
@@ -636,6 +695,87 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
     }
 }
 
+/* Weight of the latest period in the rates of the predictive throttle */
+#define THROTTLE_PREDICT_WEIGHT 0.5
+
+static double throttle_predict_smooth(double prev, double now)
+{
+    if (!prev) {
+        return now;
+    }
+    return THROTTLE_PREDICT_WEIGHT * now +
+           (1 - THROTTLE_PREDICT_WEIGHT) * prev;
+}
+
+/**
+ * mig_throttle_predictive: throttle the guest to meet the downtime limit
+ *
+ * Sending the remaining dirty memory at the measured bandwidth takes
+ * remaining / bandwidth seconds, during which the guest dirties
+ * dirty_rate * remaining / bandwidth bytes.  Sending those with the
+ * guest stopped is the downtime that the next iteration leaves us with:
+ *
+ *     downtime = dirty_rate * remaining / bandwidth^2
+ *
+ * Solve for the dirty rate that meets downtime-limit and, assuming the
+ * dirty rate is proportional to the CPU time the guest gets, for the
+ * throttle.  The throttle moves toward it by at most
+ * cpu-throttle-increment per period, up or down, so that it settles
+ * instead of oscillating with the noise of the measurements.
+ *
+ * @rs: current RAM state
+ * @dirty_rate: bytes dirtied per second during the last period
+ * @bandwidth: bytes transferred per second during the last period
+ */
+static void mig_throttle_predictive(RAMState *rs, double dirty_rate,
+                                    double bandwidth)
+{
+    MigrationState *s = migrate_get_current();
+    int pct_increment = s->parameters.cpu_throttle_increment;
+    int pct_max = s->parameters.max_cpu_throttle;
+    int throttle_now = cpu_throttle_get_percentage();
+    double limit = s->parameters.downtime_limit / 1000.0;
+    double remaining = ram_bytes_remaining();
+    double predicted, target_rate, cpu;
+    int throttle;
+
+    rs->throttle_dirty_rate = throttle_predict_smooth(rs->throttle_dirty_rate,
+                                                      dirty_rate);
+    rs->throttle_bandwidth = throttle_predict_smooth(rs->throttle_bandwidth,
+                                                     bandwidth);
+    dirty_rate = rs->throttle_dirty_rate;
+    bandwidth = rs->throttle_bandwidth;
+    if (!bandwidth) {
+        /* Nothing was sent, there is nothing to predict from */
+        return;
+    }
+
+    predicted = dirty_rate * remaining / (bandwidth * bandwidth);
+    if (!dirty_rate || !remaining) {
+        throttle = 0;
+    } else {
+        target_rate = limit * bandwidth * bandwidth / remaining;
+        cpu = (100 - throttle_now) * target_rate / dirty_rate;
+        throttle = 100 - MIN(cpu, 100);
+    }
+
+    throttle = MIN(throttle, throttle_now + pct_increment);
+    throttle = MAX(throttle, throttle_now - pct_increment);
+    throttle = MIN(MAX(throttle, 0), pct_max);
+
+    trace_migration_throttle_predictive(dirty_rate, bandwidth, remaining,
+                                        predicted * 1000, throttle_now,
+                                        throttle);
+    if (throttle == throttle_now) {
+        return;
+    }
+    if (throttle) {
+        cpu_throttle_set(throttle);
+    } else {
+        cpu_throttle_stop();
+    }
+}
+
 void mig_throttle_counter_reset(void)
 {
     RAMState *rs = ram_state;
@@ -665,8 +805,8 @@ static void xbzrle_cache_zero_page(RAMState *rs, ram_addr_t current_addr)
 
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
-    cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
-                 ram_counters.dirty_sync_count);
+    cache_insert(qatomic_rcu_read(&XBZRLE.cache), current_addr,
+                 XBZRLE.zero_target_page, ram_counters.dirty_sync_count);
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -678,6 +818,8 @@ static void xbzrle_cache_zero_page(RAMState *rs, ram_addr_t current_addr)
  *          0 means that page is identical to the one already sent
  *          -1 means that xbzrle would be longer than normal
  *
+ * Must be called under rcu_read_lock().
+ *
  * @rs: current RAM state
  * @current_data: pointer to the address of the page contents
  * @current_addr: addr of the page
@@ -689,22 +831,29 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
                             ram_addr_t current_addr, RAMBlock *block,
                             ram_addr_t offset, bool last_stage)
 {
+    PageCache *cache = qatomic_rcu_read(&XBZRLE.cache);
     int encoded_len = 0, bytes_xbzrle;
     uint8_t *prev_cached_page;
+    bool hit;
 
-    if (!cache_is_cached(XBZRLE.cache, current_addr,
-                         ram_counters.dirty_sync_count)) {
+    prev_cached_page = cache_lock_page(cache, current_addr,
+                                       ram_counters.dirty_sync_count, &hit);
+    if (!hit || !prev_cached_page) {
         xbzrle_counters.cache_miss++;
+        if (!prev_cached_page) {
+            return -1;
+        }
         if (!last_stage) {
-            if (cache_insert(XBZRLE.cache, current_addr, *current_data,
-                             ram_counters.dirty_sync_count) == -1) {
-                return -1;
-            } else {
-                /* update *current_data when the page has been
-                   inserted into cache */
-                *current_data = get_cached_data(XBZRLE.cache, current_addr);
-            }
+            memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
+            memcpy(prev_cached_page, XBZRLE.current_buf, TARGET_PAGE_SIZE);
+            /*
+             * update *current_data when the page has been inserted into
+             * cache; the copy in current_buf is sent so that the entry
+             * doesn't stay locked
+             */
+            *current_data = XBZRLE.current_buf;
         }
+        cache_unlock_page(cache, prev_cached_page, !last_stage);
         return -1;
     }
 
@@ -720,7 +869,6 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
      * guest page is good for xbzrle encoding.
      */
     xbzrle_counters.pages++;
-    prev_cached_page = get_cached_data(XBZRLE.cache, current_addr);
 
     /* save current buffer into memory */
     memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
@@ -738,11 +886,12 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
         memcpy(prev_cached_page, XBZRLE.current_buf, TARGET_PAGE_SIZE);
         /*
          * In the case where we couldn't compress, ensure that the caller
-         * sends the data from the cache, since the guest might have
+         * sends the data of the cache, since the guest might have
          * changed the RAM since we copied it.
          */
-        *current_data = prev_cached_page;
+        *current_data = XBZRLE.current_buf;
     }
+    cache_unlock_page(cache, prev_cached_page, true);
 
     if (encoded_len == 0) {
         trace_save_xbzrle_page_skipping();
@@ -891,7 +1040,12 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
      */
     migration_clear_memory_region_dirty_bitmap(rb, page);
 
-    ret = test_and_clear_bit(page, rb->bmap);
+    /* The write fault thread of background snapshots clears bits too */
+    if (migrate_background_snapshot()) {
+        ret = test_and_clear_bit_atomic(page, rb->bmap);
+    } else {
+        ret = test_and_clear_bit(page, rb->bmap);
+    }
     if (ret) {
         rs->migration_dirty_pages--;
     }
@@ -984,6 +1138,183 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Parallel dirty bitmap sync
+ *
+ * RAMBlocks are split into chunks that are handed out to a pool of
+ * helper threads.  Chunks start on a word boundary of the dirty bitmap,
+ * so two threads never touch the same word of rb->bmap.
+ */
+
+/* Must be a multiple of BITS_PER_LONG target pages */
+#define BITMAP_SYNC_CHUNK_SIZE (1ULL << 30)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncChunk;
+
+typedef struct {
+    QemuThread thread;
+    QemuSemaphore sem;
+    bool quit;
+    /* Newly dirtied pages found by this thread during the last sync */
+    uint64_t dirty_pages;
+} BitmapSyncParam;
+
+typedef struct {
+    /* Number of helper threads, the migration thread is not included */
+    int thread_count;
+    BitmapSyncParam *params;
+    BitmapSyncChunk *chunks;
+    int nr_chunks;
+    int chunks_size;
+    /* Index of the next chunk to process, grabbed atomically */
+    int next_chunk;
+    QemuSemaphore sem_done;
+} BitmapSyncState;
+
+static BitmapSyncState *bitmap_sync;
+
+static uint64_t bitmap_sync_process_chunks(void)
+{
+    uint64_t dirty_pages = 0;
+    int i;
+
+    while ((i = qatomic_fetch_inc(&bitmap_sync->next_chunk)) <
+           bitmap_sync->nr_chunks) {
+        BitmapSyncChunk *c = &bitmap_sync->chunks[i];
+
+        dirty_pages += cpu_physical_memory_sync_dirty_bitmap(c->block,
+                                                             c->start,
+                                                             c->length);
+    }
+    return dirty_pages;
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    BitmapSyncParam *p = opaque;
+
+    rcu_register_thread();
+
+    while (true) {
+        qemu_sem_wait(&p->sem);
+        if (p->quit) {
+            break;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            p->dirty_pages = bitmap_sync_process_chunks();
+        }
+        qemu_sem_post(&bitmap_sync->sem_done);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void bitmap_sync_threads_cleanup(void)
+{
+    int i;
+
+    if (!bitmap_sync) {
+        return;
+    }
+
+    for (i = 0; i < bitmap_sync->thread_count; i++) {
+        BitmapSyncParam *p = &bitmap_sync->params[i];
+
+        p->quit = true;
+        qemu_sem_post(&p->sem);
+        qemu_thread_join(&p->thread);
+        qemu_sem_destroy(&p->sem);
+    }
+    qemu_sem_destroy(&bitmap_sync->sem_done);
+    g_free(bitmap_sync->params);
+    g_free(bitmap_sync->chunks);
+    g_free(bitmap_sync);
+    bitmap_sync = NULL;
+}
+
+static void bitmap_sync_threads_setup(void)
+{
+    int i, thread_count = migrate_dirty_sync_threads() - 1;
+
+    if (thread_count <= 0) {
+        return;
+    }
+
+    bitmap_sync = g_new0(BitmapSyncState, 1);
+    bitmap_sync->thread_count = thread_count;
+    bitmap_sync->params = g_new0(BitmapSyncParam, thread_count);
+    qemu_sem_init(&bitmap_sync->sem_done, 0);
+    for (i = 0; i < thread_count; i++) {
+        BitmapSyncParam *p = &bitmap_sync->params[i];
+
+        qemu_sem_init(&p->sem, 0);
+        qemu_thread_create(&p->thread, "mig/bitmapsync",
+                           bitmap_sync_thread, p, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void bitmap_sync_add_chunk(RAMBlock *rb, ram_addr_t start,
+                                  ram_addr_t length)
+{
+    BitmapSyncChunk *c;
+
+    if (bitmap_sync->nr_chunks == bitmap_sync->chunks_size) {
+        bitmap_sync->chunks_size = MAX(bitmap_sync->chunks_size * 2, 16);
+        bitmap_sync->chunks = g_renew(BitmapSyncChunk, bitmap_sync->chunks,
+                                      bitmap_sync->chunks_size);
+    }
+    c = &bitmap_sync->chunks[bitmap_sync->nr_chunks++];
+    c->block = rb;
+    c->start = start;
+    c->length = length;
+}
+
+/* Called with RCU critical section and bitmap_mutex held */
+static void bitmap_sync_parallel(RAMState *rs)
+{
+    RAMBlock *block;
+    uint64_t new_dirty_pages;
+    int i;
+
+    bitmap_sync->nr_chunks = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length;
+             start += BITMAP_SYNC_CHUNK_SIZE) {
+            bitmap_sync_add_chunk(block, start,
+                                  MIN(BITMAP_SYNC_CHUNK_SIZE,
+                                      block->used_length - start));
+        }
+    }
+    bitmap_sync->next_chunk = 0;
+
+    trace_migration_bitmap_sync_parallel(bitmap_sync->nr_chunks,
+                                         bitmap_sync->thread_count + 1);
+
+    for (i = 0; i < bitmap_sync->thread_count; i++) {
+        qemu_sem_post(&bitmap_sync->params[i].sem);
+    }
+
+    /* The migration thread takes its share of the work too */
+    new_dirty_pages = bitmap_sync_process_chunks();
+
+    for (i = 0; i < bitmap_sync->thread_count; i++) {
+        qemu_sem_wait(&bitmap_sync->sem_done);
+    }
+    for (i = 0; i < bitmap_sync->thread_count; i++) {
+        new_dirty_pages += bitmap_sync->params[i].dirty_pages;
+    }
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1063,7 +1394,7 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
     }
 }
 
-static void migration_trigger_throttle(RAMState *rs)
+static void migration_trigger_throttle(RAMState *rs, int64_t end_time)
 {
     MigrationState *s = migrate_get_current();
     uint64_t threshold = s->parameters.throttle_trigger_threshold;
@@ -1076,6 +1407,14 @@ static void migration_trigger_throttle(RAMState *rs)
      * that ram migration makes no progress. Avoid this by disabling the
      * throttling logic during the bulk phase of block migration. */
     if (migrate_auto_converge() && !blk_mig_bulk_active()) {
+        if (migrate_cpu_throttle_predictive()) {
+            double period = (end_time - rs->time_last_bitmap_sync) / 1000.0;
+
+            mig_throttle_predictive(rs, bytes_dirty_period / period,
+                                    bytes_xfer_period / period);
+            return;
+        }
+
         /* The following detection logic can be refined later. For now:
            Check to see if the ratio between dirtied bytes and the approx.
            amount of bytes that just got transferred since the last time
@@ -1092,10 +1431,102 @@ static void migration_trigger_throttle(RAMState *rs)
     }
 }
 
+/*
+ * Dirty ring driven precopy
+ *
+ * With the KVM dirty ring, the pages dirtied by the guest are known
+ * individually when the rings are reaped.  Queue them, so that an
+ * iteration only has to look at the pages that were really dirtied
+ * instead of scanning the whole migration bitmap.  The bitmap stays the
+ * reference: queued pages are only sent if their bit is set, and the
+ * bitmap is still scanned whenever dirty pages remain that the queue
+ * doesn't know about (e.g. dirtied by DMA, or dropped on overflow).
+ */
+
+/* Maximum number of queued pages, for each of the two queues */
+#define DIRTY_RING_QUEUE_PAGES (1 << 20)
+
+/* Called by the KVM dirty ring reapers, with the KVM slots lock held */
+static void ram_dirty_ring_page_hook(ram_addr_t addr)
+{
+    RAMState *rs = ram_state;
+
+    qemu_mutex_lock(&rs->dirty_ring_mutex);
+    if (rs->dirty_ring_pending_num < DIRTY_RING_QUEUE_PAGES) {
+        rs->dirty_ring_pending[rs->dirty_ring_pending_num++] = addr;
+    } else {
+        rs->dirty_ring_dropped++;
+    }
+    qemu_mutex_unlock(&rs->dirty_ring_mutex);
+}
+
+static void dirty_ring_queue_setup(RAMState *rs)
+{
+    if (!migrate_dirty_ring_precopy()) {
+        return;
+    }
+
+    rs->dirty_ring_pending = g_new(ram_addr_t, DIRTY_RING_QUEUE_PAGES);
+    rs->dirty_ring_pages = g_new(ram_addr_t, DIRTY_RING_QUEUE_PAGES);
+    kvm_dirty_ring_set_page_hook(ram_dirty_ring_page_hook);
+}
+
+static void dirty_ring_queue_cleanup(RAMState *rs)
+{
+    if (!rs->dirty_ring_pages) {
+        return;
+    }
+
+    kvm_dirty_ring_set_page_hook(NULL);
+    g_free(rs->dirty_ring_pending);
+    rs->dirty_ring_pending = NULL;
+    g_free(rs->dirty_ring_pages);
+    rs->dirty_ring_pages = NULL;
+}
+
+/*
+ * Called after the migration bitmap has been synchronized: everything
+ * reaped so far now has its bit set in the migration bitmap.
+ */
+static void dirty_ring_queue_refill(RAMState *rs)
+{
+    unsigned long left = rs->dirty_ring_pages_num - rs->dirty_ring_pages_pos;
+    unsigned long count;
+
+    /* Keep the queued pages that haven't been looked at yet */
+    memmove(rs->dirty_ring_pages,
+            rs->dirty_ring_pages + rs->dirty_ring_pages_pos,
+            left * sizeof(ram_addr_t));
+
+    qemu_mutex_lock(&rs->dirty_ring_mutex);
+    if (!left) {
+        ram_addr_t *tmp = rs->dirty_ring_pages;
+
+        rs->dirty_ring_pages = rs->dirty_ring_pending;
+        rs->dirty_ring_pending = tmp;
+        count = rs->dirty_ring_pending_num;
+    } else {
+        count = MIN(rs->dirty_ring_pending_num,
+                    DIRTY_RING_QUEUE_PAGES - left);
+        memcpy(rs->dirty_ring_pages + left, rs->dirty_ring_pending,
+               count * sizeof(ram_addr_t));
+        rs->dirty_ring_dropped += rs->dirty_ring_pending_num - count;
+    }
+    rs->dirty_ring_pending_num = 0;
+    qemu_mutex_unlock(&rs->dirty_ring_mutex);
+
+    rs->dirty_ring_pages_num = left + count;
+    rs->dirty_ring_pages_pos = 0;
+
+    trace_dirty_ring_queue_refill(rs->dirty_ring_pages_num,
+                                  rs->dirty_ring_dropped);
+}
+
 static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
     int64_t end_time;
+    int64_t start = migration_latency_start();
 
     ram_counters.dirty_sync_count++;
 
@@ -1108,8 +1539,15 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+        if (bitmap_sync) {
+            bitmap_sync_parallel(rs);
+        } else {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
+        }
+        if (rs->dirty_ring_pages) {
+            dirty_ring_queue_refill(rs);
         }
         ram_counters.remaining = ram_bytes_remaining();
     }
@@ -1117,12 +1555,13 @@ static void migration_bitmap_sync(RAMState *rs)
 
     memory_global_after_dirty_log_sync();
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    migration_latency_end(MIGRATION_LATENCY_BITMAP_SYNC, start);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
-        migration_trigger_throttle(rs);
+        migration_trigger_throttle(rs, end_time);
 
         migration_update_rates(rs, end_time);
 
@@ -1176,6 +1615,7 @@ static int save_zero_page_to_file(RAMState *rs, QEMUFile *file,
     int len = 0;
 
     if (buffer_is_zero(p, TARGET_PAGE_SIZE)) {
+        ram_block_merge_hint(block, offset, TARGET_PAGE_SIZE);
         len += save_page_header(rs, file, block, offset | RAM_SAVE_FLAG_ZERO);
         qemu_put_byte(file, 0);
         len += 1;
@@ -1184,24 +1624,52 @@ static int save_zero_page_to_file(RAMState *rs, QEMUFile *file,
 }
 
 /**
- * save_zero_page: send the zero page to the stream
+ * save_zero_page_buf: send the page to the stream if @buf is zero
  *
- * Returns the number of pages written.
+ * Returns the number of pages written, -1 if @buf is not zero.
  *
  * @rs: current RAM state
  * @block: block that contains the page we want to send
  * @offset: offset inside the block for the page
+ * @buf: contents of the page
  */
-static int save_zero_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
+static int save_zero_page_buf(RAMState *rs, RAMBlock *block,
+                              ram_addr_t offset, uint8_t *buf)
 {
-    int len = save_zero_page_to_file(rs, rs->f, block, offset);
+    int len;
 
-    if (len) {
+    if (!buffer_is_zero(buf, TARGET_PAGE_SIZE)) {
+        return -1;
+    }
+    ram_block_merge_hint(block, offset, TARGET_PAGE_SIZE);
+
+    if (migrate_fixed_ram()) {
+        /* Absent from the file bitmap, the page stays zero on load */
+        clear_bit_atomic(offset >> TARGET_PAGE_BITS, block->file_bmap);
         ram_counters.duplicate++;
-        ram_counters.transferred += len;
         return 1;
     }
-    return -1;
+
+    len = save_page_header(rs, rs->f, block, offset | RAM_SAVE_FLAG_ZERO);
+    qemu_put_byte(rs->f, 0);
+    len += 1;
+    ram_counters.duplicate++;
+    ram_counters.transferred += len;
+    return 1;
+}
+
+/**
+ * save_zero_page: send the zero page to the stream
+ *
+ * Returns the number of pages written.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ */
+static int save_zero_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
+{
+    return save_zero_page_buf(rs, block, offset, block->host + offset);
 }
 
 static void ram_release_pages(const char *rbname, uint64_t offset, int pages)
@@ -1265,6 +1733,15 @@ static bool control_save_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
 static int save_normal_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
                             uint8_t *buf, bool async)
 {
+    if (migrate_fixed_ram()) {
+        qemu_put_buffer_at(rs->f, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit_atomic(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_counters.transferred += TARGET_PAGE_SIZE;
+        ram_counters.normal++;
+        return 1;
+    }
+
     ram_counters.transferred += save_page_header(rs, rs->f, block,
                                                  offset | RAM_SAVE_FLAG_PAGE);
     if (async) {
@@ -1304,13 +1781,13 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss, bool last_stage)
     p = block->host + offset;
     trace_ram_save_page(block->idstr, (uint64_t)offset, p);
 
-    XBZRLE_cache_lock();
     if (rs->xbzrle_enabled && !migration_in_postcopy()) {
         pages = save_xbzrle_page(rs, &p, current_addr, block,
                                  offset, last_stage);
         if (!last_stage) {
-            /* Can't send this cached data async, since the cache page
-             * might get updated before it gets to the wire
+            /*
+             * Can't send this cached data async, since the buffer
+             * gets reused for the next page
              */
             send_async = false;
         }
@@ -1321,8 +1798,6 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss, bool last_stage)
         pages = save_normal_page(rs, block, offset, p, send_async);
     }
 
-    XBZRLE_cache_unlock();
-
     return pages;
 }
 
@@ -1333,6 +1808,7 @@ static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
         return -1;
     }
     ram_counters.normal++;
+    rs->wp_multifd_queued = true;
 
     return 1;
 }
@@ -1560,37 +2036,260 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
     return block;
 }
 
+/*
+ * Queue a request for the migration thread to save @len bytes at @start
+ * of @ramblock before anything else.
+ */
+static void ram_queue_page_request(RAMState *rs, RAMBlock *ramblock,
+                                   ram_addr_t start, ram_addr_t len)
+{
+    struct RAMSrcPageRequest *new_entry =
+        g_malloc0(sizeof(struct RAMSrcPageRequest));
+    new_entry->rb = ramblock;
+    new_entry->offset = start;
+    new_entry->len = len;
+
+    memory_region_ref(ramblock->mr);
+    qemu_mutex_lock(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+    migration_make_urgent_request();
+    qemu_mutex_unlock(&rs->src_page_req_mutex);
+}
+
 #if defined(__linux__)
+/*
+ * Write faults of background snapshots
+ *
+ * The guest memory is write protected while the snapshot is taken, and a
+ * vCPU that writes to a page not saved yet waits until the page is
+ * released.  Rather than having the vCPU wait for the migration thread to
+ * notice the fault and push the page through the stream, a dedicated
+ * thread copies the page to a slot of a bounded copy-out buffer, takes it
+ * out of the migration bitmap and releases it right away.  The migration
+ * thread sends the copies before anything else.
+ *
+ * When the buffer is full, the page is queued for the migration thread
+ * as a postcopy request would be.  When the migration thread is already
+ * saving the page, it releases the page once it is saved.
+ */
+
+/* Size of the copy-out buffer, in host pages */
+#define WP_COPY_SLOTS 1024
+/* Maximum number of faults read at once */
+#define WP_FAULT_BATCH 16
+
+typedef struct WPCopySlot {
+    RAMBlock *block;
+    /* Offset of the host page in @block */
+    ram_addr_t offset;
+    /* Target pages of the host page taken out of the migration bitmap */
+    uint64_t pages;
+    uint8_t *data;
+    QSLIST_ENTRY(WPCopySlot) next_free;
+    QSIMPLEQ_ENTRY(WPCopySlot) next;
+} WPCopySlot;
+
+/*
+ * Wait for the copy that the write fault thread may be taking of a page
+ * the caller is about to release.  The fault thread clears the bits of
+ * the pages it copies under wp_copy_mutex, so once past it the fault
+ * thread sees the bits cleared by the caller and leaves the page alone.
+ */
+static void ram_wp_copy_barrier(RAMState *rs)
+{
+    qemu_mutex_lock(&rs->wp_copy_mutex);
+    qemu_mutex_unlock(&rs->wp_copy_mutex);
+}
+
+static void ram_wp_fault_resolve(RAMState *rs, uint64_t address)
+{
+    size_t size = qemu_real_host_page_size;
+    unsigned long npages = size >> TARGET_PAGE_BITS;
+    void *host = (void *)(uintptr_t)QEMU_ALIGN_DOWN(address, size);
+    WPCopySlot *slot = NULL;
+    uint64_t pages = 0;
+    unsigned long page, i;
+    ram_addr_t offset;
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+
+    block = qemu_ram_block_from_host(host, false, &offset);
+    assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
+    page = offset >> TARGET_PAGE_BITS;
+
+    qemu_mutex_lock(&rs->wp_copy_mutex);
+    /* Huge pages are too large for the slots */
+    if (block->page_size == size && npages <= 64) {
+        slot = QSLIST_FIRST(&rs->wp_copy_free);
+    }
+    if (!slot) {
+        qemu_mutex_unlock(&rs->wp_copy_mutex);
+        trace_ram_wp_fault_queue(block->idstr, offset);
+        ram_queue_page_request(rs, block, offset, size);
+        return;
+    }
+
+    for (i = 0; i < npages; i++) {
+        if (test_and_clear_bit_atomic(page + i, block->bmap)) {
+            pages |= BIT_ULL(i);
+        }
+    }
+    if (!pages) {
+        /* The migration thread is saving it, and releases it afterwards */
+        qemu_mutex_unlock(&rs->wp_copy_mutex);
+        trace_ram_wp_fault_busy(block->idstr, offset);
+        return;
+    }
+
+    /* Still write protected, so the copy is consistent */
+    memcpy(slot->data, host, size);
+    slot->block = block;
+    slot->offset = offset;
+    slot->pages = pages;
+    QSLIST_REMOVE_HEAD(&rs->wp_copy_free, next_free);
+    QSIMPLEQ_INSERT_TAIL(&rs->wp_copy_queue, slot, next);
+    qemu_mutex_unlock(&rs->wp_copy_mutex);
+    migration_make_urgent_request();
+
+    trace_ram_wp_fault_copy(block->idstr, offset, pages);
+    /* Otherwise the migration thread releases it along with its own pages */
+    if (pages == MAKE_64BIT_MASK(0, npages)) {
+        uffd_change_protection(rs->uffdio_fd, host, size, false, false);
+    }
+}
+
+static void *ram_wp_fault_thread(void *opaque)
+{
+    RAMState *rs = opaque;
+    struct uffd_msg msgs[WP_FAULT_BATCH];
+    struct pollfd pfd[2] = {
+        { .fd = rs->uffdio_fd, .events = POLLIN },
+        { .fd = event_notifier_get_fd(&rs->wp_fault_quit), .events = POLLIN },
+    };
+
+    rcu_register_thread();
+
+    while (true) {
+        int i, n;
+
+        if (poll(pfd, ARRAY_SIZE(pfd), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error_report("%s: poll() failed: %s", __func__, strerror(errno));
+            break;
+        }
+        if (pfd[1].revents) {
+            break;
+        }
+
+        n = uffd_read_events(rs->uffdio_fd, msgs, WP_FAULT_BATCH);
+        if (n < 0) {
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                ram_wp_fault_resolve(rs, msgs[i].arg.pagefault.address);
+            }
+        }
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static int ram_wp_fault_thread_start(RAMState *rs)
+{
+    size_t size = qemu_real_host_page_size;
+    int i;
+
+    if (event_notifier_init(&rs->wp_fault_quit, false)) {
+        return -1;
+    }
+
+    qemu_mutex_init(&rs->wp_copy_mutex);
+    QSLIST_INIT(&rs->wp_copy_free);
+    QSIMPLEQ_INIT(&rs->wp_copy_queue);
+    rs->wp_copy_buf = qemu_memalign(size, WP_COPY_SLOTS * size);
+    rs->wp_copy_slots = g_new0(WPCopySlot, WP_COPY_SLOTS);
+    for (i = 0; i < WP_COPY_SLOTS; i++) {
+        rs->wp_copy_slots[i].data = rs->wp_copy_buf + i * size;
+        QSLIST_INSERT_HEAD(&rs->wp_copy_free, &rs->wp_copy_slots[i],
+                           next_free);
+    }
+
+    qemu_thread_create(&rs->wp_fault_thread, "bg-snap-fault",
+                       ram_wp_fault_thread, rs, QEMU_THREAD_JOINABLE);
+    rs->wp_fault_thread_running = true;
+    return 0;
+}
+
+static void ram_wp_fault_thread_stop(RAMState *rs)
+{
+    if (!rs->wp_fault_thread_running) {
+        return;
+    }
+
+    event_notifier_set(&rs->wp_fault_quit);
+    qemu_thread_join(&rs->wp_fault_thread);
+    rs->wp_fault_thread_running = false;
+    event_notifier_cleanup(&rs->wp_fault_quit);
+
+    /* The pages left in the buffer are only those of a cancelled snapshot */
+    qemu_mutex_destroy(&rs->wp_copy_mutex);
+    g_free(rs->wp_copy_slots);
+    rs->wp_copy_slots = NULL;
+    qemu_vfree(rs->wp_copy_buf);
+    rs->wp_copy_buf = NULL;
+}
+
 /**
- * poll_fault_page: try to get next UFFD write fault page and, if pending fault
- *   is found, return RAM block pointer and page offset
+ * ram_save_wp_copy: send a page copied out on a write fault
  *
- * Returns pointer to the RAMBlock containing faulting page,
- *   NULL if no write faults are pending
+ * Returns the number of target pages written, 0 if there was no copy
  *
  * @rs: current RAM state
- * @offset: page offset from the beginning of the block
  */
-static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
+static int ram_save_wp_copy(RAMState *rs)
 {
-    struct uffd_msg uffd_msg;
-    void *page_address;
-    RAMBlock *block;
-    int res;
+    WPCopySlot *slot;
+    int pages = 0;
+    int i;
 
-    if (!migrate_background_snapshot()) {
-        return NULL;
+    if (!rs->wp_fault_thread_running ||
+        QSIMPLEQ_EMPTY_ATOMIC(&rs->wp_copy_queue)) {
+        return 0;
     }
 
-    res = uffd_read_events(rs->uffdio_fd, &uffd_msg, 1);
-    if (res <= 0) {
-        return NULL;
+    WITH_QEMU_LOCK_GUARD(&rs->wp_copy_mutex) {
+        slot = QSIMPLEQ_FIRST(&rs->wp_copy_queue);
+        if (slot) {
+            QSIMPLEQ_REMOVE_HEAD(&rs->wp_copy_queue, next);
+        }
+    }
+    if (!slot) {
+        return 0;
     }
 
-    page_address = (void *)(uintptr_t) uffd_msg.arg.pagefault.address;
-    block = qemu_ram_block_from_host(page_address, false, offset);
-    assert(block && (block->flags & RAM_UF_WRITEPROTECT) != 0);
-    return block;
+    for (i = 0; i < 64; i++) {
+        ram_addr_t offset = slot->offset + ((ram_addr_t)i << TARGET_PAGE_BITS);
+        uint8_t *buf = slot->data + ((size_t)i << TARGET_PAGE_BITS);
+
+        if (!(slot->pages & BIT_ULL(i))) {
+            continue;
+        }
+        if (save_zero_page_buf(rs, slot->block, offset, buf) < 0) {
+            save_normal_page(rs, slot->block, offset, buf, false);
+        }
+        rs->migration_dirty_pages--;
+        pages++;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&rs->wp_copy_mutex) {
+        QSLIST_INSERT_HEAD(&rs->wp_copy_free, slot, next_free);
+    }
+    return pages;
 }
 
 /**
@@ -1606,8 +2305,16 @@ static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
 static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
         unsigned long start_page)
 {
+    bool multifd_queued = rs->wp_multifd_queued;
     int res = 0;
 
+    rs->wp_multifd_queued = false;
+
+    /* The multifd channels release the pages once they have sent them */
+    if (multifd_queued) {
+        return 0;
+    }
+
     /* Check if page is from UFFD-managed region. */
     if (pss->block->flags & RAM_UF_WRITEPROTECT) {
         void *page_address = pss->block->host + (start_page << TARGET_PAGE_BITS);
@@ -1615,6 +2322,7 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
 
         /* Flush async buffers before un-protect. */
         qemu_fflush(rs->f);
+        ram_wp_copy_barrier(rs);
         /* Un-protect memory range. */
         res = uffd_change_protection(rs->uffdio_fd, page_address, run_length,
                 false, false);
@@ -1623,6 +2331,31 @@ static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
     return res;
 }
 
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t *offset, uint32_t num)
+{
+    RAMState *rs = ram_state;
+    uint32_t start, i;
+
+    if (!(rb->flags & RAM_UF_WRITEPROTECT)) {
+        return 0;
+    }
+
+    ram_wp_copy_barrier(rs);
+    for (start = 0; start < num; start = i) {
+        for (i = start + 1; i < num; i++) {
+            if (offset[i] != offset[i - 1] + TARGET_PAGE_SIZE) {
+                break;
+            }
+        }
+        if (uffd_change_protection(rs->uffdio_fd, rb->host + offset[start],
+                                   (uint64_t)(i - start) << TARGET_PAGE_BITS,
+                                   false, false)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 /* ram_write_tracking_available: check if kernel supports required UFFD features
  *
  * Returns true if supports, false otherwise
@@ -1815,6 +2548,10 @@ int ram_write_tracking_start(void)
                 block->host, block->max_length);
     }
 
+    if (ram_wp_fault_thread_start(rs)) {
+        goto fail;
+    }
+
     return 0;
 
 fail:
@@ -1849,6 +2586,8 @@ void ram_write_tracking_stop(void)
     RAMState *rs = ram_state;
     RAMBlock *block;
 
+    ram_wp_fault_thread_stop(rs);
+
     RCU_READ_LOCK_GUARD();
 
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
@@ -1876,12 +2615,11 @@ void ram_write_tracking_stop(void)
 #else
 /* No target OS support, stubs just fail or ignore */
 
-static RAMBlock *poll_fault_page(RAMState *rs, ram_addr_t *offset)
+static int ram_save_wp_copy(RAMState *rs)
 {
     (void) rs;
-    (void) offset;
 
-    return NULL;
+    return 0;
 }
 
 static int ram_save_release_protection(RAMState *rs, PageSearchStatus *pss,
@@ -1915,6 +2653,12 @@ void ram_write_tracking_stop(void)
 {
     assert(0);
 }
+
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t *offset, uint32_t num)
+{
+    assert(0);
+    return -1;
+}
 #endif /* defined(__linux__) */
 
 /**
@@ -1956,14 +2700,6 @@ static bool get_queued_page(RAMState *rs, PageSearchStatus *pss)
 
     } while (block && !dirty);
 
-    if (!block) {
-        /*
-         * Poll write faults too if background snapshot is enabled; that's
-         * when we have vcpus got blocked by the write protected pages.
-         */
-        block = poll_fault_page(rs, &offset);
-    }
-
     if (block) {
         /*
          * We want the background search to continue from the queued page
@@ -1983,6 +2719,47 @@ static bool get_queued_page(RAMState *rs, PageSearchStatus *pss)
     return !!block;
 }
 
+/**
+ * get_dirty_ring_page: get the next dirty page reaped from the dirty rings
+ *
+ * Returns true if a dirty page is found
+ *
+ * @rs: current RAM state
+ * @pss: data about the state of the current dirty page scan
+ */
+static bool get_dirty_ring_page(RAMState *rs, PageSearchStatus *pss)
+{
+    RAMBlock *block = pss->block;
+
+    while (rs->dirty_ring_pages_pos < rs->dirty_ring_pages_num) {
+        ram_addr_t addr = rs->dirty_ring_pages[rs->dirty_ring_pages_pos++];
+        unsigned long page;
+
+        if (!block || addr < block->offset ||
+            addr - block->offset >= block->used_length) {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                if (addr >= block->offset &&
+                    addr - block->offset < block->used_length) {
+                    break;
+                }
+            }
+            if (!block) {
+                continue;
+            }
+        }
+
+        page = (addr - block->offset) >> TARGET_PAGE_BITS;
+        if (test_bit(page, block->bmap)) {
+            pss->block = block;
+            pss->page = page;
+            pss->complete_round = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /**
  * migration_page_queue_free: drop any remaining pages in the ram
  * request queue
@@ -2055,18 +2832,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
         return -1;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_malloc0(sizeof(struct RAMSrcPageRequest));
-    new_entry->rb = ramblock;
-    new_entry->offset = start;
-    new_entry->len = len;
-
-    memory_region_ref(ramblock->mr);
-    qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
-    qemu_mutex_unlock(&rs->src_page_req_mutex);
-
+    ram_queue_page_request(rs, ramblock, start, len);
     return 0;
 }
 
@@ -2146,15 +2912,22 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
+    /*
+     * When the multifd channels look for zero pages themselves, just
+     * queue the page and leave the zero page check to them.
+     */
+    if (!save_page_use_compression(rs) && migrate_use_multifd()
+        && migrate_multifd_zero_page() && !migration_in_postcopy()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
          * page would be stale
          */
         if (!save_page_use_compression(rs)) {
-            XBZRLE_cache_lock();
             xbzrle_cache_zero_page(rs, block->offset + offset);
-            XBZRLE_cache_unlock();
         }
         ram_release_pages(block->idstr, offset, res);
         return res;
@@ -2201,6 +2974,12 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     unsigned long hostpage_boundary =
         QEMU_ALIGN_UP(pss->page + 1, pagesize_bits);
     unsigned long start_page = pss->page;
+    /*
+     * Free page hints clear bits in the bitmap concurrently, so let them in
+     * while the page is being sent, which may mean waiting for a multifd
+     * channel.  Postcopy never uses free page hints.
+     */
+    bool yield_bitmap = !migrate_postcopy_ram();
     int res;
 
     if (ramblock_is_ignored(pss->block)) {
@@ -2211,7 +2990,13 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     do {
         /* Check the pages is dirty and if it is send it */
         if (migration_bitmap_clear_dirty(rs, pss->block, pss->page)) {
+            if (yield_bitmap) {
+                qemu_mutex_unlock(&rs->bitmap_mutex);
+            }
             tmppages = ram_save_target_page(rs, pss, last_stage);
+            if (yield_bitmap) {
+                qemu_mutex_lock(&rs->bitmap_mutex);
+            }
             if (tmppages < 0) {
                 return tmppages;
             }
@@ -2232,8 +3017,48 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     /* The offset we leave with is the min boundary of host page and block */
     pss->page = MIN(pss->page, hostpage_boundary) - 1;
 
-    res = ram_save_release_protection(rs, pss, start_page);
-    return (res < 0 ? res : pages);
+    res = ram_save_release_protection(rs, pss, start_page);
+    return (res < 0 ? res : pages);
+}
+
+/**
+ * postcopy_preempt_choose_channel: select the channel used to send pages
+ *
+ * Only pages requested by the destination go through the preempt
+ * channel, so that they don't wait behind the background pages queued
+ * on the main channel.
+ *
+ * @rs: current RAM state
+ * @channel: RAM_CHANNEL_PRECOPY or RAM_CHANNEL_POSTCOPY
+ */
+static void postcopy_preempt_choose_channel(RAMState *rs, unsigned int channel)
+{
+    MigrationState *s = migrate_get_current();
+
+    if (channel == rs->postcopy_channel) {
+        return;
+    }
+
+    /* RAM_SAVE_FLAG_CONTINUE is only valid within one channel */
+    rs->postcopy_last_sent_block[rs->postcopy_channel] = rs->last_sent_block;
+    rs->last_sent_block = rs->postcopy_last_sent_block[channel];
+
+    if (channel == RAM_CHANNEL_POSTCOPY) {
+        rs->f = s->postcopy_qemufile_src;
+    } else {
+        /* Make sure the urgent pages leave now */
+        int ret;
+
+        qemu_fflush(rs->f);
+        ret = qemu_file_get_error(rs->f);
+        if (ret < 0) {
+            /* Let the migration thread notice it and pause postcopy */
+            qemu_file_set_error(s->to_dst_file, ret);
+        }
+        rs->f = s->to_dst_file;
+    }
+    rs->postcopy_channel = channel;
+    trace_postcopy_preempt_switch_channel(channel);
 }
 
 /**
@@ -2255,13 +3080,19 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
 {
     PageSearchStatus pss;
     int pages = 0;
-    bool again, found;
+    bool again, found, urgent;
 
     /* No dirty page as there is zero RAM */
     if (!ram_bytes_total()) {
         return pages;
     }
 
+    /* Pages copied on background snapshot write faults come first */
+    pages = ram_save_wp_copy(rs);
+    if (pages) {
+        return pages;
+    }
+
     pss.block = rs->last_seen_block;
     pss.page = rs->last_page;
     pss.complete_round = false;
@@ -2273,14 +3104,33 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     do {
         again = true;
         found = get_queued_page(rs, &pss);
+        urgent = found && migrate_get_current()->postcopy_qemufile_src &&
+                 migration_in_postcopy();
+
+        if (!found && rs->dirty_ring_pages) {
+            found = get_dirty_ring_page(rs, &pss);
+            if (!found && !rs->migration_dirty_pages) {
+                /* Nothing left that the bitmap scan could find */
+                break;
+            }
+        }
 
         if (!found) {
+            int64_t start = migration_latency_start();
+
             /* priority queue empty, so just search for something dirty */
             found = find_dirty_block(rs, &pss, &again);
+            migration_latency_end(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, start);
         }
 
         if (found) {
+            if (urgent) {
+                postcopy_preempt_choose_channel(rs, RAM_CHANNEL_POSTCOPY);
+            }
             pages = ram_save_host_page(rs, &pss, last_stage);
+            if (urgent) {
+                postcopy_preempt_choose_channel(rs, RAM_CHANNEL_PRECOPY);
+            }
         }
     } while (!pages && again);
 
@@ -2342,6 +3192,8 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        dirty_ring_queue_cleanup(*rsp);
+        qemu_mutex_destroy(&(*rsp)->dirty_ring_mutex);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2392,8 +3244,14 @@ static void ram_save_cleanup(void *opaque)
         block->bmap = NULL;
     }
 
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
+    }
+
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    bitmap_sync_threads_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -2783,6 +3641,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    qemu_mutex_init(&(*rsp)->dirty_ring_mutex);
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -2791,6 +3650,7 @@ static int ram_state_init(RAMState **rsp)
      */
     (*rsp)->migration_dirty_pages = ram_bytes_total() >> TARGET_PAGE_BITS;
     ram_state_reset(*rsp);
+    dirty_ring_queue_setup(*rsp);
 
     return 0;
 }
@@ -2983,6 +3843,46 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * @f: QEMUFile where to send the data
  * @opaque: RAMState pointer
  */
+/*
+ * Reserve the region of the file for the pages of @block: write the
+ * fixed-ram header in the stream and skip over the bitmap and the pages.
+ */
+static void fixed_ram_insert_header(QEMUFile *f, RAMBlock *block)
+{
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    FixedRamHeader header;
+
+    block->file_bmap = bitmap_new(num_pages);
+    block->bitmap_offset = qemu_get_offset(f) + sizeof(header);
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   FIXED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    header.version = cpu_to_be32(FIXED_RAM_HDR_VERSION);
+    header.page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header.bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header.pages_offset = cpu_to_be64(block->pages_offset);
+    qemu_put_buffer(f, (uint8_t *)&header, sizeof(header));
+
+    qemu_set_offset(f, block->pages_offset + block->used_length, SEEK_SET);
+}
+
+/* Write the bitmap of the pages present in the file for each RAMBlock */
+static void fixed_ram_write_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        long num_pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+        g_autofree unsigned long *le_bitmap = bitmap_new(num_pages);
+
+        bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+        qemu_put_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           block->bitmap_offset);
+    }
+}
+
 static int ram_save_setup(QEMUFile *f, void *opaque)
 {
     RAMState **rsp = opaque;
@@ -2991,10 +3891,12 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     if (compress_threads_save_setup()) {
         return -1;
     }
+    bitmap_sync_threads_setup();
 
     /* migration has already setup the bitmap, reuse it. */
     if (!migration_in_colo_state()) {
         if (ram_init_all(rsp) != 0) {
+            bitmap_sync_threads_cleanup();
             compress_threads_save_cleanup();
             return -1;
         }
@@ -3015,6 +3917,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_fixed_ram()) {
+                fixed_ram_insert_header(f, block);
+            }
         }
     }
 
@@ -3053,11 +3958,10 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
     }
 
     /*
-     * We'll take this lock a little bit long, but it's okay for two reasons.
-     * Firstly, the only possible other thread to take it is who calls
-     * qemu_guest_free_page_hint(), which should be rare; secondly, see
-     * MAX_WAIT (if curious, further see commit 4508bd9ed8053ce) below, which
-     * guarantees that we'll at least released it in a regular basis.
+     * The only other thread to take this lock is the one calling
+     * qemu_guest_free_page_hint().  ram_save_host_page() releases it while
+     * sending each page, so that hints keep clearing the bitmap while the
+     * pages ahead are being sent.
      */
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
@@ -3169,6 +4073,9 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
         /* try transferring iterative blocks of memory */
 
+        /* ram_save_host_page() expects the lock to be held */
+        qemu_mutex_lock(&rs->bitmap_mutex);
+
         /* flush all remaining blocks regardless of rate limiting */
         while (true) {
             int pages;
@@ -3183,13 +4090,26 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
                 break;
             }
         }
+        qemu_mutex_unlock(&rs->bitmap_mutex);
 
         flush_compressed_data(rs);
         ram_control_after_iterate(f, RAM_CONTROL_FINISH);
     }
 
     if (ret >= 0) {
+        QEMUFile *preempt_file = migrate_get_current()->postcopy_qemufile_src;
+
         multifd_send_sync_main(rs->f);
+        if (migrate_fixed_ram()) {
+            WITH_RCU_READ_LOCK_GUARD() {
+                fixed_ram_write_bitmaps(f);
+            }
+        }
+        if (preempt_file && migration_in_postcopy()) {
+            /* Let the preempt thread of the destination quit */
+            qemu_put_be64(preempt_file, RAM_SAVE_FLAG_EOS);
+            qemu_fflush(preempt_file);
+        }
         qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
         qemu_fflush(f);
     }
@@ -3269,10 +4189,13 @@ static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
  *
  * @f: QEMUFile where to read the data from
  * @flags: Page flags (mostly to see if it's a continuation of previous block)
+ * @channel: the RAM channel that @f belongs to
  */
-static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
+static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags,
+                                              int channel)
 {
-    static RAMBlock *block;
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    RAMBlock *block = mis->last_recv_block[channel];
     char id[256];
     uint8_t len;
 
@@ -3289,6 +4212,7 @@ static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
     id[len] = 0;
 
     block = qemu_ram_block_by_name(id);
+    mis->last_recv_block[channel] = block;
     if (!block) {
         error_report("Can't find block %s", id);
         return NULL;
@@ -3343,13 +4267,29 @@ static inline void *colo_cache_from_block_offset(RAMBlock *block,
     * It help us to decide which pages in ram cache should be flushed
     * into VM's RAM later.
     */
-    if (record_bitmap &&
-        !test_and_set_bit(offset >> TARGET_PAGE_BITS, block->bmap)) {
-        ram_state->migration_dirty_pages++;
+    if (record_bitmap) {
+        colo_record_bitmap(block, &offset, 1);
     }
     return block->colo_cache + offset;
 }
 
+/*
+ * Marks @num pages of @block, loaded into its COLO cache, to be flushed by
+ * colo_flush_ram_cache().  Can be called by the multifd receive threads.
+ */
+void colo_record_bitmap(RAMBlock *block, ram_addr_t *offsets, uint32_t num)
+{
+    uint32_t i;
+
+    qemu_mutex_lock(&ram_state->bitmap_mutex);
+    for (i = 0; i < num; i++) {
+        if (!test_and_set_bit(offsets[i] >> TARGET_PAGE_BITS, block->bmap)) {
+            ram_state->migration_dirty_pages++;
+        }
+    }
+    qemu_mutex_unlock(&ram_state->bitmap_mutex);
+}
+
 /**
  * ram_handle_compressed: handle the zero page case
  *
@@ -3674,15 +4614,21 @@ static int ram_load_setup(QEMUFile *f, void *opaque)
 
 static int ram_load_cleanup(void *opaque)
 {
+    MigrationIncomingState *mis = migration_incoming_get_current();
     RAMBlock *rb;
 
+    xbzrle_load_cleanup();
+    compress_threads_load_cleanup();
+
+    /* The receivedmaps are still in use, see ram_lazy_restore_finish() */
+    if (mis->lazy_restore_ioc) {
+        return 0;
+    }
+
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         qemu_ram_block_writeback(rb);
     }
 
-    xbzrle_load_cleanup();
-    compress_threads_load_cleanup();
-
     RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
         rb->receivedmap = NULL;
@@ -3712,19 +4658,21 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis)
  *
  * Returns 0 for success or -errno in case of error
  *
- * Called in postcopy mode by ram_load().
+ * Called in postcopy mode by ram_load(), and by the preempt thread for
+ * the pages sent on the preempt channel.
  * rcu_read_lock is taken prior to this being called.
  *
  * @f: QEMUFile where to send the data
+ * @channel: the RAM channel that @f belongs to
  */
-static int ram_load_postcopy(QEMUFile *f)
+int ram_load_postcopy(QEMUFile *f, int channel)
 {
     int flags = 0, ret = 0;
     bool place_needed = false;
     bool matches_target_page_size = false;
     MigrationIncomingState *mis = migration_incoming_get_current();
     /* Temporary page that is later 'placed' */
-    void *postcopy_host_page = mis->postcopy_tmp_page;
+    void *postcopy_host_page = mis->postcopy_tmp_pages[channel];
     void *host_page = NULL;
     bool all_zero = true;
     int target_pages = 0;
@@ -3754,7 +4702,7 @@ static int ram_load_postcopy(QEMUFile *f)
         trace_ram_load_postcopy_loop((uint64_t)addr, flags);
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE)) {
-            block = ram_block_from_stream(f, flags);
+            block = ram_block_from_stream(f, flags, channel);
             if (!block) {
                 ret = -EINVAL;
                 break;
@@ -3960,6 +4908,445 @@ void colo_flush_ram_cache(void)
  *
  * @f: QEMUFile where to send the data
  */
+typedef struct FixedRamLoadThread {
+    QemuThread thread;
+    QIOChannel *ioc;
+    RAMBlock *block;
+    unsigned long *bitmap;
+    unsigned long start;
+    unsigned long end;
+    off_t pages_offset;
+    Error *err;
+} FixedRamLoadThread;
+
+/*
+ * Read the runs of pages of [start, end) that are present in the file.
+ * Runs in a worker thread, or in the load coroutine with a single
+ * reader.
+ */
+static void *fixed_ram_load_range(void *opaque)
+{
+    FixedRamLoadThread *t = opaque;
+    unsigned long set, clear;
+
+    for (set = find_next_bit(t->bitmap, t->end, t->start);
+         set < t->end;
+         set = find_next_bit(t->bitmap, t->end, clear)) {
+        ram_addr_t offset = (ram_addr_t)set << TARGET_PAGE_BITS;
+        void *host = host_from_ram_block_offset(t->block, offset);
+        struct iovec iov;
+
+        if (!host) {
+            error_setg(&t->err, "Illegal RAM offset " RAM_ADDR_FMT, offset);
+            break;
+        }
+
+        clear = find_next_zero_bit(t->bitmap, t->end, set);
+        iov.iov_base = host;
+        iov.iov_len = (clear - set) << TARGET_PAGE_BITS;
+        if (qio_channel_preadv(t->ioc, &iov, 1, t->pages_offset + offset,
+                               &t->err) < 0) {
+            break;
+        }
+        ramblock_recv_bitmap_set_range(t->block, host, clear - set);
+    }
+
+    return NULL;
+}
+
+/*
+ * Load the pages of @block from a fixed-ram file.  The pages are split
+ * in one range per multifd channel and read in parallel.
+ */
+static int fixed_ram_load_pages(QEMUFile *f, RAMBlock *block,
+                                unsigned long *bitmap, long num_pages,
+                                off_t pages_offset)
+{
+    int nthreads = migrate_use_multifd() ? migrate_multifd_channels() : 1;
+    unsigned long chunk = DIV_ROUND_UP(num_pages, nthreads);
+    g_autofree FixedRamLoadThread *threads = NULL;
+    int ret = 0;
+    int i;
+
+    threads = g_new0(FixedRamLoadThread, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        FixedRamLoadThread *t = &threads[i];
+
+        t->ioc = qemu_file_get_ioc(f);
+        t->block = block;
+        t->bitmap = bitmap;
+        t->start = MIN(i * chunk, num_pages);
+        t->end = MIN(t->start + chunk, num_pages);
+        t->pages_offset = pages_offset;
+        if (nthreads > 1) {
+            qemu_thread_create(&t->thread, "mig/fixed_ram",
+                               fixed_ram_load_range, t, QEMU_THREAD_JOINABLE);
+        }
+    }
+
+    if (nthreads == 1) {
+        fixed_ram_load_range(&threads[0]);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        FixedRamLoadThread *t = &threads[i];
+
+        if (nthreads > 1) {
+            qemu_thread_join(&t->thread);
+        }
+        if (t->err) {
+            error_report_err(t->err);
+            ret = -EIO;
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * With fixed-ram-lazy, the guest starts before its RAM has been read from
+ * the file.  All of RAM is discarded and registered with the postcopy fault
+ * threads, which read the host pages that are accessed; meanwhile
+ * ram_lazy_restore_thread() reads the others in order.  Each host page is
+ * claimed in @lazy_bmap by the thread that loads it, so it is placed once.
+ */
+
+/* Size of the reads of the background thread */
+#define RAM_LAZY_RESTORE_CHUNK (1 * MiB)
+
+/* Returns true if the caller has to load the host page at @offset */
+static bool ram_lazy_restore_claim(RAMBlock *rb, ram_addr_t offset)
+{
+    unsigned long nr = offset / qemu_ram_pagesize(rb);
+    unsigned long mask = BIT_MASK(nr);
+
+    return !(qatomic_fetch_or(&rb->lazy_bmap[BIT_WORD(nr)], mask) & mask);
+}
+
+/*
+ * Place the host page at @offset, whose data read from the file is in @buf.
+ * Target pages that are not in the file are zero.
+ */
+static int ram_lazy_restore_place(MigrationIncomingState *mis, RAMBlock *rb,
+                                  ram_addr_t offset, void *buf)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    unsigned long first = offset >> TARGET_PAGE_BITS;
+    unsigned long last = (offset + pagesize) >> TARGET_PAGE_BITS;
+    void *host = host_from_ram_block_offset(rb, offset);
+    unsigned long i;
+
+    if (find_next_bit(rb->file_bmap, last, first) == last) {
+        return postcopy_place_page_zero(mis, host, rb);
+    }
+
+    for (i = first; i < last; i++) {
+        if (!test_bit(i, rb->file_bmap)) {
+            memset(buf + ((i - first) << TARGET_PAGE_BITS), 0,
+                   TARGET_PAGE_SIZE);
+        }
+    }
+    return postcopy_place_page(mis, host, buf, rb);
+}
+
+/*
+ * Called by the fault threads for an access to the host page at @offset
+ * of @rb.  The page may already be on its way, the kernel then wakes the
+ * faulting thread when it is placed.
+ */
+int ram_lazy_restore_fault(MigrationIncomingState *mis, RAMBlock *rb,
+                           ram_addr_t offset)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    Error *local_err = NULL;
+    struct iovec iov;
+    void *buf;
+    int ret;
+
+    if (!ram_lazy_restore_claim(rb, offset)) {
+        return 0;
+    }
+
+    trace_ram_lazy_restore_fault(rb->idstr, offset);
+
+    if (find_next_bit(rb->file_bmap, (offset + pagesize) >> TARGET_PAGE_BITS,
+                      offset >> TARGET_PAGE_BITS) ==
+        (offset + pagesize) >> TARGET_PAGE_BITS) {
+        /* A zero page, nothing to read */
+        return ram_lazy_restore_place(mis, rb, offset, NULL);
+    }
+
+    /* UFFDIO_COPY needs a page aligned source */
+    buf = qemu_memalign(qemu_real_host_page_size, pagesize);
+    iov.iov_base = buf;
+    iov.iov_len = pagesize;
+    if (qio_channel_preadv(mis->lazy_restore_ioc, &iov, 1,
+                           rb->pages_offset + offset, &local_err) < 0) {
+        error_report_err(local_err);
+        ret = -EFAULT;
+    } else {
+        ret = ram_lazy_restore_place(mis, rb, offset, buf);
+    }
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+static int ram_lazy_restore_block(MigrationIncomingState *mis, RAMBlock *rb,
+                                  void *buf, size_t chunk)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t offset, i;
+
+    for (offset = 0; offset < rb->postcopy_length; offset += chunk) {
+        size_t len = MIN(chunk, rb->postcopy_length - offset);
+        unsigned long first = offset >> TARGET_PAGE_BITS;
+        unsigned long last = (offset + len) >> TARGET_PAGE_BITS;
+
+        /* Skip what the fault threads have loaded */
+        if (find_next_zero_bit(rb->lazy_bmap, (offset + len) / pagesize,
+                               offset / pagesize) ==
+            (offset + len) / pagesize) {
+            continue;
+        }
+
+        if (find_next_bit(rb->file_bmap, last, first) < last) {
+            Error *local_err = NULL;
+            struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+            if (qio_channel_preadv(mis->lazy_restore_ioc, &iov, 1,
+                                   rb->pages_offset + offset,
+                                   &local_err) < 0) {
+                error_report_err(local_err);
+                return -EIO;
+            }
+        }
+
+        for (i = 0; i < len; i += pagesize) {
+            if (ram_lazy_restore_claim(rb, offset + i)) {
+                int ret = ram_lazy_restore_place(mis, rb, offset + i,
+                                                 buf + i);
+
+                if (ret) {
+                    return ret;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void ram_lazy_restore_finish(MigrationIncomingState *mis)
+{
+    RAMBlock *rb;
+
+    qemu_thread_join(&mis->lazy_restore_thread);
+
+    if (mis->lazy_restore_ret) {
+        /*
+         * Keep userfaultfd registered, the fault threads may still be able
+         * to load the pages that are accessed.
+         */
+        error_report("Loading the RAM of fixed-ram-lazy failed: %s",
+                     strerror(-mis->lazy_restore_ret));
+        migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_ACTIVE,
+                          MIGRATION_STATUS_FAILED);
+        return;
+    }
+
+    if (postcopy_ram_incoming_cleanup(mis)) {
+        migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_ACTIVE,
+                          MIGRATION_STATUS_FAILED);
+        return;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+            qemu_ram_block_writeback(rb);
+            g_free(rb->receivedmap);
+            rb->receivedmap = NULL;
+            g_free(rb->file_bmap);
+            rb->file_bmap = NULL;
+            g_free(rb->lazy_bmap);
+            rb->lazy_bmap = NULL;
+        }
+    }
+
+    object_unref(OBJECT(mis->lazy_restore_ioc));
+    mis->lazy_restore_ioc = NULL;
+
+    trace_ram_lazy_restore_finish();
+    migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_ACTIVE,
+                      MIGRATION_STATUS_COMPLETED);
+    migration_incoming_state_destroy();
+}
+
+static void ram_lazy_restore_loaded_bh(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+
+    mis->lazy_restore_loaded = true;
+    /* Otherwise the device state is still being loaded */
+    if (mis->state == MIGRATION_STATUS_POSTCOPY_ACTIVE) {
+        ram_lazy_restore_finish(mis);
+    }
+}
+
+static void *ram_lazy_restore_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    size_t chunk = MAX(RAM_LAZY_RESTORE_CHUNK, mis->largest_page_size);
+    void *buf = qemu_memalign(qemu_real_host_page_size, chunk);
+    RAMBlock *rb;
+    int ret = 0;
+
+    rcu_register_thread();
+    trace_ram_lazy_restore_thread_entry();
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+            ret = ram_lazy_restore_block(mis, rb, buf,
+                                         ROUND_DOWN(chunk,
+                                                    qemu_ram_pagesize(rb)));
+            if (ret) {
+                break;
+            }
+        }
+    }
+
+    qemu_vfree(buf);
+    mis->lazy_restore_ret = ret;
+    trace_ram_lazy_restore_thread_exit(ret);
+    rcu_unregister_thread();
+
+    aio_bh_schedule_oneshot(qemu_get_aio_context(),
+                            ram_lazy_restore_loaded_bh, mis);
+    return NULL;
+}
+
+/*
+ * Called by process_incoming_migration_bh() instead of completing the
+ * migration, once the device state has been loaded.
+ */
+void ram_lazy_restore_activate(MigrationIncomingState *mis)
+{
+    migrate_set_state(&mis->state, MIGRATION_STATUS_ACTIVE,
+                      MIGRATION_STATUS_POSTCOPY_ACTIVE);
+    if (mis->lazy_restore_loaded) {
+        ram_lazy_restore_finish(mis);
+    }
+}
+
+/*
+ * Start faulting the pages in, after the fixed-ram headers of all blocks
+ * have been parsed and before the device state is loaded, as devices may
+ * access guest RAM while loading.
+ */
+static int ram_lazy_restore_start(QEMUFile *f)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    RAMBlock *rb;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
+        if (!rb->file_bmap) {
+            error_report("RAM block %s is missing from the migration file",
+                         rb->idstr);
+            return -EINVAL;
+        }
+        rb->lazy_bmap = bitmap_new(DIV_ROUND_UP(rb->used_length,
+                                                qemu_ram_pagesize(rb)));
+    }
+
+    /* userfaultfd only reports accesses to missing pages */
+    if (postcopy_ram_incoming_init(mis)) {
+        return -EINVAL;
+    }
+
+    mis->lazy_restore_ioc = qemu_file_get_ioc(f);
+    object_ref(OBJECT(mis->lazy_restore_ioc));
+    mis->lazy_restore_loaded = false;
+    if (postcopy_ram_incoming_setup(mis)) {
+        return -EINVAL;
+    }
+
+    trace_ram_lazy_restore_start();
+    qemu_thread_create(&mis->lazy_restore_thread, "mig/lazy_ram",
+                       ram_lazy_restore_thread, mis, QEMU_THREAD_JOINABLE);
+    return 0;
+}
+
+static int parse_ramblock_fixed_ram(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length)
+{
+    g_autofree unsigned long *bitmap = NULL;
+    FixedRamHeader header;
+    size_t bitmap_size;
+    long num_pages;
+    int ret;
+
+    if (!qemu_file_get_ioc(f)) {
+        error_report("fixed-ram requires a file as the migration channel");
+        return -EINVAL;
+    }
+
+    if (qemu_get_buffer(f, (uint8_t *)&header, sizeof(header)) !=
+        sizeof(header)) {
+        error_report("Error reading fixed-ram header of %s", block->idstr);
+        return -EINVAL;
+    }
+
+    header.version = be32_to_cpu(header.version);
+    header.page_size = be64_to_cpu(header.page_size);
+    header.bitmap_offset = be64_to_cpu(header.bitmap_offset);
+    header.pages_offset = be64_to_cpu(header.pages_offset);
+
+    if (header.version > FIXED_RAM_HDR_VERSION) {
+        error_report("Migration fixed-ram capability version mismatch "
+                     "(expected %d, got %d)", FIXED_RAM_HDR_VERSION,
+                     header.version);
+        return -EINVAL;
+    }
+
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_report("Mismatched fixed-ram page size for %s: %" PRIu64
+                     " != %d", block->idstr, header.page_size,
+                     TARGET_PAGE_SIZE);
+        return -EINVAL;
+    }
+
+    num_pages = length >> TARGET_PAGE_BITS;
+    bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    bitmap = bitmap_new(num_pages);
+    if (qemu_get_buffer_at(f, (uint8_t *)bitmap, bitmap_size,
+                           header.bitmap_offset) != bitmap_size) {
+        error_report("Error reading fixed-ram bitmap of %s", block->idstr);
+        return -EINVAL;
+    }
+    bitmap_from_le(bitmap, bitmap, num_pages);
+
+    trace_ram_load_fixed_ram(block->idstr, header.bitmap_offset,
+                             header.pages_offset,
+                             bitmap_count_one(bitmap, num_pages));
+
+    if (migrate_fixed_ram_lazy()) {
+        /* Loaded once the guest runs, see ram_lazy_restore_start() */
+        g_free(block->file_bmap);
+        block->file_bmap = g_steal_pointer(&bitmap);
+        block->pages_offset = header.pages_offset;
+    } else {
+        ret = fixed_ram_load_pages(f, block, bitmap, num_pages,
+                                   header.pages_offset);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    /* The rest of the stream follows the pages */
+    qemu_set_offset(f, header.pages_offset + length, SEEK_SET);
+    return qemu_file_get_error(f);
+}
+
 static int ram_load_precopy(QEMUFile *f)
 {
     int flags = 0, ret = 0, invalid_flags = 0, len = 0, i = 0;
@@ -4000,7 +5387,8 @@ static int ram_load_precopy(QEMUFile *f)
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
-            RAMBlock *block = ram_block_from_stream(f, flags);
+            RAMBlock *block = ram_block_from_stream(f, flags,
+                                                    RAM_CHANNEL_PRECOPY);
 
             host = host_from_ram_block_offset(block, addr);
             /*
@@ -4080,7 +5468,12 @@ static int ram_load_precopy(QEMUFile *f)
                     }
                     if (migrate_ignore_shared()) {
                         hwaddr addr = qemu_get_be64(f);
-                        if (ramblock_is_ignored(block) &&
+                        /*
+                         * A block that maps a file privately may be a
+                         * clone of a block that the source ignored, so
+                         * its contents must be at the same place too.
+                         */
+                        if ((ramblock_is_ignored(block) || block->fd >= 0) &&
                             block->mr->addr != addr) {
                             error_report("Mismatched GPAs for block %s "
                                          "%" PRId64 "!= %" PRId64,
@@ -4089,6 +5482,9 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_fixed_ram()) {
+                        ret = parse_ramblock_fixed_ram(f, block, length);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4099,6 +5495,9 @@ static int ram_load_precopy(QEMUFile *f)
 
                 total_ram_bytes -= length;
             }
+            if (!ret && migrate_fixed_ram_lazy()) {
+                ret = ram_lazy_restore_start(f);
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
@@ -4177,7 +5576,7 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
      */
     WITH_RCU_READ_LOCK_GUARD() {
         if (postcopy_running) {
-            ret = ram_load_postcopy(f);
+            ret = ram_load_postcopy(f, RAM_CHANNEL_PRECOPY);
         } else {
             ret = ram_load_precopy(f);
         }
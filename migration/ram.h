@@ -63,6 +63,10 @@ int ram_postcopy_send_discard_bitmap(MigrationState *ms);
 /* For incoming postcopy discard */
 int ram_discard_range(const char *block_name, uint64_t start, size_t length);
 int ram_postcopy_incoming_init(MigrationIncomingState *mis);
+int ram_lazy_restore_fault(MigrationIncomingState *mis, RAMBlock *rb,
+                           ram_addr_t offset);
+void ram_lazy_restore_activate(MigrationIncomingState *mis);
+int ram_load_postcopy(QEMUFile *f, int channel);
 
 void ram_handle_compressed(void *host, uint8_t ch, uint64_t size);
 
@@ -80,6 +84,7 @@ int colo_init_ram_cache(void);
 void colo_flush_ram_cache(void);
 void colo_release_ram_cache(void);
 void colo_incoming_start_dirty_log(void);
+void colo_record_bitmap(RAMBlock *block, ram_addr_t *offsets, uint32_t num);
 
 /* Background snapshot */
 bool ram_write_tracking_available(void);
@@ -87,5 +92,10 @@ bool ram_write_tracking_compatible(void);
 void ram_write_tracking_prepare(void);
 int ram_write_tracking_start(void);
 void ram_write_tracking_stop(void);
+/*
+ * Release the write protection of the @num pages at @offset in @rb, once
+ * they have been sent by a multifd channel.
+ */
+int ram_write_tracking_release(RAMBlock *rb, ram_addr_t *offset, uint32_t num);
 
 #endif
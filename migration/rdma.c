@@ -400,6 +400,13 @@ typedef struct RDMAContext {
     /* the RDMAContext for return path */
     struct RDMAContext *return_path;
     bool is_return_path;
+
+    /*
+     * For the connection of a multifd channel, the main connection.  Its
+     * protection domain and its pinned RAM blocks are shared, so that
+     * the channel can RDMA write the pages without its own registration.
+     */
+    struct RDMAContext *parent;
 } RDMAContext;
 
 #define TYPE_QIO_CHANNEL_RDMA "qio-channel-rdma"
@@ -1055,7 +1062,11 @@ err_resolve_create_id:
 static int qemu_rdma_alloc_pd_cq(RDMAContext *rdma)
 {
     /* allocate pd */
-    rdma->pd = ibv_alloc_pd(rdma->verbs);
+    if (rdma->parent) {
+        rdma->pd = rdma->parent->pd;
+    } else {
+        rdma->pd = ibv_alloc_pd(rdma->verbs);
+    }
     if (!rdma->pd) {
         error_report("failed to allocate protection domain");
         return -1;
@@ -1095,7 +1106,7 @@ static int qemu_rdma_alloc_pd_cq(RDMAContext *rdma)
     return 0;
 
 err_alloc_pd_cq:
-    if (rdma->pd) {
+    if (rdma->pd && !rdma->parent) {
         ibv_dealloc_pd(rdma->pd);
     }
     if (rdma->recv_comp_channel) {
@@ -1555,7 +1566,13 @@ static uint64_t qemu_rdma_poll(RDMAContext *rdma, struct ibv_cq *cq,
         rdma->control_ready_expected = 0;
     }
 
-    if (wr_id == RDMA_WRID_RDMA_WRITE) {
+    if (wr_id == RDMA_WRID_RDMA_WRITE && rdma->parent) {
+        /* multifd channels do not track chunks */
+        trace_qemu_rdma_poll_write_multifd(rdma->nb_sent);
+        if (rdma->nb_sent > 0) {
+            rdma->nb_sent--;
+        }
+    } else if (wr_id == RDMA_WRID_RDMA_WRITE) {
         uint64_t chunk =
             (wc.wr_id & RDMA_WRID_CHUNK_MASK) >> RDMA_WRID_CHUNK_SHIFT;
         uint64_t index =
@@ -2450,7 +2467,8 @@ static void qemu_rdma_cleanup(RDMAContext *rdma)
         rdma->connected = false;
     }
 
-    if (rdma->channel) {
+    /* the event channel of a multifd channel may belong to the main one */
+    if (rdma->channel && !rdma->parent) {
         qemu_set_fd_handler(rdma->channel->fd, NULL, NULL, NULL);
     }
     g_free(rdma->dest_blocks);
@@ -2491,7 +2509,9 @@ static void qemu_rdma_cleanup(RDMAContext *rdma)
         rdma->send_comp_channel = NULL;
     }
     if (rdma->pd) {
-        ibv_dealloc_pd(rdma->pd);
+        if (!rdma->parent) {
+            ibv_dealloc_pd(rdma->pd);
+        }
         rdma->pd = NULL;
     }
     if (rdma->cm_id) {
@@ -2501,13 +2521,13 @@ static void qemu_rdma_cleanup(RDMAContext *rdma)
 
     /* the destination side, listen_id and channel is shared */
     if (rdma->listen_id) {
-        if (!rdma->is_return_path) {
+        if (!rdma->is_return_path && !rdma->parent) {
             rdma_destroy_id(rdma->listen_id);
         }
         rdma->listen_id = NULL;
 
         if (rdma->channel) {
-            if (!rdma->is_return_path) {
+            if (!rdma->is_return_path && !rdma->parent) {
                 rdma_destroy_event_channel(rdma->channel);
             }
             rdma->channel = NULL;
@@ -2586,6 +2606,60 @@ err_rdma_source_init:
     return -1;
 }
 
+/*
+ * Set up the connection of a multifd channel.  It goes to the same
+ * device and host as @parent, and uses the protection domain and the
+ * RAM block registrations of @parent.
+ */
+static int qemu_rdma_multifd_source_init(RDMAContext *rdma,
+                                         RDMAContext *parent, Error **errp)
+{
+    int ret, idx;
+    Error *local_err = NULL, **temp = &local_err;
+
+    rdma->parent = parent;
+    rdma->pin_all = parent->pin_all;
+
+    ret = qemu_rdma_resolve_host(rdma, temp);
+    if (ret) {
+        goto err_rdma_multifd_source_init;
+    }
+
+    if (rdma->verbs != parent->verbs) {
+        ERROR(temp, "rdma migration: multifd channel is not on the device "
+                    "of the main connection");
+        goto err_rdma_multifd_source_init;
+    }
+
+    ret = qemu_rdma_alloc_pd_cq(rdma);
+    if (ret) {
+        ERROR(temp, "rdma migration: error allocating cq!");
+        goto err_rdma_multifd_source_init;
+    }
+
+    ret = qemu_rdma_alloc_qp(rdma);
+    if (ret) {
+        ERROR(temp, "rdma migration: error allocating qp!");
+        goto err_rdma_multifd_source_init;
+    }
+
+    for (idx = 0; idx < RDMA_WRID_MAX; idx++) {
+        ret = qemu_rdma_reg_control(rdma, idx);
+        if (ret) {
+            ERROR(temp, "rdma migration: error registering %d control!",
+                                                            idx);
+            goto err_rdma_multifd_source_init;
+        }
+    }
+
+    return 0;
+
+err_rdma_multifd_source_init:
+    error_propagate(errp, local_err);
+    qemu_rdma_cleanup(rdma);
+    return -1;
+}
+
 static int qemu_get_cm_event_timeout(RDMAContext *rdma,
                                      struct rdma_cm_event **cm_event,
                                      long msec, Error **errp)
@@ -2833,6 +2907,7 @@ static ssize_t qio_channel_rdma_writev(QIOChannel *ioc,
                                        size_t niov,
                                        int *fds,
                                        size_t nfds,
+                                       int flags,
                                        Error **errp)
 {
     QIOChannelRDMA *rioc = QIO_CHANNEL_RDMA(ioc);
@@ -3309,7 +3384,7 @@ static size_t qemu_rdma_save_page(QEMUFile *f, void *opaque,
 
     CHECK_ERROR_STATE();
 
-    if (migration_in_postcopy()) {
+    if (migration_in_postcopy() || multifd_use_rdma()) {
         return RAM_SAVE_CONTROL_NOT_SUPP;
     }
 
@@ -3416,6 +3491,8 @@ err:
 }
 
 static void rdma_accept_incoming_migration(void *opaque);
+static void rdma_accept_multifd_channel(RDMAContext *parent,
+                                        struct rdma_cm_event *cm_event);
 
 static void rdma_cm_poll_handler(void *opaque)
 {
@@ -3430,6 +3507,18 @@ static void rdma_cm_poll_handler(void *opaque)
         return;
     }
 
+    if (multifd_use_rdma()) {
+        if (cm_event->event == RDMA_CM_EVENT_CONNECT_REQUEST) {
+            rdma_accept_multifd_channel(rdma, cm_event);
+            return;
+        }
+        /* multifd channels go away with their recv thread */
+        if (cm_event->id != rdma->cm_id) {
+            rdma_ack_cm_event(cm_event);
+            return;
+        }
+    }
+
     if (cm_event->event == RDMA_CM_EVENT_DISCONNECTED ||
         cm_event->event == RDMA_CM_EVENT_DEVICE_REMOVAL) {
         if (!rdma->error_state &&
@@ -3451,7 +3540,11 @@ static void rdma_cm_poll_handler(void *opaque)
     rdma_ack_cm_event(cm_event);
 }
 
-static int qemu_rdma_accept(RDMAContext *rdma)
+/*
+ * Accept a connection.  @cm_event is the connection request, or NULL to
+ * wait for one on the event channel.
+ */
+static int qemu_rdma_accept(RDMAContext *rdma, struct rdma_cm_event *cm_event)
 {
     RDMACapabilities cap;
     struct rdma_conn_param conn_param = {
@@ -3460,14 +3553,15 @@ static int qemu_rdma_accept(RDMAContext *rdma)
                                             .private_data_len = sizeof(cap),
                                          };
     RDMAContext *rdma_return_path = NULL;
-    struct rdma_cm_event *cm_event;
     struct ibv_context *verbs;
     int ret = -EINVAL;
     int idx;
 
-    ret = rdma_get_cm_event(rdma->channel, &cm_event);
-    if (ret) {
-        goto err_rdma_dest_wait;
+    if (!cm_event) {
+        ret = rdma_get_cm_event(rdma->channel, &cm_event);
+        if (ret) {
+            goto err_rdma_dest_wait;
+        }
     }
 
     if (cm_event->event != RDMA_CM_EVENT_CONNECT_REQUEST) {
@@ -3479,7 +3573,7 @@ static int qemu_rdma_accept(RDMAContext *rdma)
      * initialize the RDMAContext for return path for postcopy after first
      * connection request reached.
      */
-    if (migrate_postcopy() && !rdma->is_return_path) {
+    if (migrate_postcopy() && !rdma->is_return_path && !rdma->parent) {
         rdma_return_path = qemu_rdma_data_init(rdma->host_port, NULL);
         if (rdma_return_path == NULL) {
             rdma_ack_cm_event(cm_event);
@@ -3546,10 +3640,13 @@ static int qemu_rdma_accept(RDMAContext *rdma)
         goto err_rdma_dest_wait;
     }
 
-    ret = qemu_rdma_init_ram_blocks(rdma);
-    if (ret) {
-        error_report("rdma migration: error initializing ram blocks!");
-        goto err_rdma_dest_wait;
+    /* multifd channels write to the RAM blocks of the main connection */
+    if (!rdma->parent) {
+        ret = qemu_rdma_init_ram_blocks(rdma);
+        if (ret) {
+            error_report("rdma migration: error initializing ram blocks!");
+            goto err_rdma_dest_wait;
+        }
     }
 
     for (idx = 0; idx < RDMA_WRID_MAX; idx++) {
@@ -3560,14 +3657,17 @@ static int qemu_rdma_accept(RDMAContext *rdma)
         }
     }
 
-    /* Accept the second connection request for return path */
-    if (migrate_postcopy() && !rdma->is_return_path) {
-        qemu_set_fd_handler(rdma->channel->fd, rdma_accept_incoming_migration,
-                            NULL,
-                            (void *)(intptr_t)rdma->return_path);
-    } else {
-        qemu_set_fd_handler(rdma->channel->fd, rdma_cm_poll_handler,
-                            NULL, rdma);
+    /* The events of multifd channels are handled by the main connection */
+    if (!rdma->parent) {
+        if (migrate_postcopy() && !rdma->is_return_path) {
+            /* Accept the second connection request for return path */
+            qemu_set_fd_handler(rdma->channel->fd,
+                                rdma_accept_incoming_migration, NULL,
+                                (void *)(intptr_t)rdma->return_path);
+        } else {
+            qemu_set_fd_handler(rdma->channel->fd, rdma_cm_poll_handler,
+                                NULL, rdma);
+        }
     }
 
     ret = rdma_accept(rdma->cm_id, &conn_param);
@@ -4184,7 +4284,7 @@ static void rdma_accept_incoming_migration(void *opaque)
     Error *local_err = NULL;
 
     trace_qemu_rdma_accept_incoming_migration();
-    ret = qemu_rdma_accept(rdma);
+    ret = qemu_rdma_accept(rdma, NULL);
 
     if (ret) {
         fprintf(stderr, "RDMA ERROR: Migration initialization failed\n");
@@ -4211,6 +4311,281 @@ static void rdma_accept_incoming_migration(void *opaque)
     }
 }
 
+/*
+ * Accept the connection of a multifd channel, on the event channel of
+ * the main connection, and hand it to the multifd code.
+ */
+static void rdma_accept_multifd_channel(RDMAContext *parent,
+                                        struct rdma_cm_event *cm_event)
+{
+    RDMAContext *rdma = qemu_rdma_data_init(parent->host_port, NULL);
+    QIOChannelRDMA *rioc;
+    Error *local_err = NULL;
+
+    if (!rdma) {
+        rdma_reject(cm_event->id, NULL, 0);
+        rdma_ack_cm_event(cm_event);
+        return;
+    }
+
+    /* the CM channel and listen id are shared */
+    rdma->channel = parent->channel;
+    rdma->listen_id = parent->listen_id;
+    rdma->verbs = parent->verbs;
+    rdma->parent = parent;
+
+    if (qemu_rdma_accept(rdma, cm_event)) {
+        fprintf(stderr, "RDMA ERROR: multifd channel initialization failed\n");
+        g_free(rdma);
+        return;
+    }
+
+    trace_rdma_accept_multifd_channel();
+
+    rioc = QIO_CHANNEL_RDMA(object_new(TYPE_QIO_CHANNEL_RDMA));
+    rioc->rdmain = rdma;
+    qio_channel_set_name(QIO_CHANNEL(rioc), "multifd-rdma-incoming");
+    migration_ioc_process_incoming(QIO_CHANNEL(rioc), &local_err);
+    object_unref(OBJECT(rioc));
+    if (local_err) {
+        error_reportf_err(local_err, "RDMA ERROR:");
+    }
+}
+
+static struct RDMAOutgoingArgs {
+    RDMAContext *rdma;
+} outgoing_args;
+
+void rdma_send_channel_create(QIOTaskFunc f, void *data)
+{
+    RDMAContext *parent = outgoing_args.rdma;
+    QIOChannelRDMA *rioc = NULL;
+    RDMAContext *rdma;
+    Error *err = NULL;
+    QIOTask *task;
+
+    if (!parent->pin_all) {
+        error_setg(&err, "multifd over RDMA requires the rdma-pin-all "
+                   "capability");
+        goto out;
+    }
+
+    rdma = qemu_rdma_data_init(parent->host_port, &err);
+    if (!rdma) {
+        goto out;
+    }
+
+    if (qemu_rdma_multifd_source_init(rdma, parent, &err) ||
+        qemu_rdma_connect(rdma, &err, false)) {
+        g_free(rdma);
+        goto out;
+    }
+
+    rioc = QIO_CHANNEL_RDMA(object_new(TYPE_QIO_CHANNEL_RDMA));
+    rioc->rdmaout = rdma;
+    qio_channel_set_name(QIO_CHANNEL(rioc), "multifd-rdma-outgoing");
+
+out:
+    task = qio_task_new(OBJECT(rioc), f, data, NULL);
+    if (err) {
+        qio_task_set_error(task, err);
+    }
+    qio_task_complete(task);
+}
+
+int rdma_send_channel_destroy(QIOChannel *send)
+{
+    object_unref(OBJECT(send));
+    outgoing_args.rdma = NULL;
+    return 0;
+}
+
+/*
+ * Post an RDMA write of @len bytes at @offset of @block, a block of the
+ * main connection registered with pin-all.
+ */
+static int qemu_rdma_post_write(RDMAContext *rdma, RDMALocalBlock *block,
+                                uint64_t offset, uint64_t len, bool signaled)
+{
+    struct ibv_sge sge = {
+        .addr = (uintptr_t)(block->local_host_addr + offset),
+        .length = len,
+        .lkey = block->mr->lkey,
+    };
+    struct ibv_send_wr send_wr = {
+        .wr_id = RDMA_WRID_RDMA_WRITE,
+        .opcode = IBV_WR_RDMA_WRITE,
+        .send_flags = signaled ? IBV_SEND_SIGNALED : 0,
+        .sg_list = &sge,
+        .num_sge = 1,
+        .wr.rdma.remote_addr = block->remote_host_addr + offset,
+        .wr.rdma.rkey = block->remote_rkey,
+    };
+    struct ibv_send_wr *bad_wr;
+    int ret;
+
+    ret = ibv_post_send(rdma->qp, &send_wr, &bad_wr);
+    if (ret) {
+        return -ret;
+    }
+
+    if (signaled) {
+        rdma->nb_sent++;
+    }
+    return 0;
+}
+
+static RDMAContext *multifd_rdma_out(MultiFDSendParams *p)
+{
+    return qatomic_rcu_read(&QIO_CHANNEL_RDMA(p->c)->rdmaout);
+}
+
+static int multifd_rdma_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    return 0;
+}
+
+static void multifd_rdma_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+}
+
+/**
+ * multifd_rdma_send_prepare: post the RDMA writes of the pages
+ *
+ * The writes are posted before the packet header is sent on the same
+ * queue pair, so the reliable connection ordering guarantees that the
+ * pages are in place on the destination once it receives the header.
+ * Only the last write is signaled.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int multifd_rdma_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    RDMALocalBlock *block;
+    RDMAContext *rdma;
+    uint32_t start, i;
+    int ret;
+
+    RCU_READ_LOCK_GUARD();
+    rdma = multifd_rdma_out(p);
+    if (!rdma || rdma->error_state) {
+        error_setg(errp, "multifd %d: RDMA is in an error state", p->id);
+        return -1;
+    }
+
+    block = g_hash_table_lookup(rdma->parent->blockmap,
+                                (void *)(uintptr_t)pages->block->offset);
+    if (!block || !block->mr) {
+        error_setg(errp, "multifd %d: RAMBlock %s is not registered",
+                   p->id, pages->block->idstr);
+        return -1;
+    }
+
+    for (start = 0; start < pages->num; start = i) {
+        for (i = start + 1; i < pages->num; i++) {
+            if (pages->offset[i] != pages->offset[i - 1] + page_size) {
+                break;
+            }
+        }
+
+        trace_multifd_rdma_send_write(p->id, pages->block->idstr,
+                                      pages->offset[start], i - start);
+        ret = qemu_rdma_post_write(rdma, block, pages->offset[start],
+                                   (i - start) * page_size, i == pages->num);
+        if (ret) {
+            error_setg_errno(errp, -ret, "multifd %d: failed to post RDMA "
+                             "write", p->id);
+            rdma->error_state = ret;
+            return -1;
+        }
+    }
+
+    p->next_packet_size = 0;
+    p->flags |= MULTIFD_FLAG_NOCOMP;
+    return 0;
+}
+
+/**
+ * multifd_rdma_send_write: wait for the RDMA writes of the packet
+ *
+ * The header is already out; wait for the completion of the writes so
+ * that the send queue never overflows.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int multifd_rdma_send_write(MultiFDSendParams *p, uint32_t used,
+                                   Error **errp)
+{
+    RDMAContext *rdma;
+    int ret;
+
+    RCU_READ_LOCK_GUARD();
+    rdma = multifd_rdma_out(p);
+    if (!rdma) {
+        error_setg(errp, "multifd %d: RDMA channel closed", p->id);
+        return -1;
+    }
+
+    while (rdma->nb_sent) {
+        ret = qemu_rdma_block_for_wrid(rdma, RDMA_WRID_RDMA_WRITE, NULL);
+        if (ret < 0) {
+            error_setg(errp, "multifd %d: RDMA write failed", p->id);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int multifd_rdma_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    return 0;
+}
+
+static void multifd_rdma_recv_cleanup(MultiFDRecvParams *p)
+{
+}
+
+/**
+ * multifd_rdma_recv_pages: check the pages of the packet
+ *
+ * The source wrote them in place before sending the packet header.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int multifd_rdma_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+
+    if (flags != MULTIFD_FLAG_NOCOMP) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_NOCOMP);
+        return -1;
+    }
+    return 0;
+}
+
+MultiFDMethods multifd_rdma_ops = {
+    .send_setup = multifd_rdma_send_setup,
+    .send_cleanup = multifd_rdma_send_cleanup,
+    .send_prepare = multifd_rdma_send_prepare,
+    .send_write = multifd_rdma_send_write,
+    .recv_setup = multifd_rdma_recv_setup,
+    .recv_cleanup = multifd_rdma_recv_cleanup,
+    .recv_pages = multifd_rdma_recv_pages
+};
+
 void rdma_start_incoming_migration(const char *host_port, Error **errp)
 {
     int ret;
@@ -4324,6 +4699,7 @@ void rdma_start_outgoing_migration(void *opaque,
 
     trace_rdma_start_outgoing_migration_after_rdma_connect();
 
+    outgoing_args.rdma = rdma;
     s->to_dst_file = qemu_fopen_rdma(rdma, "wb");
     migrate_fd_connect(s, NULL);
     return;
@@ -17,9 +17,18 @@
 #ifndef QEMU_MIGRATION_RDMA_H
 #define QEMU_MIGRATION_RDMA_H
 
+#include "io/channel.h"
+#include "io/task.h"
+#include "multifd.h"
+
 void rdma_start_outgoing_migration(void *opaque, const char *host_port,
                                    Error **errp);
 
 void rdma_start_incoming_migration(const char *host_port, Error **errp);
 
+void rdma_send_channel_create(QIOTaskFunc f, void *data);
+int rdma_send_channel_destroy(QIOChannel *send);
+
+extern MultiFDMethods multifd_rdma_ops;
+
 #endif
@@ -40,6 +40,8 @@
 #include "qemu-file.h"
 #include "savevm.h"
 #include "postcopy-ram.h"
+#include "multifd.h"
+#include "latency.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-migration.h"
 #include "qapi/qmp/json-writer.h"
@@ -55,6 +57,7 @@
 #include "qemu/main-loop.h"
 #include "block/snapshot.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "io/channel-buffer.h"
 #include "io/channel-file.h"
 #include "sysemu/replay.h"
@@ -130,30 +133,185 @@ static struct mig_cmd_args {
 /***********************************************************/
 /* savevm/loadvm support */
 
+/*
+ * The VM state arrives in small sequential pieces.  Gather them into larger
+ * chunks and keep several chunks in flight, each at its own fixed offset in
+ * the vmstate area.  Loading reads ahead the same way.
+ */
+#define BDRV_VMSTATE_CHUNK_SIZE (1 * MiB)
+#define BDRV_VMSTATE_CHUNKS     8
+
+typedef struct BdrvVMState BdrvVMState;
+
+typedef struct BdrvVMStateChunk {
+    BdrvVMState *s;
+    uint8_t *buf;
+    int64_t pos;
+    size_t len;
+    bool busy;                  /* I/O in flight */
+    int ret;
+} BdrvVMStateChunk;
+
+struct BdrvVMState {
+    BlockDriverState *bs;
+    bool is_writable;
+    BdrvVMStateChunk chunks[BDRV_VMSTATE_CHUNKS];
+    BdrvVMStateChunk *cur;      /* chunk being filled when saving */
+    int64_t next_pos;           /* next chunk to read ahead when loading */
+    int in_flight;
+    int ret;                    /* first write error */
+};
+
+static void coroutine_fn bdrv_vmstate_co_entry(void *opaque)
+{
+    BdrvVMStateChunk *c = opaque;
+    BdrvVMState *s = c->s;
+    QEMUIOVector qiov;
+
+    qemu_iovec_init_buf(&qiov, c->buf, c->len);
+    if (s->is_writable) {
+        c->ret = bdrv_writev_vmstate(s->bs, &qiov, c->pos);
+        if (c->ret < 0 && !s->ret) {
+            s->ret = c->ret;
+        }
+    } else {
+        c->ret = bdrv_readv_vmstate(s->bs, &qiov, c->pos);
+    }
+
+    c->busy = false;
+    s->in_flight--;
+    aio_wait_kick();
+}
+
+static void bdrv_vmstate_start(BdrvVMStateChunk *c)
+{
+    Coroutine *co = qemu_coroutine_create(bdrv_vmstate_co_entry, c);
+
+    c->busy = true;
+    c->s->in_flight++;
+    bdrv_coroutine_enter(c->s->bs, co);
+}
+
+static void bdrv_vmstate_submit(BdrvVMState *s)
+{
+    if (s->cur && s->cur->len) {
+        bdrv_vmstate_start(s->cur);
+    }
+    s->cur = NULL;
+}
+
+static BdrvVMStateChunk *bdrv_vmstate_idle_chunk(BdrvVMState *s)
+{
+    int i;
+
+    BDRV_POLL_WHILE(s->bs, s->in_flight == BDRV_VMSTATE_CHUNKS);
+    for (i = 0; i < BDRV_VMSTATE_CHUNKS; i++) {
+        if (!s->chunks[i].busy) {
+            return &s->chunks[i];
+        }
+    }
+    g_assert_not_reached();
+}
+
 static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
                                    int64_t pos, Error **errp)
 {
-    int ret;
-    QEMUIOVector qiov;
+    BdrvVMState *s = opaque;
+    size_t size = iov_size(iov, iovcnt);
+    size_t done = 0;
 
-    qemu_iovec_init_external(&qiov, iov, iovcnt);
-    ret = bdrv_writev_vmstate(opaque, &qiov, pos);
-    if (ret < 0) {
-        return ret;
+    if (s->cur && s->cur->pos + s->cur->len != pos) {
+        bdrv_vmstate_submit(s);
+    }
+
+    while (done < size && !s->ret) {
+        BdrvVMStateChunk *c = s->cur;
+
+        if (!c) {
+            c = s->cur = bdrv_vmstate_idle_chunk(s);
+            c->pos = pos + done;
+            c->len = 0;
+        }
+        done += iov_to_buf(iov, iovcnt, done, c->buf + c->len,
+                           BDRV_VMSTATE_CHUNK_SIZE - c->len);
+        c->len = pos + done - c->pos;
+        if (c->len == BDRV_VMSTATE_CHUNK_SIZE) {
+            bdrv_vmstate_submit(s);
+        }
     }
 
-    return qiov.size;
+    if (s->ret < 0) {
+        return s->ret;
+    }
+    return size;
 }
 
 static ssize_t block_get_buffer(void *opaque, uint8_t *buf, int64_t pos,
                                 size_t size, Error **errp)
 {
-    return bdrv_load_vmstate(opaque, buf, pos, size);
+    BdrvVMState *s = opaque;
+    BdrvVMStateChunk *c = NULL;
+    int i;
+
+    for (i = 0; i < BDRV_VMSTATE_CHUNKS; i++) {
+        if (s->chunks[i].pos <= pos &&
+            pos < s->chunks[i].pos + s->chunks[i].len) {
+            c = &s->chunks[i];
+            break;
+        }
+    }
+
+    if (!c) {
+        /* First read, or not sequential: restart the read-ahead at pos */
+        BDRV_POLL_WHILE(s->bs, s->in_flight);
+        for (i = 0; i < BDRV_VMSTATE_CHUNKS; i++) {
+            s->chunks[i].pos = pos + i * BDRV_VMSTATE_CHUNK_SIZE;
+            s->chunks[i].len = BDRV_VMSTATE_CHUNK_SIZE;
+            bdrv_vmstate_start(&s->chunks[i]);
+        }
+        s->next_pos = pos + BDRV_VMSTATE_CHUNKS * BDRV_VMSTATE_CHUNK_SIZE;
+        c = &s->chunks[0];
+    }
+
+    BDRV_POLL_WHILE(s->bs, c->busy);
+    if (c->ret < 0) {
+        return c->ret;
+    }
+
+    size = MIN(size, c->pos + c->len - pos);
+    memcpy(buf, c->buf + (pos - c->pos), size);
+
+    if (pos + size == c->pos + c->len) {
+        /* Used up, reuse it for the next chunk */
+        c->pos = s->next_pos;
+        s->next_pos += BDRV_VMSTATE_CHUNK_SIZE;
+        bdrv_vmstate_start(c);
+    }
+
+    return size;
 }
 
 static int bdrv_fclose(void *opaque, Error **errp)
 {
-    return bdrv_flush(opaque);
+    BdrvVMState *s = opaque;
+    int ret;
+    int i;
+
+    if (s->is_writable) {
+        bdrv_vmstate_submit(s);
+    }
+    BDRV_POLL_WHILE(s->bs, s->in_flight);
+
+    ret = s->ret;
+    if (!ret) {
+        ret = bdrv_flush(s->bs);
+    }
+
+    for (i = 0; i < BDRV_VMSTATE_CHUNKS; i++) {
+        qemu_vfree(s->chunks[i].buf);
+    }
+    g_free(s);
+    return ret;
 }
 
 static const QEMUFileOps bdrv_read_ops = {
@@ -168,10 +326,20 @@ static const QEMUFileOps bdrv_write_ops = {
 
 static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
 {
+    BdrvVMState *s = g_new0(BdrvVMState, 1);
+    int i;
+
+    s->bs = bs;
+    s->is_writable = is_writable;
+    for (i = 0; i < BDRV_VMSTATE_CHUNKS; i++) {
+        s->chunks[i].s = s;
+        s->chunks[i].buf = qemu_blockalign(bs, BDRV_VMSTATE_CHUNK_SIZE);
+    }
+
     if (is_writable) {
-        return qemu_fopen_ops(bs, &bdrv_write_ops, false);
+        return qemu_fopen_ops(s, &bdrv_write_ops, false);
     }
-    return qemu_fopen_ops(bs, &bdrv_read_ops, false);
+    return qemu_fopen_ops(s, &bdrv_read_ops, false);
 }
 
 
@@ -233,6 +401,32 @@ typedef struct CompatEntry {
     int instance_id;
 } CompatEntry;
 
+/* A device state buffer received from a multifd channel */
+typedef struct SaveStateBuffer {
+    uint64_t idx;
+    char *buf;
+    size_t len;
+} SaveStateBuffer;
+
+/* Reorders the device state buffers of a device on the destination */
+typedef struct SaveStateBuffers {
+    /* this mutex protects the following parameters */
+    QemuMutex lock;
+    /* signalled when done is set or loading ends */
+    QemuCond cond;
+    /* buffers received and not yet loaded, indexed by idx */
+    GHashTable *pending;
+    /* index of the next buffer to load */
+    uint64_t next_idx;
+    /* the incoming migration sends the device state in buffers */
+    bool ready;
+    /* a thread is inside load_state_buffer */
+    bool loading;
+    /* all buffers have been loaded, or loading failed */
+    bool done;
+    int ret;
+} SaveStateBuffers;
+
 typedef struct SaveStateEntry {
     QTAILQ_ENTRY(SaveStateEntry) entry;
     char idstr[256];
@@ -249,8 +443,20 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /* only for handlers with load_state_buffer */
+    SaveStateBuffers *load_buffers;
+    /* index of the next device state buffer sent by this migration */
+    uint64_t device_state_idx;
 } SaveStateEntry;
 
+typedef struct SaveCompletePrecopyThread {
+    QemuThread thread;
+    SaveStateEntry *se;
+    SaveLiveCompletePrecopyThreadData data;
+    int ret;
+    Error *err;
+} SaveCompletePrecopyThread;
+
 typedef struct SaveState {
     QTAILQ_HEAD(, SaveStateEntry) handlers;
     SaveStateEntry *handler_pri_head[MIG_PRI_MAX + 1];
@@ -258,6 +464,8 @@ typedef struct SaveState {
     uint32_t len;
     const char *name;
     uint32_t target_page_bits;
+    /* running save_live_complete_precopy_thread handlers */
+    GPtrArray *complete_threads;
     uint32_t caps_count;
     MigrationCapability *capabilities;
     QemuUUID uuid;
@@ -783,6 +991,36 @@ static void savevm_state_handler_remove(SaveStateEntry *se)
    of the system, so instance_id should be removed/replaced.
    Meanwhile pass -1 as instance_id if you do not already have a clearly
    distinguishing id for all instances of your device class. */
+static void save_state_buffer_free(gpointer data)
+{
+    SaveStateBuffer *sb = data;
+
+    g_free(sb->buf);
+    g_free(sb);
+}
+
+static SaveStateBuffers *save_state_buffers_new(void)
+{
+    SaveStateBuffers *b = g_new0(SaveStateBuffers, 1);
+
+    qemu_mutex_init(&b->lock);
+    qemu_cond_init(&b->cond);
+    b->pending = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL,
+                                       save_state_buffer_free);
+    return b;
+}
+
+static void save_state_buffers_free(SaveStateBuffers *b)
+{
+    if (!b) {
+        return;
+    }
+    g_hash_table_destroy(b->pending);
+    qemu_cond_destroy(&b->cond);
+    qemu_mutex_destroy(&b->lock);
+    g_free(b);
+}
+
 int register_savevm_live(const char *idstr,
                          uint32_t instance_id,
                          int version_id,
@@ -802,6 +1040,10 @@ int register_savevm_live(const char *idstr,
         se->is_ram = 1;
     }
 
+    if (ops->load_state_buffer) {
+        se->load_buffers = save_state_buffers_new();
+    }
+
     pstrcat(se->idstr, sizeof(se->idstr), idstr);
 
     if (instance_id == VMSTATE_INSTANCE_ID_ANY) {
@@ -833,6 +1075,7 @@ void unregister_savevm(VMStateIf *obj, const char *idstr, void *opaque)
         if (strcmp(se->idstr, id) == 0 && se->opaque == opaque) {
             savevm_state_handler_remove(se);
             g_free(se->compat);
+            save_state_buffers_free(se->load_buffers);
             g_free(se);
         }
     }
@@ -1204,6 +1447,7 @@ void qemu_savevm_state_setup(QEMUFile *f)
 
     trace_savevm_state_setup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->device_state_idx = 0;
         if (!se->ops || !se->ops->save_setup) {
             continue;
         }
@@ -1258,6 +1502,33 @@ int qemu_savevm_state_resume_prepare(MigrationState *s)
  *   0 : We haven't finished, caller have to go again
  *   1 : We have finished, we can go to complete phase
  */
+/*
+ * Let @se queue its next chunk of precopy data on the multifd channels.
+ * Nothing goes in the main stream; the buffers are numbered after those
+ * of the previous iterations, and the stop-copy buffers follow them.
+ */
+static int qemu_savevm_iterate_device_state(QEMUFile *f, SaveStateEntry *se)
+{
+    SaveLiveCompletePrecopyThreadData d = {
+        .idstr = se->idstr,
+        .instance_id = se->instance_id,
+        .opaque = se->opaque,
+        .idx = se->device_state_idx,
+    };
+    Error *local_err = NULL;
+    int ret;
+
+    ret = se->ops->save_live_iterate_buffers(&d, &local_err);
+    se->device_state_idx = d.idx;
+    trace_savevm_iterate_device_state(se->idstr, se->instance_id, d.idx, ret);
+    if (ret < 0) {
+        error_report_err(local_err);
+    }
+
+    multifd_device_state_account(f);
+    return ret;
+}
+
 int qemu_savevm_state_iterate(QEMUFile *f, bool postcopy)
 {
     SaveStateEntry *se;
@@ -1289,13 +1560,19 @@ int qemu_savevm_state_iterate(QEMUFile *f, bool postcopy)
         if (qemu_file_rate_limit(f)) {
             return 0;
         }
-        trace_savevm_section_start(se->idstr, se->section_id);
 
-        save_section_header(f, se, QEMU_VM_SECTION_PART);
+        if (se->ops->save_live_iterate_buffers &&
+            qemu_savevm_device_state_active()) {
+            ret = qemu_savevm_iterate_device_state(f, se);
+        } else {
+            trace_savevm_section_start(se->idstr, se->section_id);
+
+            save_section_header(f, se, QEMU_VM_SECTION_PART);
 
-        ret = se->ops->save_live_iterate(f, se->opaque);
-        trace_savevm_section_end(se->idstr, se->section_id, ret);
-        save_section_footer(f, se);
+            ret = se->ops->save_live_iterate(f, se->opaque);
+            trace_savevm_section_end(se->idstr, se->section_id, ret);
+            save_section_footer(f, se);
+        }
 
         if (ret < 0) {
             error_report("failed to save SaveStateEntry with id(name): %d(%s)",
@@ -1359,6 +1636,101 @@ void qemu_savevm_state_complete_postcopy(QEMUFile *f)
     qemu_fflush(f);
 }
 
+bool qemu_savevm_device_state_active(void)
+{
+    return multifd_device_state_save_active();
+}
+
+int qemu_savevm_queue_device_state(SaveLiveCompletePrecopyThreadData *d,
+                                   char *buf, size_t len, Error **errp)
+{
+    return multifd_queue_device_state(d->idstr, d->instance_id, d->idx++,
+                                      buf, len, errp);
+}
+
+static void *qemu_savevm_complete_precopy_thread(void *opaque)
+{
+    SaveCompletePrecopyThread *t = opaque;
+    SaveStateEntry *se = t->se;
+
+    rcu_register_thread();
+    trace_savevm_complete_precopy_thread_start(se->idstr, se->instance_id);
+
+    t->ret = se->ops->save_live_complete_precopy_thread(&t->data, &t->err);
+    if (!t->ret) {
+        /* An empty buffer tells the destination that the state is complete */
+        t->ret = qemu_savevm_queue_device_state(&t->data, NULL, 0, &t->err);
+    }
+
+    trace_savevm_complete_precopy_thread_end(se->idstr, se->instance_id,
+                                             t->ret);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void qemu_savevm_start_complete_precopy_thread(SaveStateEntry *se)
+{
+    SaveCompletePrecopyThread *t = g_new0(SaveCompletePrecopyThread, 1);
+
+    t->se = se;
+    t->data.idstr = se->idstr;
+    t->data.instance_id = se->instance_id;
+    t->data.opaque = se->opaque;
+    t->data.idx = se->device_state_idx;
+
+    if (!savevm_state.complete_threads) {
+        savevm_state.complete_threads = g_ptr_array_new();
+    }
+    g_ptr_array_add(savevm_state.complete_threads, t);
+    qemu_thread_create(&t->thread, "mig/dev_save",
+                       qemu_savevm_complete_precopy_thread, t,
+                       QEMU_THREAD_JOINABLE);
+}
+
+/*
+ * Wait for the save_live_complete_precopy_thread handlers and for the
+ * multifd channels to write what they queued.
+ */
+static int qemu_savevm_join_complete_precopy_threads(QEMUFile *f)
+{
+    GPtrArray *threads = savevm_state.complete_threads;
+    int ret = 0;
+    guint i;
+
+    if (!threads) {
+        return 0;
+    }
+    savevm_state.complete_threads = NULL;
+
+    for (i = 0; i < threads->len; i++) {
+        SaveCompletePrecopyThread *t = g_ptr_array_index(threads, i);
+
+        qemu_thread_join(&t->thread);
+        if (t->ret) {
+            if (t->err) {
+                error_report_err(t->err);
+            } else {
+                error_report("%s: failed to save the state of '%s'",
+                             __func__, t->se->idstr);
+            }
+            if (!ret) {
+                ret = t->ret < 0 ? t->ret : -EINVAL;
+            }
+        }
+        g_free(t);
+    }
+    g_ptr_array_free(threads, true);
+
+    if (multifd_device_state_flush(f) < 0 && !ret) {
+        error_report("%s: failed to send the device state", __func__);
+        ret = -EIO;
+    }
+    if (ret) {
+        qemu_file_set_error(f, ret);
+    }
+    return ret;
+}
+
 static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
@@ -1366,6 +1738,8 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     int ret;
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        int64_t start;
+
         if (!se->ops ||
             (in_postcopy && se->ops->has_postcopy &&
              se->ops->has_postcopy(se->opaque)) ||
@@ -1379,16 +1753,23 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
             }
         }
         trace_savevm_section_start(se->idstr, se->section_id);
+        start = migration_latency_start();
 
         save_section_header(f, se, QEMU_VM_SECTION_END);
 
         ret = se->ops->save_live_complete_precopy(f, se->opaque);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
+        migration_latency_device_end(se->idstr, se->instance_id, true, start);
         save_section_footer(f, se);
         if (ret < 0) {
             qemu_file_set_error(f, ret);
             return -1;
         }
+
+        if (se->ops->save_live_complete_precopy_thread &&
+            qemu_savevm_device_state_active()) {
+            qemu_savevm_start_complete_precopy_thread(se);
+        }
     }
 
     return 0;
@@ -1408,6 +1789,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     json_writer_int64(vmdesc, "page_size", qemu_target_page_size());
     json_writer_start_array(vmdesc, "devices");
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        int64_t start;
 
         if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
             continue;
@@ -1418,6 +1800,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         }
 
         trace_savevm_section_start(se->idstr, se->section_id);
+        start = migration_latency_start();
 
         json_writer_start_object(vmdesc, NULL);
         json_writer_str(vmdesc, "name", se->idstr);
@@ -1430,6 +1813,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
             return ret;
         }
         trace_savevm_section_end(se->idstr, se->section_id, 0);
+        migration_latency_device_end(se->idstr, se->instance_id, false, start);
         save_section_footer(f, se);
 
         json_writer_end_object(vmdesc);
@@ -1482,7 +1866,7 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     if (!in_postcopy || iterable_only) {
         ret = qemu_savevm_state_complete_precopy_iterable(f, in_postcopy);
         if (ret) {
-            return ret;
+            goto fail;
         }
     }
 
@@ -1493,12 +1877,21 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     ret = qemu_savevm_state_complete_precopy_non_iterable(f, in_postcopy,
                                                           inactivate_disks);
     if (ret) {
-        return ret;
+        goto fail;
     }
 
 flush:
+    /* The device state threads ran alongside the non-iterable sections */
+    ret = qemu_savevm_join_complete_precopy_threads(f);
+    if (ret) {
+        return ret;
+    }
     qemu_fflush(f);
     return 0;
+
+fail:
+    qemu_savevm_join_complete_precopy_threads(f);
+    return ret;
 }
 
 /* Give an estimate of the amount left to be transferred,
@@ -2099,6 +2492,8 @@ static void migrate_send_rp_req_pages_pending(MigrationIncomingState *mis)
 
 static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
 {
+    int i;
+
     if (mis->state != MIGRATION_STATUS_POSTCOPY_RECOVER) {
         error_report("%s: illegal resume received", __func__);
         /* Don't fail the load, only for this. */
@@ -2137,12 +2532,14 @@ static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
     migrate_send_rp_req_pages_pending(mis);
 
     /*
-     * It's time to switch state and release the fault thread to continue
+     * It's time to switch state and release the fault threads to continue
      * service page faults.  Note that this should be explicitly after the
-     * above call to migrate_send_rp_req_pages_pending().  In short:
-     * migrate_send_rp_message_req_pages() is not thread safe, yet.
+     * above call to migrate_send_rp_req_pages_pending(), so that the pages
+     * requested before the recovery are sent first.
      */
-    qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    for (i = 0; i < mis->nr_fault_threads; i++) {
+        qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    }
 
     return 0;
 }
@@ -2381,8 +2778,156 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
     return true;
 }
 
+/*
+ * Pass the buffers of @se that are next in order to load_state_buffer.
+ * Only one thread loads at a time; the lock is dropped meanwhile so
+ * that the other channels can queue more buffers.
+ *
+ * Called with the lock of @se->load_buffers held.
+ */
+static int qemu_loadvm_load_state_buffers(SaveStateEntry *se, Error **errp)
+{
+    SaveStateBuffers *b = se->load_buffers;
+    SaveStateBuffer *sb;
+    int ret = 0;
+
+    if (b->loading) {
+        return 0;
+    }
+
+    b->loading = true;
+    while (b->ready && !b->done &&
+           (sb = g_hash_table_lookup(b->pending, &b->next_idx))) {
+        g_hash_table_steal(b->pending, &sb->idx);
+        b->next_idx++;
+
+        if (sb->len) {
+            qemu_mutex_unlock(&b->lock);
+            ret = se->ops->load_state_buffer(se->opaque, sb->buf, sb->len,
+                                             errp);
+            qemu_mutex_lock(&b->lock);
+        } else {
+            /* An empty buffer marks the end of the state */
+            b->done = true;
+        }
+        g_free(sb);
+
+        if (ret) {
+            b->ret = ret < 0 ? ret : -EINVAL;
+            b->done = true;
+        }
+    }
+    b->loading = false;
+    qemu_cond_broadcast(&b->cond);
+
+    return ret;
+}
+
+/*
+ * Called by the multifd receive threads.  The handlers list does not
+ * change while an incoming migration is running.
+ */
+int qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
+                                  uint64_t idx, char *buf, size_t len,
+                                  Error **errp)
+{
+    SaveStateEntry *se = find_se(idstr, instance_id);
+    SaveStateBuffers *b;
+    SaveStateBuffer *sb;
+
+    trace_loadvm_load_state_buffer(idstr, instance_id, idx, len);
+
+    if (!se || !se->load_buffers) {
+        error_setg(errp, "Unknown device state buffer for '%s' %"PRIu32,
+                   idstr, instance_id);
+        g_free(buf);
+        return -1;
+    }
+
+    b = se->load_buffers;
+    QEMU_LOCK_GUARD(&b->lock);
+    if (b->done || idx < b->next_idx ||
+        g_hash_table_contains(b->pending, &idx)) {
+        error_setg(errp, "Unexpected device state buffer %"PRIu64
+                   " for '%s' %"PRIu32, idx, idstr, instance_id);
+        g_free(buf);
+        return -1;
+    }
+
+    sb = g_new(SaveStateBuffer, 1);
+    sb->idx = idx;
+    sb->buf = buf;
+    sb->len = len;
+    g_hash_table_insert(b->pending, &sb->idx, sb);
+
+    return qemu_loadvm_load_state_buffers(se, errp) ? -1 : 0;
+}
+
+/*
+ * No more device state buffers will arrive: wake up the main thread
+ * if it waits for the state of a device that is not complete.
+ */
+void qemu_loadvm_abort_state_buffers(void)
+{
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        SaveStateBuffers *b = se->load_buffers;
+
+        if (!b) {
+            continue;
+        }
+        WITH_QEMU_LOCK_GUARD(&b->lock) {
+            if (!b->done) {
+                b->done = true;
+                b->ret = -EIO;
+                qemu_cond_broadcast(&b->cond);
+            }
+        }
+    }
+}
+
+/* Wait until all the device state of @se has been loaded */
+static int qemu_loadvm_wait_state_buffers(SaveStateEntry *se)
+{
+    SaveStateBuffers *b = se->load_buffers;
+    int ret;
+
+    if (!b || !b->ready) {
+        return 0;
+    }
+
+    trace_loadvm_wait_state_buffers(se->idstr, se->instance_id);
+    qemu_mutex_lock(&b->lock);
+    while (!b->done || b->loading) {
+        qemu_cond_wait(&b->cond, &b->lock);
+    }
+    ret = b->ret;
+    qemu_mutex_unlock(&b->lock);
+
+    if (ret) {
+        error_report("Failed to load the device state of '%s'", se->idstr);
+    }
+    return ret;
+}
+
+static int qemu_loadvm_wait_all_state_buffers(void)
+{
+    SaveStateEntry *se;
+    int ret;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        ret = qemu_loadvm_wait_state_buffers(se);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
 static int
-qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
+                               uint8_t section_type)
 {
     uint32_t instance_id, version_id, section_id;
     SaveStateEntry *se;
@@ -2433,6 +2978,14 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
         return -EINVAL;
     }
 
+    /* The device state sent on the multifd channels comes first */
+    if (section_type == QEMU_VM_SECTION_FULL) {
+        ret = qemu_loadvm_wait_state_buffers(se);
+        if (ret) {
+            return ret;
+        }
+    }
+
     ret = vmstate_load(f, se);
     if (ret < 0) {
         error_report("error while loading state for instance 0x%"PRIx32" of"
@@ -2545,6 +3098,21 @@ static int qemu_loadvm_state_setup(QEMUFile *f)
             error_report("Load state of device %s failed", se->idstr);
             return ret;
         }
+
+        if (se->load_buffers && multifd_device_state_load_active()) {
+            Error *local_err = NULL;
+
+            /* Load the buffers that may have arrived already */
+            WITH_QEMU_LOCK_GUARD(&se->load_buffers->lock) {
+                se->load_buffers->ready = true;
+                ret = qemu_loadvm_load_state_buffers(se, &local_err);
+            }
+            if (ret) {
+                qemu_file_set_error(f, -EINVAL);
+                error_report_err(local_err);
+                return -EINVAL;
+            }
+        }
     }
     return 0;
 }
@@ -2555,6 +3123,22 @@ void qemu_loadvm_state_cleanup(void)
 
     trace_loadvm_state_cleanup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        SaveStateBuffers *b = se->load_buffers;
+
+        if (b) {
+            /* Make sure that no receive thread is still loading */
+            WITH_QEMU_LOCK_GUARD(&b->lock) {
+                b->done = true;
+                while (b->loading) {
+                    qemu_cond_wait(&b->cond, &b->lock);
+                }
+                g_hash_table_remove_all(b->pending);
+                b->next_idx = 0;
+                b->ready = false;
+                b->done = false;
+                b->ret = 0;
+            }
+        }
         if (se->ops && se->ops->load_cleanup) {
             se->ops->load_cleanup(se->opaque);
         }
@@ -2625,7 +3209,7 @@ retry:
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
-            ret = qemu_loadvm_section_start_full(f, mis);
+            ret = qemu_loadvm_section_start_full(f, mis, section_type);
             if (ret < 0) {
                 goto out;
             }
@@ -2646,6 +3230,7 @@ retry:
             break;
         case QEMU_VM_EOF:
             /* This is the end of migration */
+            ret = qemu_loadvm_wait_all_state_buffers();
             goto out;
         default:
             error_report("Unknown savevm section type %d", section_type);
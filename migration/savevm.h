@@ -65,6 +65,10 @@ int qemu_loadvm_state(QEMUFile *f);
 void qemu_loadvm_state_cleanup(void);
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis);
 int qemu_load_device_state(QEMUFile *f);
+int qemu_loadvm_load_state_buffer(const char *idstr, uint32_t instance_id,
+                                  uint64_t idx, char *buf, size_t len,
+                                  Error **errp);
+void qemu_loadvm_abort_state_buffers(void);
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         bool in_postcopy, bool inactivate_disks);
 
@@ -57,6 +57,17 @@ migration_tls_get_creds(MigrationState *s,
 }
 
 
+/* Whether the kernel encrypts outgoing data of TLS migration channels */
+bool migration_tls_ktls_enabled(MigrationState *s)
+{
+    QCryptoTLSCreds *creds;
+
+    creds = migration_tls_get_creds(s, QCRYPTO_TLS_CREDS_ENDPOINT_CLIENT,
+                                    NULL);
+    return creds && object_property_get_bool(OBJECT(creds), "ktls", NULL);
+}
+
+
 static void migration_tls_incoming_handshake(QIOTask *task,
                                              gpointer opaque)
 {
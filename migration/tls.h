@@ -37,4 +37,6 @@ void migration_tls_channel_connect(MigrationState *s,
                                    QIOChannel *ioc,
                                    const char *hostname,
                                    Error **errp);
+
+bool migration_tls_ktls_enabled(MigrationState *s);
 #endif
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,17 +25,14 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
     long res;
     uint8_t *nzrun_start = NULL;
 
-    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
-               sizeof(long)));
-
     while (i < slen) {
         /* overflow */
         if (d + 2 > dlen) {
@@ -126,6 +124,299 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT) || \
+    defined(__aarch64__)
+/*
+ * Vectorized encoders: the data is compared a vector at a time, and the
+ * length of each run is found from the mask of equal bytes.  The encoding
+ * they produce is byte for byte the one of xbzrle_encode_buffer_int().
+ *
+ * A run length function returns the length of the longest prefix of
+ * @old_buf and @new_buf, at most @len bytes, where the bytes are all
+ * equal (@equal true) or all different (@equal false).
+ */
+typedef size_t XbzrleRunLenFn(const uint8_t *old_buf, const uint8_t *new_buf,
+                              size_t len, bool equal);
+
+static size_t xbzrle_run_len_tail(const uint8_t *old_buf,
+                                  const uint8_t *new_buf,
+                                  size_t i, size_t len, bool equal)
+{
+    while (i < len && (old_buf[i] == new_buf[i]) == equal) {
+        i++;
+    }
+    return i;
+}
+
+static inline int xbzrle_encode_buffer_accel(uint8_t *old_buf,
+                                             uint8_t *new_buf, int slen,
+                                             uint8_t *dst, int dlen,
+                                             XbzrleRunLenFn *run_len)
+{
+    uint32_t zrun_len, nzrun_len;
+    int d = 0, i = 0;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        zrun_len = run_len(old_buf + i, new_buf + i, slen - i, true);
+        i += zrun_len;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        nzrun_len = run_len(old_buf + i, new_buf + i, slen - i, false);
+        d += uleb128_encode_small(dst + d, nzrun_len);
+
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i += nzrun_len;
+    }
+
+    return d;
+}
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static size_t xbzrle_run_len_avx2(const uint8_t *old_buf,
+                                  const uint8_t *new_buf,
+                                  size_t len, bool equal)
+{
+    uint32_t end = equal ? -1 : 0;
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(old_buf + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(new_buf + i));
+        /* One bit per byte that ends the run */
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)) ^ end;
+
+        if (mask) {
+            return i + ctz32(mask);
+        }
+    }
+    return xbzrle_run_len_tail(old_buf, new_buf, i, len, equal);
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_accel(old_buf, new_buf, slen, dst, dlen,
+                                      xbzrle_run_len_avx2);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512BW_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512bw")
+#include <immintrin.h>
+
+static size_t xbzrle_run_len_avx512(const uint8_t *old_buf,
+                                    const uint8_t *new_buf,
+                                    size_t len, bool equal)
+{
+    uint64_t end = equal ? -1 : 0;
+    size_t i;
+
+    for (i = 0; i + 64 <= len; i += 64) {
+        __m512i a = _mm512_loadu_si512(old_buf + i);
+        __m512i b = _mm512_loadu_si512(new_buf + i);
+        /* One bit per byte that ends the run */
+        uint64_t mask = _mm512_cmpeq_epi8_mask(a, b) ^ end;
+
+        if (mask) {
+            return i + ctz64(mask);
+        }
+    }
+    return xbzrle_run_len_tail(old_buf, new_buf, i, len, equal);
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_accel(old_buf, new_buf, slen, dst, dlen,
+                                      xbzrle_run_len_avx512);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512BW_OPT */
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+static size_t xbzrle_run_len_neon(const uint8_t *old_buf,
+                                  const uint8_t *new_buf,
+                                  size_t len, bool equal)
+{
+    uint64_t end = equal ? -1 : 0;
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf + i), vld1q_u8(new_buf + i));
+        /*
+         * Narrow the 0x00/0xff bytes to one nibble per byte, there is no
+         * movemask on NEON.
+         */
+        uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) ^ end;
+
+        if (mask) {
+            return i + ctz64(mask) / 4;
+        }
+    }
+    return xbzrle_run_len_tail(old_buf, new_buf, i, len, equal);
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_accel(old_buf, new_buf, slen, dst, dlen,
+                                      xbzrle_run_len_neon);
+}
+#endif /* __aarch64__ */
+
+typedef int XbzrleEncodeFn(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                           uint8_t *dst, int dlen);
+
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT)
+/*
+ * Note that for xbzrle_test_next_accel, the most preferred ISA must have
+ * the least significant bit.
+ */
+#define CACHE_AVX512BW 1
+#define CACHE_AVX2     2
+
+static unsigned cpuid_cache;
+static XbzrleEncodeFn *xbzrle_encode_accel = xbzrle_encode_buffer_int;
+static const char *xbzrle_encode_accel_name = "int";
+
+static void init_accel(unsigned cache)
+{
+    XbzrleEncodeFn *fn = xbzrle_encode_buffer_int;
+    const char *name = "int";
+
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = xbzrle_encode_buffer_avx2;
+        name = "avx2";
+    }
+#endif
+#ifdef CONFIG_AVX512BW_OPT
+    if (cache & CACHE_AVX512BW) {
+        fn = xbzrle_encode_buffer_avx512;
+        name = "avx512bw";
+    }
+#endif
+    xbzrle_encode_accel = fn;
+    xbzrle_encode_accel_name = name;
+}
+
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+            /* See util/bufferiszero.c for the XCR0 bits of AVX-512 */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512BW)) {
+                cache |= CACHE_AVX512BW;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+
+bool xbzrle_test_next_accel(void)
+{
+    /*
+     * If no bits set, we just tested xbzrle_encode_buffer_int, and there
+     * are no more acceleration options to test.
+     */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+#elif defined(__aarch64__)
+/* NEON is part of the base ISA, only the integer fallback is left to test */
+static XbzrleEncodeFn *xbzrle_encode_accel = xbzrle_encode_buffer_neon;
+static const char *xbzrle_encode_accel_name = "neon";
+
+bool xbzrle_test_next_accel(void)
+{
+    if (xbzrle_encode_accel == xbzrle_encode_buffer_int) {
+        return false;
+    }
+    xbzrle_encode_accel = xbzrle_encode_buffer_int;
+    xbzrle_encode_accel_name = "int";
+    return true;
+}
+#else
+#define xbzrle_encode_accel      xbzrle_encode_buffer_int
+#define xbzrle_encode_accel_name "int"
+
+bool xbzrle_test_next_accel(void)
+{
+    return false;
+}
+#endif
+
+const char *xbzrle_accel_name(void)
+{
+    return xbzrle_encode_accel_name;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
+               sizeof(long)));
+
+    return xbzrle_encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
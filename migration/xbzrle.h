@@ -18,4 +18,13 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
+
+/*
+ * Switch xbzrle_encode_buffer() to the next slower implementation
+ * supported by the host, returns false when the portable one was already
+ * in use.  For tests and benchmarks only.
+ */
+bool xbzrle_test_next_accel(void);
+/* Name of the implementation used by xbzrle_encode_buffer() */
+const char *xbzrle_accel_name(void);
 #endif
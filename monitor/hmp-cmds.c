@@ -216,6 +216,24 @@ static char *SocketAddress_to_str(SocketAddress *addr)
     }
 }
 
+static void hmp_info_migrate_latency(Monitor *mon, const char *name,
+                                     MigrationLatencyHistogram *h)
+{
+    Visitor *v;
+    char *str;
+
+    monitor_printf(mon, "%s latency: %" PRIu64 " samples, avg %" PRIu64
+                   " ns, max %" PRIu64 " ns\n", name, h->count,
+                   h->count ? h->total / h->count : 0, h->max);
+
+    v = string_output_visitor_new(false, &str);
+    visit_type_uint64List(v, NULL, &h->buckets, &error_abort);
+    visit_complete(v, &str);
+    monitor_printf(mon, "%s latency buckets: %s\n", name, str);
+    g_free(str);
+    visit_free(v);
+}
+
 void hmp_info_migrate(Monitor *mon, const QDict *qdict)
 {
     MigrationInfo *info;
@@ -284,6 +302,14 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->multifd_bytes >> 10);
         monitor_printf(mon, "pages-per-second: %" PRIu64 "\n",
                        info->ram->pages_per_second);
+        if (info->ram->zero_copy_bytes) {
+            monitor_printf(mon, "zero-copy bytes: %" PRIu64 " kbytes\n",
+                           info->ram->zero_copy_bytes >> 10);
+        }
+        if (info->ram->dirty_sync_missed_zero_copy) {
+            monitor_printf(mon, "zero-copy-send fallbacks: %" PRIu64 "\n",
+                           info->ram->dirty_sync_missed_zero_copy);
+        }
 
         if (info->ram->dirty_pages_rate) {
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
@@ -373,6 +399,25 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->vfio->transferred >> 10);
     }
 
+    if (info->has_latency) {
+        MigrationDeviceLatencyList *dev;
+
+        hmp_info_migrate_latency(mon, "bitmap sync",
+                                 info->latency->bitmap_sync);
+        hmp_info_migrate_latency(mon, "find dirty block",
+                                 info->latency->find_dirty_block);
+        hmp_info_migrate_latency(mon, "multifd send prepare",
+                                 info->latency->multifd_send_prepare);
+        hmp_info_migrate_latency(mon, "multifd send write",
+                                 info->latency->multifd_send_write);
+        for (dev = info->latency->stop_and_copy; dev; dev = dev->next) {
+            monitor_printf(mon, "stop and copy %s/%u%s: %" PRIu64 " us\n",
+                           dev->value->idstr, dev->value->instance_id,
+                           dev->value->iterable ? " (iterable)" : "",
+                           dev->value->time / SCALE_US);
+        }
+    }
+
     qapi_free_MigrationInfo(info);
 }
 
@@ -487,6 +532,21 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_AUTHZ),
             params->tls_authz);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_ZERO_PAGE),
+            params->multifd_zero_page ? "on" : "off");
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS),
+            params->postcopy_fault_threads);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRECT_IO),
+            params->direct_io ? "on" : "off");
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_CPU_THROTTLE_PREDICTIVE),
+            params->cpu_throttle_predictive ? "on" : "off");
 
         if (params->has_block_bitmap_mapping) {
             const BitmapMigrationNodeAliasList *bmnal;
@@ -1328,6 +1388,26 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_announce_step = true;
         visit_type_size(v, param, &p->announce_step, &err);
         break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_uint8(v, param, &p->dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_MULTIFD_ZERO_PAGE:
+        p->has_multifd_zero_page = true;
+        visit_type_bool(v, param, &p->multifd_zero_page, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS:
+        p->has_postcopy_fault_threads = true;
+        visit_type_uint8(v, param, &p->postcopy_fault_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRECT_IO:
+        p->has_direct_io = true;
+        visit_type_bool(v, param, &p->direct_io, &err);
+        break;
+    case MIGRATION_PARAMETER_CPU_THROTTLE_PREDICTIVE:
+        p->has_cpu_throttle_predictive = true;
+        visit_type_bool(v, param, &p->cpu_throttle_predictive, &err);
+        break;
     case MIGRATION_PARAMETER_BLOCK_BITMAP_MAPPING:
         error_setg(&err, "The block-bitmap-mapping parameter can only be set "
                    "through QMP");
@@ -185,7 +185,8 @@ static void hmp_trace_event(Monitor *mon, const QDict *qdict)
         return;
     }
 
-    qmp_trace_event_set_state(tp_name, new_state, true, true, has_vcpu, vcpu, &local_err);
+    qmp_trace_event_set_state(tp_name, new_state, true, true, has_vcpu, vcpu,
+                              false, 0, false, false, &local_err);
     if (local_err) {
         error_report_err(local_err);
     }
@@ -378,9 +379,13 @@ static void hmp_info_trace_events(Monitor *mon, const QDict *qdict)
     }
 
     for (elem = events; elem != NULL; elem = elem->next) {
-        monitor_printf(mon, "%s : state %u\n",
+        monitor_printf(mon, "%s : state %u",
                        elem->value->name,
                        elem->value->state == TRACE_EVENT_STATE_ENABLED ? 1 : 0);
+        if (elem->value->has_count) {
+            monitor_printf(mon, " count %" PRIu64, elem->value->count);
+        }
+        monitor_printf(mon, "\n");
     }
     qapi_free_TraceEventInfoList(events);
 }
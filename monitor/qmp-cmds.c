@@ -17,6 +17,9 @@
 #include "qemu-common.h"
 #include "qemu/cutils.h"
 #include "qemu/option.h"
+#include "qemu/coroutine-prof.h"
+#include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
 #include "qemu/config-file.h"
@@ -29,6 +32,7 @@
 #include "sysemu/runstate.h"
 #include "sysemu/runstate-action.h"
 #include "sysemu/blockdev.h"
+#include "sysemu/iothread.h"
 #include "sysemu/block-backend.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-acpi.h"
@@ -439,6 +443,97 @@ static int qmp_x_query_irq_foreach(Object *obj, void *opaque)
     return 0;
 }
 
+HumanReadableText *qmp_x_query_rcu(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    RCUStats stats;
+
+    rcu_get_stats(&stats);
+    g_string_append_printf(buf, "grace periods: %" PRIu64
+                           " (%" PRIu64 " expedited)\n",
+                           stats.grace_periods, stats.expedited_grace_periods);
+    if (stats.grace_periods) {
+        g_string_append_printf(buf, "grace period latency: avg %" PRIu64
+                               " us, max %" PRIu64 " us\n",
+                               stats.grace_period_total_ns /
+                               stats.grace_periods / SCALE_US,
+                               stats.grace_period_max_ns / SCALE_US);
+    }
+    g_string_append_printf(buf, "callbacks: %" PRIu64 ", largest batch %"
+                           PRIu64 "\n", stats.callbacks,
+                           stats.callback_batch_max);
+
+    return human_readable_text_from_str(buf);
+}
+
+SyncProfileEntryList *qmp_x_query_sync_profile(bool has_max, uint32_t max,
+                                               bool has_sort_by_average,
+                                               bool sort_by_average,
+                                               bool has_coalesce,
+                                               bool coalesce, Error **errp)
+{
+    return qsp_query(has_max ? max : 10,
+                     sort_by_average ? QSP_SORT_BY_AVG_WAIT_TIME :
+                     QSP_SORT_BY_TOTAL_WAIT_TIME,
+                     has_coalesce ? coalesce : true);
+}
+
+void qmp_x_sync_profile(bool has_enable, bool enable, bool has_reset,
+                        bool reset, Error **errp)
+{
+    if (has_enable) {
+        if (enable) {
+            qsp_enable();
+        } else {
+            qsp_disable();
+        }
+    }
+    if (reset) {
+        qsp_reset();
+    }
+}
+
+void qmp_x_coroutine_profile(bool enable, bool has_interval,
+                             uint32_t interval, Error **errp)
+{
+    if (enable) {
+        coroutine_prof_start(has_interval ? interval : 1000);
+    } else {
+        coroutine_prof_stop();
+    }
+}
+
+static char *coroutine_prof_ctx_name(AioContext *ctx)
+{
+    IOThreadInfoList *list = qmp_query_iothreads(NULL);
+    IOThreadInfoList *info;
+    char *name = NULL;
+
+    if (ctx == qemu_get_aio_context()) {
+        return g_strdup("main-loop");
+    }
+    for (info = list; info; info = info->next) {
+        IOThread *iothread = iothread_by_id(info->value->id);
+
+        if (iothread && iothread_get_aio_context(iothread) == ctx) {
+            name = g_strdup(info->value->id);
+            break;
+        }
+    }
+    qapi_free_IOThreadInfoList(list);
+
+    return name ?: g_strdup_printf("ctx-%p", ctx);
+}
+
+HumanReadableText *qmp_x_query_coroutine_profile(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    coroutine_prof_dump(buf, coroutine_prof_ctx_name);
+
+    return human_readable_text_from_str(buf);
+}
+
 HumanReadableText *qmp_x_query_irq(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
@@ -131,6 +131,8 @@ struct NBDClient {
 
     CoMutex send_lock;
     Coroutine *send_coroutine;
+    int send_waiters;   /* Coroutines waiting for send_lock */
+    bool corked;
 
     bool read_yielding;
     bool quiescing;
@@ -1852,17 +1854,37 @@ const BlockExportDriver blk_exp_nbd = {
     .request_shutdown   = nbd_export_request_shutdown,
 };
 
+/*
+ * Keep the channel corked while other replies are ready to be sent, so that
+ * replies to pipelined requests are batched into as few packets as possible
+ * instead of one (or more) per reply.  Nothing waits for requests that are
+ * still being processed, so this does not add latency.
+ */
+static void nbd_client_update_cork(NBDClient *client)
+{
+    bool cork = client->send_waiters > 0;
+
+    if (cork != client->corked) {
+        client->corked = cork;
+        qio_channel_set_cork(client->ioc, cork);
+    }
+}
+
 static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
                                         unsigned niov, Error **errp)
 {
     int ret;
 
     g_assert(qemu_in_coroutine());
+    client->send_waiters++;
     qemu_co_mutex_lock(&client->send_lock);
+    client->send_waiters--;
     client->send_coroutine = qemu_coroutine_self();
+    nbd_client_update_cork(client);
 
     ret = qio_channel_writev_all(client->ioc, iov, niov, errp) < 0 ? -EIO : 0;
 
+    nbd_client_update_cork(client);
     client->send_coroutine = NULL;
     qemu_co_mutex_unlock(&client->send_lock);
 
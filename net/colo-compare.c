@@ -15,6 +15,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/error-report.h"
+#include "qemu/units.h"
 #include "trace.h"
 #include "qapi/error.h"
 #include "net/net.h"
@@ -47,6 +48,8 @@ static NotifierList colo_compare_notifiers =
     NOTIFIER_LIST_INITIALIZER(colo_compare_notifiers);
 
 #define COMPARE_READ_LEN_MAX NET_BUFSIZE
+/* Queued packets are written out in batches of about this many bytes */
+#define COMPARE_SEND_BATCH_MAX (256 * KiB)
 #define MAX_QUEUE_SIZE 1024
 
 #define COLO_COMPARE_FREE_PRIMARY     0x01
@@ -728,50 +731,39 @@ static void coroutine_fn _compare_chr_send(void *opaque)
 {
     SendCo *sendco = opaque;
     CompareState *s = sendco->s;
+    /*
+     * We send vnet header len make other module(like filter-redirector)
+     * know how to parse net packet correctly.
+     */
+    bool vnet_hdr = !sendco->notify_remote_frame && s->vnet_hdr;
+    g_autoptr(GByteArray) frames = g_byte_array_new();
     int ret = 0;
 
+    /*
+     * Frame all packets queued so far and write them at once instead of
+     * issuing three writes per packet.  More packets may be queued while
+     * the coroutine waits for the chardev.
+     */
     while (!g_queue_is_empty(&sendco->send_list)) {
-        SendEntry *entry = g_queue_pop_tail(&sendco->send_list);
-        uint32_t len = htonl(entry->size);
-
-        ret = qemu_chr_fe_write_all(sendco->chr, (uint8_t *)&len, sizeof(len));
-
-        if (ret != sizeof(len)) {
+        g_byte_array_set_size(frames, 0);
+        while (!g_queue_is_empty(&sendco->send_list) &&
+               frames->len < COMPARE_SEND_BATCH_MAX) {
+            SendEntry *entry = g_queue_pop_tail(&sendco->send_list);
+            struct iovec iov = {
+                .iov_base = entry->buf,
+                .iov_len = entry->size,
+            };
+
+            net_rstate_frame_append(frames, vnet_hdr, entry->vnet_hdr_len,
+                                    &iov, 1);
             g_free(entry->buf);
             g_slice_free(SendEntry, entry);
-            goto err;
         }
 
-        if (!sendco->notify_remote_frame && s->vnet_hdr) {
-            /*
-             * We send vnet header len make other module(like filter-redirector)
-             * know how to parse net packet correctly.
-             */
-            len = htonl(entry->vnet_hdr_len);
-
-            ret = qemu_chr_fe_write_all(sendco->chr,
-                                        (uint8_t *)&len,
-                                        sizeof(len));
-
-            if (ret != sizeof(len)) {
-                g_free(entry->buf);
-                g_slice_free(SendEntry, entry);
-                goto err;
-            }
-        }
-
-        ret = qemu_chr_fe_write_all(sendco->chr,
-                                    (uint8_t *)entry->buf,
-                                    entry->size);
-
-        if (ret != entry->size) {
-            g_free(entry->buf);
-            g_slice_free(SendEntry, entry);
+        ret = qemu_chr_fe_write_all(sendco->chr, frames->data, frames->len);
+        if (ret != frames->len) {
             goto err;
         }
-
-        g_free(entry->buf);
-        g_slice_free(SendEntry, entry);
     }
 
     sendco->ret = 0;
@@ -0,0 +1,465 @@
+/*
+ * Generic receive offload for netdevs with vnet headers
+ *
+ * Backends such as tap pass frames up one at a time unless the host kernel
+ * already coalesced them.  This filter merges in-order TCP/IPv4 segments of
+ * the same connection that the netdev sends towards the guest into one large
+ * packet, which it hands on with a TCPV4 GSO vnet header.  The guest stack
+ * then processes one packet instead of dozens.
+ *
+ * Merging only happens while the netdev uses vnet headers and the guest has
+ * enabled checksum and TSO4 offloads (i.e. while it accepts GSO packets);
+ * everything else passes through unmodified.  Segments are held for at most
+ * @timeout microseconds.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/filter.h"
+#include "net/net.h"
+#include "net/eth.h"
+#include "net/checksum.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu/bswap.h"
+#include "qemu/iov.h"
+#include "qemu/timer.h"
+#include "qom/object.h"
+#include "standard-headers/linux/virtio_net.h"
+#include "trace.h"
+
+#define TYPE_FILTER_GRO "filter-gro"
+
+OBJECT_DECLARE_SIMPLE_TYPE(FilterGROState, FILTER_GRO)
+
+/* Number of connections that can be merged at the same time */
+#define FILTER_GRO_FLOWS            8
+#define FILTER_GRO_DEFAULT_TIMEOUT  50
+/* Maximum length of a merged IPv4 packet */
+#define FILTER_GRO_MAX_LEN          0xffff
+
+/* vnet header, Ethernet, IPv4 without options and TCP with options */
+#define FILTER_GRO_HDR_MAX \
+    (sizeof(struct virtio_net_hdr_v1_hash) + sizeof(struct eth_header) + \
+     sizeof(struct ip_header) + 60)
+
+#define FILTER_GRO_TCP_FLAG_PSH     0x08
+
+typedef struct FilterGROPacket {
+    uint8_t hdr[FILTER_GRO_HDR_MAX];
+    size_t l3_off;              /* all offsets include the vnet header */
+    size_t l4_off;
+    size_t data_off;
+    size_t data_len;
+    uint32_t seq;
+    uint8_t tcp_flags;
+} FilterGROPacket;
+
+typedef struct FilterGROFlow {
+    NetClientState *sender;
+    unsigned flags;
+    uint8_t *buf;
+    size_t len;
+    size_t l3_off;
+    size_t l4_off;
+    size_t data_off;
+    uint32_t next_seq;
+    uint16_t mss;
+    unsigned segs;
+} FilterGROFlow;
+
+struct FilterGROState {
+    NetFilterState parent_obj;
+
+    uint32_t timeout;
+    QEMUTimer flush_timer;
+    unsigned next_evict;
+    FilterGROFlow flows[FILTER_GRO_FLOWS];
+};
+
+static bool filter_gro_enabled(NetFilterState *nf)
+{
+    NetClientState *nc = nf->netdev;
+
+    return nc->vnet_hdr_len >= sizeof(struct virtio_net_hdr) &&
+           nc->offload_csum && nc->offload_tso4;
+}
+
+static uint16_t filter_gro_vnet16(NetFilterState *nf, uint16_t val)
+{
+    return nf->netdev->vnet_hdr_swap ? bswap16(val) : val;
+}
+
+static void filter_gro_flush_flow(NetFilterState *nf, FilterGROFlow *flow)
+{
+    struct iovec iov;
+
+    if (!flow->segs) {
+        return;
+    }
+
+    if (flow->segs > 1) {
+        struct virtio_net_hdr *vhdr = (struct virtio_net_hdr *)flow->buf;
+        struct ip_header *ip = (struct ip_header *)(flow->buf + flow->l3_off);
+        tcp_header *tcp = (tcp_header *)(flow->buf + flow->l4_off);
+        size_t ip_len = flow->len - flow->l3_off;
+        size_t l4_off = flow->l4_off - nf->netdev->vnet_hdr_len;
+        uint32_t csum;
+
+        ip->ip_len = cpu_to_be16(ip_len);
+        ip->ip_sum = 0;
+        ip->ip_sum = cpu_to_be16(net_raw_checksum((uint8_t *)ip,
+                                                  flow->l4_off -
+                                                  flow->l3_off));
+
+        /* The guest only checks the pseudo header sum of partial packets */
+        csum = net_checksum_add(8, (uint8_t *)&ip->ip_src);
+        csum += IP_PROTO_TCP + (flow->len - flow->l4_off);
+        tcp->th_sum = cpu_to_be16((uint16_t)~net_checksum_finish(csum));
+
+        vhdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        vhdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        vhdr->hdr_len = filter_gro_vnet16(nf, flow->data_off -
+                                          nf->netdev->vnet_hdr_len);
+        vhdr->gso_size = filter_gro_vnet16(nf, flow->mss);
+        vhdr->csum_start = filter_gro_vnet16(nf, l4_off);
+        vhdr->csum_offset = filter_gro_vnet16(nf,
+                                              offsetof(tcp_header, th_sum));
+    }
+
+    trace_filter_gro_flush(nf, flow->segs, flow->len);
+
+    iov.iov_base = flow->buf;
+    iov.iov_len = flow->len;
+    flow->segs = 0;
+    qemu_netfilter_pass_to_next(flow->sender, flow->flags, &iov, 1, nf);
+}
+
+static void filter_gro_flush(NetFilterState *nf)
+{
+    FilterGROState *s = FILTER_GRO(nf);
+    int i;
+
+    for (i = 0; i < FILTER_GRO_FLOWS; i++) {
+        filter_gro_flush_flow(nf, &s->flows[i]);
+    }
+}
+
+static void filter_gro_flush_timer(void *opaque)
+{
+    filter_gro_flush(opaque);
+}
+
+/*
+ * Parses the headers of a TCP/IPv4 segment that carries data.  Returns
+ * false for anything that cannot be merged; @pkt->tcp_flags is non-zero if
+ * the packet is still a TCP segment, which must not overtake held segments
+ * of its connection.
+ */
+static bool filter_gro_parse(NetFilterState *nf, const struct iovec *iov,
+                             int iovcnt, FilterGROPacket *pkt)
+{
+    size_t vnet_hdr_len = nf->netdev->vnet_hdr_len;
+    size_t size = iov_size(iov, iovcnt);
+    size_t hdr_size, ip_len, tcp_len;
+    struct virtio_net_hdr *vhdr;
+    struct eth_header *eth;
+    struct ip_header *ip;
+    tcp_header *tcp;
+    uint32_t csum;
+
+    pkt->tcp_flags = 0;
+    hdr_size = iov_to_buf(iov, iovcnt, 0, pkt->hdr, sizeof(pkt->hdr));
+
+    pkt->l3_off = vnet_hdr_len + sizeof(struct eth_header);
+    pkt->l4_off = pkt->l3_off + sizeof(struct ip_header);
+    if (hdr_size < pkt->l4_off + sizeof(tcp_header)) {
+        return false;
+    }
+
+    vhdr = (struct virtio_net_hdr *)pkt->hdr;
+    eth = (struct eth_header *)(pkt->hdr + vnet_hdr_len);
+    ip = (struct ip_header *)(pkt->hdr + pkt->l3_off);
+    tcp = (tcp_header *)(pkt->hdr + pkt->l4_off);
+
+    if (be16_to_cpu(eth->h_proto) != ETH_P_IP ||
+        ip->ip_ver_len != 0x45 || ip->ip_p != IP_PROTO_TCP ||
+        IP4_IS_FRAGMENT(ip)) {
+        return false;
+    }
+
+    ip_len = be16_to_cpu(ip->ip_len);
+    tcp_len = TCP_HEADER_DATA_OFFSET(tcp);
+    pkt->data_off = pkt->l4_off + tcp_len;
+    if (tcp_len < sizeof(tcp_header) || pkt->data_off > hdr_size ||
+        pkt->l3_off + ip_len > size ||
+        pkt->data_off > pkt->l3_off + ip_len) {
+        return false;
+    }
+
+    pkt->tcp_flags = TCP_HEADER_FLAGS(tcp);
+    pkt->seq = be32_to_cpu(tcp->th_seq);
+    pkt->data_len = pkt->l3_off + ip_len - pkt->data_off;
+
+    if (vhdr->gso_type != VIRTIO_NET_HDR_GSO_NONE || !pkt->data_len ||
+        (pkt->tcp_flags & ~FILTER_GRO_TCP_FLAG_PSH) != TCP_FLAG_ACK) {
+        return false;
+    }
+
+    /* Merged packets are marked as checksummed, so verify them first */
+    if (!(vhdr->flags & (VIRTIO_NET_HDR_F_NEEDS_CSUM |
+                         VIRTIO_NET_HDR_F_DATA_VALID))) {
+        if (net_raw_checksum((uint8_t *)ip, sizeof(*ip))) {
+            return false;
+        }
+        csum = net_checksum_add(8, (uint8_t *)&ip->ip_src);
+        csum += IP_PROTO_TCP + (ip_len - sizeof(*ip));
+        csum += net_checksum_add_iov(iov, iovcnt, pkt->l4_off,
+                                     ip_len - sizeof(*ip), 0);
+        if (net_checksum_finish(csum)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool filter_gro_same_flow(FilterGROFlow *flow, FilterGROPacket *pkt)
+{
+    struct ip_header *ip = (struct ip_header *)(flow->buf + flow->l3_off);
+    struct ip_header *pip = (struct ip_header *)(pkt->hdr + pkt->l3_off);
+    tcp_header *tcp = (tcp_header *)(flow->buf + flow->l4_off);
+    tcp_header *ptcp = (tcp_header *)(pkt->hdr + pkt->l4_off);
+
+    return flow->segs &&
+           ip->ip_src == pip->ip_src && ip->ip_dst == pip->ip_dst &&
+           tcp->th_sport == ptcp->th_sport && tcp->th_dport == ptcp->th_dport;
+}
+
+static bool filter_gro_can_merge(FilterGROFlow *flow, FilterGROPacket *pkt)
+{
+    struct ip_header *ip = (struct ip_header *)(flow->buf + flow->l3_off);
+    struct ip_header *pip = (struct ip_header *)(pkt->hdr + pkt->l3_off);
+    tcp_header *tcp = (tcp_header *)(flow->buf + flow->l4_off);
+    tcp_header *ptcp = (tcp_header *)(pkt->hdr + pkt->l4_off);
+    size_t tcp_len = flow->data_off - flow->l4_off;
+
+    /* Only the window may change, the options must be identical */
+    return pkt->seq == flow->next_seq &&
+           pkt->data_len <= flow->mss &&
+           pkt->data_off - pkt->l4_off == tcp_len &&
+           flow->len - flow->l3_off + pkt->data_len <= FILTER_GRO_MAX_LEN &&
+           ip->ip_tos == pip->ip_tos && ip->ip_ttl == pip->ip_ttl &&
+           (ip->ip_off & cpu_to_be16(IP_DF)) ==
+           (pip->ip_off & cpu_to_be16(IP_DF)) &&
+           tcp->th_ack == ptcp->th_ack &&
+           !memcmp(tcp + 1, ptcp + 1, tcp_len - sizeof(tcp_header));
+}
+
+static void filter_gro_start_flow(FilterGROState *s, FilterGROFlow *flow,
+                                  NetClientState *sender, unsigned flags,
+                                  const struct iovec *iov, int iovcnt,
+                                  FilterGROPacket *pkt)
+{
+    if (!flow->buf) {
+        flow->buf = g_malloc(sizeof(pkt->hdr) + FILTER_GRO_MAX_LEN);
+    }
+
+    flow->sender = sender;
+    flow->flags = flags;
+    flow->l3_off = pkt->l3_off;
+    flow->l4_off = pkt->l4_off;
+    flow->data_off = pkt->data_off;
+    flow->len = iov_to_buf(iov, iovcnt, 0, flow->buf,
+                           pkt->data_off + pkt->data_len);
+    flow->next_seq = pkt->seq + pkt->data_len;
+    flow->mss = pkt->data_len;
+    flow->segs = 1;
+
+    if (!timer_pending(&s->flush_timer)) {
+        timer_mod(&s->flush_timer,
+                  qemu_clock_get_us(QEMU_CLOCK_VIRTUAL) + s->timeout);
+    }
+}
+
+static void filter_gro_merge(FilterGROFlow *flow, const struct iovec *iov,
+                             int iovcnt, FilterGROPacket *pkt)
+{
+    tcp_header *tcp = (tcp_header *)(flow->buf + flow->l4_off);
+    tcp_header *ptcp = (tcp_header *)(pkt->hdr + pkt->l4_off);
+
+    flow->len += iov_to_buf(iov, iovcnt, pkt->data_off, flow->buf + flow->len,
+                            pkt->data_len);
+    flow->next_seq += pkt->data_len;
+    flow->segs++;
+
+    tcp->th_win = ptcp->th_win;
+    tcp->th_offset_flags |= ptcp->th_offset_flags;
+}
+
+/* filter APIs */
+static ssize_t filter_gro_receive_iov(NetFilterState *nf,
+                                      NetClientState *sender,
+                                      unsigned flags,
+                                      const struct iovec *iov,
+                                      int iovcnt,
+                                      NetPacketSent *sent_cb)
+{
+    FilterGROState *s = FILTER_GRO(nf);
+    FilterGROFlow *flow = NULL, *free_flow = NULL;
+    FilterGROPacket pkt;
+    bool mergeable;
+    int i;
+
+    /* Only packets towards the guest are merged */
+    if (sender != nf->netdev) {
+        return 0;
+    }
+
+    if (!filter_gro_enabled(nf)) {
+        filter_gro_flush(nf);
+        return 0;
+    }
+
+    mergeable = filter_gro_parse(nf, iov, iovcnt, &pkt);
+    if (!pkt.tcp_flags) {
+        return 0;
+    }
+
+    for (i = 0; i < FILTER_GRO_FLOWS; i++) {
+        if (filter_gro_same_flow(&s->flows[i], &pkt)) {
+            flow = &s->flows[i];
+            break;
+        }
+        if (!free_flow && !s->flows[i].segs) {
+            free_flow = &s->flows[i];
+        }
+    }
+
+    if (flow && mergeable && filter_gro_can_merge(flow, &pkt)) {
+        filter_gro_merge(flow, iov, iovcnt, &pkt);
+        if (pkt.data_len < flow->mss ||
+            (pkt.tcp_flags & FILTER_GRO_TCP_FLAG_PSH) ||
+            flow->len - flow->l3_off + flow->mss > FILTER_GRO_MAX_LEN) {
+            filter_gro_flush_flow(nf, flow);
+        }
+        return iov_size(iov, iovcnt);
+    }
+
+    /* Keep the segments of a connection in order */
+    if (flow) {
+        filter_gro_flush_flow(nf, flow);
+        free_flow = flow;
+    }
+
+    if (!mergeable || (pkt.tcp_flags & FILTER_GRO_TCP_FLAG_PSH)) {
+        return 0;
+    }
+
+    if (!free_flow) {
+        free_flow = &s->flows[s->next_evict];
+        s->next_evict = (s->next_evict + 1) % FILTER_GRO_FLOWS;
+        filter_gro_flush_flow(nf, free_flow);
+    }
+
+    filter_gro_start_flow(s, free_flow, sender, flags, iov, iovcnt, &pkt);
+    return iov_size(iov, iovcnt);
+}
+
+static void filter_gro_cleanup(NetFilterState *nf)
+{
+    FilterGROState *s = FILTER_GRO(nf);
+    int i;
+
+    timer_del(&s->flush_timer);
+    filter_gro_flush(nf);
+
+    for (i = 0; i < FILTER_GRO_FLOWS; i++) {
+        g_free(s->flows[i].buf);
+        s->flows[i].buf = NULL;
+    }
+}
+
+static void filter_gro_setup(NetFilterState *nf, Error **errp)
+{
+    FilterGROState *s = FILTER_GRO(nf);
+
+    timer_init_us(&s->flush_timer, QEMU_CLOCK_VIRTUAL,
+                  filter_gro_flush_timer, nf);
+}
+
+static void filter_gro_status_changed(NetFilterState *nf, Error **errp)
+{
+    FilterGROState *s = FILTER_GRO(nf);
+
+    if (!nf->on) {
+        timer_del(&s->flush_timer);
+        filter_gro_flush(nf);
+    }
+}
+
+static void filter_gro_get_timeout(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    FilterGROState *s = FILTER_GRO(obj);
+    uint32_t value = s->timeout;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void filter_gro_set_timeout(Object *obj, Visitor *v,
+                                   const char *name, void *opaque,
+                                   Error **errp)
+{
+    FilterGROState *s = FILTER_GRO(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!value) {
+        error_setg(errp, "Property '%s.%s' requires a positive value",
+                   object_get_typename(obj), name);
+        return;
+    }
+    s->timeout = value;
+}
+
+static void filter_gro_class_init(ObjectClass *oc, void *data)
+{
+    NetFilterClass *nfc = NETFILTER_CLASS(oc);
+
+    object_class_property_add(oc, "timeout", "uint32",
+                              filter_gro_get_timeout,
+                              filter_gro_set_timeout, NULL, NULL);
+
+    nfc->setup = filter_gro_setup;
+    nfc->cleanup = filter_gro_cleanup;
+    nfc->receive_iov = filter_gro_receive_iov;
+    nfc->status_changed = filter_gro_status_changed;
+}
+
+static void filter_gro_init(Object *obj)
+{
+    FilterGROState *s = FILTER_GRO(obj);
+
+    s->timeout = FILTER_GRO_DEFAULT_TIMEOUT;
+}
+
+static const TypeInfo filter_gro_info = {
+    .name = TYPE_FILTER_GRO,
+    .parent = TYPE_NETFILTER,
+    .class_init = filter_gro_class_init,
+    .instance_init = filter_gro_init,
+    .instance_size = sizeof(FilterGROState),
+};
+
+static void register_types(void)
+{
+    type_register_static(&filter_gro_info);
+}
+
+type_init(register_types);
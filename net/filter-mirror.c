@@ -40,6 +40,7 @@ struct MirrorState {
     CharBackend chr_out;
     SocketReadState rs;
     bool vnet_hdr;
+    GByteArray *send_buf;
 };
 
 static int filter_send(MirrorState *s,
@@ -49,49 +50,28 @@ static int filter_send(MirrorState *s,
     NetFilterState *nf = NETFILTER(s);
     int ret = 0;
     ssize_t size = 0;
-    uint32_t len = 0;
-    char *buf;
 
     size = iov_size(iov, iovcnt);
     if (!size) {
         return 0;
     }
 
-    len = htonl(size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-    if (ret != sizeof(len)) {
-        goto err;
-    }
-
-    if (s->vnet_hdr) {
-        /*
-         * If vnet_hdr = on, we send vnet header len to make other
-         * module(like colo-compare) know how to parse net
-         * packet correctly.
-         */
-        ssize_t vnet_hdr_len;
-
-        vnet_hdr_len = nf->netdev->vnet_hdr_len;
-
-        len = htonl(vnet_hdr_len);
-        ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-        if (ret != sizeof(len)) {
-            goto err;
-        }
-    }
-
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
-    g_free(buf);
-    if (ret != size) {
-        goto err;
+    /*
+     * Frame the packet in a single write.  If vnet_hdr = on, we send
+     * vnet header len to make other module(like colo-compare) know how
+     * to parse net packet correctly.
+     */
+    g_byte_array_set_size(s->send_buf, 0);
+    net_rstate_frame_append(s->send_buf, s->vnet_hdr,
+                            nf->netdev->vnet_hdr_len, iov, iovcnt);
+
+    ret = qemu_chr_fe_write_all(&s->chr_out, s->send_buf->data,
+                                s->send_buf->len);
+    if (ret != s->send_buf->len) {
+        return ret < 0 ? ret : -EIO;
     }
 
     return size;
-
-err:
-    return ret < 0 ? ret : -EIO;
 }
 
 static void redirector_to_filter(NetFilterState *nf,
@@ -407,6 +387,7 @@ static void filter_mirror_init(Object *obj)
     MirrorState *s = FILTER_MIRROR(obj);
 
     s->vnet_hdr = false;
+    s->send_buf = g_byte_array_new();
 }
 
 static void filter_redirector_init(Object *obj)
@@ -414,6 +395,7 @@ static void filter_redirector_init(Object *obj)
     MirrorState *s = FILTER_REDIRECTOR(obj);
 
     s->vnet_hdr = false;
+    s->send_buf = g_byte_array_new();
 }
 
 static void filter_mirror_fini(Object *obj)
@@ -421,6 +403,7 @@ static void filter_mirror_fini(Object *obj)
     MirrorState *s = FILTER_MIRROR(obj);
 
     g_free(s->outdev);
+    g_byte_array_unref(s->send_buf);
 }
 
 static void filter_redirector_fini(Object *obj)
@@ -429,6 +412,7 @@ static void filter_redirector_fini(Object *obj)
 
     g_free(s->indev);
     g_free(s->outdev);
+    g_byte_array_unref(s->send_buf);
 }
 
 static const TypeInfo filter_redirector_info = {
@@ -509,6 +509,8 @@ void qemu_set_offload(NetClientState *nc, int csum, int tso4, int tso6,
         return;
     }
 
+    nc->offload_csum = csum;
+    nc->offload_tso4 = tso4;
     nc->info->set_offload(nc, csum, tso4, tso6, ecn, ufo);
 }
 
@@ -525,11 +527,17 @@ void qemu_set_vnet_hdr_len(NetClientState *nc, int len)
 int qemu_set_vnet_le(NetClientState *nc, bool is_le)
 {
 #ifdef HOST_WORDS_BIGENDIAN
+    int ret;
+
     if (!nc || !nc->info->set_vnet_le) {
         return -ENOSYS;
     }
 
-    return nc->info->set_vnet_le(nc, is_le);
+    ret = nc->info->set_vnet_le(nc, is_le);
+    if (!ret) {
+        nc->vnet_hdr_swap = is_le;
+    }
+    return ret;
 #else
     return 0;
 #endif
@@ -540,11 +548,17 @@ int qemu_set_vnet_be(NetClientState *nc, bool is_be)
 #ifdef HOST_WORDS_BIGENDIAN
     return 0;
 #else
+    int ret;
+
     if (!nc || !nc->info->set_vnet_be) {
         return -ENOSYS;
     }
 
-    return nc->info->set_vnet_be(nc, is_be);
+    ret = nc->info->set_vnet_be(nc, is_be);
+    if (!ret) {
+        nc->vnet_hdr_swap = is_be;
+    }
+    return ret;
 #endif
 }
 
@@ -1008,6 +1022,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1101,6 +1118,9 @@ void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -1308,6 +1328,69 @@ RxFilterInfoList *qmp_query_rx_filter(bool has_name, const char *name,
     return filter_list;
 }
 
+static NetClientState *net_rss_find_nic(const char *name, Error **errp)
+{
+    NetClientState *nc;
+
+    QTAILQ_FOREACH(nc, &net_clients, next) {
+        if (nc->queue_index == 0 && !strcmp(nc->name, name)) {
+            if (nc->info->type != NET_CLIENT_DRIVER_NIC) {
+                error_setg(errp, "net client(%s) isn't a NIC", name);
+                return NULL;
+            }
+            return nc;
+        }
+    }
+
+    error_setg(errp, "invalid net client name: %s", name);
+    return NULL;
+}
+
+void qmp_x_net_rss_flow_set(const char *name, NetRssFlow *flow,
+                            uint16_t queue, Error **errp)
+{
+    NetClientState *nc = net_rss_find_nic(name, errp);
+
+    if (!nc) {
+        return;
+    }
+    if (!nc->info->set_rss_flow) {
+        error_setg(errp, "net client(%s) doesn't support flow steering", name);
+        return;
+    }
+    nc->info->set_rss_flow(nc, flow, queue, errp);
+}
+
+void qmp_x_net_rss_flow_del(const char *name, NetRssFlow *flow, Error **errp)
+{
+    NetClientState *nc = net_rss_find_nic(name, errp);
+
+    if (!nc) {
+        return;
+    }
+    if (!nc->info->set_rss_flow) {
+        error_setg(errp, "net client(%s) doesn't support flow steering", name);
+        return;
+    }
+    nc->info->set_rss_flow(nc, flow, -1, errp);
+}
+
+NetRssQueueStatsList *qmp_x_query_net_rss_stats(const char *name,
+                                                Error **errp)
+{
+    NetClientState *nc = net_rss_find_nic(name, errp);
+
+    if (!nc) {
+        return NULL;
+    }
+    if (!nc->info->query_rss_stats) {
+        error_setg(errp, "net client(%s) doesn't support RSS statistics",
+                   name);
+        return NULL;
+    }
+    return nc->info->query_rss_stats(nc, errp);
+}
+
 void hmp_info_network(Monitor *mon, const QDict *qdict)
 {
     NetClientState *nc, *peer;
@@ -1764,3 +1847,27 @@ int net_fill_rstate(SocketReadState *rs, const uint8_t *buf, int size)
     assert(size == 0);
     return 0;
 }
+
+/*
+ * Appends a packet to @buf in the format parsed by net_fill_rstate(): its
+ * length, its vnet header length if @vnet_hdr is set, then its data.
+ */
+void net_rstate_frame_append(GByteArray *buf, bool vnet_hdr,
+                             uint32_t vnet_hdr_len,
+                             const struct iovec *iov, int iovcnt)
+{
+    size_t size = iov_size(iov, iovcnt);
+    uint32_t len;
+    guint offset;
+
+    len = htonl(size);
+    g_byte_array_append(buf, (uint8_t *)&len, sizeof(len));
+    if (vnet_hdr) {
+        len = htonl(vnet_hdr_len);
+        g_byte_array_append(buf, (uint8_t *)&len, sizeof(len));
+    }
+
+    offset = buf->len;
+    g_byte_array_set_size(buf, offset + size);
+    iov_to_buf(iov, iovcnt, 0, buf->data + offset, size);
+}
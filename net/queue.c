@@ -38,8 +38,17 @@
  *
  * If a sent callback isn't provided, we just drop the packet to avoid
  * unbounded queueing.
+ *
+ * Packets are only copied when they have to be queued, which happens in
+ * bursts while the receiver is not ready.  Buffers for packets of up to
+ * NET_PACKET_CACHE_DATA_SIZE bytes are kept on a per-queue free list once
+ * delivered, so that a backlog that keeps filling up and draining does not
+ * go through the allocator for every packet.
  */
 
+#define NET_PACKET_CACHE_DATA_SIZE  2048
+#define NET_PACKET_CACHE_MAX        256
+
 struct NetPacket {
     QTAILQ_ENTRY(NetPacket) entry;
     NetClientState *sender;
@@ -56,6 +65,8 @@ struct NetQueue {
     NetQueueDeliverFunc *deliver;
 
     QTAILQ_HEAD(, NetPacket) packets;
+    QTAILQ_HEAD(, NetPacket) free_packets;
+    uint32_t nq_free;
 
     unsigned delivering : 1;
 };
@@ -72,6 +83,7 @@ NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
     queue->deliver = deliver;
 
     QTAILQ_INIT(&queue->packets);
+    QTAILQ_INIT(&queue->free_packets);
 
     queue->delivering = 0;
 
@@ -86,10 +98,43 @@ void qemu_del_net_queue(NetQueue *queue)
         QTAILQ_REMOVE(&queue->packets, packet, entry);
         g_free(packet);
     }
+    QTAILQ_FOREACH_SAFE(packet, &queue->free_packets, entry, next) {
+        QTAILQ_REMOVE(&queue->free_packets, packet, entry);
+        g_free(packet);
+    }
 
     g_free(queue);
 }
 
+static NetPacket *qemu_net_queue_packet_alloc(NetQueue *queue, size_t size)
+{
+    NetPacket *packet;
+
+    if (size > NET_PACKET_CACHE_DATA_SIZE) {
+        return g_malloc(sizeof(NetPacket) + size);
+    }
+
+    packet = QTAILQ_FIRST(&queue->free_packets);
+    if (packet) {
+        QTAILQ_REMOVE(&queue->free_packets, packet, entry);
+        queue->nq_free--;
+        return packet;
+    }
+    return g_malloc(sizeof(NetPacket) + NET_PACKET_CACHE_DATA_SIZE);
+}
+
+static void qemu_net_queue_packet_free(NetQueue *queue, NetPacket *packet)
+{
+    if (packet->size > NET_PACKET_CACHE_DATA_SIZE ||
+        queue->nq_free >= NET_PACKET_CACHE_MAX) {
+        g_free(packet);
+        return;
+    }
+
+    QTAILQ_INSERT_HEAD(&queue->free_packets, packet, entry);
+    queue->nq_free++;
+}
+
 static void qemu_net_queue_append(NetQueue *queue,
                                   NetClientState *sender,
                                   unsigned flags,
@@ -102,7 +147,7 @@ static void qemu_net_queue_append(NetQueue *queue,
     if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
         return; /* drop if queue full and no callback */
     }
-    packet = g_malloc(sizeof(NetPacket) + size);
+    packet = qemu_net_queue_packet_alloc(queue, size);
     packet->sender = sender;
     packet->flags = flags;
     packet->size = size;
@@ -131,7 +176,7 @@ void qemu_net_queue_append_iov(NetQueue *queue,
         max_len += iov[i].iov_len;
     }
 
-    packet = g_malloc(sizeof(NetPacket) + max_len);
+    packet = qemu_net_queue_packet_alloc(queue, max_len);
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
@@ -265,7 +310,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            qemu_net_queue_packet_free(queue, packet);
         }
     }
 }
@@ -298,7 +343,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        qemu_net_queue_packet_free(queue, packet);
     }
     return true;
 }
@@ -42,6 +42,7 @@
 #include "chardev/char-fe.h"
 #include "sysemu/sysemu.h"
 #include "qemu/cutils.h"
+#include "qemu/iov.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
 #include "util.h"
@@ -95,6 +96,7 @@ typedef struct SlirpState {
     gchar *smb_dir;
 #endif
     GSList *fwd;
+    uint8_t *input_buf;         /* Gathers packets sent from several iovecs */
 } SlirpState;
 
 static struct slirp_config_str *slirp_configs;
@@ -138,6 +140,33 @@ static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t
     return size;
 }
 
+static ssize_t net_slirp_receive_iov(NetClientState *nc,
+                                     const struct iovec *iov, int iovcnt)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+    size_t size;
+
+    if (iovcnt == 1) {
+        return net_slirp_receive(nc, iov[0].iov_base, iov[0].iov_len);
+    }
+
+    /*
+     * NIC models such as virtio-net send every packet as several iovecs.
+     * slirp_input() needs a contiguous packet, so gather it into a buffer
+     * that is reused rather than allocated for each packet.
+     */
+    size = iov_size(iov, iovcnt);
+    if (size > NET_BUFSIZE) {
+        return -1;
+    }
+    if (!s->input_buf) {
+        s->input_buf = g_malloc(NET_BUFSIZE);
+    }
+    iov_to_buf(iov, iovcnt, 0, s->input_buf, size);
+
+    return net_slirp_receive(nc, s->input_buf, size);
+}
+
 static void slirp_smb_exit(Notifier *n, void *data)
 {
     SlirpState *s = container_of(n, SlirpState, exit_notifier);
@@ -164,6 +193,7 @@ static void net_slirp_cleanup(NetClientState *nc)
         qemu_remove_exit_notifier(&s->exit_notifier);
     }
     slirp_smb_cleanup(s);
+    g_free(s->input_buf);
     QTAILQ_REMOVE(&slirp_stacks, s, entry);
 }
 
@@ -171,6 +201,7 @@ static NetClientInfo net_slirp_info = {
     .type = NET_CLIENT_DRIVER_USER,
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
+    .receive_iov = net_slirp_receive_iov,
     .cleanup = net_slirp_cleanup,
 };
 
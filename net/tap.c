@@ -48,6 +48,35 @@
 
 #include "net/vhost_net.h"
 
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+
+/* Reads kept posted and writes in flight with io-uring=on */
+#define TAP_URING_RX_ENTRIES    32
+#define TAP_URING_TX_ENTRIES    64
+
+typedef struct TapUringTxReq {
+    struct iovec iov;
+    uint8_t data[];
+} TapUringTxReq;
+
+/*
+ * Reads and writes go through separate rings, so that completed reads can
+ * stay in their ring while the peer cannot receive, without keeping the
+ * tx completion handler busy.
+ */
+typedef struct TapUring {
+    struct io_uring rx_ring;
+    struct io_uring tx_ring;
+    struct iovec rx_iov[TAP_URING_RX_ENTRIES];
+    bool rx_posted[TAP_URING_RX_ENTRIES];
+    QEMUBH *tx_bh;
+    unsigned tx_queued;         /* prepared, but not submitted yet */
+    unsigned tx_inflight;       /* including tx_queued */
+    bool tx_blocked;
+} TapUring;
+#endif
+
 typedef struct TAPState {
     NetClientState nc;
     int fd;
@@ -62,6 +91,9 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+#ifdef CONFIG_LINUX_IO_URING
+    TapUring *uring;
+#endif
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -69,9 +101,20 @@ static void launch_script(const char *setup_script, const char *ifname,
 
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
+#ifdef CONFIG_LINUX_IO_URING
+static void tap_uring_send(void *opaque);
+#endif
 
 static void tap_update_fd_handler(TAPState *s)
 {
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        qemu_set_fd_handler(s->uring->rx_ring.ring_fd,
+                            s->read_poll && s->enabled ? tap_uring_send : NULL,
+                            NULL, s);
+        return;
+    }
+#endif
     qemu_set_fd_handler(s->fd,
                         s->read_poll && s->enabled ? tap_send : NULL,
                         s->write_poll && s->enabled ? tap_writable : NULL,
@@ -99,10 +142,78 @@ static void tap_writable(void *opaque)
     qemu_flush_queued_packets(&s->nc);
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static void tap_uring_tx_bh(void *opaque)
+{
+    TapUring *u = opaque;
+
+    io_uring_submit(&u->tx_ring);
+    u->tx_queued = 0;
+}
+
+static void tap_uring_tx_complete(void *opaque)
+{
+    TAPState *s = opaque;
+    TapUring *u = s->uring;
+    struct io_uring_cqe *cqe;
+
+    while (io_uring_peek_cqe(&u->tx_ring, &cqe) == 0) {
+        /* The packet is dropped on errors, just like with writev() */
+        g_free(io_uring_cqe_get_data(cqe));
+        io_uring_cqe_seen(&u->tx_ring, cqe);
+        u->tx_inflight--;
+    }
+
+    if (u->tx_blocked) {
+        u->tx_blocked = false;
+        qemu_flush_queued_packets(&s->nc);
+    }
+}
+
+/*
+ * The packet is copied, as the caller may reuse its buffers as soon as we
+ * return.  All writes queued until the main loop runs again are submitted
+ * with a single system call.
+ */
+static ssize_t tap_uring_write_packet(TAPState *s, const struct iovec *iov,
+                                      int iovcnt)
+{
+    TapUring *u = s->uring;
+    size_t size = iov_size(iov, iovcnt);
+    struct io_uring_sqe *sqe;
+    TapUringTxReq *req;
+
+    if (u->tx_inflight == TAP_URING_TX_ENTRIES) {
+        /* Retried by tap_uring_tx_complete() */
+        u->tx_blocked = true;
+        return 0;
+    }
+
+    sqe = io_uring_get_sqe(&u->tx_ring);
+    req = g_malloc(sizeof(*req) + size);
+    req->iov.iov_base = req->data;
+    req->iov.iov_len = iov_to_buf(iov, iovcnt, 0, req->data, size);
+    io_uring_prep_writev(sqe, s->fd, &req->iov, 1, 0);
+    io_uring_sqe_set_data(sqe, req);
+
+    u->tx_inflight++;
+    if (!u->tx_queued++) {
+        qemu_bh_schedule(u->tx_bh);
+    }
+    return size;
+}
+#endif
+
 static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
 {
     ssize_t len;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        return tap_uring_write_packet(s, iov, iovcnt);
+    }
+#endif
+
     do {
         len = writev(s->fd, iov, iovcnt);
     } while (len == -1 && errno == EINTR);
@@ -182,6 +293,27 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
     tap_read_poll(s, true);
 }
 
+/* Passes a packet read from the tap device to the peer */
+static int tap_send_packet(TAPState *s, uint8_t *buf, int size)
+{
+    uint8_t min_pkt[ETH_ZLEN];
+    size_t min_pktsz = sizeof(min_pkt);
+
+    if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
+        buf  += s->host_vnet_hdr_len;
+        size -= s->host_vnet_hdr_len;
+    }
+
+    if (net_peer_needs_padding(&s->nc)) {
+        if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
+            buf = min_pkt;
+            size = min_pktsz;
+        }
+    }
+
+    return qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
+}
+
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
@@ -189,28 +321,12 @@ static void tap_send(void *opaque)
     int packets = 0;
 
     while (true) {
-        uint8_t *buf = s->buf;
-        uint8_t min_pkt[ETH_ZLEN];
-        size_t min_pktsz = sizeof(min_pkt);
-
         size = tap_read_packet(s->fd, s->buf, sizeof(s->buf));
         if (size <= 0) {
             break;
         }
 
-        if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
-            buf  += s->host_vnet_hdr_len;
-            size -= s->host_vnet_hdr_len;
-        }
-
-        if (net_peer_needs_padding(&s->nc)) {
-            if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
-                buf = min_pkt;
-                size = min_pktsz;
-            }
-        }
-
-        size = qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
+        size = tap_send_packet(s, s->buf, size);
         if (size == 0) {
             tap_read_poll(s, false);
             break;
@@ -231,6 +347,154 @@ static void tap_send(void *opaque)
     }
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+static void tap_uring_post_read(TAPState *s, unsigned i)
+{
+    TapUring *u = s->uring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&u->rx_ring);
+
+    io_uring_prep_readv(sqe, s->fd, &u->rx_iov[i], 1, 0);
+    io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+    u->rx_posted[i] = true;
+}
+
+/* Reposts the buffers of failed reads, e.g. after a queue was reattached */
+static void tap_uring_post_reads(TAPState *s)
+{
+    TapUring *u = s->uring;
+    unsigned i;
+
+    for (i = 0; i < TAP_URING_RX_ENTRIES; i++) {
+        if (!u->rx_posted[i]) {
+            tap_uring_post_read(s, i);
+        }
+    }
+    io_uring_submit(&u->rx_ring);
+}
+
+static void tap_uring_send(void *opaque)
+{
+    TAPState *s = opaque;
+    TapUring *u = s->uring;
+    struct io_uring_cqe *cqe;
+    int packets = 0;
+
+    /* Same budget as tap_send() */
+    while (packets < 50 && io_uring_peek_cqe(&u->rx_ring, &cqe) == 0) {
+        unsigned i = (uintptr_t)io_uring_cqe_get_data(cqe);
+        int size = cqe->res;
+
+        io_uring_cqe_seen(&u->rx_ring, cqe);
+        u->rx_posted[i] = false;
+        if (size <= 0) {
+            /* A detached queue fails reads right away, so don't repost */
+            continue;
+        }
+
+        /* The packet is copied if it has to be queued */
+        size = tap_send_packet(s, u->rx_iov[i].iov_base, size);
+        tap_uring_post_read(s, i);
+        packets++;
+        if (size == 0) {
+            tap_read_poll(s, false);
+            break;
+        } else if (size < 0) {
+            break;
+        }
+    }
+
+    io_uring_submit(&u->rx_ring);
+}
+
+static int tap_uring_init(TAPState *s, Error **errp)
+{
+    TapUring *u = g_new0(TapUring, 1);
+    unsigned i;
+    int ret;
+
+    ret = io_uring_queue_init(TAP_URING_RX_ENTRIES, &u->rx_ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to initialize io_uring");
+        g_free(u);
+        return -1;
+    }
+    ret = io_uring_queue_init(TAP_URING_TX_ENTRIES, &u->tx_ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to initialize io_uring");
+        io_uring_queue_exit(&u->rx_ring);
+        g_free(u);
+        return -1;
+    }
+
+    for (i = 0; i < TAP_URING_RX_ENTRIES; i++) {
+        u->rx_iov[i].iov_base = g_malloc(NET_BUFSIZE);
+        u->rx_iov[i].iov_len = NET_BUFSIZE;
+    }
+    u->tx_bh = qemu_bh_new(tap_uring_tx_bh, u);
+
+    /*
+     * With O_NONBLOCK, io_uring would fail reads on an empty tap device
+     * instead of waiting for a packet.  Nothing reads or writes the fd
+     * directly anymore.
+     */
+    qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    qemu_set_block(s->fd);
+
+    s->uring = u;
+    qemu_set_fd_handler(u->tx_ring.ring_fd, tap_uring_tx_complete, NULL, s);
+    tap_uring_post_reads(s);
+    tap_update_fd_handler(s);
+    return 0;
+}
+
+static void tap_uring_cleanup(TAPState *s)
+{
+    TapUring *u = s->uring;
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    unsigned i, posted = 0;
+
+    qemu_set_fd_handler(u->rx_ring.ring_fd, NULL, NULL, NULL);
+    qemu_set_fd_handler(u->tx_ring.ring_fd, NULL, NULL, NULL);
+
+    /* Reads only complete when a packet arrives, so cancel them */
+    for (i = 0; i < TAP_URING_RX_ENTRIES; i++) {
+        if (u->rx_posted[i]) {
+            sqe = io_uring_get_sqe(&u->rx_ring);
+            io_uring_prep_cancel(sqe, (void *)(uintptr_t)i, 0);
+            io_uring_sqe_set_data(sqe, (void *)(uintptr_t)UINT_MAX);
+            posted++;
+        }
+    }
+    io_uring_submit(&u->rx_ring);
+    while (posted && io_uring_wait_cqe(&u->rx_ring, &cqe) == 0) {
+        if ((uintptr_t)io_uring_cqe_get_data(cqe) != UINT_MAX) {
+            posted--;
+        }
+        io_uring_cqe_seen(&u->rx_ring, cqe);
+    }
+
+    /* Writes complete quickly, let them finish */
+    qemu_bh_delete(u->tx_bh);
+    if (u->tx_queued) {
+        io_uring_submit(&u->tx_ring);
+    }
+    while (u->tx_inflight && io_uring_wait_cqe(&u->tx_ring, &cqe) == 0) {
+        g_free(io_uring_cqe_get_data(cqe));
+        io_uring_cqe_seen(&u->tx_ring, cqe);
+        u->tx_inflight--;
+    }
+
+    io_uring_queue_exit(&u->rx_ring);
+    io_uring_queue_exit(&u->tx_ring);
+    for (i = 0; i < TAP_URING_RX_ENTRIES; i++) {
+        g_free(u->rx_iov[i].iov_base);
+    }
+    g_free(u);
+    s->uring = NULL;
+}
+#endif
+
 static bool tap_has_ufo(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -336,6 +600,11 @@ static void tap_cleanup(NetClientState *nc)
 
     tap_read_poll(s, false);
     tap_write_poll(s, false);
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring) {
+        tap_uring_cleanup(s);
+    }
+#endif
     close(s->fd);
     s->fd = -1;
 }
@@ -704,6 +973,19 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
         }
     }
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (tap->has_io_uring && tap->io_uring) {
+        if (tap->has_vhost ? tap->vhost :
+            vhostfdname || (tap->has_vhostforce && tap->vhostforce)) {
+            error_setg(errp, "io-uring=on is not compatible with vhost");
+            return;
+        }
+        if (tap_uring_init(s, errp) < 0) {
+            return;
+        }
+    }
+#endif
+
     if (tap->has_vhost ? tap->vhost :
         vhostfdname || (tap->has_vhostforce && tap->vhostforce)) {
         VhostNetOptions options;
@@ -1031,6 +1313,11 @@ int tap_enable(NetClientState *nc)
         ret = tap_fd_enable(s->fd);
         if (ret == 0) {
             s->enabled = true;
+#ifdef CONFIG_LINUX_IO_URING
+            if (s->uring) {
+                tap_uring_post_reads(s);
+            }
+#endif
             tap_update_fd_handler(s);
         }
         return ret;
@@ -14,8 +14,12 @@
 #include "net/vhost_net.h"
 #include "net/vhost-vdpa.h"
 #include "hw/virtio/vhost-vdpa.h"
+#include "hw/virtio/virtio-net.h"
+#include "migration/misc.h"
 #include "qemu/config-file.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
+#include "qemu/log.h"
 #include "qemu/option.h"
 #include "qapi/error.h"
 #include <linux/vhost.h>
@@ -24,12 +28,22 @@
 #include "standard-headers/linux/virtio_net.h"
 #include "monitor/monitor.h"
 #include "hw/virtio/vhost.h"
+#include "trace.h"
 
-/* Todo:need to add the multiqueue support here */
 typedef struct VhostVDPAState {
     NetClientState nc;
     struct vhost_vdpa vhost_vdpa;
     VHostNetState *vhost_net;
+    /* Switches to shadow virtqueues during migration, queue pair 0 only */
+    Notifier migration_state;
+
+    /*
+     * Page sized buffers for the commands of a shadowed control virtqueue,
+     * the only ones the device sees in it
+     */
+    void *cvq_cmd_out_buffer;
+    virtio_net_ctrl_ack *status;
+
     bool started;
 } VhostVDPAState;
 
@@ -62,6 +76,7 @@ const int vdpa_feature_bits[] = {
     VIRTIO_NET_F_CTRL_VQ,
     VIRTIO_F_IOMMU_PLATFORM,
     VIRTIO_F_RING_PACKED,
+    VIRTIO_F_IN_ORDER,
     VIRTIO_NET_F_RSS,
     VIRTIO_NET_F_HASH_REPORT,
     VIRTIO_NET_F_GUEST_ANNOUNCE,
@@ -128,15 +143,22 @@ static void vhost_vdpa_cleanup(NetClientState *nc)
 {
     VhostVDPAState *s = DO_UPCAST(VhostVDPAState, nc, nc);
 
+    if (s->migration_state.notify) {
+        remove_migration_state_change_notifier(&s->migration_state);
+        s->migration_state.notify = NULL;
+    }
     if (s->vhost_net) {
         vhost_net_cleanup(s->vhost_net);
         g_free(s->vhost_net);
         s->vhost_net = NULL;
     }
+    g_clear_pointer(&s->vhost_vdpa.iova_tree, vhost_iova_tree_unref);
      if (s->vhost_vdpa.device_fd >= 0) {
         qemu_close(s->vhost_vdpa.device_fd);
         s->vhost_vdpa.device_fd = -1;
     }
+    g_clear_pointer(&s->cvq_cmd_out_buffer, qemu_vfree);
+    g_clear_pointer(&s->status, qemu_vfree);
 }
 
 static bool vhost_vdpa_has_vnet_hdr(NetClientState *nc)
@@ -177,6 +199,69 @@ static ssize_t vhost_vdpa_receive(NetClientState *nc, const uint8_t *buf,
     return 0;
 }
 
+/*
+ * Restart the device of @s with or without shadow virtqueues.  All the
+ * queue pairs of the device are switched, as they are started together.
+ */
+static void vhost_vdpa_net_set_svq(VhostVDPAState *s, bool enable)
+{
+    NetClientState *peer = s->nc.peer;
+    VirtIODevice *vdev;
+    VirtIONet *n;
+    int queue_pairs, cvq, i, r;
+
+    if (!peer || peer->info->type != NET_CLIENT_DRIVER_NIC ||
+        s->vhost_vdpa.shadow_vqs_enabled == enable) {
+        return;
+    }
+
+    n = qemu_get_nic_opaque(peer);
+    vdev = VIRTIO_DEVICE(n);
+    queue_pairs = n->multiqueue ? n->max_queue_pairs : 1;
+    cvq = n->max_ncs - n->max_queue_pairs;
+
+    trace_vhost_vdpa_net_set_svq(s, enable, n->vhost_started);
+    if (n->vhost_started) {
+        vhost_net_stop(vdev, n->nic->ncs, queue_pairs, cvq);
+    }
+
+    for (i = 0; i < n->max_ncs; i++) {
+        NetClientState *nc = qemu_get_peer(n->nic->ncs, i);
+        VhostVDPAState *vs = DO_UPCAST(VhostVDPAState, nc, nc);
+
+        /* The control virtqueue is always shadowed */
+        if (nc->is_datapath) {
+            vs->vhost_vdpa.shadow_vqs_enabled = enable;
+        }
+        vs->vhost_vdpa.shadow_data = enable;
+    }
+
+    if (n->vhost_started) {
+        r = vhost_net_start(vdev, n->nic->ncs, queue_pairs, cvq);
+        if (r < 0) {
+            error_report("unable to restart vhost-vdpa %s shadow virtqueues: "
+                         "%d: falling back on userspace virtio",
+                         enable ? "with" : "without", -r);
+            n->vhost_started = 0;
+        }
+    }
+}
+
+static void vhost_vdpa_net_migration_state_notify(Notifier *notifier,
+                                                  void *data)
+{
+    VhostVDPAState *s = container_of(notifier, VhostVDPAState,
+                                     migration_state);
+    MigrationState *migration = data;
+
+    if (migration_in_setup(migration)) {
+        vhost_vdpa_net_set_svq(s, true);
+    } else if (migration_has_finished(migration) ||
+               migration_has_failed(migration)) {
+        vhost_vdpa_net_set_svq(s, false);
+    }
+}
+
 static NetClientInfo net_vhost_vdpa_info = {
         .type = NET_CLIENT_DRIVER_VHOST_VDPA,
         .size = sizeof(VhostVDPAState),
@@ -187,13 +272,360 @@ static NetClientInfo net_vhost_vdpa_info = {
         .check_peer_type = vhost_vdpa_check_peer_type,
 };
 
+static void vhost_vdpa_cvq_unmap_buf(struct vhost_vdpa *v, void *addr)
+{
+    const DMAMap needle = {
+        .translated_addr = (hwaddr)(uintptr_t)addr,
+    };
+    const DMAMap *result;
+    DMAMap map;
+    int r;
+
+    result = vhost_iova_tree_find_iova(v->iova_tree, &needle);
+    if (!result) {
+        /* Not mapped, or the start of the device failed before */
+        return;
+    }
+
+    map = *result;
+    r = vhost_vdpa_dma_unmap(v, map.iova, map.size + 1);
+    if (unlikely(r != 0)) {
+        error_report("Device cannot unmap: %s(%d)", g_strerror(-r), -r);
+    }
+
+    vhost_iova_tree_remove(v->iova_tree, &map);
+}
+
+/* Map a control command buffer at an iova allocated for it */
+static int vhost_vdpa_cvq_map_buf(struct vhost_vdpa *v, void *buf,
+                                  bool write)
+{
+    DMAMap map = {
+        .translated_addr = (hwaddr)(uintptr_t)buf,
+        .size = qemu_real_host_page_size - 1,
+        .perm = write ? IOMMU_RW : IOMMU_RO,
+    };
+    int r;
+
+    r = vhost_iova_tree_map_alloc(v->iova_tree, &map);
+    if (unlikely(r != IOVA_OK)) {
+        error_report("Cannot allocate iova for control commands (%d)", r);
+        return -ENOMEM;
+    }
+
+    r = vhost_vdpa_dma_map(v, map.iova, qemu_real_host_page_size, buf,
+                           !write);
+    if (unlikely(r < 0)) {
+        vhost_iova_tree_remove(v->iova_tree, &map);
+    }
+
+    return r;
+}
+
+/*
+ * Send the command in the first @out_len bytes of the command buffer to the
+ * device, and wait for its status.  Returns the number of bytes the device
+ * wrote, or a negative errno.
+ */
+static ssize_t vhost_vdpa_net_cvq_add(VhostVDPAState *s, size_t out_len)
+{
+    const struct iovec out = {
+        .iov_base = s->cvq_cmd_out_buffer,
+        .iov_len = out_len,
+    };
+    const struct iovec in = {
+        .iov_base = s->status,
+        .iov_len = sizeof(virtio_net_ctrl_ack),
+    };
+    VhostShadowVirtqueue *svq = g_ptr_array_index(s->vhost_vdpa.shadow_vqs, 0);
+    int r;
+
+    r = vhost_svq_add(svq, &out, 1, &in, 1, NULL);
+    if (unlikely(r != 0)) {
+        if (unlikely(r == -ENOSPC)) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: No space on device queue\n",
+                          __func__);
+        }
+        return r;
+    }
+
+    /*
+     * The device answers quickly, and the guest cannot send another command
+     * before it gets the status of this one anyway.
+     */
+    return vhost_svq_poll(svq);
+}
+
+static int vhost_vdpa_net_load_cmd(VhostVDPAState *s, uint8_t class,
+                                   uint8_t cmd, const void *data,
+                                   size_t data_size)
+{
+    const struct virtio_net_ctrl_hdr ctrl = {
+        .class = class,
+        .cmd = cmd,
+    };
+    ssize_t dev_written;
+
+    assert(data_size < qemu_real_host_page_size - sizeof(ctrl));
+
+    trace_vhost_vdpa_net_load_cmd(s, class, cmd, data_size);
+    memcpy(s->cvq_cmd_out_buffer, &ctrl, sizeof(ctrl));
+    memcpy(s->cvq_cmd_out_buffer + sizeof(ctrl), data, data_size);
+
+    dev_written = vhost_vdpa_net_cvq_add(s, sizeof(ctrl) + data_size);
+    if (unlikely(dev_written < 0)) {
+        return dev_written;
+    }
+    if (unlikely(dev_written < sizeof(*s->status) ||
+                 *s->status != VIRTIO_NET_OK)) {
+        error_report("vhost-vdpa: device refused control command %u:%u",
+                     class, cmd);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+/*
+ * Send the RSS or hash reporting configuration of the device model.  Both
+ * commands have the layout of struct virtio_net_rss_config; the fields that
+ * only apply to RSS are reserved for hash reporting.
+ */
+static int vhost_vdpa_net_load_rss(VhostVDPAState *s, const VirtIONet *n,
+                                   bool do_rss)
+{
+    const VirtioNetRssData *rss = &n->rss_data;
+    uint16_t table_len = do_rss ? rss->indirections_len : 1;
+    size_t len = offsetof(struct virtio_net_rss_config, indirection_table) +
+                 table_len * sizeof(uint16_t) + sizeof(uint16_t) + 1 +
+                 sizeof(rss->key);
+    g_autofree uint8_t *cfg = g_malloc0(len);
+    uint8_t *p = cfg;
+    unsigned i;
+
+    stl_le_p(p, rss->hash_types);
+    p += sizeof(uint32_t);
+    if (do_rss) {
+        stw_le_p(p, rss->indirections_len - 1);
+        stw_le_p(p + sizeof(uint16_t), rss->default_queue);
+    }
+    p += 2 * sizeof(uint16_t);
+    for (i = 0; i < table_len; i++, p += sizeof(uint16_t)) {
+        stw_le_p(p, do_rss ? rss->indirections_table[i] : 0);
+    }
+    stw_le_p(p, do_rss ? n->curr_queue_pairs : 0);
+    p += sizeof(uint16_t);
+
+    /*
+     * The model does not keep the length of the guest's key.  The longest
+     * key is as good, as the hash only uses as many key bytes as the
+     * hashed fields need.
+     */
+    *p++ = sizeof(rss->key);
+    memcpy(p, rss->key, sizeof(rss->key));
+
+    return vhost_vdpa_net_load_cmd(s, VIRTIO_NET_CTRL_MQ,
+                                   do_rss ? VIRTIO_NET_CTRL_MQ_RSS_CONFIG :
+                                            VIRTIO_NET_CTRL_MQ_HASH_CONFIG,
+                                   cfg, len);
+}
+
+static int vhost_vdpa_net_load_mq(VhostVDPAState *s, const VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int r;
+
+    if (n->rss_data.enabled && n->rss_data.redirect) {
+        /* Also sets the number of queue pairs */
+        return vhost_vdpa_net_load_rss(s, n, true);
+    }
+
+    if (virtio_vdev_has_feature(vdev, VIRTIO_NET_F_MQ) &&
+        n->curr_queue_pairs > 1) {
+        struct virtio_net_ctrl_mq mq;
+
+        stw_le_p(&mq.virtqueue_pairs, n->curr_queue_pairs);
+        r = vhost_vdpa_net_load_cmd(s, VIRTIO_NET_CTRL_MQ,
+                                    VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET,
+                                    &mq, sizeof(mq));
+        if (r < 0) {
+            return r;
+        }
+    }
+
+    if (n->rss_data.enabled) {
+        return vhost_vdpa_net_load_rss(s, n, false);
+    }
+
+    return 0;
+}
+
+/*
+ * Restore the configuration that the guest made through the control
+ * virtqueue, which the device lost when it was reset, or never had on
+ * the destination of a migration.  Receive filters are not restored.
+ */
+static int vhost_vdpa_net_load(VhostVDPAState *s)
+{
+    VirtIONet *n = qemu_get_nic_opaque(s->nc.peer);
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int r;
+
+    if (virtio_vdev_has_feature(vdev, VIRTIO_NET_F_CTRL_MAC_ADDR)) {
+        r = vhost_vdpa_net_load_cmd(s, VIRTIO_NET_CTRL_MAC,
+                                    VIRTIO_NET_CTRL_MAC_ADDR_SET,
+                                    n->mac, sizeof(n->mac));
+        if (r < 0) {
+            return r;
+        }
+    }
+
+    if (virtio_vdev_has_feature(vdev, VIRTIO_NET_F_MQ) ||
+        virtio_vdev_has_feature(vdev, VIRTIO_NET_F_RSS) ||
+        virtio_vdev_has_feature(vdev, VIRTIO_NET_F_HASH_REPORT)) {
+        return vhost_vdpa_net_load_mq(s, n);
+    }
+
+    return 0;
+}
+
+static int vhost_vdpa_net_cvq_start(NetClientState *nc)
+{
+    VhostVDPAState *s = DO_UPCAST(VhostVDPAState, nc, nc);
+    struct vhost_vdpa *v = &s->vhost_vdpa;
+    int r;
+
+    assert(nc->info->type == NET_CLIENT_DRIVER_VHOST_VDPA);
+
+    if (!v->shadow_vqs_enabled) {
+        return 0;
+    }
+
+    r = vhost_vdpa_cvq_map_buf(v, s->cvq_cmd_out_buffer, false);
+    if (unlikely(r < 0)) {
+        return r;
+    }
+
+    r = vhost_vdpa_cvq_map_buf(v, s->status, true);
+    if (unlikely(r < 0)) {
+        goto err_status;
+    }
+
+    r = vhost_vdpa_net_load(s);
+    if (unlikely(r < 0)) {
+        goto err_load;
+    }
+    return 0;
+
+err_load:
+    vhost_vdpa_cvq_unmap_buf(v, s->status);
+err_status:
+    vhost_vdpa_cvq_unmap_buf(v, s->cvq_cmd_out_buffer);
+    return r;
+}
+
+static void vhost_vdpa_net_cvq_stop(NetClientState *nc)
+{
+    VhostVDPAState *s = DO_UPCAST(VhostVDPAState, nc, nc);
+    struct vhost_vdpa *v = &s->vhost_vdpa;
+
+    assert(nc->info->type == NET_CLIENT_DRIVER_VHOST_VDPA);
+
+    if (!v->shadow_vqs_enabled) {
+        return;
+    }
+
+    vhost_vdpa_cvq_unmap_buf(v, s->cvq_cmd_out_buffer);
+    vhost_vdpa_cvq_unmap_buf(v, s->status);
+}
+
+static NetClientInfo net_vhost_vdpa_cvq_info = {
+    .type = NET_CLIENT_DRIVER_VHOST_VDPA,
+    .size = sizeof(VhostVDPAState),
+    .receive = vhost_vdpa_receive,
+    .start = vhost_vdpa_net_cvq_start,
+    .stop = vhost_vdpa_net_cvq_stop,
+    .cleanup = vhost_vdpa_cleanup,
+    .has_vnet_hdr = vhost_vdpa_has_vnet_hdr,
+    .has_ufo = vhost_vdpa_has_ufo,
+    .check_peer_type = vhost_vdpa_check_peer_type,
+};
+
+/*
+ * Forward a command of the guest to the device through the command buffer,
+ * and apply it to the device model too if the device accepted it, so that
+ * the model can restore it later.
+ */
+static int vhost_vdpa_net_handle_ctrl_avail(VhostShadowVirtqueue *svq,
+                                            VirtQueueElement *elem,
+                                            void *opaque)
+{
+    VhostVDPAState *s = opaque;
+    virtio_net_ctrl_ack status = VIRTIO_NET_ERR;
+    struct iovec out = {
+        .iov_base = s->cvq_cmd_out_buffer,
+    };
+    /* The status of the model, once the device succeeded */
+    const struct iovec model_in = {
+        .iov_base = &status,
+        .iov_len = sizeof(status),
+    };
+    ssize_t dev_written = -EINVAL;
+    size_t in_len;
+
+    out.iov_len = iov_to_buf(elem->out_sg, elem->out_num, 0,
+                             s->cvq_cmd_out_buffer,
+                             qemu_real_host_page_size);
+    if (unlikely(iov_size(elem->out_sg, elem->out_num) > out.iov_len)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: control command too long\n",
+                      __func__);
+        goto out;
+    }
+
+    dev_written = vhost_vdpa_net_cvq_add(s, out.iov_len);
+    if (unlikely(dev_written < 0)) {
+        goto out;
+    }
+
+    if (unlikely(dev_written < sizeof(status))) {
+        error_report("Insufficient written data (%zd)", dev_written);
+        goto out;
+    }
+
+    if (*s->status != VIRTIO_NET_OK) {
+        status = *s->status;
+        goto out;
+    }
+
+    virtio_net_handle_ctrl_iov(svq->vdev, &model_in, 1, &out, 1);
+    if (status != VIRTIO_NET_OK) {
+        error_report("Bad control command processing in the device model");
+    }
+
+out:
+    in_len = iov_from_buf(elem->in_sg, elem->in_num, 0, &status,
+                          sizeof(status));
+    if (unlikely(in_len < sizeof(status))) {
+        error_report("Bad device control virtqueue status buffer");
+    }
+    vhost_svq_push_elem(svq, elem, MIN(in_len, sizeof(status)));
+    g_free(elem);
+    return dev_written < 0 ? dev_written : 0;
+}
+
+static const VhostShadowVirtqueueOps vhost_vdpa_net_svq_ops = {
+    .avail_handler = vhost_vdpa_net_handle_ctrl_avail,
+};
+
 static NetClientState *net_vhost_vdpa_init(NetClientState *peer,
                                            const char *device,
                                            const char *name,
                                            int vdpa_device_fd,
                                            int queue_pair_index,
                                            int nvqs,
-                                           bool is_datapath)
+                                           bool is_datapath,
+                                           bool svq_migration,
+                                           VhostIOVATree *iova_tree)
 {
     NetClientState *nc = NULL;
     VhostVDPAState *s;
@@ -203,7 +635,7 @@ static NetClientState *net_vhost_vdpa_init(NetClientState *peer,
         nc = qemu_new_net_client(&net_vhost_vdpa_info, peer, device,
                                  name);
     } else {
-        nc = qemu_new_net_control_client(&net_vhost_vdpa_info, peer,
+        nc = qemu_new_net_control_client(&net_vhost_vdpa_cvq_info, peer,
                                          device, name);
     }
     snprintf(nc->info_str, sizeof(nc->info_str), TYPE_VHOST_VDPA);
@@ -211,11 +643,36 @@ static NetClientState *net_vhost_vdpa_init(NetClientState *peer,
 
     s->vhost_vdpa.device_fd = vdpa_device_fd;
     s->vhost_vdpa.index = queue_pair_index;
+    s->vhost_vdpa.shadow_vqs_migration = svq_migration;
+    if (iova_tree) {
+        s->vhost_vdpa.iova_tree = vhost_iova_tree_ref(iova_tree);
+    }
+    if (svq_migration && !is_datapath) {
+        /*
+         * Shadow the control virtqueue all the time, so that the device model
+         * knows the configuration to restore whenever the device restarts.
+         */
+        s->cvq_cmd_out_buffer = qemu_memalign(qemu_real_host_page_size,
+                                              qemu_real_host_page_size);
+        memset(s->cvq_cmd_out_buffer, 0, qemu_real_host_page_size);
+        s->status = qemu_memalign(qemu_real_host_page_size,
+                                  qemu_real_host_page_size);
+        memset(s->status, 0, qemu_real_host_page_size);
+
+        s->vhost_vdpa.shadow_vqs_enabled = true;
+        s->vhost_vdpa.shadow_vq_ops = &vhost_vdpa_net_svq_ops;
+        s->vhost_vdpa.shadow_vq_ops_opaque = s;
+    }
     ret = vhost_vdpa_add(nc, (void *)&s->vhost_vdpa, queue_pair_index, nvqs);
     if (ret) {
         qemu_del_net_client(nc);
         return NULL;
     }
+
+    if (svq_migration && queue_pair_index == 0) {
+        s->migration_state.notify = vhost_vdpa_net_migration_state_notify;
+        add_migration_state_change_notifier(&s->migration_state);
+    }
     return nc;
 }
 
@@ -258,6 +715,18 @@ static int vhost_vdpa_get_max_queue_pairs(int fd, int *has_cvq, Error **errp)
     return 1;
 }
 
+static VhostIOVATree *vhost_vdpa_net_iova_tree_new(int fd)
+{
+    struct vhost_vdpa_iova_range iova_range;
+
+    if (ioctl(fd, VHOST_VDPA_GET_IOVA_RANGE, &iova_range)) {
+        iova_range.first = 0;
+        iova_range.last = UINT64_MAX;
+    }
+
+    return vhost_iova_tree_new(iova_range.first, iova_range.last);
+}
+
 int net_init_vhost_vdpa(const Netdev *netdev, const char *name,
                         NetClientState *peer, Error **errp)
 {
@@ -265,6 +734,8 @@ int net_init_vhost_vdpa(const Netdev *netdev, const char *name,
     int vdpa_device_fd;
     NetClientState **ncs, *nc;
     int queue_pairs, i, has_cvq = 0;
+    bool svq_migration;
+    g_autoptr(VhostIOVATree) iova_tree = NULL;
 
     assert(netdev->type == NET_CLIENT_DRIVER_VHOST_VDPA);
     opts = &netdev->u.vhost_vdpa;
@@ -285,18 +756,25 @@ int net_init_vhost_vdpa(const Netdev *netdev, const char *name,
         return queue_pairs;
     }
 
+    svq_migration = opts->has_x_svq_migration && opts->x_svq_migration;
+    if (svq_migration) {
+        iova_tree = vhost_vdpa_net_iova_tree_new(vdpa_device_fd);
+    }
+
     ncs = g_malloc0(sizeof(*ncs) * queue_pairs);
 
     for (i = 0; i < queue_pairs; i++) {
         ncs[i] = net_vhost_vdpa_init(peer, TYPE_VHOST_VDPA, name,
-                                     vdpa_device_fd, i, 2, true);
+                                     vdpa_device_fd, i, 2, true,
+                                     svq_migration, iova_tree);
         if (!ncs[i])
             goto err;
     }
 
     if (has_cvq) {
         nc = net_vhost_vdpa_init(peer, TYPE_VHOST_VDPA, name,
-                                 vdpa_device_fd, i, 1, false);
+                                 vdpa_device_fd, i, 1, false,
+                                 svq_migration, iova_tree);
         if (!nc)
             goto err;
     }
@@ -36,6 +36,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/plugin.h"
+#include "qemu/host-utils.h"
 #include "tcg/tcg.h"
 #include "exec/exec-all.h"
 #include "exec/ram_addr.h"
@@ -93,7 +94,31 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               void *ptr, uint64_t imm)
 {
     if (!tb->mem_only) {
-        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr, imm);
+        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr, 0,
+                                  imm);
+    }
+}
+
+static void *plugin_u64_base(qemu_plugin_u64 entry)
+{
+    return entry.score->data->data + entry.offset;
+}
+
+static size_t plugin_u64_stride(qemu_plugin_u64 entry)
+{
+    return g_array_get_element_size(entry.score->data);
+}
+
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm)
+{
+    if (!tb->mem_only) {
+        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op,
+                                  plugin_u64_base(entry),
+                                  plugin_u64_stride(entry), imm);
     }
 }
 
@@ -114,7 +139,20 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
 {
     if (!insn->mem_only) {
         plugin_register_inline_op(&insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE],
-                                  0, op, ptr, imm);
+                                  0, op, ptr, 0, imm);
+    }
+}
+
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm)
+{
+    if (!insn->mem_only) {
+        plugin_register_inline_op(&insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE],
+                                  0, op, plugin_u64_base(entry),
+                                  plugin_u64_stride(entry), imm);
     }
 }
 
@@ -139,7 +177,50 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           uint64_t imm)
 {
     plugin_register_inline_op(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE],
-                              rw, op, ptr, imm);
+                              rw, op, ptr, 0, imm);
+}
+
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm)
+{
+    plugin_register_inline_op(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE],
+                              rw, op, plugin_u64_base(entry),
+                              plugin_u64_stride(entry), imm);
+}
+
+struct qemu_plugin_mem_ring *
+qemu_plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                         void *userdata)
+{
+    struct qemu_plugin_mem_ring *ring = g_new0(struct qemu_plugin_mem_ring, 1);
+
+    g_assert(n_records && n_records <= (1u << 30));
+    ring->n_records = pow2ceil(n_records);
+    ring->cb = cb;
+    ring->userdata = userdata;
+    ring->score = plugin_scoreboard_new(sizeof(PluginMemRingHeader) +
+                                        ring->n_records *
+                                        sizeof(qemu_plugin_mem_record));
+    return ring;
+}
+
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_mem_ring *ring)
+{
+    plugin_register_vcpu_mem_ring(
+        &insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING], rw, ring);
+}
+
+void qemu_plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring,
+                                unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < ring->score->data->len);
+    plugin_mem_ring_drain(ring, vcpu_index);
 }
 
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
@@ -379,6 +460,59 @@ int qemu_plugin_n_max_vcpus(void)
 #endif
 }
 
+/*
+ * Scoreboards
+ *
+ * Per-vCPU storage that inline ops can update without racing between
+ * vCPUs.
+ */
+
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size)
+{
+    return plugin_scoreboard_new(element_size);
+}
+
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    plugin_scoreboard_free(score);
+}
+
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < score->data->len);
+    return score->data->data +
+           vcpu_index * g_array_get_element_size(score->data);
+}
+
+static uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
+                                    unsigned int vcpu_index)
+{
+    return qemu_plugin_scoreboard_find(entry.score, vcpu_index) + entry.offset;
+}
+
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index)
+{
+    return *plugin_u64_address(entry, vcpu_index);
+}
+
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val)
+{
+    *plugin_u64_address(entry, vcpu_index) = val;
+}
+
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry)
+{
+    uint64_t total = 0;
+    unsigned int i;
+
+    for (i = 0; i < entry.score->data->len; i++) {
+        total += qemu_plugin_u64_get(entry, i);
+    }
+    return total;
+}
+
 /*
  * Plugin output
  */
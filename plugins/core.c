@@ -29,6 +29,9 @@
 #include "tcg/tcg-op.h"
 #include "plugin.h"
 #include "qemu/compiler.h"
+#ifndef CONFIG_USER_ONLY
+#include "hw/boards.h"
+#endif
 
 struct qemu_plugin_cb {
     struct qemu_plugin_ctx *ctx;
@@ -210,11 +213,87 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+static size_t plugin_scoreboard_size__locked(void)
+{
+    if (!plugin.scoreboard_alloc_size) {
+#ifdef CONFIG_USER_ONLY
+        plugin.scoreboard_alloc_size = 16;
+#else
+        plugin.scoreboard_alloc_size =
+            MACHINE(qdev_get_machine())->smp.max_cpus;
+#endif
+    }
+    return plugin.scoreboard_alloc_size;
+}
+
+static void plugin_grow_scoreboards__locked(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t size = plugin_scoreboard_size__locked();
+
+    if (cpu->cpu_index < size) {
+        return;
+    }
+    while (cpu->cpu_index >= size) {
+        size *= 2;
+    }
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        plugin.scoreboard_alloc_size = size;
+        return;
+    }
+
+    /*
+     * Only reached in user-mode, where new vCPUs are created by the thread
+     * of a vCPU that is in a syscall.  Translated code embeds pointers to
+     * the scoreboards, so stop all vCPUs and flush the code cache before
+     * moving them.  Drop the lock while waiting, as running vCPUs may need
+     * it to get out of their callbacks.
+     */
+    g_assert(current_cpu);
+    qemu_rec_mutex_unlock(&plugin.lock);
+    start_exclusive();
+    qemu_rec_mutex_lock(&plugin.lock);
+    /* another vCPU may have grown the scoreboards meanwhile */
+    if (size > plugin.scoreboard_alloc_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            g_array_set_size(score->data, size);
+        }
+        plugin.scoreboard_alloc_size = size;
+        tb_flush(current_cpu);
+    }
+    end_exclusive();
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t size;
+
+    g_assert(element_size);
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    size = plugin_scoreboard_size__locked();
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->data = g_array_sized_new(false, true, element_size, size);
+    g_array_set_size(score->data, size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    QEMU_LOCK_GUARD(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    g_array_free(score->data, true);
+    g_free(score);
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
     qemu_rec_mutex_lock(&plugin.lock);
+    plugin_grow_scoreboards__locked(cpu);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
@@ -282,7 +361,7 @@ static struct qemu_plugin_dyn_cb *plugin_get_dyn_cb(GArray **arr)
 void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
-                               uint64_t imm)
+                               size_t stride, uint64_t imm)
 {
     struct qemu_plugin_dyn_cb *dyn_cb;
 
@@ -292,6 +371,7 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.stride = stride;
 }
 
 void plugin_register_dyn_cb__udata(GArray **arr,
@@ -323,6 +403,155 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->f.generic = cb;
 }
 
+void plugin_register_vcpu_mem_ring(GArray **arr, enum qemu_plugin_mem_rw rw,
+                                   struct qemu_plugin_mem_ring *ring)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = ring;
+    dyn_cb->type = PLUGIN_CB_MEM_RING;
+    dyn_cb->rw = rw;
+    dyn_cb->mem_ring.base = ring->score->data->data;
+    dyn_cb->mem_ring.stride = g_array_get_element_size(ring->score->data);
+    dyn_cb->mem_ring.mask = ring->n_records - 1;
+}
+
+static PluginMemRingHeader *
+plugin_mem_ring_header(struct qemu_plugin_mem_ring *ring, int cpu_index)
+{
+    GArray *data = ring->score->data;
+
+    return (void *)(data->data + cpu_index * g_array_get_element_size(data));
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring, int cpu_index)
+{
+    PluginMemRingHeader *hdr = plugin_mem_ring_header(ring, cpu_index);
+    qemu_plugin_mem_record *records = (qemu_plugin_mem_record *)(hdr + 1);
+    uint32_t head = hdr->head;
+    uint32_t n = head - hdr->tail;
+    uint32_t start, first;
+    uint64_t lost = 0;
+
+    if (n > ring->n_records) {
+        lost = n - ring->n_records;
+        n = ring->n_records;
+    }
+    if (n) {
+        start = (head - n) & (ring->n_records - 1);
+        first = MIN(n, ring->n_records - start);
+        ring->cb(cpu_index, records + start, first, lost, ring->userdata);
+        if (first < n) {
+            ring->cb(cpu_index, records, n - first, 0, ring->userdata);
+        }
+    }
+    hdr->tail = head;
+}
+
+/*
+ * Called before every TB that logs accesses to @udata: drain the ring
+ * if the records of the TB might not fit in it.
+ */
+static void plugin_mem_ring_check(unsigned int cpu_index, void *udata)
+{
+    struct qemu_plugin_mem_ring *ring = udata;
+    PluginMemRingHeader *hdr = plugin_mem_ring_header(ring, cpu_index);
+    uint64_t fill = (uint32_t)(hdr->head - hdr->tail);
+
+    if (fill + qatomic_read(&ring->tb_max) > ring->n_records) {
+        plugin_mem_ring_drain(ring, cpu_index);
+    }
+}
+
+/*
+ * Log an access made by a helper, which can check for room itself.  The
+ * inline appends still to come in the current TB only had their room
+ * checked before the TB, so leave room for those as well.
+ */
+static void plugin_mem_ring_append(struct qemu_plugin_mem_ring *ring,
+                                   int cpu_index, uint64_t vaddr,
+                                   qemu_plugin_meminfo_t info)
+{
+    PluginMemRingHeader *hdr = plugin_mem_ring_header(ring, cpu_index);
+    uint64_t fill = (uint32_t)(hdr->head - hdr->tail);
+    qemu_plugin_mem_record *rec;
+
+    if (fill + 1 + qatomic_read(&ring->tb_max) > ring->n_records) {
+        plugin_mem_ring_drain(ring, cpu_index);
+    }
+    rec = (qemu_plugin_mem_record *)(hdr + 1) +
+          (hdr->head & (ring->n_records - 1));
+    rec->vaddr = vaddr;
+    rec->info = info;
+    hdr->head++;
+}
+
+/* Plant a check before @tb for every ring its instructions log to */
+static void plugin_add_mem_ring_checks(struct qemu_plugin_tb *tb)
+{
+    size_t i, j, k;
+
+    for (i = 0; i < tb->n; i++) {
+        struct qemu_plugin_insn *insn = g_ptr_array_index(tb->insns, i);
+        GArray *rings = insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING];
+
+        for (j = 0; j < rings->len; j++) {
+            void *ring = g_array_index(rings, struct qemu_plugin_dyn_cb,
+                                       j).userp;
+            GArray *checks = tb->cbs[PLUGIN_CB_REGULAR];
+
+            for (k = 0; checks && k < checks->len; k++) {
+                struct qemu_plugin_dyn_cb *cb =
+                    &g_array_index(checks, struct qemu_plugin_dyn_cb, k);
+
+                if (cb->f.vcpu_udata == plugin_mem_ring_check &&
+                    cb->userp == ring) {
+                    break;
+                }
+            }
+            if (!checks || k == checks->len) {
+                plugin_register_dyn_cb__udata(&tb->cbs[PLUGIN_CB_REGULAR],
+                                              plugin_mem_ring_check,
+                                              QEMU_PLUGIN_CB_NO_REGS, ring);
+            }
+        }
+    }
+}
+
+void qemu_plugin_tb_mem_ring_records(struct qemu_plugin_tb *tb,
+                                     uint32_t n_records)
+{
+    GArray *checks = tb->cbs[PLUGIN_CB_REGULAR];
+    size_t i;
+
+    for (i = 0; checks && i < checks->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(checks, struct qemu_plugin_dyn_cb, i);
+        struct qemu_plugin_mem_ring *ring = cb->userp;
+        uint32_t old;
+
+        if (cb->f.vcpu_udata != plugin_mem_ring_check) {
+            continue;
+        }
+        old = qatomic_read(&ring->tb_max);
+        while (n_records > old) {
+            uint32_t prev = qatomic_cmpxchg(&ring->tb_max, old, n_records);
+
+            if (prev == old) {
+                break;
+            }
+            old = prev;
+        }
+    }
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -341,6 +570,8 @@ void qemu_plugin_tb_trans_cb(CPUState *cpu, struct qemu_plugin_tb *tb)
 
         func(cb->ctx->id, tb);
     }
+
+    plugin_add_mem_ring_checks(tb);
 }
 
 /*
@@ -432,14 +663,17 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    uint64_t *val = cb->userp + cpu_index * cb->inline_insn.stride;
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
         *val += cb->inline_insn.imm;
         break;
+    case QEMU_PLUGIN_INLINE_STORE_U64:
+        *val = cb->inline_insn.imm;
+        break;
     default:
         g_assert_not_reached();
     }
@@ -467,7 +701,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_MEM_RING:
+            plugin_mem_ring_append(cb->userp, cpu->cpu_index, vaddr,
+                                   make_plugin_meminfo(oi, rw));
             break;
         default:
             g_assert_not_reached();
@@ -552,6 +790,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
@@ -44,6 +44,28 @@ struct qemu_plugin_state {
      * the code cache is flushed.
      */
     struct qht dyn_cb_arr_ht;
+    /*
+     * All scoreboards, and the number of vCPU elements allocated in each
+     * of them.  Scoreboards only grow in user-mode; in system emulation
+     * they are sized for the maximum number of vCPUs from the start.
+     */
+    QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    size_t scoreboard_alloc_size;
+};
+
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/* The ring of each vCPU is an element of @score */
+struct qemu_plugin_mem_ring {
+    struct qemu_plugin_scoreboard *score;
+    uint32_t n_records;
+    /* most records a single TB appends, updated at translation time */
+    uint32_t tb_max;
+    qemu_plugin_vcpu_mem_ring_cb_t cb;
+    void *userdata;
 };
 
 
@@ -67,7 +89,7 @@ struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
 void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
-                               uint64_t imm);
+                               size_t stride, uint64_t imm);
 
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
@@ -95,6 +117,15 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index);
+
+void plugin_register_vcpu_mem_ring(GArray **arr, enum qemu_plugin_mem_rw rw,
+                                   struct qemu_plugin_mem_ring *ring);
+
+void plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring, int cpu_index);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
 #endif /* _PLUGIN_INTERNAL_H_ */
@@ -33,6 +33,7 @@
 #include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qnum.h"
 #include "qemu/cutils.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
@@ -41,6 +42,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/sockets.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
@@ -83,6 +85,10 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_JOBS = 278,
+    OPTION_RANDOM = 279,
+    OPTION_SEED = 280,
+    OPTION_RW_MIX = 281,
 };
 
 typedef enum OutputFormat {
@@ -1635,6 +1641,12 @@ enum ImgConvertBlockStatus {
     BLK_BACKING_FILE,
 };
 
+typedef struct ConvertExtent {
+    int64_t sector_num;
+    int64_t nb_sectors;
+    enum ImgConvertBlockStatus status;
+} ConvertExtent;
+
 #define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
@@ -1650,6 +1662,12 @@ typedef struct ImgConvertState {
     int64_t wr_offs;
     enum ImgConvertBlockStatus status;
     int64_t sector_next_status;
+    /*
+     * Merged extents of the whole source, only collected with copy
+     * offloading so that every data extent takes as few requests as possible
+     */
+    GArray *extents;
+    guint cur_extent;
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
@@ -1657,6 +1675,11 @@ typedef struct ImgConvertState {
     bool target_has_backing;
     int64_t target_backing_sectors; /* negative if unknown */
     bool wr_in_order;
+    /*
+     * The target lays out compressed writes in submission order, so writes
+     * only need to be submitted in order and may complete in parallel
+     */
+    bool wr_submit_in_order;
     bool copy_range;
     bool salvage;
     bool quiet;
@@ -1705,7 +1728,16 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
         }
     }
 
-    if (s->sector_next_status <= sector_num) {
+    if (s->sector_next_status <= sector_num && s->extents) {
+        ConvertExtent *e;
+
+        e = &g_array_index(s->extents, ConvertExtent, s->cur_extent);
+        while (e->sector_num + e->nb_sectors <= sector_num) {
+            e = &g_array_index(s->extents, ConvertExtent, ++s->cur_extent);
+        }
+        s->status = e->status;
+        s->sector_next_status = e->sector_num + e->nb_sectors;
+    } else if (s->sector_next_status <= sector_num) {
         uint64_t offset = (sector_num - src_cur_offset) * BDRV_SECTOR_SIZE;
         int64_t count;
         int tail;
@@ -1771,7 +1803,8 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
     }
 
     n = MIN(n, s->sector_next_status - sector_num);
-    if (s->status == BLK_DATA) {
+    /* Offloaded copies don't go through the buffer */
+    if (s->status == BLK_DATA && !s->copy_range) {
         n = MIN(n, s->buf_sectors);
     }
 
@@ -1939,6 +1972,71 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
+/*
+ * Copies a range through @buf after copy offloading failed for it.  The
+ * range may be larger than the buffer because it was not split for
+ * offloading.
+ */
+static void coroutine_fn convert_co_copy_buffered(ImgConvertState *s,
+                                                  int64_t sector_num,
+                                                  int nb_sectors, uint8_t *buf)
+{
+    int n, ret;
+
+    while (nb_sectors > 0) {
+        n = MIN(nb_sectors, s->buf_sectors);
+
+        ret = convert_co_read(s, sector_num, n, buf);
+        if (ret < 0) {
+            error_report("error while reading at byte %lld: %s",
+                         sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
+            s->ret = ret;
+            return;
+        }
+
+        ret = convert_co_write(s, sector_num, n, buf, BLK_DATA);
+        if (ret < 0) {
+            error_report("error while writing at byte %lld: %s",
+                         sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
+            s->ret = ret;
+            return;
+        }
+
+        sector_num += n;
+        nb_sectors -= n;
+    }
+}
+
+/*
+ * Lets the coroutine that waits to write at @wr_offs continue.  If
+ * @schedule is true, it only runs once the caller yields.
+ */
+static void coroutine_fn convert_wake_next_writer(ImgConvertState *s,
+                                                  int64_t wr_offs,
+                                                  bool schedule)
+{
+    int i;
+
+    s->wr_offs = wr_offs;
+    for (i = 0; i < s->num_coroutines; i++) {
+        if (s->co[i] && s->wait_sector_num[i] == s->wr_offs) {
+            if (schedule) {
+                /* Entered only once, it no longer waits when it runs */
+                s->wait_sector_num[i] = -1;
+                aio_co_schedule(qemu_get_aio_context(), s->co[i]);
+            } else {
+                /*
+                 * A -> B -> A cannot occur because A has
+                 * s->wait_sector_num[i] == -1 during A -> B.  Therefore
+                 * B will never enter A during this time window.
+                 */
+                qemu_coroutine_enter(s->co[i]);
+            }
+            break;
+        }
+    }
+}
+
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
@@ -1977,6 +2075,7 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         /* save current sector and allocation status to local variables */
         sector_num = s->sector_num;
         status = s->status;
+        copy_range = s->copy_range && status == BLK_DATA;
         if (!s->min_sparse && s->status == BLK_ZERO) {
             n = MIN(n, s->buf_sectors);
         }
@@ -1991,8 +2090,6 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
                                         s->allocated_sectors, 0);
         }
 
-retry:
-        copy_range = s->copy_range && s->status == BLK_DATA;
         if (status == BLK_DATA && !copy_range) {
             ret = convert_co_read(s, sector_num, n, buf);
             if (ret < 0) {
@@ -2012,40 +2109,39 @@ retry:
                 qemu_coroutine_yield();
             }
             s->wait_sector_num[index] = -1;
+
+            if (s->wr_submit_in_order) {
+                /*
+                 * Let the next writer go as soon as this write has been
+                 * submitted, i.e. when this coroutine yields in it
+                 */
+                convert_wake_next_writer(s, sector_num + n, true);
+            }
         }
 
         if (s->ret == -EINPROGRESS) {
             if (copy_range) {
                 ret = convert_co_copy_range(s, sector_num, n);
                 if (ret) {
+                    /* Don't try to offload any further copies */
                     s->copy_range = false;
-                    goto retry;
+                    convert_co_copy_buffered(s, sector_num, n, buf);
                 }
             } else {
                 ret = convert_co_write(s, sector_num, n, buf, status);
-            }
-            if (ret < 0) {
-                error_report("error while writing at byte %lld: %s",
-                             sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
-                s->ret = ret;
+                if (ret < 0) {
+                    error_report("error while writing at byte %lld: %s",
+                                 sector_num * BDRV_SECTOR_SIZE,
+                                 strerror(-ret));
+                    s->ret = ret;
+                }
             }
         }
 
-        if (s->wr_in_order) {
+        if (s->wr_in_order && !s->wr_submit_in_order) {
             /* reenter the coroutine that might have waited
              * for this write to complete */
-            s->wr_offs = sector_num + n;
-            for (i = 0; i < s->num_coroutines; i++) {
-                if (s->co[i] && s->wait_sector_num[i] == s->wr_offs) {
-                    /*
-                     * A -> B -> A cannot occur because A has
-                     * s->wait_sector_num[i] == -1 during A -> B.  Therefore
-                     * B will never enter A during this time window.
-                     */
-                    qemu_coroutine_enter(s->co[i]);
-                    break;
-                }
-            }
+            convert_wake_next_writer(s, sector_num + n, false);
         }
     }
 
@@ -2062,6 +2158,7 @@ static int convert_do_copy(ImgConvertState *s)
 {
     int ret, i, n;
     int64_t sector_num = 0;
+    g_autoptr(GArray) extents = NULL;
 
     /* Check whether we have zero initialisation or can get it efficiently */
     if (!s->has_zero_init && s->target_is_new && s->min_sparse &&
@@ -2079,6 +2176,10 @@ static int convert_do_copy(ImgConvertState *s)
         s->buf_sectors = s->cluster_sectors;
     }
 
+    if (s->copy_range) {
+        extents = g_array_new(false, false, sizeof(ConvertExtent));
+    }
+
     while (sector_num < s->total_sectors) {
         n = convert_iteration_sectors(s, sector_num);
         if (n < 0) {
@@ -2088,10 +2189,28 @@ static int convert_do_copy(ImgConvertState *s)
         {
             s->allocated_sectors += n;
         }
+        if (extents) {
+            ConvertExtent *last = extents->len ?
+                &g_array_index(extents, ConvertExtent, extents->len - 1) :
+                NULL;
+
+            if (last && last->status == s->status) {
+                last->nb_sectors += n;
+            } else {
+                ConvertExtent e = {
+                    .sector_num = sector_num,
+                    .nb_sectors = n,
+                    .status = s->status,
+                };
+                g_array_append_val(extents, e);
+            }
+        }
         sector_num += n;
     }
 
     /* Do the copy */
+    s->extents = extents;
+    s->cur_extent = 0;
     s->sector_next_status = 0;
     s->ret = -EINPROGRESS;
 
@@ -2105,6 +2224,7 @@ static int convert_do_copy(ImgConvertState *s)
     while (s->running_coroutines) {
         main_loop_wait(false);
     }
+    s->extents = NULL;
 
     if (s->compressed && !s->ret) {
         /* signal EOF to align */
@@ -2737,6 +2857,7 @@ static int img_convert(int argc, char **argv)
     } else {
         s.compressed = s.compressed || bdi.needs_compressed_writes;
         s.cluster_sectors = bdi.cluster_size / BDRV_SECTOR_SIZE;
+        s.wr_submit_in_order = s.compressed && bdi.ordered_compressed_writes;
     }
 
     if (rate_limit) {
@@ -4248,23 +4369,251 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+/*
+ * Latency histogram: values below BENCH_HIST_SUB have their own bucket,
+ * larger ones share BENCH_HIST_SUB buckets per power of two
+ */
+#define BENCH_HIST_SUB_BITS 4
+#define BENCH_HIST_SUB      (1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS  ((64 - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB)
+
+typedef struct BenchStats {
+    uint64_t requests;
+    uint64_t bytes;
+    uint64_t lat_min;
+    uint64_t lat_max;
+    uint64_t lat_sum;
+    uint64_t hist[BENCH_HIST_BUCKETS];
+} BenchStats;
+
+typedef struct BenchSize {
+    int size;
+    unsigned weight;
+} BenchSize;
+
+typedef struct BenchData BenchData;
+
+typedef struct BenchReq {
+    BenchData *b;
+    QEMUIOVector qiov;
+    uint8_t *buf;
+    uint8_t *read_buf;  /* with --rw-mix, so that buf keeps the pattern */
+    int64_t start_ns;
+    bool write;
+} BenchReq;
+
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
-    bool write;
-    int bufsize;
+    int write_percent;
+    bool random;
+    GRand *rand;
+    BenchSize *sizes;
+    int nb_sizes;
+    unsigned total_weight;
     int step;
     int nrreq;
     int n;
     int flush_interval;
     bool drain_on_flush;
-    uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchReq *reqs;
+    BenchReq **free_reqs;
+    int nb_free;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
-} BenchData;
+
+    BenchStats read;
+    BenchStats write;
+};
+
+static int bench_hist_index(uint64_t v)
+{
+    int e;
+
+    if (v < BENCH_HIST_SUB) {
+        return v;
+    }
+    e = 63 - clz64(v);
+    return (e - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB +
+           ((v >> (e - BENCH_HIST_SUB_BITS)) & (BENCH_HIST_SUB - 1));
+}
+
+/* Returns the smallest value that falls into bucket @i */
+static uint64_t bench_hist_value(int i)
+{
+    int e;
+
+    if (i < BENCH_HIST_SUB) {
+        return i;
+    }
+    e = i / BENCH_HIST_SUB + BENCH_HIST_SUB_BITS - 1;
+    return (uint64_t)(BENCH_HIST_SUB + i % BENCH_HIST_SUB) <<
+           (e - BENCH_HIST_SUB_BITS);
+}
+
+static uint64_t bench_percentile(BenchStats *st, double percent)
+{
+    uint64_t target = MAX(1, (uint64_t)(st->requests * percent / 100));
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        count += st->hist[i];
+        if (count >= target) {
+            return MIN(bench_hist_value(i), st->lat_max);
+        }
+    }
+    return st->lat_max;
+}
+
+static void bench_account(BenchStats *st, uint64_t bytes, uint64_t lat)
+{
+    if (!st->requests || lat < st->lat_min) {
+        st->lat_min = lat;
+    }
+    st->lat_max = MAX(st->lat_max, lat);
+    st->lat_sum += lat;
+    st->requests++;
+    st->bytes += bytes;
+    st->hist[bench_hist_index(lat)]++;
+}
+
+static void bench_stats_merge(BenchStats *to, BenchStats *from)
+{
+    int i;
+
+    if (!from->requests) {
+        return;
+    }
+    if (!to->requests || from->lat_min < to->lat_min) {
+        to->lat_min = from->lat_min;
+    }
+    to->lat_max = MAX(to->lat_max, from->lat_max);
+    to->lat_sum += from->lat_sum;
+    to->requests += from->requests;
+    to->bytes += from->bytes;
+    for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+        to->hist[i] += from->hist[i];
+    }
+}
+
+static void bench_print_human(const char *name, BenchStats *st, double secs)
+{
+    if (!st->requests) {
+        return;
+    }
+    printf("%s: %" PRIu64 " requests, %.1f IOPS, %.1f MiB/s\n", name,
+           st->requests, st->requests / secs, st->bytes / secs / MiB);
+    printf("  latency (us): min %.1f, avg %.1f, max %.1f, "
+           "p50 %.1f, p99 %.1f, p99.9 %.1f\n",
+           st->lat_min / 1000.0, st->lat_sum / 1000.0 / st->requests,
+           st->lat_max / 1000.0, bench_percentile(st, 50) / 1000.0,
+           bench_percentile(st, 99) / 1000.0,
+           bench_percentile(st, 99.9) / 1000.0);
+}
+
+static QDict *bench_stats_to_qdict(BenchStats *st, double secs)
+{
+    QDict *dict = qdict_new();
+    QDict *lat = qdict_new();
+
+    qdict_put_int(dict, "requests", st->requests);
+    qdict_put_int(dict, "bytes", st->bytes);
+    qdict_put(dict, "iops", qnum_from_double(st->requests / secs));
+    qdict_put(dict, "bandwidth", qnum_from_double(st->bytes / secs));
+
+    if (st->requests) {
+        qdict_put_int(lat, "min", st->lat_min);
+        qdict_put_int(lat, "max", st->lat_max);
+        qdict_put_int(lat, "mean", st->lat_sum / st->requests);
+        qdict_put_int(lat, "p50", bench_percentile(st, 50));
+        qdict_put_int(lat, "p99", bench_percentile(st, 99));
+        qdict_put_int(lat, "p99.9", bench_percentile(st, 99.9));
+    }
+    qdict_put(dict, "latency-ns", lat);
+    return dict;
+}
+
+/*
+ * Parses SIZE[:WEIGHT][,SIZE[:WEIGHT]...]; the weights default to 1.
+ * Returns the number of sizes, or -1 on error.
+ */
+static int bench_parse_sizes(const char *str, BenchSize **sizes)
+{
+    gchar **parts = g_strsplit(str, ",", 0);
+    int i, n = g_strv_length(parts);
+
+    *sizes = g_new0(BenchSize, n);
+    for (i = 0; i < n; i++) {
+        char *weight = strchr(parts[i], ':');
+        unsigned long res = 1;
+        int64_t sval;
+
+        if (weight) {
+            *weight++ = '\0';
+            if (qemu_strtoul(weight, NULL, 0, &res) < 0 || !res ||
+                res > 1000000) {
+                error_report("Invalid weight specified for buffer size %s",
+                             parts[i]);
+                goto fail;
+            }
+        }
+        sval = cvtnum_full("buffer size", parts[i], 1, INT_MAX);
+        if (sval < 0) {
+            goto fail;
+        }
+        (*sizes)[i] = (BenchSize) {
+            .size = sval,
+            .weight = res,
+        };
+    }
+    g_strfreev(parts);
+    return n;
+
+fail:
+    g_strfreev(parts);
+    g_free(*sizes);
+    *sizes = NULL;
+    return -1;
+}
+
+static int bench_pick_size(BenchData *b)
+{
+    unsigned w;
+    int i;
+
+    if (b->nb_sizes == 1) {
+        return b->sizes[0].size;
+    }
+    w = g_rand_int_range(b->rand, 0, b->total_weight);
+    for (i = 0; i < b->nb_sizes - 1; i++) {
+        if (w < b->sizes[i].weight) {
+            break;
+        }
+        w -= b->sizes[i].weight;
+    }
+    return b->sizes[i].size;
+}
+
+static uint64_t bench_pick_offset(BenchData *b, int size)
+{
+    uint64_t offset, nb_blocks;
+
+    if (b->random) {
+        nb_blocks = MAX(1, b->image_size / size);
+        offset = ((uint64_t)g_rand_int(b->rand) << 32 | g_rand_int(b->rand));
+        return offset % nb_blocks * size;
+    }
+
+    offset = b->offset;
+    b->offset += b->step ?: size;
+    b->offset %= b->image_size;
+    return offset;
+}
+
+static void bench_submit(BenchData *b);
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4274,63 +4623,93 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
-static void bench_cb(void *opaque, int ret)
+static void bench_drained_flush_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
+
+    bench_undrained_flush_cb(opaque, ret);
+
+    /* Just finished a flush with drained queue: Start next requests */
+    assert(b->in_flight == 0);
+    b->in_flush = false;
+    bench_submit(b);
+}
+
+static void bench_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchData *b = req->b;
     BlockAIOCB *acb;
+    int remaining;
 
     if (ret < 0) {
         error_report("Failed request: %s", strerror(-ret));
         exit(EXIT_FAILURE);
     }
 
-    if (b->in_flush) {
-        /* Just finished a flush with drained queue: Start next requests */
-        assert(b->in_flight == 0);
-        b->in_flush = false;
-    } else if (b->in_flight > 0) {
-        int remaining = b->n - b->in_flight;
+    bench_account(req->write ? &b->write : &b->read, req->qiov.size,
+                  get_clock() - req->start_ns);
+    b->free_reqs[b->nb_free++] = req;
 
-        b->n--;
-        b->in_flight--;
+    remaining = b->n - b->in_flight;
+    b->n--;
+    b->in_flight--;
 
-        /* Time for flush? Drain queue if requested, then flush */
-        if (b->flush_interval && remaining % b->flush_interval == 0) {
-            if (!b->in_flight || !b->drain_on_flush) {
-                BlockCompletionFunc *cb;
-
-                if (b->drain_on_flush) {
-                    b->in_flush = true;
-                    cb = bench_cb;
-                } else {
-                    cb = bench_undrained_flush_cb;
-                }
+    /* Time for flush? Drain queue if requested, then flush */
+    if (b->flush_interval && remaining % b->flush_interval == 0) {
+        if (!b->in_flight || !b->drain_on_flush) {
+            BlockCompletionFunc *cb;
 
-                acb = blk_aio_flush(b->blk, cb, b);
-                if (!acb) {
-                    error_report("Failed to issue flush request");
-                    exit(EXIT_FAILURE);
-                }
-            }
             if (b->drain_on_flush) {
-                return;
+                b->in_flush = true;
+                cb = bench_drained_flush_cb;
+            } else {
+                cb = bench_undrained_flush_cb;
+            }
+
+            acb = blk_aio_flush(b->blk, cb, b);
+            if (!acb) {
+                error_report("Failed to issue flush request");
+                exit(EXIT_FAILURE);
             }
         }
+        if (b->drain_on_flush) {
+            return;
+        }
     }
 
-    while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+    bench_submit(b);
+}
+
+static void bench_submit(BenchData *b)
+{
+    BlockAIOCB *acb;
+
+    while (b->n > b->in_flight && b->in_flight < b->nrreq && !b->in_flush) {
+        BenchReq *req = b->free_reqs[--b->nb_free];
+        int size = bench_pick_size(b);
+        int64_t offset = bench_pick_offset(b, size);
+        uint8_t *buf;
+
+        req->write = b->write_percent == 100 ||
+                     (b->write_percent &&
+                      g_rand_int_range(b->rand, 0, 100) < b->write_percent);
+        buf = req->write || !req->read_buf ? req->buf : req->read_buf;
+        qemu_iovec_reset(&req->qiov);
+        qemu_iovec_add(&req->qiov, buf, size);
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        req->start_ns = get_clock();
+        if (req->write) {
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0, bench_cb,
+                                  req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0, bench_cb,
+                                 req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4349,20 +4728,32 @@ static int img_bench(int argc, char **argv)
     int count = 75000;
     int depth = 64;
     int64_t offset = 0;
-    size_t bufsize = 4096;
+    BenchSize default_size = { .size = 4096, .weight = 1 };
+    BenchSize *sizes = NULL;
+    int nb_sizes = 0;
+    int max_size = 0;
+    unsigned total_weight = 0;
     int pattern = 0;
     size_t step = 0;
     int flush_interval = 0;
     bool drain_on_flush = true;
+    int write_percent = -1;
+    bool rand_offsets = false;
+    uint32_t seed = 0;
+    int nb_jobs = 1;
+    const char *output = NULL;
+    OutputFormat output_format = OFORMAT_HUMAN;
     int64_t image_size;
     BlockBackend *blk = NULL;
-    BenchData data = {};
+    BenchData *jobs = NULL;
+    BenchStats read_stats = {}, write_stats = {};
     int flags = 0;
     bool writethrough = false;
-    struct timeval t1, t2;
-    int i;
+    int64_t t1, t2;
+    double secs;
+    bool running;
+    int i, j;
     bool force_share = false;
-    size_t buf_size;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4372,6 +4763,11 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"jobs", required_argument, 0, OPTION_JOBS},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"seed", required_argument, 0, OPTION_SEED},
+            {"rw-mix", required_argument, 0, OPTION_RW_MIX},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:ni:o:qs:S:t:wU", long_options,
@@ -4439,17 +4835,12 @@ static int img_bench(int argc, char **argv)
             quiet = true;
             break;
         case 's':
-        {
-            int64_t sval;
-
-            sval = cvtnum_full("buffer size", optarg, 0, INT_MAX);
-            if (sval < 0) {
+            g_free(sizes);
+            nb_sizes = bench_parse_sizes(optarg, &sizes);
+            if (nb_sizes < 0) {
                 return 1;
             }
-
-            bufsize = sval;
             break;
-        }
         case 'S':
         {
             int64_t sval;
@@ -4505,6 +4896,46 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_JOBS:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || !res ||
+                res > 1024) {
+                error_report("Invalid number of jobs specified");
+                return 1;
+            }
+            nb_jobs = res;
+            break;
+        }
+        case OPTION_RANDOM:
+            rand_offsets = true;
+            break;
+        case OPTION_SEED:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > UINT32_MAX) {
+                error_report("Invalid seed specified");
+                return 1;
+            }
+            seed = res;
+            break;
+        }
+        case OPTION_RW_MIX:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid write percentage specified");
+                return 1;
+            }
+            write_percent = res;
+            break;
+        }
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         }
     }
 
@@ -4513,16 +4944,44 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        ret = -1;
+        goto out;
+    }
+
     if (!is_write && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
     }
+    if (!is_write && write_percent >= 0) {
+        error_report("--rw-mix is only available in write tests");
+        ret = -1;
+        goto out;
+    }
     if (flush_interval && flush_interval < depth) {
         error_report("Flush interval can't be smaller than depth");
         ret = -1;
         goto out;
     }
+    if (!depth) {
+        error_report("Queue depth must be at least 1");
+        ret = -1;
+        goto out;
+    }
+    if (!sizes) {
+        sizes = g_memdup2(&default_size, sizeof(default_size));
+        nb_sizes = 1;
+    }
+    for (i = 0; i < nb_sizes; i++) {
+        max_size = MAX(max_size, sizes[i].size);
+        total_weight += sizes[i].weight;
+    }
 
     blk = img_open(image_opts, filename, fmt, flags, writethrough, quiet,
                    force_share);
@@ -4536,57 +4995,129 @@ static int img_bench(int argc, char **argv)
         ret = image_size;
         goto out;
     }
-
-    data = (BenchData) {
-        .blk            = blk,
-        .image_size     = image_size,
-        .bufsize        = bufsize,
-        .step           = step ?: bufsize,
-        .nrreq          = depth,
-        .n              = count,
-        .offset         = offset,
-        .write          = is_write,
-        .flush_interval = flush_interval,
-        .drain_on_flush = drain_on_flush,
-    };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
+    if (rand_offsets && image_size < max_size) {
+        error_report("The image is smaller than the buffer size");
+        ret = -1;
+        goto out;
     }
 
-    buf_size = data.nrreq * data.bufsize;
-    data.buf = blk_blockalign(blk, buf_size);
-    memset(data.buf, pattern, data.nrreq * data.bufsize);
+    jobs = g_new0(BenchData, nb_jobs);
+    for (i = 0; i < nb_jobs; i++) {
+        BenchData *b = &jobs[i];
+
+        *b = (BenchData) {
+            .blk            = blk,
+            .image_size     = image_size,
+            .write_percent  = is_write ? (write_percent < 0 ? 100 :
+                                          write_percent) : 0,
+            .random         = rand_offsets,
+            .rand           = g_rand_new_with_seed(seed + i),
+            .sizes          = sizes,
+            .nb_sizes       = nb_sizes,
+            .total_weight   = total_weight,
+            .step           = step ?: (nb_sizes == 1 ? sizes[0].size : 0),
+            .nrreq          = depth,
+            .n              = count,
+            /* Sequential jobs start evenly spread over the image */
+            .offset         = (offset + i * (image_size / nb_jobs)) %
+                              image_size,
+            .flush_interval = flush_interval,
+            .drain_on_flush = drain_on_flush,
+        };
 
-    blk_register_buf(blk, data.buf, buf_size);
+        b->reqs = g_new0(BenchReq, depth);
+        b->free_reqs = g_new(BenchReq *, depth);
+        for (j = 0; j < depth; j++) {
+            BenchReq *req = &b->reqs[j];
+
+            req->b = b;
+            req->buf = blk_blockalign(blk, max_size);
+            memset(req->buf, pattern, max_size);
+            blk_register_buf(blk, req->buf, max_size);
+            if (b->write_percent && b->write_percent < 100) {
+                req->read_buf = blk_blockalign(blk, max_size);
+                blk_register_buf(blk, req->read_buf, max_size);
+            }
+            qemu_iovec_init(&req->qiov, 1);
+            b->free_reqs[b->nb_free++] = req;
+        }
+    }
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
-    for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
-                       data.buf + i * data.bufsize, data.bufsize);
+    if (output_format == OFORMAT_HUMAN) {
+        printf("Sending %d %s requests, %d bytes each, %d in parallel "
+               "(starting at offset %" PRId64 ", step size %d)\n",
+               count, is_write ? "write" : "read", sizes[0].size, depth,
+               offset, jobs[0].step);
+        if (nb_jobs > 1 || nb_sizes > 1 || rand_offsets ||
+            (is_write && write_percent >= 0)) {
+            printf("Using %d jobs, %d buffer sizes, %s offsets, "
+                   "%d%% writes\n", nb_jobs, nb_sizes,
+                   rand_offsets ? "random" : "sequential",
+                   jobs[0].write_percent);
+        }
+        if (flush_interval) {
+            printf("Sending flush every %d requests\n", flush_interval);
+        }
     }
 
-    gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
+    t1 = get_clock();
+    for (i = 0; i < nb_jobs; i++) {
+        bench_submit(&jobs[i]);
+    }
 
-    while (data.n > 0) {
+    do {
         main_loop_wait(false);
+        running = false;
+        for (i = 0; i < nb_jobs; i++) {
+            running |= jobs[i].n > 0;
+        }
+    } while (running);
+    t2 = get_clock();
+
+    secs = (t2 - t1) / (double)NANOSECONDS_PER_SECOND;
+    for (i = 0; i < nb_jobs; i++) {
+        bench_stats_merge(&read_stats, &jobs[i].read);
+        bench_stats_merge(&write_stats, &jobs[i].write);
     }
-    gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    if (output_format == OFORMAT_JSON) {
+        QDict *dict = qdict_new();
+        GString *str;
+
+        qdict_put(dict, "time", qnum_from_double(secs));
+        qdict_put_int(dict, "jobs", nb_jobs);
+        qdict_put(dict, "read", bench_stats_to_qdict(&read_stats, secs));
+        qdict_put(dict, "write", bench_stats_to_qdict(&write_stats, secs));
+
+        str = qobject_to_json_pretty(QOBJECT(dict), true);
+        printf("%s\n", str->str);
+        g_string_free(str, true);
+        qobject_unref(dict);
+    } else {
+        printf("Run completed in %3.3f seconds.\n", secs);
+        bench_print_human("read", &read_stats, secs);
+        bench_print_human("write", &write_stats, secs);
+    }
 
 out:
-    if (data.buf) {
-        blk_unregister_buf(blk, data.buf);
+    for (i = 0; jobs && i < nb_jobs; i++) {
+        for (j = 0; j < depth; j++) {
+            BenchReq *req = &jobs[i].reqs[j];
+
+            blk_unregister_buf(blk, req->buf);
+            qemu_vfree(req->buf);
+            if (req->read_buf) {
+                blk_unregister_buf(blk, req->read_buf);
+                qemu_vfree(req->read_buf);
+            }
+            qemu_iovec_destroy(&req->qiov);
+        }
+        g_free(jobs[i].reqs);
+        g_free(jobs[i].free_reqs);
+        g_rand_free(jobs[i].rand);
     }
-    qemu_vfree(data.buf);
+    g_free(jobs);
+    g_free(sizes);
     blk_unref(blk);
 
     if (ret) {
@@ -150,9 +150,12 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                perf-map=on|off (write a perf map of TCG generated code)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-stats=on|off (collect TCG translation block statistics)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                halt-poll-ns=n (KVM halt polling time for this VM)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
 ``-accel name[,prop=value[,...]]``
@@ -177,6 +180,12 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``perf-map=on|off``
+        Writes the address and size of each TCG translation block, named
+        after its guest PC and symbol, to ``/tmp/perf-<pid>.map`` so that
+        ``perf report`` can attribute samples in generated code. The
+        default is off.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -186,6 +195,12 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``tb-stats=on|off``
+        Collects execution, translation and invalidation counts for
+        each guest block, queryable with ``info tb-stats``. Translated
+        code then updates a counter on each block execution. The
+        default is off.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -204,6 +219,15 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+    ``halt-poll-ns=n``
+        When the KVM accelerator is used, it sets the maximum time in
+        nanoseconds that a halted vCPU of this VM polls for a wakeup before
+        it is put to sleep.  KVM grows and shrinks the polling time of
+        each vCPU up to this limit, depending on how soon the vCPU was
+        woken up in the past.  Large values lower wakeup latency at the
+        cost of host CPU time; 0 disables polling.  By default, the host's
+        ``halt_poll_ns`` module parameter is used.
+
 ERST
 
 DEF("smp", HAS_ARG, QEMU_OPTION_smp,
@@ -1218,6 +1242,17 @@ SRST
             Specifies the AIO backend (threads/native/io_uring,
             default: threads)
 
+        ``aio-sqpoll``
+            With aio=io_uring, poll the submission queue from a kernel
+            thread instead of submitting requests with a system call
+            (on/off, default: off)
+
+        ``aio-register-buffers``
+            With aio=io_uring, register guest RAM with the kernel so that
+            pages are not pinned again for every request. Guest RAM stays
+            pinned and cannot be discarded while the node is open
+            (on/off, default: off)
+
         ``locking``
             Specifies whether the image file is protected with Linux OFD
             / POSIX locks. The default is to use the Linux Open File
@@ -1295,6 +1330,35 @@ SRST
             supporting platforms, and 0 on other platforms. Setting it
             to 0 disables this feature.
 
+        ``alloc-pool-size``
+            Allocate data clusters in batches of this many bytes (at
+            most 1 GiB) and use them for allocating writes, which saves
+            most of the refcount updates. Clusters that are still unused
+            when QEMU crashes are leaked until ``qemu-img check -r
+            leaks`` is run. The default value is 0, which disables this
+            feature.
+
+        ``decompress-cache-size``
+            The maximum size of the cache of decompressed clusters in
+            bytes. Repeated reads of the same compressed clusters, e.g.
+            from a compressed base image while guests boot, are then
+            served without decompressing the data again. The cache is
+            shared by all users of the node. The default value is 0,
+            which disables this feature.
+
+        ``shared-l2-cache``
+            Path of a file, typically on tmpfs, which holds a cache of
+            L2 tables that is shared by all processes using the image
+            with the same file, so that many VMs with a common backing
+            file load its L2 tables only once. The file is created if
+            it does not exist. It is only used while the image is
+            read-only, and the image must not be modified as long as
+            the file exists.
+
+        ``shared-l2-cache-size``
+            The size of the shared L2 table cache in bytes, if the file
+            given by ``shared-l2-cache`` is created (default: 32 MiB)
+
         ``pass-discard-request``
             Whether discard requests to the qcow2 device should be
             forwarded to the data source (on/off; default: on if
@@ -2097,7 +2161,8 @@ DEF("spice", HAS_ARG, QEMU_OPTION_spice,
     "       [,image-compression=[auto_glz|auto_lz|quic|glz|lz|off]]\n"
     "       [,jpeg-wan-compression=[auto|never|always]]\n"
     "       [,zlib-glz-wan-compression=[auto|never|always]]\n"
-    "       [,streaming-video=[off|all|filter]][,disable-copy-paste=on|off]\n"
+    "       [,streaming-video=[off|all|filter]][,video-codecs=<codecs>]\n"
+    "       [,disable-copy-paste=on|off]\n"
     "       [,disable-agent-file-xfer=on|off][,agent-mouse=[on|off]]\n"
     "       [,playback-compression=[on|off]][,seamless-migration=[on|off]]\n"
     "       [,gl=[on|off]][,rendernode=<file>]\n"
@@ -2184,6 +2249,17 @@ SRST
     ``streaming-video=[off|all|filter]``
         Configure video stream detection. Default is off.
 
+    ``video-codecs=<codecs>``
+        Set the encoders to use for video streams, in order of
+        preference, as a semicolon-separated list of
+        ``encoder:codec`` pairs, for example
+        ``gstreamer:h264;gstreamer:vp8;spice:mjpeg``.  The
+        ``gstreamer`` encoders use the hardware encoders available
+        to GStreamer on the host, such as VA-API, which lowers the
+        CPU cost and the bandwidth of remote sessions.  Requires
+        spice-server 0.13.2 or newer.  The default is chosen by
+        spice-server.
+
     ``agent-mouse=[on|off]``
         Enable/disable passing mouse events via vdagent. Default is on.
 
@@ -2659,7 +2735,11 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "-netdev tap,id=str[,fd=h][,fds=x:y:...:z][,ifname=name][,script=file][,downscript=dfile]\n"
     "         [,br=bridge][,helper=helper][,sndbuf=nbytes][,vnet_hdr=on|off][,vhost=on|off]\n"
     "         [,vhostfd=h][,vhostfds=x:y:...:z][,vhostforce=on|off][,queues=n]\n"
-    "         [,poll-us=n]\n"
+    "         [,poll-us=n]"
+#ifdef CONFIG_LINUX_IO_URING
+    "[,io-uring=on|off]"
+#endif
+    "\n"
     "                configure a host TAP network backend with ID 'str'\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
     "                use network scripts 'file' (default=" DEFAULT_NETWORK_SCRIPT ")\n"
@@ -2682,6 +2762,9 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                use 'queues=n' to specify the number of queues to be created for multiqueue TAP\n"
     "                use 'poll-us=n' to specify the maximum number of microseconds that could be\n"
     "                spent on busy polling for vhost net\n"
+#ifdef CONFIG_LINUX_IO_URING
+    "                use io-uring=on to batch packet reads and writes with io_uring\n"
+#endif
     "-netdev bridge,id=str[,br=bridge][,helper=helper]\n"
     "                configure a host TAP network backend with ID 'str' that is\n"
     "                connected to a bridge (default=" DEFAULT_BRIDGE_INTERFACE ")\n"
@@ -2736,13 +2819,30 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-budget=n]\n"
+    "                attach to the existing network interface 'name' with AF_XDP socket\n"
+    "                use 'mode=MODE' to specify an XDP program attach mode\n"
+    "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
+    "                use 'inhibit=on|off' to inhibit loading of a default XDP program (default: off)\n"
+    "                    with inhibit=on,\n"
+    "                      use 'sock-fds' to provide file descriptors for already open AF_XDP sockets\n"
+    "                      added to a socket map in XDP program.  One socket per queue.\n"
+    "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
+    "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-budget=n' to enable busy polling with a budget of n packets\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
 #endif
 #ifdef __linux__
-    "-netdev vhost-vdpa,id=str,vhostdev=/path/to/dev\n"
+    "-netdev vhost-vdpa,id=str,vhostdev=/path/to/dev[,x-svq-migration=on|off]\n"
     "                configure a vhost-vdpa network,Establish a vhost-vdpa netdev\n"
+    "                use 'x-svq-migration=on' to shadow the virtqueues while\n"
+    "                migrating (experimental)\n"
 #endif
     "-netdev hubport,id=str,hubid=n[,netdev=nd]\n"
     "                configure a hub port on the hub with ID 'n'\n", QEMU_ARCH_ALL)
@@ -2760,6 +2860,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -3004,6 +3107,11 @@ SRST
     ``fd``\ =h can be used to specify the handle of an already opened
     host TAP interface.
 
+    ``io-uring=on`` reads and writes packets through io_uring when QEMU
+    is built with io_uring support. Reads are kept posted into a pool of
+    buffers and writes are submitted in batches, so fewer system calls
+    are needed per packet. It cannot be combined with vhost.
+
     Examples:
 
     .. parsed-literal::
@@ -3203,6 +3311,63 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-budget=n]``
+    Configure AF_XDP backend to connect to a network interface 'name'
+    using AF_XDP socket. A specific program attach mode for a default
+    XDP program can be forced with 'mode', defaults to best-effort,
+    where the likely most performant mode will be in use. Number of
+    queues 'n' should generally match the number of queues in the
+    interface and defaults to 1. Traffic arriving on non-configured
+    device queues will not be delivered to the network backend.
+
+    .. parsed-literal::
+
+        # set number of queues to 4
+        ethtool -L eth0 combined 4
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=4
+
+    'start-queue' option can be specified if a particular range of queues
+    [m, m + n] should be in use. For example, this may be necessary in
+    order to use certain NICs in native mode. Kernel allows the driver to
+    create a separate set of XDP queues on top of regular ones, and only
+    these queues can be used for AF_XDP sockets. NICs that work this way
+    may also require an additional traffic redirection with ethtool to
+    these special queues.
+
+    .. parsed-literal::
+
+        # set number of queues to 1
+        ethtool -L eth0 combined 1
+        # redirect all the traffic to the second queue (id: 1)
+        # note: drivers may require non-empty key/mask pair.
+        ethtool -N eth0 flow-type ether \\
+            dst 00:00:00:00:00:00 m FF:FF:FF:FF:FF:FE action 1
+        ethtool -N eth0 flow-type ether \\
+            dst 00:00:00:00:00:01 m FF:FF:FF:FF:FF:FE action 1
+        # launch QEMU instance
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=1,start-queue=1
+
+    XDP program can also be loaded externally. In this case 'inhibit'
+    option should be set to 'on' and 'sock-fds' provided with file
+    descriptors for already open but not bound XDP sockets already added
+    to a socket map for corresponding queues. One socket per queue.
+
+    .. parsed-literal::
+
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
+
+    With 'busy-budget', the sockets use preferred busy polling: the
+    driver processes up to n packets from the system calls that QEMU
+    makes, instead of from interrupts. This needs the interface to be
+    configured to defer interrupts, for example::
+
+        echo 2 > /sys/class/net/eth0/napi_defer_hard_irqs
+        echo 200000 > /sys/class/net/eth0/gro_flush_timeout
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -3222,7 +3387,7 @@ SRST
              -netdev type=vhost-user,id=net0,chardev=chr0 \
              -device virtio-net-pci,netdev=net0
 
-``-netdev vhost-vdpa,vhostdev=/path/to/dev``
+``-netdev vhost-vdpa,vhostdev=/path/to/dev[,x-svq-migration=on|off]``
     Establish a vhost-vdpa netdev.
 
     vDPA device is a device that uses a datapath which complies with
@@ -3230,6 +3395,14 @@ SRST
     vDPA devices can be both physically located on the hardware or
     emulated by software.
 
+    vDPA devices usually cannot log the guest memory they write, which
+    prevents migration.  With ``x-svq-migration=on`` (experimental),
+    QEMU relays the virtqueues through shadow virtqueues while the guest
+    is being migrated and logs the written memory itself; the device goes
+    back to accessing the guest's virtqueues directly when the migration
+    completes or fails.  Packed virtqueues and ``VIRTIO_F_IN_ORDER`` are
+    not offered to the guest in this mode.
+
 ``-netdev hubport,id=id,hubid=hubid[,netdev=nd]``
     Create a hub port on the emulated hub with ID hubid.
 
@@ -3384,7 +3557,7 @@ The available backends are:
     A void device. This device will not emit any data, and will drop any
     data it receives. The null backend does not take any options.
 
-``-chardev socket,id=id[,TCP options or unix options][,server=on|off][,wait=on|off][,telnet=on|off][,websocket=on|off][,reconnect=seconds][,tls-creds=id][,tls-authz=id]``
+``-chardev socket,id=id[,TCP options or unix options][,server=on|off][,wait=on|off][,telnet=on|off][,websocket=on|off][,reconnect=seconds][,coalesce=ms][,tls-creds=id][,tls-authz=id]``
     Create a two-way stream socket, which can be either a TCP or a unix
     socket. A unix socket will be created if ``path`` is specified.
     Behaviour is undefined if TCP options are specified for a unix
@@ -3406,6 +3579,11 @@ The available backends are:
     seconds and then attempt to reconnect. Zero disables reconnecting,
     and is the default.
 
+    ``coalesce`` gathers small writes, such as those of a busy serial
+    console, and sends them together after at most this many
+    milliseconds, or sooner if the buffer fills up. Zero sends every
+    write at once, and is the default.
+
     ``tls-creds`` requests enablement of the TLS protocol for
     encryption, and specifies the id of the TLS credentials to use for
     the handshake. The credentials must be previously created with the
@@ -4766,6 +4944,9 @@ SRST
         from core dumps. This feature is also known as MADV\_DONTDUMP.
 
         The ``prealloc`` boolean option enables memory preallocation.
+        The preallocation threads run on the CPUs of the NUMA host nodes
+        in ``host-nodes``, if set.  Memory backends created on startup are
+        preallocated while the machine and its devices are being created.
 
         The ``host-nodes`` option binds the memory range to a list of
         NUMA host nodes.
@@ -4908,7 +5089,7 @@ SRST
         recommended that a persistent set of parameters be generated up
         front and saved.
 
-    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id``
+    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id,ktls=on|off``
         Creates a TLS anonymous credentials object, which can be used to
         provide TLS support on network backends. The ``id`` parameter is
         a unique ID which network backends will use to access the
@@ -4952,6 +5133,17 @@ SRST
         string as described at
         https://gnutls.org/manual/html_node/Priority-Strings.html.
 
+        If ``ktls`` is enabled, then once the handshake of a connection
+        over TCP is completed, encryption of the data that QEMU sends is
+        handed over to the Linux kernel (kTLS); this needs the ``tls``
+        kernel module and a session using AES-GCM or ChaCha20-Poly1305
+        with TLS 1.2; TLS 1.3 sessions are still encrypted by QEMU, as
+        the kernel cannot honour key update requests from the peer. The
+        ``ktls`` parameter is also accepted by the other TLS credentials
+        objects. It allows the zero-copy-send migration capability to be
+        used together with TLS, provided that every multifd channel did
+        hand its encryption over to the kernel.
+
     ``-object tls-cipher-suites,id=id,priority=priority``
         Creates a TLS cipher suites object, which can be used to control
         the TLS cipher/protocol algorithms that applications are permitted
@@ -5030,6 +5222,15 @@ SRST
 
         ``behind``: insert behind the specified filter (default).
 
+    ``-object filter-gro,id=id,netdev=netdevid[,timeout=t][,queue=all|rx|tx][,status=on|off][,position=head|tail|id=<id>][,insert=behind|before]``
+        Merge in-order TCP segments over IPv4 that netdev netdevid sends
+        to the guest into large GSO packets, so that the guest handles
+        fewer, bigger packets. Segments are held for at most t
+        microseconds (default 50). The filter only merges while the
+        netdev uses vnet headers (e.g. ``-netdev tap,vnet_hdr=on``) and
+        the guest has enabled checksum and TSO offloads; other packets
+        are passed on unmodified.
+
     ``-object filter-mirror,id=id,netdev=netdevid,outdev=chardevid,queue=all|rx|tx[,vnet_hdr_support][,position=head|tail|id=<id>][,insert=behind|before]``
         filter-mirror on netdev netdevid,mirror net packet to
         chardevchardevid, if it has the vnet\_hdr\_support flag,
@@ -5414,6 +5615,13 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
+    ``-object stats-shm,id=id,path=path[,interval=ms]``
+        Publishes statistics of block backends, vCPUs and migration in
+        the file ``path``, updated every ``interval`` milliseconds
+        (default 100). Monitoring agents can map the file and read it
+        without a monitor connection. The format is described in
+        ``docs/interop/stats-shm.rst``.
+
     ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
@@ -5436,7 +5644,9 @@ SRST
         event occurs, the polling algorithm spins waiting for events for
         a short time. The algorithm's default parameters are suitable
         for many cases but can be adjusted based on knowledge of the
-        workload and/or host device latency.
+        workload and/or host device latency.  The polling time is tuned
+        separately for each event source (for example each virtqueue or
+        disk), so rarely active sources do not cause spinning.
 
         The ``poll-max-ns`` parameter is the maximum number of
         nanoseconds to busy wait for events. Polling can be disabled by
@@ -362,7 +362,7 @@ GuestFileRead *guest_file_read_unsafe(GuestFileHandle *gfh,
     bool is_ok;
     DWORD read_count;
 
-    buf = g_malloc0(count + 1);
+    buf = g_malloc(count + 1);
     is_ok = ReadFile(fh, buf, count, &read_count, NULL);
     if (!is_ok) {
         error_setg_win32(errp, GetLastError(), "failed to read file");
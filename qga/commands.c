@@ -23,7 +23,10 @@
 
 /* Maximum captured guest-exec out_data/err_data - 16MB */
 #define GUEST_EXEC_MAX_OUTPUT (16 * 1024 * 1024)
-/* Allocation and I/O buffer for reading guest-exec out_data/err_data - 4KB */
+/*
+ * Initial allocation and I/O buffer for reading guest-exec out_data/err_data
+ * - 4KB.  The allocation doubles from there.
+ */
 #define GUEST_EXEC_IO_SIZE (4 * 1024)
 /*
  * Maximum file size to read - 48MB
@@ -345,8 +348,11 @@ static gboolean guest_exec_output_watch(GIOChannel *ch,
 
     if (p->size == p->length) {
         gpointer t = NULL;
+        size_t size = MIN(MAX(p->size * 2, GUEST_EXEC_IO_SIZE),
+                          GUEST_EXEC_MAX_OUTPUT);
+
         if (!p->truncated && p->size < GUEST_EXEC_MAX_OUTPUT) {
-            t = g_try_realloc(p->data, p->size + GUEST_EXEC_IO_SIZE);
+            t = g_try_realloc(p->data, size);
         }
         if (t == NULL) {
             /* ignore truncated output */
@@ -361,7 +367,7 @@ static gboolean guest_exec_output_watch(GIOChannel *ch,
 
             return true;
         }
-        p->size += GUEST_EXEC_IO_SIZE;
+        p->size = size;
         p->data = t;
     }
 
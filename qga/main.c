@@ -58,6 +58,8 @@
 #define QGA_FSFREEZE_HOOK_DEFAULT CONFIG_QEMU_CONFDIR "/fsfreeze-hook"
 #endif
 #define QGA_SENTINEL_BYTE 0xFF
+/* Large guest-file-write requests are read in chunks of this size */
+#define QGA_CHANNEL_READ_SIZE (64 * 1024)
 #define QGA_CONF_DEFAULT CONFIG_QEMU_CONFDIR G_DIR_SEPARATOR_S "qemu-ga.conf"
 #define QGA_RETRY_INTERVAL 5
 
@@ -586,9 +588,10 @@ end:
 static gboolean channel_event_cb(GIOCondition condition, gpointer data)
 {
     GAState *s = data;
-    gchar buf[QGA_READ_COUNT_DEFAULT + 1];
+    gchar buf[QGA_CHANNEL_READ_SIZE + 1];
     gsize count;
-    GIOStatus status = ga_channel_read(s->channel, buf, QGA_READ_COUNT_DEFAULT, &count);
+    GIOStatus status = ga_channel_read(s->channel, buf, QGA_CHANNEL_READ_SIZE,
+                                       &count);
     switch (status) {
     case G_IO_STATUS_ERROR:
         g_warning("error reading channel");
@@ -1056,6 +1056,7 @@ typedef struct OCFData
 {
     void (*fn)(ObjectClass *klass, void *opaque);
     const char *implements_type;
+    TypeImpl *target;           /* implements_type, unless an interface */
     bool include_abstract;
     void *opaque;
 } OCFData;
@@ -1067,14 +1068,23 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
-    type_initialize(type);
-    k = type->class;
-
     if (!data->include_abstract && type->abstract) {
         return;
     }
 
-    if (data->implements_type && 
+    /*
+     * Only the parent chain is needed to rule out a type, so do not
+     * initialize classes that cannot match.  Interfaces are only known
+     * once the class is initialized.
+     */
+    if (data->target && !type_is_ancestor(type, data->target)) {
+        return;
+    }
+
+    type_initialize(type);
+    k = type->class;
+
+    if (data->implements_type &&
         !object_class_dynamic_cast(k, data->implements_type)) {
         return;
     }
@@ -1086,7 +1096,15 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
                           const char *implements_type, bool include_abstract,
                           void *opaque)
 {
-    OCFData data = { fn, implements_type, include_abstract, opaque };
+    OCFData data = { fn, implements_type, NULL, include_abstract, opaque };
+
+    if (implements_type) {
+        TypeImpl *target = type_get_by_name(implements_type);
+
+        if (target && !type_is_ancestor(target, type_interface)) {
+            data.target = target;
+        }
+    }
 
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
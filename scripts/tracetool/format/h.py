@@ -89,11 +89,17 @@ def generate(events, backend, group):
             'static inline void %(api)s(%(args)s)',
             '{',
             '    if (%(cond)s) {',
+            '        if (%(backend_dstate)s() &&',
+            '            !trace_event_sample(&%(event)s)) {',
+            '            return;',
+            '        }',
             '        %(api_nocheck)s(%(names)s);',
             '    }',
             '}',
             api=e.api(),
             api_nocheck=e.api(e.QEMU_TRACE_NOCHECK),
+            backend_dstate=e.api(e.QEMU_BACKEND_DSTATE),
+            event=e.api(e.QEMU_EVENT),
             args=e.args,
             names=", ".join(e.args.names()),
             cond=cond)
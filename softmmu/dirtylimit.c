@@ -0,0 +1,422 @@
+/*
+ * Dirty page rate limit implementation code
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qmp/qdict.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "hw/boards.h"
+#include "monitor/hmp.h"
+#include "monitor/monitor.h"
+#include "migration/dirtyrate.h"
+#include "trace.h"
+
+/*
+ * Each vCPU with a limit gets its dirty page rate measured periodically,
+ * and is put to sleep every time it exits because its dirty ring is
+ * full.  The sleep time is adjusted after every measurement to bring
+ * the dirty page rate of the vCPU down to its quota.  vCPUs without a
+ * limit are left alone, unlike with the migration auto-converge
+ * throttle which slows down all of them.
+ */
+
+/* Period of the dirty page rate measurement */
+#define DIRTYLIMIT_CALC_TIME_MS         1000
+/* A dirty page rate within this range of the quota is good enough, MB/s */
+#define DIRTYLIMIT_TOLERANCE_RANGE      25
+/*
+ * Above this difference between the current dirty page rate and the
+ * quota, in percent, the sleep time is adjusted proportionally to the
+ * difference instead of in small steps.
+ */
+#define DIRTYLIMIT_LINEAR_ADJUSTMENT_PCT 50
+/* Maximum sleep time, relative to the time it takes to fill the ring */
+#define DIRTYLIMIT_THROTTLE_PCT_MAX     99
+
+typedef struct VcpuDirtyLimitState {
+    bool enabled;
+    /* Upper limit of the dirty page rate, in MB/s */
+    uint64_t quota;
+    /* Last measured dirty page rate, in MB/s */
+    uint64_t current;
+} VcpuDirtyLimitState;
+
+typedef struct DirtyLimitState {
+    /* Protects states, limited_nvcpu and max_dirtyrate */
+    QemuMutex mutex;
+    int max_cpus;
+    VcpuDirtyLimitState *states;
+    /* Number of vCPUs with a limit */
+    int limited_nvcpu;
+    /* Highest dirty page rate measured so far, in MB/s */
+    uint64_t max_dirtyrate;
+    /* Measurement thread, only started and stopped with the BQL held */
+    QemuThread thread;
+    bool thread_alive;
+    bool running;
+} DirtyLimitState;
+
+/* Allocated on first use and never freed */
+static DirtyLimitState *dirtylimit_state;
+
+static void dirtylimit_state_init(void)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    int max_cpus = ms->smp.max_cpus;
+
+    if (dirtylimit_state) {
+        return;
+    }
+
+    dirtylimit_state = g_new0(DirtyLimitState, 1);
+    qemu_mutex_init(&dirtylimit_state->mutex);
+    dirtylimit_state->max_cpus = max_cpus;
+    dirtylimit_state->states = g_new0(VcpuDirtyLimitState, max_cpus);
+}
+
+bool dirtylimit_in_service(void)
+{
+    return dirtylimit_state && qatomic_read(&dirtylimit_state->limited_nvcpu);
+}
+
+static bool dirtylimit_vcpu_index_valid(int64_t cpu_index)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+
+    return cpu_index >= 0 && cpu_index < ms->smp.max_cpus;
+}
+
+/* Time it takes to fill the dirty ring at the highest rate, in us */
+static int64_t dirtylimit_dirty_ring_full_time(uint64_t dirtyrate)
+{
+    uint64_t dirty_ring_size_MB =
+        ((uint64_t)kvm_dirty_ring_size() * qemu_target_page_size()) >> 20;
+
+    if (dirtylimit_state->max_dirtyrate < dirtyrate) {
+        dirtylimit_state->max_dirtyrate = dirtyrate;
+    }
+
+    return MAX(dirty_ring_size_MB, 1) * 1000000 /
+           dirtylimit_state->max_dirtyrate;
+}
+
+static bool dirtylimit_done(uint64_t quota, uint64_t current)
+{
+    return MAX(quota, current) - MIN(quota, current) <=
+           DIRTYLIMIT_TOLERANCE_RANGE;
+}
+
+static bool dirtylimit_need_linear_adjustment(uint64_t quota,
+                                              uint64_t current)
+{
+    uint64_t max = MAX(quota, current);
+
+    return (max - MIN(quota, current)) * 100 / max >
+           DIRTYLIMIT_LINEAR_ADJUSTMENT_PCT;
+}
+
+/* Called with dirtylimit_state->mutex held */
+static void dirtylimit_set_throttle(CPUState *cpu, uint64_t quota,
+                                    uint64_t current)
+{
+    int64_t ring_full_time_us;
+    int64_t throttle_us = cpu->throttle_us_per_full;
+    uint64_t sleep_pct;
+
+    if (!current) {
+        cpu->throttle_us_per_full = 0;
+        return;
+    }
+
+    ring_full_time_us = dirtylimit_dirty_ring_full_time(current);
+
+    if (dirtylimit_need_linear_adjustment(quota, current)) {
+        if (quota < current) {
+            sleep_pct = (current - quota) * 100 / current;
+            throttle_us += ring_full_time_us * sleep_pct / (100 - sleep_pct);
+        } else {
+            sleep_pct = (quota - current) * 100 / quota;
+            throttle_us -= ring_full_time_us * sleep_pct / (100 - sleep_pct);
+        }
+        trace_dirtylimit_throttle_pct(cpu->cpu_index, sleep_pct, throttle_us);
+    } else if (quota < current) {
+        throttle_us += ring_full_time_us / 10;
+    } else {
+        throttle_us -= ring_full_time_us / 10;
+    }
+
+    throttle_us = MIN(throttle_us,
+                      ring_full_time_us * DIRTYLIMIT_THROTTLE_PCT_MAX);
+    cpu->throttle_us_per_full = MAX(throttle_us, 0);
+}
+
+/* Called with dirtylimit_state->mutex held */
+static void dirtylimit_adjust_throttle(CPUState *cpu)
+{
+    VcpuDirtyLimitState *state = &dirtylimit_state->states[cpu->cpu_index];
+
+    if (!dirtylimit_done(state->quota, state->current)) {
+        dirtylimit_set_throttle(cpu, state->quota, state->current);
+    }
+
+    trace_dirtylimit_adjust_throttle(cpu->cpu_index, state->quota,
+                                     state->current,
+                                     cpu->throttle_us_per_full);
+}
+
+static void *dirtylimit_thread(void *opaque)
+{
+    DirtyLimitState *s = opaque;
+
+    rcu_register_thread();
+
+    while (qatomic_read(&s->running)) {
+        VcpuStat stat;
+        CPUState *cpu;
+        int i;
+
+        vcpu_calculate_dirtyrate(DIRTYLIMIT_CALC_TIME_MS, &stat);
+
+        qemu_mutex_lock(&s->mutex);
+        for (i = 0; i < stat.nvcpu && i < s->max_cpus; i++) {
+            s->states[i].current = stat.rates[i].dirty_rate;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            CPU_FOREACH(cpu) {
+                if (cpu->cpu_index < s->max_cpus &&
+                    s->states[cpu->cpu_index].enabled) {
+                    dirtylimit_adjust_throttle(cpu);
+                }
+            }
+        }
+        qemu_mutex_unlock(&s->mutex);
+
+        g_free(stat.rates);
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Start or stop the measurement thread depending on whether any vCPU is
+ * limited.  Called with the BQL held.
+ */
+static void dirtylimit_update_service(void)
+{
+    DirtyLimitState *s = dirtylimit_state;
+
+    if (s->limited_nvcpu && !s->thread_alive) {
+        memory_global_dirty_log_start(GLOBAL_DIRTY_LIMIT);
+        qatomic_set(&s->running, true);
+        s->thread_alive = true;
+        qemu_thread_create(&s->thread, "dirtylimit-stat", dirtylimit_thread,
+                           s, QEMU_THREAD_JOINABLE);
+    } else if (!s->limited_nvcpu && s->thread_alive &&
+               qatomic_read(&s->running)) {
+        qatomic_set(&s->running, false);
+        /* The thread takes the BQL to sync the dirty log */
+        qemu_mutex_unlock_iothread();
+        qemu_thread_join(&s->thread);
+        qemu_mutex_lock_iothread();
+        s->thread_alive = false;
+        memory_global_dirty_log_stop(GLOBAL_DIRTY_LIMIT);
+
+        /* A limit may have been set while the BQL was released */
+        dirtylimit_update_service();
+    }
+}
+
+/* Called with dirtylimit_state->mutex held */
+static void dirtylimit_vcpu_set(int cpu_index, uint64_t quota, bool enable)
+{
+    VcpuDirtyLimitState *state = &dirtylimit_state->states[cpu_index];
+    CPUState *cpu;
+
+    trace_dirtylimit_vcpu_set(cpu_index, quota, enable);
+
+    if (state->enabled != enable) {
+        dirtylimit_state->limited_nvcpu += enable ? 1 : -1;
+    }
+    state->enabled = enable;
+    state->quota = enable ? quota : 0;
+
+    if (!enable) {
+        cpu = qemu_get_cpu(cpu_index);
+        if (cpu) {
+            cpu->throttle_us_per_full = 0;
+        }
+    }
+}
+
+static void dirtylimit_set(bool has_cpu_index, int64_t cpu_index,
+                           uint64_t quota, bool enable)
+{
+    int i;
+
+    dirtylimit_state_init();
+
+    qemu_mutex_lock(&dirtylimit_state->mutex);
+    if (has_cpu_index) {
+        dirtylimit_vcpu_set(cpu_index, quota, enable);
+    } else {
+        for (i = 0; i < dirtylimit_state->max_cpus; i++) {
+            dirtylimit_vcpu_set(i, quota, enable);
+        }
+    }
+    qemu_mutex_unlock(&dirtylimit_state->mutex);
+
+    dirtylimit_update_service();
+}
+
+static bool dirtylimit_check(bool has_cpu_index, int64_t cpu_index,
+                             Error **errp)
+{
+    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty page limit feature requires KVM with"
+                   " accelerator property 'dirty-ring-size' set");
+        return false;
+    }
+
+    if (has_cpu_index && !dirtylimit_vcpu_index_valid(cpu_index)) {
+        error_setg(errp, "incorrect cpu index specified");
+        return false;
+    }
+
+    return true;
+}
+
+void dirtylimit_vcpu_execute(CPUState *cpu)
+{
+    int64_t throttle_us = cpu->throttle_us_per_full;
+
+    if (throttle_us) {
+        trace_dirtylimit_vcpu_execute(cpu->cpu_index, throttle_us);
+        g_usleep(throttle_us);
+    }
+}
+
+void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
+                              int64_t cpu_index,
+                              uint64_t dirty_rate,
+                              Error **errp)
+{
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    /* A limit of 0 means unlimited */
+    dirtylimit_set(has_cpu_index, cpu_index, dirty_rate, !!dirty_rate);
+}
+
+void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index,
+                                 int64_t cpu_index,
+                                 Error **errp)
+{
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (!dirtylimit_in_service()) {
+        return;
+    }
+
+    dirtylimit_set(has_cpu_index, cpu_index, 0, false);
+}
+
+DirtyLimitInfoList *qmp_query_vcpu_dirty_limit(Error **errp)
+{
+    DirtyLimitInfoList *head = NULL, **tail = &head;
+    int i;
+
+    if (!dirtylimit_in_service()) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&dirtylimit_state->mutex);
+    for (i = 0; i < dirtylimit_state->max_cpus; i++) {
+        VcpuDirtyLimitState *state = &dirtylimit_state->states[i];
+        DirtyLimitInfo *info;
+
+        if (!state->enabled) {
+            continue;
+        }
+
+        info = g_malloc0(sizeof(*info));
+        info->cpu_index = i;
+        info->limit_rate = state->quota;
+        info->current_rate = state->current;
+        QAPI_LIST_APPEND(tail, info);
+    }
+    qemu_mutex_unlock(&dirtylimit_state->mutex);
+
+    return head;
+}
+
+void hmp_set_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t dirty_rate = qdict_get_int(qdict, "dirty_rate");
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    qmp_set_vcpu_dirty_limit(cpu_index != -1, cpu_index, dirty_rate, &err);
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+
+    monitor_printf(mon, "[Please use 'info vcpu_dirty_limit' to query "
+                   "dirty limit for virtual CPU]\n");
+}
+
+void hmp_cancel_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    qmp_cancel_vcpu_dirty_limit(cpu_index != -1, cpu_index, &err);
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+
+    monitor_printf(mon, "[Please use 'info vcpu_dirty_limit' to query "
+                   "dirty limit for virtual CPU]\n");
+}
+
+void hmp_info_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    DirtyLimitInfoList *info, *head;
+    Error *err = NULL;
+
+    head = qmp_query_vcpu_dirty_limit(&err);
+    if (err) {
+        hmp_handle_error(mon, err);
+        return;
+    }
+
+    if (!head) {
+        monitor_printf(mon, "Dirty page limit not enabled!\n");
+        return;
+    }
+
+    for (info = head; info != NULL; info = info->next) {
+        monitor_printf(mon, "vcpu[%"PRIi64"], limit rate %"PRIu64 " (MB/s),"
+                       " current rate %"PRIu64 " (MB/s)\n",
+                       info->value->cpu_index,
+                       info->value->limit_rate,
+                       info->value->current_rate);
+    }
+
+    qapi_free_DirtyLimitInfoList(head);
+}
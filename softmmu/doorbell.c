@@ -0,0 +1,126 @@
+/*
+ * MMIO doorbell regions dispatched to an AioContext
+ *
+ * Devices whose hot path consists of doorbell writes (queue tails, heads)
+ * otherwise take the BQL and run their whole doorbell handler in the vCPU
+ * thread for every write.  ioeventfds avoid that only for writes that carry
+ * no information, or a value known in advance.  A doorbell region instead
+ * stores the written value in a per-doorbell slot, marks the slot pending
+ * and kicks an EventNotifier; the device processes the latest values in its
+ * AioContext, coalescing bursts of writes to the same doorbell.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/atomic.h"
+#include "block/aio.h"
+#include "exec/doorbell.h"
+#include "trace.h"
+
+static uint64_t doorbell_read(void *opaque, hwaddr addr, unsigned size)
+{
+    return 0;
+}
+
+/* Called without the BQL */
+static void doorbell_write(void *opaque, hwaddr addr, uint64_t val,
+                           unsigned size)
+{
+    MemoryRegionDoorbell *db = opaque;
+    unsigned i = addr >> 2;
+
+    qatomic_set(&db->values[i], val);
+    /*
+     * The read-modify-write is a full barrier, pairing with the qatomic_xchg()
+     * in memory_region_doorbell_flush().  A plain read of the pending bit
+     * could be ordered before the store to the value, and miss a flush that
+     * cleared the bit and then read the old value.
+     */
+    if (!(qatomic_fetch_or(&db->pending[BIT_WORD(i)], BIT_MASK(i)) &
+          BIT_MASK(i))) {
+        event_notifier_set(&db->notifier);
+    }
+}
+
+static const MemoryRegionOps doorbell_ops = {
+    .read = doorbell_read,
+    .write = doorbell_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+void memory_region_doorbell_flush(MemoryRegionDoorbell *db)
+{
+    unsigned long word;
+    unsigned w, i;
+    uint32_t val;
+
+    for (w = 0; w < BITS_TO_LONGS(db->nr); w++) {
+        if (!qatomic_read(&db->pending[w])) {
+            continue;
+        }
+
+        word = qatomic_xchg(&db->pending[w], 0);
+        while (word) {
+            i = w * BITS_PER_LONG + ctzl(word);
+            word &= word - 1;
+            val = qatomic_read(&db->values[i]);
+            trace_memory_region_doorbell(db, i << 2, val);
+            db->handler(db->opaque, (hwaddr)i << 2, val);
+        }
+    }
+}
+
+static void doorbell_notify(EventNotifier *e)
+{
+    MemoryRegionDoorbell *db = container_of(e, MemoryRegionDoorbell, notifier);
+
+    if (event_notifier_test_and_clear(e)) {
+        memory_region_doorbell_flush(db);
+    }
+}
+
+int memory_region_doorbell_init(MemoryRegionDoorbell *db, Object *owner,
+                                const char *name, uint64_t size,
+                                AioContext *ctx,
+                                MemoryRegionDoorbellHandler *handler,
+                                void *opaque)
+{
+    int ret;
+
+    assert(size && QEMU_IS_ALIGNED(size, 4));
+
+    ret = event_notifier_init(&db->notifier, 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    db->ctx = ctx;
+    db->handler = handler;
+    db->opaque = opaque;
+    db->nr = size >> 2;
+    db->values = g_new0(uint32_t, db->nr);
+    db->pending = bitmap_new(db->nr);
+
+    aio_set_event_notifier(ctx, &db->notifier, true, doorbell_notify,
+                           NULL, NULL);
+
+    memory_region_init_io(&db->mr, owner, &doorbell_ops, db, name, size);
+    memory_region_enable_lockless_io(&db->mr);
+
+    return 0;
+}
+
+void memory_region_doorbell_destroy(MemoryRegionDoorbell *db)
+{
+    aio_set_event_notifier(db->ctx, &db->notifier, true, NULL, NULL, NULL);
+    event_notifier_cleanup(&db->notifier);
+    g_free(db->values);
+    g_free(db->pending);
+}
@@ -41,6 +41,16 @@ static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
 unsigned int global_dirty_tracking;
 
+/*
+ * Every rendered FlatView gets a new generation number.  A MemoryRegion
+ * change records the current generation in the region, so a FlatView has
+ * to be rendered again only if its tree contains a region that changed
+ * after the FlatView was rendered.  Changes that affect the rendering of
+ * all regions record the generation in memory_topology_full_gen.
+ */
+static uint64_t memory_topology_gen = 1;
+static uint64_t memory_topology_full_gen;
+
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
     = QTAILQ_HEAD_INITIALIZER(memory_listeners);
 
@@ -725,12 +735,50 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
 }
 
 /* Render a memory topology into a list of disjoint absolute ranges. */
+static void memory_region_topology_changed(MemoryRegion *mr)
+{
+    mr->topology_gen = memory_topology_gen;
+}
+
+static bool memory_region_changed_since(MemoryRegion *mr, uint64_t gen)
+{
+    MemoryRegion *subregion;
+
+    if (mr->topology_gen > gen) {
+        return true;
+    }
+    /* Disabled regions are not rendered, see render_memory_region() */
+    if (!mr->enabled) {
+        return false;
+    }
+    if (mr->alias) {
+        return memory_region_changed_since(mr->alias, gen);
+    }
+    QTAILQ_FOREACH(subregion, &mr->subregions, subregions_link) {
+        if (memory_region_changed_since(subregion, gen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Whether @view still matches the tree below its root */
+static bool flatview_is_current(FlatView *view)
+{
+    if (view->topology_gen < memory_topology_full_gen) {
+        return false;
+    }
+    return !view->root ||
+           !memory_region_changed_since(view->root, view->topology_gen);
+}
+
 static FlatView *generate_memory_topology(MemoryRegion *mr)
 {
     int i;
     FlatView *view;
 
     view = flatview_new(mr);
+    view->topology_gen = memory_topology_gen++;
 
     if (mr) {
         render_memory_region(view, mr, int128_zero(),
@@ -1003,24 +1051,38 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /*
+     * Render unique FVs.  FVs whose tree did not change are kept, so that
+     * address_space_set_flatview() does not have to notify their listeners.
+     */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (view && flatview_is_current(view)) {
+            trace_flatview_reuse(view, physmr);
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+            continue;
+        }
+
         generate_memory_topology(physmr);
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1435,6 +1497,38 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
     }
 }
 
+/*
+ * Regions with their own lock are accessed with it held, whether or not
+ * the caller holds the BQL.  Returns the time the lock was taken if the
+ * hold time is traced.
+ */
+static int64_t memory_region_access_lock(MemoryRegion *mr)
+{
+    if (!mr->lock) {
+        return 0;
+    }
+
+    qemu_mutex_lock(mr->lock);
+    if (trace_event_get_state_backends(TRACE_MEMORY_REGION_LOCK_HOLD)) {
+        return get_clock();
+    }
+    return 0;
+}
+
+static void memory_region_access_unlock(MemoryRegion *mr, hwaddr addr,
+                                        int64_t start)
+{
+    if (!mr->lock) {
+        return;
+    }
+
+    if (start) {
+        trace_memory_region_lock_hold(mr, memory_region_name(mr), addr,
+                                      get_clock() - start);
+    }
+    qemu_mutex_unlock(mr->lock);
+}
+
 MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
                                         hwaddr addr,
                                         uint64_t *pval,
@@ -1443,6 +1537,7 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
 {
     unsigned size = memop_size(op);
     MemTxResult r;
+    int64_t start;
 
     if (mr->alias) {
         return memory_region_dispatch_read(mr->alias,
@@ -1454,7 +1549,9 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
+    start = memory_region_access_lock(mr);
     r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    memory_region_access_unlock(mr, addr, start);
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1492,6 +1589,8 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
+    MemTxResult r;
+    int64_t start;
 
     if (mr->alias) {
         return memory_region_dispatch_write(mr->alias,
@@ -1510,20 +1609,22 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
         return MEMTX_OK;
     }
 
+    start = memory_region_access_lock(mr);
     if (mr->ops->write) {
-        return access_with_adjusted_size(addr, &data, size,
-                                         mr->ops->impl.min_access_size,
-                                         mr->ops->impl.max_access_size,
-                                         memory_region_write_accessor, mr,
-                                         attrs);
+        r = access_with_adjusted_size(addr, &data, size,
+                                      mr->ops->impl.min_access_size,
+                                      mr->ops->impl.max_access_size,
+                                      memory_region_write_accessor, mr,
+                                      attrs);
     } else {
-        return
-            access_with_adjusted_size(addr, &data, size,
+        r = access_with_adjusted_size(addr, &data, size,
                                       mr->ops->impl.min_access_size,
                                       mr->ops->impl.max_access_size,
                                       memory_region_write_with_attrs_accessor,
                                       mr, attrs);
     }
+    memory_region_access_unlock(mr, addr, start);
+    return r;
 }
 
 void memory_region_init_io(MemoryRegion *mr,
@@ -2135,6 +2236,7 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
+    memory_region_topology_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2265,6 +2367,7 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
+        memory_region_topology_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2275,6 +2378,7 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
+        memory_region_topology_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2285,6 +2389,7 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
+        memory_region_topology_changed(mr);
         memory_region_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
@@ -2442,6 +2547,18 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+    mr->lockless_io = true;
+}
+
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock)
+{
+    assert(!mr->alias);
+    mr->lock = lock;
+    mr->lockless_io = true;
+}
+
 static bool userspace_eventfd_warning;
 
 void memory_region_add_eventfd(MemoryRegion *mr,
@@ -2537,6 +2654,7 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
+    memory_region_topology_changed(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2587,6 +2705,7 @@ void memory_region_del_subregion(MemoryRegion *mr,
     }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
+    memory_region_topology_changed(mr);
     memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
@@ -2598,6 +2717,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
+    memory_region_topology_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2614,6 +2734,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
+    memory_region_topology_changed(mr);
     memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
@@ -2651,6 +2772,7 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
+    memory_region_topology_changed(mr);
     memory_region_update_pending |= mr->enabled;
     memory_region_transaction_commit();
 }
@@ -2809,6 +2931,8 @@ void memory_global_dirty_log_start(unsigned int flags)
     if (!old_flags) {
         MEMORY_LISTENER_CALL_GLOBAL(log_global_start, Forward);
         memory_region_transaction_begin();
+        /* The dirty log mask of all RAM regions changes */
+        memory_topology_full_gen = memory_topology_gen;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
     }
@@ -2824,6 +2948,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
+        memory_topology_full_gen = memory_topology_gen;
         memory_region_update_pending = true;
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
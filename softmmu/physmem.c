@@ -23,6 +23,7 @@
 
 #include "qemu/cutils.h"
 #include "qemu/cacheflush.h"
+#include "qemu/units.h"
 
 #ifdef CONFIG_TCG
 #include "hw/core/tcg-cpu-ops.h"
@@ -55,6 +56,7 @@
 
 #include "qemu/rcu_queue.h"
 #include "qemu/main-loop.h"
+#include "qemu/lockable.h"
 #include "exec/translate-all.h"
 #include "sysemu/replay.h"
 
@@ -143,6 +145,17 @@ typedef struct subpage_t {
 
 #define PHYS_SECTION_UNASSIGNED 0
 
+/* Granularity of ram_block_merge_hint() */
+#define RAM_MERGE_HINT_SIZE (2 * MiB)
+/* Hinted chunks at most this many chunks apart are joined into one range */
+#define RAM_MERGE_HINT_GAP 8
+/*
+ * Every separate mergeable range splits the mapping into up to two more
+ * VMAs.  Past this many ranges in a RAMBlock, the whole block is marked
+ * mergeable instead, which keeps well clear of vm.max_map_count.
+ */
+#define RAM_MERGE_HINT_MAX_RANGES 1024
+
 static void io_mem_init(void);
 static void memory_map_init(void);
 static void tcg_log_global_after_sync(MemoryListener *listener);
@@ -1752,6 +1765,15 @@ void qemu_ram_unset_migratable(RAMBlock *rb)
     rb->flags &= ~RAM_MIGRATABLE;
 }
 
+/* Called with iothread lock held, before the block is used.  */
+void qemu_ram_set_merge_hints(RAMBlock *rb)
+{
+    rb->merge_hint_bmap = bitmap_new(DIV_ROUND_UP(rb->max_length,
+                                                  RAM_MERGE_HINT_SIZE));
+    qemu_mutex_init(&rb->merge_hint_lock);
+    rb->flags |= RAM_MERGE_HINTS;
+}
+
 /* Called with iothread lock held.  */
 void qemu_ram_set_idstr(RAMBlock *new_block, const char *name, DeviceState *dev)
 {
@@ -2211,6 +2233,10 @@ static void reclaim_ramblock(RAMBlock *block)
     } else {
         qemu_anon_ram_free(block->host, block->max_length);
     }
+    if (block->flags & RAM_MERGE_HINTS) {
+        qemu_mutex_destroy(&block->merge_hint_lock);
+        g_free(block->merge_hint_bmap);
+    }
     g_free(block);
 }
 
@@ -2748,7 +2774,12 @@ static bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!qemu_mutex_iothread_locked()) {
+    /*
+     * Flushing the coalesced MMIO ring dispatches the buffered writes to
+     * their regions, which need the BQL, even if @mr itself does not.
+     */
+    if ((!mr->lockless_io || mr->flush_coalesced_mmio) &&
+        !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         release_lock = true;
     }
@@ -2927,6 +2958,73 @@ MemTxResult address_space_rw(AddressSpace *as, hwaddr addr, MemTxAttrs attrs,
     }
 }
 
+/*
+ * Returns the region and offset of @addr from @cache if it is still valid,
+ * and fills @cache otherwise.  Returns NULL for accesses that
+ * flatview_translate() must handle: RAM accesses are clamped to the
+ * section, an IOMMU translates each access on its own, and the
+ * unassigned section covers all addresses.
+ *
+ * Called from RCU critical section.
+ */
+static MemoryRegion *section_cache_lookup(FlatView *fv, hwaddr addr,
+                                          hwaddr *xlat,
+                                          AddressSpaceSectionCache *cache)
+{
+    MemoryRegionSection *section = &cache->section;
+    hwaddr l = 1;
+
+    if (cache->topology_gen == fv->topology_gen &&
+        section_covers_addr(section, addr)) {
+        *xlat = addr - section->offset_within_address_space +
+                section->offset_within_region;
+        return section->mr;
+    }
+
+    section = address_space_translate_internal(flatview_to_dispatch(fv),
+                                               addr, xlat, &l, true);
+    if (memory_region_is_ram(section->mr) ||
+        memory_region_get_iommu(section->mr) ||
+        section->mr == &io_mem_unassigned) {
+        cache->topology_gen = 0;
+        return NULL;
+    }
+
+    cache->section = *section;
+    cache->topology_gen = fv->topology_gen;
+    return section->mr;
+}
+
+MemTxResult address_space_rw_cached_section(AddressSpace *as, hwaddr addr,
+                                            MemTxAttrs attrs, void *buf,
+                                            hwaddr len, bool is_write,
+                                            AddressSpaceSectionCache *cache)
+{
+    MemoryRegion *mr;
+    hwaddr addr1;
+    FlatView *fv;
+
+    if (!len) {
+        return MEMTX_OK;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    fv = address_space_to_flatview(as);
+    mr = section_cache_lookup(fv, addr, &addr1, cache);
+    if (!mr) {
+        return is_write ? flatview_write(fv, addr, attrs, buf, len) :
+                          flatview_read(fv, addr, attrs, buf, len);
+    }
+
+    if (is_write) {
+        return flatview_write_continue(fv, addr, attrs, buf, len,
+                                       addr1, len, mr);
+    } else {
+        return flatview_read_continue(fv, addr, attrs, buf, len,
+                                      addr1, len, mr);
+    }
+}
+
 MemTxResult address_space_set(AddressSpace *as, hwaddr addr,
                               uint8_t c, hwaddr len, MemTxAttrs attrs)
 {
@@ -3033,7 +3131,46 @@ typedef struct {
     bool in_use;
 } BounceBuffer;
 
-static BounceBuffer bounce;
+/*
+ * Memory that cannot be accessed directly, e.g. MMIO, is mapped through a
+ * bounce buffer.  A single one would let only one such mapping exist at a
+ * time, so that concurrent DMA requests split into many small ones while
+ * they wait for each other.
+ */
+#define BOUNCE_BUFFERS      16
+/* Avoid unbounded allocations */
+#define BOUNCE_BUFFER_SIZE  (64 * KiB)
+
+static BounceBuffer bounce[BOUNCE_BUFFERS];
+static int bounce_count;    /* buffers in use, only an optimization */
+
+static BounceBuffer *bounce_get(void)
+{
+    int i;
+
+    for (i = 0; i < BOUNCE_BUFFERS; i++) {
+        if (!qatomic_xchg(&bounce[i].in_use, true)) {
+            qatomic_inc(&bounce_count);
+            return &bounce[i];
+        }
+    }
+    return NULL;
+}
+
+static BounceBuffer *bounce_find(void *buffer)
+{
+    int i;
+
+    if (!qatomic_read(&bounce_count)) {
+        return NULL;
+    }
+    for (i = 0; i < BOUNCE_BUFFERS; i++) {
+        if (qatomic_read(&bounce[i].buffer) == buffer) {
+            return &bounce[i];
+        }
+    }
+    return NULL;
+}
 
 typedef struct MapClient {
     QEMUBH *bh;
@@ -3068,7 +3205,7 @@ void cpu_register_map_client(QEMUBH *bh)
     qemu_mutex_lock(&map_client_list_lock);
     client->bh = bh;
     QLIST_INSERT_HEAD(&map_client_list, client, link);
-    if (!qatomic_read(&bounce.in_use)) {
+    if (qatomic_read(&bounce_count) < BOUNCE_BUFFERS) {
         cpu_notify_map_clients_locked();
     }
     qemu_mutex_unlock(&map_client_list_lock);
@@ -3202,25 +3339,27 @@ void *address_space_map(AddressSpace *as,
     mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
 
     if (!memory_access_is_direct(mr, is_write)) {
-        if (qatomic_xchg(&bounce.in_use, true)) {
+        BounceBuffer *b = bounce_get();
+        void *buffer;
+
+        if (!b) {
             *plen = 0;
             return NULL;
         }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
+        l = MIN(l, BOUNCE_BUFFER_SIZE);
+        buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
+        b->addr = addr;
+        b->len = l;
 
         memory_region_ref(mr);
-        bounce.mr = mr;
+        b->mr = mr;
         if (!is_write) {
-            flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
+            flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED, buffer, l);
         }
+        qatomic_set(&b->buffer, buffer);
 
         *plen = l;
-        return bounce.buffer;
+        return buffer;
     }
 
 
@@ -3240,7 +3379,9 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          bool is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
+    BounceBuffer *b = bounce_find(buffer);
+
+    if (!b) {
         MemoryRegion *mr;
         ram_addr_t addr1;
 
@@ -3256,13 +3397,14 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         return;
     }
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
-    }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    qatomic_mb_set(&bounce.in_use, false);
+        address_space_write(as, b->addr, MEMTXATTRS_UNSPECIFIED,
+                            b->buffer, access_len);
+    }
+    qatomic_set(&b->buffer, NULL);
+    qemu_vfree(buffer);
+    memory_region_unref(b->mr);
+    qatomic_dec(&bounce_count);
+    qatomic_mb_set(&b->in_use, false);
     cpu_notify_map_clients();
 }
 
@@ -3623,6 +3765,82 @@ err:
     return ret;
 }
 
+/*
+ * Hint that the memory at @start, of @length bytes, is likely identical to
+ * other memory, for example because it is zero.  With RAM_MERGE_HINTS, the
+ * chunks of RAM_MERGE_HINT_SIZE bytes that contain it are marked mergeable,
+ * so that KSM only scans them instead of all the guest memory.  Each chunk
+ * is marked only once.
+ *
+ * Every separate range that madvise() marks costs VMAs, so nearby ranges are
+ * joined by marking the chunks between them too, and once a block has
+ * RAM_MERGE_HINT_MAX_RANGES ranges the whole block is marked mergeable.
+ * Can be called from any thread.
+ */
+void ram_block_merge_hint(RAMBlock *rb, uint64_t start, size_t length)
+{
+    unsigned long *bmap = rb->merge_hint_bmap;
+    uint64_t end = MIN(start + length, rb->max_length);
+    unsigned long nchunks, first, last, chunk, i;
+    unsigned joined = 0;
+    uint64_t offset;
+
+    if (!(rb->flags & RAM_MERGE_HINTS) || start >= end) {
+        return;
+    }
+
+    nchunks = DIV_ROUND_UP(rb->max_length, RAM_MERGE_HINT_SIZE);
+    first = start / RAM_MERGE_HINT_SIZE;
+    last = (end - 1) / RAM_MERGE_HINT_SIZE;
+    if (find_next_zero_bit(bmap, last + 1, first) > last) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&rb->merge_hint_lock);
+    if (find_next_zero_bit(bmap, last + 1, first) > last) {
+        return;
+    }
+
+    for (i = 1; i <= RAM_MERGE_HINT_GAP + 1 && i <= first; i++) {
+        if (test_bit(first - i, bmap)) {
+            first -= i - 1;
+            break;
+        }
+    }
+    for (i = 1; i <= RAM_MERGE_HINT_GAP + 1 && last + i < nchunks; i++) {
+        if (test_bit(last + i, bmap)) {
+            last += i - 1;
+            break;
+        }
+    }
+
+    /* Count the existing ranges that [first, last] touches */
+    if (first > 0 && test_bit(first - 1, bmap)) {
+        joined++;
+    }
+    for (chunk = first; chunk <= last + 1 && chunk < nchunks; chunk++) {
+        if (test_bit(chunk, bmap) &&
+            (chunk == 0 || !test_bit(chunk - 1, bmap))) {
+            joined++;
+        }
+    }
+
+    if (rb->merge_hint_ranges - joined + 1 > RAM_MERGE_HINT_MAX_RANGES) {
+        first = 0;
+        last = nchunks - 1;
+        rb->merge_hint_ranges = 1;
+    } else {
+        rb->merge_hint_ranges = rb->merge_hint_ranges - joined + 1;
+    }
+
+    offset = first * RAM_MERGE_HINT_SIZE;
+    qemu_madvise(rb->host + offset,
+                 MIN((last + 1) * RAM_MERGE_HINT_SIZE, rb->max_length) - offset,
+                 QEMU_MADV_MERGEABLE);
+    bitmap_set_atomic(bmap, first, last - first + 1);
+    trace_ram_block_merge_hint(rb->idstr, offset, last - first + 1);
+}
+
 bool ramblock_is_pmem(RAMBlock *rb)
 {
     return rb->flags & RAM_PMEM;
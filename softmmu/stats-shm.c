@@ -0,0 +1,337 @@
+/*
+ * Statistics published in shared memory
+ *
+ * A stats-shm object periodically writes counters of the block backends,
+ * the vCPUs and of any subsystem that registered a provider into a file
+ * that monitoring agents map.  Agents then read them as often as they like,
+ * without a monitor connection, JSON, or taking the BQL: updates are
+ * published under a sequence counter in the file header, so readers simply
+ * retry if they raced with one.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "qom/object_interfaces.h"
+#include "hw/core/cpu.h"
+#include "block/accounting.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/stats-shm.h"
+#include "trace.h"
+
+OBJECT_DECLARE_SIMPLE_TYPE(StatsShm, STATS_SHM)
+
+struct StatsShm {
+    Object parent_obj;
+
+    char *path;
+    uint32_t interval;          /* milliseconds */
+
+    int fd;
+    void *map;
+    size_t map_size;
+    QEMUTimer *timer;
+};
+
+struct StatsShmWriter {
+    GArray *entries;
+};
+
+typedef struct StatsShmProviderEntry {
+    StatsShmProvider *fn;
+    void *opaque;
+} StatsShmProviderEntry;
+
+static GArray *stats_shm_providers;
+
+void stats_shm_register_provider(StatsShmProvider *fn, void *opaque)
+{
+    StatsShmProviderEntry p = { .fn = fn, .opaque = opaque };
+
+    if (!stats_shm_providers) {
+        stats_shm_providers = g_array_new(false, false, sizeof(p));
+    }
+    g_array_append_val(stats_shm_providers, p);
+}
+
+/* Names longer than STATS_SHM_NAME_LEN - 1 bytes are truncated */
+void stats_shm_add(StatsShmWriter *w, const char *prefix, const char *name,
+                   uint64_t value)
+{
+    StatsShmEntry e = { .value = value };
+
+    snprintf(e.name, sizeof(e.name), "%s/%s", prefix, name);
+    g_array_append_val(w->entries, e);
+}
+
+static void stats_shm_add_block(StatsShmWriter *w)
+{
+    static const char *const types[BLOCK_MAX_IOTYPE] = {
+        [BLOCK_ACCT_READ] = "rd",
+        [BLOCK_ACCT_WRITE] = "wr",
+        [BLOCK_ACCT_FLUSH] = "flush",
+        [BLOCK_ACCT_UNMAP] = "unmap",
+    };
+    BlockBackend *blk = NULL;
+    char name[32];
+    int i;
+
+    while ((blk = blk_next(blk))) {
+        AioContext *ctx = blk_get_aio_context(blk);
+        BlockAcctStats *stats = blk_get_stats(blk);
+        g_autofree char *dev = NULL;
+        g_autofree char *prefix = NULL;
+
+        aio_context_acquire(ctx);
+        if (!*blk_name(blk)) {
+            dev = blk_get_attached_dev_id(blk);
+        }
+        prefix = g_strdup_printf("block/%s", dev ? dev : blk_name(blk));
+
+        for (i = BLOCK_ACCT_READ; i < BLOCK_MAX_IOTYPE; i++) {
+            snprintf(name, sizeof(name), "%s_bytes", types[i]);
+            stats_shm_add(w, prefix, name, stats->nr_bytes[i]);
+            snprintf(name, sizeof(name), "%s_operations", types[i]);
+            stats_shm_add(w, prefix, name, stats->nr_ops[i]);
+            snprintf(name, sizeof(name), "%s_total_time_ns", types[i]);
+            stats_shm_add(w, prefix, name, stats->total_time_ns[i]);
+        }
+        aio_context_release(ctx);
+    }
+}
+
+static void stats_shm_add_cpus(StatsShmWriter *w)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        g_autofree char *prefix = g_strdup_printf("cpu/%d", cpu->cpu_index);
+        clockid_t clk;
+        struct timespec ts;
+
+        stats_shm_add(w, prefix, "halted", cpu->halted);
+
+        /* time spent running the thread of the vCPU */
+        if (cpu->thread &&
+            !pthread_getcpuclockid(cpu->thread->thread, &clk) &&
+            !clock_gettime(clk, &ts)) {
+            stats_shm_add(w, prefix, "run_time_ns",
+                          ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec);
+        }
+    }
+}
+
+static bool stats_shm_map(StatsShm *s, size_t size, Error **errp)
+{
+    size = ROUND_UP(size, qemu_real_host_page_size);
+    if (size <= s->map_size) {
+        return true;
+    }
+
+    if (ftruncate(s->fd, size) < 0) {
+        error_setg_errno(errp, errno, "Could not resize '%s'", s->path);
+        return false;
+    }
+    if (s->map) {
+        munmap(s->map, s->map_size);
+    }
+    s->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Could not map '%s'", s->path);
+        s->map = NULL;
+        s->map_size = 0;
+        return false;
+    }
+    s->map_size = size;
+    return true;
+}
+
+static void stats_shm_update(void *opaque)
+{
+    StatsShm *s = opaque;
+    StatsShmWriter w = {
+        .entries = g_array_new(false, false, sizeof(StatsShmEntry)),
+    };
+    StatsShmHeader *hdr;
+    size_t size;
+    guint i;
+
+    stats_shm_add_block(&w);
+    stats_shm_add_cpus(&w);
+    for (i = 0; stats_shm_providers && i < stats_shm_providers->len; i++) {
+        StatsShmProviderEntry *p = &g_array_index(stats_shm_providers,
+                                                  StatsShmProviderEntry, i);
+        p->fn(&w, p->opaque);
+    }
+
+    size = sizeof(StatsShmHeader) + w.entries->len * sizeof(StatsShmEntry);
+    if (!stats_shm_map(s, size, NULL)) {
+        /* publish the entries that fit */
+        g_array_set_size(w.entries, (s->map_size - sizeof(StatsShmHeader)) /
+                                    sizeof(StatsShmEntry));
+        size = sizeof(StatsShmHeader) +
+               w.entries->len * sizeof(StatsShmEntry);
+    }
+
+    /*
+     * The file only grows, so readers that map the size from the header
+     * never fault; they remap when it exceeds the size they mapped.
+     */
+    hdr = s->map;
+    qatomic_set(&hdr->sequence, hdr->sequence + 1);
+    /* make the sequence odd before the entries change */
+    smp_wmb();
+    memcpy(hdr + 1, w.entries->data, w.entries->len * sizeof(StatsShmEntry));
+    hdr->nr_entries = w.entries->len;
+    hdr->size = size;
+    hdr->timestamp_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    hdr->interval_ns = (uint64_t)s->interval * SCALE_MS;
+    /* pairs with the read barrier of readers, see stats-shm.rst */
+    smp_wmb();
+    qatomic_set(&hdr->sequence, hdr->sequence + 1);
+
+    trace_stats_shm_update(s->path, w.entries->len);
+
+    g_array_free(w.entries, true);
+    timer_mod(s->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + s->interval);
+}
+
+static void stats_shm_complete(UserCreatable *uc, Error **errp)
+{
+    StatsShm *s = STATS_SHM(uc);
+    StatsShmHeader *hdr;
+
+    if (!s->path) {
+        error_setg(errp, "The 'path' property must be set");
+        return;
+    }
+    if (!s->interval) {
+        error_setg(errp, "'interval' must be at least 1 millisecond");
+        return;
+    }
+
+    s->fd = qemu_create(s->path, O_RDWR | O_TRUNC, 0640, errp);
+    if (s->fd < 0) {
+        return;
+    }
+    if (!stats_shm_map(s, sizeof(StatsShmHeader), errp)) {
+        close(s->fd);
+        s->fd = -1;
+        return;
+    }
+
+    hdr = s->map;
+    memcpy(hdr->magic, STATS_SHM_MAGIC, sizeof(hdr->magic));
+    hdr->version = STATS_SHM_VERSION;
+    hdr->entry_size = sizeof(StatsShmEntry);
+    hdr->size = sizeof(StatsShmHeader);
+
+    s->timer = timer_new_ms(QEMU_CLOCK_REALTIME, stats_shm_update, s);
+    stats_shm_update(s);
+}
+
+static void stats_shm_finalize(Object *obj)
+{
+    StatsShm *s = STATS_SHM(obj);
+
+    if (s->timer) {
+        timer_free(s->timer);
+    }
+    if (s->map) {
+        munmap(s->map, s->map_size);
+    }
+    if (s->fd >= 0) {
+        /* do not leave stale statistics behind */
+        unlink(s->path);
+        close(s->fd);
+    }
+    g_free(s->path);
+}
+
+static void stats_shm_init(Object *obj)
+{
+    StatsShm *s = STATS_SHM(obj);
+
+    s->fd = -1;
+    s->interval = 100;
+}
+
+static char *stats_shm_get_path(Object *obj, Error **errp)
+{
+    return g_strdup(STATS_SHM(obj)->path);
+}
+
+static void stats_shm_set_path(Object *obj, const char *value, Error **errp)
+{
+    StatsShm *s = STATS_SHM(obj);
+
+    g_free(s->path);
+    s->path = g_strdup(value);
+}
+
+static void stats_shm_get_interval(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    visit_type_uint32(v, name, &STATS_SHM(obj)->interval, errp);
+}
+
+static void stats_shm_set_interval(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    StatsShm *s = STATS_SHM(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!value) {
+        error_setg(errp, "'interval' must be at least 1 millisecond");
+        return;
+    }
+    s->interval = value;
+}
+
+static bool stats_shm_can_be_deleted(UserCreatable *uc)
+{
+    return true;
+}
+
+static void stats_shm_class_init(ObjectClass *oc, void *data)
+{
+    UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
+
+    ucc->complete = stats_shm_complete;
+    ucc->can_be_deleted = stats_shm_can_be_deleted;
+
+    object_class_property_add_str(oc, "path", stats_shm_get_path,
+                                  stats_shm_set_path);
+    object_class_property_add(oc, "interval", "uint32",
+                              stats_shm_get_interval, stats_shm_set_interval,
+                              NULL, NULL);
+}
+
+static const TypeInfo stats_shm_info = {
+    .parent = TYPE_OBJECT,
+    .name = TYPE_STATS_SHM,
+    .instance_size = sizeof(StatsShm),
+    .instance_init = stats_shm_init,
+    .instance_finalize = stats_shm_finalize,
+    .class_init = stats_shm_class_init,
+    .interfaces = (InterfaceInfo[]) {
+        { TYPE_USER_CREATABLE },
+        { }
+    }
+};
+
+static void stats_shm_register_types(void)
+{
+    type_register_static(&stats_shm_info);
+}
+
+type_init(stats_shm_register_types);
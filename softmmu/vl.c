@@ -104,6 +104,7 @@
 #include "qemu/queue.h"
 #include "sysemu/arch_init.h"
 #include "exec/confidential-guest-support.h"
+#include "exec/memory.h"
 
 #include "ui/qemu-spice.h"
 #include "qapi/string-input-visitor.h"
@@ -2668,6 +2669,15 @@ static void qemu_create_cli_devices(void)
 {
     DeviceOption *opt;
 
+    /*
+     * Devices add and map memory regions while being realized.  Render the
+     * FlatViews and update the memory listeners (and thus KVM memory slots)
+     * once, when all devices have been created, instead of after every
+     * change.  Listeners registered meanwhile are handed the ranges that
+     * were rendered before, and the changes when the transaction commits.
+     */
+    memory_region_transaction_begin();
+
     soundhw_init();
 
     qemu_opts_foreach(qemu_find_opts("fw_cfg"),
@@ -2698,6 +2708,8 @@ static void qemu_create_cli_devices(void)
         loc_pop(&opt->loc);
     }
     rom_reset_order_override();
+
+    memory_region_transaction_commit();
 }
 
 static void qemu_machine_creation_done(void)
@@ -2744,6 +2756,7 @@ void qmp_x_exit_preconfig(Error **errp)
 
     qemu_init_board();
     qemu_create_cli_devices();
+    host_memory_backend_prealloc_finish(&error_fatal);
     qemu_machine_creation_done();
 
     if (loadvm) {
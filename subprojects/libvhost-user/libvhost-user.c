@@ -26,6 +26,7 @@
 #include <sys/socket.h>
 #include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <sys/vfs.h>
 #include <endian.h>
 
 #if defined(__linux__)
@@ -1619,17 +1620,26 @@ vu_inflight_queue_size(uint16_t queue_size)
 
 #ifdef MFD_ALLOW_SEALING
 static void *
-memfd_alloc(const char *name, size_t size, unsigned int flags, int *fd)
+memfd_alloc_flags(const char *name, size_t *size, unsigned int mfd_flags,
+                  unsigned int flags, int *fd)
 {
+    struct statfs fs;
     void *ptr;
     int ret;
 
-    *fd = memfd_create(name, MFD_ALLOW_SEALING);
+    *fd = memfd_create(name, mfd_flags);
     if (*fd < 0) {
         return NULL;
     }
 
-    ret = ftruncate(*fd, size);
+    /* hugetlbfs reports the huge page size as block size */
+    if (fstatfs(*fd, &fs) < 0) {
+        close(*fd);
+        return NULL;
+    }
+    *size = ALIGN_UP(*size, fs.f_bsize);
+
+    ret = ftruncate(*fd, *size);
     if (ret < 0) {
         close(*fd);
         return NULL;
@@ -1641,7 +1651,7 @@ memfd_alloc(const char *name, size_t size, unsigned int flags, int *fd)
         return NULL;
     }
 
-    ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    ptr = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
     if (ptr == MAP_FAILED) {
         close(*fd);
         return NULL;
@@ -1649,6 +1659,31 @@ memfd_alloc(const char *name, size_t size, unsigned int flags, int *fd)
 
     return ptr;
 }
+
+/*
+ * Allocates a sealed memfd of at least *@size bytes and maps it.  Huge pages
+ * are tried first, so that the inflight descriptors of all queues share a
+ * single TLB entry; without free huge pages (or on old kernels, which cannot
+ * seal hugetlbfs memfds) ordinary pages are used.  *@size is rounded up to
+ * the page size of the mapping.
+ */
+static void *
+memfd_alloc(const char *name, size_t *size, unsigned int flags, int *fd)
+{
+#ifdef MFD_HUGETLB
+    size_t hugetlb_size = *size;
+    void *ptr;
+
+    ptr = memfd_alloc_flags(name, &hugetlb_size,
+                            MFD_ALLOW_SEALING | MFD_HUGETLB, flags, fd);
+    if (ptr) {
+        *size = hugetlb_size;
+        return ptr;
+    }
+#endif
+
+    return memfd_alloc_flags(name, size, MFD_ALLOW_SEALING, flags, fd);
+}
 #endif
 
 static bool
@@ -1656,7 +1691,7 @@ vu_get_inflight_fd(VuDev *dev, VhostUserMsg *vmsg)
 {
     int fd = -1;
     void *addr = NULL;
-    uint64_t mmap_size;
+    size_t mmap_size;
     uint16_t num_queues, queue_size;
 
     if (vmsg->size != sizeof(vmsg->payload.inflight)) {
@@ -1674,7 +1709,7 @@ vu_get_inflight_fd(VuDev *dev, VhostUserMsg *vmsg)
     mmap_size = vu_inflight_queue_size(queue_size) * num_queues;
 
 #ifdef MFD_ALLOW_SEALING
-    addr = memfd_alloc("vhost-inflight", mmap_size,
+    addr = memfd_alloc("vhost-inflight", &mmap_size,
                        F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL,
                        &fd);
 #else
@@ -692,11 +692,24 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
     int i, nb_oargs;
 
     /*
-     * For an opcode that ends a BB, reset all temp data.
-     * We do no cross-BB optimization.
+     * For an opcode that ends a BB, reset temp data.  The fall-through
+     * path of a conditional branch only has one predecessor, so what is
+     * known about globals and local temps still holds there; we optimize
+     * across extended basic blocks.  Normal temps die at the branch.
      */
     if (def->flags & TCG_OPF_BB_END) {
-        memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        if (def->flags & TCG_OPF_COND_BRANCH) {
+            TCGContext *s = ctx->tcg;
+
+            for (i = s->nb_globals; i < s->nb_temps; i++) {
+                if (s->temps[i].kind == TEMP_NORMAL &&
+                    test_bit(i, ctx->temps_used.l)) {
+                    reset_ts(&s->temps[i]);
+                }
+            }
+        } else {
+            memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        }
         ctx->prev_mb = NULL;
         return;
     }
@@ -56,6 +56,15 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    /*
+     * Regions that have filled up, oldest first, in a circular buffer
+     * of n entries; and regions that were freed by tcg_region_evict().
+     */
+    size_t *full;
+    size_t full_head;
+    size_t n_full;
+    size_t *free;
+    size_t n_free;
 };
 
 static struct tcg_region_state region;
@@ -163,10 +172,24 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Returns the index of the region containing @p, in the rw buffer */
+static size_t tcg_region_index(const void *p)
 {
-    size_t region_idx;
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
 
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -178,18 +201,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
-    return region_trees + region_idx * tree_size;
+    return region_trees + tcg_region_index(p) * tree_size;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
@@ -331,11 +343,14 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    if (region.current < region.n) {
+        tcg_region_assign(s, region.current);
+        region.current++;
+    } else if (region.n_free) {
+        tcg_region_assign(s, region.free[--region.n_free]);
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
     return false;
 }
 
@@ -348,11 +363,14 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t idx_full = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        region.full[(region.full_head + region.n_full) % region.n] = idx_full;
+        region.n_full++;
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -384,6 +402,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.full_head = 0;
+    region.n_full = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -394,6 +415,45 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+/*
+ * Call from a safe-work context.  Frees up to @n of the regions that filled
+ * up first, calling @invalidate on each of their TBs beforehand, so that
+ * they can be allocated again.  Regions in use by a context are never freed.
+ * Returns the number of regions freed.
+ */
+size_t tcg_region_evict(size_t n, GTraverseFunc invalidate)
+{
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < n && region.n_full; i++) {
+        size_t idx = region.full[region.full_head];
+        struct tcg_region_tree *rt = region_trees + idx * tree_size;
+        void *start, *end;
+
+        region.full_head = (region.full_head + 1) % region.n;
+        region.n_full--;
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, invalidate, NULL);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(idx, &start, &end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        region.free[region.n_free++] = idx;
+    }
+    qemu_mutex_unlock(&region.lock);
+    return i;
+}
+
+size_t tcg_region_count(void)
+{
+    return region.n;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -401,16 +461,21 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 #else
     size_t n_regions;
 
+    /*
+     * With a single vCPU thread, still split the buffer into a few regions
+     * of at least 2 MB, so that tcg_region_evict() can free the oldest code
+     * instead of flushing everything.
+     */
+    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
+        return MAX(1, MIN(tb_size / (2 * MiB), 8));
+    }
+
     /*
      * It is likely that some vCPUs will translate more code than others,
      * so we first try to set more regions than max_cpus, with those regions
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
 
     /*
      * Try to have more regions than max_cpus, with each region being >= 2 MB.
@@ -821,6 +886,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     }
 
     tcg_region_trees_init();
+    region.full = g_new(size_t, region.n);
+    region.free = g_new(size_t, region.n);
 
     /*
      * Leave the initial context initialized to the first region.
@@ -3173,6 +3173,17 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Return true if freeing 'reg' does not require a store, because its
+ * temporary is a constant or its value is already in memory.
+ */
+static bool tcg_reg_free_is_cheap(TCGContext *s, TCGReg reg)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+
+    return ts == NULL || temp_readonly(ts) || ts->mem_coherent;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -3232,6 +3243,15 @@ static TCGReg tcg_reg_alloc(TCGContext *s, TCGRegSet required_regs,
             tcg_reg_free(s, reg, allocated_regs);
             return reg;
         } else {
+            /* Prefer evicting a value that need not be stored first.  */
+            for (i = 0; i < n; i++) {
+                TCGReg reg = order[i];
+                if (tcg_regset_test_reg(set, reg) &&
+                    tcg_reg_free_is_cheap(s, reg)) {
+                    tcg_reg_free(s, reg, allocated_regs);
+                    return reg;
+                }
+            }
             for (i = 0; i < n; i++) {
                 TCGReg reg = order[i];
                 if (tcg_regset_test_reg(set, reg)) {
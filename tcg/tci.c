@@ -62,6 +62,7 @@ static uint64_t tci_uint64(uint32_t high, uint32_t low)
  *   i = immediate (uint32_t)
  *   I = immediate (tcg_target_ulong)
  *   l = label or pointer
+ *   L = label in the following word
  *   m = immediate (MemOpIdx)
  *   n = immediate (call return length)
  *   r = register
@@ -93,6 +94,17 @@ static void tci_args_rl(uint32_t insn, const void *tb_ptr,
     *l1 = sextract32(insn, 12, 20) + (void *)tb_ptr;
 }
 
+static void tci_args_rrcL(uint32_t insn, const uint32_t **tb_ptr,
+                          TCGReg *r0, TCGReg *r1, TCGCond *c2, void **l3)
+{
+    int32_t diff = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *c2 = extract32(insn, 16, 4);
+    *l3 = (void *)*tb_ptr + diff;
+}
+
 static void tci_args_rr(uint32_t insn, TCGReg *r0, TCGReg *r1)
 {
     *r0 = extract32(insn, 8, 4);
@@ -183,6 +195,22 @@ static void tci_args_rrrr(uint32_t insn,
     *r3 = extract32(insn, 20, 4);
 }
 
+#if TCG_TARGET_REG_BITS == 32
+static void tci_args_rrrrcL(uint32_t insn, const uint32_t **tb_ptr, TCGReg *r0,
+                            TCGReg *r1, TCGReg *r2, TCGReg *r3,
+                            TCGCond *c4, void **l5)
+{
+    int32_t diff = *(*tb_ptr)++;
+
+    *r0 = extract32(insn, 8, 4);
+    *r1 = extract32(insn, 12, 4);
+    *r2 = extract32(insn, 16, 4);
+    *r3 = extract32(insn, 20, 4);
+    *c4 = extract32(insn, 24, 4);
+    *l5 = (void *)*tb_ptr + diff;
+}
+#endif
+
 static void tci_args_rrrrrc(uint32_t insn, TCGReg *r0, TCGReg *r1,
                             TCGReg *r2, TCGReg *r3, TCGReg *r4, TCGCond *c5)
 {
@@ -768,11 +796,22 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i32:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if ((uint32_t)regs[r0]) {
+            tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare32(regs[r0], regs[r1], condition)) {
+                tb_ptr = ptr;
+            }
+            break;
+#if TCG_TARGET_REG_BITS == 32
+        case INDEX_op_brcond2_i32:
+            tci_args_rrrrcL(insn, &tb_ptr, &r0, &r1, &r2, &r3,
+                            &condition, &ptr);
+            T1 = tci_uint64(regs[r1], regs[r0]);
+            T2 = tci_uint64(regs[r3], regs[r2]);
+            if (tci_compare64(T1, T2, condition)) {
                 tb_ptr = ptr;
             }
             break;
+#endif
 #if TCG_TARGET_REG_BITS == 32 || TCG_TARGET_HAS_add2_i32
         case INDEX_op_add2_i32:
             tci_args_rrrrrr(insn, &r0, &r1, &r2, &r3, &r4, &r5);
@@ -981,8 +1020,8 @@ uintptr_t QEMU_DISABLE_CFI tcg_qemu_tb_exec(CPUArchState *env,
             break;
 #endif
         case INDEX_op_brcond_i64:
-            tci_args_rl(insn, tb_ptr, &r0, &ptr);
-            if (regs[r0]) {
+            tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &condition, &ptr);
+            if (tci_compare64(regs[r0], regs[r1], condition)) {
                 tb_ptr = ptr;
             }
             break;
@@ -1182,11 +1221,20 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
 
     case INDEX_op_brcond_i32:
     case INDEX_op_brcond_i64:
-        tci_args_rl(insn, tb_ptr, &r0, &ptr);
-        info->fprintf_func(info->stream, "%-12s  %s, 0, ne, %p",
-                           op_name, str_r(r0), ptr);
+        tci_args_rrcL(insn, &tb_ptr, &r0, &r1, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_c(c), ptr);
         break;
 
+#if TCG_TARGET_REG_BITS == 32
+    case INDEX_op_brcond2_i32:
+        tci_args_rrrrcL(insn, &tb_ptr, &r0, &r1, &r2, &r3, &c, &ptr);
+        info->fprintf_func(info->stream, "%-12s  %s, %s, %s, %s, %s, %p",
+                           op_name, str_r(r0), str_r(r1), str_r(r2),
+                           str_r(r3), str_c(c), ptr);
+        break;
+#endif
+
     case INDEX_op_setcond_i32:
     case INDEX_op_setcond_i64:
         tci_args_rrrc(insn, &r0, &r1, &r2, &c);
@@ -1397,5 +1445,5 @@ int print_insn_tci(bfd_vma addr, disassemble_info *info)
         break;
     }
 
-    return sizeof(insn);
+    return (void *)tb_ptr - (void *)(uintptr_t)addr;
 }
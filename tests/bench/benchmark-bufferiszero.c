@@ -0,0 +1,71 @@
+/*
+ * buffer_is_zero() speed benchmark
+ *
+ * Checks pages the way migration does, on workloads that are mostly made of
+ * zero pages and mostly made of dirty pages, once with each implementation
+ * supported by the host, fastest first.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+
+#define BENCH_PAGE_SIZE 4096
+#define BENCH_PAGES 256
+
+/* Percentage of pages with a non-zero byte, at a random offset */
+static const int dirty_percent[] = { 0, 10, 90, 100 };
+
+static void bench_pages(uint8_t *buf, int dirty)
+{
+    const size_t total = 4 * GiB;
+    size_t remain, zero = 0;
+    int i;
+
+    memset(buf, 0, BENCH_PAGES * BENCH_PAGE_SIZE);
+    for (i = 0; i < BENCH_PAGES; i++) {
+        if (g_test_rand_int_range(0, 100) < dirty) {
+            int offset = g_test_rand_int_range(0, BENCH_PAGE_SIZE);
+
+            buf[i * BENCH_PAGE_SIZE + offset] = 1;
+        }
+    }
+
+    g_test_timer_start();
+    for (remain = total, i = 0; remain; remain -= BENCH_PAGE_SIZE, i++) {
+        int page = i % BENCH_PAGES;
+
+        zero += buffer_is_zero(buf + page * BENCH_PAGE_SIZE, BENCH_PAGE_SIZE);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("buffer_is_zero(%s): %d%% dirty pages, %zu zero, "
+                   "%.2f MB/sec", buffer_is_zero_accel_name(), dirty, zero,
+                   total / MiB / g_test_timer_last());
+}
+
+static void test_speed(void)
+{
+    uint8_t *buf = qemu_memalign(BENCH_PAGE_SIZE,
+                                 BENCH_PAGES * BENCH_PAGE_SIZE);
+    int i;
+
+    /* Switching implementation can't be undone, so test them all here */
+    do {
+        for (i = 0; i < ARRAY_SIZE(dirty_percent); i++) {
+            bench_pages(buf, dirty_percent[i]);
+        }
+    } while (test_buffer_is_zero_next_accel());
+
+    qemu_vfree(buf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/bufferiszero/benchmark/pages", test_speed);
+
+    return g_test_run();
+}
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bswap.h"
 #include "crypto/init.h"
 #include "crypto/cipher.h"
 
@@ -164,6 +165,90 @@ static void test_cipher_speed_xts_aes_256(const void *opaque)
                       QCRYPTO_CIPHER_ALG_AES_256);
 }
 
+/*
+ * Encrypt a 1 MiB buffer as a sequence of XTS sectors of @sector_size
+ * bytes, each with its own tweak, the way block/crypto handles disk I/O.
+ */
+static void test_cipher_speed_xts_sectors(size_t sector_size,
+                                          QCryptoCipherAlgorithm alg)
+{
+    QCryptoCipher *cipher;
+    Error *err = NULL;
+    uint8_t *key = NULL, *buf = NULL;
+    uint8_t iv[16];
+    size_t nkey;
+    const size_t bufsize = 1 * MiB;
+    const size_t total = 2 * GiB;
+    size_t remain, i;
+
+    if (!qcrypto_cipher_supports(alg, QCRYPTO_CIPHER_MODE_XTS)) {
+        return;
+    }
+
+    nkey = qcrypto_cipher_get_key_len(alg) * 2;
+    key = g_new0(uint8_t, nkey);
+    memset(key, g_test_rand_int(), nkey);
+
+    buf = g_new0(uint8_t, bufsize);
+    memset(buf, g_test_rand_int(), bufsize);
+
+    cipher = qcrypto_cipher_new(alg, QCRYPTO_CIPHER_MODE_XTS,
+                                key, nkey, &err);
+    g_assert(cipher != NULL);
+
+    g_test_timer_start();
+    for (remain = total; remain; remain -= bufsize) {
+        for (i = 0; i < bufsize; i += sector_size) {
+            uint64_t sector = cpu_to_le64(i / sector_size);
+
+            memset(iv, 0, sizeof(iv));
+            memcpy(iv, &sector, sizeof(sector));
+            g_assert(qcrypto_cipher_setiv(cipher, iv, sizeof(iv), &err) == 0);
+            g_assert(qcrypto_cipher_encrypt(cipher, buf + i, buf + i,
+                                            sector_size, &err) == 0);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("enc(%s-xts) sectors %zu bytes %.2f MB/sec ",
+                   QCryptoCipherAlgorithm_str(alg),
+                   sector_size, (double)total / MiB / g_test_timer_last());
+
+    g_test_timer_start();
+    for (remain = total; remain; remain -= bufsize) {
+        for (i = 0; i < bufsize; i += sector_size) {
+            uint64_t sector = cpu_to_le64(i / sector_size);
+
+            memset(iv, 0, sizeof(iv));
+            memcpy(iv, &sector, sizeof(sector));
+            g_assert(qcrypto_cipher_setiv(cipher, iv, sizeof(iv), &err) == 0);
+            g_assert(qcrypto_cipher_decrypt(cipher, buf + i, buf + i,
+                                            sector_size, &err) == 0);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("dec(%s-xts) sectors %zu bytes %.2f MB/sec ",
+                   QCryptoCipherAlgorithm_str(alg),
+                   sector_size, (double)total / MiB / g_test_timer_last());
+
+    qcrypto_cipher_free(cipher);
+    g_free(buf);
+    g_free(key);
+}
+
+static void test_cipher_speed_xts_sectors_aes_128(const void *opaque)
+{
+    size_t sector_size = (size_t)opaque;
+    test_cipher_speed_xts_sectors(sector_size, QCRYPTO_CIPHER_ALG_AES_128);
+}
+
+static void test_cipher_speed_xts_sectors_aes_256(const void *opaque)
+{
+    size_t sector_size = (size_t)opaque;
+    test_cipher_speed_xts_sectors(sector_size, QCRYPTO_CIPHER_ALG_AES_256);
+}
+
 
 int main(int argc, char **argv)
 {
@@ -204,5 +289,10 @@ int main(int argc, char **argv)
     ADD_TESTS(16384);
     ADD_TESTS(65536);
 
+    ADD_TEST(xts_sectors, aes, 128, 512);
+    ADD_TEST(xts_sectors, aes, 256, 512);
+    ADD_TEST(xts_sectors, aes, 128, 4096);
+    ADD_TEST(xts_sectors, aes, 256, 4096);
+
     return g_test_run();
 }
@@ -0,0 +1,80 @@
+/*
+ * XBZRLE encoder speed benchmark
+ *
+ * Runs the encoder on pages with different amounts of changed bytes, once
+ * with each implementation supported by the host, fastest first.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+#define XBZRLE_BENCH_PAGES 256
+
+/* Number of bytes changed in each page, the rest is left untouched */
+static const int changed_bytes[] = { 1, 16, 64, 256, 1024 };
+
+static void bench_encode(uint8_t *old_buf, uint8_t *new_buf, int changed)
+{
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    const size_t total = 1 * GiB;
+    size_t remain;
+    int i;
+
+    memcpy(new_buf, old_buf, XBZRLE_BENCH_PAGES * XBZRLE_PAGE_SIZE);
+    for (i = 0; i < XBZRLE_BENCH_PAGES * changed; i++) {
+        int page = i / changed;
+        int offset = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+
+        new_buf[page * XBZRLE_PAGE_SIZE + offset] ^= 0xff;
+    }
+
+    g_test_timer_start();
+    for (remain = total, i = 0; remain; remain -= XBZRLE_PAGE_SIZE, i++) {
+        int page = i % XBZRLE_BENCH_PAGES;
+
+        /* Pages with too many changes overflow, as during migration */
+        xbzrle_encode_buffer(old_buf + page * XBZRLE_PAGE_SIZE,
+                             new_buf + page * XBZRLE_PAGE_SIZE,
+                             XBZRLE_PAGE_SIZE, compressed, XBZRLE_PAGE_SIZE);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("xbzrle(%s): %d changed bytes per page %.2f MB/sec",
+                   xbzrle_accel_name(), changed,
+                   total / MiB / g_test_timer_last());
+
+    g_free(compressed);
+}
+
+static void test_encode_speed(void)
+{
+    uint8_t *old_buf = g_malloc(XBZRLE_BENCH_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(XBZRLE_BENCH_PAGES * XBZRLE_PAGE_SIZE);
+    int i;
+
+    for (i = 0; i < XBZRLE_BENCH_PAGES * XBZRLE_PAGE_SIZE; i++) {
+        old_buf[i] = g_test_rand_int();
+    }
+
+    /* Switching implementation can't be undone, so test them all here */
+    do {
+        for (i = 0; i < ARRAY_SIZE(changed_bytes); i++) {
+            bench_encode(old_buf, new_buf, changed_bytes[i]);
+        }
+    } while (xbzrle_test_next_accel());
+
+    g_free(old_buf);
+    g_free(new_buf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/xbzrle/benchmark/encode", test_encode_speed);
+
+    return g_test_run();
+}
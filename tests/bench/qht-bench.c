@@ -9,6 +9,7 @@
 #include "qemu/atomic.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "qemu/xxhash.h"
 
 struct thread_stats {
@@ -20,6 +21,7 @@ struct thread_stats {
     size_t not_rm;
     size_t rz;
     size_t not_rz;
+    int64_t in_max_ns;
 };
 
 struct thread_info {
@@ -60,6 +62,7 @@ static double resize_rate; /* 0.0 to 1.0 */
 static unsigned int n_rz_threads = 1;
 static QemuThread *rz_threads;
 static bool precompute_hash;
+static bool measure_latency;
 
 static double update_rate; /* 0.0 to 1.0 */
 static uint64_t update_threshold;
@@ -92,7 +95,9 @@ static const char commands_string[] =
     " -R = enable auto-resize\n"
     " -S = resize rate (0.0 to 100.0)\n"
     " -D = delay (in us) between potential resizes\n"
-    " -N = number of resize threads";
+    " -N = number of resize threads\n"
+    "\n"
+    " -L = measure the latency of insertions, e.g. to find resize stalls";
 
 static void usage_complete(int argc, char *argv[])
 {
@@ -180,7 +185,15 @@ static void do_rw(struct thread_info *info)
             bool written = false;
 
             if (qht_lookup(&ht, p, hash) == NULL) {
-                written = qht_insert(&ht, p, hash, NULL);
+                if (measure_latency) {
+                    int64_t t = get_clock();
+
+                    written = qht_insert(&ht, p, hash, NULL);
+                    t = get_clock() - t;
+                    stats->in_max_ns = MAX(stats->in_max_ns, t);
+                } else {
+                    written = qht_insert(&ht, p, hash, NULL);
+                }
             }
             if (written) {
                 stats->in++;
@@ -377,6 +390,7 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 
         s->in += stats->in;
         s->not_in += stats->not_in;
+        s->in_max_ns = MAX(s->in_max_ns, stats->in_max_ns);
 
         s->rm += stats->rm;
         s->not_rm += stats->not_rm;
@@ -409,6 +423,9 @@ static void pr_stats(void)
            (double)s.in / 1e6,
            (double)s.in / (s.in + s.not_in) * 100,
            (double)(s.in + s.not_in) / 1e6);
+    if (measure_latency) {
+        printf(" Slowest insertion: %.2f us\n", s.in_max_ns / 1e3);
+    }
     printf(" Removed:           %.2f M (%.2f%% of %.2fM)\n",
            (double)s.rm / 1e6,
            (double)s.rm / (s.rm + s.not_rm) * 100,
@@ -444,7 +461,7 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:pr:Rs:S:u:");
+        c = getopt(argc, argv, "d:D:g:k:K:l:hLn:N:o:pr:Rs:S:u:");
         if (c < 0) {
             break;
         }
@@ -474,6 +491,9 @@ static void parse_args(int argc, char *argv[])
         case 'l':
             lookup_range = pow2ceil(atol(optarg));
             break;
+        case 'L':
+            measure_latency = true;
+            break;
         case 'n':
             n_rw_threads = atoi(optarg);
             break;
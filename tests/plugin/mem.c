@@ -19,13 +19,22 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 static uint64_t inline_mem_count;
 static uint64_t cb_mem_count;
 static uint64_t io_count;
-static bool do_inline, do_callback;
+static uint64_t ring_mem_count, ring_lost_count;
+static GMutex ring_lock;
+static struct qemu_plugin_mem_ring *ring;
+static unsigned int n_vcpus;
+static bool do_inline, do_callback, do_ring;
 static bool do_haddr;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 
 static void plugin_exit(qemu_plugin_id_t id, void *p)
 {
     g_autoptr(GString) out = g_string_new("");
+    unsigned int i;
+
+    for (i = 0; do_ring && i < n_vcpus; i++) {
+        qemu_plugin_mem_ring_drain(ring, i);
+    }
 
     if (do_inline) {
         g_string_printf(out, "inline mem accesses: %" PRIu64 "\n", inline_mem_count);
@@ -36,9 +45,31 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     if (do_haddr) {
         g_string_append_printf(out, "io accesses: %" PRIu64 "\n", io_count);
     }
+    if (do_ring) {
+        g_string_append_printf(out, "ring mem accesses: %" PRIu64
+                               " (%" PRIu64 " lost)\n",
+                               ring_mem_count, ring_lost_count);
+    }
     qemu_plugin_outs(out->str);
 }
 
+static void vcpu_init(qemu_plugin_id_t id, unsigned int cpu_index)
+{
+    g_mutex_lock(&ring_lock);
+    n_vcpus = MAX(n_vcpus, cpu_index + 1);
+    g_mutex_unlock(&ring_lock);
+}
+
+static void vcpu_mem_ring(unsigned int cpu_index,
+                          const qemu_plugin_mem_record *records, size_t n,
+                          uint64_t lost, void *udata)
+{
+    g_mutex_lock(&ring_lock);
+    ring_mem_count += n;
+    ring_lost_count += lost;
+    g_mutex_unlock(&ring_lock);
+}
+
 static void vcpu_mem(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
                      uint64_t vaddr, void *udata)
 {
@@ -73,6 +104,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
                                              QEMU_PLUGIN_CB_NO_REGS,
                                              rw, NULL);
         }
+        if (do_ring) {
+            qemu_plugin_register_vcpu_mem_ring(insn, rw, ring);
+        }
     }
 }
 
@@ -111,12 +145,22 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "ring") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &do_ring)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
         }
     }
 
+    if (do_ring) {
+        ring = qemu_plugin_mem_ring_new(4096, vcpu_mem_ring, NULL);
+        qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
     return 0;
@@ -51,6 +51,7 @@ enum Reg {
     INTRSTATUS = 4,
     IVPOSITION = 8,
     DOORBELL = 12,
+    PENDING = 16,
 };
 
 static const char* reg2str(enum Reg reg) {
@@ -63,6 +64,8 @@ static const char* reg2str(enum Reg reg) {
         return "IVPosition";
     case DOORBELL:
         return "DoorBell";
+    case PENDING:
+        return "Pending";
     default:
         return NULL;
     }
@@ -156,6 +159,8 @@ static void test_ivshmem_single(void)
     g_assert_cmpuint(in_reg(s, INTRMASK), ==, 0);
     g_assert_cmpuint(in_reg(s, INTRSTATUS), ==, 0);
     g_assert_cmpuint(in_reg(s, IVPOSITION), ==, 0);
+    /* no MSI-X, nothing to poll */
+    g_assert_cmpuint(in_reg(s, PENDING), ==, 0);
 
     /* trigger interrupt via registers */
     out_reg(s, INTRMASK, 0xffffffff);
@@ -354,6 +359,11 @@ static void test_ivshmem_server(void)
     } while (ret == 0 && g_get_monotonic_time() < end_time);
     g_assert_cmpuint(ret, !=, 0);
 
+    /* the vector is masked, so polling Pending returns and clears it */
+    g_assert_cmpuint(in_reg(s1, PENDING), ==, 1 << 0);
+    g_assert_cmpuint(in_reg(s1, PENDING), ==, 0);
+    g_assert_false(qpci_msix_pending(s1->dev, 0));
+
     /* ping vm1 -> vm2 on vector 1 */
     ret = qpci_msix_pending(s2->dev, 1);
     g_assert_cmpuint(ret, ==, 0);
@@ -364,6 +374,9 @@ static void test_ivshmem_server(void)
     } while (ret == 0 && g_get_monotonic_time() < end_time);
     g_assert_cmpuint(ret, !=, 0);
 
+    g_assert_cmpuint(in_reg(s2, PENDING), ==, 1 << 1);
+    g_assert_cmpuint(in_reg(s2, PENDING), ==, 0);
+
     cleanup_vm(s2);
     cleanup_vm(s1);
 
@@ -388,6 +388,62 @@ void qvirtqueue_kick(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
     }
 }
 
+/*
+ * qvirtqueue_kick_batch:
+ * @heads: the first descriptors of the chains to make available
+ * @n: the number of chains
+ *
+ * Like qvirtqueue_kick() for @n chains at once, with a single update of
+ * the avail index and a single notification.  This keeps the number of
+ * qtest commands per request low, so that a benchmark can reuse the same
+ * descriptor chains over and over.
+ */
+void qvirtqueue_kick_batch(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
+                           const uint32_t *heads, int n)
+{
+    /* vq->avail->idx */
+    uint16_t idx = qvirtio_readw(d, qts, vq->avail + 2);
+    bool big_endian = !(d->features & (1ull << VIRTIO_F_VERSION_1)) &&
+                      qtest_big_endian(qts);
+    g_autofree uint16_t *ring = g_new(uint16_t, n);
+    int i, start, len;
+
+    g_assert_cmpint(n, <=, vq->size);
+    for (i = 0; i < n; i++) {
+        ring[i] = big_endian ? cpu_to_be16(heads[i]) : cpu_to_le16(heads[i]);
+    }
+
+    /* vq->avail->ring[idx % vq->size], in up to two pieces if it wraps */
+    for (i = 0; i < n; i += len) {
+        start = (uint16_t)(idx + i) % vq->size;
+        len = MIN(n - i, vq->size - start);
+        qtest_memwrite(qts, vq->avail + 4 + 2 * start, ring + i,
+                       len * sizeof(*ring));
+    }
+    /* vq->avail->idx */
+    qvirtio_writew(d, qts, vq->avail + 2, idx + n);
+
+    d->bus->virtqueue_kick(d, vq);
+}
+
+/*
+ * qvirtqueue_consume_used:
+ *
+ * Skips all the used elements that are ready, without reading them.
+ *
+ * Returns: the number of elements that were skipped
+ */
+uint16_t qvirtqueue_consume_used(QTestState *qts, QVirtQueue *vq)
+{
+    uint16_t idx, n;
+
+    idx = qvirtio_readw(vq->vdev, qts,
+                        vq->used + offsetof(struct vring_used, idx));
+    n = idx - vq->last_used_idx;
+    vq->last_used_idx = idx;
+    return n;
+}
+
 /*
  * qvirtqueue_get_buf:
  * @desc_idx: A pointer that is filled with the vq->desc[] index, may be NULL
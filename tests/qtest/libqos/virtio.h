@@ -145,6 +145,9 @@ uint32_t qvirtqueue_add_indirect(QTestState *qts, QVirtQueue *vq,
                                  QVRingIndirectDesc *indirect);
 void qvirtqueue_kick(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
                      uint32_t free_head);
+void qvirtqueue_kick_batch(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
+                           const uint32_t *heads, int n);
+uint16_t qvirtqueue_consume_used(QTestState *qts, QVirtQueue *vq);
 bool qvirtqueue_get_buf(QTestState *qts, QVirtQueue *vq, uint32_t *desc_idx,
                         uint32_t *len);
 
@@ -1298,6 +1298,20 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    test_multifd_tcp("lz4");
+}
+#endif
+
+#ifdef CONFIG_QPL
+static void test_multifd_tcp_qpl(void)
+{
+    test_multifd_tcp("qpl");
+}
+#endif
+
 /*
  * This test does:
  *  source               target
@@ -1479,6 +1493,12 @@ int main(int argc, char **argv)
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/zstd", test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/lz4", test_multifd_tcp_lz4);
+#endif
+#ifdef CONFIG_QPL
+    qtest_add_func("/migration/multifd/tcp/qpl", test_multifd_tcp_qpl);
+#endif
 
     if (kvm_dirty_ring_supported()) {
         qtest_add_func("/migration/dirty_ring",
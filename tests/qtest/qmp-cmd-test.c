@@ -54,6 +54,8 @@ static int query_error_class(const char *cmd)
         /* Only valid with accel=tcg */
         { "x-query-jit", ERROR_CLASS_GENERIC_ERROR },
         { "x-query-opcount", ERROR_CLASS_GENERIC_ERROR },
+        /* Likewise, and requires tb-stats=on */
+        { "x-query-tb-stats", ERROR_CLASS_GENERIC_ERROR },
         { NULL, -1 }
     };
     int i;
@@ -174,6 +174,43 @@ static void remove_netdev_with_multi_netfilter(void)
     qobject_unref(response);
 }
 
+/* add a filter-gro to a netdev and then remove it */
+static void add_gro_netfilter(void)
+{
+    QDict *response;
+
+    response = qmp("{'execute': 'object-add',"
+                   " 'arguments': {"
+                   "   'qom-type': 'filter-gro',"
+                   "   'id': 'qtest-f0',"
+                   "   'netdev': 'qtest-bn0',"
+                   "   'timeout': 0"
+                   "}}");
+    g_assert(response);
+    g_assert(qdict_haskey(response, "error"));
+    qobject_unref(response);
+
+    response = qmp("{'execute': 'object-add',"
+                   " 'arguments': {"
+                   "   'qom-type': 'filter-gro',"
+                   "   'id': 'qtest-f0',"
+                   "   'netdev': 'qtest-bn0',"
+                   "   'queue': 'tx',"
+                   "   'timeout': 100"
+                   "}}");
+    g_assert(response);
+    g_assert(!qdict_haskey(response, "error"));
+    qobject_unref(response);
+
+    response = qmp("{'execute': 'object-del',"
+                   " 'arguments': {"
+                   "   'id': 'qtest-f0'"
+                   "}}");
+    g_assert(response);
+    g_assert(!qdict_haskey(response, "error"));
+    qobject_unref(response);
+}
+
 int main(int argc, char **argv)
 {
     int ret;
@@ -186,6 +223,7 @@ int main(int argc, char **argv)
     qtest_add_func("/netfilter/addremove_multi", add_multi_netfilter);
     qtest_add_func("/netfilter/remove_netdev_multi",
                    remove_netdev_with_multi_netfilter);
+    qtest_add_func("/netfilter/addremove_gro", add_gro_netfilter);
 
     args = g_strdup_printf("-nic user,id=qtest-bn0");
     qtest_start(args);
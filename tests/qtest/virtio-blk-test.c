@@ -12,6 +12,7 @@
 #include "libqtest-single.h"
 #include "qemu/bswap.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
@@ -24,6 +25,11 @@
 #define QVIRTIO_BLK_TIMEOUT_US  (30 * 1000 * 1000)
 #define PCI_SLOT_HP             0x06
 
+/* Requests in flight and number of times they are resubmitted */
+#define BENCH_DEPTH             32
+#define BENCH_ROUNDS            4096
+#define BENCH_BUF_SIZE          4096
+
 typedef struct QVirtioBlkReq {
     uint32_t type;
     uint32_t ioprio;
@@ -766,6 +772,94 @@ static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/*
+ * Read benchmark of the virtqueue fast path.  The descriptor chains are set
+ * up once and made available again in batches, and the disk is null-co, so
+ * that the time goes to virtio and virtio-blk rather than to host I/O.  The
+ * qtest protocol round trips are included in the results, so only compare
+ * them between builds on the same host.
+ */
+static void perf_read(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QTestState *qts = global_qtest;
+    uint64_t req_addr[BENCH_DEPTH];
+    uint32_t heads[BENCH_DEPTH];
+    QVirtioBlkReq req;
+    QVirtQueue *vq;
+    uint64_t features;
+    int64_t ticks;
+    double duration;
+    int i, done;
+
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                    (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                    (1u << VIRTIO_RING_F_EVENT_IDX) |
+                    (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    g_assert_cmpint(vq->size, >=, 3 * BENCH_DEPTH);
+
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        req.type = VIRTIO_BLK_T_IN;
+        req.ioprio = 1;
+        req.sector = i * (BENCH_BUF_SIZE / 512);
+        req.data = g_malloc0(BENCH_BUF_SIZE);
+
+        req_addr[i] = virtio_blk_request(t_alloc, dev, &req, BENCH_BUF_SIZE);
+
+        g_free(req.data);
+
+        heads[i] = qvirtqueue_add(qts, vq, req_addr[i], 16, false, true);
+        qvirtqueue_add(qts, vq, req_addr[i] + 16, BENCH_BUF_SIZE, true, true);
+        qvirtqueue_add(qts, vq, req_addr[i] + 16 + BENCH_BUF_SIZE, 1, true,
+                       false);
+    }
+
+    g_test_timer_start();
+    ticks = cpu_get_host_ticks();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        gint64 start_time = g_get_monotonic_time();
+
+        qvirtqueue_kick_batch(qts, dev, vq, heads, BENCH_DEPTH);
+        for (done = 0; done < BENCH_DEPTH;
+             done += qvirtqueue_consume_used(qts, vq)) {
+            g_assert(g_get_monotonic_time() - start_time <=
+                     QVIRTIO_BLK_TIMEOUT_US);
+        }
+        g_assert_cmpint(done, ==, BENCH_DEPTH);
+    }
+    ticks = cpu_get_host_ticks() - ticks;
+    duration = g_test_timer_elapsed();
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        g_assert_cmpint(readb(req_addr[i] + 16 + BENCH_BUF_SIZE), ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    g_test_message("virtio-blk read: %d requests of %d bytes, %d in parallel: "
+                   "%f s, %.0f requests/s, %" PRId64 " host ticks per request",
+                   BENCH_ROUNDS * BENCH_DEPTH, BENCH_BUF_SIZE, BENCH_DEPTH,
+                   duration, BENCH_ROUNDS * BENCH_DEPTH / duration,
+                   ticks / (BENCH_ROUNDS * BENCH_DEPTH));
+
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
+static void *virtio_blk_bench_setup(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -drive if=none,id=drive0,file=null-co://,"
+                    "format=raw ");
+
+    return arg;
+}
+
 static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
 {
     char *tmp_path = drive_create();
@@ -797,6 +891,11 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    if (g_test_perf()) {
+        opts.before = virtio_blk_bench_setup;
+        qos_add_test("perf-read", "virtio-blk", perf_read, &opts);
+    }
 }
 
 libqos_init(register_virtio_blk_test);
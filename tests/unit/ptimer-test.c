@@ -27,18 +27,18 @@ static void ptimer_test_expire_qemu_timers(int64_t expire_time,
                                            QEMUClockType type)
 {
     QEMUTimerList *timer_list = main_loop_tlg.tl[type];
-    QEMUTimer *t = timer_list->active_timers.next;
+    int i;
+
+    for (i = 0; i < PTIMER_TEST_MAX_TIMERS; i++) {
+        QEMUTimer *t = timer_list->active_timers[i];
 
-    while (t != NULL) {
-        if (t->expire_time == expire_time) {
+        if (t && t->expire_time == expire_time) {
             timer_del(t);
 
             if (t->cb != NULL) {
                 t->cb(t->opaque);
             }
         }
-
-        t = t->next;
     }
 }
 
@@ -0,0 +1,81 @@
+/*
+ * buffer_diff_chunks() tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+
+#define TEST_SIZE 4096
+
+static uint8_t buf_a[TEST_SIZE + 64];
+static uint8_t buf_b[TEST_SIZE + 64];
+
+static void test_chunks(size_t chunk, size_t len, size_t align)
+{
+    size_t nbits = DIV_ROUND_UP(len, chunk);
+    g_autofree unsigned long *bitmap = bitmap_new(nbits);
+    uint8_t *a = buf_a + align, *b = buf_b + align;
+    size_t i;
+
+    memset(buf_a, 0x5a, sizeof(buf_a));
+    memset(buf_b, 0x5a, sizeof(buf_b));
+
+    /* Equal buffers */
+    bitmap_set(bitmap, 0, nbits);
+    g_assert_cmpint(buffer_diff_chunks(a, b, len, chunk, bitmap), ==, 0);
+    g_assert(bitmap_empty(bitmap, nbits));
+
+    /* One changed byte, at every offset */
+    for (i = 0; i < len; i++) {
+        b[i] ^= 1;
+        bitmap_set(bitmap, 0, nbits);
+        g_assert_cmpint(buffer_diff_chunks(a, b, len, chunk, bitmap), ==, 1);
+        g_assert_cmpint(find_first_bit(bitmap, nbits), ==, i / chunk);
+
+        /* Clear bits are not compared */
+        bitmap_zero(bitmap, nbits);
+        g_assert_cmpint(buffer_diff_chunks(a, b, len, chunk, bitmap), ==, 0);
+        b[i] ^= 1;
+    }
+
+    /* Bytes outside of the buffers are ignored */
+    b[-1] ^= 1;
+    b[len] ^= 1;
+    bitmap_set(bitmap, 0, nbits);
+    g_assert_cmpint(buffer_diff_chunks(a, b, len, chunk, bitmap), ==, 0);
+}
+
+static void test_1(void)
+{
+    static const size_t chunks[] = { 1, 7, 16, 32, 64, 100, 128 };
+    size_t c, align;
+
+    for (c = 0; c < ARRAY_SIZE(chunks); c++) {
+        for (align = 1; align < 64; align += 31) {
+            test_chunks(chunks[c], TEST_SIZE / 4 + 3, align);
+            test_chunks(chunks[c], chunks[c] * 3, align);
+        }
+    }
+}
+
+static void test_2(void)
+{
+    if (g_test_perf()) {
+        test_1();
+    } else {
+        do {
+            test_1();
+        } while (test_buffer_diff_next_accel());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/cutils/bufferdiff", test_2);
+
+    return g_test_run();
+}
@@ -378,6 +378,26 @@ static void test_hbitmap_reset(TestHBitmapData *data,
     hbitmap_test_set(data, L3 / 2, L3);
 }
 
+/* The last level is allocated in pages of 512 words */
+#define PAGE_BITS                  (BITS_PER_LONG * 512)
+
+static void test_hbitmap_reset_pages(TestHBitmapData *data,
+                                     const void *unused)
+{
+    hbitmap_test_init(data, L3 * 2, 0);
+    hbitmap_test_set(data, PAGE_BITS - 1, 2);
+    hbitmap_test_reset(data, PAGE_BITS - 1, 1);
+    hbitmap_test_reset(data, PAGE_BITS, 1);
+    hbitmap_test_set(data, PAGE_BITS, PAGE_BITS * 2);
+    hbitmap_test_reset(data, PAGE_BITS + 1, PAGE_BITS);
+    hbitmap_test_check_get(data);
+    hbitmap_test_reset(data, 0, L3);
+    hbitmap_test_set(data, L3 - 1, 2);
+    hbitmap_test_check_get(data);
+    hbitmap_test_reset(data, L3 - 1, L3 + 1);
+    hbitmap_test_check_get(data);
+}
+
 static void test_hbitmap_reset_all(TestHBitmapData *data,
                                    const void *unused)
 {
@@ -1042,6 +1062,126 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+static void test_hbitmap_merge_check(HBitmap *r, HBitmap *a, HBitmap *b,
+                                     uint64_t size)
+{
+    uint64_t i;
+
+    for (i = 0; i < size; i++) {
+        g_assert_cmpint(hbitmap_get(r, i), ==,
+                        hbitmap_get(a, i) || hbitmap_get(b, i));
+    }
+}
+
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    uint64_t size = L3 * 4;
+    HBitmap *b, *r;
+
+    hbitmap_test_init(data, size, 0);
+    b = hbitmap_alloc(size, 0);
+    r = hbitmap_alloc(size, 0);
+
+    hbitmap_test_set(data, 0, L1);
+    hbitmap_test_set(data, L3 + 5, L2);
+    hbitmap_set(b, L1 / 2, L1);
+    hbitmap_set(b, size - L2, L2);
+    /* Not set in either input, so it must be cleared */
+    hbitmap_set(r, L3 * 2, 1);
+
+    g_assert(hbitmap_merge(data->hb, b, r));
+    test_hbitmap_merge_check(r, data->hb, b, size);
+    g_assert_cmpint(hbitmap_count(r), ==, L1 + L1 / 2 + 2 * L2);
+
+    /* Merge in place, with pages that are missing in one of the inputs */
+    g_assert(hbitmap_merge(data->hb, b, data->hb));
+    test_hbitmap_merge_check(data->hb, r, r, size);
+    g_assert_cmpint(hbitmap_count(data->hb), ==, hbitmap_count(r));
+
+    hbitmap_free(b);
+    hbitmap_free(r);
+}
+
+/* 1 TiB at a 64 KiB granularity; one in eight pages of words is dirty */
+#define PERF_SIZE       (1ULL << 40)
+#define PERF_GRAN       16
+#define PERF_CHUNK      (1ULL << 31)
+
+static HBitmap *perf_hbitmap_alloc(uint64_t offset)
+{
+    HBitmap *hb = hbitmap_alloc(PERF_SIZE, PERF_GRAN);
+    uint64_t i;
+
+    for (i = offset; i < PERF_SIZE; i += PERF_CHUNK * 8) {
+        hbitmap_set(hb, i, PERF_CHUNK);
+    }
+    return hb;
+}
+
+static void perf_hbitmap_merge(void)
+{
+    HBitmap *a = perf_hbitmap_alloc(0);
+    HBitmap *b = perf_hbitmap_alloc(PERF_CHUNK * 3);
+    HBitmap *r = hbitmap_alloc(PERF_SIZE, PERF_GRAN);
+    unsigned int i, max = 1000;
+    double duration;
+
+    g_test_timer_start();
+    for (i = 0; i < max; i++) {
+        hbitmap_merge(a, b, r);
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("Merge %u iterations: %f s", max, duration);
+    g_assert_cmpint(hbitmap_count(r), ==, hbitmap_count(a) * 2);
+
+    hbitmap_free(a);
+    hbitmap_free(b);
+    hbitmap_free(r);
+}
+
+static void perf_hbitmap_next_dirty_area(void)
+{
+    HBitmap *hb = perf_hbitmap_alloc(0);
+    unsigned int i, max = 1000, areas = 0;
+    int64_t offset, count;
+    double duration;
+
+    g_test_timer_start();
+    for (i = 0; i < max; i++) {
+        for (offset = 0;
+             hbitmap_next_dirty_area(hb, offset, PERF_SIZE, INT64_MAX,
+                                     &offset, &count);
+             offset += count) {
+            areas++;
+        }
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("Next dirty area %u iterations, %u areas: %f s",
+                   max, areas, duration);
+
+    hbitmap_free(hb);
+}
+
+static void perf_hbitmap_set(void)
+{
+    HBitmap *hb = hbitmap_alloc(PERF_SIZE, PERF_GRAN);
+    unsigned int i, max = 1000;
+    double duration;
+
+    g_test_timer_start();
+    for (i = 0; i < max; i++) {
+        hbitmap_set(hb, 0, PERF_SIZE);
+        hbitmap_reset_all(hb);
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("Set all %u iterations: %f s", max, duration);
+
+    hbitmap_free(hb);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1060,6 +1200,7 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/set/overlap", test_hbitmap_set_overlap);
     hbitmap_test_add("/hbitmap/reset/empty", test_hbitmap_reset_empty);
     hbitmap_test_add("/hbitmap/reset/general", test_hbitmap_reset);
+    hbitmap_test_add("/hbitmap/reset/pages", test_hbitmap_reset_pages);
     hbitmap_test_add("/hbitmap/reset/all", test_hbitmap_reset_all);
     hbitmap_test_add("/hbitmap/granularity", test_hbitmap_granularity);
 
@@ -1112,6 +1253,14 @@ int main(int argc, char **argv)
                      test_hbitmap_next_dirty_area_4);
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
+    hbitmap_test_add("/hbitmap/merge", test_hbitmap_merge);
+
+    if (g_test_perf()) {
+        g_test_add_func("/hbitmap/perf/merge", perf_hbitmap_merge);
+        g_test_add_func("/hbitmap/perf/next_dirty_area",
+                        perf_hbitmap_next_dirty_area);
+        g_test_add_func("/hbitmap/perf/set", perf_hbitmap_set);
+    }
 
     g_test_run();
 
@@ -101,6 +101,47 @@ static void test_io_channel_fd(void)
     object_unref(OBJECT(ioc));
 }
 
+static void test_io_channel_file_pwritev(void)
+{
+    QIOChannel *src, *dst;
+    char buf[16] = { 0 };
+    char a[] = "hello";
+    char b[] = "world";
+    struct iovec iov[2] = {
+        { .iov_base = a, .iov_len = 5 },
+        { .iov_base = b, .iov_len = 5 },
+    };
+    struct iovec riov = { .iov_base = buf, .iov_len = 10 };
+
+    unlink(TEST_FILE);
+    src = QIO_CHANNEL(qio_channel_file_new_path(
+                          TEST_FILE,
+                          O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, TEST_MASK,
+                          &error_abort));
+    g_assert(qio_channel_has_feature(src, QIO_CHANNEL_FEATURE_SEEKABLE));
+
+    /* Positional writes leave the file offset alone */
+    g_assert_cmpint(qio_channel_pwritev(src, iov, 2, 4096, &error_abort),
+                    ==, 0);
+    g_assert_cmpint(qio_channel_io_seek(src, 0, SEEK_CUR, &error_abort),
+                    ==, 0);
+
+    dst = QIO_CHANNEL(qio_channel_file_new_path(
+                          TEST_FILE,
+                          O_RDONLY | O_BINARY, 0,
+                          &error_abort));
+    g_assert_cmpint(qio_channel_preadv(dst, &riov, 1, 4096, &error_abort),
+                    ==, 0);
+    g_assert_cmpstr(buf, ==, "helloworld");
+
+    /* Reading past the end of the file is an error */
+    g_assert_cmpint(qio_channel_preadv(dst, &riov, 1, 8192, NULL), ==, -1);
+
+    unlink(TEST_FILE);
+    object_unref(OBJECT(src));
+    object_unref(OBJECT(dst));
+}
+
 
 #ifndef _WIN32
 static void test_io_channel_pipe(bool async)
@@ -147,6 +188,7 @@ int main(int argc, char **argv)
     g_test_add_func("/io/channel/file", test_io_channel_file);
     g_test_add_func("/io/channel/file/rdwr", test_io_channel_file_rdwr);
     g_test_add_func("/io/channel/file/fd", test_io_channel_fd);
+    g_test_add_func("/io/channel/file/pwritev", test_io_channel_file_pwritev);
 #ifndef _WIN32
     g_test_add_func("/io/channel/pipe/sync", test_io_channel_pipe_sync);
     g_test_add_func("/io/channel/pipe/async", test_io_channel_pipe_async);
@@ -0,0 +1,80 @@
+/*
+ * IOVA tree allocation unit-tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "exec/memory.h"
+#include "qemu/iova-tree.h"
+
+static void check_iova_tree_alloc(void)
+{
+    IOVATree *tree = iova_tree_new();
+    DMAMap a = { .translated_addr = 0x10000, .size = 0xfff, .perm = IOMMU_RW };
+    DMAMap b = { .translated_addr = 0x20000, .size = 0xfff, .perm = IOMMU_RO };
+    DMAMap c = { .translated_addr = 0x30000, .size = 0x1fff, .perm = IOMMU_RW };
+    DMAMap big = { .size = 0x10000, .perm = IOMMU_RW };
+
+    /* Allocations are lowest first within the allowed range */
+    g_assert_cmpint(iova_tree_alloc_map(tree, &a, 0x1000, 0xffff), ==,
+                    IOVA_OK);
+    g_assert_cmphex(a.iova, ==, 0x1000);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &b, 0x1000, 0xffff), ==,
+                    IOVA_OK);
+    g_assert_cmphex(b.iova, ==, 0x2000);
+
+    /* Holes left by removed mappings are reused */
+    iova_tree_remove(tree, &a);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &c, 0x1000, 0xffff), ==,
+                    IOVA_OK);
+    g_assert_cmphex(c.iova, ==, 0x3000);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &a, 0x1000, 0xffff), ==,
+                    IOVA_OK);
+    g_assert_cmphex(a.iova, ==, 0x1000);
+
+    /* Nothing fits above iova_last */
+    g_assert_cmpint(iova_tree_alloc_map(tree, &big, 0x1000, 0xffff), ==,
+                    IOVA_ERR_NOMEM);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &big, 0x1000, 0x1000), ==,
+                    IOVA_ERR_NOMEM);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &big, 0x2000, 0x1000), ==,
+                    IOVA_ERR_INVALID);
+
+    /* Reverse lookups use the translated addresses */
+    g_assert(iova_tree_find_iova(tree, &b)->iova == 0x2000);
+    g_assert(iova_tree_find_iova(tree, &(DMAMap) {
+        .translated_addr = 0x31000, .size = 0x10 })->iova == 0x3000);
+    g_assert_null(iova_tree_find_iova(tree, &(DMAMap) {
+        .translated_addr = 0x40000, .size = 0x10 }));
+
+    iova_tree_destroy(tree);
+}
+
+static void check_iova_tree_alloc_top(void)
+{
+    IOVATree *tree = iova_tree_new();
+    DMAMap top = { .size = 0xfff, .perm = IOMMU_RW };
+    DMAMap next = { .size = 0, .perm = IOMMU_RW };
+
+    g_assert_cmpint(iova_tree_alloc_map(tree, &top, HWADDR_MAX - 0xfff,
+                                        HWADDR_MAX), ==, IOVA_OK);
+    g_assert_cmphex(top.iova, ==, HWADDR_MAX - 0xfff);
+    g_assert_cmpint(iova_tree_alloc_map(tree, &next, HWADDR_MAX - 0xfff,
+                                        HWADDR_MAX), ==, IOVA_ERR_NOMEM);
+
+    iova_tree_destroy(tree);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/iova-tree/alloc", check_iova_tree_alloc);
+    g_test_add_func("/iova-tree/alloc-top", check_iova_tree_alloc_top);
+
+    g_test_run();
+
+    return 0;
+}
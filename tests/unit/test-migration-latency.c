@@ -0,0 +1,112 @@
+/*
+ * Migration latency histogram unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qapi/qapi-types-migration.h"
+#include "../migration/latency.h"
+
+static uint64_t test_bucket(MigrationLatencyHistogram *h, int n)
+{
+    uint64List *l = h->buckets;
+
+    while (n--) {
+        l = l->next;
+    }
+    return l->value;
+}
+
+static void test_disabled(void)
+{
+    MigrationLatencyStats *info;
+
+    migration_latency_reset(false);
+    migration_latency_record(MIGRATION_LATENCY_BITMAP_SYNC, 1000);
+    g_assert_cmpint(migration_latency_start(), ==, 0);
+    migration_latency_device_end("ram", 0, true, 0);
+
+    info = migration_latency_query();
+    g_assert_cmpuint(info->bitmap_sync->count, ==, 0);
+    g_assert(!info->stop_and_copy);
+    qapi_free_MigrationLatencyStats(info);
+}
+
+static void test_buckets(void)
+{
+    MigrationLatencyStats *info;
+    MigrationLatencyHistogram *h;
+    uint64List *l;
+    int n = 0;
+
+    migration_latency_reset(true);
+    migration_latency_record(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, 0);
+    migration_latency_record(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, 1);
+    migration_latency_record(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, 3);
+    migration_latency_record(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, 1024);
+    migration_latency_record(MIGRATION_LATENCY_FIND_DIRTY_BLOCK, UINT64_MAX);
+
+    info = migration_latency_query();
+    h = info->find_dirty_block;
+    for (l = h->buckets; l; l = l->next) {
+        n++;
+    }
+    g_assert_cmpint(n, ==, MIGRATION_LATENCY_BUCKETS);
+    g_assert_cmpuint(h->count, ==, 5);
+    g_assert_cmpuint(h->max, ==, UINT64_MAX);
+    g_assert_cmpuint(test_bucket(h, 0), ==, 1);
+    g_assert_cmpuint(test_bucket(h, 1), ==, 1);
+    g_assert_cmpuint(test_bucket(h, 2), ==, 1);
+    g_assert_cmpuint(test_bucket(h, 11), ==, 1);
+    g_assert_cmpuint(test_bucket(h, MIGRATION_LATENCY_BUCKETS - 1), ==, 1);
+    g_assert_cmpuint(info->bitmap_sync->count, ==, 0);
+    qapi_free_MigrationLatencyStats(info);
+
+    migration_latency_reset(true);
+    info = migration_latency_query();
+    g_assert_cmpuint(info->find_dirty_block->count, ==, 0);
+    g_assert_cmpuint(info->find_dirty_block->max, ==, 0);
+    qapi_free_MigrationLatencyStats(info);
+}
+
+static void test_devices(void)
+{
+    MigrationLatencyStats *info;
+    MigrationDeviceLatencyList *l;
+    int64_t start;
+
+    migration_latency_reset(true);
+    start = migration_latency_start();
+    g_assert_cmpint(start, !=, 0);
+    migration_latency_device_end("ram", 0, true, start);
+    migration_latency_device_end("timer", 1, false, start);
+
+    info = migration_latency_query();
+    l = info->stop_and_copy;
+    g_assert(l);
+    g_assert_cmpstr(l->value->idstr, ==, "ram");
+    g_assert(l->value->iterable);
+    l = l->next;
+    g_assert(l);
+    g_assert_cmpstr(l->value->idstr, ==, "timer");
+    g_assert_cmpuint(l->value->instance_id, ==, 1);
+    g_assert(!l->value->iterable);
+    g_assert(!l->next);
+    qapi_free_MigrationLatencyStats(info);
+
+    migration_latency_reset(false);
+    info = migration_latency_query();
+    g_assert(!info->stop_and_copy);
+    qapi_free_MigrationLatencyStats(info);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/migration/latency/disabled", test_disabled);
+    g_test_add_func("/migration/latency/buckets", test_buckets);
+    g_test_add_func("/migration/latency/devices", test_devices);
+
+    return g_test_run();
+}
@@ -0,0 +1,139 @@
+/*
+ * XBZRLE page cache unit tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/thread.h"
+#include "../migration/page_cache.h"
+
+#define TEST_PAGE_SIZE 4096
+#define TEST_CACHE_PAGES 64
+#define TEST_THREADS 4
+
+static PageCache *test_cache_new(void)
+{
+    return cache_init(TEST_CACHE_PAGES * TEST_PAGE_SIZE, TEST_PAGE_SIZE,
+                      &error_abort);
+}
+
+static void test_init_errors(void)
+{
+    Error *err = NULL;
+
+    g_assert(!cache_init(TEST_PAGE_SIZE - 1, TEST_PAGE_SIZE, &err));
+    error_free_or_abort(&err);
+    g_assert(!cache_init(3 * TEST_PAGE_SIZE, TEST_PAGE_SIZE, &err));
+    error_free_or_abort(&err);
+}
+
+static void test_insert_lookup(void)
+{
+    PageCache *cache = test_cache_new();
+    uint8_t page[TEST_PAGE_SIZE];
+    uint8_t *data;
+    bool hit;
+
+    memset(page, 0x42, sizeof(page));
+    g_assert_cmpint(cache_insert(cache, 5 * TEST_PAGE_SIZE, page, 1), ==, 0);
+
+    data = cache_lock_page(cache, 5 * TEST_PAGE_SIZE, 1, &hit);
+    g_assert(data);
+    g_assert(hit);
+    g_assert(memcmp(data, page, sizeof(page)) == 0);
+    cache_unlock_page(cache, data, true);
+
+    /* An entry that isn't filled keeps its page */
+    data = cache_lock_page(cache, 6 * TEST_PAGE_SIZE, 1, &hit);
+    g_assert(data);
+    g_assert(!hit);
+    cache_unlock_page(cache, data, false);
+
+    data = cache_lock_page(cache, 6 * TEST_PAGE_SIZE, 1, &hit);
+    g_assert(data);
+    g_assert(!hit);
+    cache_unlock_page(cache, data, false);
+
+    cache_fini(cache);
+}
+
+static void test_fresh_pages(void)
+{
+    PageCache *cache = cache_init(TEST_PAGE_SIZE, TEST_PAGE_SIZE,
+                                  &error_abort);
+    uint8_t page[TEST_PAGE_SIZE] = { 0 };
+
+    g_assert_cmpint(cache_insert(cache, 0, page, 1), ==, 0);
+    /* The only entry holds a fresh page, it can't be replaced yet */
+    g_assert_cmpint(cache_insert(cache, TEST_PAGE_SIZE, page, 2), ==, -1);
+    g_assert_cmpint(cache_insert(cache, TEST_PAGE_SIZE, page, 3), ==, 0);
+
+    cache_fini(cache);
+}
+
+typedef struct TestThread {
+    QemuThread thread;
+    PageCache *cache;
+    int id;
+} TestThread;
+
+/* Each thread keeps the pages of its own address range up to date */
+static void *test_thread_fn(void *opaque)
+{
+    TestThread *tt = opaque;
+    uint64_t age, i;
+
+    for (age = 0; age < 100; age++) {
+        for (i = 0; i < TEST_CACHE_PAGES; i++) {
+            uint64_t addr = (i * TEST_THREADS + tt->id) * TEST_PAGE_SIZE;
+            uint8_t *data;
+            bool hit;
+
+            data = cache_lock_page(tt->cache, addr, age, &hit);
+            if (!data) {
+                continue;
+            }
+            if (hit) {
+                g_assert_cmpint(data[0], ==, tt->id);
+                g_assert_cmpint(data[TEST_PAGE_SIZE - 1], ==, (uint8_t)i);
+            }
+            memset(data, tt->id, TEST_PAGE_SIZE - 1);
+            data[TEST_PAGE_SIZE - 1] = i;
+            cache_unlock_page(tt->cache, data, true);
+        }
+    }
+
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    PageCache *cache = test_cache_new();
+    TestThread threads[TEST_THREADS];
+    int i;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        threads[i].cache = cache;
+        threads[i].id = i;
+        qemu_thread_create(&threads[i].thread, "test-page-cache",
+                           test_thread_fn, &threads[i], QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        qemu_thread_join(&threads[i].thread);
+    }
+
+    cache_fini(cache);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/page-cache/init_errors", test_init_errors);
+    g_test_add_func("/page-cache/insert_lookup", test_insert_lookup);
+    g_test_add_func("/page-cache/fresh_pages", test_fresh_pages);
+    g_test_add_func("/page-cache/threads", test_threads);
+
+    return g_test_run();
+}
@@ -232,6 +232,37 @@ static void test_cancel_async(void)
     do_test_cancel(false);
 }
 
+static void test_steal(void)
+{
+    WorkerTestData data = { .n = 0 };
+    WorkerTestData stolen = { .n = 0, .ret = -EINPROGRESS };
+    AioContext *ctx2 = aio_context_new(&error_abort);
+    ThreadPool *pool2 = aio_get_thread_pool(ctx2);
+
+    /*
+     * pool2 only starts a worker once ctx2 is polled, so until then its
+     * request can only be run by a worker of the other pool.
+     */
+    thread_pool_submit_aio(pool2, worker_cb, &stolen, done_cb, &stolen);
+    thread_pool_submit(pool, worker_cb, &data);
+    while (data.n == 0) {
+        aio_poll(ctx, true);
+    }
+    while (qatomic_read(&stolen.n) == 0) {
+        g_usleep(1000);
+    }
+
+    active = 1;
+    while (stolen.ret == -EINPROGRESS) {
+        aio_poll(ctx2, true);
+    }
+    g_assert_cmpint(active, ==, 0);
+    g_assert_cmpint(stolen.n, ==, 1);
+    g_assert_cmpint(stolen.ret, ==, 0);
+
+    aio_context_unref(ctx2);
+}
+
 int main(int argc, char **argv)
 {
     qemu_init_main_loop(&error_abort);
@@ -245,6 +276,7 @@ int main(int argc, char **argv)
     g_test_add_func("/thread-pool/submit-many", test_submit_many);
     g_test_add_func("/thread-pool/cancel", test_cancel);
     g_test_add_func("/thread-pool/cancel-async", test_cancel_async);
+    g_test_add_func("/thread-pool/steal", test_steal);
 
     return g_test_run();
 }
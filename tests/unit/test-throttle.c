@@ -671,6 +671,44 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_account_units(void)
+{
+    ThrottleConfig cfg;
+
+    g_assert(double_cmp(throttle_op_units(0, 64 * 512), 1));
+    g_assert(double_cmp(throttle_op_units(13 * 512, 512), 1));
+    g_assert(double_cmp(throttle_op_units(13 * 512, 64 * 512), 64.0 / 13));
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_OPS_TOTAL].avg = 10;
+    cfg.buckets[THROTTLE_OPS_TOTAL].max = 10;
+    cfg.buckets[THROTTLE_BPS_WRITE].avg = 4096;
+    cfg.buckets[THROTTLE_BPS_WRITE].max = 8192;
+
+    throttle_init(&ts);
+    throttle_timers_init(tt, ctx, QEMU_CLOCK_VIRTUAL,
+                         read_timer_cb, write_timer_cb, &ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* prepay eight writes of 512 bytes */
+    throttle_account_units(&ts, true, 8, 8 * 512);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 8));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 4096));
+    g_assert(!throttle_would_wait(&ts, true));
+
+    /* three more ops exceed the limit of 10 */
+    throttle_account_units(&ts, true, 3, 0);
+    g_assert(throttle_would_wait(&ts, true));
+
+    /* taking credit back never makes a bucket negative */
+    throttle_account_units(&ts, true, -20, -8192);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_WRITE].level, 0));
+    g_assert(!throttle_would_wait(&ts, true));
+
+    throttle_timers_destroy(tt);
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -764,6 +802,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/account_units",      test_account_units);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -174,6 +174,57 @@ static void test_encode_decode(void)
     }
 }
 
+#define ACCEL_PAGES 64
+
+/* Every implementation must produce exactly the same encoding */
+static void test_encode_accel(void)
+{
+    uint8_t *old_buf = g_malloc(ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *ref = g_malloc(ACCEL_PAGES * XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int ref_len[ACCEL_PAGES];
+    int i, j, rc;
+
+    for (i = 0; i < ACCEL_PAGES * XBZRLE_PAGE_SIZE; i++) {
+        old_buf[i] = g_test_rand_int();
+        /* Page i has one byte out of 2 * (i + 1) changed on average */
+        j = i / XBZRLE_PAGE_SIZE;
+        if (g_test_rand_int_range(0, 2 * (j + 1))) {
+            new_buf[i] = old_buf[i];
+        } else {
+            new_buf[i] = g_test_rand_int();
+        }
+    }
+
+    for (i = 0; i < ACCEL_PAGES; i++) {
+        ref_len[i] = xbzrle_encode_buffer(old_buf + i * XBZRLE_PAGE_SIZE,
+                                          new_buf + i * XBZRLE_PAGE_SIZE,
+                                          XBZRLE_PAGE_SIZE,
+                                          ref + i * XBZRLE_PAGE_SIZE,
+                                          XBZRLE_PAGE_SIZE);
+    }
+
+    while (xbzrle_test_next_accel()) {
+        for (i = 0; i < ACCEL_PAGES; i++) {
+            rc = xbzrle_encode_buffer(old_buf + i * XBZRLE_PAGE_SIZE,
+                                      new_buf + i * XBZRLE_PAGE_SIZE,
+                                      XBZRLE_PAGE_SIZE, compressed,
+                                      XBZRLE_PAGE_SIZE);
+            g_assert_cmpint(rc, ==, ref_len[i]);
+            if (rc > 0) {
+                g_assert(memcmp(compressed, ref + i * XBZRLE_PAGE_SIZE,
+                                rc) == 0);
+            }
+        }
+    }
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(ref);
+    g_free(compressed);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +237,7 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
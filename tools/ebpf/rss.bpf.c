@@ -35,6 +35,9 @@
 
 #define INDIRECTION_TABLE_SIZE 128
 #define HASH_CALCULATION_BUFFER_SIZE 36
+/* Keep in sync with EBPF_RSS_FLOW_TABLE_SIZE and EBPF_RSS_MAX_QUEUES */
+#define FLOW_TABLE_SIZE 1024
+#define MAX_QUEUES 256
 
 struct rss_config_t {
     __u8 redirect;
@@ -57,6 +60,7 @@ struct packet_hash_info_t {
     __u8 is_ipv6_ext_src;
     __u8 is_ipv6_ext_dst;
     __u8 is_fragmented;
+    __u8 l4_protocol;
 
     __u16 src_port;
     __u16 dst_port;
@@ -100,6 +104,37 @@ tap_rss_map_indirection_table = {
         .max_entries = INDIRECTION_TABLE_SIZE,
 };
 
+/*
+ * Flows steered to a fixed queue by the host, ahead of the RSS hash.  Ports
+ * are only set for TCP and UDP; IPv4 addresses use the first 4 bytes.
+ */
+struct rss_flow_key_t {
+    __u8 src[16];
+    __u8 dst[16];
+    __be16 src_port;
+    __be16 dst_port;
+    __u8 protocol;
+    __u8 is_ipv6;
+    __u8 padding[2];
+} __attribute__((packed));
+
+struct bpf_map_def SEC("maps")
+tap_rss_map_flow_table = {
+        .type        = BPF_MAP_TYPE_HASH,
+        .key_size    = sizeof(struct rss_flow_key_t),
+        .value_size  = sizeof(__u16),
+        .max_entries = FLOW_TABLE_SIZE,
+};
+
+/* Packets steered to each queue, summed over all CPUs by the loader */
+struct bpf_map_def SEC("maps")
+tap_rss_map_queue_stats = {
+        .type        = BPF_MAP_TYPE_PERCPU_ARRAY,
+        .key_size    = sizeof(__u32),
+        .value_size  = sizeof(__u64),
+        .max_entries = MAX_QUEUES,
+};
+
 static inline void net_rx_rss_add_chunk(__u8 *rss_input, size_t *bytes_written,
                                         const void *ptr, size_t size) {
     __builtin_memcpy(&rss_input[*bytes_written], ptr, size);
@@ -346,6 +381,8 @@ static inline int parse_packet(struct __sk_buff *skb,
         }
     }
 
+    info->l4_protocol = l4_protocol;
+
     if (l4_protocol != 0 && !info->is_fragmented) {
         if (l4_protocol == IPPROTO_TCP) {
             info->is_tcp = 1;
@@ -380,146 +417,139 @@ error:
     return err;
 }
 
-static inline __u32 calculate_rss_hash(struct __sk_buff *skb,
+static inline __u32 calculate_rss_hash(struct packet_hash_info_t *info,
         struct rss_config_t *config, struct toeplitz_key_data_t *toe)
 {
     __u8 rss_input[HASH_CALCULATION_BUFFER_SIZE] = {};
     size_t bytes_written = 0;
     __u32 result = 0;
-    int err = 0;
-    struct packet_hash_info_t packet_info = {};
-
-    err = parse_packet(skb, &packet_info);
-    if (err) {
-        return 0;
-    }
 
-    if (packet_info.is_ipv4) {
-        if (packet_info.is_tcp &&
+    if (info->is_ipv4) {
+        if (info->is_tcp &&
             config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCPv4) {
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
-        } else if (packet_info.is_udp &&
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
+        } else if (info->is_udp &&
                    config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDPv4) {
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
         } else if (config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IPv4) {
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_src,
-                                 sizeof(packet_info.in_src));
+                                 &info->in_src,
+                                 sizeof(info->in_src));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.in_dst,
-                                 sizeof(packet_info.in_dst));
+                                 &info->in_dst,
+                                 sizeof(info->in_dst));
         }
-    } else if (packet_info.is_ipv6) {
-        if (packet_info.is_tcp &&
+    } else if (info->is_ipv6) {
+        if (info->is_tcp &&
             config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCPv6) {
 
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_TCP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
-        } else if (packet_info.is_udp &&
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
+        } else if (info->is_udp &&
                    config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDPv6) {
 
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_UDP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
 
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.src_port,
-                                 sizeof(packet_info.src_port));
+                                 &info->src_port,
+                                 sizeof(info->src_port));
             net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                 &packet_info.dst_port,
-                                 sizeof(packet_info.dst_port));
+                                 &info->dst_port,
+                                 sizeof(info->dst_port));
 
         } else if (config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IPv6) {
-            if (packet_info.is_ipv6_ext_src &&
+            if (info->is_ipv6_ext_src &&
                config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_src,
-                                     sizeof(packet_info.in6_ext_src));
+                                     &info->in6_ext_src,
+                                     sizeof(info->in6_ext_src));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_src,
-                                     sizeof(packet_info.in6_src));
+                                     &info->in6_src,
+                                     sizeof(info->in6_src));
             }
-            if (packet_info.is_ipv6_ext_dst &&
+            if (info->is_ipv6_ext_dst &&
                 config->hash_types & VIRTIO_NET_RSS_HASH_TYPE_IP_EX) {
 
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_ext_dst,
-                                     sizeof(packet_info.in6_ext_dst));
+                                     &info->in6_ext_dst,
+                                     sizeof(info->in6_ext_dst));
             } else {
                 net_rx_rss_add_chunk(rss_input, &bytes_written,
-                                     &packet_info.in6_dst,
-                                     sizeof(packet_info.in6_dst));
+                                     &info->in6_dst,
+                                     sizeof(info->in6_dst));
             }
         }
     }
@@ -531,12 +561,49 @@ static inline __u32 calculate_rss_hash(struct __sk_buff *skb,
     return result;
 }
 
+static inline __u16 *lookup_flow(struct packet_hash_info_t *info)
+{
+    struct rss_flow_key_t flow = {};
+
+    if (info->is_ipv4) {
+        __builtin_memcpy(flow.src, &info->in_src, sizeof(info->in_src));
+        __builtin_memcpy(flow.dst, &info->in_dst, sizeof(info->in_dst));
+    } else if (info->is_ipv6) {
+        __builtin_memcpy(flow.src, &info->in6_src, sizeof(info->in6_src));
+        __builtin_memcpy(flow.dst, &info->in6_dst, sizeof(info->in6_dst));
+        flow.is_ipv6 = 1;
+    } else {
+        return 0;
+    }
+
+    flow.protocol = info->l4_protocol;
+    if (info->is_tcp || info->is_udp) {
+        flow.src_port = info->src_port;
+        flow.dst_port = info->dst_port;
+    }
+
+    return bpf_map_lookup_elem(&tap_rss_map_flow_table, &flow);
+}
+
+static inline int count_queue(__u32 queue)
+{
+    __u64 *packets = bpf_map_lookup_elem(&tap_rss_map_queue_stats, &queue);
+
+    /* Per-CPU counter, no atomics needed */
+    if (packets) {
+        *packets += 1;
+    }
+
+    return queue;
+}
+
 SEC("tun_rss_steering")
 int tun_rss_steering_prog(struct __sk_buff *skb)
 {
 
     struct rss_config_t *config;
     struct toeplitz_key_data_t *toe;
+    struct packet_hash_info_t packet_info = {};
 
     __u32 key = 0;
     __u32 hash = 0;
@@ -546,23 +613,31 @@ int tun_rss_steering_prog(struct __sk_buff *skb)
 
     if (config && toe) {
         if (!config->redirect) {
-            return config->default_queue;
+            return count_queue(config->default_queue);
+        }
+
+        if (parse_packet(skb, &packet_info)) {
+            return count_queue(config->default_queue);
+        }
+
+        __u16 *queue = lookup_flow(&packet_info);
+        if (queue) {
+            return count_queue(*queue);
         }
 
-        hash = calculate_rss_hash(skb, config, toe);
+        hash = calculate_rss_hash(&packet_info, config, toe);
         if (hash) {
             __u32 table_idx = hash % config->indirections_len;
-            __u16 *queue = 0;
 
             queue = bpf_map_lookup_elem(&tap_rss_map_indirection_table,
                                         &table_idx);
 
             if (queue) {
-                return *queue;
+                return count_queue(*queue);
             }
         }
 
-        return config->default_queue;
+        return count_queue(config->default_queue);
     }
 
     return -1;
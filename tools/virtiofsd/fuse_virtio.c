@@ -29,13 +29,24 @@
 
 struct fv_VuDev;
 struct fv_QueueInfo {
-    pthread_t thread;
     /*
-     * This lock protects the VuVirtq preventing races between
-     * fv_queue_thread() and fv_queue_worker().
+     * Worker threads.  They take turns waiting for the next request on the
+     * queue, and each processes the requests it popped itself.
      */
+    pthread_t *threads;
+    unsigned int nthreads;
+
+    /* This lock protects the VuVirtq against races between the workers */
     pthread_mutex_t vq_lock;
 
+    /* Protects has_leader and quit */
+    pthread_mutex_t leader_lock;
+    pthread_cond_t leader_cond;
+    /* A worker is waiting for the next request */
+    bool has_leader;
+    /* The queue is stopping */
+    bool quit;
+
     struct fv_VuDev *virtio_dev;
 
     /* Our queue index, corresponds to array position */
@@ -442,12 +453,10 @@ int virtio_send_data_iov(struct fuse_session *se, struct fuse_chan *ch,
 
 static __thread bool clone_fs_called;
 
-/* Process one FVRequest in a thread pool */
-static void fv_queue_worker(gpointer data, gpointer user_data)
+/* Process one FVRequest in the worker thread that popped it */
+static void fv_queue_worker(struct fv_QueueInfo *qi, FVRequest *req)
 {
-    struct fv_QueueInfo *qi = user_data;
     struct fuse_session *se = qi->virtio_dev->se;
-    FVRequest *req = data;
     VuVirtqElement *elem = &req->elem;
     struct fuse_buf fbuf = {};
     bool allocated_bufv = false;
@@ -598,31 +607,30 @@ out:
     free(req);
 }
 
-/* Thread function for individual queues, created when a queue is 'started' */
-static void *fv_queue_thread(void *opaque)
+/*
+ * Pop the next request of the queue, waiting for a kick if there is none.
+ * Returns NULL when the queue must stop.
+ */
+static FVRequest *fv_queue_wait_request(struct fv_QueueInfo *qi)
 {
-    struct fv_QueueInfo *qi = opaque;
     struct VuDev *dev = &qi->virtio_dev->dev;
     struct VuVirtq *q = vu_get_queue(dev, qi->qidx);
-    struct fuse_session *se = qi->virtio_dev->se;
-    GThreadPool *pool = NULL;
-    GList *req_list = NULL;
-
-    if (se->thread_pool_size) {
-        fuse_log(FUSE_LOG_DEBUG, "%s: Creating thread pool for Queue %d\n",
-                 __func__, qi->qidx);
-        pool = g_thread_pool_new(fv_queue_worker, qi, se->thread_pool_size,
-                                 FALSE, NULL);
-        if (!pool) {
-            fuse_log(FUSE_LOG_ERR, "%s: g_thread_pool_new failed\n", __func__);
-            return NULL;
-        }
-    }
 
-    fuse_log(FUSE_LOG_INFO, "%s: Start for queue %d kick_fd %d\n", __func__,
-             qi->qidx, qi->kick_fd);
     while (1) {
         struct pollfd pf[2];
+        FVRequest *req;
+
+        /* Mutual exclusion with virtio_loop() */
+        vu_dispatch_rdlock(qi->virtio_dev);
+        pthread_mutex_lock(&qi->vq_lock);
+        req = vu_queue_pop(dev, q, sizeof(FVRequest));
+        pthread_mutex_unlock(&qi->vq_lock);
+        vu_dispatch_unlock(qi->virtio_dev);
+
+        if (req) {
+            req->reply_sent = false;
+            return req;
+        }
 
         pf[0].fd = qi->kick_fd;
         pf[0].events = POLLIN;
@@ -642,24 +650,24 @@ static void *fv_queue_thread(void *opaque)
                 continue;
             }
             fuse_log(FUSE_LOG_ERR, "fv_queue_thread ppoll: %m\n");
-            break;
+            return NULL;
         }
         assert(poll_res >= 1);
         if (pf[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
             fuse_log(FUSE_LOG_ERR, "%s: Unexpected poll revents %x Queue %d\n",
                      __func__, pf[0].revents, qi->qidx);
-            break;
+            return NULL;
         }
         if (pf[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
             fuse_log(FUSE_LOG_ERR,
                      "%s: Unexpected poll revents %x Queue %d killfd\n",
                      __func__, pf[1].revents, qi->qidx);
-            break;
+            return NULL;
         }
         if (pf[1].revents) {
             fuse_log(FUSE_LOG_INFO, "%s: kill event on queue %d - quitting\n",
                      __func__, qi->qidx);
-            break;
+            return NULL;
         }
         assert(pf[0].revents & POLLIN);
         fuse_log(FUSE_LOG_DEBUG, "%s: Got queue event on Queue %d\n", __func__,
@@ -668,48 +676,53 @@ static void *fv_queue_thread(void *opaque)
         eventfd_t evalue;
         if (eventfd_read(qi->kick_fd, &evalue)) {
             fuse_log(FUSE_LOG_ERR, "Eventfd_read for queue: %m\n");
-            break;
+            return NULL;
         }
-        /* Mutual exclusion with virtio_loop() */
-        vu_dispatch_rdlock(qi->virtio_dev);
-        pthread_mutex_lock(&qi->vq_lock);
-        /* out is from guest, in is too guest */
-        unsigned int in_bytes, out_bytes;
-        vu_queue_get_avail_bytes(dev, q, &in_bytes, &out_bytes, ~0, ~0);
-
-        fuse_log(FUSE_LOG_DEBUG,
-                 "%s: Queue %d gave evalue: %zx available: in: %u out: %u\n",
-                 __func__, qi->qidx, (size_t)evalue, in_bytes, out_bytes);
-
-        while (1) {
-            FVRequest *req = vu_queue_pop(dev, q, sizeof(FVRequest));
-            if (!req) {
-                break;
-            }
+    }
+}
 
-            req->reply_sent = false;
+/* Thread function for the workers of a queue, created when it is 'started' */
+static void *fv_queue_thread(void *opaque)
+{
+    struct fv_QueueInfo *qi = opaque;
 
-            if (!se->thread_pool_size) {
-                req_list = g_list_prepend(req_list, req);
-            } else {
-                g_thread_pool_push(pool, req, NULL);
-            }
+    fuse_log(FUSE_LOG_INFO, "%s: Start for queue %d kick_fd %d\n", __func__,
+             qi->qidx, qi->kick_fd);
+    while (1) {
+        FVRequest *req;
+
+        /*
+         * Only one worker at a time waits for a request.  Once it got one,
+         * it lets another worker wait for the next one and processes the
+         * request itself, so that requests never change threads.
+         */
+        pthread_mutex_lock(&qi->leader_lock);
+        while (qi->has_leader && !qi->quit) {
+            pthread_cond_wait(&qi->leader_cond, &qi->leader_lock);
         }
+        if (qi->quit) {
+            pthread_mutex_unlock(&qi->leader_lock);
+            break;
+        }
+        qi->has_leader = true;
+        pthread_mutex_unlock(&qi->leader_lock);
 
-        pthread_mutex_unlock(&qi->vq_lock);
-        vu_dispatch_unlock(qi->virtio_dev);
+        req = fv_queue_wait_request(qi);
 
-        /* Process all the requests. */
-        if (!se->thread_pool_size && req_list != NULL) {
-            req_list = g_list_reverse(req_list);
-            g_list_foreach(req_list, fv_queue_worker, qi);
-            g_list_free(req_list);
-            req_list = NULL;
+        pthread_mutex_lock(&qi->leader_lock);
+        qi->has_leader = false;
+        if (req) {
+            pthread_cond_signal(&qi->leader_cond);
+        } else {
+            qi->quit = true;
+            pthread_cond_broadcast(&qi->leader_cond);
         }
-    }
+        pthread_mutex_unlock(&qi->leader_lock);
 
-    if (pool) {
-        g_thread_pool_free(pool, FALSE, TRUE);
+        if (!req) {
+            break;
+        }
+        fv_queue_worker(qi, req);
     }
 
     return NULL;
@@ -719,20 +732,27 @@ static void fv_queue_cleanup_thread(struct fv_VuDev *vud, int qidx)
 {
     int ret;
     struct fv_QueueInfo *ourqi;
+    unsigned int i;
 
     assert(qidx < vud->nqueues);
     ourqi = vud->qi[qidx];
 
-    /* Kill the thread */
+    /* Kill the threads, the one waiting for a request wakes up the others */
     if (eventfd_write(ourqi->kill_fd, 1)) {
         fuse_log(FUSE_LOG_ERR, "Eventfd_write for queue %d: %s\n",
                  qidx, strerror(errno));
     }
-    ret = pthread_join(ourqi->thread, NULL);
-    if (ret) {
-        fuse_log(FUSE_LOG_ERR, "%s: Failed to join thread idx %d err %d\n",
-                 __func__, qidx, ret);
+    for (i = 0; i < ourqi->nthreads; i++) {
+        ret = pthread_join(ourqi->threads[i], NULL);
+        if (ret) {
+            fuse_log(FUSE_LOG_ERR, "%s: Failed to join thread idx %d err %d\n",
+                     __func__, qidx, ret);
+        }
     }
+    g_free(ourqi->threads);
+    ourqi->threads = NULL;
+    pthread_cond_destroy(&ourqi->leader_cond);
+    pthread_mutex_destroy(&ourqi->leader_lock);
     pthread_mutex_destroy(&ourqi->vq_lock);
     close(ourqi->kill_fd);
     ourqi->kick_fd = -1;
@@ -757,25 +777,12 @@ static void fv_queue_set_started(VuDev *dev, int qidx, bool started)
 {
     struct fv_VuDev *vud = container_of(dev, struct fv_VuDev, dev);
     struct fv_QueueInfo *ourqi;
+    unsigned int i;
 
     fuse_log(FUSE_LOG_INFO, "%s: qidx=%d started=%d\n", __func__, qidx,
              started);
     assert(qidx >= 0);
 
-    /*
-     * Ignore additional request queues for now.  passthrough_ll.c must be
-     * audited for thread-safety issues first.  It was written with a
-     * well-behaved client in mind and may not protect against all types of
-     * races yet.
-     */
-    if (qidx > 1) {
-        fuse_log(FUSE_LOG_ERR,
-                 "%s: multiple request queues not yet implemented, please only "
-                 "configure 1 request queue\n",
-                 __func__);
-        exit(EXIT_FAILURE);
-    }
-
     if (started) {
         /* Fire up a thread to watch this queue */
         if (qidx >= vud->nqueues) {
@@ -798,11 +805,22 @@ static void fv_queue_set_started(VuDev *dev, int qidx, bool started)
         ourqi->kill_fd = eventfd(0, EFD_CLOEXEC | EFD_SEMAPHORE);
         assert(ourqi->kill_fd != -1);
         pthread_mutex_init(&ourqi->vq_lock, NULL);
-
-        if (pthread_create(&ourqi->thread, NULL, fv_queue_thread, ourqi)) {
-            fuse_log(FUSE_LOG_ERR, "%s: Failed to create thread for queue %d\n",
-                     __func__, qidx);
-            assert(0);
+        pthread_mutex_init(&ourqi->leader_lock, NULL);
+        pthread_cond_init(&ourqi->leader_cond, NULL);
+        ourqi->has_leader = false;
+        ourqi->quit = false;
+
+        /* Without a thread pool, the requests are processed one by one */
+        ourqi->nthreads = MAX(vud->se->thread_pool_size, 1);
+        ourqi->threads = g_new(pthread_t, ourqi->nthreads);
+        for (i = 0; i < ourqi->nthreads; i++) {
+            if (pthread_create(&ourqi->threads[i], NULL, fv_queue_thread,
+                               ourqi)) {
+                fuse_log(FUSE_LOG_ERR,
+                         "%s: Failed to create thread for queue %d\n",
+                         __func__, qidx);
+                assert(0);
+            }
         }
     } else {
         /*
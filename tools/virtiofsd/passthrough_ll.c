@@ -108,7 +108,7 @@ struct lo_inode {
      * Note that this value is untrusted because the client can manipulate
      * it arbitrarily using FUSE_FORGET requests.
      *
-     * Protected by lo->mutex.
+     * Protected by the mutex of the inode's shard.
      */
     uint64_t nlookup;
 
@@ -142,6 +142,20 @@ typedef struct xattr_map_entry {
     unsigned int flags;
 } XattrMapEntry;
 
+/*
+ * The inode table is split in shards, each with its own lock, so that
+ * requests for different inodes do not serialize on lo->mutex.  A FUSE inode
+ * number encodes the shard in its low bits, and an inode lives in the shard
+ * that its key hashes to, so both kinds of lookups find the same shard.
+ */
+#define LO_INODE_SHARDS 16
+
+struct lo_inode_shard {
+    pthread_mutex_t mutex;
+    GHashTable *inodes; /* protected by mutex */
+    struct lo_map ino_map; /* protected by mutex */
+};
+
 struct lo_data {
     pthread_mutex_t mutex;
     int sandbox;
@@ -163,8 +177,7 @@ struct lo_data {
     int announce_submounts;
     bool use_statx;
     struct lo_inode root;
-    GHashTable *inodes; /* protected by lo->mutex */
-    struct lo_map ino_map; /* protected by lo->mutex */
+    struct lo_inode_shard inode_shards[LO_INODE_SHARDS];
     struct lo_map dirp_map; /* protected by lo->mutex */
     struct lo_map fd_map; /* protected by lo->mutex */
     XattrMapEntry *xattr_map_list;
@@ -536,18 +549,34 @@ static ssize_t lo_add_dirp_mapping(fuse_req_t req, struct lo_dirp *dirp)
     return elem - lo_data(req)->dirp_map.elems;
 }
 
-/* Assumes lo->mutex is held */
-static ssize_t lo_add_inode_mapping(fuse_req_t req, struct lo_inode *inode)
+static struct lo_inode_shard *lo_ino_shard(struct lo_data *lo,
+                                           fuse_ino_t ino)
+{
+    return &lo->inode_shards[ino % LO_INODE_SHARDS];
+}
+
+static struct lo_inode_shard *lo_key_shard(struct lo_data *lo,
+                                           const struct lo_key *key)
+{
+    return &lo->inode_shards[(key->ino + key->dev + key->mnt_id) %
+                             LO_INODE_SHARDS];
+}
+
+/* Assumes shard->mutex is held */
+static ssize_t lo_add_inode_mapping(struct lo_data *lo,
+                                    struct lo_inode_shard *shard,
+                                    struct lo_inode *inode)
 {
     struct lo_map_elem *elem;
 
-    elem = lo_map_alloc_elem(&lo_data(req)->ino_map);
+    elem = lo_map_alloc_elem(&shard->ino_map);
     if (!elem) {
         return -1;
     }
 
     elem->inode = inode;
-    return elem - lo_data(req)->ino_map.elems;
+    return (elem - shard->ino_map.elems) * LO_INODE_SHARDS +
+           (shard - lo->inode_shards);
 }
 
 static void lo_inode_put(struct lo_data *lo, struct lo_inode **inodep)
@@ -569,15 +598,15 @@ static void lo_inode_put(struct lo_data *lo, struct lo_inode **inodep)
 /* Caller must release refcount using lo_inode_put() */
 static struct lo_inode *lo_inode(fuse_req_t req, fuse_ino_t ino)
 {
-    struct lo_data *lo = lo_data(req);
+    struct lo_inode_shard *shard = lo_ino_shard(lo_data(req), ino);
     struct lo_map_elem *elem;
 
-    pthread_mutex_lock(&lo->mutex);
-    elem = lo_map_get(&lo->ino_map, ino);
+    pthread_mutex_lock(&shard->mutex);
+    elem = lo_map_get(&shard->ino_map, ino / LO_INODE_SHARDS);
     if (elem) {
         g_atomic_int_inc(&elem->inode->refcount);
     }
-    pthread_mutex_unlock(&lo->mutex);
+    pthread_mutex_unlock(&shard->mutex);
 
     if (!elem) {
         return NULL;
@@ -920,15 +949,16 @@ static struct lo_inode *lo_find(struct lo_data *lo, struct stat *st,
         .dev = st->st_dev,
         .mnt_id = mnt_id,
     };
+    struct lo_inode_shard *shard = lo_key_shard(lo, &key);
 
-    pthread_mutex_lock(&lo->mutex);
-    p = g_hash_table_lookup(lo->inodes, &key);
+    pthread_mutex_lock(&shard->mutex);
+    p = g_hash_table_lookup(shard->inodes, &key);
     if (p) {
         assert(p->nlookup > 0);
         p->nlookup++;
         g_atomic_int_inc(&p->refcount);
     }
-    pthread_mutex_unlock(&lo->mutex);
+    pthread_mutex_unlock(&shard->mutex);
 
     return p;
 }
@@ -1016,6 +1046,7 @@ static int lo_do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name,
     struct lo_data *lo = lo_data(req);
     struct lo_inode *inode = NULL;
     struct lo_inode *dir = lo_inode(req, parent);
+    struct lo_inode_shard *shard;
 
     if (inodep) {
         *inodep = NULL; /* in case there is an error */
@@ -1083,10 +1114,11 @@ static int lo_do_lookup(fuse_req_t req, fuse_ino_t parent, const char *name,
             inode->posix_locks = g_hash_table_new_full(
                 g_direct_hash, g_direct_equal, NULL, posix_locks_value_destroy);
         }
-        pthread_mutex_lock(&lo->mutex);
-        inode->fuse_ino = lo_add_inode_mapping(req, inode);
-        g_hash_table_insert(lo->inodes, &inode->key, inode);
-        pthread_mutex_unlock(&lo->mutex);
+        shard = lo_key_shard(lo, &inode->key);
+        pthread_mutex_lock(&shard->mutex);
+        inode->fuse_ino = lo_add_inode_mapping(lo, shard, inode);
+        g_hash_table_insert(shard->inodes, &inode->key, inode);
+        pthread_mutex_unlock(&shard->mutex);
     }
     e->ino = inode->fuse_ino;
 
@@ -1343,6 +1375,7 @@ static void lo_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t parent,
     struct lo_data *lo = lo_data(req);
     struct lo_inode *parent_inode;
     struct lo_inode *inode;
+    struct lo_inode_shard *shard;
     struct fuse_entry_param e;
     char procname[64];
     int saverr;
@@ -1380,9 +1413,10 @@ static void lo_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t parent,
         goto out_err;
     }
 
-    pthread_mutex_lock(&lo->mutex);
+    shard = lo_ino_shard(lo, inode->fuse_ino);
+    pthread_mutex_lock(&shard->mutex);
     inode->nlookup++;
-    pthread_mutex_unlock(&lo->mutex);
+    pthread_mutex_unlock(&shard->mutex);
     e.ino = inode->fuse_ino;
 
     fuse_log(FUSE_LOG_DEBUG, "  %lli/%s -> %lli\n", (unsigned long long)parent,
@@ -1544,9 +1578,11 @@ static void lo_unlink(fuse_req_t req, fuse_ino_t parent, const char *name)
     lo_inode_put(lo, &inode);
 }
 
-/* To be called with lo->mutex held */
+/* To be called with the mutex of the inode's shard held */
 static void unref_inode(struct lo_data *lo, struct lo_inode *inode, uint64_t n)
 {
+    struct lo_inode_shard *shard;
+
     if (!inode) {
         return;
     }
@@ -1554,8 +1590,9 @@ static void unref_inode(struct lo_data *lo, struct lo_inode *inode, uint64_t n)
     assert(inode->nlookup >= n);
     inode->nlookup -= n;
     if (!inode->nlookup) {
-        lo_map_remove(&lo->ino_map, inode->fuse_ino);
-        g_hash_table_remove(lo->inodes, &inode->key);
+        shard = lo_ino_shard(lo, inode->fuse_ino);
+        lo_map_remove(&shard->ino_map, inode->fuse_ino / LO_INODE_SHARDS);
+        g_hash_table_remove(shard->inodes, &inode->key);
         if (lo->posix_lock) {
             if (g_hash_table_size(inode->posix_locks)) {
                 fuse_log(FUSE_LOG_WARNING, "Hash table is not empty\n");
@@ -1571,13 +1608,16 @@ static void unref_inode(struct lo_data *lo, struct lo_inode *inode, uint64_t n)
 static void unref_inode_lolocked(struct lo_data *lo, struct lo_inode *inode,
                                  uint64_t n)
 {
+    struct lo_inode_shard *shard;
+
     if (!inode) {
         return;
     }
 
-    pthread_mutex_lock(&lo->mutex);
+    shard = lo_ino_shard(lo, inode->fuse_ino);
+    pthread_mutex_lock(&shard->mutex);
     unref_inode(lo, inode, n);
-    pthread_mutex_unlock(&lo->mutex);
+    pthread_mutex_unlock(&shard->mutex);
 }
 
 static void lo_forget_one(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup)
@@ -3335,21 +3375,26 @@ static void lo_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
 static void lo_destroy(void *userdata)
 {
     struct lo_data *lo = (struct lo_data *)userdata;
+    int i;
 
-    pthread_mutex_lock(&lo->mutex);
-    while (true) {
-        GHashTableIter iter;
-        gpointer key, value;
+    for (i = 0; i < LO_INODE_SHARDS; i++) {
+        struct lo_inode_shard *shard = &lo->inode_shards[i];
 
-        g_hash_table_iter_init(&iter, lo->inodes);
-        if (!g_hash_table_iter_next(&iter, &key, &value)) {
-            break;
-        }
+        pthread_mutex_lock(&shard->mutex);
+        while (true) {
+            GHashTableIter iter;
+            gpointer key, value;
 
-        struct lo_inode *inode = value;
-        unref_inode(lo, inode, inode->nlookup);
+            g_hash_table_iter_init(&iter, shard->inodes);
+            if (!g_hash_table_iter_next(&iter, &key, &value)) {
+                break;
+            }
+
+            struct lo_inode *inode = value;
+            unref_inode(lo, inode, inode->nlookup);
+        }
+        pthread_mutex_unlock(&shard->mutex);
     }
-    pthread_mutex_unlock(&lo->mutex);
 }
 
 static struct fuse_lowlevel_ops lo_oper = {
@@ -3869,8 +3914,13 @@ static gboolean lo_key_equal(gconstpointer a, gconstpointer b)
 
 static void fuse_lo_data_cleanup(struct lo_data *lo)
 {
-    if (lo->inodes) {
-        g_hash_table_destroy(lo->inodes);
+    int i;
+
+    for (i = 0; i < LO_INODE_SHARDS; i++) {
+        if (lo->inode_shards[i].inodes) {
+            g_hash_table_destroy(lo->inode_shards[i].inodes);
+        }
+        lo_map_destroy(&lo->inode_shards[i].ino_map);
     }
 
     if (lo->root.posix_locks) {
@@ -3878,7 +3928,6 @@ static void fuse_lo_data_cleanup(struct lo_data *lo)
     }
     lo_map_destroy(&lo->fd_map);
     lo_map_destroy(&lo->dirp_map);
-    lo_map_destroy(&lo->ino_map);
 
     if (lo->proc_self_fd >= 0) {
         close(lo->proc_self_fd);
@@ -3914,9 +3963,11 @@ int main(int argc, char *argv[])
         .user_killpriv_v2 = -1,
         .user_posix_acl = -1,
     };
+    struct lo_inode_shard *shard;
     struct lo_map_elem *root_elem;
     struct lo_map_elem *reserve_elem;
     int ret = -1;
+    int i;
 
     /* Initialize time conversion information for localtime_r(). */
     tzset();
@@ -3927,24 +3978,31 @@ int main(int argc, char *argv[])
     qemu_init_exec_dir(argv[0]);
 
     pthread_mutex_init(&lo.mutex, NULL);
-    lo.inodes = g_hash_table_new(lo_key_hash, lo_key_equal);
+    for (i = 0; i < LO_INODE_SHARDS; i++) {
+        pthread_mutex_init(&lo.inode_shards[i].mutex, NULL);
+        lo.inode_shards[i].inodes = g_hash_table_new(lo_key_hash,
+                                                     lo_key_equal);
+        lo_map_init(&lo.inode_shards[i].ino_map);
+    }
     lo.root.fd = -1;
     lo.root.fuse_ino = FUSE_ROOT_ID;
     lo.cache = CACHE_AUTO;
 
     /*
-     * Set up the ino map like this:
+     * Set up the ino maps like this:
      * [0] Reserved (will not be used)
      * [1] Root inode
      */
-    lo_map_init(&lo.ino_map);
-    reserve_elem = lo_map_reserve(&lo.ino_map, 0);
+    shard = lo_ino_shard(&lo, 0);
+    reserve_elem = lo_map_reserve(&shard->ino_map, 0);
     if (!reserve_elem) {
         fuse_log(FUSE_LOG_ERR, "failed to alloc reserve_elem.\n");
         goto err_out1;
     }
     reserve_elem->in_use = false;
-    root_elem = lo_map_reserve(&lo.ino_map, lo.root.fuse_ino);
+    shard = lo_ino_shard(&lo, lo.root.fuse_ino);
+    root_elem = lo_map_reserve(&shard->ino_map,
+                               lo.root.fuse_ino / LO_INODE_SHARDS);
     if (!root_elem) {
         fuse_log(FUSE_LOG_ERR, "failed to alloc root_elem.\n");
         goto err_out1;
@@ -56,6 +56,21 @@ static inline bool trace_event_get_state_dynamic(TraceEvent *ev)
     return unlikely(trace_events_enabled_count) && *ev->dstate;
 }
 
+static inline bool trace_event_sample(TraceEvent *ev)
+{
+    uint32_t sample = qatomic_read(&ev->sample);
+    unsigned long n;
+
+    if (likely(!sample)) {
+        return true;
+    }
+
+    /* Increments may be lost, but that is cheaper than an atomic op */
+    n = qatomic_read(&ev->count);
+    qatomic_set(&ev->count, n + 1);
+    return sample != TRACE_EVENT_COUNT_ONLY && n % sample == 0;
+}
+
 void trace_event_register_group(TraceEvent **events);
 
 #endif /* TRACE__CONTROL_INTERNAL_H */
@@ -104,6 +104,18 @@ TraceEvent *trace_event_name(const char *name)
     return NULL;
 }
 
+void trace_event_set_sampling(TraceEvent *ev, uint32_t sample)
+{
+    qatomic_set(&ev->sample, 0);
+    qatomic_set(&ev->count, 0);
+    qatomic_set(&ev->sample, sample);
+}
+
+unsigned long trace_event_get_count(TraceEvent *ev)
+{
+    return qatomic_read(&ev->count);
+}
+
 void trace_event_iter_init_all(TraceEventIter *iter)
 {
     iter->event = 0;
@@ -185,6 +185,36 @@ void trace_event_set_state_dynamic(TraceEvent *ev, bool state);
 void trace_event_set_vcpu_state_dynamic(CPUState *vcpu,
                                         TraceEvent *ev, bool state);
 
+/* Sampling rate of events whose occurrences are counted but never recorded */
+#define TRACE_EVENT_COUNT_ONLY UINT32_MAX
+
+/**
+ * trace_event_set_sampling:
+ * @ev: Event.
+ * @sample: Record one in @sample occurrences of the event, or none if
+ *          TRACE_EVENT_COUNT_ONLY.  0 records all of them without counting.
+ *
+ * Set the sampling rate of an event and reset its counter.  Sampling only
+ * applies while the event is enabled; the counter is cheap but not exact if
+ * the event fires in several threads at the same time.
+ */
+void trace_event_set_sampling(TraceEvent *ev, uint32_t sample);
+
+/**
+ * trace_event_get_count:
+ *
+ * Get the number of occurrences of an event since its sampling rate was set.
+ */
+unsigned long trace_event_get_count(TraceEvent *ev);
+
+/**
+ * trace_event_sample:
+ *
+ * Count an occurrence of an enabled event, and return whether it must be
+ * recorded.
+ */
+static bool trace_event_sample(TraceEvent *ev);
+
 
 
 /**
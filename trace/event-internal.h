@@ -37,6 +37,9 @@ typedef struct TraceEvent {
     const char * name;
     const bool sstate;
     uint16_t *dstate;
+    /* See trace_event_set_sampling() */
+    uint32_t sample;
+    unsigned long count;
 } TraceEvent;
 
 void trace_event_set_state_dynamic_init(TraceEvent *ev, bool state);
@@ -98,9 +98,20 @@ TraceEventInfoList *qmp_trace_event_get_state(const char *name,
             continue;
         }
 
-        value = g_new(TraceEventInfo, 1);
+        value = g_new0(TraceEventInfo, 1);
         value->vcpu = is_vcpu;
         value->name = g_strdup(trace_event_get_name(ev));
+        if (ev->sample) {
+            if (ev->sample == TRACE_EVENT_COUNT_ONLY) {
+                value->has_count_only = true;
+                value->count_only = true;
+            } else if (ev->sample > 1) {
+                value->has_sample = true;
+                value->sample = ev->sample;
+            }
+            value->has_count = true;
+            value->count = trace_event_get_count(ev);
+        }
 
         if (!trace_event_get_state_static(ev)) {
             value->state = TRACE_EVENT_STATE_UNAVAILABLE;
@@ -131,6 +142,8 @@ TraceEventInfoList *qmp_trace_event_get_state(const char *name,
 void qmp_trace_event_set_state(const char *name, bool enable,
                                bool has_ignore_unavailable, bool ignore_unavailable,
                                bool has_vcpu, int64_t vcpu,
+                               bool has_sample, uint32_t sample,
+                               bool has_count_only, bool count_only,
                                Error **errp)
 {
     Error *err = NULL;
@@ -146,6 +159,17 @@ void qmp_trace_event_set_state(const char *name, bool enable,
         return;
     }
 
+    if (has_sample && (sample == 0 || sample == TRACE_EVENT_COUNT_ONLY)) {
+        error_setg(errp, "Parameter 'sample' must be between 1 and %u",
+                   TRACE_EVENT_COUNT_ONLY - 1);
+        return;
+    }
+    if (has_sample && count_only) {
+        error_setg(errp, "Parameters 'sample' and 'count-only' are mutually "
+                   "exclusive");
+        return;
+    }
+
     /* Check events */
     if (!check_events(has_vcpu, has_ignore_unavailable && ignore_unavailable,
                       is_pattern, name, errp)) {
@@ -159,6 +183,12 @@ void qmp_trace_event_set_state(const char *name, bool enable,
             (has_vcpu && !trace_event_is_vcpu(ev))) {
             continue;
         }
+        if (has_sample) {
+            trace_event_set_sampling(ev, sample);
+        } else if (has_count_only) {
+            trace_event_set_sampling(ev, count_only ? TRACE_EVENT_COUNT_ONLY
+                                                    : 0);
+        }
         if (has_vcpu) {
             trace_event_set_vcpu_state_dynamic(cpu, ev, enable);
         } else {
@@ -30,12 +30,13 @@
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
-
 /*
- * Trace records are written out by a dedicated thread.  The thread waits for
- * records to become available, writes them out, and then waits again.
+ * Every thread that emits trace events gets its own ring buffer, so that
+ * recording an event does not touch any data shared with other threads.
+ * Each buffer has a single producer (its thread) and a single consumer (the
+ * writeout thread).  The writeout thread waits for records to become
+ * available, merges the records of all buffers by timestamp, writes them out,
+ * and then waits again.
  */
 static GMutex trace_lock;
 static GCond trace_available_cond;
@@ -45,14 +46,42 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_LEN = 4096 * 16,
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+/* Offsets are free-running, so they must wrap at a multiple of the size */
+QEMU_BUILD_BUG_ON(TRACE_BUF_LEN & (TRACE_BUF_LEN - 1));
+
+struct TraceThreadBuffer {
+    /* Protected by trace_lock */
+    TraceThreadBuffer *next;
+    bool exited;
+
+    /* Free-running offsets; written by the producer and consumer resp. */
+    unsigned int head;
+    unsigned int tail;
+
+    /* Written by the producer, the consumer keeps its own copy */
+    unsigned int dropped_events;
+    unsigned int dropped_written;
+
+    uint8_t data[TRACE_BUF_LEN];
+};
+
+static TraceThreadBuffer *trace_buffers;
+static __thread TraceThreadBuffer *trace_thread_buf;
+
+/*
+ * Set while this thread writes a record or holds trace_lock.  An event
+ * traced by a signal handler meanwhile would corrupt the record or deadlock,
+ * so it is dropped instead.
+ */
+static __thread volatile sig_atomic_t trace_thread_busy;
+
+static void trace_thread_exit(gpointer opaque);
+static GPrivate trace_thread_key = G_PRIVATE_INIT(trace_thread_exit);
+
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
@@ -76,53 +105,67 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static void read_from_buffer(TraceThreadBuffer *buf, unsigned int idx,
+                             void *dataptr, size_t size)
+{
+    size_t off = idx % TRACE_BUF_LEN;
+    size_t part = MIN(size, TRACE_BUF_LEN - off);
+
+    memcpy(dataptr, buf->data + off, part);
+    memcpy((uint8_t *)dataptr + part, buf->data, size - part);
+}
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static unsigned int write_to_buffer(TraceThreadBuffer *buf, unsigned int idx,
+                                    const void *dataptr, size_t size)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
-    }
+    size_t off = idx % TRACE_BUF_LEN;
+    size_t part = MIN(size, TRACE_BUF_LEN - off);
+
+    memcpy(buf->data + off, dataptr, part);
+    memcpy(buf->data, (const uint8_t *)dataptr + part, size - part);
+    return idx + size; /* most callers wants to know where to write next */
 }
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
+
+/*
+ * Called when a thread that has a trace buffer exits; the writeout thread
+ * frees the buffer once it has written out the remaining records.
  */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+static void trace_thread_exit(gpointer opaque)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    TraceThreadBuffer *buf = opaque;
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
+    trace_thread_busy = 1;
+    g_mutex_lock(&trace_lock);
+    buf->exited = true;
+    g_mutex_unlock(&trace_lock);
+
+    /* Events traced later in the thread's exit get a new buffer */
+    trace_thread_buf = NULL;
+    trace_thread_busy = 0;
+}
+
+static TraceThreadBuffer *trace_thread_buffer(void)
+{
+    TraceThreadBuffer *buf = trace_thread_buf;
+
+    if (likely(buf)) {
+        return buf;
     }
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
+    /* don't use g_malloc, can deadlock when traced */
+    buf = calloc(1, sizeof(*buf));
+    if (!buf) {
+        return NULL;
+    }
+
+    g_mutex_lock(&trace_lock);
+    buf->next = trace_buffers;
+    trace_buffers = buf;
+    g_mutex_unlock(&trace_lock);
+
+    g_private_set(&trace_thread_key, buf);
+    trace_thread_buf = buf;
+    return buf;
 }
 
 /**
@@ -132,6 +175,9 @@ static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
  */
 static void flush_trace_file(bool wait)
 {
+    sig_atomic_t busy = trace_thread_busy;
+
+    trace_thread_busy = 1;
     g_mutex_lock(&trace_lock);
     trace_available = true;
     g_cond_signal(&trace_available_cond);
@@ -141,6 +187,7 @@ static void flush_trace_file(bool wait)
     }
 
     g_mutex_unlock(&trace_lock);
+    trace_thread_busy = busy;
 }
 
 static void wait_for_trace_records_available(void)
@@ -154,43 +201,125 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+static void write_dropped_record(unsigned int count)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
-    size_t unused __attribute__ ((unused));
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    size_t unused G_GNUC_UNUSED;
+
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.arguments[0] = count;
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+}
 
-    for (;;) {
-        wait_for_trace_records_available();
+/* Writes out one record and frees its space in @buf */
+static void write_trace_record(TraceThreadBuffer *buf, uint32_t length)
+{
+    size_t unused G_GNUC_UNUSED;
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    size_t off = buf->tail % TRACE_BUF_LEN;
+    size_t part = MIN(length, TRACE_BUF_LEN - off);
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(buf->data + off, part, 1, trace_fp);
+    if (part < length) {
+        unused = fwrite(buf->data, length - part, 1, trace_fp);
+    }
+
+    /* Finish reading the record before the producer may overwrite it */
+    qatomic_store_release(&buf->tail, buf->tail + length);
+}
+
+/*
+ * Writes out the records that were committed to the thread buffers when
+ * the function was called, oldest first.  Records that are committed while
+ * the merge is running are left for the next call, since an older record
+ * could still be committed to another buffer.
+ */
+static void write_trace_records(void)
+{
+    TraceThreadBuffer **bufs, *buf, **prev;
+    unsigned int *heads;
+    size_t i, n = 0;
+
+    g_mutex_lock(&trace_lock);
+    for (buf = trace_buffers; buf; buf = buf->next) {
+        n++;
+    }
+    /* don't use g_malloc, can deadlock when traced */
+    bufs = malloc(n * sizeof(*bufs));
+    heads = malloc(n * sizeof(*heads));
+    if (n && (!bufs || !heads)) {
+        g_mutex_unlock(&trace_lock);
+        free(bufs);
+        free(heads);
+        return;
+    }
+    for (i = 0, buf = trace_buffers; buf; buf = buf->next, i++) {
+        bufs[i] = buf;
+        /* Pairs with the release in trace_record_finish() */
+        heads[i] = qatomic_load_acquire(&buf->head);
+    }
+    g_mutex_unlock(&trace_lock);
+
+    for (i = 0; i < n; i++) {
+        unsigned int dropped = qatomic_read(&bufs[i]->dropped_events);
+
+        if (dropped != bufs[i]->dropped_written) {
+            write_dropped_record(dropped - bufs[i]->dropped_written);
+            bufs[i]->dropped_written = dropped;
         }
+    }
+
+    for (;;) {
+        TraceRecord oldest = { 0 }, record;
+        size_t min = n;
+
+        for (i = 0; i < n; i++) {
+            if (bufs[i]->tail == heads[i]) {
+                continue;
+            }
+            read_from_buffer(bufs[i], bufs[i]->tail, &record, sizeof(record));
+            if (min == n || record.timestamp_ns < oldest.timestamp_ns) {
+                oldest = record;
+                min = i;
+            }
+        }
+        if (min == n) {
+            break;
+        }
+        write_trace_record(bufs[min], oldest.length);
+    }
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+    free(bufs);
+    free(heads);
+
+    /* Free the buffers of threads that have exited and have been drained */
+    g_mutex_lock(&trace_lock);
+    prev = &trace_buffers;
+    while ((buf = *prev) != NULL) {
+        if (buf->exited && buf->tail == qatomic_read(&buf->head)) {
+            *prev = buf->next;
+            free(buf);
+        } else {
+            prev = &buf->next;
         }
+    }
+    g_mutex_unlock(&trace_lock);
+}
 
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        wait_for_trace_records_available();
+        write_trace_records();
         fflush(trace_fp);
     }
     return NULL;
@@ -198,86 +327,74 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, &val,
+                                   sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, &slen,
+                                   sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
-    uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
+    TraceThreadBuffer *buf;
+    TraceRecord record = {
+        .event = event,
+        .timestamp_ns = get_clock(),
+        .length = sizeof(TraceRecord) + datasize,
+        .pid = trace_pid,
+    };
+    unsigned int head;
+
+    if (trace_thread_busy) {
+        /* Called from a signal handler that interrupted this thread */
+        buf = trace_thread_buf;
+        if (buf) {
+            qatomic_set(&buf->dropped_events, buf->dropped_events + 1);
         }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+        return -EBUSY;
+    }
+    trace_thread_busy = 1;
 
-    idx = old_idx % TRACE_BUF_LEN;
+    buf = trace_thread_buffer();
+    if (!buf) {
+        trace_thread_busy = 0;
+        return -ENOMEM;
+    }
 
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    head = buf->head;
+    /* Pairs with the release in write_trace_record() */
+    if (head + record.length - qatomic_load_acquire(&buf->tail) >
+        TRACE_BUF_LEN) {
+        /* Trace Buffer Full, Event dropped ! */
+        qatomic_set(&buf->dropped_events, buf->dropped_events + 1);
+        trace_thread_busy = 0;
+        return -ENOSPC;
+    }
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
+    rec->buf = buf;
+    rec->tbuf_idx = head;
+    rec->rec_off = write_to_buffer(buf, head, &record, sizeof(record));
     return 0;
 }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
+void trace_record_finish(TraceBufferRecord *rec)
 {
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
-}
+    TraceThreadBuffer *buf = rec->buf;
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
-    }
-    return idx; /* most callers wants to know where to write next */
-}
+    /* Publish the record to the writeout thread */
+    qatomic_store_release(&buf->head, rec->rec_off);
 
-void trace_record_finish(TraceBufferRecord *rec)
-{
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    if (rec->rec_off - qatomic_read(&buf->tail) > TRACE_BUF_FLUSH_THRESHOLD &&
+        rec->tbuf_idx - buf->tail <= TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
+    trace_thread_busy = 0;
 }
 
 static int st_write_event_mapping(TraceEventIter *iter)
@@ -17,6 +17,8 @@
 
 #include "qemu/osdep.h"
 #include "ui/qemu-spice.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
 #include "qemu/timer.h"
 #include "qemu/lockable.h"
 #include "qemu/main-loop.h"
@@ -189,7 +191,8 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
     static const int blksize = 32;
     int blocks = DIV_ROUND_UP(surface_width(ssd->ds), blksize);
     int dirty_top[blocks];
-    int y, yoff1, yoff2, x, xoff, blk, bw;
+    unsigned long changed[BITS_TO_LONGS(blocks)];
+    int y, yoff1, yoff2, x, xoff, blk, bw, n;
     int bpp = surface_bytes_per_pixel(ssd->ds);
     uint8_t *guest, *mirror;
 
@@ -203,16 +206,19 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
 
     guest = surface_data(ssd->ds);
     mirror = (void *)pixman_image_get_data(ssd->mirror);
+    xoff = ssd->dirty.left * bpp;
+    n = DIV_ROUND_UP(ssd->dirty.right - ssd->dirty.left, blksize);
     for (y = ssd->dirty.top; y < ssd->dirty.bottom; y++) {
         yoff1 = y * surface_stride(ssd->ds);
         yoff2 = y * pixman_image_get_stride(ssd->mirror);
+        bitmap_set(changed, 0, n);
+        buffer_diff_chunks(guest + yoff1 + xoff, mirror + yoff2 + xoff,
+                           (ssd->dirty.right - ssd->dirty.left) * bpp,
+                           blksize * bpp, changed);
         for (x = ssd->dirty.left; x < ssd->dirty.right; x += blksize) {
-            xoff = x * bpp;
             blk = x / blksize;
             bw = MIN(blksize, ssd->dirty.right - x);
-            if (memcmp(guest + yoff1 + xoff,
-                       mirror + yoff2 + xoff,
-                       bw * bpp) == 0) {
+            if (!test_bit((x - ssd->dirty.left) / blksize, changed)) {
                 if (dirty_top[blk] != -1) {
                     QXLRect update = {
                         .top    = dirty_top[blk],
@@ -45,18 +45,25 @@
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
- * to avoid screen corruption (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not held because the thread works on
- * its own output buffer.
+ * While a VNC worker thread is working, it holds the VncDisplay global lock
+ * in shared mode to avoid screen corruption (this does not block vnc_refresh()
+ * because it uses trylock()) but the output lock is not held because the
+ * thread works on its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Several worker threads encode the jobs of different clients in parallel.
+ * The jobs of a client are encoded one at a time and in order, because the
+ * encoders keep per-client state such as zlib streams.
  */
 
+/* Upper bound on the number of encoding threads */
+#define VNC_WORKER_THREADS_MAX 8
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    int nb_threads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
@@ -64,8 +71,7 @@ struct VncJobQueue {
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
+ * We use a single global queue, shared by all the encoding threads
  */
 static VncJobQueue *queue;
 
@@ -235,6 +241,31 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
     return false;
 }
 
+/*
+ * Return the oldest job that can be encoded now, i.e. whose client has no
+ * older job, running or not.
+ */
+static VncJob *vnc_queue_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job, *prev;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->running) {
+            continue;
+        }
+        for (prev = QTAILQ_FIRST(&queue->jobs); prev != job;
+             prev = QTAILQ_NEXT(prev, next)) {
+            if (prev->vs == job->vs) {
+                break;
+            }
+        }
+        if (prev == job) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
     VncJob *job;
@@ -244,17 +275,16 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!queue->exit && !(job = vnc_queue_next_job_locked(queue))) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
-    vnc_unlock_queue(queue);
-    assert(job->vs->magic == VNC_MAGIC);
-
     if (queue->exit) {
+        vnc_unlock_queue(queue);
         return -1;
     }
+    job->running = true;
+    vnc_unlock_queue(queue);
+    assert(job->vs->magic == VNC_MAGIC);
 
     vnc_lock_output(job->vs);
     if (job->vs->ioc == NULL || job->vs->abort == true) {
@@ -282,12 +312,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -304,7 +334,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         g_free(entry);
     }
     trace_vnc_job_nrects(&vs, job, n_rectangles);
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
@@ -355,11 +385,16 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+
+    vnc_lock_queue(queue);
+    last = --queue->nb_threads == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
     return NULL;
 }
 
@@ -371,12 +406,21 @@ static bool vnc_worker_thread_running(void)
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    long nb_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int i;
 
     if (vnc_worker_thread_running())
         return ;
 
+    nb_threads = MAX(MIN(nb_threads, VNC_WORKER_THREADS_MAX), 1);
+
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nb_threads = nb_threads;
+    for (i = 0; i < nb_threads; i++) {
+        QemuThread thread;
+
+        qemu_thread_create(&thread, "vnc_worker", vnc_worker_thread, q,
+                           QEMU_THREAD_DETACHED);
+    }
     queue = q; /* Set global queue */
 }
@@ -3094,6 +3094,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int height = MIN(pixman_image_get_height(vd->guest.fb),
                      pixman_image_get_height(vd->server));
     int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride, y = 0;
+    int dirty_width = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
     uint8_t *guest_row0 = NULL, *server_row0;
     VncState *vs;
     int has_dirty = 0;
@@ -3131,7 +3132,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
 
     for (;;) {
         int x;
-        uint8_t *guest_ptr, *server_ptr;
+        uint8_t *guest_row, *server_row;
         unsigned long offset = find_next_bit((unsigned long *) &vd->guest.dirty,
                                              height * VNC_DIRTY_BPL(&vd->guest),
                                              y * VNC_DIRTY_BPL(&vd->guest));
@@ -3142,30 +3143,31 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         y = offset / VNC_DIRTY_BPL(&vd->guest);
         x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_row = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
-            guest_ptr = (uint8_t *)pixman_image_get_data(tmpbuf);
+            guest_row = (uint8_t *)pixman_image_get_data(tmpbuf);
         } else {
-            guest_ptr = guest_row0 + y * guest_stride;
+            guest_row = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
+        /* Leave only the bits of the chunks that really changed */
+        buffer_diff_chunks(server_row, guest_row, line_bytes, cmp_bytes,
+                           vd->guest.dirty[y]);
+
+        for (x = find_next_bit(vd->guest.dirty[y], dirty_width, x);
+             x < dirty_width;
+             x = find_next_bit(vd->guest.dirty[y], dirty_width, x + 1)) {
             int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
+
+            clear_bit(x, vd->guest.dirty[y]);
             if ((x + 1) * cmp_bytes > line_bytes) {
                 _cmp_bytes = line_bytes - x * cmp_bytes;
             }
             assert(_cmp_bytes >= 0);
-            if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
-                continue;
-            }
-            memcpy(server_ptr, guest_ptr, _cmp_bytes);
+            memcpy(server_row + x * cmp_bytes, guest_row + x * cmp_bytes,
+                   _cmp_bytes);
             if (!vd->non_adaptive) {
                 vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
                                  y, &tv);
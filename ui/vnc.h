@@ -158,6 +158,8 @@ struct VncDisplay
     int ledstate;
     QKbdState *kbd;
     QemuMutex mutex;
+    /* worker threads reading the server surface, protected by mutex */
+    int encoders;
 
     QEMUCursor *cursor;
     int cursor_msize;
@@ -250,6 +252,8 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    /* a worker thread is encoding the job */
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
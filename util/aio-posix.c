@@ -149,6 +149,7 @@ void aio_set_fd_handler(AioContext *ctx,
             new_node->pfd.fd = fd;
         } else {
             new_node->pfd = node->pfd;
+            new_node->poll_ns = node->poll_ns;
         }
         g_source_add_poll(&ctx->source, &new_node->pfd);
 
@@ -481,6 +482,7 @@ static bool remove_idle_poll_handlers(AioContext *ctx,
         } else if (now >= node->poll_idle_timeout) {
             trace_poll_remove(ctx, node, node->pfd.fd);
             node->poll_idle_timeout = 0LL;
+            node->poll_ns = 0;
             QLIST_SAFE_REMOVE(node, node_poll);
             if (ctx->poll_started && node->io_poll_end) {
                 node->io_poll_end(node->opaque);
@@ -572,13 +574,19 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
 static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
                           int64_t *timeout)
 {
-    int64_t max_ns;
+    AioHandler *node;
+    int64_t max_ns = 0;
 
     if (QLIST_EMPTY_RCU(&ctx->poll_aio_handlers)) {
         return false;
     }
 
-    max_ns = qemu_soonest_timeout(*timeout, ctx->poll_ns);
+    /* Poll for as long as the handler that is worth polling the longest */
+    QLIST_FOREACH(node, &ctx->poll_aio_handlers, node_poll) {
+        max_ns = MAX(max_ns, node->poll_ns);
+    }
+    max_ns = MIN(max_ns, ctx->poll_max_ns);
+    max_ns = qemu_soonest_timeout(*timeout, max_ns);
     if (max_ns && !ctx->fdmon_ops->need_wait(ctx)) {
         poll_set_started(ctx, ready_list, true);
 
@@ -595,6 +603,70 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     return false;
 }
 
+static void shrink_polling_time(AioContext *ctx, AioHandler *node)
+{
+    int64_t old = node->poll_ns;
+
+    if (ctx->poll_shrink) {
+        node->poll_ns /= ctx->poll_shrink;
+    } else {
+        node->poll_ns = 0;
+    }
+
+    trace_poll_shrink(ctx, node, old, node->poll_ns);
+}
+
+static void grow_polling_time(AioContext *ctx, AioHandler *node)
+{
+    int64_t old = node->poll_ns;
+    int64_t grow = ctx->poll_grow;
+
+    if (grow == 0) {
+        grow = 2;
+    }
+
+    if (node->poll_ns) {
+        node->poll_ns *= grow;
+    } else {
+        node->poll_ns = 4000; /* start polling at 4 microseconds */
+    }
+
+    if (node->poll_ns > ctx->poll_max_ns) {
+        node->poll_ns = ctx->poll_max_ns;
+    }
+
+    trace_poll_grow(ctx, node, old, node->poll_ns);
+}
+
+/*
+ * Adjusts the polling time of @node after aio_poll() waited @block_ns for
+ * events.  Each handler is tuned on its own, based on whether its events
+ * arrive soon enough to be caught by polling: a handler that becomes ready
+ * within poll_max_ns polls longer next time, one whose polling time passed
+ * without an event polls less.  aio_poll() then only spins for the handlers
+ * that benefit from it.
+ */
+static void adjust_polling_time(AioContext *ctx, AioHandler *node,
+                                int64_t block_ns)
+{
+    if (!QLIST_IS_INSERTED(node, node_ready)) {
+        /* The whole polling time of @node passed without an event */
+        if (node->poll_ns && block_ns > node->poll_ns) {
+            shrink_polling_time(ctx, node);
+        }
+    } else if (block_ns <= node->poll_ns) {
+        /* This is the sweet spot, no adjustment needed */
+    } else if (block_ns > ctx->poll_max_ns) {
+        /* We'd have to poll for too long, poll less */
+        if (node->poll_ns) {
+            shrink_polling_time(ctx, node);
+        }
+    } else if (node->poll_ns < ctx->poll_max_ns) {
+        /* There is room to grow, poll longer */
+        grow_polling_time(ctx, node);
+    }
+}
+
 bool aio_poll(AioContext *ctx, bool blocking)
 {
     AioHandlerList ready_list = QLIST_HEAD_INITIALIZER(ready_list);
@@ -666,46 +738,16 @@ bool aio_poll(AioContext *ctx, bool blocking)
     /* Adjust polling time */
     if (ctx->poll_max_ns) {
         int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+        AioHandler *node;
 
-        if (block_ns <= ctx->poll_ns) {
-            /* This is the sweet spot, no adjustment needed */
-        } else if (block_ns > ctx->poll_max_ns) {
-            /* We'd have to poll for too long, poll less */
-            int64_t old = ctx->poll_ns;
-
-            if (ctx->poll_shrink) {
-                ctx->poll_ns /= ctx->poll_shrink;
-            } else {
-                ctx->poll_ns = 0;
-            }
-
-            trace_poll_shrink(ctx, old, ctx->poll_ns);
-        } else if (ctx->poll_ns < ctx->poll_max_ns &&
-                   block_ns < ctx->poll_max_ns) {
-            /* There is room to grow, poll longer */
-            int64_t old = ctx->poll_ns;
-            int64_t grow = ctx->poll_grow;
-
-            if (grow == 0) {
-                grow = 2;
-            }
-
-            if (ctx->poll_ns) {
-                ctx->poll_ns *= grow;
-            } else {
-                ctx->poll_ns = 4000; /* start polling at 4 microseconds */
-            }
-
-            if (ctx->poll_ns > ctx->poll_max_ns) {
-                ctx->poll_ns = ctx->poll_max_ns;
-            }
-
-            trace_poll_grow(ctx, old, ctx->poll_ns);
+        QLIST_FOREACH(node, &ctx->poll_aio_handlers, node_poll) {
+            adjust_polling_time(ctx, node, block_ns);
         }
     }
 
     progress |= aio_bh_poll(ctx);
     progress |= aio_dispatch_ready_handlers(ctx, &ready_list);
+    progress |= fdmon_io_uring_dispatch(ctx);
 
     aio_free_deleted_handlers(ctx);
 
@@ -755,7 +797,6 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
      * is used once.
      */
     ctx->poll_max_ns = max_ns;
-    ctx->poll_ns = 0;
     ctx->poll_grow = grow;
     ctx->poll_shrink = shrink;
 
@@ -34,9 +34,11 @@ struct AioHandler {
     QLIST_ENTRY(AioHandler) node_poll;
 #ifdef CONFIG_LINUX_IO_URING
     QSLIST_ENTRY(AioHandler) node_submitted;
+    QLIST_ENTRY(AioHandler) node_parked;
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
+    int64_t poll_ns;           /* how long to poll for this handler's events */
     bool is_external;
 };
 
@@ -68,6 +70,7 @@ static inline void fdmon_epoll_disable(AioContext *ctx)
 #ifdef CONFIG_LINUX_IO_URING
 bool fdmon_io_uring_setup(AioContext *ctx);
 void fdmon_io_uring_destroy(AioContext *ctx);
+bool fdmon_io_uring_dispatch(AioContext *ctx);
 #else
 static inline bool fdmon_io_uring_setup(AioContext *ctx)
 {
@@ -77,6 +80,11 @@ static inline bool fdmon_io_uring_setup(AioContext *ctx)
 static inline void fdmon_io_uring_destroy(AioContext *ctx)
 {
 }
+
+static inline bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    return false;
+}
 #endif /* !CONFIG_LINUX_IO_URING */
 
 #endif /* AIO_POSIX_H */
@@ -418,7 +418,9 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    /* Share the ring used for file descriptor monitoring if there is one */
+    ctx->linux_io_uring = luring_init(aio_has_io_uring(ctx) ?
+                                      LURING_SHARED_RING : 0, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -555,7 +557,6 @@ AioContext *aio_context_new(Error **errp)
     qemu_rec_mutex_init(&ctx->lock);
     timerlistgroup_init(&ctx->tlg, aio_timerlist_notify, ctx);
 
-    ctx->poll_ns = 0;
     ctx->poll_max_ns = 0;
     ctx->poll_grow = 0;
     ctx->poll_shrink = 0;
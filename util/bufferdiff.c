@@ -0,0 +1,247 @@
+/*
+ * Find the chunks that differ between two buffers
+ *
+ * Display front ends keep a copy of the guest framebuffer and compare it
+ * with the guest's, one tile row at a time, to find what changed.  The
+ * chunks are small (64 or 128 bytes) and most of them are equal, so an
+ * inlined vector compare without early exits beats memcmp() here.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/cutils.h"
+
+static bool
+buffer_equal_int(const void *a, const void *b, size_t len)
+{
+    return memcmp(a, b, len) == 0;
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <emmintrin.h>
+
+/* Requires len >= 16 */
+static bool
+buffer_equal_sse2(const void *a, const void *b, size_t len)
+{
+    __m128i t = _mm_set1_epi8(-1);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        t &= _mm_cmpeq_epi8(_mm_loadu_si128(a + i), _mm_loadu_si128(b + i));
+    }
+    if (i < len) {
+        t &= _mm_cmpeq_epi8(_mm_loadu_si128(a + len - 16),
+                            _mm_loadu_si128(b + len - 16));
+    }
+    return _mm_movemask_epi8(t) == 0xffff;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC pop_options
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+/* Requires len >= 32 */
+static bool
+buffer_equal_avx2(const void *a, const void *b, size_t len)
+{
+    __m256i t = _mm256_set1_epi8(-1);
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        t &= _mm256_cmpeq_epi8(_mm256_loadu_si256(a + i),
+                               _mm256_loadu_si256(b + i));
+    }
+    if (i < len) {
+        t &= _mm256_cmpeq_epi8(_mm256_loadu_si256(a + len - 32),
+                               _mm256_loadu_si256(b + len - 32));
+    }
+    return _mm256_movemask_epi8(t) == -1;
+}
+#pragma GCC pop_options
+
+#include "qemu/cpuinfo.h"
+#endif /* CONFIG_AVX2_OPT */
+
+/*
+ * Note that for test_buffer_diff_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX2    1
+#define CACHE_SSE2    2
+
+#ifdef CONFIG_AVX2_OPT
+# define INIT_CACHE 0
+# define INIT_ACCEL buffer_equal_int
+#else
+# define INIT_CACHE CACHE_SSE2
+# define INIT_ACCEL buffer_equal_sse2
+#endif
+
+static unsigned cpuid_cache = INIT_CACHE;
+static bool (*buffer_accel)(const void *, const void *, size_t) = INIT_ACCEL;
+static size_t length_to_accel = 16;
+static const char *accel_name = INIT_CACHE ? "sse2" : "int";
+
+static void init_accel(unsigned cache)
+{
+    bool (*fn)(const void *, const void *, size_t) = buffer_equal_int;
+    const char *name = "int";
+
+    if (cache & CACHE_SSE2) {
+        fn = buffer_equal_sse2;
+        name = "sse2";
+        length_to_accel = 16;
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = buffer_equal_avx2;
+        name = "avx2";
+        length_to_accel = 32;
+    }
+#endif
+    buffer_accel = fn;
+    accel_name = name;
+}
+
+#ifdef CONFIG_AVX2_OPT
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned info = cpuinfo_get();
+    unsigned cache = 0;
+
+    if (info & CPUINFO_SSE2) {
+        cache |= CACHE_SSE2;
+    }
+    if (info & CPUINFO_AVX2) {
+        cache |= CACHE_AVX2;
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+const char *buffer_diff_accel_name(void)
+{
+    return accel_name;
+}
+
+bool test_buffer_diff_next_accel(void)
+{
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+static bool buffer_equal(const void *a, const void *b, size_t len)
+{
+    if (likely(len >= length_to_accel)) {
+        return buffer_accel(a, b, len);
+    }
+    return buffer_equal_int(a, b, len);
+}
+
+#elif defined(__aarch64__)
+/* Advanced SIMD is always available on AArch64.  */
+#include <arm_neon.h>
+
+/* Requires len >= 16 */
+static bool
+buffer_equal_neon(const void *a, const void *b, size_t len)
+{
+    uint8x16_t t = vdupq_n_u8(0xff);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        t = vandq_u8(t, vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+    if (i < len) {
+        t = vandq_u8(t, vceqq_u8(vld1q_u8(a + len - 16),
+                                 vld1q_u8(b + len - 16)));
+    }
+    return vminvq_u8(t) == 0xff;
+}
+
+static bool use_neon = true;
+
+bool test_buffer_diff_next_accel(void)
+{
+    if (!use_neon) {
+        return false;
+    }
+    use_neon = false;
+    return true;
+}
+
+const char *buffer_diff_accel_name(void)
+{
+    return use_neon ? "neon" : "int";
+}
+
+static bool buffer_equal(const void *a, const void *b, size_t len)
+{
+    if (likely(len >= 16) && use_neon) {
+        return buffer_equal_neon(a, b, len);
+    }
+    return buffer_equal_int(a, b, len);
+}
+
+#else
+#define buffer_equal  buffer_equal_int
+bool test_buffer_diff_next_accel(void)
+{
+    return false;
+}
+
+const char *buffer_diff_accel_name(void)
+{
+    return "int";
+}
+#endif
+
+/*
+ * buffer_diff_chunks:
+ * @a: first buffer
+ * @b: second buffer
+ * @len: size of @a and @b
+ * @chunk: size of a chunk; the last chunk is shorter if @len is not a
+ *         multiple of it
+ * @bitmap: one bit per chunk
+ *
+ * Compares the chunks whose bit is set in @bitmap, and clears the bits of
+ * those that are equal in @a and @b.  Returns the number of bits that are
+ * still set.
+ */
+size_t buffer_diff_chunks(const void *a, const void *b, size_t len,
+                          size_t chunk, unsigned long *bitmap)
+{
+    size_t nbits = DIV_ROUND_UP(len, chunk);
+    size_t i, changed = 0;
+
+    for (i = find_next_bit(bitmap, nbits, 0); i < nbits;
+         i = find_next_bit(bitmap, nbits, i + 1)) {
+        size_t offset = i * chunk;
+
+        if (buffer_equal(a + offset, b + offset, MIN(chunk, len - offset))) {
+            clear_bit(i, bitmap);
+        } else {
+            changed++;
+        }
+    }
+    return changed;
+}
@@ -240,74 +240,71 @@ buffer_zero_avx512(const void *buf, size_t len)
 static unsigned cpuid_cache = INIT_CACHE;
 static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
 static int length_to_accel = 64;
+static const char *accel_name = INIT_CACHE ? "sse2" : "int";
 
 static void init_accel(unsigned cache)
 {
     bool (*fn)(const void *, size_t) = buffer_zero_int;
+    const char *name = "int";
+
     if (cache & CACHE_SSE2) {
         fn = buffer_zero_sse2;
+        name = "sse2";
         length_to_accel = 64;
     }
 #ifdef CONFIG_AVX2_OPT
     if (cache & CACHE_SSE4) {
         fn = buffer_zero_sse4;
+        name = "sse4";
         length_to_accel = 64;
     }
     if (cache & CACHE_AVX2) {
         fn = buffer_zero_avx2;
+        name = "avx2";
         length_to_accel = 128;
     }
 #endif
 #ifdef CONFIG_AVX512F_OPT
     if (cache & CACHE_AVX512F) {
         fn = buffer_zero_avx512;
+        name = "avx512f";
         length_to_accel = 256;
     }
 #endif
     buffer_accel = fn;
+    accel_name = name;
 }
 
 #if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT)
-#include "qemu/cpuid.h"
+#include "qemu/cpuinfo.h"
 
 static void __attribute__((constructor)) init_cpuid_cache(void)
 {
-    int max = __get_cpuid_max(0, NULL);
-    int a, b, c, d;
+    unsigned info = cpuinfo_get();
     unsigned cache = 0;
 
-    if (max >= 1) {
-        __cpuid(1, a, b, c, d);
-        if (d & bit_SSE2) {
-            cache |= CACHE_SSE2;
-        }
-        if (c & bit_SSE4_1) {
-            cache |= CACHE_SSE4;
-        }
-
-        /* We must check that AVX is not just available, but usable.  */
-        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
-            int bv;
-            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
-            __cpuid_count(7, 0, a, b, c, d);
-            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
-                cache |= CACHE_AVX2;
-            }
-            /* 0xe6:
-            *  XCR0[7:5] = 111b (OPMASK state, upper 256-bit of ZMM0-ZMM15
-            *                    and ZMM16-ZMM31 state are enabled by OS)
-            *  XCR0[2:1] = 11b (XMM state and YMM state are enabled by OS)
-            */
-            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512F)) {
-                cache |= CACHE_AVX512F;
-            }
-        }
+    if (info & CPUINFO_SSE2) {
+        cache |= CACHE_SSE2;
+    }
+    if (info & CPUINFO_SSE4_1) {
+        cache |= CACHE_SSE4;
+    }
+    if (info & CPUINFO_AVX2) {
+        cache |= CACHE_AVX2;
+    }
+    if (info & CPUINFO_AVX512F) {
+        cache |= CACHE_AVX512F;
     }
     cpuid_cache = cache;
     init_accel(cache);
 }
 #endif /* CONFIG_AVX2_OPT */
 
+const char *buffer_is_zero_accel_name(void)
+{
+    return accel_name;
+}
+
 bool test_buffer_is_zero_next_accel(void)
 {
     /* If no bits set, we just tested buffer_zero_int, and there
@@ -329,12 +326,77 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__)
+/* Advanced SIMD is always available on AArch64.  */
+#include <arm_neon.h>
+
+static inline bool neon_is_zero(uint64x2_t t)
+{
+    return vmaxvq_u32(vreinterpretq_u32_u64(t)) == 0;
+}
+
+/* Same structure as buffer_zero_sse2, requires len >= 64.  */
+static bool
+buffer_zero_neon(const void *buf, size_t len)
+{
+    uint64x2_t t = vld1q_u64(buf);
+    const uint64x2_t *p = (uint64x2_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint64x2_t *e = (uint64x2_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(!neon_is_zero(t))) {
+            return false;
+        }
+        t = vorrq_u64(vorrq_u64(p[-4], p[-3]), vorrq_u64(p[-2], p[-1]));
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t = vorrq_u64(t, vorrq_u64(e[-3], vorrq_u64(e[-2], e[-1])));
+
+    /* Finish the unaligned tail.  */
+    t = vorrq_u64(t, vld1q_u64(buf + len - 16));
+
+    return neon_is_zero(t);
+}
+
+static bool use_neon = true;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    if (!use_neon) {
+        return false;
+    }
+    use_neon = false;
+    return true;
+}
+
+const char *buffer_is_zero_accel_name(void)
+{
+    return use_neon ? "neon" : "int";
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= 64) && use_neon) {
+        return buffer_zero_neon(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
 {
     return false;
 }
+
+const char *buffer_is_zero_accel_name(void)
+{
+    return "int";
+}
 #endif
 
 /*
@@ -342,10 +404,21 @@ bool test_buffer_is_zero_next_accel(void)
  */
 bool buffer_is_zero(const void *buf, size_t len)
 {
+    const unsigned char *p = buf;
+
     if (unlikely(len == 0)) {
         return true;
     }
 
+    /*
+     * Pages and clusters that are not zero rarely have zeroes at both ends
+     * and in the middle, so checking three bytes rejects most of them
+     * without touching more than three cache lines.
+     */
+    if (p[0] | p[len / 2] | p[len - 1]) {
+        return false;
+    }
+
     /* Fetch the beginning of the buffer while we select the accelerator.  */
     __builtin_prefetch(buf);
 
@@ -0,0 +1,251 @@
+/*
+ * Coroutine-aware sampling profiler
+ *
+ * perf and gdb only see the coroutine trampoline and the event loop when an
+ * IOThread is busy, because coroutines run on their own stacks.  Instead,
+ * every thread that runs coroutines publishes the coroutine it is currently
+ * running, and a sampling thread periodically records the entry point,
+ * AioContext and tags (e.g. block node names) of these coroutines.
+ *
+ * Publishing only happens while a profile is being recorded; otherwise the
+ * cost is one load per coroutine switch.  Samples are only taken while a
+ * thread is inside a coroutine, so time spent in the event loop itself or
+ * in bottom halves does not show up.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/coroutine-prof.h"
+#include "qemu/coroutine_int.h"
+#include "qemu/lockable.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/xxhash.h"
+#include "block/aio.h"
+
+/* What a thread is running right now, as seen by the sampling thread */
+typedef struct CoroutineProfThread {
+    CoroutineEntry *entry;
+    AioContext *ctx;
+    const char *tag;
+    Notifier exit_notifier;
+    QLIST_ENTRY(CoroutineProfThread) next;
+} CoroutineProfThread;
+
+typedef struct CoroutineProfSample {
+    CoroutineEntry *entry;
+    AioContext *ctx;
+    const char *tag;
+    uint64_t count;
+} CoroutineProfSample;
+
+bool coroutine_prof_enabled;
+
+static __thread CoroutineProfThread *prof_thread;
+
+/* Protects everything below */
+static QemuMutex prof_lock;
+static QLIST_HEAD(, CoroutineProfThread) prof_threads =
+    QLIST_HEAD_INITIALIZER(prof_threads);
+static GHashTable *prof_samples;
+static QemuThread prof_sampler;
+static bool prof_sampler_running;
+static unsigned int prof_interval_us;
+
+static void __attribute__((__constructor__)) coroutine_prof_init(void)
+{
+    qemu_mutex_init(&prof_lock);
+}
+
+static guint coroutine_prof_sample_hash(gconstpointer p)
+{
+    const CoroutineProfSample *s = p;
+
+    return qemu_xxhash5((uintptr_t)s->entry, (uintptr_t)s->ctx,
+                        (uint32_t)(uintptr_t)s->tag);
+}
+
+static gboolean coroutine_prof_sample_equal(gconstpointer a, gconstpointer b)
+{
+    const CoroutineProfSample *x = a, *y = b;
+
+    return x->entry == y->entry && x->ctx == y->ctx && x->tag == y->tag;
+}
+
+static void coroutine_prof_thread_exit(Notifier *n, void *unused)
+{
+    CoroutineProfThread *t = container_of(n, CoroutineProfThread,
+                                          exit_notifier);
+
+    WITH_QEMU_LOCK_GUARD(&prof_lock) {
+        QLIST_REMOVE(t, next);
+    }
+    g_free(t);
+}
+
+static CoroutineProfThread *coroutine_prof_get_thread(void)
+{
+    CoroutineProfThread *t = prof_thread;
+
+    if (!t) {
+        t = g_new0(CoroutineProfThread, 1);
+        t->exit_notifier.notify = coroutine_prof_thread_exit;
+        qemu_thread_atexit_add(&t->exit_notifier);
+        WITH_QEMU_LOCK_GUARD(&prof_lock) {
+            QLIST_INSERT_HEAD(&prof_threads, t, next);
+        }
+        prof_thread = t;
+    }
+    return t;
+}
+
+/*
+ * Called from qemu_aio_coroutine_enter() whenever this thread starts or
+ * resumes running @co.  Out of line, like every function using prof_thread,
+ * so that the TLS address is not reused after the coroutine moved threads.
+ */
+void coroutine_prof_switch(Coroutine *co)
+{
+    CoroutineProfThread *t = coroutine_prof_get_thread();
+
+    qatomic_set(&t->ctx, co->ctx);
+    qatomic_set(&t->tag, co->prof_tag);
+    qatomic_set(&t->entry, co->entry);
+}
+
+const char *coroutine_prof_push_tag__slowpath(const char *tag)
+{
+    Coroutine *self = qemu_coroutine_self();
+    const char *old = self->prof_tag;
+    g_autofree char *tags = NULL;
+
+    if (old) {
+        tags = g_strconcat(old, ";", tag, NULL);
+        tag = tags;
+    }
+    self->prof_tag = g_intern_string(tag);
+    qatomic_set(&coroutine_prof_get_thread()->tag, self->prof_tag);
+    return old;
+}
+
+void coroutine_prof_pop_tag__slowpath(const char *old)
+{
+    Coroutine *self = qemu_coroutine_self();
+
+    self->prof_tag = old;
+    qatomic_set(&coroutine_prof_get_thread()->tag, old);
+}
+
+static void coroutine_prof_sample(void)
+{
+    CoroutineProfThread *t;
+    CoroutineProfSample key, *s;
+
+    QEMU_LOCK_GUARD(&prof_lock);
+    QLIST_FOREACH(t, &prof_threads, next) {
+        key.entry = qatomic_read(&t->entry);
+        if (!key.entry) {
+            continue;
+        }
+        key.ctx = qatomic_read(&t->ctx);
+        key.tag = qatomic_read(&t->tag);
+
+        s = g_hash_table_lookup(prof_samples, &key);
+        if (!s) {
+            s = g_memdup2(&key, sizeof(key));
+            s->count = 0;
+            g_hash_table_add(prof_samples, s);
+        }
+        s->count++;
+    }
+}
+
+static void *coroutine_prof_sampler(void *opaque)
+{
+    while (qatomic_read(&coroutine_prof_enabled)) {
+        g_usleep(prof_interval_us);
+        coroutine_prof_sample();
+    }
+    return NULL;
+}
+
+void coroutine_prof_start(unsigned int interval_us)
+{
+    CoroutineProfThread *t;
+
+    coroutine_prof_stop();
+
+    WITH_QEMU_LOCK_GUARD(&prof_lock) {
+        if (prof_samples) {
+            g_hash_table_destroy(prof_samples);
+        }
+        prof_samples = g_hash_table_new_full(coroutine_prof_sample_hash,
+                                             coroutine_prof_sample_equal,
+                                             g_free, NULL);
+
+        /* Threads publish again on their next switch */
+        QLIST_FOREACH(t, &prof_threads, next) {
+            qatomic_set(&t->entry, NULL);
+        }
+    }
+
+    prof_interval_us = MAX(interval_us, 1);
+    qatomic_set(&coroutine_prof_enabled, true);
+    qemu_thread_create(&prof_sampler, "coroutine-prof",
+                       coroutine_prof_sampler, NULL, QEMU_THREAD_JOINABLE);
+    prof_sampler_running = true;
+}
+
+void coroutine_prof_stop(void)
+{
+    if (!prof_sampler_running) {
+        return;
+    }
+
+    qatomic_set(&coroutine_prof_enabled, false);
+    qemu_thread_join(&prof_sampler);
+    prof_sampler_running = false;
+}
+
+static gint coroutine_prof_cmp_count(gconstpointer a, gconstpointer b)
+{
+    const CoroutineProfSample *x = *(CoroutineProfSample * const *)a;
+    const CoroutineProfSample *y = *(CoroutineProfSample * const *)b;
+
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return 0;
+}
+
+void coroutine_prof_dump(GString *buf, char *(*ctx_name)(AioContext *ctx))
+{
+    g_autoptr(GPtrArray) samples = g_ptr_array_new_with_free_func(g_free);
+    GHashTableIter iter;
+    gpointer s;
+    guint i;
+
+    WITH_QEMU_LOCK_GUARD(&prof_lock) {
+        if (prof_samples) {
+            g_hash_table_iter_init(&iter, prof_samples);
+            while (g_hash_table_iter_next(&iter, &s, NULL)) {
+                g_ptr_array_add(samples,
+                                g_memdup2(s, sizeof(CoroutineProfSample)));
+            }
+        }
+    }
+
+    g_ptr_array_sort(samples, coroutine_prof_cmp_count);
+    for (i = 0; i < samples->len; i++) {
+        const CoroutineProfSample *sample = g_ptr_array_index(samples, i);
+        g_autofree char *name = ctx_name(sample->ctx);
+
+        g_string_append_printf(buf, "%s;0x%" PRIxPTR "%s%s %" PRIu64 "\n",
+                               name, (uintptr_t)sample->entry,
+                               sample->tag ? ";" : "",
+                               sample->tag ? sample->tag : "",
+                               sample->count);
+    }
+}
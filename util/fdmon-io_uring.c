@@ -19,9 +19,12 @@
  * 4. Nanosecond timeouts are supported so it requires fewer syscalls than
  *    epoll(7).
  *
- * This code only monitors file descriptors and does not do asynchronous disk
- * I/O.  Implementing disk I/O efficiently has other requirements and should
- * use a separate io_uring so it does not make sense to unify the code.
+ * Other code running in the AioContext can submit its own requests on the
+ * same ring with aio_get_sqe(), so that a single io_uring_enter(2) call
+ * submits them together with the file descriptor monitoring operations and
+ * waits for all of them.  The per-AioContext io_uring of block/io_uring.c
+ * does this.  Such requests have the lowest bit of their user_data set, to
+ * tell them apart from AioHandlers.
  *
  * File descriptor monitoring is implemented using the following operations:
  *
@@ -37,10 +40,16 @@
  * io_uring calls the submission queue the "sq ring" and the completion queue
  * the "cq ring".  Ring entries are called "sqe" and "cqe", respectively.
  *
- * The code is structured so that sq/cq rings are only modified within
- * fdmon_io_uring_wait().  Changes to AioHandlers are made by enqueuing them on
+ * The code is structured so that the cq ring is only consumed within
+ * fdmon_io_uring_wait(), and sqes are only added from the AioContext's
+ * thread.  Changes to AioHandlers are made by enqueuing them on
  * ctx->submit_list so that fdmon_io_uring_wait() can submit IORING_OP_POLL_ADD
  * and/or IORING_OP_POLL_REMOVE sqes for them.
+ *
+ * While external clients are disabled, handlers of external clients whose
+ * IORING_OP_POLL_ADD completes are not re-armed but put on ctx->parked_list,
+ * and re-armed once external clients are enabled again.  This keeps the ring
+ * (and the requests submitted on it) running during drained sections.
  */
 
 #include "qemu/osdep.h"
@@ -55,6 +64,10 @@ enum {
     FDMON_IO_URING_PENDING  = (1 << 0),
     FDMON_IO_URING_ADD      = (1 << 1),
     FDMON_IO_URING_REMOVE   = (1 << 2),
+    FDMON_IO_URING_PARKED   = (1 << 3),
+
+    /* Set in the user_data of requests added with aio_get_sqe() */
+    FDMON_IO_URING_REQUEST  = 1,
 };
 
 static inline int poll_events_from_pfd(int pfd_events)
@@ -209,12 +222,36 @@ static void fill_sq_ring(AioContext *ctx)
         if (flags & FDMON_IO_URING_ADD) {
             add_poll_add_sqe(ctx, node);
         }
-        if (flags & FDMON_IO_URING_REMOVE) {
+        if ((flags & FDMON_IO_URING_REMOVE) &&
+            (flags & FDMON_IO_URING_PARKED)) {
+            /* No IORING_OP_POLL_ADD is pending, delete it right away */
+            QLIST_REMOVE(node, node_parked);
+            qatomic_and(&node->flags,
+                        ~(FDMON_IO_URING_REMOVE | FDMON_IO_URING_PARKED));
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
+        } else if (flags & FDMON_IO_URING_REMOVE) {
             add_poll_remove_sqe(ctx, node);
         }
     }
 }
 
+/* Re-arm the handlers that fired while external clients were disabled */
+static void rearm_parked_handlers(AioContext *ctx)
+{
+    AioHandler *node, *tmp;
+
+    if (qatomic_read(&ctx->external_disable_cnt)) {
+        return;
+    }
+
+    QLIST_FOREACH_SAFE(node, &ctx->parked_list, node_parked, tmp) {
+        QLIST_REMOVE(node, node_parked);
+        qatomic_and(&node->flags, ~FDMON_IO_URING_PARKED);
+        add_poll_add_sqe(ctx, node);
+    }
+}
+
 /* Returns true if a handler became ready */
 static bool process_cqe(AioContext *ctx,
                         AioHandlerList *ready_list,
@@ -228,6 +265,15 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    if ((uintptr_t)node & FDMON_IO_URING_REQUEST) {
+        AioUringRequest *req = (AioUringRequest *)
+            ((uintptr_t)node & ~(uintptr_t)FDMON_IO_URING_REQUEST);
+
+        req->res = cqe->res;
+        QSIMPLEQ_INSERT_TAIL(&ctx->completed_requests, req, next);
+        return true;
+    }
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
@@ -239,6 +285,12 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    if (!aio_node_check(ctx, node->is_external)) {
+        qatomic_or(&node->flags, FDMON_IO_URING_PARKED);
+        QLIST_INSERT_HEAD(&ctx->parked_list, node, node_parked);
+        return false;
+    }
+
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
     /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
@@ -272,11 +324,6 @@ static int fdmon_io_uring_wait(AioContext *ctx, AioHandlerList *ready_list,
     unsigned wait_nr = 1; /* block until at least one cqe is ready */
     int ret;
 
-    /* Fall back while external clients are disabled */
-    if (qatomic_read(&ctx->external_disable_cnt)) {
-        return fdmon_poll_ops.wait(ctx, ready_list, timeout);
-    }
-
     if (timeout == 0) {
         wait_nr = 0; /* non-blocking */
     } else if (timeout > 0) {
@@ -284,6 +331,7 @@ static int fdmon_io_uring_wait(AioContext *ctx, AioHandlerList *ready_list,
     }
 
     fill_sq_ring(ctx);
+    rearm_parked_handlers(ctx);
 
     do {
         ret = io_uring_submit_and_wait(&ctx->fdmon_io_uring, wait_nr);
@@ -311,8 +359,9 @@ static bool fdmon_io_uring_need_wait(AioContext *ctx)
         return true;
     }
 
-    /* Are we falling back to fdmon-poll? */
-    return qatomic_read(&ctx->external_disable_cnt);
+    /* Can parked handlers be re-armed? */
+    return !QLIST_EMPTY(&ctx->parked_list) &&
+           !qatomic_read(&ctx->external_disable_cnt);
 }
 
 static const FDMonOps fdmon_io_uring_ops = {
@@ -321,10 +370,46 @@ static const FDMonOps fdmon_io_uring_ops = {
     .need_wait = fdmon_io_uring_need_wait,
 };
 
+bool aio_has_io_uring(AioContext *ctx)
+{
+    return ctx->fdmon_ops == &fdmon_io_uring_ops;
+}
+
+struct io_uring_sqe *aio_get_sqe(AioContext *ctx)
+{
+    assert(aio_has_io_uring(ctx));
+    return io_uring_get_sqe(&ctx->fdmon_io_uring);
+}
+
+void aio_sqe_set_request(struct io_uring_sqe *sqe, AioUringRequest *req)
+{
+    io_uring_sqe_set_data(sqe, (void *)((uintptr_t)req |
+                                        FDMON_IO_URING_REQUEST));
+}
+
+/* Calls the completion callbacks of requests added with aio_get_sqe() */
+bool fdmon_io_uring_dispatch(AioContext *ctx)
+{
+    AioUringRequest *req;
+    bool progress = false;
+
+    /* Callbacks may run a nested aio_poll() that dispatches the rest */
+    while ((req = QSIMPLEQ_FIRST(&ctx->completed_requests))) {
+        QSIMPLEQ_REMOVE_HEAD(&ctx->completed_requests, next);
+        req->cb(req);
+        progress = true;
+    }
+
+    return progress;
+}
+
 bool fdmon_io_uring_setup(AioContext *ctx)
 {
     int ret;
 
+    QLIST_INIT(&ctx->parked_list);
+    QSIMPLEQ_INIT(&ctx->completed_requests);
+
     ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
     if (ret != 0) {
         return false;
@@ -338,10 +423,15 @@ bool fdmon_io_uring_setup(AioContext *ctx)
 void fdmon_io_uring_destroy(AioContext *ctx)
 {
     if (ctx->fdmon_ops == &fdmon_io_uring_ops) {
-        AioHandler *node;
+        AioHandler *node, *tmp;
 
         io_uring_queue_exit(&ctx->fdmon_io_uring);
 
+        QLIST_FOREACH_SAFE(node, &ctx->parked_list, node_parked, tmp) {
+            QLIST_REMOVE(node, node_parked);
+            qatomic_and(&node->flags, ~FDMON_IO_URING_PARKED);
+        }
+
         /* Move handlers due to be removed onto the deleted list */
         while ((node = QSLIST_FIRST_RCU(&ctx->submit_list))) {
             unsigned flags = qatomic_fetch_and(&node->flags,
@@ -50,8 +50,17 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * The last level is by far the largest, so it is split into pages that are
+ * only allocated while they contain set bits.  Memory usage therefore grows
+ * with the number of dirty areas rather than with the size of the bitmap,
+ * which matters for large disks with a fine granularity.  A page can be
+ * found to be empty by looking at the 2nd-last level.
  */
 
+/* Number of words in a page of the last level */
+#define HBITMAP_PAGE_WORDS  512
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -93,14 +102,83 @@ struct HBitmap {
      * actual bitmap.
      *
      * Note that all bitmaps have the same number of levels.  Even a 1-bit
-     * bitmap will still allocate HBITMAP_LEVELS arrays.
+     * bitmap will still allocate HBITMAP_LEVELS arrays.  The last level is
+     * not in levels[], but in pages[]; NULL pages are all zero.
      */
-    unsigned long *levels[HBITMAP_LEVELS];
+    unsigned long *levels[HBITMAP_LEVELS - 1];
+    unsigned long **pages;
+    uint64_t nb_pages;
 
-    /* The length of each levels[] array. */
+    /* The length of each level, in words. */
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+static inline unsigned long hb_get_word(const HBitmap *hb, int level,
+                                        uint64_t pos)
+{
+    const unsigned long *page;
+
+    if (level < HBITMAP_LEVELS - 1) {
+        return hb->levels[level][pos];
+    }
+
+    page = hb->pages[pos / HBITMAP_PAGE_WORDS];
+    return page ? page[pos % HBITMAP_PAGE_WORDS] : 0;
+}
+
+/* Returns NULL for a word in an unallocated page, unless @alloc is true */
+static unsigned long *hb_word(HBitmap *hb, int level, uint64_t pos,
+                              bool alloc)
+{
+    unsigned long **page;
+
+    if (level < HBITMAP_LEVELS - 1) {
+        return &hb->levels[level][pos];
+    }
+
+    page = &hb->pages[pos / HBITMAP_PAGE_WORDS];
+    if (!*page) {
+        if (!alloc) {
+            return NULL;
+        }
+        *page = g_new0(unsigned long, HBITMAP_PAGE_WORDS);
+    }
+    return &(*page)[pos % HBITMAP_PAGE_WORDS];
+}
+
+/* Stores @val in the last level, allocating a page only if needed */
+static void hb_store_word(HBitmap *hb, uint64_t pos, unsigned long val)
+{
+    unsigned long *elem = hb_word(hb, HBITMAP_LEVELS - 1, pos, val != 0);
+
+    if (elem) {
+        *elem = val;
+    }
+}
+
+/* Frees the pages covering words @first to @last that became all zero */
+static void hb_free_empty_pages(HBitmap *hb, uint64_t first, uint64_t last)
+{
+    const unsigned long *summary = hb->levels[HBITMAP_LEVELS - 2];
+    const uint64_t summary_words = HBITMAP_PAGE_WORDS / BITS_PER_LONG;
+    uint64_t p, i, end;
+
+    for (p = first / HBITMAP_PAGE_WORDS; p <= last / HBITMAP_PAGE_WORDS;
+         p++) {
+        if (!hb->pages[p]) {
+            continue;
+        }
+        end = MIN((p + 1) * summary_words, hb->sizes[HBITMAP_LEVELS - 2]);
+        for (i = p * summary_words; i < end && !summary[i]; i++) {
+            /* Look for a nonzero word */
+        }
+        if (i == end) {
+            g_free(hb->pages[p]);
+            hb->pages[p] = NULL;
+        }
+    }
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -136,7 +214,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
         hbi->cur[i] = cur & (cur - 1);
 
         /* Set up next level for iteration.  */
-        cur = hb->levels[i + 1][pos];
+        cur = hb_get_word(hb, i + 1, pos);
     }
 
     hbi->pos = pos;
@@ -149,7 +227,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
 int64_t hbitmap_iter_next(HBitmapIter *hbi)
 {
     unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1] &
-            hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
+            hb_get_word(hbi->hb, HBITMAP_LEVELS - 1, hbi->pos);
     int64_t item;
 
     if (cur == 0) {
@@ -182,7 +260,7 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
         pos >>= BITS_PER_LEVEL;
 
         /* Drop bits representing items before first.  */
-        hbi->cur[i] = hb->levels[i][pos] & ~((1UL << bit) - 1);
+        hbi->cur[i] = hb_get_word(hb, i, pos) & ~((1UL << bit) - 1);
 
         /* We have already added level i+1, so the lowest set bit has
          * been processed.  Clear it.
@@ -217,11 +295,41 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
     return MAX(start, first_dirty_off);
 }
 
+/*
+ * Returns the index of the first word in [@pos, @end) of the last level that
+ * has a zero bit, or @end if there is none.  Unallocated pages are all zero;
+ * allocated ones are scanned directly, four words at a time.
+ */
+static uint64_t hb_find_not_full(const HBitmap *hb, uint64_t pos, uint64_t end)
+{
+    while (pos < end) {
+        const unsigned long *page = hb->pages[pos / HBITMAP_PAGE_WORDS];
+        uint64_t page_end = MIN(end, ROUND_DOWN(pos, HBITMAP_PAGE_WORDS) +
+                                     HBITMAP_PAGE_WORDS);
+        const unsigned long *w;
+
+        if (!page) {
+            return pos;
+        }
+        for (; pos + 4 <= page_end; pos += 4) {
+            w = &page[pos % HBITMAP_PAGE_WORDS];
+            if ((w[0] & w[1] & w[2] & w[3]) != ~0UL) {
+                break;
+            }
+        }
+        for (; pos < page_end; pos++) {
+            if (page[pos % HBITMAP_PAGE_WORDS] != ~0UL) {
+                return pos;
+            }
+        }
+    }
+    return end;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
-    unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
-    unsigned long cur = last_lev[pos];
+    unsigned long cur;
     unsigned start_bit_offset;
     uint64_t end_bit, sz;
     int64_t res;
@@ -236,6 +344,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
                 hb->size :
                 ((start + count - 1) >> hb->granularity) + 1;
     sz = (end_bit + BITS_PER_LONG - 1) >> BITS_PER_LEVEL;
+    cur = hb_get_word(hb, HBITMAP_LEVELS - 1, pos);
 
     /* There may be some zero bits in @cur before @start. We are not interested
      * in them, let's set them.
@@ -245,15 +354,12 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_find_not_full(hb, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
 
-        cur = last_lev[pos];
+        cur = hb_get_word(hb, HBITMAP_LEVELS - 1, pos);
     }
 
     res = (pos << BITS_PER_LEVEL) + ctol(cur);
@@ -401,23 +507,26 @@ static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
     size_t pos = start >> BITS_PER_LEVEL;
     size_t lastpos = last >> BITS_PER_LEVEL;
     bool changed = false;
-    size_t i;
+    unsigned long *elem;
+    size_t i, j, n;
 
     i = pos;
     if (i < lastpos) {
-        uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
-        changed |= hb_set_elem(&hb->levels[level][i], start, next - 1);
-        for (;;) {
-            start = next;
-            next += BITS_PER_LONG;
-            if (++i == lastpos) {
-                break;
+        changed |= hb_set_elem(hb_word(hb, level, i, true), start,
+                               start | (BITS_PER_LONG - 1));
+
+        /* Fill the full words in between one page at a time */
+        for (i++; i < lastpos; i += n) {
+            n = MIN(lastpos - i, HBITMAP_PAGE_WORDS - i % HBITMAP_PAGE_WORDS);
+            elem = hb_word(hb, level, i, true);
+            for (j = 0; j < n; j++) {
+                changed |= (elem[j] == 0);
             }
-            changed |= (hb->levels[level][i] == 0);
-            hb->levels[level][i] = ~0UL;
+            memset(elem, 0xff, n * sizeof(*elem));
         }
+        start = (uint64_t)lastpos << BITS_PER_LEVEL;
     }
-    changed |= hb_set_elem(&hb->levels[level][i], start, last);
+    changed |= hb_set_elem(hb_word(hb, level, i, true), start, last);
 
     /* If there was any change in this layer, we may have to update
      * the one above.
@@ -464,6 +573,11 @@ static inline bool hb_reset_elem(unsigned long *elem, uint64_t start, uint64_t l
     assert((last >> BITS_PER_LEVEL) == (start >> BITS_PER_LEVEL));
     assert(start <= last);
 
+    /* Unallocated pages are already zero */
+    if (!elem) {
+        return false;
+    }
+
     mask = 2UL << (last & (BITS_PER_LONG - 1));
     mask -= 1UL << (start & (BITS_PER_LONG - 1));
     blanked = *elem != 0 && ((*elem & ~mask) == 0);
@@ -479,6 +593,7 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
     size_t pos = start >> BITS_PER_LEVEL;
     size_t lastpos = last >> BITS_PER_LEVEL;
     bool changed = false;
+    unsigned long *elem;
     size_t i;
 
     i = pos;
@@ -490,7 +605,7 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
          * unless the lower-level word became entirely zero.  So, remove pos
          * from the upper-level range if bits remain set.
          */
-        if (hb_reset_elem(&hb->levels[level][i], start, next - 1)) {
+        if (hb_reset_elem(hb_word(hb, level, i, false), start, next - 1)) {
             changed = true;
         } else {
             pos++;
@@ -502,13 +617,16 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
+            elem = hb_word(hb, level, i, false);
+            if (elem) {
+                changed |= (*elem != 0);
+                *elem = 0UL;
+            }
         }
     }
 
     /* Same as above, this time for lastpos.  */
-    if (hb_reset_elem(&hb->levels[level][i], start, last)) {
+    if (hb_reset_elem(hb_word(hb, level, i, false), start, last)) {
         changed = true;
     } else {
         lastpos--;
@@ -544,18 +662,27 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
 
     hb->count -= hb_count_between(hb, first, last);
-    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
-        hbitmap_set(hb->meta, start, count);
+    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last)) {
+        hb_free_empty_pages(hb, first >> BITS_PER_LEVEL,
+                            last >> BITS_PER_LEVEL);
+        if (hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
     }
 }
 
 void hbitmap_reset_all(HBitmap *hb)
 {
     unsigned int i;
+    uint64_t p;
+
+    for (p = 0; p < hb->nb_pages; p++) {
+        g_free(hb->pages[p]);
+        hb->pages[p] = NULL;
+    }
 
     /* Same as hbitmap_alloc() except for memset() instead of malloc() */
-    for (i = HBITMAP_LEVELS; --i >= 1; ) {
+    for (i = HBITMAP_LEVELS - 1; --i >= 1; ) {
         memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
     }
 
@@ -588,7 +715,8 @@ bool hbitmap_get(const HBitmap *hb, uint64_t item)
     unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
     assert(pos < hb->size);
 
-    return (hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] & bit) != 0;
+    return (hb_get_word(hb, HBITMAP_LEVELS - 1, pos >> BITS_PER_LEVEL) &
+            bit) != 0;
 }
 
 uint64_t hbitmap_serialization_align(const HBitmap *hb)
@@ -605,7 +733,7 @@ uint64_t hbitmap_serialization_align(const HBitmap *hb)
  */
 static void serialization_chunk(const HBitmap *hb,
                                 uint64_t start, uint64_t count,
-                                unsigned long **first_el, uint64_t *el_count)
+                                uint64_t *first_el, uint64_t *el_count)
 {
     uint64_t last = start + count - 1;
     uint64_t gran = hbitmap_serialization_align(hb);
@@ -619,7 +747,7 @@ static void serialization_chunk(const HBitmap *hb,
     start = (start >> hb->granularity) >> BITS_PER_LEVEL;
     last = (last >> hb->granularity) >> BITS_PER_LEVEL;
 
-    *first_el = &hb->levels[HBITMAP_LEVELS - 1][start];
+    *first_el = start;
     *el_count = last - start + 1;
 }
 
@@ -627,7 +755,7 @@ uint64_t hbitmap_serialization_size(const HBitmap *hb,
                                     uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur;
+    uint64_t cur;
 
     if (!count) {
         return 0;
@@ -641,7 +769,7 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
 
     if (!count) {
         return;
@@ -650,9 +778,9 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        unsigned long el =
-            (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
+        unsigned long el = hb_get_word(hb, HBITMAP_LEVELS - 1, cur);
 
+        el = (BITS_PER_LONG == 32 ? cpu_to_le32(el) : cpu_to_le64(el));
         memcpy(buf, &el, sizeof(el));
         buf += sizeof(el);
         cur++;
@@ -664,7 +792,8 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    uint64_t cur, end;
+    unsigned long el;
 
     if (!count) {
         return;
@@ -673,13 +802,9 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     end = cur + el_count;
 
     while (cur != end) {
-        memcpy(cur, buf, sizeof(*cur));
-
-        if (BITS_PER_LONG == 32) {
-            le32_to_cpus((uint32_t *)cur);
-        } else {
-            le64_to_cpus((uint64_t *)cur);
-        }
+        memcpy(&el, buf, sizeof(el));
+        el = (BITS_PER_LONG == 32 ? le32_to_cpu(el) : le64_to_cpu(el));
+        hb_store_word(hb, cur, el);
 
         buf += sizeof(unsigned long);
         cur++;
@@ -693,14 +818,16 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first, i;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    for (i = first; i < first + el_count; i++) {
+        hb_store_word(hb, i, 0);
+    }
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -710,14 +837,16 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *first;
+    uint64_t first, i;
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &first, &el_count);
 
-    memset(first, 0xff, el_count * sizeof(unsigned long));
+    for (i = first; i < first + el_count; i++) {
+        hb_store_word(hb, i, ~0UL);
+    }
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -726,12 +855,40 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
 void hbitmap_deserialize_finish(HBitmap *bitmap)
 {
     int64_t i, size, prev_size;
+    uint64_t p, j;
+    unsigned long *summary = bitmap->levels[HBITMAP_LEVELS - 2];
     int lev;
 
-    /* restore levels starting from penultimate to zero level, assuming
-     * that the last level is ok */
-    size = MAX((bitmap->size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
-    for (lev = HBITMAP_LEVELS - 1; lev-- > 0; ) {
+    /*
+     * Restore levels starting from penultimate to zero level, assuming
+     * that the last level is ok; drop pages that were deserialized as
+     * all zero
+     */
+    memset(summary, 0,
+           bitmap->sizes[HBITMAP_LEVELS - 2] * sizeof(unsigned long));
+    for (p = 0; p < bitmap->nb_pages; p++) {
+        unsigned long *page = bitmap->pages[p];
+        bool empty = true;
+
+        if (!page) {
+            continue;
+        }
+        for (j = 0; j < HBITMAP_PAGE_WORDS; j++) {
+            if (page[j]) {
+                i = p * HBITMAP_PAGE_WORDS + j;
+                summary[i >> BITS_PER_LEVEL] |=
+                    1UL << (i & (BITS_PER_LONG - 1));
+                empty = false;
+            }
+        }
+        if (empty) {
+            g_free(page);
+            bitmap->pages[p] = NULL;
+        }
+    }
+
+    size = bitmap->sizes[HBITMAP_LEVELS - 2];
+    for (lev = HBITMAP_LEVELS - 2; lev-- > 0; ) {
         prev_size = size;
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
@@ -751,8 +908,14 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
 void hbitmap_free(HBitmap *hb)
 {
     unsigned i;
+    uint64_t p;
+
     assert(!hb->meta);
-    for (i = HBITMAP_LEVELS; i-- > 0; ) {
+    for (p = 0; p < hb->nb_pages; p++) {
+        g_free(hb->pages[p]);
+    }
+    g_free(hb->pages);
+    for (i = HBITMAP_LEVELS - 1; i-- > 0; ) {
         g_free(hb->levels[i]);
     }
     g_free(hb);
@@ -775,7 +938,12 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
-        hb->levels[i] = g_new0(unsigned long, size);
+        if (i == HBITMAP_LEVELS - 1) {
+            hb->nb_pages = DIV_ROUND_UP(size, HBITMAP_PAGE_WORDS);
+            hb->pages = g_new0(unsigned long *, hb->nb_pages);
+        } else {
+            hb->levels[i] = g_new0(unsigned long, size);
+        }
     }
 
     /* We necessarily have free bits in level 0 due to the definition
@@ -829,6 +997,20 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         }
         old = hb->sizes[i];
         hb->sizes[i] = size;
+        if (i == HBITMAP_LEVELS - 1) {
+            uint64_t p, nb_pages = DIV_ROUND_UP(size, HBITMAP_PAGE_WORDS);
+
+            /* Pages past the end are all zero after the reset above */
+            for (p = nb_pages; p < hb->nb_pages; p++) {
+                g_free(hb->pages[p]);
+            }
+            hb->pages = g_renew(unsigned long *, hb->pages, nb_pages);
+            for (p = hb->nb_pages; p < nb_pages; p++) {
+                hb->pages[p] = NULL;
+            }
+            hb->nb_pages = nb_pages;
+            continue;
+        }
         hb->levels[i] = g_realloc(hb->levels[i], size * sizeof(unsigned long));
         if (!shrink) {
             memset(&hb->levels[i][old], 0x00,
@@ -864,6 +1046,34 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/*
+ * Stores @a | @b into @r, any of which may alias, and returns the number of
+ * bits set in the result.  Kept simple enough for the compiler to vectorize.
+ */
+static uint64_t hb_or_words(unsigned long *r, const unsigned long *a,
+                            const unsigned long *b, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        r[i] = a[i] | b[i];
+        count += ctpopl(r[i]);
+    }
+    return count;
+}
+
+static uint64_t hb_count_words(const unsigned long *w, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        count += ctpopl(w[i]);
+    }
+    return count;
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -874,8 +1084,10 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
  */
 bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 {
+    static const unsigned long zero_page[HBITMAP_PAGE_WORDS];
+    uint64_t count = 0;
     int i;
-    uint64_t j;
+    uint64_t j, p;
 
     if (!hbitmap_can_merge(a, b) || !hbitmap_can_merge(a, result)) {
         return false;
@@ -908,16 +1120,40 @@ bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
      * It may be possible to improve running times for sparsely populated maps
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
+     * Pages missing from either input are skipped or treated as zero, and
+     * the dirty count is accumulated while merging.
      */
     assert(a->size == b->size);
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
+    for (p = 0; p < a->nb_pages; p++) {
+        const unsigned long *pa = a->pages[p];
+        const unsigned long *pb = b->pages[p];
+        unsigned long *pr;
+
+        if (!pa && !pb) {
+            g_free(result->pages[p]);
+            result->pages[p] = NULL;
+            continue;
+        }
+        if ((!pb && result == a) || (!pa && result == b)) {
+            /* Merging in a zero page leaves the result unchanged */
+            count += hb_count_words(pa ?: pb, HBITMAP_PAGE_WORDS);
+            continue;
+        }
+        if (!result->pages[p]) {
+            result->pages[p] = g_new0(unsigned long, HBITMAP_PAGE_WORDS);
+        }
+        pr = result->pages[p];
+        count += hb_or_words(pr, pa ?: zero_page, pb ?: zero_page,
+                             HBITMAP_PAGE_WORDS);
+    }
+    for (i = HBITMAP_LEVELS - 2; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
         }
     }
 
-    /* Recompute the dirty count */
-    result->count = hb_count_between(result, 0, result->size - 1);
+    /* Bits past the end of the bitmap are never set */
+    result->count = count;
 
     return true;
 }
@@ -925,9 +1161,22 @@ bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
 {
     size_t size = bitmap->sizes[HBITMAP_LEVELS - 1] * sizeof(unsigned long);
-    char *data = (char *)bitmap->levels[HBITMAP_LEVELS - 1];
+    const size_t page_size = HBITMAP_PAGE_WORDS * sizeof(unsigned long);
+    g_autofree unsigned long *zero_page = NULL;
+    g_autofree struct iovec *iov = g_new(struct iovec, bitmap->nb_pages);
     char *hash = NULL;
-    qcrypto_hash_digest(QCRYPTO_HASH_ALG_SHA256, data, size, &hash, errp);
+    uint64_t p;
+
+    /* Hash the same data as a bitmap whose last level is not split */
+    for (p = 0; p < bitmap->nb_pages; p++) {
+        if (!bitmap->pages[p] && !zero_page) {
+            zero_page = g_new0(unsigned long, HBITMAP_PAGE_WORDS);
+        }
+        iov[p].iov_base = bitmap->pages[p] ?: zero_page;
+        iov[p].iov_len = MIN(size - p * page_size, page_size);
+    }
+    qcrypto_hash_digestv(QCRYPTO_HASH_ALG_SHA256, iov, bitmap->nb_pages,
+                         &hash, errp);
 
     return hash;
 }
@@ -41,6 +41,8 @@
 #include <libgen.h>
 #include "qemu/cutils.h"
 #include "qemu/compiler.h"
+#include "qemu/bitops.h"
+#include "qemu/queue.h"
 #include "qemu/units.h"
 
 #ifdef CONFIG_LINUX
@@ -82,6 +84,12 @@ typedef struct MemsetContext {
     bool any_thread_failed;
     struct MemsetThread *threads;
     int num_threads;
+    bool bind_threads;
+#ifdef CONFIG_LINUX
+    /* CPUs of the host nodes the memory is bound to */
+    cpu_set_t cpus;
+#endif
+    QSLIST_ENTRY(MemsetContext) next;
 } MemsetContext;
 
 struct MemsetThread {
@@ -102,6 +110,10 @@ static QemuMutex sigbus_mutex;
 static QemuMutex page_mutex;
 static QemuCond page_cond;
 
+/* Asynchronous preallocations, waited for by os_mem_prealloc_finish() */
+static QSLIST_HEAD(, MemsetContext) memset_async_contexts =
+    QSLIST_HEAD_INITIALIZER(memset_async_contexts);
+
 int qemu_get_thread_id(void)
 {
 #if defined(__linux__)
@@ -487,12 +499,29 @@ static void sigbus_handler(int signal)
     warn_report("os_mem_prealloc: unrelated SIGBUS detected and ignored");
 }
 
+static void memset_thread_bind(MemsetThread *memset_args)
+{
+#ifdef CONFIG_LINUX
+    MemsetContext *context = memset_args->context;
+
+    /*
+     * Zeroing pages is faster from a CPU close to the memory.  This is only
+     * an optimization, so ignore failures (e.g. because of -sandbox).
+     */
+    if (context->bind_threads) {
+        sched_setaffinity(0, sizeof(context->cpus), &context->cpus);
+    }
+#endif
+}
+
 static void *do_touch_pages(void *arg)
 {
     MemsetThread *memset_args = (MemsetThread *)arg;
     sigset_t set, oldset;
     int ret = 0;
 
+    memset_thread_bind(memset_args);
+
     /*
      * On Linux, the page faults from the loop below can cause mmap_sem
      * contention with allocation of the thread stacks.  Do not start
@@ -540,6 +569,8 @@ static void *do_madv_populate_write_pages(void *arg)
     char * const addr = memset_args->addr;
     int ret = 0;
 
+    memset_thread_bind(memset_args);
+
     /* See do_touch_pages(). */
     qemu_mutex_lock(&page_mutex);
     while (!memset_args->context->all_threads_created) {
@@ -553,12 +584,74 @@ static void *do_madv_populate_write_pages(void *arg)
     return (void *)(uintptr_t)ret;
 }
 
-static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
+#ifdef CONFIG_LINUX
+/*
+ * Fills @cpus with the CPUs of the host NUMA nodes set in @nodes that this
+ * process may run on.  Returns false if there are none, for example because
+ * sysfs does not describe the host topology.
+ */
+static bool get_memset_node_cpus(const unsigned long *nodes,
+                                 unsigned long maxnode, cpu_set_t *cpus)
+{
+    cpu_set_t allowed;
+    unsigned long node;
+
+    CPU_ZERO(cpus);
+    if (!nodes || sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return false;
+    }
+
+    for (node = find_first_bit(nodes, maxnode); node < maxnode;
+         node = find_next_bit(nodes, maxnode, node + 1)) {
+        g_autofree char *path = NULL;
+        g_autofree char *list = NULL;
+        const char *p;
+
+        path = g_strdup_printf("/sys/devices/system/node/node%lu/cpulist",
+                               node);
+        if (!g_file_get_contents(path, &list, NULL, NULL)) {
+            continue;
+        }
+
+        /* The format is a comma separated list of ranges, e.g. "0-3,8" */
+        p = list;
+        while (*p && *p != '\n') {
+            unsigned long first, last, cpu;
+
+            if (qemu_strtoul(p, &p, 10, &first)) {
+                break;
+            }
+            last = first;
+            if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last)) {
+                break;
+            }
+            for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+                CPU_SET(cpu, cpus);
+            }
+            if (*p == ',') {
+                p++;
+            }
+        }
+    }
+
+    CPU_AND(cpus, cpus, &allowed);
+    return CPU_COUNT(cpus) > 0;
+}
+#endif
+
+static inline int get_memset_num_threads(MemsetContext *context,
+                                         size_t hpagesize, size_t numpages,
                                          int smp_cpus)
 {
     long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
     int ret = 1;
 
+#ifdef CONFIG_LINUX
+    if (context->bind_threads) {
+        host_procs = CPU_COUNT(&context->cpus);
+    }
+#endif
+
     if (host_procs > 0) {
         ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), smp_cpus);
     }
@@ -572,13 +665,30 @@ static inline int get_memset_num_threads(size_t hpagesize, size_t numpages,
     return ret;
 }
 
+static int wait_and_free_memset_context(MemsetContext *context)
+{
+    int ret = 0, i;
+
+    for (i = 0; i < context->num_threads; i++) {
+        int tmp = (uintptr_t)qemu_thread_join(&context->threads[i].pgthread);
+
+        if (tmp) {
+            ret = tmp;
+        }
+    }
+
+    g_free(context->threads);
+    g_free(context);
+    return ret;
+}
+
 static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                           int smp_cpus, bool use_madv_populate_write)
+                           int smp_cpus, const unsigned long *host_nodes,
+                           unsigned long maxnode, bool use_madv_populate_write,
+                           bool async)
 {
     static gsize initialized = 0;
-    MemsetContext context = {
-        .num_threads = get_memset_num_threads(hpagesize, numpages, smp_cpus),
-    };
+    MemsetContext *context = g_new0(MemsetContext, 1);
     size_t numpages_per_thread, leftover;
     void *(*touch_fn)(void *);
     int ret = 0, i = 0;
@@ -590,9 +700,20 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         g_once_init_leave(&initialized, 1);
     }
 
+#ifdef CONFIG_LINUX
+    context->bind_threads = get_memset_node_cpus(host_nodes, maxnode,
+                                                 &context->cpus);
+#endif
+    context->num_threads = get_memset_num_threads(context, hpagesize,
+                                                  numpages, smp_cpus);
+
     if (use_madv_populate_write) {
-        /* Avoid creating a single thread for MADV_POPULATE_WRITE */
-        if (context.num_threads == 1) {
+        /*
+         * Avoid creating a single thread for MADV_POPULATE_WRITE, unless it
+         * has to run in the background or on specific CPUs.
+         */
+        if (context->num_threads == 1 && !async && !context->bind_threads) {
+            g_free(context);
             if (qemu_madvise(area, hpagesize * numpages,
                              QEMU_MADV_POPULATE_WRITE)) {
                 return -errno;
@@ -601,44 +722,44 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         }
         touch_fn = do_madv_populate_write_pages;
     } else {
+        /* The SIGBUS handler is only installed while we wait */
+        assert(!async);
         touch_fn = do_touch_pages;
     }
 
-    context.threads = g_new0(MemsetThread, context.num_threads);
-    numpages_per_thread = numpages / context.num_threads;
-    leftover = numpages % context.num_threads;
-    for (i = 0; i < context.num_threads; i++) {
-        context.threads[i].addr = addr;
-        context.threads[i].numpages = numpages_per_thread + (i < leftover);
-        context.threads[i].hpagesize = hpagesize;
-        context.threads[i].context = &context;
-        qemu_thread_create(&context.threads[i].pgthread, "touch_pages",
-                           touch_fn, &context.threads[i],
+    context->threads = g_new0(MemsetThread, context->num_threads);
+    numpages_per_thread = numpages / context->num_threads;
+    leftover = numpages % context->num_threads;
+    for (i = 0; i < context->num_threads; i++) {
+        context->threads[i].addr = addr;
+        context->threads[i].numpages = numpages_per_thread + (i < leftover);
+        context->threads[i].hpagesize = hpagesize;
+        context->threads[i].context = context;
+        qemu_thread_create(&context->threads[i].pgthread, "touch_pages",
+                           touch_fn, &context->threads[i],
                            QEMU_THREAD_JOINABLE);
-        addr += context.threads[i].numpages * hpagesize;
+        addr += context->threads[i].numpages * hpagesize;
     }
 
     if (!use_madv_populate_write) {
-        sigbus_memset_context = &context;
+        sigbus_memset_context = context;
     }
 
     qemu_mutex_lock(&page_mutex);
-    context.all_threads_created = true;
+    context->all_threads_created = true;
     qemu_cond_broadcast(&page_cond);
     qemu_mutex_unlock(&page_mutex);
 
-    for (i = 0; i < context.num_threads; i++) {
-        int tmp = (uintptr_t)qemu_thread_join(&context.threads[i].pgthread);
-
-        if (tmp) {
-            ret = tmp;
-        }
+    if (async) {
+        QSLIST_INSERT_HEAD(&memset_async_contexts, context, next);
+        return 0;
     }
 
+    ret = wait_and_free_memset_context(context);
+
     if (!use_madv_populate_write) {
         sigbus_memset_context = NULL;
     }
-    g_free(context.threads);
 
     return ret;
 }
@@ -650,7 +771,8 @@ static bool madv_populate_write_possible(char *area, size_t pagesize)
 }
 
 void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+                     const unsigned long *host_nodes, unsigned long maxnode,
+                     bool async, Error **errp)
 {
     static gsize initialized;
     int ret;
@@ -666,6 +788,9 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     use_madv_populate_write = madv_populate_write_possible(area, hpagesize);
 
     if (!use_madv_populate_write) {
+        /* Touching pages relies on a SIGBUS handler for the whole process */
+        async = false;
+
         if (g_once_init_enter(&initialized)) {
             qemu_mutex_init(&sigbus_mutex);
             g_once_init_leave(&initialized, 1);
@@ -690,8 +815,8 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 
     /* touch pages simultaneously */
-    ret = touch_all_pages(area, hpagesize, numpages, smp_cpus,
-                          use_madv_populate_write);
+    ret = touch_all_pages(area, hpagesize, numpages, smp_cpus, host_nodes,
+                          maxnode, use_madv_populate_write, async);
     if (ret) {
         error_setg_errno(errp, -ret,
                          "os_mem_prealloc: preallocating memory failed");
@@ -708,6 +833,29 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+bool os_mem_prealloc_finish(Error **errp)
+{
+    MemsetContext *context;
+    int ret = 0;
+
+    while ((context = QSLIST_FIRST(&memset_async_contexts))) {
+        int tmp;
+
+        QSLIST_REMOVE_HEAD(&memset_async_contexts, next);
+        tmp = wait_and_free_memset_context(context);
+        if (tmp) {
+            ret = tmp;
+        }
+    }
+
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "os_mem_prealloc: preallocating memory failed");
+        return false;
+    }
+    return true;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     char *name = NULL;
@@ -371,7 +371,8 @@ int getpagesize(void)
 }
 
 void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+                     const unsigned long *host_nodes, unsigned long maxnode,
+                     bool async, Error **errp)
 {
     int i;
     size_t pagesize = qemu_real_host_page_size;
@@ -382,6 +383,11 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+bool os_mem_prealloc_finish(Error **errp)
+{
+    return true;
+}
+
 char *qemu_get_pid_name(pid_t pid)
 {
     /* XXX Implement me */
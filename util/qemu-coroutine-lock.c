@@ -39,9 +39,12 @@ void qemu_co_queue_init(CoQueue *queue)
     QSIMPLEQ_INIT(&queue->entries);
 }
 
-void coroutine_fn qemu_co_queue_wait_impl(CoQueue *queue, QemuLockable *lock)
+void coroutine_fn qemu_co_queue_wait_impl(CoQueue *queue, QemuLockable *lock,
+                                          const char *file, int line)
 {
     Coroutine *self = qemu_coroutine_self();
+    int64_t t0 = qsp_wait_begin();
+
     QSIMPLEQ_INSERT_TAIL(&queue->entries, self, co_queue_next);
 
     if (lock) {
@@ -65,6 +68,7 @@ void coroutine_fn qemu_co_queue_wait_impl(CoQueue *queue, QemuLockable *lock)
     if (lock) {
         qemu_lockable_lock(lock);
     }
+    qsp_wait_end(queue, QSP_CO_QUEUE, file, line, t0);
 }
 
 static bool qemu_co_queue_do_restart(CoQueue *queue, bool single)
@@ -232,10 +236,12 @@ static void coroutine_fn qemu_co_mutex_lock_slowpath(AioContext *ctx,
     trace_qemu_co_mutex_lock_return(mutex, self);
 }
 
-void coroutine_fn qemu_co_mutex_lock(CoMutex *mutex)
+void coroutine_fn qemu_co_mutex_lock_impl(CoMutex *mutex, const char *file,
+                                          int line)
 {
     AioContext *ctx = qemu_get_current_aio_context();
     Coroutine *self = qemu_coroutine_self();
+    int64_t t0 = qsp_wait_begin();
     int waiters, i;
 
     /* Running a very small critical section on pthread_mutex_t and CoMutex
@@ -270,6 +276,7 @@ retry_fast_path:
     }
     mutex->holder = self;
     self->locks_held++;
+    qsp_wait_end(mutex, QSP_CO_MUTEX, file, line, t0);
 }
 
 void coroutine_fn qemu_co_mutex_unlock(CoMutex *mutex)
@@ -374,9 +381,10 @@ static void qemu_co_rwlock_maybe_wake_one(CoRwlock *lock)
     }
 }
 
-void qemu_co_rwlock_rdlock(CoRwlock *lock)
+void qemu_co_rwlock_rdlock_impl(CoRwlock *lock, const char *file, int line)
 {
     Coroutine *self = qemu_coroutine_self();
+    int64_t t0 = qsp_wait_begin();
 
     qemu_co_mutex_lock(&lock->mutex);
     /* For fairness, wait if a writer is in line.  */
@@ -397,6 +405,7 @@ void qemu_co_rwlock_rdlock(CoRwlock *lock)
     }
 
     self->locks_held++;
+    qsp_wait_end(lock, QSP_CO_RWLOCK, file, line, t0);
 }
 
 void qemu_co_rwlock_unlock(CoRwlock *lock)
@@ -427,9 +436,10 @@ void qemu_co_rwlock_downgrade(CoRwlock *lock)
     qemu_co_rwlock_maybe_wake_one(lock);
 }
 
-void qemu_co_rwlock_wrlock(CoRwlock *lock)
+void qemu_co_rwlock_wrlock_impl(CoRwlock *lock, const char *file, int line)
 {
     Coroutine *self = qemu_coroutine_self();
+    int64_t t0 = qsp_wait_begin();
 
     qemu_co_mutex_lock(&lock->mutex);
     if (lock->owners == 0) {
@@ -445,10 +455,13 @@ void qemu_co_rwlock_wrlock(CoRwlock *lock)
     }
 
     self->locks_held++;
+    qsp_wait_end(lock, QSP_CO_RWLOCK, file, line, t0);
 }
 
-void qemu_co_rwlock_upgrade(CoRwlock *lock)
+void qemu_co_rwlock_upgrade_impl(CoRwlock *lock, const char *file, int line)
 {
+    int64_t t0 = qsp_wait_begin();
+
     qemu_co_mutex_lock(&lock->mutex);
     assert(lock->owners > 0);
     /* For fairness, wait if a writer is in line.  */
@@ -464,4 +477,5 @@ void qemu_co_rwlock_upgrade(CoRwlock *lock)
         qemu_coroutine_yield();
         assert(lock->owners == -1);
     }
+    qsp_wait_end(lock, QSP_CO_RWLOCK, file, line, t0);
 }
@@ -18,12 +18,21 @@
 #include "qemu/atomic.h"
 #include "qemu/coroutine.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/coroutine-prof.h"
 #include "block/aio.h"
 
 enum {
-    POOL_BATCH_SIZE = 64,
+    POOL_INITIAL_BATCH_SIZE = 64,
 };
 
+/*
+ * Number of coroutines moved between release_pool and the per-thread
+ * alloc_pool at a time.  Devices that can keep many requests in flight grow
+ * it with qemu_coroutine_inc_pool_size(), so that the pools do not thrash
+ * when the number of concurrent requests exceeds POOL_INITIAL_BATCH_SIZE.
+ */
+static unsigned int pool_batch_size = POOL_INITIAL_BATCH_SIZE;
+
 /** Free list to speed up creation */
 static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
 static unsigned int release_pool_size;
@@ -49,7 +58,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     if (CONFIG_COROUTINE_POOL) {
         co = QSLIST_FIRST(&alloc_pool);
         if (!co) {
-            if (release_pool_size > POOL_BATCH_SIZE) {
+            if (release_pool_size > qatomic_read(&pool_batch_size)) {
                 /* Slow path; a good place to register the destructor, too.  */
                 if (!coroutine_pool_cleanup_notifier.notify) {
                     coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
@@ -73,10 +82,12 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 
     if (!co) {
         co = qemu_coroutine_new();
+        trace_qemu_coroutine_pool_miss(co, qatomic_read(&pool_batch_size));
     }
 
     co->entry = entry;
     co->entry_arg = opaque;
+    co->prof_tag = NULL;
     QSIMPLEQ_INIT(&co->co_queue_wakeup);
     return co;
 }
@@ -86,12 +97,12 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+        if (release_pool_size < qatomic_read(&pool_batch_size) * 2) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
             qatomic_inc(&release_pool_size);
             return;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
+        if (alloc_pool_size < qatomic_read(&pool_batch_size)) {
             QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
             alloc_pool_size++;
             return;
@@ -144,7 +155,13 @@ void qemu_aio_coroutine_enter(AioContext *ctx, Coroutine *co)
          */
         smp_wmb();
 
+        if (unlikely(qatomic_read(&coroutine_prof_enabled))) {
+            coroutine_prof_switch(to);
+        }
         ret = qemu_coroutine_switch(from, to, COROUTINE_ENTER);
+        if (unlikely(qatomic_read(&coroutine_prof_enabled))) {
+            coroutine_prof_switch(from);
+        }
 
         /* Queued coroutines are run depth-first; previously pending coroutines
          * run after those queued more recently.
@@ -202,3 +219,13 @@ AioContext *coroutine_fn qemu_coroutine_get_aio_context(Coroutine *co)
 {
     return co->ctx;
 }
+
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size)
+{
+    qatomic_add(&pool_batch_size, additional_pool_size);
+}
+
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
+{
+    qatomic_sub(&pool_batch_size, removing_pool_size);
+}
@@ -61,12 +61,20 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * used by different AioContexts / threads. Each clock also has
  * a list of the QEMUTimerLists associated with it, in order that
  * reenabling the clock can call all the notifiers.
+ *
+ * The pending timers are kept in a binary min-heap ordered by expire_time,
+ * so that timer_mod() and timer_del() are O(log n) while the next deadline
+ * is still found in constant time.  Timers with the same expire_time fire
+ * in the order in which they were armed.
  */
 
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    QEMUTimer **active_timers;          /* the heap */
+    int nb_active_timers;
+    int active_timers_size;
+    uint64_t seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -117,6 +125,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -171,7 +180,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!qatomic_read(&timer_list->active_timers);
+    return qatomic_read(&timer_list->nb_active_timers) > 0;
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -184,15 +193,15 @@ bool timerlist_expired(QEMUTimerList *timer_list)
 {
     int64_t expire_time;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nb_active_timers) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timer_list->active_timers[0]->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -214,7 +223,7 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     int64_t delta;
     int64_t expire_time;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return -1;
     }
 
@@ -227,10 +236,10 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nb_active_timers) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timer_list->active_timers[0]->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -255,6 +264,7 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
     QEMUTimer *ts;
     QEMUTimerList *timer_list;
     QEMUClock *clock = qemu_clock_ptr(type);
+    int i;
 
     if (!clock->enabled) {
         return -1;
@@ -262,17 +272,26 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
-        /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
+        expire_time = -1;
+        /*
+         * Skip all external timers.  Unless the soonest timer qualifies,
+         * this has to look at all of them, as the heap is only partially
+         * ordered.
+         */
+        for (i = 0; i < timer_list->nb_active_timers; i++) {
+            ts = timer_list->active_timers[i];
+            if (!(ts->attributes & ~attr_mask) &&
+                (expire_time == -1 || ts->expire_time < expire_time)) {
+                expire_time = ts->expire_time;
+                if (i == 0) {
+                    break;
+                }
+            }
         }
-        if (!ts) {
-            qemu_mutex_unlock(&timer_list->active_timers_lock);
+        qemu_mutex_unlock(&timer_list->active_timers_lock);
+        if (expire_time == -1) {
             continue;
         }
-        expire_time = ts->expire_time;
-        qemu_mutex_unlock(&timer_list->active_timers_lock);
 
         delta = expire_time - qemu_clock_get_ns(type);
         if (delta <= 0) {
@@ -375,43 +394,104 @@ void timer_deinit(QEMUTimer *ts)
     ts->timer_list = NULL;
 }
 
-static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+static inline bool timer_heap_before(const QEMUTimer *a, const QEMUTimer *b)
 {
-    QEMUTimer **pt, *t;
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            qatomic_set(pt, t->next);
+static inline void timer_heap_set(QEMUTimerList *timer_list, int i,
+                                  QEMUTimer *ts)
+{
+    timer_list->active_timers[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timer_heap_sift_up(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!timer_heap_before(ts, timer_list->active_timers[parent])) {
             break;
         }
-        pt = &t->next;
+        timer_heap_set(timer_list, i, timer_list->active_timers[parent]);
+        i = parent;
     }
+    timer_heap_set(timer_list, i, ts);
 }
 
-static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
-                                QEMUTimer *ts, int64_t expire_time)
+static void timer_heap_sift_down(QEMUTimerList *timer_list, int i)
 {
-    QEMUTimer **pt, *t;
+    QEMUTimer *ts = timer_list->active_timers[i];
+    int n = timer_list->nb_active_timers;
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
     for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
+        int child = 2 * i + 1;
+
+        if (child >= n) {
             break;
         }
-        pt = &t->next;
+        if (child + 1 < n &&
+            timer_heap_before(timer_list->active_timers[child + 1],
+                              timer_list->active_timers[child])) {
+            child++;
+        }
+        if (!timer_heap_before(timer_list->active_timers[child], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, timer_list->active_timers[child]);
+        i = child;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int i = ts->heap_index;
+    int last;
+
+    if (ts->expire_time == -1) {
+        return;
+    }
+
+    ts->expire_time = -1;
+    assert(timer_list->active_timers[i] == ts);
+    last = timer_list->nb_active_timers - 1;
+    qatomic_set(&timer_list->nb_active_timers, last);
+    if (i != last) {
+        QEMUTimer *moved = timer_list->active_timers[last];
+
+        /* Fill the hole with the last timer and restore the heap order */
+        timer_heap_set(timer_list, i, moved);
+        timer_heap_sift_up(timer_list, i);
+        if (moved->heap_index == i) {
+            timer_heap_sift_down(timer_list, i);
+        }
+    }
+}
+
+static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
+                                QEMUTimer *ts, int64_t expire_time)
+{
+    int n = timer_list->nb_active_timers;
+
+    if (n == timer_list->active_timers_size) {
+        timer_list->active_timers_size = MAX(n * 2, 16);
+        timer_list->active_timers = g_renew(QEMUTimer *,
+                                            timer_list->active_timers,
+                                            timer_list->active_timers_size);
     }
+
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    qatomic_set(pt, ts);
+    ts->seq = timer_list->seq++;
+    timer_list->active_timers[n] = ts;
+    qatomic_set(&timer_list->nb_active_timers, n + 1);
+    timer_heap_sift_up(timer_list, n);
 
-    return pt == &timer_list->active_timers;
+    return ts->heap_index == 0;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -503,7 +583,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     QEMUTimerCB *cb;
     void *opaque;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
@@ -542,7 +622,8 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    while ((ts = timer_list->active_timers)) {
+    while (timer_list->nb_active_timers) {
+        ts = timer_list->active_timers[0];
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
              * if no timers fired or they were all external.
@@ -562,9 +643,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
 
@@ -48,6 +48,18 @@
  * ht->map pointer is set, and the old map is freed once no RCU readers can see
  * it anymore.
  *
+ * Automatic resizes instead grow the table incrementally, so that writers are
+ * never stalled for the time it takes to copy the whole table.  The new map,
+ * twice the size of the old one, is published right away and points to the
+ * old map.  Entries of old head bucket i belong to new head buckets i and
+ * i + old->n_buckets; they are copied ("migrated") by the first writer that
+ * needs one of these two buckets, and by every insertion a few at a time, in
+ * the spirit of split-ordered lists.  Until old bucket i has been migrated,
+ * lookups keep reading it from the old map.  Migration copies entries rather
+ * than moving them, so lookups that read the old bucket slightly late still
+ * find a consistent chain.  The old map is freed after its last bucket has
+ * been migrated.
+ *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occurred
  * while the bucket spinlock was being acquired.
@@ -68,6 +80,7 @@
 #include "qemu/osdep.h"
 #include "qemu/qht.h"
 #include "qemu/atomic.h"
+#include "qemu/bitmap.h"
 #include "qemu/rcu.h"
 
 //#define QHT_DEBUG
@@ -159,6 +172,10 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @old: map whose entries are still being migrated to this one, or NULL.
+ * @migrated: bitmap of the head buckets of @old that have been migrated.
+ * @n_migrated: number of bits set in @migrated.
+ * @migrate_next: next head bucket of @old to be migrated by insertions.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -168,14 +185,24 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *old;
+    unsigned long *migrated;
+    size_t n_migrated;
+    size_t migrate_next;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+/* number of old head buckets migrated by each insertion during a grow */
+#define QHT_MIGRATE_BATCH 4
+
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void qht_map_migrate_hash(const struct qht *ht, struct qht_map *map,
+                                 uint32_t hash);
+static void qht_map_migrate_all(const struct qht *ht, struct qht_map *map);
 
 #ifdef QHT_DEBUG
 
@@ -241,6 +268,31 @@ struct qht_bucket *qht_map_to_bucket(const struct qht_map *map, uint32_t hash)
     return &map->buckets[hash & (map->n_buckets - 1)];
 }
 
+/* Pairs with the barrier in qht_map_migrate_bucket() */
+static inline bool qht_map_is_migrated(const struct qht_map *map, size_t i)
+{
+    unsigned long word = qatomic_load_acquire(&map->migrated[BIT_WORD(i)]);
+
+    return word & BIT_MASK(i);
+}
+
+/*
+ * Get the head bucket that holds the entries for @hash, which is in the old
+ * map if it has not been migrated yet.  Call within an RCU read-side
+ * critical section.
+ */
+static inline const struct qht_bucket *
+qht_map_to_lookup_bucket(const struct qht_map *map, uint32_t hash)
+{
+    const struct qht_map *old = qatomic_rcu_read(&map->old);
+
+    if (unlikely(old) &&
+        !qht_map_is_migrated(map, hash & (old->n_buckets - 1))) {
+        return qht_map_to_bucket(old, hash);
+    }
+    return qht_map_to_bucket(map, hash);
+}
+
 /* acquire all bucket locks from a map */
 static void qht_map_lock_buckets(struct qht_map *map)
 {
@@ -287,6 +339,7 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     if (likely(!qht_map_is_stale__locked(ht, map))) {
         *pmap = map;
@@ -297,6 +350,7 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qht_lock(ht);
     map = ht->map;
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     qht_unlock(ht);
     *pmap = map;
@@ -319,6 +373,7 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
+    qht_map_migrate_hash(ht, map, hash);
     b = qht_map_to_bucket(map, hash);
 
     qemu_spin_lock(&b->lock);
@@ -331,6 +386,7 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qht_lock(ht);
     map = ht->map;
+    qht_map_migrate_hash(ht, map, hash);
     b = qht_map_to_bucket(map, hash);
     qemu_spin_lock(&b->lock);
     qht_unlock(ht);
@@ -366,6 +422,7 @@ static void qht_map_destroy(struct qht_map *map)
         qht_chain_destroy(&map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->migrated);
     g_free(map);
 }
 
@@ -374,7 +431,7 @@ static struct qht_map *qht_map_create(size_t n_buckets)
     struct qht_map *map;
     size_t i;
 
-    map = g_malloc(sizeof(*map));
+    map = g_malloc0(sizeof(*map));
     map->n_buckets = n_buckets;
 
     map->n_added_buckets = 0;
@@ -411,6 +468,9 @@ void qht_init(struct qht *ht, qht_cmp_func_t cmp, size_t n_elems,
 /* call only when there are no readers/writers left */
 void qht_destroy(struct qht *ht)
 {
+    if (ht->map->old) {
+        qht_map_destroy(ht->map->old);
+    }
     qht_map_destroy(ht->map);
     memset(ht, 0, sizeof(*ht));
 }
@@ -534,7 +594,7 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
     void *ret;
 
     map = qatomic_rcu_read(&ht->map);
-    b = qht_map_to_bucket(map, hash);
+    b = qht_map_to_lookup_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
     ret = qht_do_lookup(b, func, userp, hash);
@@ -603,6 +663,88 @@ static void *qht_insert__locked(const struct qht *ht, struct qht_map *map,
     return NULL;
 }
 
+/*
+ * Copy the entries of head bucket @i of map->old to @map, if not done yet.
+ * Lock order is the old bucket, then the new buckets in ascending order.
+ */
+static void qht_map_migrate_bucket(const struct qht *ht, struct qht_map *map,
+                                   size_t i)
+{
+    struct qht_map *old = qatomic_rcu_read(&map->old);
+    struct qht_bucket *from, *lo, *hi, *b;
+    bool done = false;
+    int j;
+
+    if (!old || qht_map_is_migrated(map, i)) {
+        return;
+    }
+
+    from = &old->buckets[i];
+    lo = &map->buckets[i];
+    hi = &map->buckets[i + old->n_buckets];
+    qemu_spin_lock(&from->lock);
+    qemu_spin_lock(&lo->lock);
+    qemu_spin_lock(&hi->lock);
+    if (!qht_map_is_migrated(map, i)) {
+        for (b = from; b; b = b->next) {
+            for (j = 0; j < QHT_BUCKET_ENTRIES && b->pointers[j]; j++) {
+                struct qht_bucket *to = qht_map_to_bucket(map, b->hashes[j]);
+
+                qht_insert__locked(ht, map, to, b->pointers[j], b->hashes[j],
+                                   NULL);
+            }
+        }
+        /* the entries must be visible before lookups switch to @map */
+        qatomic_or(&map->migrated[BIT_WORD(i)], BIT_MASK(i));
+        done = qatomic_fetch_inc(&map->n_migrated) + 1 == old->n_buckets;
+    }
+    qht_bucket_debug__locked(lo);
+    qht_bucket_debug__locked(hi);
+    qemu_spin_unlock(&hi->lock);
+    qemu_spin_unlock(&lo->lock);
+    qemu_spin_unlock(&from->lock);
+
+    if (done) {
+        qatomic_set(&map->old, NULL);
+        call_rcu(old, qht_map_destroy, rcu);
+    }
+}
+
+/* Make sure the entries for @hash are in @map before writing them */
+static void qht_map_migrate_hash(const struct qht *ht, struct qht_map *map,
+                                 uint32_t hash)
+{
+    if (unlikely(qatomic_read(&map->old))) {
+        qht_map_migrate_bucket(ht, map, hash & (map->n_buckets / 2 - 1));
+    }
+}
+
+/* Migrate a few more buckets, so that migration ends even without writes */
+static __attribute__((noinline))
+void qht_map_migrate_some(const struct qht *ht, struct qht_map *map)
+{
+    int k;
+
+    for (k = 0; k < QHT_MIGRATE_BATCH && qatomic_read(&map->old); k++) {
+        size_t i = qatomic_fetch_inc(&map->migrate_next);
+
+        if (i >= map->n_buckets / 2) {
+            break;
+        }
+        qht_map_migrate_bucket(ht, map, i);
+    }
+}
+
+/* Finish the migration to @map; needed before locking all of its buckets */
+static void qht_map_migrate_all(const struct qht *ht, struct qht_map *map)
+{
+    size_t i;
+
+    for (i = 0; i < map->n_buckets / 2 && qatomic_read(&map->old); i++) {
+        qht_map_migrate_bucket(ht, map, i);
+    }
+}
+
 static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
 {
     struct qht_map *map;
@@ -615,11 +757,17 @@ static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
         return;
     }
     map = ht->map;
-    /* another thread might have just performed the resize we were after */
-    if (qht_map_needs_resize(map)) {
+    /*
+     * another thread might have just performed the resize we were after,
+     * and a map cannot grow again until the previous migration is over
+     */
+    if (qht_map_needs_resize(map) && !qatomic_read(&map->old)) {
         struct qht_map *new = qht_map_create(map->n_buckets * 2);
 
-        qht_do_resize(ht, new);
+        /* no bucket locks needed: entries are migrated lazily */
+        new->old = map;
+        new->migrated = bitmap_new(map->n_buckets);
+        qatomic_rcu_set(&ht->map, new);
     }
     qht_unlock(ht);
 }
@@ -639,6 +787,9 @@ bool qht_insert(struct qht *ht, void *p, uint32_t hash, void **existing)
     qht_bucket_debug__locked(b);
     qemu_spin_unlock(&b->lock);
 
+    if (unlikely(qatomic_read(&map->old))) {
+        qht_map_migrate_some(ht, map);
+    }
     if (unlikely(needs_resize) && ht->mode & QHT_MODE_AUTO_RESIZE) {
         qht_grow_maybe(ht);
     }
@@ -805,6 +956,7 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
@@ -860,6 +1012,7 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
     struct qht_map_copy_data data;
 
     old = ht->map;
+    qht_map_migrate_all(ht, old);
     qht_map_lock_buckets(old);
 
     if (reset) {
@@ -920,13 +1073,22 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
     stats->head_buckets = map->n_buckets;
 
     for (i = 0; i < map->n_buckets; i++) {
-        const struct qht_bucket *head = &map->buckets[i];
+        const struct qht_bucket *head;
         const struct qht_bucket *b;
         unsigned int version;
         size_t buckets;
         size_t entries;
         int j;
 
+        /*
+         * While a grow is in progress, count the entries of each old bucket
+         * that has not been migrated yet once, at the lower of its new buckets
+         */
+        head = qht_map_to_lookup_bucket(map, i);
+        if (head != &map->buckets[i] && i >= map->n_buckets / 2) {
+            continue;
+        }
+
         do {
             version = seqlock_read_begin(&head->sequence);
             buckets = 0;
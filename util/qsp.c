@@ -16,6 +16,12 @@
  * either due to blocking (e.g. cond_wait, mutex_lock) or cache line
  * contention (e.g. mutex_lock, mutex_trylock).
  *
+ * Coroutine mutexes, rwlocks and queues, as well as RCU grace periods, are
+ * profiled too.  They cannot be swapped out through function pointers, so
+ * they check qsp_recording and report their wait times through
+ * qsp_wait_record().  A coroutine may resume on a different thread than the
+ * one it started waiting on; its wait is then accounted to the latter.
+ *
  * QSP's design focuses on speed and scalability. This is achieved
  * by having threads do their profiling entirely on thread-local data.
  * The appropriate thread-local data is found via a QHT, i.e. a concurrent hash
@@ -64,13 +70,7 @@
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
 #include "qemu/xxhash.h"
-
-enum QSPType {
-    QSP_MUTEX,
-    QSP_BQL_MUTEX,
-    QSP_REC_MUTEX,
-    QSP_CONDVAR,
-};
+#include "qapi/qapi-types-misc.h"
 
 struct QSPCallSite {
     const void *obj;
@@ -122,8 +122,25 @@ static const char * const qsp_typenames[] = {
     [QSP_BQL_MUTEX] = "BQL mutex",
     [QSP_REC_MUTEX] = "rec_mutex",
     [QSP_CONDVAR]   = "condvar",
+    [QSP_CO_MUTEX]  = "co_mutex",
+    [QSP_CO_RWLOCK] = "co_rwlock",
+    [QSP_CO_QUEUE]  = "co_queue",
+    [QSP_RCU]       = "rcu",
+};
+
+static const SyncProfileType qsp_qapi_types[] = {
+    [QSP_MUTEX]     = SYNC_PROFILE_TYPE_MUTEX,
+    [QSP_BQL_MUTEX] = SYNC_PROFILE_TYPE_BQL_MUTEX,
+    [QSP_REC_MUTEX] = SYNC_PROFILE_TYPE_REC_MUTEX,
+    [QSP_CONDVAR]   = SYNC_PROFILE_TYPE_CONDVAR,
+    [QSP_CO_MUTEX]  = SYNC_PROFILE_TYPE_CO_MUTEX,
+    [QSP_CO_RWLOCK] = SYNC_PROFILE_TYPE_CO_RWLOCK,
+    [QSP_CO_QUEUE]  = SYNC_PROFILE_TYPE_CO_QUEUE,
+    [QSP_RCU]       = SYNC_PROFILE_TYPE_RCU,
 };
 
+bool qsp_recording;
+
 QemuMutexLockFunc qemu_bql_mutex_lock_func = qemu_mutex_lock_impl;
 QemuMutexLockFunc qemu_mutex_lock_func = qemu_mutex_lock_impl;
 QemuMutexTrylockFunc qemu_mutex_trylock_func = qemu_mutex_trylock_impl;
@@ -430,6 +447,21 @@ qsp_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms,
     return ret;
 }
 
+int64_t qsp_clock(void)
+{
+    return get_clock();
+}
+
+void qsp_wait_record(const void *obj, enum QSPType type, const char *file,
+                     int line, int64_t t0)
+{
+    int64_t t1 = get_clock();
+    QSPEntry *e;
+
+    e = qsp_entry_get(obj, file, line, type);
+    qsp_entry_record(e, t1 - t0);
+}
+
 bool qsp_is_enabled(void)
 {
     return qatomic_read(&qemu_mutex_lock_func) == qsp_mutex_lock;
@@ -444,6 +476,7 @@ void qsp_enable(void)
     qatomic_set(&qemu_rec_mutex_trylock_func, qsp_rec_mutex_trylock);
     qatomic_set(&qemu_cond_wait_func, qsp_cond_wait);
     qatomic_set(&qemu_cond_timedwait_func, qsp_cond_timedwait);
+    qatomic_set(&qsp_recording, true);
 }
 
 void qsp_disable(void)
@@ -455,6 +488,7 @@ void qsp_disable(void)
     qatomic_set(&qemu_rec_mutex_trylock_func, qemu_rec_mutex_trylock_impl);
     qatomic_set(&qemu_cond_wait_func, qemu_cond_wait_impl);
     qatomic_set(&qemu_cond_timedwait_func, qemu_cond_timedwait_impl);
+    qatomic_set(&qsp_recording, false);
 }
 
 static gint qsp_tree_cmp(gconstpointer ap, gconstpointer bp, gpointer up)
@@ -661,7 +695,9 @@ static char *qsp_at(const QSPCallSite *callsite)
 struct QSPReportEntry {
     const void *obj;
     char *callsite_at;
+    enum QSPType type;
     const char *typename;
+    uint64_t ns;
     double time_s;
     double ns_avg;
     uint64_t n_acqs;
@@ -691,7 +727,9 @@ static gboolean qsp_tree_report(gpointer key, gpointer value, gpointer udata)
     entry->obj = e->callsite->obj;
     entry->n_objs = e->n_objs;
     entry->callsite_at = qsp_at(e->callsite);
+    entry->type = e->callsite->type;
     entry->typename = qsp_typenames[e->callsite->type];
+    entry->ns = e->ns;
     entry->time_s = e->ns * 1e-9;
     entry->n_acqs = e->n_acqs;
     entry->ns_avg = e->n_acqs ? e->ns / e->n_acqs : 0;
@@ -765,26 +803,58 @@ static void report_destroy(QSPReport *rep)
     g_free(rep->entries);
 }
 
-void qsp_report(size_t max, enum QSPSortBy sort_by,
-                bool callsite_coalesce)
+static void report_init(QSPReport *rep, size_t max, enum QSPSortBy sort_by,
+                        bool callsite_coalesce)
 {
     GTree *tree = g_tree_new_full(qsp_tree_cmp, &sort_by, g_free, NULL);
-    QSPReport rep;
 
     qsp_init();
 
-    rep.entries = g_new0(QSPReportEntry, max);
-    rep.n_entries = 0;
-    rep.max_n_entries = max;
+    rep->entries = g_new0(QSPReportEntry, max);
+    rep->n_entries = 0;
+    rep->max_n_entries = max;
 
     qsp_mktree(tree, callsite_coalesce);
-    g_tree_foreach(tree, qsp_tree_report, &rep);
+    g_tree_foreach(tree, qsp_tree_report, rep);
     g_tree_destroy(tree);
+}
 
+void qsp_report(size_t max, enum QSPSortBy sort_by,
+                bool callsite_coalesce)
+{
+    QSPReport rep;
+
+    report_init(&rep, max, sort_by, callsite_coalesce);
     pr_report(&rep);
     report_destroy(&rep);
 }
 
+/* Same as qsp_report(), but returns the entries for QMP */
+SyncProfileEntryList *qsp_query(size_t max, enum QSPSortBy sort_by,
+                                bool callsite_coalesce)
+{
+    SyncProfileEntryList *head = NULL, **tail = &head;
+    QSPReport rep;
+    size_t i;
+
+    report_init(&rep, max, sort_by, callsite_coalesce);
+    for (i = 0; i < rep.n_entries; i++) {
+        const QSPReportEntry *e = &rep.entries[i];
+        SyncProfileEntry *info = g_new0(SyncProfileEntry, 1);
+
+        info->type = qsp_qapi_types[e->type];
+        info->objects = MAX(e->n_objs, 1);
+        info->object = e->n_objs > 1 ? 0 : (uintptr_t)e->obj;
+        info->callsite = g_strdup(e->callsite_at);
+        info->wait_time_ns = e->ns;
+        info->count = e->n_acqs;
+        QAPI_LIST_APPEND(tail, info);
+    }
+    report_destroy(&rep);
+
+    return head;
+}
+
 static void qsp_snapshot_destroy(QSPSnapshot *snap)
 {
     qht_iter(&snap->ht, qsp_ht_delete, NULL);
@@ -32,6 +32,8 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/timer.h"
+#include "trace.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -50,6 +52,10 @@ static int in_drain_call_rcu;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/* Protected by rcu_stats_lock, not rcu_sync_lock, so reading never waits */
+static QemuMutex rcu_stats_lock;
+static RCUStats rcu_stats;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -72,7 +78,7 @@ typedef QLIST_HEAD(, rcu_reader_data) ThreadList;
 static ThreadList registry = QLIST_HEAD_INITIALIZER(registry);
 
 /* Wait for previous parity/grace period to be empty of readers.  */
-static void wait_for_readers(void)
+static void wait_for_readers(bool expedited)
 {
     ThreadList qsreaders = QLIST_HEAD_INITIALIZER(qsreaders);
     struct rcu_reader_data *index, *tmp;
@@ -97,7 +103,11 @@ static void wait_for_readers(void)
          * index->ctr.  Pairs with smp_mb_placeholder() in rcu_read_unlock(),
          * ensuring that the loads of index->ctr are sequentially consistent.
          */
-        smp_mb_global();
+        if (expedited) {
+            smp_mb_global_expedited();
+        } else {
+            smp_mb_global();
+        }
 
         QLIST_FOREACH_SAFE(index, &registry, node, tmp) {
             if (!rcu_gp_ongoing(&index->ctr)) {
@@ -108,7 +118,7 @@ static void wait_for_readers(void)
                  * get some extra futex wakeups.
                  */
                 qatomic_set(&index->waiting, false);
-            } else if (qatomic_read(&in_drain_call_rcu)) {
+            } else if (expedited || qatomic_read(&in_drain_call_rcu)) {
                 notifier_list_notify(&index->force_rcu, NULL);
             }
         }
@@ -143,14 +153,32 @@ static void wait_for_readers(void)
     QLIST_SWAP(&registry, &qsreaders, node);
 }
 
-void synchronize_rcu(void)
+static void rcu_account_grace_period(int64_t ns, bool expedited)
+{
+    QEMU_LOCK_GUARD(&rcu_stats_lock);
+
+    rcu_stats.grace_periods++;
+    if (expedited) {
+        rcu_stats.expedited_grace_periods++;
+    }
+    rcu_stats.grace_period_total_ns += ns;
+    rcu_stats.grace_period_max_ns = MAX(rcu_stats.grace_period_max_ns, ns);
+}
+
+static void do_synchronize_rcu(bool expedited)
 {
     QEMU_LOCK_GUARD(&rcu_sync_lock);
+    int64_t start = get_clock();
+    int64_t ns;
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
      */
-    smp_mb_global();
+    if (expedited) {
+        smp_mb_global_expedited();
+    } else {
+        smp_mb_global();
+    }
 
     QEMU_LOCK_GUARD(&rcu_registry_lock);
     if (!QLIST_EMPTY(&registry)) {
@@ -164,15 +192,41 @@ void synchronize_rcu(void)
              * Switch parity: 0 -> 1, 1 -> 0.
              */
             qatomic_mb_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
-            wait_for_readers();
+            wait_for_readers(expedited);
             qatomic_mb_set(&rcu_gp_ctr, rcu_gp_ctr ^ RCU_GP_CTR);
         } else {
             /* Increment current grace period.  */
             qatomic_mb_set(&rcu_gp_ctr, rcu_gp_ctr + RCU_GP_CTR);
         }
 
-        wait_for_readers();
+        wait_for_readers(expedited);
     }
+
+    ns = get_clock() - start;
+    trace_rcu_grace_period(expedited, ns);
+    rcu_account_grace_period(ns, expedited);
+}
+
+void synchronize_rcu(void)
+{
+    int64_t t0 = qsp_wait_begin();
+
+    do_synchronize_rcu(false);
+    qsp_wait_end(&rcu_gp_ctr, QSP_RCU, __FILE__, __LINE__, t0);
+}
+
+void synchronize_rcu_expedited(void)
+{
+    int64_t t0 = qsp_wait_begin();
+
+    do_synchronize_rcu(true);
+    qsp_wait_end(&rcu_gp_ctr, QSP_RCU, __FILE__, __LINE__, t0);
+}
+
+void rcu_get_stats(RCUStats *stats)
+{
+    QEMU_LOCK_GUARD(&rcu_stats_lock);
+    *stats = rcu_stats;
 }
 
 
@@ -235,9 +289,69 @@ retry:
     return node;
 }
 
+/* Appends the callbacks in @list, most recent first, to @tail in FIFO order */
+static struct rcu_head **append_reversed(struct rcu_head **tail,
+                                         struct rcu_head *list, int *n)
+{
+    struct rcu_head *fifo = NULL, *node;
+
+    while (list) {
+        node = list;
+        list = node->next;
+        node->next = fifo;
+        fifo = node;
+    }
+    for (*tail = fifo; *tail; tail = &(*tail)->next) {
+        (*n)++;
+    }
+    return tail;
+}
+
+/*
+ * Takes all callbacks that are visible now: those of the global queue, then
+ * those of each registered thread.  Callbacks queued by one thread stay in
+ * order.
+ */
+static struct rcu_head *collect_callbacks(int *n)
+{
+    struct rcu_head *batch = NULL, **batch_tail = &batch;
+    struct rcu_reader_data *index;
+
+    *n = 0;
+    while (head != &dummy || qatomic_mb_read(&tail) != &dummy.next) {
+        struct rcu_head *node = try_dequeue();
+
+        if (!node) {
+            /* An enqueuer is halfway through, pick it up next time */
+            break;
+        }
+        *batch_tail = node;
+        batch_tail = &node->next;
+        (*n)++;
+    }
+    *batch_tail = NULL;
+
+    /* With rcu_sync_lock taken, all readers are in the registry */
+    QEMU_LOCK_GUARD(&rcu_sync_lock);
+    QEMU_LOCK_GUARD(&rcu_registry_lock);
+    QLIST_FOREACH(index, &registry, node) {
+        batch_tail = append_reversed(batch_tail,
+                                     qatomic_xchg(&index->callbacks, NULL), n);
+    }
+    return batch;
+}
+
+static void rcu_account_callbacks(int n)
+{
+    QEMU_LOCK_GUARD(&rcu_stats_lock);
+
+    rcu_stats.callbacks += n;
+    rcu_stats.callback_batch_max = MAX(rcu_stats.callback_batch_max, n);
+}
+
 static void *call_rcu_thread(void *opaque)
 {
-    struct rcu_head *node;
+    struct rcu_head *node, *batch;
 
     rcu_register_thread();
 
@@ -245,16 +359,19 @@ static void *call_rcu_thread(void *opaque)
         int tries = 0;
         int n = qatomic_read(&rcu_call_count);
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
+        /*
+         * Heuristically wait for a decent number of callbacks to pile up,
+         * unless someone is waiting for them in drain_call_rcu().  The count
+         * can be briefly negative, because call_rcu1() increments it after
+         * making the callback visible.
          */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
+        while (n <= 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5 &&
+                          !qatomic_read(&in_drain_call_rcu))) {
             g_usleep(10000);
-            if (n == 0) {
+            if (n <= 0) {
                 qemu_event_reset(&rcu_call_ready_event);
                 n = qatomic_read(&rcu_call_count);
-                if (n == 0) {
+                if (n <= 0) {
 #if defined(CONFIG_MALLOC_TRIM)
                     malloc_trim(4 * 1024 * 1024);
 #endif
@@ -264,34 +381,50 @@ static void *call_rcu_thread(void *opaque)
             n = qatomic_read(&rcu_call_count);
         }
 
+        /*
+         * Only process callbacks that were added before synchronize_rcu()
+         * starts.
+         */
+        batch = collect_callbacks(&n);
         qatomic_sub(&rcu_call_count, n);
-        synchronize_rcu();
-        qemu_mutex_lock_iothread();
-        while (n > 0) {
-            node = try_dequeue();
-            while (!node) {
-                qemu_mutex_unlock_iothread();
-                qemu_event_reset(&rcu_call_ready_event);
-                node = try_dequeue();
-                if (!node) {
-                    qemu_event_wait(&rcu_call_ready_event);
-                    node = try_dequeue();
-                }
-                qemu_mutex_lock_iothread();
-            }
+        if (!batch) {
+            continue;
+        }
 
-            n--;
+        if (qatomic_read(&in_drain_call_rcu)) {
+            synchronize_rcu_expedited();
+        } else {
+            synchronize_rcu();
+        }
+        qemu_mutex_lock_iothread();
+        while (batch) {
+            node = batch;
+            batch = node->next;
             node->func(node);
         }
         qemu_mutex_unlock_iothread();
+        rcu_account_callbacks(n);
     }
     abort();
 }
 
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
+    struct rcu_head *next;
+
     node->func = func;
-    enqueue(node);
+    if (rcu_reader.registered) {
+        /*
+         * Only the call_rcu thread competes for this list, so this is much
+         * cheaper than the global queue when many threads call call_rcu1().
+         */
+        do {
+            next = qatomic_read(&rcu_reader.callbacks);
+            node->next = next;
+        } while (qatomic_cmpxchg(&rcu_reader.callbacks, next, node) != next);
+    } else {
+        enqueue(node);
+    }
     qatomic_inc(&rcu_call_count);
     qemu_event_set(&rcu_call_ready_event);
 }
@@ -321,6 +454,7 @@ void drain_call_rcu(void)
 {
     struct rcu_drain rcu_drain;
     bool locked = qemu_mutex_iothread_locked();
+    int64_t t0;
 
     memset(&rcu_drain, 0, sizeof(struct rcu_drain));
     qemu_event_init(&rcu_drain.drain_complete_event, false);
@@ -331,20 +465,24 @@ void drain_call_rcu(void)
 
 
     /*
-     * RCU callbacks are invoked in the same order as in which they
-     * are registered, thus we can be sure that when 'drain_rcu_callback'
+     * The callbacks of each thread, whether on its own list or on the
+     * global queue, are invoked in the same order as in which they are
+     * registered, thus we can be sure that when 'drain_rcu_callback'
      * is called, all RCU callbacks that were registered on this thread
      * prior to calling this function are completed.
      *
-     * Note that since we have only one global queue of the RCU callbacks,
-     * we also end up waiting for most of RCU callbacks that were registered
-     * on the other threads, but this is a side effect that shoudn't be
-     * assumed.
+     * The call_rcu thread collects the global queue and every thread's
+     * list at once, so we usually end up waiting for the callbacks that
+     * other threads registered before us as well; this is a side effect
+     * that shouldn't be assumed.  While we wait, the call_rcu thread does
+     * not delay the batch and uses an expedited grace period.
      */
 
     qatomic_inc(&in_drain_call_rcu);
     call_rcu1(&rcu_drain.rcu, drain_rcu_callback);
+    t0 = qsp_wait_begin();
     qemu_event_wait(&rcu_drain.drain_complete_event);
+    qsp_wait_end(&in_drain_call_rcu, QSP_RCU, __FILE__, __LINE__, t0);
     qatomic_dec(&in_drain_call_rcu);
 
     if (locked) {
@@ -358,14 +496,28 @@ void rcu_register_thread(void)
     assert(rcu_reader.ctr == 0);
     qemu_mutex_lock(&rcu_registry_lock);
     QLIST_INSERT_HEAD(&registry, &rcu_reader, node);
+    rcu_reader.registered = true;
     qemu_mutex_unlock(&rcu_registry_lock);
 }
 
 void rcu_unregister_thread(void)
 {
+    struct rcu_head *list, *fifo, *node;
+    int n = 0;
+
     qemu_mutex_lock(&rcu_registry_lock);
     QLIST_REMOVE(&rcu_reader, node);
+    rcu_reader.registered = false;
+    list = qatomic_xchg(&rcu_reader.callbacks, NULL);
     qemu_mutex_unlock(&rcu_registry_lock);
+
+    /* The call_rcu thread cannot see our list anymore, hand it over */
+    append_reversed(&fifo, list, &n);
+    while (fifo) {
+        node = fifo;
+        fifo = node->next;
+        enqueue(node);
+    }
 }
 
 void rcu_add_force_rcu_notifier(Notifier *n)
@@ -388,6 +540,7 @@ static void rcu_init_complete(void)
 
     qemu_mutex_init(&rcu_registry_lock);
     qemu_mutex_init(&rcu_sync_lock);
+    qemu_mutex_init(&rcu_stats_lock);
     qemu_event_init(&rcu_gp_event, true);
 
     qemu_event_init(&rcu_call_ready_event, false);
@@ -19,6 +19,13 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+/*
+ * MEMBARRIER_CMD_SHARED waits for an RCU grace period of the kernel,
+ * while the private expedited command only interrupts the CPUs that run
+ * our threads.
+ */
+static bool membarrier_expedited;
 #endif
 
 void smp_mb_global(void)
@@ -32,6 +39,17 @@ void smp_mb_global(void)
 #endif
 }
 
+void smp_mb_global_expedited(void)
+{
+#ifdef CONFIG_LINUX
+    if (membarrier_expedited) {
+        membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        return;
+    }
+#endif
+    smp_mb_global();
+}
+
 void smp_mb_global_init(void)
 {
 #ifdef CONFIG_LINUX
@@ -46,5 +64,9 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+    if ((ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        membarrier_expedited = true;
+    }
 #endif
 }
@@ -18,12 +18,31 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/bitmap.h"
+#include "qapi/error.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
 
 static void do_spawn_thread(ThreadPool *pool);
 
+/*
+ * All pools, so that idle workers can pick up requests that are still queued
+ * in another pool because all of its workers are busy.  Lock order is
+ * thread_pools_lock, then pool->lock.
+ */
+static QemuMutex thread_pools_lock;
+static QLIST_HEAD(, ThreadPool) thread_pools =
+    QLIST_HEAD_INITIALIZER(thread_pools);
+
+/* Number of requests queued in any pool, read without thread_pools_lock */
+static int thread_pools_queued;
+
+static void __attribute__((__constructor__)) thread_pools_init(void)
+{
+    qemu_mutex_init(&thread_pools_lock);
+}
+
 typedef struct ThreadPoolElement ThreadPoolElement;
 
 enum ThreadState {
@@ -48,6 +67,12 @@ struct ThreadPoolElement {
     /* Access to this list is protected by lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
+    /*
+     * Completed requests are pushed onto pool->done_list by the thread that
+     * ran them, without taking any lock.
+     */
+    QSLIST_ENTRY(ThreadPoolElement) done;
+
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
@@ -61,8 +86,12 @@ struct ThreadPool {
     int max_threads;
     QEMUBH *new_thread_bh;
 
+    /* Requests that completed since the last run of completion_bh */
+    QSLIST_HEAD(, ThreadPoolElement) done_list;
+
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    QSLIST_HEAD(, ThreadPoolElement) completed;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
@@ -71,13 +100,107 @@ struct ThreadPool {
     int new_threads;     /* backlog of threads we need to create */
     int pending_threads; /* threads created but not running yet */
     bool stopping;
+    unsigned long *cpus; /* host CPUs for new workers, NULL if inherited */
+
+    /* Protected by thread_pools_lock */
+    QLIST_ENTRY(ThreadPool) next;
 };
 
+/* Called with pool->lock held */
+static ThreadPoolElement *thread_pool_dequeue(ThreadPool *pool)
+{
+    ThreadPoolElement *req = QTAILQ_FIRST(&pool->request_list);
+
+    QTAILQ_REMOVE(&pool->request_list, req, reqs);
+    qatomic_dec(&thread_pools_queued);
+    return req;
+}
+
+/* Hands a completed or cancelled request back to the AioContext of its pool */
+static void thread_pool_complete(ThreadPoolElement *req, int ret)
+{
+    ThreadPool *pool = req->pool;
+
+    req->ret = ret;
+    /* Write ret before state.  */
+    smp_wmb();
+    req->state = THREAD_DONE;
+
+    QSLIST_INSERT_HEAD_ATOMIC(&pool->done_list, req, done);
+    qemu_bh_schedule(pool->completion_bh);
+}
+
+/*
+ * Takes a request from a pool other than @self whose workers are all busy
+ * and runs it.  Returns false if there was nothing to take.
+ */
+static bool thread_pool_steal(ThreadPool *self)
+{
+    ThreadPool *pool;
+    ThreadPoolElement *req = NULL;
+
+    if (!qatomic_read(&thread_pools_queued)) {
+        return false;
+    }
+
+    qemu_mutex_lock(&thread_pools_lock);
+    QLIST_FOREACH(pool, &thread_pools, next) {
+        if (pool == self) {
+            continue;
+        }
+
+        qemu_mutex_lock(&pool->lock);
+        /* As in thread_pool_cancel(), taking the semaphore claims a request */
+        if (!pool->idle_threads && !QTAILQ_EMPTY(&pool->request_list) &&
+            qemu_sem_timedwait(&pool->sem, 0) == 0) {
+            req = thread_pool_dequeue(pool);
+            req->state = THREAD_ACTIVE;
+        }
+        qemu_mutex_unlock(&pool->lock);
+
+        if (req) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&thread_pools_lock);
+
+    if (!req) {
+        return false;
+    }
+
+    trace_thread_pool_steal(self, req->pool, req);
+    thread_pool_complete(req, req->func(req->arg));
+    return true;
+}
+
+static void thread_pool_set_worker_affinity(ThreadPool *pool)
+{
+#ifdef CONFIG_LINUX
+    cpu_set_t cpus;
+    unsigned long cpu;
+
+    if (!pool->cpus) {
+        return;
+    }
+
+    CPU_ZERO(&cpus);
+    for (cpu = find_first_bit(pool->cpus, THREAD_POOL_MAX_CPUS);
+         cpu < THREAD_POOL_MAX_CPUS;
+         cpu = find_next_bit(pool->cpus, THREAD_POOL_MAX_CPUS, cpu + 1)) {
+        CPU_SET(cpu, &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+        trace_thread_pool_set_affinity_failed(pool, errno);
+    }
+#endif
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
 
     qemu_mutex_lock(&pool->lock);
+    thread_pool_set_worker_affinity(pool);
     pool->pending_threads--;
     do_spawn_thread(pool);
 
@@ -88,7 +211,14 @@ static void *worker_thread(void *opaque)
         do {
             pool->idle_threads++;
             qemu_mutex_unlock(&pool->lock);
-            ret = qemu_sem_timedwait(&pool->sem, 10000);
+            ret = qemu_sem_timedwait(&pool->sem, 0);
+            while (ret == -1 && thread_pool_steal(pool)) {
+                /* Requests of our own pool still come first */
+                ret = qemu_sem_timedwait(&pool->sem, 0);
+            }
+            if (ret == -1) {
+                ret = qemu_sem_timedwait(&pool->sem, 10000);
+            }
             qemu_mutex_lock(&pool->lock);
             pool->idle_threads--;
         } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
@@ -96,21 +226,13 @@ static void *worker_thread(void *opaque)
             break;
         }
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
+        req = thread_pool_dequeue(pool);
         req->state = THREAD_ACTIVE;
         qemu_mutex_unlock(&pool->lock);
 
-        ret = req->func(req->arg);
-
-        req->ret = ret;
-        /* Write ret before state.  */
-        smp_wmb();
-        req->state = THREAD_DONE;
+        thread_pool_complete(req, req->func(req->arg));
 
         qemu_mutex_lock(&pool->lock);
-
-        qemu_bh_schedule(pool->completion_bh);
     }
 
     pool->cur_threads--;
@@ -162,14 +284,27 @@ static void spawn_thread(ThreadPool *pool)
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     aio_context_acquire(pool->ctx);
 restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
+    /*
+     * Collect what completed since the last batch, oldest first.  Leftovers
+     * are kept in pool->completed because a callback may call aio_poll(),
+     * which runs us recursively.
+     */
+    if (QSLIST_EMPTY(&pool->completed)) {
+        QSLIST_HEAD(, ThreadPoolElement) done;
+
+        QSLIST_MOVE_ATOMIC(&done, &pool->done_list);
+        while ((elem = QSLIST_FIRST(&done))) {
+            QSLIST_REMOVE_HEAD(&done, done);
+            QSLIST_INSERT_HEAD(&pool->completed, elem, done);
         }
+    }
+
+    while ((elem = QSLIST_FIRST(&pool->completed))) {
+        QSLIST_REMOVE_HEAD(&pool->completed, done);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -219,12 +354,9 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
-
-        elem->state = THREAD_DONE;
-        elem->ret = -ECANCELED;
+        qatomic_dec(&thread_pools_queued);
+        thread_pool_complete(elem, -ECANCELED);
     }
-
 }
 
 static AioContext *thread_pool_get_aio_context(BlockAIOCB *acb)
@@ -261,6 +393,7 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         spawn_thread(pool);
     }
     QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
+    qatomic_inc(&thread_pools_queued);
     qemu_mutex_unlock(&pool->lock);
     qemu_sem_post(&pool->sem);
     return &req->common;
@@ -309,8 +442,14 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->max_threads = 64;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
+    QSLIST_INIT(&pool->done_list);
     QLIST_INIT(&pool->head);
+    QSLIST_INIT(&pool->completed);
     QTAILQ_INIT(&pool->request_list);
+
+    qemu_mutex_lock(&thread_pools_lock);
+    QLIST_INSERT_HEAD(&thread_pools, pool, next);
+    qemu_mutex_unlock(&thread_pools_lock);
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -328,6 +467,10 @@ void thread_pool_free(ThreadPool *pool)
 
     assert(QLIST_EMPTY(&pool->head));
 
+    qemu_mutex_lock(&thread_pools_lock);
+    QLIST_REMOVE(pool, next);
+    qemu_mutex_unlock(&thread_pools_lock);
+
     qemu_mutex_lock(&pool->lock);
 
     /* Stop new threads from spawning */
@@ -348,5 +491,21 @@ void thread_pool_free(ThreadPool *pool)
     qemu_sem_destroy(&pool->sem);
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);
+    g_free(pool->cpus);
     g_free(pool);
 }
+
+void thread_pool_set_cpus(ThreadPool *pool, const unsigned long *cpus,
+                          Error **errp)
+{
+#ifdef CONFIG_LINUX
+    QEMU_LOCK_GUARD(&pool->lock);
+    if (!pool->cpus) {
+        pool->cpus = bitmap_new(THREAD_POOL_MAX_CPUS);
+    }
+    bitmap_copy(pool->cpus, cpus, THREAD_POOL_MAX_CPUS);
+#else
+    error_setg(errp, "Setting the CPU affinity of worker threads is not "
+               "supported on this host");
+#endif
+}
@@ -444,12 +444,43 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
-/* do the accounting for this operation
+/*
+ * return whether the next operation of this type would have to wait,
+ * without arming any timer and without leaking the buckets
  *
  * @is_write: the type of operation (read/write)
- * @size:     the size of the operation
+ * @ret:      true if the operation would be throttled
  */
-void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+bool throttle_would_wait(ThrottleState *ts, bool is_write)
+{
+    return throttle_compute_wait_for(ts, is_write) > 0;
+}
+
+/*
+ * compute how many operations an I/O request counts as
+ *
+ * @op_size: the iops-size setting, or 0 if there is none
+ * @size:    the size of the request
+ * @ret:     the number of operations to account
+ */
+double throttle_op_units(uint64_t op_size, uint64_t size)
+{
+    /* if op_size is defined and smaller than size we compute unit count */
+    if (op_size && size > op_size) {
+        return (double) size / op_size;
+    }
+    return 1.0;
+}
+
+/*
+ * add (or, if negative, remove) operations and bytes to the buckets
+ *
+ * @is_write: the type of operation (read/write)
+ * @units:    the number of operations, see throttle_op_units()
+ * @size:     the number of bytes
+ */
+void throttle_account_units(ThrottleState *ts, bool is_write,
+                            double units, double size)
 {
     const BucketType bucket_types_size[2][2] = {
         { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
@@ -459,31 +490,37 @@ void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
     };
-    double units = 1.0;
     unsigned i;
 
-    /* if cfg.op_size is defined and smaller than size we compute unit count */
-    if (ts->cfg.op_size && size > ts->cfg.op_size) {
-        units = (double) size / ts->cfg.op_size;
-    }
-
     for (i = 0; i < 2; i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[is_write][i]];
-        bkt->level += size;
+        bkt->level = MAX(bkt->level + size, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+            bkt->burst_level = MAX(bkt->burst_level + size, 0);
         }
 
         bkt = &ts->cfg.buckets[bucket_types_units[is_write][i]];
-        bkt->level += units;
+        bkt->level = MAX(bkt->level + units, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+            bkt->burst_level = MAX(bkt->burst_level + units, 0);
         }
     }
 }
 
+/*
+ * do the accounting for this operation
+ *
+ * @is_write: the type of operation (read/write)
+ * @size:     the size of the operation
+ */
+void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+{
+    throttle_account_units(ts, is_write,
+                           throttle_op_units(ts->cfg.op_size, size), size);
+}
+
 /* return a ThrottleConfig based on the options in a ThrottleLimits
  *
  * @arg:    the ThrottleLimits object to read from
@@ -23,10 +23,9 @@
 #include "qemu/event_notifier.h"
 #include "qemu/vfio-helpers.h"
 #include "qemu/lockable.h"
+#include "qemu/iova-tree.h"
 #include "trace.h"
 
-#define QEMU_VFIO_DEBUG 0
-
 #define QEMU_VFIO_IOVA_MIN 0x10000ULL
 /* XXX: Once VFIO exposes the iova bit width in the IOMMU capability interface,
  * we can use a runtime limit; alternatively it's also possible to do platform
@@ -34,13 +33,6 @@
  **/
 #define QEMU_VFIO_IOVA_MAX (1ULL << 39)
 
-typedef struct {
-    /* Page aligned addr. */
-    void *host;
-    size_t size;
-    uint64_t iova;
-} IOVAMapping;
-
 struct IOVARange {
     uint64_t start;
     uint64_t end;
@@ -96,8 +88,13 @@ struct QEMUVFIOState {
      **/
     uint64_t low_water_mark;
     uint64_t high_water_mark;
-    IOVAMapping *mappings;
-    int nr_mappings;
+
+    /*
+     * The fixed mappings, keyed by host address: for each of them, @iova of
+     * the DMAMap is the (page aligned) host address and @translated_addr is
+     * the IOVA that it is mapped to.
+     */
+    IOVATree *mappings;
 };
 
 /**
@@ -492,6 +489,7 @@ static void qemu_vfio_open_common(QEMUVFIOState *s)
     s->ram_notifier.ram_block_removed = qemu_vfio_ram_block_removed;
     s->low_water_mark = QEMU_VFIO_IOVA_MIN;
     s->high_water_mark = QEMU_VFIO_IOVA_MAX;
+    s->mappings = iova_tree_new();
     ram_block_notifier_add(&s->ram_notifier);
 }
 
@@ -524,88 +522,50 @@ QEMUVFIOState *qemu_vfio_open_pci(const char *device, Error **errp)
     return s;
 }
 
+static gboolean qemu_vfio_dump_mapping(DMAMap *map)
+{
+    trace_qemu_vfio_dump_mapping((void *)(uintptr_t)map->iova,
+                                 map->translated_addr, map->size + 1);
+    return false;
+}
+
 static void qemu_vfio_dump_mappings(QEMUVFIOState *s)
 {
-    for (int i = 0; i < s->nr_mappings; ++i) {
-        trace_qemu_vfio_dump_mapping(s->mappings[i].host,
-                                     s->mappings[i].iova,
-                                     s->mappings[i].size);
+    /* Walking the whole tree is only worth it if someone is looking */
+    if (trace_event_get_state_backends(TRACE_QEMU_VFIO_DUMP_MAPPING)) {
+        iova_tree_foreach(s->mappings, qemu_vfio_dump_mapping);
     }
 }
 
-/**
- * Find the mapping entry that contains [host, host + size) and set @index to
- * the position. If no entry contains it, @index is the position _after_ which
- * to insert the new mapping. IOW, it is the index of the largest element that
- * is smaller than @host, or -1 if no entry is.
- */
-static IOVAMapping *qemu_vfio_find_mapping(QEMUVFIOState *s, void *host,
-                                           int *index)
+/* Find the mapping entry that contains @host, if any. */
+static const DMAMap *qemu_vfio_find_mapping(QEMUVFIOState *s, void *host)
 {
-    IOVAMapping *p = s->mappings;
-    IOVAMapping *q = p ? p + s->nr_mappings - 1 : NULL;
-    IOVAMapping *mid;
     trace_qemu_vfio_find_mapping(s, host);
-    if (!p) {
-        *index = -1;
-        return NULL;
-    }
-    while (true) {
-        mid = p + (q - p) / 2;
-        if (mid == p) {
-            break;
-        }
-        if (mid->host > host) {
-            q = mid;
-        } else if (mid->host < host) {
-            p = mid;
-        } else {
-            break;
-        }
-    }
-    if (mid->host > host) {
-        mid--;
-    } else if (mid < &s->mappings[s->nr_mappings - 1]
-               && (mid + 1)->host <= host) {
-        mid++;
-    }
-    *index = mid - &s->mappings[0];
-    if (mid >= &s->mappings[0] &&
-        mid->host <= host && mid->host + mid->size > host) {
-        assert(mid < &s->mappings[s->nr_mappings]);
-        return mid;
-    }
-    /* At this point *index + 1 is the right position to insert the new
-     * mapping.*/
-    return NULL;
+    return iova_tree_find_address(s->mappings, (uintptr_t)host);
 }
 
 /**
- * Allocate IOVA and create a new mapping record and insert it in @s.
+ * Create a new mapping record for [host, host + size) at @iova and insert it
+ * in @s.  The area must not overlap with any existing mapping.
  */
-static IOVAMapping *qemu_vfio_add_mapping(QEMUVFIOState *s,
-                                          void *host, size_t size,
-                                          int index, uint64_t iova)
+static void qemu_vfio_add_mapping(QEMUVFIOState *s, void *host, size_t size,
+                                  uint64_t iova)
 {
-    int shift;
-    IOVAMapping m = {.host = host, .size = size, .iova = iova};
-    IOVAMapping *insert;
+    DMAMap m = {
+        .iova = (uintptr_t)host,
+        .translated_addr = iova,
+        .size = size - 1,
+        .perm = IOMMU_RW,
+    };
+    int ret;
 
     assert(QEMU_IS_ALIGNED(size, qemu_real_host_page_size));
     assert(QEMU_IS_ALIGNED(s->low_water_mark, qemu_real_host_page_size));
     assert(QEMU_IS_ALIGNED(s->high_water_mark, qemu_real_host_page_size));
-    trace_qemu_vfio_new_mapping(s, host, size, index, iova);
-
-    assert(index >= 0);
-    s->nr_mappings++;
-    s->mappings = g_renew(IOVAMapping, s->mappings, s->nr_mappings);
-    insert = &s->mappings[index];
-    shift = s->nr_mappings - index - 1;
-    if (shift) {
-        memmove(insert + 1, insert, shift * sizeof(s->mappings[0]));
-    }
-    *insert = m;
-    return insert;
+    trace_qemu_vfio_new_mapping(s, host, size, iova);
+
+    ret = iova_tree_insert(s->mappings, &m);
+    assert(ret == IOVA_OK);
 }
 
 /* Do the DMA mapping with VFIO. */
@@ -629,52 +589,25 @@ static int qemu_vfio_do_mapping(QEMUVFIOState *s, void *host, size_t size,
 }
 
 /**
- * Undo the DMA mapping from @s with VFIO, and remove from mapping list.
+ * Undo the DMA mapping @mapping with VFIO, and remove it from the mapping tree.
  */
-static void qemu_vfio_undo_mapping(QEMUVFIOState *s, IOVAMapping *mapping,
+static void qemu_vfio_undo_mapping(QEMUVFIOState *s, const DMAMap *mapping,
                                    Error **errp)
 {
-    int index;
+    DMAMap m = *mapping;
     struct vfio_iommu_type1_dma_unmap unmap = {
         .argsz = sizeof(unmap),
         .flags = 0,
-        .iova = mapping->iova,
-        .size = mapping->size,
+        .iova = m.translated_addr,
+        .size = m.size + 1,
     };
 
-    index = mapping - s->mappings;
-    assert(mapping->size > 0);
-    assert(QEMU_IS_ALIGNED(mapping->size, qemu_real_host_page_size));
-    assert(index >= 0 && index < s->nr_mappings);
+    assert(QEMU_IS_ALIGNED(m.size + 1, qemu_real_host_page_size));
     if (ioctl(s->container, VFIO_IOMMU_UNMAP_DMA, &unmap)) {
         error_setg_errno(errp, errno, "VFIO_UNMAP_DMA failed");
     }
-    memmove(mapping, &s->mappings[index + 1],
-            sizeof(s->mappings[0]) * (s->nr_mappings - index - 1));
-    s->nr_mappings--;
-    s->mappings = g_renew(IOVAMapping, s->mappings, s->nr_mappings);
-}
-
-/* Check if the mapping list is (ascending) ordered. */
-static bool qemu_vfio_verify_mappings(QEMUVFIOState *s)
-{
-    int i;
-    if (QEMU_VFIO_DEBUG) {
-        for (i = 0; i < s->nr_mappings - 1; ++i) {
-            if (!(s->mappings[i].host < s->mappings[i + 1].host)) {
-                error_report("item %d not sorted!", i);
-                qemu_vfio_dump_mappings(s);
-                return false;
-            }
-            if (!(s->mappings[i].host + s->mappings[i].size <=
-                  s->mappings[i + 1].host)) {
-                error_report("item %d overlap with next!", i);
-                qemu_vfio_dump_mappings(s);
-                return false;
-            }
-        }
-    }
-    return true;
+    /* This frees *mapping */
+    iova_tree_remove(s->mappings, &m);
 }
 
 static bool qemu_vfio_find_fixed_iova(QEMUVFIOState *s, size_t size,
@@ -748,17 +681,16 @@ static bool qemu_vfio_water_mark_reached(QEMUVFIOState *s, size_t size,
 int qemu_vfio_dma_map(QEMUVFIOState *s, void *host, size_t size,
                       bool temporary, uint64_t *iova, Error **errp)
 {
-    int index;
-    IOVAMapping *mapping;
+    const DMAMap *mapping;
     uint64_t iova0;
 
     assert(QEMU_PTR_IS_ALIGNED(host, qemu_real_host_page_size));
     assert(QEMU_IS_ALIGNED(size, qemu_real_host_page_size));
     trace_qemu_vfio_dma_map(s, host, size, temporary, iova);
     QEMU_LOCK_GUARD(&s->lock);
-    mapping = qemu_vfio_find_mapping(s, host, &index);
+    mapping = qemu_vfio_find_mapping(s, host);
     if (mapping) {
-        iova0 = mapping->iova + ((uint8_t *)host - (uint8_t *)mapping->host);
+        iova0 = mapping->translated_addr + ((uintptr_t)host - mapping->iova);
     } else {
         int ret;
 
@@ -770,13 +702,11 @@ int qemu_vfio_dma_map(QEMUVFIOState *s, void *host, size_t size,
                 return -ENOMEM;
             }
 
-            mapping = qemu_vfio_add_mapping(s, host, size, index + 1, iova0);
-            assert(qemu_vfio_verify_mappings(s));
             ret = qemu_vfio_do_mapping(s, host, size, iova0, errp);
             if (ret < 0) {
-                qemu_vfio_undo_mapping(s, mapping, NULL);
                 return ret;
             }
+            qemu_vfio_add_mapping(s, host, size, iova0);
             qemu_vfio_dump_mappings(s);
         } else {
             if (!qemu_vfio_find_temp_iova(s, size, &iova0, errp)) {
@@ -818,8 +748,7 @@ int qemu_vfio_dma_reset_temporary(QEMUVFIOState *s)
  * qemu_vfio_dma_map(). */
 void qemu_vfio_dma_unmap(QEMUVFIOState *s, void *host)
 {
-    int index = 0;
-    IOVAMapping *m;
+    const DMAMap *m;
 
     if (!host) {
         return;
@@ -827,7 +756,7 @@ void qemu_vfio_dma_unmap(QEMUVFIOState *s, void *host)
 
     trace_qemu_vfio_dma_unmap(s, host);
     QEMU_LOCK_GUARD(&s->lock);
-    m = qemu_vfio_find_mapping(s, host, &index);
+    m = qemu_vfio_find_mapping(s, host);
     if (!m) {
         return;
     }
@@ -842,14 +771,16 @@ static void qemu_vfio_reset(QEMUVFIOState *s)
 /* Close and free the VFIO resources. */
 void qemu_vfio_close(QEMUVFIOState *s)
 {
-    int i;
+    const DMAMap all = { .iova = 0, .size = HWADDR_MAX };
+    const DMAMap *m;
 
     if (!s) {
         return;
     }
-    for (i = 0; i < s->nr_mappings; ++i) {
-        qemu_vfio_undo_mapping(s, &s->mappings[i], NULL);
+    while ((m = iova_tree_find(s->mappings, &all))) {
+        qemu_vfio_undo_mapping(s, m, NULL);
     }
+    iova_tree_destroy(s->mappings);
     ram_block_notifier_remove(&s->ram_notifier);
     g_free(s->usable_iova_ranges);
     s->nb_iova_ranges = 0;
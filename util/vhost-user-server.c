@@ -217,6 +217,64 @@ static void kick_handler(void *opaque)
     }
 }
 
+/*
+ * libvhost-user only watches kick fds, and passes the virtqueue index as
+ * pvt.  This lets the AioContext busy-poll the vrings: while polling, guest
+ * notifications are disabled and new requests are picked up directly from
+ * the avail ring, without an eventfd round trip.
+ */
+static VuVirtq *vu_fd_watch_get_queue(VuFdWatch *vu_fd_watch)
+{
+    return vu_get_queue(vu_fd_watch->vu_dev, (intptr_t)vu_fd_watch->pvt);
+}
+
+static bool kick_poll(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+    VuVirtq *vq = vu_fd_watch_get_queue(vu_fd_watch);
+
+    if (vu_dev->broken || !vu_queue_started(vu_dev, vq)) {
+        return false;
+    }
+
+    return !vu_queue_empty(vu_dev, vq);
+}
+
+static void kick_poll_ready(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuVirtq *vq = vu_fd_watch_get_queue(vu_fd_watch);
+
+    /* There may be no kick to read from the eventfd, call the handler */
+    if (vq->handler) {
+        vq->handler(vu_fd_watch->vu_dev, (intptr_t)vu_fd_watch->pvt);
+    }
+}
+
+static void kick_poll_begin(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+
+    vu_queue_set_notification(vu_fd_watch->vu_dev,
+                              vu_fd_watch_get_queue(vu_fd_watch), 0);
+}
+
+static void kick_poll_end(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+
+    vu_queue_set_notification(vu_fd_watch->vu_dev,
+                              vu_fd_watch_get_queue(vu_fd_watch), 1);
+}
+
+static void vu_fd_watch_attach(AioContext *ctx, VuFdWatch *vu_fd_watch)
+{
+    aio_set_fd_handler(ctx, vu_fd_watch->fd, true, kick_handler, NULL,
+                       kick_poll, kick_poll_ready, vu_fd_watch);
+    aio_set_fd_poll(ctx, vu_fd_watch->fd, kick_poll_begin, kick_poll_end);
+}
+
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
 {
 
@@ -249,10 +307,9 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
         qemu_set_nonblock(fd);
-        aio_set_fd_handler(server->ioc->ctx, fd, true, kick_handler,
-                           NULL, NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        vu_fd_watch_attach(server->ioc->ctx, vu_fd_watch);
     }
 }
 
@@ -377,8 +434,7 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
     qio_channel_attach_aio_context(server->ioc, ctx);
 
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, true, kick_handler, NULL,
-                           NULL, NULL, vu_fd_watch);
+        vu_fd_watch_attach(ctx, vu_fd_watch);
     }
 
     aio_co_schedule(ctx, server->co_trip);